@@ -36,6 +36,7 @@ namespace Demo
         private void MainForm_FormClosing(object sender, FormClosingEventArgs e)
         {
             thrashOldCamera();
+            CameraService.Dispose();
         }
 
         private void btnStop_Click(object sender, EventArgs e)
@@ -95,7 +96,8 @@ namespace Demo
 
         public void OnImageCaptured(Touchless.Vision.Contracts.IFrameSource frameSource, Touchless.Vision.Contracts.Frame frame, double fps)
         {
-            _latestFrame = frame.Image;
+            // The frame and its images are disposed once this handler returns
+            _latestFrame = new Bitmap(frame.OriginalImage);
             pictureBoxDisplay.Invalidate();
         }
 
@@ -115,7 +117,8 @@ namespace Demo
             if (_frameSource != null)
             {
                 _frameSource.NewFrame -= OnImageCaptured;
-                _frameSource.Camera.Dispose();
+                // The camera stays in the list to be started again; CameraService disposes it on closing
+                _frameSource.StopFrameCapture();
                 setFrameSource(null);
                 pictureBoxDisplay.Paint -= new PaintEventHandler(drawLatestImage);
             }
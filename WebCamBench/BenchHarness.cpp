@@ -0,0 +1,233 @@
+//*****************************************************************************************
+//  File:       BenchHarness.cpp
+//  Project:    WebCamBench
+//
+//  Defines the clock, sample summaries and table output shared by the benchmarks
+//*****************************************************************************************
+
+#include <algorithm>
+#include <windows.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "BenchHarness.h"
+
+using namespace WebCamBench;
+
+// The scene's moving square, and how far it travels between frames
+#define BENCH_SCENE_SQUARE		96
+#define BENCH_SCENE_SPEED		6
+
+LONGLONG BenchClock::Now()
+{
+	LARGE_INTEGER liNow;
+	QueryPerformanceCounter(&liNow);
+
+	return liNow.QuadPart;
+}
+
+double BenchClock::ToMicroseconds(LONGLONG llTicks)
+{
+	return static_cast<double>(llTicks) * 1000000.0 / static_cast<double>(GetFrequency());
+}
+
+double BenchClock::ToSeconds(LONGLONG llTicks)
+{
+	return static_cast<double>(llTicks) / static_cast<double>(GetFrequency());
+}
+
+LONGLONG BenchClock::FromSeconds(double dSeconds)
+{
+	return static_cast<LONGLONG>(dSeconds * static_cast<double>(GetFrequency()));
+}
+
+LONGLONG BenchClock::GetFrequency()
+{
+	// Fixed at boot, so reading it once is enough
+	static LONGLONG s_llFrequency = 0;
+
+	if (s_llFrequency == 0)
+	{
+		LARGE_INTEGER liFrequency;
+		QueryPerformanceFrequency(&liFrequency);
+		s_llFrequency = liFrequency.QuadPart;
+	}
+
+	return s_llFrequency;
+}
+
+double BenchSamples::GetMean() const
+{
+	if (m_aValues.empty())
+		return 0.0;
+
+	double dSum = 0.0;
+	for (size_t n = 0; n < m_aValues.size(); n++)
+	{
+		dSum += m_aValues[n];
+	}
+
+	return dSum / static_cast<double>(m_aValues.size());
+}
+
+double BenchSamples::GetPercentile(double dFraction) const
+{
+	if (m_aValues.empty())
+		return 0.0;
+
+	std::vector<double> aSorted(m_aValues);
+
+	size_t nIndex = static_cast<size_t>(dFraction * static_cast<double>(aSorted.size() - 1) + 0.5);
+	nIndex = min(nIndex, aSorted.size() - 1);
+
+	std::nth_element(aSorted.begin(), aSorted.begin() + nIndex, aSorted.end());
+
+	return aSorted[nIndex];
+}
+
+BenchPsnr::BenchPsnr()
+{
+	Clear();
+}
+
+void BenchPsnr::Add(const BYTE* pReference, const BYTE* pSamples, int nCount)
+{
+	double dSquaredError = 0.0;
+
+	for (int n = 0; n < nCount; n++)
+	{
+		int nError = static_cast<int>(pSamples[n]) - pReference[n];
+		dSquaredError += nError * nError;
+	}
+
+	m_dSquaredError += dSquaredError;
+	m_dCount += nCount;
+}
+
+void BenchPsnr::Clear()
+{
+	m_dSquaredError = 0.0;
+	m_dCount = 0.0;
+}
+
+double BenchPsnr::GetDecibels() const
+{
+	if (m_dCount == 0.0 || m_dSquaredError == 0.0)
+		return 99.0;
+
+	double dMeanSquaredError = m_dSquaredError / m_dCount;
+
+	return min(10.0 * log10(255.0 * 255.0 / dMeanSquaredError), 99.0);
+}
+
+BenchRandom::BenchRandom(ULONG nSeed)
+{
+	m_ullState = nSeed;
+	m_dSpare = 0.0;
+	m_bHasSpare = false;
+}
+
+double BenchRandom::NextUniform()
+{
+	// Knuth's MMIX constants; the top 53 bits make the double
+	m_ullState = m_ullState * 6364136223846793005ULL + 1442695040888963407ULL;
+
+	return static_cast<double>(m_ullState >> 11) / 9007199254740992.0;
+}
+
+double BenchRandom::NextGaussian(double dSigma)
+{
+	if (m_bHasSpare)
+	{
+		m_bHasSpare = false;
+		return m_dSpare * dSigma;
+	}
+
+	// Marsaglia's polar method gives two at a time
+	double dU;
+	double dV;
+	double dS;
+
+	do
+	{
+		dU = 2.0 * NextUniform() - 1.0;
+		dV = 2.0 * NextUniform() - 1.0;
+		dS = dU * dU + dV * dV;
+	}
+	while (dS >= 1.0 || dS == 0.0);
+
+	double dScale = sqrt(-2.0 * log(dS) / dS);
+
+	m_dSpare = dV * dScale;
+	m_bHasSpare = true;
+
+	return dU * dScale * dSigma;
+}
+
+void BenchRandom::AddNoise(BYTE* pSamples, int nCount, double dSigma)
+{
+	for (int n = 0; n < nCount; n++)
+	{
+		int nValue = pSamples[n] + static_cast<int>(floor(NextGaussian(dSigma) + 0.5));
+		pSamples[n] = static_cast<BYTE>(max(0, min(nValue, 255)));
+	}
+}
+
+BenchScene::BenchScene(int nWidth, int nHeight)
+{
+	m_nWidth = nWidth;
+	m_nHeight = nHeight;
+	m_nSquareX = 0;
+	m_nSquareY = 0;
+	m_aPixels.resize(static_cast<size_t>(nWidth) * 3 * nHeight);
+
+	Render(0);
+}
+
+int BenchScene::GetSquareSize()
+{
+	return BENCH_SCENE_SQUARE;
+}
+
+void BenchScene::Render(int nFrame)
+{
+	int nTravel = max(m_nWidth - BENCH_SCENE_SQUARE, 1);
+	int nPosition = (nFrame * BENCH_SCENE_SPEED) % (2 * nTravel);
+	m_nSquareX = nPosition < nTravel ? nPosition : 2 * nTravel - nPosition;
+	m_nSquareY = max(m_nHeight - BENCH_SCENE_SQUARE, 0) / 2;
+
+	for (int y = 0; y < m_nHeight; y++)
+	{
+		BYTE* pPixel = &m_aPixels[static_cast<size_t>(y) * GetRowBytes()];
+		bool bSquareRow = y >= m_nSquareY && y < m_nSquareY + BENCH_SCENE_SQUARE;
+
+		for (int x = 0; x < m_nWidth; x++, pPixel += 3)
+		{
+			if (bSquareRow && x >= m_nSquareX && x < m_nSquareX + BENCH_SCENE_SQUARE)
+			{
+				pPixel[0] = 40;
+				pPixel[1] = 200;
+				pPixel[2] = 220;
+				continue;
+			}
+
+			int nChecker = ((x / 32) + (y / 32)) % 2 != 0 ? 30 : -30;
+
+			pPixel[0] = static_cast<BYTE>(max(0, min(48 + x * 160 / m_nWidth + nChecker, 255)));
+			pPixel[1] = static_cast<BYTE>(max(0, min(48 + y * 160 / m_nHeight + nChecker, 255)));
+			pPixel[2] = static_cast<BYTE>(128 + nChecker);
+		}
+	}
+}
+
+void WebCamBench::PrintBenchHeader(const char* szTitle, const char* const* aszColumns, size_t nColumns)
+{
+	printf("\n%s\n", szTitle);
+
+	for (size_t n = 0; n < nColumns; n++)
+	{
+		printf("%10s", aszColumns[n]);
+	}
+
+	printf("\n");
+}
@@ -0,0 +1,190 @@
+//*****************************************************************************************
+//  File:       BenchHarness.h
+//  Project:    WebCamBench
+//
+//  Declares the clock, sample summaries and table output shared by the benchmarks
+//*****************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <vector>
+
+namespace WebCamBench
+{
+	/// <summary>
+	/// The performance counter, which is also what frames are timestamped with on arrival
+	/// </summary>
+	class BenchClock
+	{
+	public:
+		static LONGLONG Now();
+
+		static double ToMicroseconds(LONGLONG llTicks);
+
+		static double ToSeconds(LONGLONG llTicks);
+
+		static LONGLONG FromSeconds(double dSeconds);
+
+	private:
+		static LONGLONG GetFrequency();
+	};
+
+	/// <summary>
+	/// Every measurement of one quantity in a run, summarised once the run is over
+	/// </summary>
+	class BenchSamples
+	{
+	public:
+		void Add(double dValue)
+		{
+			m_aValues.push_back(dValue);
+		}
+
+		void Add(const BenchSamples& samples)
+		{
+			m_aValues.insert(m_aValues.end(), samples.m_aValues.begin(), samples.m_aValues.end());
+		}
+
+		void Clear()
+		{
+			m_aValues.clear();
+		}
+
+		int GetCount() const
+		{
+			return static_cast<int>(m_aValues.size());
+		}
+
+		/// <summary>
+		/// Zero when there are no samples
+		/// </summary>
+		double GetMean() const;
+
+		/// <summary>
+		/// Value below which dFraction of the samples fall, 0.5 for the median; zero when there are none
+		/// </summary>
+		double GetPercentile(double dFraction) const;
+
+	private:
+		std::vector<double> m_aValues;
+	};
+
+	/// <summary>
+	/// Peak signal to noise ratio of 8 bit samples against a reference, over as many spans as are added
+	/// </summary>
+	class BenchPsnr
+	{
+	public:
+		BenchPsnr();
+
+		void Add(const BYTE* pReference, const BYTE* pSamples, int nCount);
+
+		void Clear();
+
+		/// <summary>
+		/// In decibels; capped at 99 when the samples match the reference exactly
+		/// </summary>
+		double GetDecibels() const;
+
+	private:
+		double m_dSquaredError;
+		double m_dCount;
+	};
+
+	/// <summary>
+	/// Repeatable pseudo-random numbers for synthetic frames, so every run sees the same noise
+	/// </summary>
+	class BenchRandom
+	{
+	public:
+		explicit BenchRandom(ULONG nSeed);
+
+		/// <summary>
+		/// Uniform in [0, 1)
+		/// </summary>
+		double NextUniform();
+
+		/// <summary>
+		/// Normally distributed with a mean of zero and the given standard deviation
+		/// </summary>
+		double NextGaussian(double dSigma);
+
+		/// <summary>
+		/// Adds rounded gaussian noise to every sample, clamped to the 8 bit range
+		/// </summary>
+		void AddNoise(BYTE* pSamples, int nCount, double dSigma);
+
+	private:
+		ULONGLONG m_ullState;
+		double m_dSpare;
+		bool m_bHasSpare;
+	};
+
+	/// <summary>
+	/// Synthetic top-down RGB24 camera scene: gradients under a checkerboard, giving both flat areas
+	/// and edges, with a square bouncing across it from frame to frame
+	/// </summary>
+	class BenchScene
+	{
+	public:
+		BenchScene(int nWidth, int nHeight);
+
+		/// <summary>
+		/// Draws the scene as it is at frame nFrame
+		/// </summary>
+		void Render(int nFrame);
+
+		int GetWidth() const
+		{
+			return m_nWidth;
+		}
+
+		int GetHeight() const
+		{
+			return m_nHeight;
+		}
+
+		int GetRowBytes() const
+		{
+			return m_nWidth * 3;
+		}
+
+		int GetSize() const
+		{
+			return static_cast<int>(m_aPixels.size());
+		}
+
+		const BYTE* GetPixels() const
+		{
+			return &m_aPixels[0];
+		}
+
+		/// <summary>
+		/// Left column and top row of the square in the frame last rendered
+		/// </summary>
+		int GetSquareX() const
+		{
+			return m_nSquareX;
+		}
+
+		int GetSquareY() const
+		{
+			return m_nSquareY;
+		}
+
+		static int GetSquareSize();
+
+	private:
+		int m_nWidth;
+		int m_nHeight;
+		int m_nSquareX;
+		int m_nSquareY;
+		std::vector<BYTE> m_aPixels;
+	};
+
+	/// <summary>
+	/// Prints the title of a table and its column headings, each column 10 characters wide
+	/// </summary>
+	void PrintBenchHeader(const char* szTitle, const char* const* aszColumns, size_t nColumns);
+}
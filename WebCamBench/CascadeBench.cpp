@@ -0,0 +1,389 @@
+//*****************************************************************************************
+//  File:       CascadeBench.cpp
+//  Project:    WebCamBench
+//
+//  Defines the cascade object detector throughput benchmark
+//*****************************************************************************************
+
+#include <windows.h>
+#include <stdio.h>
+
+#include "WorkerPool.h"
+#include "CascadeScanner.h"
+
+#include "BenchHarness.h"
+#include "CascadeBench.h"
+
+using namespace WebCamLib;
+using namespace WebCamBench;
+
+#define CASCADE_BENCH_WIDTH				640
+#define CASCADE_BENCH_HEIGHT			480
+#define CASCADE_BENCH_FRAMES			8
+#define CASCADE_BENCH_NOISE				4.0
+#define CASCADE_BENCH_SEED				20140301
+
+// The window of OpenCV's frontal face cascades
+#define CASCADE_BENCH_WINDOW			24
+
+// Share of the windows reaching a stage which it passes, traincascade's default maxFalseAlarmRate
+#define CASCADE_BENCH_PASS_RATE			0.5
+
+// Halvings of the range a stage's threshold is searched in
+#define CASCADE_BENCH_THRESHOLD_STEPS	24
+
+// Haar stumps compare the contrast-normalised feature with a threshold this far either side of 0
+#define CASCADE_BENCH_HAAR_THRESHOLD	0.02
+
+struct CascadeBenchShape
+{
+	const char* szName;
+	CascadeFeatureType eType;
+	int nStages;
+	int nFirstStumps;		// in the first stage
+	double dGrowth;			// stumps added from one stage to the next
+	int nMaxStumps;
+};
+
+struct CascadeBenchStump
+{
+	int nFeature;
+	float fThreshold;
+	float fLeft;
+	float fRight;
+	int anSubset[8];
+};
+
+/// <summary>
+/// What a synthetic cascade is made of, so it can be loaded into a classifier again whenever a
+/// stage threshold changes
+/// </summary>
+struct CascadeBenchCascade
+{
+	std::vector<CascadeRect> aRects;		// three per Haar feature
+	std::vector<int> anCells;				// x, y, cell width and height per LBP feature
+	std::vector<int> anStageStumps;
+	std::vector<float> afStageThresholds;
+	std::vector<CascadeBenchStump> aStumps;
+};
+
+static int NextInt(BenchRandom& random, int nMinimum, int nMaximum)
+{
+	return nMinimum + min(static_cast<int>(random.NextUniform() * (nMaximum - nMinimum + 1)), nMaximum - nMinimum);
+}
+
+static float NextFloat(BenchRandom& random, double dMinimum, double dMaximum)
+{
+	return static_cast<float>(dMinimum + random.NextUniform() * (dMaximum - dMinimum));
+}
+
+static HRESULT LoadCascade(CascadeFeatureType eType, const CascadeBenchCascade& cascade, CascadeClassifier& classifier)
+{
+	HRESULT hr = classifier.Create(eType, CASCADE_BENCH_WINDOW, CASCADE_BENCH_WINDOW);
+
+	for (size_t n = 0; SUCCEEDED(hr) && n < cascade.aRects.size(); n += 3)
+	{
+		hr = classifier.AddHaarFeature(&cascade.aRects[n], 3);
+	}
+
+	for (size_t n = 0; SUCCEEDED(hr) && n < cascade.anCells.size(); n += 4)
+	{
+		hr = classifier.AddLbpFeature(cascade.anCells[n], cascade.anCells[n + 1], cascade.anCells[n + 2], cascade.anCells[n + 3]);
+	}
+
+	size_t nStump = 0;
+
+	for (size_t nStage = 0; SUCCEEDED(hr) && nStage < cascade.anStageStumps.size(); nStage++)
+	{
+		hr = classifier.AddStage(cascade.afStageThresholds[nStage]);
+
+		for (int n = 0; SUCCEEDED(hr) && n < cascade.anStageStumps[nStage]; n++)
+		{
+			const CascadeBenchStump& stump = cascade.aStumps[nStump++];
+
+			if (eType == CascadeFeatureType_Haar)
+			{
+				hr = classifier.AddHaarStump(stump.nFeature, stump.fThreshold, stump.fLeft, stump.fRight);
+			}
+			else
+			{
+				hr = classifier.AddLbpStump(stump.nFeature, stump.anSubset, stump.fLeft, stump.fRight);
+			}
+		}
+	}
+
+	return hr;
+}
+
+/// <summary>
+/// Adds a random feature and a stump testing it: an edge or line Haar feature, weighted as
+/// traincascade weights them, or an LBP grid of random cells with a random subset
+/// </summary>
+static void AddRandomStump(CascadeFeatureType eType, BenchRandom& random, CascadeBenchCascade* pCascade)
+{
+	CascadeBenchStump stump;
+	ZeroMemory(&stump, sizeof(stump));
+
+	if (eType == CascadeFeatureType_Haar)
+	{
+		// Two or three parts side by side, across or down
+		int nParts = NextInt(random, 2, 3);
+		bool bAcross = random.NextUniform() < 0.5;
+
+		int nPart = NextInt(random, 1, CASCADE_BENCH_WINDOW / nParts);
+		int nBreadth = NextInt(random, 1, CASCADE_BENCH_WINDOW);
+		int nWidth = bAcross ? nParts * nPart : nBreadth;
+		int nHeight = bAcross ? nBreadth : nParts * nPart;
+
+		CascadeRect aRects[3] =
+		{
+			{ NextInt(random, 0, CASCADE_BENCH_WINDOW - nWidth), NextInt(random, 0, CASCADE_BENCH_WINDOW - nHeight), nWidth, nHeight, -1.0f },
+			{ 0, 0, 0, 0, static_cast<float>(nParts) },
+			{ 0, 0, 0, 0, 0.0f },
+		};
+
+		// The second part, the right or lower half or the middle third, weighted to balance the whole
+		aRects[1].nX = aRects[0].nX + (bAcross ? nPart : 0);
+		aRects[1].nY = aRects[0].nY + (bAcross ? 0 : nPart);
+		aRects[1].nWidth = bAcross ? nPart : nWidth;
+		aRects[1].nHeight = bAcross ? nHeight : nPart;
+
+		stump.nFeature = static_cast<int>(pCascade->aRects.size() / 3);
+		stump.fThreshold = NextFloat(random, -CASCADE_BENCH_HAAR_THRESHOLD, CASCADE_BENCH_HAAR_THRESHOLD);
+
+		pCascade->aRects.insert(pCascade->aRects.end(), aRects, aRects + 3);
+	}
+	else
+	{
+		int nCellWidth = NextInt(random, 1, CASCADE_BENCH_WINDOW / 3);
+		int nCellHeight = NextInt(random, 1, CASCADE_BENCH_WINDOW / 3);
+
+		stump.nFeature = static_cast<int>(pCascade->anCells.size() / 4);
+
+		pCascade->anCells.push_back(NextInt(random, 0, CASCADE_BENCH_WINDOW - 3 * nCellWidth));
+		pCascade->anCells.push_back(NextInt(random, 0, CASCADE_BENCH_WINDOW - 3 * nCellHeight));
+		pCascade->anCells.push_back(nCellWidth);
+		pCascade->anCells.push_back(nCellHeight);
+
+		for (int n = 0; n < 8; n++)
+		{
+			stump.anSubset[n] = static_cast<int>(static_cast<DWORD>(NextInt(random, 0, 0xffff)) << 16 | static_cast<DWORD>(NextInt(random, 0, 0xffff)));
+		}
+	}
+
+	stump.fLeft = NextFloat(random, -1.0, 1.0);
+	stump.fRight = NextFloat(random, -1.0, 1.0);
+
+	pCascade->aStumps.push_back(stump);
+}
+
+/// <summary>
+/// Windows among anWindows, given by their top left table entry, which the whole cascade passes
+/// </summary>
+static size_t CountPassing(const CascadeClassifier& classifier, const IntegralImage& integral, const std::vector<int>& anOffsets,
+	const std::vector<int>& anWindows, std::vector<int>* pPassing)
+{
+	size_t cPassing = 0;
+
+	for (size_t n = 0; n < anWindows.size(); n++)
+	{
+		if (classifier.TestWindow(integral, &anOffsets[0], anWindows[n]))
+		{
+			cPassing++;
+
+			if (pPassing != NULL)
+				pPassing->push_back(anWindows[n]);
+		}
+	}
+
+	return cPassing;
+}
+
+/// <summary>
+/// Makes a cascade of the given shape and sets every stage's threshold, in turn, so that it passes
+/// CASCADE_BENCH_PASS_RATE of the frame's windows which the stages before it passed
+/// </summary>
+static HRESULT BuildCascade(const CascadeBenchShape& shape, const BYTE* pFrame, CascadeBenchCascade* pCascade)
+{
+	LumaPlane luma;
+	IntegralImage integral;
+
+	HRESULT hr = luma.Extract(pFrame, CASCADE_BENCH_WIDTH, CASCADE_BENCH_HEIGHT, CASCADE_BENCH_WIDTH * 3, 24);
+	if (SUCCEEDED(hr))
+		hr = integral.Build(luma.GetData(), luma.GetWidth(), luma.GetHeight(), luma.GetWidth(), shape.eType == CascadeFeatureType_Haar);
+
+	if (FAILED(hr))
+		return hr;
+
+	// The windows the scanner tests at full scale, every second one across and down
+	std::vector<int> anWindows;
+	for (int y = 0; y + CASCADE_BENCH_WINDOW <= CASCADE_BENCH_HEIGHT; y += 2)
+	{
+		for (int x = 0; x + CASCADE_BENCH_WINDOW <= CASCADE_BENCH_WIDTH; x += 2)
+		{
+			anWindows.push_back(y * integral.GetStride() + x);
+		}
+	}
+
+	BenchRandom random(CASCADE_BENCH_SEED);
+	CascadeClassifier classifier;
+	std::vector<int> anOffsets;
+
+	for (int nStage = 0; nStage < shape.nStages && SUCCEEDED(hr); nStage++)
+	{
+		int nStumps = min(shape.nFirstStumps + static_cast<int>(nStage * shape.dGrowth), shape.nMaxStumps);
+		float fLow = 0.0f;
+		float fHigh = 0.0f;
+
+		for (int n = 0; n < nStumps; n++)
+		{
+			AddRandomStump(shape.eType, random, pCascade);
+
+			const CascadeBenchStump& stump = pCascade->aStumps.back();
+			fLow += min(stump.fLeft, stump.fRight);
+			fHigh += max(stump.fLeft, stump.fRight);
+		}
+
+		pCascade->anStageStumps.push_back(nStumps);
+		pCascade->afStageThresholds.push_back(fHigh);
+
+		size_t cTarget = static_cast<size_t>(anWindows.size() * CASCADE_BENCH_PASS_RATE);
+
+		for (int nStep = 0; nStep < CASCADE_BENCH_THRESHOLD_STEPS && SUCCEEDED(hr); nStep++)
+		{
+			float fMiddle = (fLow + fHigh) * 0.5f;
+			pCascade->afStageThresholds.back() = fMiddle;
+
+			hr = LoadCascade(shape.eType, *pCascade, classifier);
+			if (SUCCEEDED(hr))
+			{
+				classifier.GetOffsets(integral.GetStride(), &anOffsets);
+
+				if (CountPassing(classifier, integral, anOffsets, anWindows, NULL) > cTarget)
+					fLow = fMiddle;
+				else
+					fHigh = fMiddle;
+			}
+		}
+
+		// The highest threshold tried which passes no more than the target
+		pCascade->afStageThresholds.back() = fHigh;
+
+		if (SUCCEEDED(hr))
+			hr = LoadCascade(shape.eType, *pCascade, classifier);
+
+		if (SUCCEEDED(hr))
+		{
+			classifier.GetOffsets(integral.GetStride(), &anOffsets);
+
+			std::vector<int> anPassing;
+			CountPassing(classifier, integral, anOffsets, anWindows, &anPassing);
+			anWindows.swap(anPassing);
+		}
+	}
+
+	return hr;
+}
+
+/// <summary>
+/// Searches the frames in turn for dSeconds, and at least once each
+/// </summary>
+static HRESULT TimeDetect(CascadeScanner& scanner, const std::vector<std::vector<BYTE> >& aFrames, double dSeconds, BenchSamples* pFrameTime, BenchSamples* pHits)
+{
+	LONGLONG llStart = BenchClock::Now();
+
+	for (int n = 0; pFrameTime->GetCount() < CASCADE_BENCH_FRAMES || BenchClock::ToSeconds(BenchClock::Now() - llStart) < dSeconds; n = (n + 1) % CASCADE_BENCH_FRAMES)
+	{
+		LONGLONG llFrameStart = BenchClock::Now();
+		int nHits = 0;
+
+		HRESULT hr = scanner.Detect(&aFrames[n][0], CASCADE_BENCH_WIDTH, CASCADE_BENCH_HEIGHT, CASCADE_BENCH_WIDTH * 3, 24, &nHits);
+
+		pFrameTime->Add(BenchClock::ToMicroseconds(BenchClock::Now() - llFrameStart));
+		pHits->Add(nHits);
+
+		if (FAILED(hr))
+			return hr;
+	}
+
+	return S_OK;
+}
+
+static void RunCascadePass(const CascadeBenchShape& shape, const CascadeBenchCascade& cascade, double dScaleFactor,
+	const std::vector<std::vector<BYTE> >& aFrames, double dSeconds)
+{
+	CascadeScanner scanner;
+	BenchSamples frameTime;
+	BenchSamples poolFrameTime;
+	BenchSamples hits;
+
+	HRESULT hr = LoadCascade(shape.eType, cascade, scanner.GetClassifier());
+	if (SUCCEEDED(hr))
+		hr = scanner.SetScaleFactor(dScaleFactor);
+
+	if (SUCCEEDED(hr))
+		hr = TimeDetect(scanner, aFrames, dSeconds, &frameTime, &hits);
+
+	// Then with the levels and bands on the shared pool, as CascadeObjectDetector runs it by default
+	scanner.SetWorkerPool(WorkerPool::GetShared());
+
+	if (SUCCEEDED(hr))
+		hr = TimeDetect(scanner, aFrames, dSeconds, &poolFrameTime, &hits);
+
+	if (FAILED(hr))
+	{
+		printf("%10s could not be searched: 0x%08x\n", shape.szName, hr);
+		return;
+	}
+
+	printf("%10s%10.1f%10d%10d%10.2f%10.2f%10.1f\n",
+		shape.szName,
+		dScaleFactor,
+		scanner.GetClassifier().GetStageCount(),
+		static_cast<int>(cascade.aStumps.size()),
+		frameTime.GetPercentile(0.5) / 1000.0,
+		poolFrameTime.GetPercentile(0.5) / 1000.0,
+		hits.GetMean());
+}
+
+void WebCamBench::RunCascadeBenchmark(double dSeconds)
+{
+	static const char* const s_aszColumns[] = { "Cascade", "Scale", "Stages", "Stumps", "Frame ms", "Pool ms", "Hits" };
+	static const CascadeBenchShape s_aShapes[] =
+	{
+		{ "haar", CascadeFeatureType_Haar, 25, 9, 9.0, 200 },
+		{ "lbp", CascadeFeatureType_Lbp, 20, 3, 0.35, 9 },
+	};
+	static const double s_adScaleFactors[] = { 1.1, 1.2 };
+
+	BenchScene scene(CASCADE_BENCH_WIDTH, CASCADE_BENCH_HEIGHT);
+	BenchRandom random(CASCADE_BENCH_SEED);
+
+	std::vector<std::vector<BYTE> > aFrames(CASCADE_BENCH_FRAMES);
+	for (int n = 0; n < CASCADE_BENCH_FRAMES; n++)
+	{
+		scene.Render(n);
+		aFrames[n].assign(scene.GetPixels(), scene.GetPixels() + scene.GetSize());
+		random.AddNoise(&aFrames[n][0], scene.GetSize(), CASCADE_BENCH_NOISE);
+	}
+
+	PrintBenchHeader("Cascade detection of 640x480 RGB24 frames, on one thread and then on the shared pool; median ms per frame, Hits are objects found per frame",
+		s_aszColumns, sizeof(s_aszColumns) / sizeof(s_aszColumns[0]));
+
+	for (size_t n = 0; n < sizeof(s_aShapes) / sizeof(s_aShapes[0]); n++)
+	{
+		CascadeBenchCascade cascade;
+
+		HRESULT hr = BuildCascade(s_aShapes[n], &aFrames[0][0], &cascade);
+		if (FAILED(hr))
+		{
+			printf("%10s could not be built: 0x%08x\n", s_aShapes[n].szName, hr);
+			continue;
+		}
+
+		for (size_t nScale = 0; nScale < sizeof(s_adScaleFactors) / sizeof(s_adScaleFactors[0]); nScale++)
+		{
+			RunCascadePass(s_aShapes[n], cascade, s_adScaleFactors[nScale], aFrames, dSeconds);
+		}
+	}
+}
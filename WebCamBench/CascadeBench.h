@@ -0,0 +1,21 @@
+//*****************************************************************************************
+//  File:       CascadeBench.h
+//  Project:    WebCamBench
+//
+//  Declares the cascade object detector throughput benchmark
+//*****************************************************************************************
+
+#pragma once
+
+namespace WebCamBench
+{
+	/// <summary>
+	/// Searches 640x480 frames of the synthetic scene, with sensor-like noise, with cascades shaped
+	/// like OpenCV's frontal face ones: 25 Haar stages growing from 9 to 200 stumps, and 20 LBP
+	/// stages of 3 to 9. Their features are random and every stage's threshold is set on the first
+	/// frame so it passes half the windows that reach it, as a trained cascade's stages do. Reports
+	/// the time per frame on one thread and on the shared worker pool, at two scale factors, each
+	/// timed for dSeconds.
+	/// </summary>
+	void RunCascadeBenchmark(double dSeconds);
+}
@@ -0,0 +1,171 @@
+//*****************************************************************************************
+//  File:       CodecBench.cpp
+//  Project:    WebCamBench
+//
+//  Defines the lossless recording codec ratio and speed benchmark
+//*****************************************************************************************
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "LosslessCodec.h"
+#include "WorkerPool.h"
+
+#include "BenchHarness.h"
+#include "CodecBench.h"
+
+using namespace WebCamLib;
+using namespace WebCamBench;
+
+// Frames in each corpus; the encoder and decoder cycle through them
+#define CODEC_BENCH_FRAMES		8
+
+#define CODEC_BENCH_SEED		19700101
+
+// Sigma of a corpus of uniformly random bytes rather than of the scene under noise
+#define CODEC_BENCH_UNIFORM		-1.0
+
+struct CodecBenchCorpus
+{
+	const char* szName;
+	int nWidth;
+	int nHeight;
+	double dSigma;
+};
+
+/// <summary>
+/// Decodes the encoded frames in turn for dSeconds, and at least once each; false if any of them
+/// did not come back exactly
+/// </summary>
+static bool TimeDecode(LosslessCodec& codec, const std::vector<std::vector<BYTE> >& aEncoded, const std::vector<DWORD>& adwEncodedSize,
+	const std::vector<std::vector<BYTE> >& aFrames, int nRowBytes, double dSeconds, BenchSamples* pDecodeTime)
+{
+	size_t cbFrame = aFrames[0].size();
+	std::vector<BYTE> aDecoded(cbFrame);
+	bool bExact = true;
+
+	LONGLONG llStart = BenchClock::Now();
+
+	for (int n = 0; pDecodeTime->GetCount() < CODEC_BENCH_FRAMES || BenchClock::ToSeconds(BenchClock::Now() - llStart) < dSeconds; n = (n + 1) % CODEC_BENCH_FRAMES)
+	{
+		LONGLONG llFrameStart = BenchClock::Now();
+
+		HRESULT hr = codec.Decode(&aEncoded[n][0], adwEncodedSize[n], &aDecoded[0], nRowBytes);
+
+		pDecodeTime->Add(BenchClock::ToMicroseconds(BenchClock::Now() - llFrameStart));
+
+		if (FAILED(hr) || memcmp(&aDecoded[0], &aFrames[n][0], cbFrame) != 0)
+		{
+			bExact = false;
+		}
+	}
+
+	return bExact;
+}
+
+static void RunCodecPass(const CodecBenchCorpus& corpus, double dSeconds)
+{
+	BenchScene scene(corpus.nWidth, corpus.nHeight);
+	BenchRandom random(CODEC_BENCH_SEED);
+
+	int nRowBytes = scene.GetRowBytes();
+	int nSize = scene.GetSize();
+	DWORD dwCapacity = LosslessCodec::GetMaxEncodedSize(corpus.nWidth, corpus.nHeight);
+
+	std::vector<std::vector<BYTE> > aFrames(CODEC_BENCH_FRAMES);
+	std::vector<std::vector<BYTE> > aEncoded(CODEC_BENCH_FRAMES);
+	std::vector<DWORD> adwEncodedSize(CODEC_BENCH_FRAMES);
+
+	for (int n = 0; n < CODEC_BENCH_FRAMES; n++)
+	{
+		scene.Render(n);
+		aFrames[n].assign(scene.GetPixels(), scene.GetPixels() + nSize);
+
+		if (corpus.dSigma == CODEC_BENCH_UNIFORM)
+		{
+			for (int i = 0; i < nSize; i++)
+			{
+				aFrames[n][i] = static_cast<BYTE>(random.NextUniform() * 256.0);
+			}
+		}
+		else if (corpus.dSigma > 0.0)
+		{
+			random.AddNoise(&aFrames[n][0], nSize, corpus.dSigma);
+		}
+
+		aEncoded[n].resize(dwCapacity);
+	}
+
+	LosslessCodec codec;
+	BenchSamples encodeTime;
+	BenchSamples decodeTime;
+	BenchSamples poolDecodeTime;
+	double dEncodedBytes = 0.0;
+
+	LONGLONG llStart = BenchClock::Now();
+
+	for (int n = 0; encodeTime.GetCount() < CODEC_BENCH_FRAMES || BenchClock::ToSeconds(BenchClock::Now() - llStart) < dSeconds; n = (n + 1) % CODEC_BENCH_FRAMES)
+	{
+		LONGLONG llFrameStart = BenchClock::Now();
+
+		HRESULT hr = codec.Encode(&aFrames[n][0], corpus.nWidth, corpus.nHeight, nRowBytes, 24, &aEncoded[n][0], dwCapacity, &adwEncodedSize[n]);
+
+		encodeTime.Add(BenchClock::ToMicroseconds(BenchClock::Now() - llFrameStart));
+
+		if (FAILED(hr))
+		{
+			printf("%10s could not be encoded: 0x%08x\n", corpus.szName, hr);
+			return;
+		}
+
+		if (encodeTime.GetCount() <= CODEC_BENCH_FRAMES)
+		{
+			dEncodedBytes += adwEncodedSize[n];
+		}
+	}
+
+	bool bExact = TimeDecode(codec, aEncoded, adwEncodedSize, aFrames, nRowBytes, dSeconds, &decodeTime);
+
+	// Then with the planes on the shared pool, as the managed codec decodes them
+	codec.SetWorkerPool(WorkerPool::GetShared());
+	bExact = TimeDecode(codec, aEncoded, adwEncodedSize, aFrames, nRowBytes, dSeconds, &poolDecodeTime) && bExact;
+
+	double dMegabytes = nSize / 1000000.0;
+	double dEncodeMedian = encodeTime.GetPercentile(0.5);
+	double dDecodeMedian = decodeTime.GetPercentile(0.5);
+
+	printf("%10s%10d%10d%10.2f%10.2f%10.0f%10.2f%10.0f%10.2f%10s\n",
+		corpus.szName,
+		corpus.nWidth,
+		corpus.nHeight,
+		static_cast<double>(nSize) * CODEC_BENCH_FRAMES / dEncodedBytes,
+		dEncodeMedian / 1000.0,
+		dEncodeMedian > 0.0 ? dMegabytes * 1000000.0 / dEncodeMedian : 0.0,
+		dDecodeMedian / 1000.0,
+		dDecodeMedian > 0.0 ? dMegabytes * 1000000.0 / dDecodeMedian : 0.0,
+		poolDecodeTime.GetPercentile(0.5) / 1000.0,
+		bExact ? "yes" : "NO");
+}
+
+void WebCamBench::RunCodecBenchmark(double dSeconds)
+{
+	static const char* const s_aszColumns[] = { "Corpus", "Width", "Height", "Ratio", "Enc ms", "Enc MB/s", "Dec ms", "Dec MB/s", "Pool ms", "Exact" };
+	static const CodecBenchCorpus s_aCorpora[] =
+	{
+		{ "clean", 640, 480, 0.0 },
+		{ "noise 2", 640, 480, 2.0 },
+		{ "noise 8", 640, 480, 8.0 },
+		{ "uniform", 640, 480, CODEC_BENCH_UNIFORM },
+		{ "clean", 1920, 1080, 0.0 },
+		{ "noise 2", 1920, 1080, 2.0 },
+	};
+
+	PrintBenchHeader("Lossless codec, RGB24 on one thread, then decoding on the shared pool; noise is the sigma of gaussian noise over the scene",
+		s_aszColumns, sizeof(s_aszColumns) / sizeof(s_aszColumns[0]));
+
+	for (size_t n = 0; n < sizeof(s_aCorpora) / sizeof(s_aCorpora[0]); n++)
+	{
+		RunCodecPass(s_aCorpora[n], dSeconds);
+	}
+}
@@ -0,0 +1,19 @@
+//*****************************************************************************************
+//  File:       CodecBench.h
+//  Project:    WebCamBench
+//
+//  Declares the lossless recording codec ratio and speed benchmark
+//*****************************************************************************************
+
+#pragma once
+
+namespace WebCamBench
+{
+	/// <summary>
+	/// Encodes and decodes short RGB24 sequences of the synthetic scene, clean and with sensor-like
+	/// noise, and of pure noise as the worst case, on one thread. Reports the compression ratio,
+	/// the time per frame each way, the decoding time again with the three planes on the shared
+	/// worker pool, and whether every frame came back exactly. Each is timed for dSeconds per corpus.
+	/// </summary>
+	void RunCodecBenchmark(double dSeconds);
+}
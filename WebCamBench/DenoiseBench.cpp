@@ -0,0 +1,175 @@
+//*****************************************************************************************
+//  File:       DenoiseBench.cpp
+//  Project:    WebCamBench
+//
+//  Defines the temporal denoise quality and throughput benchmark
+//*****************************************************************************************
+
+#include <windows.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "TemporalDenoiser.h"
+
+#include "BenchHarness.h"
+#include "DenoiseBench.h"
+
+using namespace WebCamLib;
+using namespace WebCamBench;
+
+#define DENOISE_BENCH_WIDTH			640
+#define DENOISE_BENCH_HEIGHT		480
+
+// Frames filtered per quality pass; the first ones, while the average builds up, are not scored
+#define DENOISE_BENCH_FRAMES		120
+#define DENOISE_BENCH_SETTLE		40
+
+#define DENOISE_BENCH_SEED			20140719
+
+static void RunQualityPass(double dSigma, double dStrength)
+{
+	// A threshold just above most of the noise, and the weight rising to one over a few times that
+	int nNoiseThreshold = static_cast<int>(dSigma + 0.5);
+	int nMotionRange = 4 * nNoiseThreshold;
+
+	TemporalDenoiser denoiser;
+	if (FAILED(denoiser.SetParameters(dStrength, nNoiseThreshold, nMotionRange)))
+		return;
+
+	BenchScene scene(DENOISE_BENCH_WIDTH, DENOISE_BENCH_HEIGHT);
+	BenchRandom random(DENOISE_BENCH_SEED);
+	BenchPsnr noisy;
+	BenchPsnr filtered;
+	BenchPsnr still;
+	BenchPsnr moving;
+	std::vector<BYTE> aFrame(scene.GetSize());
+
+	int nRowBytes = scene.GetRowBytes();
+	int nSquareBytes = BenchScene::GetSquareSize() * 3;
+
+	for (int nFrame = 0; nFrame < DENOISE_BENCH_FRAMES; nFrame++)
+	{
+		scene.Render(nFrame);
+
+		CopyMemory(&aFrame[0], scene.GetPixels(), scene.GetSize());
+		random.AddNoise(&aFrame[0], scene.GetSize(), dSigma);
+
+		bool bScored = nFrame >= DENOISE_BENCH_SETTLE;
+		if (bScored)
+		{
+			noisy.Add(scene.GetPixels(), &aFrame[0], scene.GetSize());
+		}
+
+		denoiser.BeginFrame(nRowBytes, scene.GetHeight());
+
+		for (int y = 0; y < scene.GetHeight(); y++)
+		{
+			denoiser.FilterRow(&aFrame[static_cast<size_t>(y) * nRowBytes], y);
+		}
+
+		if (!bScored)
+			continue;
+
+		filtered.Add(scene.GetPixels(), &aFrame[0], scene.GetSize());
+
+		// Split every row into the spans left of, on and right of the square
+		int nSquareLeft = scene.GetSquareX() * 3;
+		int nSquareRight = nSquareLeft + nSquareBytes;
+
+		for (int y = 0; y < scene.GetHeight(); y++)
+		{
+			size_t nOffset = static_cast<size_t>(y) * nRowBytes;
+			const BYTE* pReference = scene.GetPixels() + nOffset;
+			const BYTE* pFiltered = &aFrame[nOffset];
+
+			if (y < scene.GetSquareY() || y >= scene.GetSquareY() + BenchScene::GetSquareSize())
+			{
+				still.Add(pReference, pFiltered, nRowBytes);
+				continue;
+			}
+
+			still.Add(pReference, pFiltered, nSquareLeft);
+			moving.Add(pReference + nSquareLeft, pFiltered + nSquareLeft, nSquareBytes);
+			still.Add(pReference + nSquareRight, pFiltered + nSquareRight, nRowBytes - nSquareRight);
+		}
+	}
+
+	printf("%10.0f%10.2f%10d%10.2f%10.2f%10.2f%10.2f%10.2f\n",
+		dSigma,
+		dStrength,
+		nNoiseThreshold,
+		noisy.GetDecibels(),
+		filtered.GetDecibels(),
+		filtered.GetDecibels() - noisy.GetDecibels(),
+		still.GetDecibels(),
+		moving.GetDecibels());
+}
+
+static void RunThroughputPass(int nWidth, int nHeight, double dSeconds)
+{
+	BenchScene scene(nWidth, nHeight);
+	std::vector<BYTE> aNoisy(scene.GetPixels(), scene.GetPixels() + scene.GetSize());
+
+	BenchRandom random(DENOISE_BENCH_SEED);
+	random.AddNoise(&aNoisy[0], scene.GetSize(), 8.0);
+
+	TemporalDenoiser denoiser;
+	std::vector<BYTE> aFrame(scene.GetSize());
+	BenchSamples frameTime;
+
+	int nRowBytes = scene.GetRowBytes();
+	LONGLONG llStart = BenchClock::Now();
+
+	while (BenchClock::ToSeconds(BenchClock::Now() - llStart) < dSeconds)
+	{
+		// Restoring the noisy frame is not part of the time
+		CopyMemory(&aFrame[0], &aNoisy[0], scene.GetSize());
+
+		LONGLONG llFrameStart = BenchClock::Now();
+
+		denoiser.BeginFrame(nRowBytes, scene.GetHeight());
+
+		for (int y = 0; y < scene.GetHeight(); y++)
+		{
+			denoiser.FilterRow(&aFrame[static_cast<size_t>(y) * nRowBytes], y);
+		}
+
+		frameTime.Add(BenchClock::ToMicroseconds(BenchClock::Now() - llFrameStart));
+	}
+
+	double dMedian = frameTime.GetPercentile(0.5);
+	double dMegabytes = scene.GetSize() / 1000000.0;
+
+	printf("%10d%10d%10.3f%10.3f%10.0f%10.0f\n",
+		nWidth,
+		nHeight,
+		dMedian / 1000.0,
+		frameTime.GetPercentile(0.99) / 1000.0,
+		dMedian > 0.0 ? 1000000.0 / dMedian : 0.0,
+		dMedian > 0.0 ? dMegabytes * 1000000.0 / dMedian : 0.0);
+}
+
+void WebCamBench::RunDenoiseBenchmark(double dSeconds)
+{
+	static const char* const s_aszQualityColumns[] = { "Sigma", "Strength", "Threshold", "Noisy dB", "Output dB", "Gain dB", "Still dB", "Moving dB" };
+	static const char* const s_aszSpeedColumns[] = { "Width", "Height", "p50 ms", "p99 ms", "Frames/s", "MB/s" };
+	static const double s_adSigmas[] = { 4.0, 8.0, 16.0 };
+	static const double s_adStrengths[] = { 0.5, 1.0 };
+
+	PrintBenchHeader("Temporal denoise quality, 640x480 RGB24 with a moving square; PSNR against the clean scene",
+		s_aszQualityColumns, sizeof(s_aszQualityColumns) / sizeof(s_aszQualityColumns[0]));
+
+	for (size_t s = 0; s < sizeof(s_adSigmas) / sizeof(s_adSigmas[0]); s++)
+	{
+		for (size_t n = 0; n < sizeof(s_adStrengths) / sizeof(s_adStrengths[0]); n++)
+		{
+			RunQualityPass(s_adSigmas[s], s_adStrengths[n]);
+		}
+	}
+
+	PrintBenchHeader("Temporal denoise throughput, RGB24 on one thread",
+		s_aszSpeedColumns, sizeof(s_aszSpeedColumns) / sizeof(s_aszSpeedColumns[0]));
+
+	RunThroughputPass(640, 480, dSeconds);
+	RunThroughputPass(1920, 1080, dSeconds);
+}
@@ -0,0 +1,19 @@
+//*****************************************************************************************
+//  File:       DenoiseBench.h
+//  Project:    WebCamBench
+//
+//  Declares the temporal denoise quality and throughput benchmark
+//*****************************************************************************************
+
+#pragma once
+
+namespace WebCamBench
+{
+	/// <summary>
+	/// Filters a synthetic 640x480 RGB24 scene, a still textured background with a square moving
+	/// across it, after adding gaussian noise of several strengths, and reports the PSNR against the
+	/// clean scene before and after, overall, where it stands still and where it moves. Then times
+	/// the filter on one thread at 640x480 and 1920x1080 for dSeconds each.
+	/// </summary>
+	void RunDenoiseBenchmark(double dSeconds);
+}
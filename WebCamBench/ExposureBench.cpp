@@ -0,0 +1,269 @@
+//*****************************************************************************************
+//  File:       ExposureBench.cpp
+//  Project:    WebCamBench
+//
+//  Defines the software auto-exposure and white balance convergence check
+//*****************************************************************************************
+
+#include <windows.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "ExposureController.h"
+
+#include "BenchHarness.h"
+#include "ExposureBench.h"
+
+using namespace WebCamLib;
+using namespace WebCamBench;
+
+// Ten seconds of a 30 frames per second camera
+#define EXPOSURE_BENCH_FRAMES		300
+#define EXPOSURE_BENCH_FRAME_MS		33
+
+// A run has only settled if it stayed settled for at least the last two seconds
+#define EXPOSURE_BENCH_HOLD			60
+
+// Frames a written value takes to show up in the picture
+#define EXPOSURE_BENCH_DELAY		2
+
+// Sigma of the measured means, in levels, as sensor noise leaves them from frame to frame
+#define EXPOSURE_BENCH_NOISE		0.5
+
+// A little wider than the controller's own tolerances, so noise at their edge is not counted
+#define EXPOSURE_BENCH_LUMA_SLACK	2.0
+#define EXPOSURE_BENCH_CAST_LIMIT	0.05
+
+#define EXPOSURE_BENCH_SEED			20140301
+
+// Stops the simulated camera's gain and white balance really span; the controller assumes 4 and 2
+#define SIMULATED_GAIN_STOPS		3.5
+#define SIMULATED_WHITE_STOPS		1.5
+
+#define SIMULATED_DEFAULT_EXPOSURE	-6
+
+/// <summary>
+/// Webcam with a one stop Exposure_lgSec range, a fine gain and a white balance in Kelvin, all of
+/// which apply a written value a few frames late. It measures a flat grey scene lit by a light
+/// of the given brightness and colour temperature.
+/// </summary>
+class SimulatedExposureDevice : public IExposureDevice
+{
+public:
+	SimulatedExposureDevice()
+	{
+		SetRange(ExposureChannel_Exposure, -11, -3, 1, SIMULATED_DEFAULT_EXPOSURE);
+		SetRange(ExposureChannel_Gain, 0, 100, 1, 0);
+		SetRange(ExposureChannel_WhiteBalance, 2800, 6500, 10, 4600);
+	}
+
+	virtual bool GetRange(ExposureChannel eChannel, PropertyRange* pRange)
+	{
+		*pRange = m_aRanges[eChannel];
+		return true;
+	}
+
+	virtual bool GetValue(ExposureChannel eChannel, long* plValue, bool* pbAutomatic)
+	{
+		*plValue = m_alPending[eChannel];
+		*pbAutomatic = m_abAutomatic[eChannel];
+		return true;
+	}
+
+	virtual bool SetValue(ExposureChannel eChannel, long lValue)
+	{
+		if (lValue < m_aRanges[eChannel].lMinimum || lValue > m_aRanges[eChannel].lMaximum)
+			return false;
+
+		m_alPending[eChannel] = lValue;
+		m_anDelay[eChannel] = EXPOSURE_BENCH_DELAY;
+		m_abAutomatic[eChannel] = false;
+		return true;
+	}
+
+	virtual bool SetAutomatic(ExposureChannel eChannel)
+	{
+		m_abAutomatic[eChannel] = true;
+		return true;
+	}
+
+	/// <summary>
+	/// Moves on by one frame, applying the writes whose delay has run out
+	/// </summary>
+	void Advance()
+	{
+		for (int n = 0; n < ExposureChannel_Count; n++)
+		{
+			if (m_anDelay[n] > 0 && --m_anDelay[n] == 0)
+				m_alApplied[n] = m_alPending[n];
+		}
+	}
+
+	/// <summary>
+	/// Statistics of the frame taken with the values applied now. dLight is the luma the scene
+	/// gives at the default exposure without gain; dKelvin the colour temperature of the light.
+	/// </summary>
+	void Measure(double dLight, double dKelvin, BenchRandom& random, ImageStatistics* pStats) const
+	{
+		const PropertyRange& gain = m_aRanges[ExposureChannel_Gain];
+		const PropertyRange& white = m_aRanges[ExposureChannel_WhiteBalance];
+
+		double dStops = m_alApplied[ExposureChannel_Exposure] - SIMULATED_DEFAULT_EXPOSURE
+			+ SIMULATED_GAIN_STOPS * (m_alApplied[ExposureChannel_Gain] - gain.lMinimum) / (gain.lMaximum - gain.lMinimum);
+
+		// Light adds up linearly, luma is gamma encoded and the sensor clips
+		double dLinear = pow(dLight / 255.0, 2.2) * pow(2.0, dStops);
+		double dLuma = 255.0 * pow(dLinear < 1.0 ? dLinear : 1.0, 1.0 / 2.2);
+
+		// Light warmer than the white balance leaves a red cast, colder a blue one
+		double dCast = (dKelvin - m_alApplied[ExposureChannel_WhiteBalance]) * SIMULATED_WHITE_STOPS / (white.lMaximum - white.lMinimum);
+
+		ZeroMemory(pStats, sizeof(ImageStatistics));
+		pStats->dwSamples = 4800;
+		pStats->dMeanLuma = dLuma + random.NextGaussian(EXPOSURE_BENCH_NOISE);
+		pStats->dMeanGreen = pStats->dMeanLuma;
+		pStats->dMeanRed = dLuma * pow(2.0, -dCast / 2.0) + random.NextGaussian(EXPOSURE_BENCH_NOISE);
+		pStats->dMeanBlue = dLuma * pow(2.0, dCast / 2.0) + random.NextGaussian(EXPOSURE_BENCH_NOISE);
+	}
+
+	/// <summary>
+	/// Blue/red imbalance in stops of the frame taken with the values applied now, without noise
+	/// </summary>
+	double GetCast(double dKelvin) const
+	{
+		const PropertyRange& white = m_aRanges[ExposureChannel_WhiteBalance];
+
+		return (dKelvin - m_alApplied[ExposureChannel_WhiteBalance]) * SIMULATED_WHITE_STOPS / (white.lMaximum - white.lMinimum);
+	}
+
+	long GetApplied(ExposureChannel eChannel) const
+	{
+		return m_alApplied[eChannel];
+	}
+
+private:
+	void SetRange(ExposureChannel eChannel, long lMinimum, long lMaximum, long lStep, long lDefault)
+	{
+		m_aRanges[eChannel].lMinimum = lMinimum;
+		m_aRanges[eChannel].lMaximum = lMaximum;
+		m_aRanges[eChannel].lStep = lStep;
+		m_aRanges[eChannel].lDefault = lDefault;
+
+		m_alApplied[eChannel] = lDefault;
+		m_alPending[eChannel] = lDefault;
+		m_anDelay[eChannel] = 0;
+		m_abAutomatic[eChannel] = true;
+	}
+
+	PropertyRange m_aRanges[ExposureChannel_Count];
+	long m_alApplied[ExposureChannel_Count];
+	long m_alPending[ExposureChannel_Count];
+	int m_anDelay[ExposureChannel_Count];
+	bool m_abAutomatic[ExposureChannel_Count];
+};
+
+struct ExposureBenchScene
+{
+	const char* szName;
+	double dLight;			// luma at the default exposure without gain
+	double dChangedLight;	// the same once the light changes, zero when it does not
+	int nChangeFrame;
+	double dKelvin;
+	bool bWhiteBalance;
+	long lExposureLimit;	// zero when exposure is not limited
+};
+
+static void RunExposurePass(const ExposureBenchScene& scene)
+{
+	// Owned and deleted by the controller
+	SimulatedExposureDevice* pDevice = new SimulatedExposureDevice();
+	SimulatedExposureDevice& device = *pDevice;
+
+	ExposureController controller;
+	controller.EnableWhiteBalance(scene.bWhiteBalance);
+
+	if (scene.lExposureLimit != 0)
+		controller.SetExposureLimit(scene.lExposureLimit);
+
+	if (!controller.Attach(pDevice))
+	{
+		printf("%10s could not be attached\n", scene.szName);
+		return;
+	}
+
+	// The controller's defaults
+	const double dTarget = controller.GetTargetLuma();
+	const double dTolerance = 6.0 + EXPOSURE_BENCH_LUMA_SLACK;
+
+	BenchRandom random(EXPOSURE_BENCH_SEED);
+	ImageStatistics statistics;
+
+	// Settling counts from the change of light when there is one
+	int nFirstFrame = scene.dChangedLight > 0.0 ? scene.nChangeFrame : 0;
+	int nSettledFrame = nFirstFrame;
+	DWORD dwWritesSettled = 0;
+	double dStartLuma = 0.0;
+	double dLuma = 0.0;
+
+	for (int nFrame = 0; nFrame < EXPOSURE_BENCH_FRAMES; nFrame++)
+	{
+		device.Advance();
+
+		bool bChanged = scene.dChangedLight > 0.0 && nFrame >= scene.nChangeFrame;
+		device.Measure(bChanged ? scene.dChangedLight : scene.dLight, scene.dKelvin, random, &statistics);
+
+		dLuma = statistics.dMeanLuma;
+		if (nFrame == nFirstFrame)
+			dStartLuma = dLuma;
+
+		bool bSettled = fabs(dLuma - dTarget) <= dTolerance && (!scene.bWhiteBalance || fabs(device.GetCast(scene.dKelvin)) <= EXPOSURE_BENCH_CAST_LIMIT);
+
+		// Settled from the frame after the last one off target
+		if (!bSettled && nFrame >= nSettledFrame)
+		{
+			nSettledFrame = nFrame + 1;
+			dwWritesSettled = controller.GetWriteCount();
+		}
+
+		controller.Update(statistics, static_cast<DWORD>(nFrame) * EXPOSURE_BENCH_FRAME_MS);
+	}
+
+	bool bConverged = nSettledFrame <= EXPOSURE_BENCH_FRAMES - EXPOSURE_BENCH_HOLD;
+
+	printf("%10s%10.0f%10.0f%10d%10lu%10lu%10ld%10ld%10ld%10s\n",
+		scene.szName,
+		dStartLuma,
+		dLuma,
+		nSettledFrame - nFirstFrame,
+		dwWritesSettled,
+		controller.GetWriteCount() - dwWritesSettled,
+		device.GetApplied(ExposureChannel_Exposure),
+		device.GetApplied(ExposureChannel_Gain),
+		device.GetApplied(ExposureChannel_WhiteBalance),
+		bConverged ? "yes" : "NO");
+}
+
+void WebCamBench::RunExposureBenchmark(double /*dSeconds*/)
+{
+	static const char* const s_aszColumns[] = { "Scene", "From luma", "To luma", "Frames", "Writes", "After", "Exposure", "Gain", "White K", "Settled" };
+	static const ExposureBenchScene s_aScenes[] =
+	{
+		{ "on target", 118.0, 0.0, 0, 4600.0, false, 0 },
+		{ "dim room", 40.0, 0.0, 0, 4600.0, false, 0 },
+		{ "night", 30.0, 0.0, 0, 4600.0, false, 0 },
+		{ "night cap", 30.0, 0.0, 0, 4600.0, false, -5 },
+		{ "window", 250.0, 0.0, 0, 4600.0, false, 0 },
+		{ "lights off", 118.0, 50.0, 120, 4600.0, false, 0 },
+		{ "lights on", 60.0, 200.0, 120, 4600.0, false, 0 },
+		{ "warm lamp", 90.0, 0.0, 0, 3000.0, true, 0 },
+		{ "daylight", 150.0, 0.0, 0, 6200.0, true, 0 },
+	};
+
+	PrintBenchHeader("Software exposure against a simulated camera at 30 frames per second; frames to settle within the tolerance after the start or the change of light",
+		s_aszColumns, sizeof(s_aszColumns) / sizeof(s_aszColumns[0]));
+
+	for (size_t n = 0; n < sizeof(s_aScenes) / sizeof(s_aScenes[0]); n++)
+	{
+		RunExposurePass(s_aScenes[n]);
+	}
+}
@@ -0,0 +1,20 @@
+//*****************************************************************************************
+//  File:       ExposureBench.h
+//  Project:    WebCamBench
+//
+//  Declares the software auto-exposure and white balance convergence check
+//*****************************************************************************************
+
+#pragma once
+
+namespace WebCamBench
+{
+	/// <summary>
+	/// Runs the ExposureController against a simulated camera, which applies writes a few frames
+	/// late and whose gain and white balance do not span quite what the controller assumes, over
+	/// scenes from night to a bright window, a sudden change of light and a warm lamp. Reports the
+	/// frames each one takes to settle within the tolerance, the writes made before and after, and
+	/// whether it settled at all. Time is simulated, so dSeconds is not used.
+	/// </summary>
+	void RunExposureBenchmark(double dSeconds);
+}
@@ -0,0 +1,234 @@
+//*****************************************************************************************
+//  File:       FrameBusBench.cpp
+//  Project:    WebCamBench
+//
+//  Defines the frame bus latency and throughput benchmark
+//*****************************************************************************************
+
+#include <windows.h>
+#include <strsafe.h>
+#include <stdio.h>
+
+#include "FrameBuffer.h"
+#include "FrameBus.h"
+
+#include "BenchHarness.h"
+#include "FrameBusBench.h"
+
+using namespace WebCamLib;
+using namespace WebCamBench;
+
+#define FRAMEBUS_BENCH_WIDTH		640
+#define FRAMEBUS_BENCH_HEIGHT		480
+#define FRAMEBUS_BENCH_BPP			24
+#define FRAMEBUS_BENCH_SLOTS		8
+
+// Rate of the latency pass, a fast camera's
+#define FRAMEBUS_BENCH_PACED_FPS	60
+
+// How long a reader waits for a frame before looking at the stop flag again
+#define FRAMEBUS_BENCH_WAIT_MS		50
+
+struct FrameBusBenchReader
+{
+	WCHAR wszName[MAX_PATH];
+	volatile LONG* pbStop;
+	volatile LONG* pnReady;
+
+	HRESULT hr;
+	LONG nFrames;
+	LONG nTorn;
+	LONG nMissed;
+	BenchSamples latency;
+};
+
+static DWORD WINAPI FrameBusBenchReaderProc(LPVOID pParameter)
+{
+	FrameBusBenchReader* pReader = static_cast<FrameBusBenchReader*>(pParameter);
+
+	FrameBusClient client;
+	pReader->hr = client.Open(pReader->wszName);
+	InterlockedIncrement(pReader->pnReady);
+
+	if (FAILED(pReader->hr))
+		return 0;
+
+	std::vector<BYTE> aCopy;
+
+	while (!*pReader->pbStop)
+	{
+		if (!client.WaitForFrame(FRAMEBUS_BENCH_WAIT_MS))
+			continue;
+
+		FrameBusFrame frame;
+		if (!client.ReadLatest(&frame))
+			continue;
+
+		// What FrameBusView.CopyTo does: copy out, then make sure the writer left the slot alone
+		if (aCopy.size() < frame.dwSize)
+			aCopy.resize(frame.dwSize);
+
+		CopyMemory(&aCopy[0], frame.pData, frame.dwSize);
+
+		if (!client.IsIntact(frame))
+		{
+			pReader->nTorn++;
+			continue;
+		}
+
+		pReader->latency.Add(BenchClock::ToMicroseconds(BenchClock::Now() - frame.llTimestamp));
+		pReader->nFrames++;
+	}
+
+	pReader->nMissed = client.GetMissedCount();
+
+	return 0;
+}
+
+static void RunFrameBusPass(int nReaders, int nFramesPerSecond, double dSeconds)
+{
+	static LONG s_nPass = 0;
+
+	WCHAR wszName[MAX_PATH];
+	StringCchPrintfW(wszName, MAX_PATH, L"Local\\WebCamBench.%u.%d", GetCurrentProcessId(), InterlockedIncrement(&s_nPass));
+
+	FrameBusWriter writer;
+	FramePool* pPool = new FramePool();
+	FrameBuffer* pFrame = pPool->Acquire(FRAMEBUS_BENCH_WIDTH, -FRAMEBUS_BENCH_HEIGHT, FRAMEBUS_BENCH_BPP);
+
+	HRESULT hr = pFrame != NULL ? S_OK : E_OUTOFMEMORY;
+	if (SUCCEEDED(hr))
+	{
+		FillMemory(pFrame->GetData(), pFrame->GetSize(), 0x80);
+		hr = writer.Create(wszName, FRAMEBUS_BENCH_SLOTS, pFrame->GetSize());
+	}
+
+	if (FAILED(hr))
+	{
+		printf("Could not create the frame bus: 0x%08x\n", hr);
+		if (pFrame != NULL)
+			pFrame->Release();
+		pPool->Release();
+		return;
+	}
+
+	volatile LONG bStop = FALSE;
+	volatile LONG nReady = 0;
+
+	std::vector<FrameBusBenchReader> aReaders(nReaders);
+	std::vector<HANDLE> ahThreads;
+
+	for (int n = 0; n < nReaders; n++)
+	{
+		FrameBusBenchReader& reader = aReaders[n];
+		StringCchCopyW(reader.wszName, MAX_PATH, wszName);
+		reader.pbStop = &bStop;
+		reader.pnReady = &nReady;
+		reader.hr = S_OK;
+		reader.nFrames = 0;
+		reader.nTorn = 0;
+		reader.nMissed = 0;
+
+		HANDLE hThread = CreateThread(NULL, 0, FrameBusBenchReaderProc, &reader, 0, NULL);
+		if (hThread == NULL)
+			break;
+
+		ahThreads.push_back(hThread);
+	}
+
+	while (nReady < static_cast<LONG>(ahThreads.size()))
+	{
+		Sleep(1);
+	}
+
+	LONGLONG llInterval = nFramesPerSecond > 0 ? BenchClock::FromSeconds(1.0 / nFramesPerSecond) : 0;
+	LONGLONG llStart = BenchClock::Now();
+	LONGLONG llNextDue = llStart;
+	LONG nPublished = 0;
+
+	while (BenchClock::ToSeconds(BenchClock::Now() - llStart) < dSeconds)
+	{
+		if (llInterval > 0)
+		{
+			llNextDue += llInterval;
+
+			// Sleep is only good to a millisecond or so, the last stretch is spent yielding
+			for (;;)
+			{
+				double dRemaining = BenchClock::ToSeconds(llNextDue - BenchClock::Now());
+				if (dRemaining <= 0.0)
+					break;
+
+				if (dRemaining > 0.002)
+					Sleep(1);
+				else
+					SwitchToThread();
+			}
+		}
+
+		pFrame->SetTimestamp(BenchClock::Now(), 0.0);
+		if (writer.Publish(pFrame))
+			nPublished++;
+	}
+
+	double dElapsed = BenchClock::ToSeconds(BenchClock::Now() - llStart);
+
+	InterlockedExchange(&bStop, TRUE);
+	WaitForMultipleObjects(static_cast<DWORD>(ahThreads.size()), &ahThreads[0], TRUE, INFINITE);
+
+	BenchSamples latency;
+	LONG nRead = 0;
+	LONG nTorn = 0;
+	LONG nMissed = 0;
+
+	for (size_t n = 0; n < ahThreads.size(); n++)
+	{
+		CloseHandle(ahThreads[n]);
+
+		const FrameBusBenchReader& reader = aReaders[n];
+		if (FAILED(reader.hr))
+			printf("Reader %d could not open the bus: 0x%08x\n", static_cast<int>(n), reader.hr);
+
+		nRead += reader.nFrames;
+		nTorn += reader.nTorn;
+		nMissed += reader.nMissed;
+
+		latency.Add(reader.latency);
+	}
+
+	double dReadersRead = ahThreads.empty() ? 0.0 : static_cast<double>(nRead) / ahThreads.size();
+	double dMissedPercent = nRead + nMissed > 0 ? 100.0 * nMissed / (nRead + nMissed) : 0.0;
+
+	printf("%10d%10s%10.0f%10.0f%10.0f%10.0f%9.1f%%%10d\n",
+		nReaders,
+		nFramesPerSecond > 0 ? "paced" : "flat out",
+		nPublished / dElapsed,
+		dReadersRead / dElapsed,
+		latency.GetPercentile(0.5),
+		latency.GetPercentile(0.99),
+		dMissedPercent,
+		nTorn);
+
+	writer.Close();
+	pFrame->Release();
+	pPool->Release();
+}
+
+void WebCamBench::RunFrameBusBenchmark(double dSeconds)
+{
+	static const char* const s_aszColumns[] = { "Readers", "Writer", "Written/s", "Read/s", "p50 us", "p99 us", "Missed", "Torn" };
+	static const int s_anReaders[] = { 1, 4, 16 };
+
+	PrintBenchHeader("Frame bus, 640x480 RGB24, 8 slots; Read/s is per reader, latency from arrival to a checked copy",
+		s_aszColumns, sizeof(s_aszColumns) / sizeof(s_aszColumns[0]));
+
+	for (size_t n = 0; n < sizeof(s_anReaders) / sizeof(s_anReaders[0]); n++)
+	{
+		RunFrameBusPass(s_anReaders[n], FRAMEBUS_BENCH_PACED_FPS, dSeconds);
+	}
+
+	for (size_t n = 0; n < sizeof(s_anReaders) / sizeof(s_anReaders[0]); n++)
+	{
+		RunFrameBusPass(s_anReaders[n], 0, dSeconds);
+	}
+}
@@ -0,0 +1,19 @@
+//*****************************************************************************************
+//  File:       FrameBusBench.h
+//  Project:    WebCamBench
+//
+//  Declares the frame bus latency and throughput benchmark
+//*****************************************************************************************
+
+#pragma once
+
+namespace WebCamBench
+{
+	/// <summary>
+	/// Publishes 640x480 RGB24 frames on a frame bus read by 1, 4 and 16 readers, first at 60 frames
+	/// per second for the latency from arrival to a reader's checked copy, then as fast as the writer
+	/// can for frames per second. Readers are threads, each with its own mapping of the bus as another
+	/// process would have. Each pass runs for dSeconds.
+	/// </summary>
+	void RunFrameBusBenchmark(double dSeconds);
+}
@@ -0,0 +1,213 @@
+//*****************************************************************************************
+//  File:       JitterBench.cpp
+//  Project:    WebCamBench
+//
+//  Defines the pipeline dispatch latency benchmark under CPU load
+//*****************************************************************************************
+
+#include <windows.h>
+#include <stdio.h>
+
+#include "FrameBuffer.h"
+#include "ProcessingPipeline.h"
+#include "ThreadPlacement.h"
+
+#include "BenchHarness.h"
+#include "JitterBench.h"
+
+using namespace WebCamLib;
+using namespace WebCamBench;
+
+#define JITTER_BENCH_WIDTH		640
+#define JITTER_BENCH_HEIGHT		480
+#define JITTER_BENCH_BPP		24
+#define JITTER_BENCH_FRAME_MS	33
+
+// Branches beside the main chain, e.g. recording, detection and streaming
+#define JITTER_BENCH_BRANCHES	3
+
+// Arithmetic a load thread does between looks at the stop flag
+#define JITTER_BENCH_SPIN		10000
+
+/// <summary>
+/// Reading stage which notes how long after the frame was handed to the pipeline it was started
+/// </summary>
+class JitterProbeStage : public ProcessingStage
+{
+public:
+	explicit JitterProbeStage(const volatile LONGLONG* pllDispatched)
+		: ProcessingStage(StageKind_Analyse, StageAccess_Read, L"Jitter probe")
+	{
+		m_pllDispatched = pllDispatched;
+	}
+
+	virtual HRESULT Process(FrameBuffer* /*pInput*/, FrameBuffer* /*pOutput*/)
+	{
+		m_latency.Add(BenchClock::ToMicroseconds(BenchClock::Now() - *m_pllDispatched));
+		return S_OK;
+	}
+
+	const BenchSamples& GetLatency() const
+	{
+		return m_latency;
+	}
+
+	void ResetLatency()
+	{
+		m_latency.Clear();
+	}
+
+private:
+	const volatile LONGLONG* m_pllDispatched;
+	BenchSamples m_latency;
+};
+
+static DWORD WINAPI JitterBenchLoadProc(LPVOID pParameter)
+{
+	volatile LONG* pbStop = static_cast<volatile LONG*>(pParameter);
+	volatile double dSink = 0.0;
+
+	while (!*pbStop)
+	{
+		double dValue = dSink;
+		for (int n = 0; n < JITTER_BENCH_SPIN; n++)
+		{
+			dValue = dValue * 0.999999 + 1.0;
+		}
+		dSink = dValue;
+	}
+
+	return 0;
+}
+
+static void RunJitterPass(const char* szLoad, bool bLoad, bool bPlacement, double dSeconds)
+{
+	FramePool* pPool = new FramePool();
+	FrameBuffer* pFrame = pPool->Acquire(JITTER_BENCH_WIDTH, -JITTER_BENCH_HEIGHT, JITTER_BENCH_BPP);
+
+	if (pFrame == NULL)
+	{
+		printf("Could not allocate the frame\n");
+		pPool->Release();
+		return;
+	}
+
+	FillMemory(pFrame->GetData(), pFrame->GetSize(), 0x80);
+
+	volatile LONGLONG llDispatched = 0;
+
+	ProcessingPipeline* pPipeline = new ProcessingPipeline();
+	JitterProbeStage* apProbes[JITTER_BENCH_BRANCHES];
+
+	for (int n = 0; n < JITTER_BENCH_BRANCHES; n++)
+	{
+		apProbes[n] = new JitterProbeStage(&llDispatched);
+		pPipeline->AddStage(pPipeline->AddBranch(), apProbes[n]);
+	}
+
+	HRESULT hr = S_OK;
+	ThreadPlacement placement;
+
+	if (bPlacement)
+	{
+		placement.nPriority = THREAD_PRIORITY_HIGHEST;
+		hr = pPipeline->SetWorkerPlacement(placement);
+
+		// The thread running the pipeline takes part in the work too; in a session that is the
+		// capture thread, placed the same way through CaptureThreadPlacement
+		if (SUCCEEDED(hr))
+			hr = ApplyThreadPlacement(GetCurrentThread(), placement, -1);
+	}
+
+	volatile LONG bStop = FALSE;
+	std::vector<HANDLE> ahLoad;
+
+	if (SUCCEEDED(hr) && bLoad)
+	{
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+
+		for (DWORD n = 0; n < si.dwNumberOfProcessors; n++)
+		{
+			HANDLE hThread = CreateThread(NULL, 0, JitterBenchLoadProc, const_cast<LONG*>(&bStop), 0, NULL);
+			if (hThread == NULL)
+				break;
+
+			ahLoad.push_back(hThread);
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		// The first frame creates the worker threads, so it is not timed
+		FrameBuffer* pOutput = pPipeline->Run(pFrame);
+		if (pOutput != NULL)
+			pOutput->Release();
+
+		for (int n = 0; n < JITTER_BENCH_BRANCHES; n++)
+		{
+			apProbes[n]->ResetLatency();
+		}
+
+		LONGLONG llEnd = BenchClock::Now() + BenchClock::FromSeconds(dSeconds);
+
+		while (BenchClock::Now() < llEnd)
+		{
+			Sleep(JITTER_BENCH_FRAME_MS);
+
+			llDispatched = BenchClock::Now();
+			pOutput = pPipeline->Run(pFrame);
+			if (pOutput != NULL)
+				pOutput->Release();
+		}
+	}
+
+	InterlockedExchange(&bStop, TRUE);
+
+	for (size_t n = 0; n < ahLoad.size(); n++)
+	{
+		WaitForSingleObject(ahLoad[n], INFINITE);
+		CloseHandle(ahLoad[n]);
+	}
+
+	if (bPlacement)
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_NORMAL);
+
+	if (FAILED(hr))
+	{
+		printf("%10s could not be placed: 0x%08x\n", szLoad, hr);
+	}
+	else
+	{
+		BenchSamples latency;
+		for (int n = 0; n < JITTER_BENCH_BRANCHES; n++)
+		{
+			latency.Add(apProbes[n]->GetLatency());
+		}
+
+		printf("%10s%10s%10d%10.0f%10.0f%10.0f%10.0f\n",
+			szLoad,
+			bPlacement ? "highest" : "none",
+			latency.GetCount(),
+			latency.GetPercentile(0.5),
+			latency.GetPercentile(0.99),
+			latency.GetPercentile(0.999),
+			latency.GetPercentile(1.0));
+	}
+
+	pPipeline->Release();
+	pFrame->Release();
+	pPool->Release();
+}
+
+void WebCamBench::RunJitterBenchmark(double dSeconds)
+{
+	static const char* const s_aszColumns[] = { "Load", "Placement", "Samples", "p50 us", "p99 us", "p99.9 us", "max us" };
+
+	PrintBenchHeader("Pipeline dispatch latency, 640x480 at 30 fps with 3 branches; us from handing over a frame to a branch starting on it",
+		s_aszColumns, sizeof(s_aszColumns) / sizeof(s_aszColumns[0]));
+
+	RunJitterPass("idle", false, false, dSeconds);
+	RunJitterPass("busy", true, false, dSeconds);
+	RunJitterPass("busy", true, true, dSeconds);
+}
@@ -0,0 +1,20 @@
+//*****************************************************************************************
+//  File:       JitterBench.h
+//  Project:    WebCamBench
+//
+//  Declares the pipeline dispatch latency benchmark under CPU load
+//*****************************************************************************************
+
+#pragma once
+
+namespace WebCamBench
+{
+	/// <summary>
+	/// Runs 640x480 frames at 30 per second through a ProcessingPipeline whose branches only note
+	/// when they start, first on an idle machine, then with a busy thread on every processor, and
+	/// then under the same load once SetWorkerPlacement has raised the worker threads' priority.
+	/// Reports the percentiles of the time from handing the pipeline a frame to each branch
+	/// starting on it. Each pass runs for dSeconds.
+	/// </summary>
+	void RunJitterBenchmark(double dSeconds);
+}
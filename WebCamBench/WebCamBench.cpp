@@ -0,0 +1,84 @@
+//*****************************************************************************************
+//  File:       WebCamBench.cpp
+//  Project:    WebCamBench
+//
+//  Runs the native benchmarks of WebCamLib from the command line:
+//      WebCamBench [suite] [seconds per pass]
+//*****************************************************************************************
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+#include "BenchHarness.h"
+#include "CascadeBench.h"
+#include "CodecBench.h"
+#include "DenoiseBench.h"
+#include "ExposureBench.h"
+#include "FrameBusBench.h"
+#include "JitterBench.h"
+
+using namespace WebCamBench;
+
+#define BENCH_DEFAULT_SECONDS	2.0
+
+struct BenchSuite
+{
+	LPCWSTR wszName;
+	LPCSTR szDescription;
+	void (*pfnRun)(double dSeconds);
+};
+
+static const BenchSuite s_aSuites[] =
+{
+	{ L"framebus", "frame bus latency and frames per second with 1, 4 and 16 readers", RunFrameBusBenchmark },
+	{ L"denoise", "temporal denoise PSNR against synthetic noise, and throughput", RunDenoiseBenchmark },
+	{ L"codec", "lossless recording codec ratio and speed over synthetic corpora", RunCodecBenchmark },
+	{ L"exposure", "software exposure and white balance convergence on a simulated camera", RunExposureBenchmark },
+	{ L"cascade", "Haar and LBP cascade detection time per 640x480 frame, on one thread and the pool", RunCascadeBenchmark },
+	{ L"jitter", "pipeline dispatch latency under CPU load, with and without worker placement", RunJitterBenchmark },
+};
+
+#define BENCH_SUITE_COUNT	(sizeof(s_aSuites) / sizeof(s_aSuites[0]))
+
+static void PrintUsage()
+{
+	printf("WebCamBench [suite] [seconds per pass]\n\nSuites, all of them when none is given:\n");
+
+	for (size_t n = 0; n < BENCH_SUITE_COUNT; n++)
+	{
+		printf("  %-10S %s\n", s_aSuites[n].wszName, s_aSuites[n].szDescription);
+	}
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+	LPCWSTR wszSuite = argc > 1 ? argv[1] : NULL;
+	double dSeconds = argc > 2 ? _wtof(argv[2]) : BENCH_DEFAULT_SECONDS;
+
+	if (dSeconds <= 0.0)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	bool bFound = false;
+
+	for (size_t n = 0; n < BENCH_SUITE_COUNT; n++)
+	{
+		if (wszSuite == NULL || _wcsicmp(wszSuite, s_aSuites[n].wszName) == 0)
+		{
+			s_aSuites[n].pfnRun(dSeconds);
+			bFound = true;
+		}
+	}
+
+	if (!bFound)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	return 0;
+}
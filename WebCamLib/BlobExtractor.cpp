@@ -0,0 +1,143 @@
+//*****************************************************************************************
+//  File:       BlobExtractor.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed entry point to the native connected components labeller
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "WorkerPool.h"
+#include "BlobLabeller.h"
+#include "BlobExtractor.h"
+
+using namespace WebCamLib;
+
+BlobInfo::BlobInfo( int label, int area, int left, int top, int right, int bottom, double centroidX, double centroidY, double mu20, double mu11, double mu02 )
+{
+	this->label = label;
+	this->area = area;
+	this->left = left;
+	this->top = top;
+	this->right = right;
+	this->bottom = bottom;
+	this->centroidX = centroidX;
+	this->centroidY = centroidY;
+	this->mu20 = mu20;
+	this->mu11 = mu11;
+	this->mu02 = mu02;
+}
+
+BlobExtractor::BlobExtractor()
+{
+	pLabeller = new BlobLabeller();
+}
+
+BlobExtractor::BlobExtractor( bool parallel )
+{
+	pLabeller = new BlobLabeller();
+
+	if( parallel )
+		pLabeller->SetWorkerPool( WorkerPool::GetShared() );
+}
+
+BlobExtractor::~BlobExtractor()
+{
+	this->!BlobExtractor();
+}
+
+BlobExtractor::!BlobExtractor()
+{
+	delete pLabeller;
+	pLabeller = NULL;
+}
+
+BlobLabeller* BlobExtractor::GetLabeller()
+{
+	if( pLabeller == NULL )
+		throw gcnew ObjectDisposedException( "BlobExtractor" );
+
+	return pLabeller;
+}
+
+int BlobExtractor::Connectivity::get()
+{
+	return GetLabeller()->GetConnectivity();
+}
+
+void BlobExtractor::Connectivity::set( int value )
+{
+	BlobLabeller* pNative = GetLabeller();
+
+	if( value != 4 && value != 8 )
+		throw gcnew ArgumentOutOfRangeException( "Connectivity must be 4 or 8." );
+
+	pNative->SetConnectivity( value );
+}
+
+int BlobExtractor::MinimumArea::get()
+{
+	return GetLabeller()->GetMinimumArea();
+}
+
+void BlobExtractor::MinimumArea::set( int value )
+{
+	GetLabeller()->SetMinimumArea( value );
+}
+
+int BlobExtractor::BlobCount::get()
+{
+	return GetLabeller()->GetBlobCount();
+}
+
+int BlobExtractor::Extract( IntPtr mask, int width, int height, int stride )
+{
+	BlobLabeller* pNative = GetLabeller();
+
+	if( mask == IntPtr::Zero )
+		throw gcnew ArgumentNullException( "mask" );
+
+	if( stride < width )
+		throw gcnew ArgumentException( "Stride cannot be smaller than the width." );
+
+	return pNative->Label( static_cast<const BYTE*>( mask.ToPointer() ), width, height, stride );
+}
+
+int BlobExtractor::Extract( array<Byte>^ mask, int width, int height, int stride )
+{
+	if( mask == nullptr )
+		throw gcnew ArgumentNullException( "mask" );
+
+	if( height > 0 && mask->Length < ( height - 1 ) * stride + width )
+		throw gcnew ArgumentException( "Mask is smaller than width, height and stride describe." );
+
+	if( mask->Length == 0 )
+		return 0;
+
+	pin_ptr<Byte> pMask = &mask[0];
+
+	return Extract( IntPtr( pMask ), width, height, stride );
+}
+
+BlobInfo BlobExtractor::GetBlob( int index )
+{
+	BlobLabeller* pNative = GetLabeller();
+
+	int count = pNative->GetBlobCount();
+	if( index < 0 || index >= count )
+		throw gcnew ArgumentOutOfRangeException( "Blob index is out of bounds: " + count.ToString() );
+
+	const BlobStatistics& blob = pNative->GetBlob( index );
+
+	return BlobInfo( blob.nLabel, blob.nArea, blob.nLeft, blob.nTop, blob.nRight, blob.nBottom, blob.dCentroidX, blob.dCentroidY, blob.dMu20, blob.dMu11, blob.dMu02 );
+}
+
+void BlobExtractor::GetBlobs( IList<BlobInfo>^ blobs )
+{
+	blobs->Clear();
+
+	for( int i = 0; i < BlobCount; ++i )
+	{
+		blobs->Add( GetBlob( i ) );
+	}
+}
@@ -0,0 +1,147 @@
+//*****************************************************************************************
+//  File:       BlobExtractor.h
+//  Project:    WebcamLib
+//
+//  Declares the managed entry point to the native connected components labeller
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+using namespace System::Collections::Generic;
+
+namespace WebCamLib
+{
+	class BlobLabeller;
+
+	/// <summary>
+	/// Area, bounds, centroid and central moments of one connected component
+	/// </summary>
+	public value struct BlobInfo
+	{
+	public:
+		BlobInfo( int label, int area, int left, int top, int right, int bottom, double centroidX, double centroidY, double mu20, double mu11, double mu02 );
+
+		property int Label
+		{
+			int get() { return label; }
+		}
+
+		property int Area
+		{
+			int get() { return area; }
+		}
+
+		property int Left
+		{
+			int get() { return left; }
+		}
+
+		property int Top
+		{
+			int get() { return top; }
+		}
+
+		property int Width
+		{
+			int get() { return right - left + 1; }
+		}
+
+		property int Height
+		{
+			int get() { return bottom - top + 1; }
+		}
+
+		property double CentroidX
+		{
+			double get() { return centroidX; }
+		}
+
+		property double CentroidY
+		{
+			double get() { return centroidY; }
+		}
+
+		property double Mu20
+		{
+			double get() { return mu20; }
+		}
+
+		property double Mu11
+		{
+			double get() { return mu11; }
+		}
+
+		property double Mu02
+		{
+			double get() { return mu02; }
+		}
+
+		/// <summary>
+		/// Angle of the major axis in radians, derived from the central moments
+		/// </summary>
+		property double Orientation
+		{
+			double get() { return 0.5 * Math::Atan2( 2.0 * mu11, mu20 - mu02 ); }
+		}
+
+	private:
+		int label, area, left, top, right, bottom;
+		double centroidX, centroidY, mu20, mu11, mu02;
+	};
+
+	/// <summary>
+	/// Extracts blobs from 8 bit binary masks (zero is background, anything else foreground)
+	/// </summary>
+	public ref class BlobExtractor
+	{
+	public:
+		BlobExtractor();
+
+		/// <summary>
+		/// When parallel is set, tall masks are labelled in strips on the shared worker pool
+		/// </summary>
+		BlobExtractor( bool parallel );
+
+		~BlobExtractor();
+
+		property int Connectivity
+		{
+			int get();
+			void set( int value );
+		}
+
+		property int MinimumArea
+		{
+			int get();
+			void set( int value );
+		}
+
+		property int BlobCount
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Labels the mask and returns the number of blobs found
+		/// </summary>
+		int Extract( IntPtr mask, int width, int height, int stride );
+
+		int Extract( array<Byte>^ mask, int width, int height, int stride );
+
+		BlobInfo GetBlob( int index );
+
+		/// <summary>
+		/// Replaces the contents of the list with the blobs of the last extraction
+		/// </summary>
+		void GetBlobs( IList<BlobInfo>^ blobs );
+
+	protected:
+		!BlobExtractor();
+
+	private:
+		BlobLabeller* GetLabeller();
+
+		BlobLabeller* pLabeller;
+	};
+}
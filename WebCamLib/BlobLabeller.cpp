@@ -0,0 +1,322 @@
+//*****************************************************************************************
+//  File:       BlobLabeller.cpp
+//  Project:    WebcamLib
+//
+//  Defines the run-length connected components labeller for binary masks
+//*****************************************************************************************
+
+#include <windows.h>
+#include <intrin.h>
+#include <emmintrin.h>
+
+#include "WorkerPool.h"
+#include "BlobLabeller.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Strips thinner than this cost more to stitch than they save
+#define MIN_STRIP_ROWS 32
+
+BlobLabeller::BlobLabeller()
+{
+	m_nConnectivity = 8;
+	m_nMinimumArea = 1;
+	m_pPool = NULL;
+	m_pMask = NULL;
+	m_nWidth = 0;
+	m_nStride = 0;
+}
+
+void BlobLabeller::SetConnectivity(int nConnectivity)
+{
+	m_nConnectivity = nConnectivity == 4 ? 4 : 8;
+}
+
+int BlobLabeller::Label(const BYTE* pMask, int nWidth, int nHeight, int nStride)
+{
+	m_aBlobs.clear();
+
+	if (pMask == NULL || nWidth <= 0 || nHeight <= 0)
+		return 0;
+
+	m_pMask = pMask;
+	m_nWidth = nWidth;
+	m_nStride = nStride;
+
+	int nStrips = 1;
+	if (m_pPool != NULL)
+	{
+		nStrips = min(m_pPool->GetConcurrency(), nHeight / MIN_STRIP_ROWS);
+		if (nStrips < 1)
+			nStrips = 1;
+	}
+
+	// Resizing keeps the storage of the strips which survive, so a steady frame size never reallocates
+	m_aStrips.resize(nStrips);
+
+	int nFirstRow = 0;
+	for (int n = 0; n < nStrips; n++)
+	{
+		Strip& strip = m_aStrips[n];
+		strip.nFirstRow = nFirstRow;
+		strip.nLastRow = (nHeight * (n + 1)) / nStrips - 1;
+		nFirstRow = strip.nLastRow + 1;
+	}
+
+	if (nStrips > 1)
+		m_pPool->Run(LabelStripProc, this, nStrips);
+	else
+		LabelStrip(m_aStrips[0]);
+
+	// Gather the strip local forests into one, rebasing the parent links
+	int nRuns = 0;
+	for (int n = 0; n < nStrips; n++)
+	{
+		m_aStrips[n].nRunOffset = nRuns;
+		nRuns += static_cast<int>(m_aStrips[n].aRuns.size());
+	}
+
+	m_aParents.resize(nRuns);
+	for (int n = 0; n < nStrips; n++)
+	{
+		const Strip& strip = m_aStrips[n];
+		int nCount = static_cast<int>(strip.aParents.size());
+		for (int nRun = 0; nRun < nCount; nRun++)
+		{
+			m_aParents[strip.nRunOffset + nRun] = strip.aParents[nRun] + strip.nRunOffset;
+		}
+	}
+
+	for (int n = 1; n < nStrips; n++)
+	{
+		MergeStrips(m_aStrips[n - 1], m_aStrips[n]);
+	}
+
+	Accumulate();
+
+	return GetBlobCount();
+}
+
+void BlobLabeller::LabelStripProc(void* pContext, int nStrip)
+{
+	BlobLabeller* pLabeller = static_cast<BlobLabeller*>(pContext);
+	pLabeller->LabelStrip(pLabeller->m_aStrips[nStrip]);
+}
+
+void BlobLabeller::LabelStrip(Strip& strip)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	strip.aRuns.clear();
+	strip.aParents.clear();
+	strip.aRowStarts.resize(strip.nLastRow - strip.nFirstRow + 2);
+
+	for (int nRow = strip.nFirstRow; nRow <= strip.nLastRow; nRow++)
+	{
+		const BYTE* pLine = m_pMask + static_cast<ptrdiff_t>(nRow) * m_nStride;
+		int nRowIndex = nRow - strip.nFirstRow;
+		int nRowStart = static_cast<int>(strip.aRuns.size());
+		strip.aRowStarts[nRowIndex] = nRowStart;
+
+		int x = 0;
+		while (x < m_nWidth)
+		{
+			// Skip background sixteen pixels at a time
+			unsigned long nBit;
+			while (x + 16 <= m_nWidth)
+			{
+				int nZeros = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pLine + x)), zero));
+				if (nZeros != 0xFFFF)
+				{
+					_BitScanForward(&nBit, ~nZeros & 0xFFFF);
+					x += nBit;
+					break;
+				}
+				x += 16;
+			}
+			while (x < m_nWidth && pLine[x] == 0)
+				x++;
+
+			if (x >= m_nWidth)
+				break;
+
+			Run run;
+			run.nStart = x;
+			run.nRow = nRow;
+
+			// Then the foreground, in the same fashion
+			while (x + 16 <= m_nWidth)
+			{
+				int nZeros = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pLine + x)), zero));
+				if (nZeros != 0)
+				{
+					_BitScanForward(&nBit, nZeros);
+					x += nBit;
+					break;
+				}
+				x += 16;
+			}
+			while (x < m_nWidth && pLine[x] != 0)
+				x++;
+
+			run.nEnd = x - 1;
+
+			strip.aParents.push_back(static_cast<int>(strip.aRuns.size()));
+			strip.aRuns.push_back(run);
+		}
+
+		if (nRowIndex > 0)
+		{
+			// Walk the previous row and this one together, joining runs which touch
+			int nAbove = strip.aRowStarts[nRowIndex - 1];
+			int nBelow = nRowStart;
+			int nBelowEnd = static_cast<int>(strip.aRuns.size());
+
+			while (nAbove < nRowStart && nBelow < nBelowEnd)
+			{
+				const Run& above = strip.aRuns[nAbove];
+				const Run& below = strip.aRuns[nBelow];
+
+				if (Touches(above, below))
+					Union(strip.aParents, nAbove, nBelow);
+
+				if (above.nEnd < below.nEnd)
+					nAbove++;
+				else
+					nBelow++;
+			}
+		}
+	}
+
+	strip.aRowStarts[strip.nLastRow - strip.nFirstRow + 1] = static_cast<int>(strip.aRuns.size());
+}
+
+void BlobLabeller::MergeStrips(const Strip& upper, const Strip& lower)
+{
+	int nUpperRows = upper.nLastRow - upper.nFirstRow + 1;
+
+	int nAbove = upper.aRowStarts[nUpperRows - 1];
+	int nAboveEnd = upper.aRowStarts[nUpperRows];
+	int nBelow = lower.aRowStarts[0];
+	int nBelowEnd = lower.aRowStarts[1];
+
+	while (nAbove < nAboveEnd && nBelow < nBelowEnd)
+	{
+		const Run& above = upper.aRuns[nAbove];
+		const Run& below = lower.aRuns[nBelow];
+
+		if (Touches(above, below))
+			Union(m_aParents, upper.nRunOffset + nAbove, lower.nRunOffset + nBelow);
+
+		if (above.nEnd < below.nEnd)
+			nAbove++;
+		else
+			nBelow++;
+	}
+}
+
+void BlobLabeller::Accumulate()
+{
+	m_aRootLabels.assign(m_aParents.size(), -1);
+	m_aAccumulators.clear();
+
+	for (size_t nStrip = 0; nStrip < m_aStrips.size(); nStrip++)
+	{
+		const Strip& strip = m_aStrips[nStrip];
+		int nCount = static_cast<int>(strip.aRuns.size());
+
+		for (int nRun = 0; nRun < nCount; nRun++)
+		{
+			const Run& run = strip.aRuns[nRun];
+
+			// Roots are always the first run of a component in raster order, so labels come out in that order too
+			int nRoot = FindRoot(m_aParents, strip.nRunOffset + nRun);
+			int nLabel = m_aRootLabels[nRoot];
+			if (nLabel < 0)
+			{
+				nLabel = static_cast<int>(m_aAccumulators.size());
+				m_aRootLabels[nRoot] = nLabel;
+
+				Accumulator acc;
+				ZeroMemory(&acc, sizeof(acc));
+				acc.nLeft = run.nStart;
+				acc.nRight = run.nEnd;
+				acc.nTop = run.nRow;
+				acc.nBottom = run.nRow;
+				m_aAccumulators.push_back(acc);
+			}
+
+			Accumulator& acc = m_aAccumulators[nLabel];
+
+			long long n = run.nEnd - run.nStart + 1;
+			long long s = run.nStart;
+			long long e = run.nEnd;
+			long long y = run.nRow;
+
+			// Closed forms of the sums of x and x^2 over [s, e]
+			long long llSumX = (s + e) * n / 2;
+			long long llSumXX = (e * (e + 1) * (2 * e + 1) - (s - 1) * s * (2 * s - 1)) / 6;
+
+			acc.nArea += static_cast<int>(n);
+			acc.nLeft = min(acc.nLeft, run.nStart);
+			acc.nRight = max(acc.nRight, run.nEnd);
+			acc.nBottom = run.nRow;
+			acc.llSumX += llSumX;
+			acc.llSumY += n * y;
+			acc.llSumXX += llSumXX;
+			acc.llSumXY += llSumX * y;
+			acc.llSumYY += n * y * y;
+		}
+	}
+
+	for (size_t nLabel = 0; nLabel < m_aAccumulators.size(); nLabel++)
+	{
+		const Accumulator& acc = m_aAccumulators[nLabel];
+		if (acc.nArea < m_nMinimumArea)
+			continue;
+
+		double dArea = acc.nArea;
+
+		BlobStatistics blob;
+		blob.nLabel = static_cast<int>(m_aBlobs.size());
+		blob.nArea = acc.nArea;
+		blob.nLeft = acc.nLeft;
+		blob.nTop = acc.nTop;
+		blob.nRight = acc.nRight;
+		blob.nBottom = acc.nBottom;
+		blob.dCentroidX = acc.llSumX / dArea;
+		blob.dCentroidY = acc.llSumY / dArea;
+		blob.dMu20 = acc.llSumXX - blob.dCentroidX * acc.llSumX;
+		blob.dMu11 = acc.llSumXY - blob.dCentroidX * acc.llSumY;
+		blob.dMu02 = acc.llSumYY - blob.dCentroidY * acc.llSumY;
+
+		m_aBlobs.push_back(blob);
+	}
+}
+
+int BlobLabeller::FindRoot(std::vector<int>& aParents, int nRun)
+{
+	while (aParents[nRun] != nRun)
+	{
+		// Path halving
+		aParents[nRun] = aParents[aParents[nRun]];
+		nRun = aParents[nRun];
+	}
+
+	return nRun;
+}
+
+void BlobLabeller::Union(std::vector<int>& aParents, int nRunA, int nRunB)
+{
+	int nRootA = FindRoot(aParents, nRunA);
+	int nRootB = FindRoot(aParents, nRunB);
+
+	if (nRootA < nRootB)
+		aParents[nRootB] = nRootA;
+	else if (nRootB < nRootA)
+		aParents[nRootA] = nRootB;
+}
+
+#pragma managed(pop)
@@ -0,0 +1,159 @@
+//*****************************************************************************************
+//  File:       BlobLabeller.h
+//  Project:    WebcamLib
+//
+//  Declares the run-length connected components labeller for binary masks
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	class WorkerPool;
+
+	/// <summary>
+	/// Area, bounds and moments of one connected component
+	/// </summary>
+	struct BlobStatistics
+	{
+		int nLabel;
+		int nArea;
+		int nLeft;
+		int nTop;
+		int nRight;
+		int nBottom;
+		double dCentroidX;
+		double dCentroidY;
+		double dMu20;	// central second order moments
+		double dMu11;
+		double dMu02;
+	};
+
+	/// <summary>
+	/// Labels the connected non-zero regions of an 8 bit mask.
+	/// The mask is reduced to horizontal runs which are merged with a union-find; large masks are
+	/// split in horizontal strips labelled in parallel and stitched together along the strip seams.
+	/// All working storage is kept between calls so steady state labelling does not allocate.
+	/// </summary>
+	class BlobLabeller
+	{
+	public:
+		BlobLabeller();
+
+		/// <summary>
+		/// 4 or 8 neighbour connectivity, 8 by default
+		/// </summary>
+		void SetConnectivity(int nConnectivity);
+
+		int GetConnectivity() const
+		{
+			return m_nConnectivity;
+		}
+
+		/// <summary>
+		/// Components smaller than this are dropped from the results
+		/// </summary>
+		void SetMinimumArea(int nMinimumArea)
+		{
+			m_nMinimumArea = nMinimumArea;
+		}
+
+		int GetMinimumArea() const
+		{
+			return m_nMinimumArea;
+		}
+
+		/// <summary>
+		/// Pool used to label strips in parallel, NULL to label on the calling thread
+		/// </summary>
+		void SetWorkerPool(WorkerPool* pPool)
+		{
+			m_pPool = pPool;
+		}
+
+		/// <summary>
+		/// Labels the mask and returns the number of components found
+		/// </summary>
+		int Label(const BYTE* pMask, int nWidth, int nHeight, int nStride);
+
+		int GetBlobCount() const
+		{
+			return static_cast<int>(m_aBlobs.size());
+		}
+
+		const BlobStatistics& GetBlob(int nIndex) const
+		{
+			return m_aBlobs[nIndex];
+		}
+
+	private:
+		struct Run
+		{
+			int nStart;
+			int nEnd;	// inclusive
+			int nRow;
+		};
+
+		struct Strip
+		{
+			int nFirstRow;
+			int nLastRow;
+			int nRunOffset;
+			std::vector<Run> aRuns;
+			std::vector<int> aParents;
+			std::vector<int> aRowStarts;
+		};
+
+		struct Accumulator
+		{
+			int nArea;
+			int nLeft;
+			int nTop;
+			int nRight;
+			int nBottom;
+			long long llSumX;
+			long long llSumY;
+			long long llSumXX;
+			long long llSumXY;
+			long long llSumYY;
+		};
+
+		static void LabelStripProc(void* pContext, int nStrip);
+
+		void LabelStrip(Strip& strip);
+
+		void MergeStrips(const Strip& upper, const Strip& lower);
+
+		void Accumulate();
+
+		static int FindRoot(std::vector<int>& aParents, int nRun);
+
+		static void Union(std::vector<int>& aParents, int nRunA, int nRunB);
+
+		bool Touches(const Run& above, const Run& below) const
+		{
+			int nReach = m_nConnectivity == 8 ? 1 : 0;
+			return above.nStart <= below.nEnd + nReach && above.nEnd + nReach >= below.nStart;
+		}
+
+		int m_nConnectivity;
+		int m_nMinimumArea;
+		WorkerPool* m_pPool;
+
+		const BYTE* m_pMask;
+		int m_nWidth;
+		int m_nStride;
+
+		std::vector<Strip> m_aStrips;
+		std::vector<int> m_aParents;
+		std::vector<int> m_aRootLabels;
+		std::vector<Accumulator> m_aAccumulators;
+		std::vector<BlobStatistics> m_aBlobs;
+	};
+}
+
+#pragma managed(pop)
@@ -0,0 +1,392 @@
+//*****************************************************************************************
+//  File:       CaptureFormatTable.cpp
+//  Project:    WebcamLib
+//
+//  Defines the per-device table of capture formats, read once from the driver
+//*****************************************************************************************
+
+#include <algorithm>
+#include <dshow.h>
+#include <math.h>
+
+#include "CaptureFormatTable.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Relative price of getting a format to the grabber's RGB24: none, a colour conversion, a decoder
+static int GetFormatCost(const GUID& subtype)
+{
+	if (subtype == MEDIASUBTYPE_RGB24 || subtype == MEDIASUBTYPE_RGB32)
+		return 0;
+
+	if (subtype == MEDIASUBTYPE_YUY2 || subtype == MEDIASUBTYPE_UYVY || subtype == MEDIASUBTYPE_NV12 ||
+		subtype == MEDIASUBTYPE_IYUV || subtype == MEDIASUBTYPE_YV12)
+		return 1;
+
+	return 2;
+}
+
+// Orders format indices by size, keeping capability order among equal sizes
+struct SizeOrder
+{
+	const std::vector<CaptureFormat>* pFormats;
+
+	bool operator()(int a, int b) const
+	{
+		const CaptureFormat& fa = (*pFormats)[a];
+		const CaptureFormat& fb = (*pFormats)[b];
+
+		if (fa.nWidth != fb.nWidth)
+			return fa.nWidth < fb.nWidth;
+
+		if (fa.nHeight != fb.nHeight)
+			return fa.nHeight < fb.nHeight;
+
+		return a < b;
+	}
+};
+
+struct AreaOrder
+{
+	const std::vector<CaptureFormat>* pFormats;
+
+	bool operator()(int a, int b) const
+	{
+		const CaptureFormat& fa = (*pFormats)[a];
+		const CaptureFormat& fb = (*pFormats)[b];
+
+		LONGLONG llAreaA = static_cast<LONGLONG>(fa.nWidth) * abs(fa.nHeight);
+		LONGLONG llAreaB = static_cast<LONGLONG>(fb.nWidth) * abs(fb.nHeight);
+
+		if (llAreaA != llAreaB)
+			return llAreaA < llAreaB;
+
+		return a < b;
+	}
+};
+
+CaptureFormatTable::CaptureFormatTable()
+{
+}
+
+CaptureFormatTable::~CaptureFormatTable()
+{
+	Clear();
+}
+
+void CaptureFormatTable::Clear()
+{
+	for (size_t n = 0; n < m_apMediaTypes.size(); n++)
+	{
+		AM_MEDIA_TYPE* pmt = m_apMediaTypes[n];
+
+		if (pmt->cbFormat != 0)
+			CoTaskMemFree(pmt->pbFormat);
+
+		if (pmt->pUnk != NULL)
+			pmt->pUnk->Release();
+
+		CoTaskMemFree(pmt);
+	}
+
+	m_aFormats.clear();
+	m_apMediaTypes.clear();
+	m_anBySize.clear();
+	m_anByArea.clear();
+}
+
+HRESULT CaptureFormatTable::Build(IAMStreamConfig* pConfig)
+{
+	Clear();
+
+	int iCount = 0, iSize = 0;
+	HRESULT hr = pConfig->GetNumberOfCapabilities(&iCount, &iSize);
+
+	// Only video capabilities are understood; anything else leaves the table empty
+	if (SUCCEEDED(hr) && iSize != sizeof(VIDEO_STREAM_CONFIG_CAPS))
+		iCount = 0;
+
+	for (int iFormat = 0; SUCCEEDED(hr) && iFormat < iCount; iFormat++)
+	{
+		VIDEO_STREAM_CONFIG_CAPS scc;
+		AM_MEDIA_TYPE* pmt = NULL;
+
+		if (FAILED(pConfig->GetStreamCaps(iFormat, &pmt, reinterpret_cast<BYTE*>(&scc))))
+			continue;
+
+		if (pmt->formattype == FORMAT_VideoInfo && pmt->cbFormat >= sizeof(VIDEOINFOHEADER) && pmt->pbFormat != NULL)
+		{
+			VIDEOINFOHEADER* pVih = reinterpret_cast<VIDEOINFOHEADER*>(pmt->pbFormat);
+
+			CaptureFormat format;
+			format.subtype = pmt->subtype;
+			format.nWidth = pVih->bmiHeader.biWidth;
+			format.nHeight = pVih->bmiHeader.biHeight;
+			format.nBitsPerPixel = pVih->bmiHeader.biBitCount;
+			format.llMinFrameInterval = scc.MinFrameInterval;
+			format.llMaxFrameInterval = scc.MaxFrameInterval;
+			format.nCapability = iFormat;
+
+			// Some drivers leave the caps empty and only fill in the media type
+			if (format.llMinFrameInterval <= 0)
+				format.llMinFrameInterval = pVih->AvgTimePerFrame;
+			if (format.llMaxFrameInterval < format.llMinFrameInterval)
+				format.llMaxFrameInterval = format.llMinFrameInterval;
+
+			m_aFormats.push_back(format);
+			m_apMediaTypes.push_back(pmt);
+		}
+		else
+		{
+			if (pmt->cbFormat != 0)
+				CoTaskMemFree(pmt->pbFormat);
+			if (pmt->pUnk != NULL)
+				pmt->pUnk->Release();
+			CoTaskMemFree(pmt);
+		}
+	}
+
+	if (FAILED(hr))
+	{
+		Clear();
+		return hr;
+	}
+
+	int nCount = GetCount();
+	m_anBySize.resize(nCount);
+	m_anByArea.resize(nCount);
+
+	for (int n = 0; n < nCount; n++)
+	{
+		m_anBySize[n] = n;
+		m_anByArea[n] = n;
+	}
+
+	SizeOrder sizeOrder = { &m_aFormats };
+	AreaOrder areaOrder = { &m_aFormats };
+
+	std::sort(m_anBySize.begin(), m_anBySize.end(), sizeOrder);
+	std::sort(m_anByArea.begin(), m_anByArea.end(), areaOrder);
+
+	return S_OK;
+}
+
+size_t CaptureFormatTable::FindSize(int nWidth, int nHeight) const
+{
+	size_t nLow = 0;
+	size_t nHigh = m_anBySize.size();
+
+	while (nLow < nHigh)
+	{
+		size_t nMiddle = (nLow + nHigh) / 2;
+		const CaptureFormat& format = m_aFormats[m_anBySize[nMiddle]];
+
+		if (format.nWidth < nWidth || (format.nWidth == nWidth && format.nHeight < nHeight))
+			nLow = nMiddle + 1;
+		else
+			nHigh = nMiddle;
+	}
+
+	return nLow;
+}
+
+bool CaptureFormatTable::IsMatch(int nIndex, int nWidth, int nHeight, int nBitsPerPixel) const
+{
+	const CaptureFormat& format = m_aFormats[nIndex];
+
+	return format.nWidth == nWidth && format.nHeight == nHeight && (nBitsPerPixel == -1 || format.nBitsPerPixel == nBitsPerPixel);
+}
+
+int CaptureFormatTable::FindExact(int nWidth, int nHeight, int nBitsPerPixel) const
+{
+	for (size_t n = FindSize(nWidth, nHeight); n < m_anBySize.size(); n++)
+	{
+		const CaptureFormat& format = m_aFormats[m_anBySize[n]];
+
+		if (format.nWidth != nWidth || format.nHeight != nHeight)
+			break;
+
+		if (IsMatch(m_anBySize[n], nWidth, nHeight, nBitsPerPixel))
+			return m_anBySize[n];
+	}
+
+	return -1;
+}
+
+int CaptureFormatTable::FindAtLeast(int nWidth, int nHeight, int nBitsPerPixel) const
+{
+	int nRows = abs(nHeight);
+	LONGLONG llArea = static_cast<LONGLONG>(nWidth) * nRows;
+
+	// Nothing smaller than the requested area can cover it
+	size_t nLow = 0;
+	size_t nHigh = m_anByArea.size();
+
+	while (nLow < nHigh)
+	{
+		size_t nMiddle = (nLow + nHigh) / 2;
+		const CaptureFormat& format = m_aFormats[m_anByArea[nMiddle]];
+
+		if (static_cast<LONGLONG>(format.nWidth) * abs(format.nHeight) < llArea)
+			nLow = nMiddle + 1;
+		else
+			nHigh = nMiddle;
+	}
+
+	// Smallest area first, so the first format covering the request is the nearest one
+	for (size_t n = nLow; n < m_anByArea.size(); n++)
+	{
+		const CaptureFormat& format = m_aFormats[m_anByArea[n]];
+
+		if (format.nWidth >= nWidth && abs(format.nHeight) >= nRows && (nBitsPerPixel == -1 || format.nBitsPerPixel == nBitsPerPixel))
+			return m_anByArea[n];
+	}
+
+	return -1;
+}
+
+int CaptureFormatTable::FindFastest(int nWidth, int nHeight, int nBitsPerPixel) const
+{
+	int result = -1;
+
+	for (size_t n = FindSize(nWidth, nHeight); n < m_anBySize.size(); n++)
+	{
+		int nIndex = m_anBySize[n];
+		const CaptureFormat& format = m_aFormats[nIndex];
+
+		if (format.nWidth != nWidth || format.nHeight != nHeight)
+			break;
+
+		if (IsMatch(nIndex, nWidth, nHeight, nBitsPerPixel) &&
+			(result == -1 || format.llMinFrameInterval < m_aFormats[result].llMinFrameInterval))
+		{
+			result = nIndex;
+		}
+	}
+
+	return result;
+}
+
+int CaptureFormatTable::FindBest(const FormatRequest& request) const
+{
+	if (request.ePriority == FormatPriority_Exact)
+		return FindExact(request.nWidth, request.nHeight, request.nBitsPerPixel);
+
+	int nRows = abs(request.nHeight);
+	double dArea = static_cast<double>(request.nWidth) * nRows;
+
+	// Each candidate is ranked by a key compared field by field in priority order; lowest wins
+	const int KEY_LENGTH = 5;
+	double adBest[KEY_LENGTH];
+	int result = -1;
+
+	for (int n = 0; n < GetCount(); n++)
+	{
+		const CaptureFormat& format = m_aFormats[n];
+
+		double dBitsMiss = request.nBitsPerPixel != -1 && format.nBitsPerPixel != request.nBitsPerPixel ? 1.0 : 0.0;
+
+		// Exact size, larger in both directions, or short of the request somewhere
+		double dSizeClass = 2.0;
+		if (format.nWidth == request.nWidth && abs(format.nHeight) == nRows)
+			dSizeClass = 0.0;
+		else if (format.nWidth >= request.nWidth && abs(format.nHeight) >= nRows)
+			dSizeClass = 1.0;
+
+		double dSizeDistance = dArea > 0.0 ? fabs(static_cast<double>(format.nWidth) * abs(format.nHeight) - dArea) / dArea : 0.0;
+
+		// How far short of the requested rate the format falls; with no rate asked for, faster is better
+		double dRateMiss;
+		if (request.llFrameInterval > 0)
+			dRateMiss = format.llMinFrameInterval > request.llFrameInterval ? static_cast<double>(format.llMinFrameInterval) / request.llFrameInterval - 1.0 : 0.0;
+		else
+			dRateMiss = format.llMinFrameInterval / 10000000.0;
+
+		double dCost = GetFormatCost(format.subtype);
+
+		double adKey[KEY_LENGTH];
+		adKey[0] = dBitsMiss;
+
+		switch (request.ePriority)
+		{
+		case FormatPriority_FrameRate:
+			adKey[1] = dRateMiss;
+			adKey[2] = dSizeClass;
+			adKey[3] = dSizeDistance;
+			adKey[4] = dCost;
+			break;
+
+		case FormatPriority_Cost:
+			adKey[1] = dSizeClass;
+			adKey[2] = dSizeDistance;
+			adKey[3] = dCost;
+			adKey[4] = dRateMiss;
+			break;
+
+		default:
+			adKey[1] = dSizeClass;
+			adKey[2] = dSizeDistance;
+			adKey[3] = dRateMiss;
+			adKey[4] = dCost;
+			break;
+		}
+
+		bool bBetter = result == -1;
+		for (int k = 0; k < KEY_LENGTH && !bBetter; k++)
+		{
+			if (adKey[k] != adBest[k])
+			{
+				if (adKey[k] > adBest[k])
+					break;
+
+				bBetter = true;
+			}
+		}
+
+		if (bBetter)
+		{
+			result = n;
+			for (int k = 0; k < KEY_LENGTH; k++)
+				adBest[k] = adKey[k];
+		}
+	}
+
+	return result;
+}
+
+LONGLONG CaptureFormatTable::GetFrameInterval(int nIndex, const FormatRequest& request) const
+{
+	if (request.ePriority == FormatPriority_Exact && request.llFrameInterval <= 0)
+		return 0;
+
+	const CaptureFormat& format = m_aFormats[nIndex];
+
+	if (request.llFrameInterval <= 0 || request.llFrameInterval < format.llMinFrameInterval)
+		return format.llMinFrameInterval;
+
+	if (request.llFrameInterval > format.llMaxFrameInterval)
+		return format.llMaxFrameInterval;
+
+	return request.llFrameInterval;
+}
+
+HRESULT CaptureFormatTable::Apply(IAMStreamConfig* pConfig, int nIndex, LONGLONG llFrameInterval) const
+{
+	const AM_MEDIA_TYPE* pmt = m_apMediaTypes[nIndex];
+
+	if (llFrameInterval <= 0)
+		return pConfig->SetFormat(const_cast<AM_MEDIA_TYPE*>(pmt));
+
+	// SetFormat copies the type, so a shallow copy with a patched format block will do
+	std::vector<BYTE> aFormat(pmt->pbFormat, pmt->pbFormat + pmt->cbFormat);
+	reinterpret_cast<VIDEOINFOHEADER*>(&aFormat[0])->AvgTimePerFrame = llFrameInterval;
+
+	AM_MEDIA_TYPE mt = *pmt;
+	mt.pbFormat = &aFormat[0];
+
+	return pConfig->SetFormat(&mt);
+}
+
+#pragma managed(pop)
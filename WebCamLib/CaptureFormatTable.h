@@ -0,0 +1,139 @@
+//*****************************************************************************************
+//  File:       CaptureFormatTable.h
+//  Project:    WebcamLib
+//
+//  Declares the per-device table of capture formats, read once from the driver
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+struct IAMStreamConfig;
+struct _AMMediaType;
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// One capability of a capture pin
+	/// </summary>
+	struct CaptureFormat
+	{
+		GUID subtype;
+		int nWidth;
+		int nHeight;					// as reported by the driver, negative for top-down formats
+		int nBitsPerPixel;
+		LONGLONG llMinFrameInterval;	// 100 ns units; the shortest interval is the highest frame rate
+		LONGLONG llMaxFrameInterval;
+		int nCapability;				// index for IAMStreamConfig::GetStreamCaps
+	};
+
+	/// <summary>
+	/// What to give up last when no format matches a request on every count
+	/// </summary>
+	enum FormatPriority
+	{
+		FormatPriority_Exact,			// exact size and bit depth or nothing, at the driver's default rate
+		FormatPriority_Resolution,		// closest size, then frame rate, then format cost
+		FormatPriority_FrameRate,		// reach the frame rate, then closest size, then format cost
+		FormatPriority_Cost				// closest size, then the cheapest format to convert, then frame rate
+	};
+
+	struct FormatRequest
+	{
+		int nWidth;
+		int nHeight;
+		int nBitsPerPixel;				// -1 for any
+		LONGLONG llFrameInterval;		// 100 ns units, 0 for the highest rate the format offers
+		FormatPriority ePriority;
+	};
+
+	/// <summary>
+	/// The formats a camera offers, walked once with GetStreamCaps and then kept, media types
+	/// included, so picking a format at start neither queries the driver nor allocates.
+	/// Sizes are indexed for exact, nearest-at-or-above and fastest lookups.
+	/// </summary>
+	class CaptureFormatTable
+	{
+	public:
+		CaptureFormatTable();
+		~CaptureFormatTable();
+
+		/// <summary>
+		/// Reads every VideoInfo capability of the pin, replacing any previous contents
+		/// </summary>
+		HRESULT Build(IAMStreamConfig* pConfig);
+
+		void Clear();
+
+		int GetCount() const
+		{
+			return static_cast<int>(m_aFormats.size());
+		}
+
+		const CaptureFormat& GetFormat(int nIndex) const
+		{
+			return m_aFormats[nIndex];
+		}
+
+		/// <summary>
+		/// Media type of a format, ready for IAMStreamConfig::SetFormat; owned by the table
+		/// </summary>
+		_AMMediaType* GetMediaType(int nIndex) const
+		{
+			return m_apMediaTypes[nIndex];
+		}
+
+		/// <summary>
+		/// First format, in capability order, of exactly this size; a bit depth of -1 matches any.
+		/// Returns -1 when there is none.
+		/// </summary>
+		int FindExact(int nWidth, int nHeight, int nBitsPerPixel) const;
+
+		/// <summary>
+		/// Smallest format covering at least the requested width and height, -1 when none is that large
+		/// </summary>
+		int FindAtLeast(int nWidth, int nHeight, int nBitsPerPixel) const;
+
+		/// <summary>
+		/// Format of exactly this size with the shortest frame interval, -1 when there is none
+		/// </summary>
+		int FindFastest(int nWidth, int nHeight, int nBitsPerPixel) const;
+
+		/// <summary>
+		/// Format best meeting a request under its priority, -1 when there is none
+		/// </summary>
+		int FindBest(const FormatRequest& request) const;
+
+		/// <summary>
+		/// Frame interval a format runs at for a requested one: clamped to the format's range,
+		/// its fastest for 0. Returns 0, meaning the driver's default, for exact requests without a rate.
+		/// </summary>
+		LONGLONG GetFrameInterval(int nIndex, const FormatRequest& request) const;
+
+		/// <summary>
+		/// Programs a format on the pin, with the given frame interval unless that is 0
+		/// </summary>
+		HRESULT Apply(IAMStreamConfig* pConfig, int nIndex, LONGLONG llFrameInterval) const;
+
+	private:
+		// Start of the run of formats with this width and height in m_anBySize
+		size_t FindSize(int nWidth, int nHeight) const;
+
+		bool IsMatch(int nIndex, int nWidth, int nHeight, int nBitsPerPixel) const;
+
+		std::vector<CaptureFormat> m_aFormats;
+		std::vector<_AMMediaType*> m_apMediaTypes;
+
+		std::vector<int> m_anBySize;	// by width, then height, then capability order
+		std::vector<int> m_anByArea;	// by pixel count, then capability order
+
+		// Not copyable; the table owns its media types
+		CaptureFormatTable(const CaptureFormatTable&);
+		CaptureFormatTable& operator=(const CaptureFormatTable&);
+	};
+}
+
+#pragma managed(pop)
@@ -0,0 +1,287 @@
+//*****************************************************************************************
+//  File:       CascadeClassifier.cpp
+//  Project:    WebcamLib
+//
+//  Defines the boosted cascade of Haar or LBP stumps a detection window is tested against
+//*****************************************************************************************
+
+#include <windows.h>
+#include <math.h>
+
+#include "IntegralImage.h"
+#include "CascadeClassifier.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Stages are compared with this much slack, as OpenCV does
+#define CASCADE_THRESHOLD_EPSILON	1e-5f
+
+// Offsets ahead of the features': the window less a one pixel border, which Haar windows are normalised over
+#define CASCADE_NORM_OFFSETS		4
+
+namespace
+{
+	inline int SumRect(const int* pSums, const int* pnOffsets)
+	{
+		return pSums[pnOffsets[0]] - pSums[pnOffsets[1]] - pSums[pnOffsets[2]] + pSums[pnOffsets[3]];
+	}
+
+	inline LONGLONG SumRect(const LONGLONG* pSquares, const int* pnOffsets)
+	{
+		return pSquares[pnOffsets[0]] - pSquares[pnOffsets[1]] - pSquares[pnOffsets[2]] + pSquares[pnOffsets[3]];
+	}
+
+	// The grid corners of a cell, counted along rows of four
+	inline int SumCell(const int* pSums, const int* pnCorners, int nRow, int nColumn)
+	{
+		int n = nRow * 4 + nColumn;
+		return pSums[pnCorners[n]] - pSums[pnCorners[n + 1]] - pSums[pnCorners[n + 4]] + pSums[pnCorners[n + 5]];
+	}
+
+	void GetRectOffsets(int nX, int nY, int nWidth, int nHeight, int nTableStride, int* pnOffsets)
+	{
+		pnOffsets[0] = nY * nTableStride + nX;
+		pnOffsets[1] = pnOffsets[0] + nWidth;
+		pnOffsets[2] = pnOffsets[0] + nHeight * nTableStride;
+		pnOffsets[3] = pnOffsets[2] + nWidth;
+	}
+}
+
+CascadeClassifier::CascadeClassifier()
+{
+	m_eType = CascadeFeatureType_Haar;
+	m_nWindowWidth = 0;
+	m_nWindowHeight = 0;
+}
+
+HRESULT CascadeClassifier::Create(CascadeFeatureType eType, int nWindowWidth, int nWindowHeight)
+{
+	if ((eType != CascadeFeatureType_Haar && eType != CascadeFeatureType_Lbp) || nWindowWidth < 3 || nWindowHeight < 3)
+		return E_INVALIDARG;
+
+	m_eType = eType;
+	m_nWindowWidth = nWindowWidth;
+	m_nWindowHeight = nWindowHeight;
+
+	m_aRects.clear();
+	m_anCells.clear();
+	m_aStages.clear();
+	m_aStumps.clear();
+	m_anSubsets.clear();
+
+	return S_OK;
+}
+
+HRESULT CascadeClassifier::AddHaarFeature(const CascadeRect* pRects, int nRects)
+{
+	if (m_eType != CascadeFeatureType_Haar || nRects < 1 || nRects > 3)
+		return E_INVALIDARG;
+
+	for (int n = 0; n < nRects; n++)
+	{
+		const CascadeRect& rect = pRects[n];
+
+		if (rect.nX < 0 || rect.nY < 0 || rect.nWidth < 0 || rect.nHeight < 0 || rect.nX + rect.nWidth > m_nWindowWidth || rect.nY + rect.nHeight > m_nWindowHeight)
+			return E_INVALIDARG;
+	}
+
+	for (int n = 0; n < 3; n++)
+	{
+		CascadeRect rect = { 0, 0, 0, 0, 0.0f };
+		m_aRects.push_back(n < nRects ? pRects[n] : rect);
+	}
+
+	return S_OK;
+}
+
+HRESULT CascadeClassifier::AddLbpFeature(int nX, int nY, int nCellWidth, int nCellHeight)
+{
+	if (m_eType != CascadeFeatureType_Lbp || nX < 0 || nY < 0 || nCellWidth < 1 || nCellHeight < 1 || nX + 3 * nCellWidth > m_nWindowWidth || nY + 3 * nCellHeight > m_nWindowHeight)
+		return E_INVALIDARG;
+
+	m_anCells.push_back(nX);
+	m_anCells.push_back(nY);
+	m_anCells.push_back(nCellWidth);
+	m_anCells.push_back(nCellHeight);
+
+	return S_OK;
+}
+
+HRESULT CascadeClassifier::AddStage(float fThreshold)
+{
+	if (m_nWindowWidth == 0)
+		return E_UNEXPECTED;
+
+	Stage stage;
+	stage.nFirstStump = static_cast<int>(m_aStumps.size());
+	stage.nStumps = 0;
+	stage.fThreshold = fThreshold;
+
+	m_aStages.push_back(stage);
+
+	return S_OK;
+}
+
+HRESULT CascadeClassifier::AddHaarStump(int nFeature, float fThreshold, float fLeft, float fRight)
+{
+	if (m_eType != CascadeFeatureType_Haar || nFeature < 0 || nFeature >= static_cast<int>(m_aRects.size() / 3))
+		return E_INVALIDARG;
+
+	if (m_aStages.empty())
+		return E_UNEXPECTED;
+
+	Stump stump;
+	stump.nFeature = nFeature;
+	stump.fThreshold = fThreshold;
+	stump.fLeft = fLeft;
+	stump.fRight = fRight;
+	stump.nSubset = -1;
+
+	m_aStumps.push_back(stump);
+	m_aStages.back().nStumps++;
+
+	return S_OK;
+}
+
+HRESULT CascadeClassifier::AddLbpStump(int nFeature, const int* pnSubset, float fLeft, float fRight)
+{
+	if (m_eType != CascadeFeatureType_Lbp || nFeature < 0 || nFeature >= static_cast<int>(m_anCells.size() / 4))
+		return E_INVALIDARG;
+
+	if (m_aStages.empty())
+		return E_UNEXPECTED;
+
+	Stump stump;
+	stump.nFeature = nFeature;
+	stump.fThreshold = 0.0f;
+	stump.fLeft = fLeft;
+	stump.fRight = fRight;
+	stump.nSubset = static_cast<int>(m_anSubsets.size());
+
+	m_anSubsets.insert(m_anSubsets.end(), pnSubset, pnSubset + 8);
+	m_aStumps.push_back(stump);
+	m_aStages.back().nStumps++;
+
+	return S_OK;
+}
+
+int CascadeClassifier::GetOffsetCount() const
+{
+	return m_eType == CascadeFeatureType_Haar ? 12 : 16;
+}
+
+void CascadeClassifier::GetOffsets(int nTableStride, std::vector<int>* pOffsets) const
+{
+	int nFeatures = m_eType == CascadeFeatureType_Haar ? static_cast<int>(m_aRects.size() / 3) : static_cast<int>(m_anCells.size() / 4);
+
+	pOffsets->resize(CASCADE_NORM_OFFSETS + nFeatures * GetOffsetCount());
+	int* pnOffsets = &(*pOffsets)[0];
+
+	GetRectOffsets(1, 1, m_nWindowWidth - 2, m_nWindowHeight - 2, nTableStride, pnOffsets);
+	pnOffsets += CASCADE_NORM_OFFSETS;
+
+	for (int nFeature = 0; nFeature < nFeatures; nFeature++)
+	{
+		if (m_eType == CascadeFeatureType_Haar)
+		{
+			for (int n = 0; n < 3; n++)
+			{
+				const CascadeRect& rect = m_aRects[nFeature * 3 + n];
+				GetRectOffsets(rect.nX, rect.nY, rect.nWidth, rect.nHeight, nTableStride, pnOffsets + n * 4);
+			}
+		}
+		else
+		{
+			const int* pnCell = &m_anCells[nFeature * 4];
+
+			for (int nRow = 0; nRow < 4; nRow++)
+			{
+				for (int nColumn = 0; nColumn < 4; nColumn++)
+				{
+					pnOffsets[nRow * 4 + nColumn] = (pnCell[1] + nRow * pnCell[3]) * nTableStride + pnCell[0] + nColumn * pnCell[2];
+				}
+			}
+		}
+
+		pnOffsets += GetOffsetCount();
+	}
+}
+
+bool CascadeClassifier::TestWindow(const IntegralImage& integral, const int* pnOffsets, int nOrigin) const
+{
+	const int* pSums = integral.GetSums() + nOrigin;
+	const int* pnFeatureOffsets = pnOffsets + CASCADE_NORM_OFFSETS;
+	const Stump* pStumps = &m_aStumps[0];
+
+	if (m_eType == CascadeFeatureType_Haar)
+	{
+		// Features are compared relative to the window's contrast, so lighting does not matter
+		int nSum = SumRect(pSums, pnOffsets);
+		LONGLONG llSquares = SumRect(integral.GetSquares() + nOrigin, pnOffsets);
+
+		double dNorm = static_cast<double>((m_nWindowWidth - 2) * (m_nWindowHeight - 2)) * llSquares - static_cast<double>(nSum) * nSum;
+		float fScale = dNorm > 0.0 ? static_cast<float>(1.0 / sqrt(dNorm)) : 1.0f;
+
+		for (size_t nStage = 0; nStage < m_aStages.size(); nStage++)
+		{
+			const Stage& stage = m_aStages[nStage];
+			float fSum = 0.0f;
+
+			for (int n = stage.nFirstStump; n < stage.nFirstStump + stage.nStumps; n++)
+			{
+				const Stump& stump = pStumps[n];
+				const int* pnRect = pnFeatureOffsets + stump.nFeature * 12;
+				const CascadeRect* pRects = &m_aRects[stump.nFeature * 3];
+
+				float fValue = pRects[0].fWeight * SumRect(pSums, pnRect) + pRects[1].fWeight * SumRect(pSums, pnRect + 4);
+				if (pRects[2].fWeight != 0.0f)
+				{
+					fValue += pRects[2].fWeight * SumRect(pSums, pnRect + 8);
+				}
+
+				fSum += fValue * fScale < stump.fThreshold ? stump.fLeft : stump.fRight;
+			}
+
+			if (fSum < stage.fThreshold - CASCADE_THRESHOLD_EPSILON)
+				return false;
+		}
+	}
+	else
+	{
+		for (size_t nStage = 0; nStage < m_aStages.size(); nStage++)
+		{
+			const Stage& stage = m_aStages[nStage];
+			float fSum = 0.0f;
+
+			for (int n = stage.nFirstStump; n < stage.nFirstStump + stage.nStumps; n++)
+			{
+				const Stump& stump = pStumps[n];
+				const int* pnCorners = pnFeatureOffsets + stump.nFeature * 16;
+
+				// Neighbours clockwise from the top left, as OpenCV numbers them
+				int nCenter = SumCell(pSums, pnCorners, 1, 1);
+				int nCode =
+					(SumCell(pSums, pnCorners, 0, 0) >= nCenter ? 128 : 0) |
+					(SumCell(pSums, pnCorners, 0, 1) >= nCenter ? 64 : 0) |
+					(SumCell(pSums, pnCorners, 0, 2) >= nCenter ? 32 : 0) |
+					(SumCell(pSums, pnCorners, 1, 2) >= nCenter ? 16 : 0) |
+					(SumCell(pSums, pnCorners, 2, 2) >= nCenter ? 8 : 0) |
+					(SumCell(pSums, pnCorners, 2, 1) >= nCenter ? 4 : 0) |
+					(SumCell(pSums, pnCorners, 2, 0) >= nCenter ? 2 : 0) |
+					(SumCell(pSums, pnCorners, 1, 0) >= nCenter ? 1 : 0);
+
+				const int* pnSubset = &m_anSubsets[stump.nSubset];
+				fSum += (pnSubset[nCode >> 5] & (1 << (nCode & 31))) != 0 ? stump.fLeft : stump.fRight;
+			}
+
+			if (fSum < stage.fThreshold - CASCADE_THRESHOLD_EPSILON)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+#pragma managed(pop)
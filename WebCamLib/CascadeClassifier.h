@@ -0,0 +1,141 @@
+//*****************************************************************************************
+//  File:       CascadeClassifier.h
+//  Project:    WebcamLib
+//
+//  Declares the boosted cascade of Haar or LBP stumps a detection window is tested against
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	class IntegralImage;
+
+	enum CascadeFeatureType
+	{
+		CascadeFeatureType_Haar,
+		CascadeFeatureType_Lbp,
+	};
+
+	/// <summary>
+	/// One weighted rectangle of a Haar feature, in pixels of the detection window
+	/// </summary>
+	struct CascadeRect
+	{
+		int nX;
+		int nY;
+		int nWidth;
+		int nHeight;
+		float fWeight;
+	};
+
+	/// <summary>
+	/// A cascade as OpenCV's traincascade writes it: stages of boosted stumps, each testing one
+	/// feature against a threshold. Haar features are up to three weighted rectangles, compared
+	/// after normalising by the window's contrast; LBP features are a 3 by 3 grid of cells whose
+	/// pattern code picks a leaf through a 256 bit subset. A window is accepted when every stage's
+	/// leaves add up to its threshold. Once built and prepared for a table stride, windows may be
+	/// tested from several threads at once.
+	/// </summary>
+	class CascadeClassifier
+	{
+	public:
+		CascadeClassifier();
+
+		/// <summary>
+		/// Drops the stages and features and starts a cascade for windows of the given size
+		/// </summary>
+		HRESULT Create(CascadeFeatureType eType, int nWindowWidth, int nWindowHeight);
+
+		CascadeFeatureType GetFeatureType() const
+		{
+			return m_eType;
+		}
+
+		int GetWindowWidth() const
+		{
+			return m_nWindowWidth;
+		}
+
+		int GetWindowHeight() const
+		{
+			return m_nWindowHeight;
+		}
+
+		int GetStageCount() const
+		{
+			return static_cast<int>(m_aStages.size());
+		}
+
+		/// <summary>
+		/// Adds a Haar feature of one to three rectangles; E_INVALIDARG when one leaves the window
+		/// </summary>
+		HRESULT AddHaarFeature(const CascadeRect* pRects, int nRects);
+
+		/// <summary>
+		/// Adds an LBP feature of 3 by 3 cells of the given size; E_INVALIDARG when it leaves the window
+		/// </summary>
+		HRESULT AddLbpFeature(int nX, int nY, int nCellWidth, int nCellHeight);
+
+		/// <summary>
+		/// Starts a stage; the stumps added next belong to it
+		/// </summary>
+		HRESULT AddStage(float fThreshold);
+
+		/// <summary>
+		/// Adds a Haar stump to the last stage: the left leaf when the feature is below the threshold
+		/// </summary>
+		HRESULT AddHaarStump(int nFeature, float fThreshold, float fLeft, float fRight);
+
+		/// <summary>
+		/// Adds an LBP stump to the last stage: the left leaf when the pattern's bit is set in the subset
+		/// </summary>
+		HRESULT AddLbpStump(int nFeature, const int* pnSubset, float fLeft, float fRight);
+
+		/// <summary>
+		/// Converts the features into offsets into tables of the given stride, for TestWindow
+		/// </summary>
+		void GetOffsets(int nTableStride, std::vector<int>* pOffsets) const;
+
+		/// <summary>
+		/// True when the window with its top left corner at table entry nOrigin passes every stage
+		/// </summary>
+		bool TestWindow(const IntegralImage& integral, const int* pnOffsets, int nOrigin) const;
+
+	private:
+		struct Stump
+		{
+			int nFeature;
+			float fThreshold;
+			float fLeft;
+			float fRight;
+			int nSubset;
+		};
+
+		struct Stage
+		{
+			int nFirstStump;
+			int nStumps;
+			float fThreshold;
+		};
+
+		// Offsets of a feature: a 4 corner rectangle per Haar rectangle, or the 16 grid corners of an LBP feature
+		int GetOffsetCount() const;
+
+		CascadeFeatureType m_eType;
+		int m_nWindowWidth;
+		int m_nWindowHeight;
+
+		std::vector<CascadeRect> m_aRects;			// three per Haar feature, unused ones of no size and weight
+		std::vector<int> m_anCells;					// x, y, width and height per LBP feature
+		std::vector<Stage> m_aStages;
+		std::vector<Stump> m_aStumps;
+		std::vector<int> m_anSubsets;				// eight words per LBP stump
+	};
+}
+
+#pragma managed(pop)
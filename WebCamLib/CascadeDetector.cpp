@@ -0,0 +1,337 @@
+//*****************************************************************************************
+//  File:       CascadeDetector.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed entry point to the native Haar and LBP cascade detector
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "WorkerPool.h"
+#include "CascadeScanner.h"
+#include "PooledFrame.h"
+#include "CascadeDetector.h"
+
+using namespace System::Globalization;
+using namespace System::Runtime::InteropServices;
+using namespace WebCamLib;
+
+#pragma region Parsing
+static array<String^>^ SplitValues( String^ text )
+{
+	return text->Split( static_cast<array<wchar_t>^>( nullptr ), StringSplitOptions::RemoveEmptyEntries );
+}
+
+static String^ GetText( XmlNode^ parent, String^ name )
+{
+	XmlNode^ node = parent->SelectSingleNode( name );
+
+	if( node == nullptr )
+		throw gcnew FormatException( "The cascade has no " + name + " element." );
+
+	return node->InnerText->Trim();
+}
+
+static int ParseInt( String^ value )
+{
+	return Int32::Parse( value, NumberStyles::Integer, CultureInfo::InvariantCulture );
+}
+
+static float ParseFloat( String^ value )
+{
+	return static_cast<float>( Double::Parse( value, NumberStyles::Float, CultureInfo::InvariantCulture ) );
+}
+#pragma endregion
+
+#pragma region CascadeDetection
+CascadeDetection::CascadeDetection( int x, int y, int width, int height, int neighbors )
+{
+	this->x = x;
+	this->y = y;
+	this->width = width;
+	this->height = height;
+	this->neighbors = neighbors;
+}
+#pragma endregion
+
+#pragma region CascadeDetector
+CascadeDetector::CascadeDetector( String^ fileName )
+{
+	Initialize( fileName, false );
+}
+
+CascadeDetector::CascadeDetector( String^ fileName, bool parallel )
+{
+	Initialize( fileName, parallel );
+}
+
+CascadeDetector::~CascadeDetector()
+{
+	this->!CascadeDetector();
+}
+
+CascadeDetector::!CascadeDetector()
+{
+	delete pScanner;
+	pScanner = NULL;
+}
+
+void CascadeDetector::Initialize( String^ fileName, bool parallel )
+{
+	if( fileName == nullptr )
+		throw gcnew ArgumentNullException( "fileName" );
+
+	XmlDocument^ document = gcnew XmlDocument();
+	document->Load( fileName );
+
+	// traincascade writes <opencv_storage><cascade>; the older haartraining format is not read
+	XmlNode^ cascade = document->DocumentElement != nullptr ? document->DocumentElement->SelectSingleNode( "cascade" ) : nullptr;
+
+	if( cascade == nullptr )
+		throw gcnew FormatException( "The file does not hold a cascade written by opencv_traincascade." );
+
+	pScanner = new CascadeScanner();
+
+	try
+	{
+		Load( cascade );
+	}
+	catch( Exception^ )
+	{
+		delete pScanner;
+		pScanner = NULL;
+		throw;
+	}
+
+	if( parallel )
+		pScanner->SetWorkerPool( WorkerPool::GetShared() );
+}
+
+void CascadeDetector::Load( XmlNode^ cascade )
+{
+	String^ featureType = GetText( cascade, "featureType" );
+	CascadeFeatureType eType;
+
+	if( featureType == "HAAR" )
+		eType = CascadeFeatureType_Haar;
+	else if( featureType == "LBP" )
+		eType = CascadeFeatureType_Lbp;
+	else
+		throw gcnew NotSupportedException( "Only HAAR and LBP cascades are supported, not " + featureType + "." );
+
+	CascadeClassifier& classifier = pScanner->GetClassifier();
+
+	if( FAILED( classifier.Create( eType, ParseInt( GetText( cascade, "width" ) ), ParseInt( GetText( cascade, "height" ) ) ) ) )
+		throw gcnew FormatException( "The cascade's window size is invalid." );
+
+	for each( XmlNode^ feature in cascade->SelectNodes( "features/_" ) )
+	{
+		HRESULT hr;
+
+		if( eType == CascadeFeatureType_Haar )
+		{
+			XmlNode^ tilted = feature->SelectSingleNode( "tilted" );
+			if( tilted != nullptr && tilted->InnerText->Trim() != "0" )
+				throw gcnew NotSupportedException( "Tilted Haar features are not supported." );
+
+			CascadeRect aRects[3];
+			int nRects = 0;
+
+			for each( XmlNode^ rect in feature->SelectNodes( "rects/_" ) )
+			{
+				array<String^>^ values = SplitValues( rect->InnerText );
+
+				if( nRects == 3 || values->Length != 5 )
+					throw gcnew FormatException( "A Haar feature of the cascade is malformed." );
+
+				aRects[nRects].nX = ParseInt( values[0] );
+				aRects[nRects].nY = ParseInt( values[1] );
+				aRects[nRects].nWidth = ParseInt( values[2] );
+				aRects[nRects].nHeight = ParseInt( values[3] );
+				aRects[nRects].fWeight = ParseFloat( values[4] );
+				nRects++;
+			}
+
+			hr = classifier.AddHaarFeature( aRects, nRects );
+		}
+		else
+		{
+			array<String^>^ values = SplitValues( GetText( feature, "rect" ) );
+
+			if( values->Length != 4 )
+				throw gcnew FormatException( "An LBP feature of the cascade is malformed." );
+
+			hr = classifier.AddLbpFeature( ParseInt( values[0] ), ParseInt( values[1] ), ParseInt( values[2] ), ParseInt( values[3] ) );
+		}
+
+		if( FAILED( hr ) )
+			throw gcnew FormatException( "A feature of the cascade does not fit its window." );
+	}
+
+	// A stump's node is the two children, the feature and then the threshold or the 8 word subset
+	int nodeLength = eType == CascadeFeatureType_Haar ? 4 : 11;
+
+	for each( XmlNode^ stage in cascade->SelectNodes( "stages/_" ) )
+	{
+		classifier.AddStage( ParseFloat( GetText( stage, "stageThreshold" ) ) );
+
+		for each( XmlNode^ weak in stage->SelectNodes( "weakClassifiers/_" ) )
+		{
+			array<String^>^ nodes = SplitValues( GetText( weak, "internalNodes" ) );
+			array<String^>^ leaves = SplitValues( GetText( weak, "leafValues" ) );
+
+			if( nodes->Length != nodeLength || leaves->Length != 2 )
+				throw gcnew NotSupportedException( "Only cascades of stumps are supported." );
+
+			int feature = ParseInt( nodes[2] );
+			HRESULT hr;
+
+			if( eType == CascadeFeatureType_Haar )
+			{
+				hr = classifier.AddHaarStump( feature, ParseFloat( nodes[3] ), ParseFloat( leaves[0] ), ParseFloat( leaves[1] ) );
+			}
+			else
+			{
+				int anSubset[8];
+				for( int i = 0; i < 8; ++i )
+				{
+					anSubset[i] = ParseInt( nodes[3 + i] );
+				}
+
+				hr = classifier.AddLbpStump( feature, anSubset, ParseFloat( leaves[0] ), ParseFloat( leaves[1] ) );
+			}
+
+			if( FAILED( hr ) )
+				throw gcnew FormatException( "A stump of the cascade refers to a missing feature." );
+		}
+	}
+
+	if( classifier.GetStageCount() == 0 )
+		throw gcnew FormatException( "The cascade has no stages." );
+}
+
+CascadeScanner* CascadeDetector::GetScanner()
+{
+	if( pScanner == NULL )
+		throw gcnew ObjectDisposedException( "CascadeDetector" );
+
+	return pScanner;
+}
+
+int CascadeDetector::WindowWidth::get()
+{
+	return GetScanner()->GetClassifier().GetWindowWidth();
+}
+
+int CascadeDetector::WindowHeight::get()
+{
+	return GetScanner()->GetClassifier().GetWindowHeight();
+}
+
+double CascadeDetector::ScaleFactor::get()
+{
+	return GetScanner()->GetScaleFactor();
+}
+
+void CascadeDetector::ScaleFactor::set( double value )
+{
+	if( FAILED( GetScanner()->SetScaleFactor( value ) ) )
+		throw gcnew ArgumentOutOfRangeException( "ScaleFactor must be more than 1." );
+}
+
+int CascadeDetector::MinNeighbors::get()
+{
+	return GetScanner()->GetMinNeighbors();
+}
+
+void CascadeDetector::MinNeighbors::set( int value )
+{
+	if( value < 0 )
+		throw gcnew ArgumentOutOfRangeException( "MinNeighbors cannot be negative." );
+
+	GetScanner()->SetMinNeighbors( value );
+}
+
+int CascadeDetector::MinimumSize::get()
+{
+	return GetScanner()->GetMinimumSize();
+}
+
+void CascadeDetector::MinimumSize::set( int value )
+{
+	if( value < 0 )
+		throw gcnew ArgumentOutOfRangeException( "MinimumSize cannot be negative." );
+
+	GetScanner()->SetSizeLimits( value, GetScanner()->GetMaximumSize() );
+}
+
+int CascadeDetector::MaximumSize::get()
+{
+	return GetScanner()->GetMaximumSize();
+}
+
+void CascadeDetector::MaximumSize::set( int value )
+{
+	if( value < 0 )
+		throw gcnew ArgumentOutOfRangeException( "MaximumSize cannot be negative." );
+
+	GetScanner()->SetSizeLimits( GetScanner()->GetMinimumSize(), value );
+}
+
+int CascadeDetector::DetectionCount::get()
+{
+	return GetScanner()->GetHitCount();
+}
+
+int CascadeDetector::Detect( IntPtr scan0, int width, int height, int stride, int bitsPerPixel )
+{
+	CascadeScanner* pNative = GetScanner();
+
+	if( scan0 == IntPtr::Zero )
+		throw gcnew ArgumentNullException( "scan0" );
+
+	if( width <= 0 || height <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "The image is empty." );
+
+	if( bitsPerPixel != 8 && bitsPerPixel != 24 && bitsPerPixel != 32 )
+		throw gcnew ArgumentException( "Only 8 bit grey and 24 or 32 bit BGR images are supported." );
+
+	int hits = 0;
+	HRESULT hr = pNative->Detect( static_cast<const BYTE*>( scan0.ToPointer() ), width, height, stride, bitsPerPixel, &hits );
+	if( FAILED( hr ) )
+		throw gcnew COMException( "Unable to search the image.", hr );
+
+	return hits;
+}
+
+int CascadeDetector::Detect( PooledFrame^ frame )
+{
+	if( frame == nullptr )
+		throw gcnew ArgumentNullException( "frame" );
+
+	return Detect( frame->Scan0, frame->Width, frame->Height, frame->Stride, frame->BitsPerPixel );
+}
+
+CascadeDetection CascadeDetector::GetDetection( int index )
+{
+	if( index < 0 || index >= DetectionCount )
+		throw gcnew ArgumentOutOfRangeException( "Detection index is out of bounds: " + DetectionCount.ToString() );
+
+	const CascadeHit& hit = pScanner->GetHit( index );
+
+	return CascadeDetection( hit.nX, hit.nY, hit.nWidth, hit.nHeight, hit.nNeighbors );
+}
+
+void CascadeDetector::GetDetections( IList<CascadeDetection>^ detections )
+{
+	if( detections == nullptr )
+		throw gcnew ArgumentNullException( "detections" );
+
+	detections->Clear();
+
+	for( int i = 0; i < DetectionCount; ++i )
+	{
+		detections->Add( GetDetection( i ) );
+	}
+}
+#pragma endregion
@@ -0,0 +1,153 @@
+//*****************************************************************************************
+//  File:       CascadeDetector.h
+//  Project:    WebcamLib
+//
+//  Declares the managed entry point to the native Haar and LBP cascade detector
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+using namespace System::Collections::Generic;
+using namespace System::Xml;
+
+namespace WebCamLib
+{
+	class CascadeScanner;
+	ref class PooledFrame;
+
+	/// <summary>
+	/// Bounds of one detected object, with the number of raw detections merged into it
+	/// </summary>
+	public value struct CascadeDetection
+	{
+	public:
+		CascadeDetection( int x, int y, int width, int height, int neighbors );
+
+		property int X
+		{
+			int get() { return x; }
+		}
+
+		property int Y
+		{
+			int get() { return y; }
+		}
+
+		property int Width
+		{
+			int get() { return width; }
+		}
+
+		property int Height
+		{
+			int get() { return height; }
+		}
+
+		property int Neighbors
+		{
+			int get() { return neighbors; }
+		}
+
+	private:
+		int x, y, width, height, neighbors;
+	};
+
+	/// <summary>
+	/// Finds objects with a Haar or LBP cascade trained by opencv_traincascade, searching every
+	/// window size from the cascade's own up to the frame's
+	/// </summary>
+	public ref class CascadeDetector
+	{
+	public:
+		/// <summary>
+		/// Loads a cascade from an OpenCV XML file. Only boosted stumps over upright features are
+		/// supported, which is what traincascade writes by default.
+		/// </summary>
+		CascadeDetector( String^ fileName );
+
+		/// <summary>
+		/// When parallel is set, the scales and row bands are searched on the shared worker pool
+		/// </summary>
+		CascadeDetector( String^ fileName, bool parallel );
+
+		~CascadeDetector();
+
+		property int WindowWidth
+		{
+			int get();
+		}
+
+		property int WindowHeight
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Ratio between successive window sizes, more than 1; 1.1 by default
+		/// </summary>
+		property double ScaleFactor
+		{
+			double get();
+			void set( double value );
+		}
+
+		/// <summary>
+		/// Objects found by this many windows or fewer are dropped; zero returns every window. 3 by default.
+		/// </summary>
+		property int MinNeighbors
+		{
+			int get();
+			void set( int value );
+		}
+
+		/// <summary>
+		/// Smallest object width searched, in pixels; zero for the cascade's window
+		/// </summary>
+		property int MinimumSize
+		{
+			int get();
+			void set( int value );
+		}
+
+		/// <summary>
+		/// Largest object width searched, in pixels; zero for no limit
+		/// </summary>
+		property int MaximumSize
+		{
+			int get();
+			void set( int value );
+		}
+
+		property int DetectionCount
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Searches an 8 bit grey, 24 or 32 bit BGR image and returns the number of objects found
+		/// </summary>
+		int Detect( IntPtr scan0, int width, int height, int stride, int bitsPerPixel );
+
+		int Detect( PooledFrame^ frame );
+
+		CascadeDetection GetDetection( int index );
+
+		/// <summary>
+		/// Replaces the contents of the list with the objects of the last search
+		/// </summary>
+		void GetDetections( IList<CascadeDetection>^ detections );
+
+	protected:
+		!CascadeDetector();
+
+	private:
+		void Initialize( String^ fileName, bool parallel );
+
+		void Load( XmlNode^ cascade );
+
+		CascadeScanner* GetScanner();
+
+		CascadeScanner* pScanner;
+	};
+}
@@ -0,0 +1,397 @@
+//*****************************************************************************************
+//  File:       CascadeScanner.cpp
+//  Project:    WebcamLib
+//
+//  Defines the multi-scale sliding window search that runs a cascade over whole frames
+//*****************************************************************************************
+
+#include <windows.h>
+#include <math.h>
+
+#include "WorkerPool.h"
+#include "CascadeScanner.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Pixel rows of a level scanned as one work item; small enough for the bands of the few large
+// levels to balance against the many small ones
+#define CASCADE_BAND_ROWS			16
+
+// Weights of the bilinear resize, in bits
+#define CASCADE_RESIZE_BITS			8
+
+// Windows whose edges are this fraction of their size apart are grouped together
+#define CASCADE_GROUP_EPSILON		0.2
+
+namespace
+{
+	inline int Round(double dValue)
+	{
+		return static_cast<int>(floor(dValue + 0.5));
+	}
+
+	bool IsSimilar(const CascadeHit& a, const CascadeHit& b)
+	{
+		double dDelta = CASCADE_GROUP_EPSILON * (min(a.nWidth, b.nWidth) + min(a.nHeight, b.nHeight)) * 0.5;
+
+		return abs(a.nX - b.nX) <= dDelta && abs(a.nY - b.nY) <= dDelta &&
+			abs(a.nX + a.nWidth - b.nX - b.nWidth) <= dDelta && abs(a.nY + a.nHeight - b.nY - b.nHeight) <= dDelta;
+	}
+
+	int FindRoot(std::vector<int>& anParents, int n)
+	{
+		while (anParents[n] != n)
+		{
+			anParents[n] = anParents[anParents[n]];
+			n = anParents[n];
+		}
+
+		return n;
+	}
+}
+
+CascadeScanner::CascadeScanner()
+{
+	m_dScaleFactor = 1.1;
+	m_nMinNeighbors = 3;
+	m_nMinimumSize = 0;
+	m_nMaximumSize = 0;
+	m_pPool = NULL;
+	m_nLevels = 0;
+}
+
+HRESULT CascadeScanner::SetScaleFactor(double dScaleFactor)
+{
+	if (!(dScaleFactor > 1.0))
+		return E_INVALIDARG;
+
+	m_dScaleFactor = dScaleFactor;
+
+	return S_OK;
+}
+
+HRESULT CascadeScanner::Detect(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, int* pnHits)
+{
+	m_aHits.clear();
+	if (pnHits != NULL)
+	{
+		*pnHits = 0;
+	}
+
+	if (m_classifier.GetStageCount() == 0)
+		return E_UNEXPECTED;
+
+	HRESULT hr = m_luma.Extract(pTop, nWidth, nHeight, nStride, nBitsPerPixel);
+	if (FAILED(hr))
+		return hr;
+
+	// Plan the pyramid: a level per window size, down to the level the window no longer fits
+	int nWindowWidth = m_classifier.GetWindowWidth();
+	int nWindowHeight = m_classifier.GetWindowHeight();
+
+	m_nLevels = 0;
+
+	for (double dScale = 1.0; ; dScale *= m_dScaleFactor)
+	{
+		int nLevelWidth = Round(nWidth / dScale);
+		int nLevelHeight = Round(nHeight / dScale);
+		int nScaledWidth = Round(nWindowWidth * dScale);
+
+		if (nLevelWidth < nWindowWidth || nLevelHeight < nWindowHeight)
+			break;
+
+		if (m_nMaximumSize > 0 && nScaledWidth > m_nMaximumSize)
+			break;
+
+		if (nScaledWidth < m_nMinimumSize)
+			continue;
+
+		if (static_cast<int>(m_aLevels.size()) <= m_nLevels)
+		{
+			m_aLevels.resize(m_nLevels + 1);
+		}
+
+		Level& level = m_aLevels[m_nLevels++];
+		level.dScale = dScale;
+		level.nWidth = nLevelWidth;
+		level.nHeight = nLevelHeight;
+		level.nStep = dScale > 2.0 ? 1 : 2;
+		level.nWindowWidth = nScaledWidth;
+		level.nWindowHeight = Round(nWindowHeight * dScale);
+	}
+
+	if (m_nLevels == 0)
+		return S_OK;
+
+	if (m_pPool != NULL && m_nLevels > 1)
+	{
+		m_pPool->Run(BuildLevelProc, this, m_nLevels);
+	}
+	else
+	{
+		for (int n = 0; n < m_nLevels; n++)
+		{
+			BuildLevel(m_aLevels[n]);
+		}
+	}
+
+	// Cut every level in bands, so the largest levels do not hold up the rest
+	m_aBands.clear();
+
+	for (int n = 0; n < m_nLevels; n++)
+	{
+		const Level& level = m_aLevels[n];
+
+		if (FAILED(level.hr))
+			return level.hr;
+
+		int nEndRow = level.nHeight - nWindowHeight + 1;
+
+		for (int nRow = 0; nRow < nEndRow; nRow += CASCADE_BAND_ROWS)
+		{
+			Band band;
+			band.nLevel = n;
+			band.nFirstRow = nRow;
+			band.nEndRow = min(nRow + CASCADE_BAND_ROWS, nEndRow);
+			m_aBands.push_back(band);
+		}
+	}
+
+	int nBands = static_cast<int>(m_aBands.size());
+	if (static_cast<int>(m_aBandHits.size()) < nBands)
+	{
+		m_aBandHits.resize(nBands);
+	}
+
+	if (m_pPool != NULL && nBands > 1)
+	{
+		m_pPool->Run(ScanBandProc, this, nBands);
+	}
+	else
+	{
+		for (int n = 0; n < nBands; n++)
+		{
+			ScanBand(n);
+		}
+	}
+
+	m_aCandidates.clear();
+	for (int n = 0; n < nBands; n++)
+	{
+		m_aCandidates.insert(m_aCandidates.end(), m_aBandHits[n].begin(), m_aBandHits[n].end());
+	}
+
+	GroupCandidates();
+
+	if (pnHits != NULL)
+	{
+		*pnHits = GetHitCount();
+	}
+
+	return S_OK;
+}
+
+void CascadeScanner::BuildLevelProc(void* pContext, int nLevel)
+{
+	CascadeScanner* pScanner = static_cast<CascadeScanner*>(pContext);
+	pScanner->BuildLevel(pScanner->m_aLevels[nLevel]);
+}
+
+void CascadeScanner::BuildLevel(Level& level)
+{
+	const BYTE* pGray = m_luma.GetData();
+	int nGrayWidth = m_luma.GetWidth();
+	int nGrayHeight = m_luma.GetHeight();
+	int nGrayStride = nGrayWidth;
+
+	if (level.nWidth != nGrayWidth || level.nHeight != nGrayHeight)
+	{
+		const int nOne = 1 << CASCADE_RESIZE_BITS;
+		size_t cPixels = static_cast<size_t>(level.nWidth) * level.nHeight;
+
+		if (level.abGray.size() < cPixels)
+		{
+			level.abGray.resize(cPixels);
+		}
+
+		// Pixel centres are mapped onto each other, as OpenCV's linear resize does
+		level.anSourceX.resize(level.nWidth);
+		level.anWeightX.resize(level.nWidth);
+
+		for (int x = 0; x < level.nWidth; x++)
+		{
+			double dSource = max((x + 0.5) * level.dScale - 0.5, 0.0);
+			int nSource = min(static_cast<int>(dSource), nGrayWidth - 1);
+
+			level.anSourceX[x] = nSource;
+			level.anWeightX[x] = nSource + 1 < nGrayWidth ? Round((dSource - nSource) * nOne) : 0;
+		}
+
+		for (int y = 0; y < level.nHeight; y++)
+		{
+			double dSource = max((y + 0.5) * level.dScale - 0.5, 0.0);
+			int nSource = min(static_cast<int>(dSource), nGrayHeight - 1);
+			int nWeightY = nSource + 1 < nGrayHeight ? Round((dSource - nSource) * nOne) : 0;
+
+			const BYTE* pAbove = pGray + static_cast<size_t>(nSource) * nGrayWidth;
+			const BYTE* pBelow = nWeightY != 0 ? pAbove + nGrayWidth : pAbove;
+			BYTE* pTarget = &level.abGray[static_cast<size_t>(y) * level.nWidth];
+
+			for (int x = 0; x < level.nWidth; x++)
+			{
+				int nX = level.anSourceX[x];
+				int nWeightX = level.anWeightX[x];
+				int nRight = nWeightX != 0 ? 1 : 0;
+
+				int nTop = pAbove[nX] * (nOne - nWeightX) + pAbove[nX + nRight] * nWeightX;
+				int nBottom = pBelow[nX] * (nOne - nWeightX) + pBelow[nX + nRight] * nWeightX;
+
+				pTarget[x] = static_cast<BYTE>((nTop * (nOne - nWeightY) + nBottom * nWeightY + (1 << (2 * CASCADE_RESIZE_BITS - 1))) >> (2 * CASCADE_RESIZE_BITS));
+			}
+		}
+
+		pGray = &level.abGray[0];
+		nGrayStride = level.nWidth;
+	}
+
+	// Only Haar windows are normalised by their variance
+	level.hr = level.integral.Build(pGray, level.nWidth, level.nHeight, nGrayStride, m_classifier.GetFeatureType() == CascadeFeatureType_Haar);
+
+	if (SUCCEEDED(level.hr))
+	{
+		m_classifier.GetOffsets(level.integral.GetStride(), &level.anOffsets);
+	}
+}
+
+void CascadeScanner::ScanBandProc(void* pContext, int nBand)
+{
+	static_cast<CascadeScanner*>(pContext)->ScanBand(nBand);
+}
+
+void CascadeScanner::ScanBand(int nBand)
+{
+	const Band& band = m_aBands[nBand];
+	const Level& level = m_aLevels[band.nLevel];
+	std::vector<CascadeHit>& aHits = m_aBandHits[nBand];
+
+	aHits.clear();
+
+	const int* pnOffsets = &level.anOffsets[0];
+	int nTableStride = level.integral.GetStride();
+	int nEndColumn = level.nWidth - m_classifier.GetWindowWidth() + 1;
+
+	// Bands start on even rows, so a step of two stays on the same grid across bands
+	for (int y = band.nFirstRow; y < band.nEndRow; y += level.nStep)
+	{
+		for (int x = 0; x < nEndColumn; x += level.nStep)
+		{
+			if (m_classifier.TestWindow(level.integral, pnOffsets, y * nTableStride + x))
+			{
+				CascadeHit hit;
+				hit.nX = Round(x * level.dScale);
+				hit.nY = Round(y * level.dScale);
+				hit.nWidth = level.nWindowWidth;
+				hit.nHeight = level.nWindowHeight;
+				hit.nNeighbors = 1;
+
+				aHits.push_back(hit);
+			}
+		}
+	}
+}
+
+void CascadeScanner::GroupCandidates()
+{
+	int nCandidates = static_cast<int>(m_aCandidates.size());
+
+	if (m_nMinNeighbors <= 0)
+	{
+		m_aHits = m_aCandidates;
+		return;
+	}
+
+	m_anParents.resize(nCandidates);
+	for (int n = 0; n < nCandidates; n++)
+	{
+		m_anParents[n] = n;
+	}
+
+	for (int i = 0; i < nCandidates; i++)
+	{
+		for (int j = 0; j < i; j++)
+		{
+			if (IsSimilar(m_aCandidates[i], m_aCandidates[j]))
+			{
+				int nRootI = FindRoot(m_anParents, i);
+				int nRootJ = FindRoot(m_anParents, j);
+
+				if (nRootI != nRootJ)
+				{
+					m_anParents[max(nRootI, nRootJ)] = min(nRootI, nRootJ);
+				}
+			}
+		}
+	}
+
+	// Sum each group at its root, then average them
+	m_aClusters.assign(nCandidates, CascadeHit());
+
+	for (int n = 0; n < nCandidates; n++)
+	{
+		CascadeHit& cluster = m_aClusters[FindRoot(m_anParents, n)];
+		const CascadeHit& candidate = m_aCandidates[n];
+
+		cluster.nX += candidate.nX;
+		cluster.nY += candidate.nY;
+		cluster.nWidth += candidate.nWidth;
+		cluster.nHeight += candidate.nHeight;
+		cluster.nNeighbors++;
+	}
+
+	int nClusters = 0;
+
+	for (int n = 0; n < nCandidates; n++)
+	{
+		CascadeHit cluster = m_aClusters[n];
+
+		if (cluster.nNeighbors <= m_nMinNeighbors)
+			continue;
+
+		double dScale = 1.0 / cluster.nNeighbors;
+		cluster.nX = Round(cluster.nX * dScale);
+		cluster.nY = Round(cluster.nY * dScale);
+		cluster.nWidth = Round(cluster.nWidth * dScale);
+		cluster.nHeight = Round(cluster.nHeight * dScale);
+
+		m_aClusters[nClusters++] = cluster;
+	}
+
+	// Drop groups lying inside a stronger one
+	for (int i = 0; i < nClusters; i++)
+	{
+		const CascadeHit& inner = m_aClusters[i];
+		bool bNested = false;
+
+		for (int j = 0; j < nClusters && !bNested; j++)
+		{
+			const CascadeHit& outer = m_aClusters[j];
+			int nDeltaX = Round(outer.nWidth * CASCADE_GROUP_EPSILON);
+			int nDeltaY = Round(outer.nHeight * CASCADE_GROUP_EPSILON);
+
+			bNested = i != j &&
+				inner.nX >= outer.nX - nDeltaX && inner.nY >= outer.nY - nDeltaY &&
+				inner.nX + inner.nWidth <= outer.nX + outer.nWidth + nDeltaX &&
+				inner.nY + inner.nHeight <= outer.nY + outer.nHeight + nDeltaY &&
+				(outer.nNeighbors > max(3, inner.nNeighbors) || inner.nNeighbors < 3);
+		}
+
+		if (!bNested)
+		{
+			m_aHits.push_back(inner);
+		}
+	}
+}
+
+#pragma managed(pop)
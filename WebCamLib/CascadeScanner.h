@@ -0,0 +1,179 @@
+//*****************************************************************************************
+//  File:       CascadeScanner.h
+//  Project:    WebcamLib
+//
+//  Declares the multi-scale sliding window search that runs a cascade over whole frames
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#include "LumaPlane.h"
+#include "IntegralImage.h"
+#include "CascadeClassifier.h"
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	class WorkerPool;
+
+	/// <summary>
+	/// One detection after grouping, in pixels of the frame, with the number of raw windows merged into it
+	/// </summary>
+	struct CascadeHit
+	{
+		int nX;
+		int nY;
+		int nWidth;
+		int nHeight;
+		int nNeighbors;
+	};
+
+	/// <summary>
+	/// Slides the classifier's window over a pyramid of the frame, each level the last one shrunk by
+	/// the scale factor, and groups the windows that pass as OpenCV's groupRectangles does. Every
+	/// level's grey image and integral tables are built in parallel and then scanned in bands of
+	/// rows, so a pool spreads the work over both scales and rows. The pyramid's buffers are kept
+	/// from one frame to the next.
+	/// </summary>
+	class CascadeScanner
+	{
+	public:
+		CascadeScanner();
+
+		/// <summary>
+		/// The cascade to run; change it only between calls to Detect
+		/// </summary>
+		CascadeClassifier& GetClassifier()
+		{
+			return m_classifier;
+		}
+
+		/// <summary>
+		/// Ratio between the window sizes of successive levels, more than 1; 1.1 by default
+		/// </summary>
+		HRESULT SetScaleFactor(double dScaleFactor);
+
+		double GetScaleFactor() const
+		{
+			return m_dScaleFactor;
+		}
+
+		/// <summary>
+		/// Groups of this many windows or fewer are dropped; zero keeps every window ungrouped. 3 by default.
+		/// </summary>
+		void SetMinNeighbors(int nMinNeighbors)
+		{
+			m_nMinNeighbors = nMinNeighbors;
+		}
+
+		int GetMinNeighbors() const
+		{
+			return m_nMinNeighbors;
+		}
+
+		/// <summary>
+		/// Smallest and largest window width searched, in frame pixels; zero for no limit
+		/// </summary>
+		void SetSizeLimits(int nMinimumSize, int nMaximumSize)
+		{
+			m_nMinimumSize = nMinimumSize;
+			m_nMaximumSize = nMaximumSize;
+		}
+
+		int GetMinimumSize() const
+		{
+			return m_nMinimumSize;
+		}
+
+		int GetMaximumSize() const
+		{
+			return m_nMaximumSize;
+		}
+
+		/// <summary>
+		/// Pool used to build and scan the levels in parallel, NULL to work on the calling thread
+		/// </summary>
+		void SetWorkerPool(WorkerPool* pPool)
+		{
+			m_pPool = pPool;
+		}
+
+		/// <summary>
+		/// Searches an 8 bit grey, 24 or 32 bit BGR image given by its top row and signed stride,
+		/// returning the number of objects found
+		/// </summary>
+		HRESULT Detect(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, int* pnHits);
+
+		int GetHitCount() const
+		{
+			return static_cast<int>(m_aHits.size());
+		}
+
+		const CascadeHit& GetHit(int nIndex) const
+		{
+			return m_aHits[nIndex];
+		}
+
+	private:
+		CascadeScanner(const CascadeScanner&);
+		CascadeScanner& operator=(const CascadeScanner&);
+
+		struct Level
+		{
+			double dScale;
+			int nWidth;
+			int nHeight;
+			int nStep;
+			int nWindowWidth;		// in frame pixels
+			int nWindowHeight;
+			HRESULT hr;
+			std::vector<int> anSourceX;		// left source column and weight of its right neighbour, per column
+			std::vector<int> anWeightX;
+			std::vector<BYTE> abGray;
+			IntegralImage integral;
+			std::vector<int> anOffsets;
+		};
+
+		// Rows of one level whose windows are scanned as one work item
+		struct Band
+		{
+			int nLevel;
+			int nFirstRow;
+			int nEndRow;
+		};
+
+		static void BuildLevelProc(void* pContext, int nLevel);
+
+		static void ScanBandProc(void* pContext, int nBand);
+
+		void BuildLevel(Level& level);
+
+		void ScanBand(int nBand);
+
+		void GroupCandidates();
+
+		CascadeClassifier m_classifier;
+		double m_dScaleFactor;
+		int m_nMinNeighbors;
+		int m_nMinimumSize;
+		int m_nMaximumSize;
+		WorkerPool* m_pPool;
+
+		LumaPlane m_luma;
+
+		std::vector<Level> m_aLevels;
+		int m_nLevels;
+		std::vector<Band> m_aBands;
+		std::vector<std::vector<CascadeHit> > m_aBandHits;
+
+		std::vector<CascadeHit> m_aCandidates;
+		std::vector<int> m_anParents;
+		std::vector<CascadeHit> m_aClusters;
+		std::vector<CascadeHit> m_aHits;
+	};
+}
+
+#pragma managed(pop)
@@ -0,0 +1,189 @@
+//*****************************************************************************************
+//  File:       CodeReader.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed entry point to the native QR code and barcode scanner
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "WorkerPool.h"
+#include "CodeScanner.h"
+#include "PooledFrame.h"
+#include "CodeReader.h"
+
+using namespace System::Runtime::InteropServices;
+using namespace System::Text;
+using namespace WebCamLib;
+
+#pragma region CodeInfo
+CodeInfo::CodeInfo( int id, CodeSymbology symbology, array<Byte>^ data, int x, int y, int width, int height, bool isNew )
+{
+	this->id = id;
+	this->symbology = symbology;
+	this->data = data;
+	this->x = x;
+	this->y = y;
+	this->width = width;
+	this->height = height;
+	this->isNew = isNew;
+}
+
+String^ CodeInfo::Text::get()
+{
+	if( data == nullptr )
+		return String::Empty;
+
+	// QR codes rarely say which character set they use; UTF-8 is the common case
+	try
+	{
+		return ( gcnew UTF8Encoding( false, true ) )->GetString( data );
+	}
+	catch( DecoderFallbackException^ )
+	{
+		return Encoding::GetEncoding( 28591 )->GetString( data );
+	}
+}
+#pragma endregion
+
+#pragma region CodeReader
+CodeReader::CodeReader()
+{
+	pScanner = new CodeScanner();
+}
+
+CodeReader::CodeReader( bool parallel )
+{
+	pScanner = new CodeScanner();
+
+	if( parallel )
+		pScanner->SetWorkerPool( WorkerPool::GetShared() );
+}
+
+CodeReader::~CodeReader()
+{
+	this->!CodeReader();
+}
+
+CodeReader::!CodeReader()
+{
+	delete pScanner;
+	pScanner = NULL;
+}
+
+CodeScanner* CodeReader::GetScanner()
+{
+	if( pScanner == NULL )
+		throw gcnew ObjectDisposedException( "CodeReader" );
+
+	return pScanner;
+}
+
+int CodeReader::Retention::get()
+{
+	return GetScanner()->GetRetention();
+}
+
+void CodeReader::Retention::set( int value )
+{
+	if( value < 0 )
+		throw gcnew ArgumentOutOfRangeException( "Retention cannot be negative." );
+
+	GetScanner()->SetRetention( value );
+}
+
+int CodeReader::VerifyInterval::get()
+{
+	return GetScanner()->GetVerifyInterval();
+}
+
+void CodeReader::VerifyInterval::set( int value )
+{
+	if( value < 1 )
+		throw gcnew ArgumentOutOfRangeException( "VerifyInterval must be at least 1." );
+
+	GetScanner()->SetVerifyInterval( value );
+}
+
+int CodeReader::CodeCount::get()
+{
+	return GetScanner()->GetCodeCount();
+}
+
+int CodeReader::Scan( IntPtr scan0, int width, int height, int stride, int bitsPerPixel )
+{
+	CodeScanner* pNative = GetScanner();
+
+	if( scan0 == IntPtr::Zero )
+		throw gcnew ArgumentNullException( "scan0" );
+
+	if( width <= 0 || height <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "The image is empty." );
+
+	if( bitsPerPixel != 8 && bitsPerPixel != 24 && bitsPerPixel != 32 )
+		throw gcnew ArgumentException( "Only 8 bit grey and 24 or 32 bit BGR images are supported." );
+
+	int codes = 0;
+	HRESULT hr = pNative->Scan( static_cast<const BYTE*>( scan0.ToPointer() ), width, height, stride, bitsPerPixel, &codes );
+	if( FAILED( hr ) )
+		throw gcnew COMException( "Unable to scan the image.", hr );
+
+	return codes;
+}
+
+int CodeReader::Scan( PooledFrame^ frame )
+{
+	if( frame == nullptr )
+		throw gcnew ArgumentNullException( "frame" );
+
+	return Scan( frame->Scan0, frame->Width, frame->Height, frame->Stride, frame->BitsPerPixel );
+}
+
+CodeInfo CodeReader::GetCode( int index )
+{
+	if( index < 0 || index >= CodeCount )
+		throw gcnew ArgumentOutOfRangeException( "Code index is out of bounds: " + CodeCount.ToString() );
+
+	const CodeTrack& track = pScanner->GetCode( index );
+
+	array<Byte>^ data = gcnew array<Byte>( static_cast<int>( track.abData.size() ) );
+	if( data->Length > 0 )
+		Marshal::Copy( IntPtr( const_cast<BYTE*>( &track.abData[0] ) ), data, 0, data->Length );
+
+	return CodeInfo( track.nId, static_cast<CodeSymbology>( track.eType ), data, track.nLeft, track.nTop,
+		track.nRight - track.nLeft, track.nBottom - track.nTop, track.bNew );
+}
+
+void CodeReader::GetCodes( IList<CodeInfo>^ codes )
+{
+	if( codes == nullptr )
+		throw gcnew ArgumentNullException( "codes" );
+
+	codes->Clear();
+
+	for( int i = 0; i < CodeCount; ++i )
+	{
+		codes->Add( GetCode( i ) );
+	}
+}
+
+void CodeReader::GetRemovedIds( IList<int>^ ids )
+{
+	if( ids == nullptr )
+		throw gcnew ArgumentNullException( "ids" );
+
+	CodeScanner* pNative = GetScanner();
+
+	ids->Clear();
+
+	for( int i = 0; i < pNative->GetRemovedCount(); ++i )
+	{
+		ids->Add( pNative->GetRemovedId( i ) );
+	}
+}
+
+void CodeReader::Reset()
+{
+	GetScanner()->Reset();
+}
+#pragma endregion
@@ -0,0 +1,172 @@
+//*****************************************************************************************
+//  File:       CodeReader.h
+//  Project:    WebcamLib
+//
+//  Declares the managed entry point to the native QR code and barcode scanner
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+using namespace System::Collections::Generic;
+
+namespace WebCamLib
+{
+	class CodeScanner;
+	ref class PooledFrame;
+
+	public enum class CodeSymbology : int
+	{
+		Qr = CodeType_Qr,
+
+		/// <summary>
+		/// EAN-13, and UPC-A read as EAN-13 with a leading zero
+		/// </summary>
+		Ean13 = CodeType_Ean13,
+	};
+
+	/// <summary>
+	/// A code seen in the last frame: its content, its bounds in pixels and whether it was new
+	/// </summary>
+	public value struct CodeInfo
+	{
+	public:
+		CodeInfo( int id, CodeSymbology symbology, array<Byte>^ data, int x, int y, int width, int height, bool isNew );
+
+		/// <summary>
+		/// Stays the same while the code is tracked
+		/// </summary>
+		property int Id
+		{
+			int get() { return id; }
+		}
+
+		property CodeSymbology Symbology
+		{
+			CodeSymbology get() { return symbology; }
+		}
+
+		/// <summary>
+		/// The bytes encoded; the digits for barcodes
+		/// </summary>
+		property array<Byte>^ Data
+		{
+			array<Byte>^ get() { return data; }
+		}
+
+		/// <summary>
+		/// The content as UTF-8, or as ISO 8859-1 when it is not valid UTF-8
+		/// </summary>
+		property String^ Text
+		{
+			String^ get();
+		}
+
+		property int X
+		{
+			int get() { return x; }
+		}
+
+		property int Y
+		{
+			int get() { return y; }
+		}
+
+		property int Width
+		{
+			int get() { return width; }
+		}
+
+		property int Height
+		{
+			int get() { return height; }
+		}
+
+		/// <summary>
+		/// Set in the frame the code was first seen in
+		/// </summary>
+		property bool IsNew
+		{
+			bool get() { return isNew; }
+		}
+
+	private:
+		int id;
+		CodeSymbology symbology;
+		array<Byte>^ data;
+		int x, y, width, height;
+		bool isNew;
+	};
+
+	/// <summary>
+	/// Finds and reads QR codes and EAN-13 barcodes frame after frame, keeping track of them so a
+	/// code in view is only decoded again every VerifyInterval frames
+	/// </summary>
+	public ref class CodeReader
+	{
+	public:
+		CodeReader();
+
+		/// <summary>
+		/// When parallel is set, the frame is binarised and read for barcodes on the shared worker pool
+		/// </summary>
+		CodeReader( bool parallel );
+
+		~CodeReader();
+
+		/// <summary>
+		/// Frames a code may go unseen before it is removed; 5 by default
+		/// </summary>
+		property int Retention
+		{
+			int get();
+			void set( int value );
+		}
+
+		/// <summary>
+		/// Frames a tracked QR code goes without being decoded again; 15 by default, 1 decodes every frame
+		/// </summary>
+		property int VerifyInterval
+		{
+			int get();
+			void set( int value );
+		}
+
+		property int CodeCount
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Searches an 8 bit grey, 24 or 32 bit BGR image and returns the number of codes seen in it
+		/// </summary>
+		int Scan( IntPtr scan0, int width, int height, int stride, int bitsPerPixel );
+
+		int Scan( PooledFrame^ frame );
+
+		CodeInfo GetCode( int index );
+
+		/// <summary>
+		/// Replaces the contents of the list with the codes seen in the last frame
+		/// </summary>
+		void GetCodes( IList<CodeInfo>^ codes );
+
+		/// <summary>
+		/// Replaces the contents of the list with the identifiers of the codes removed in the last frame
+		/// </summary>
+		void GetRemovedIds( IList<int>^ ids );
+
+		/// <summary>
+		/// Forgets every code without reporting them as removed
+		/// </summary>
+		void Reset();
+
+	protected:
+		!CodeReader();
+
+	private:
+		CodeScanner* GetScanner();
+
+		CodeScanner* pScanner;
+	};
+}
@@ -0,0 +1,380 @@
+//*****************************************************************************************
+//  File:       CodeScanner.cpp
+//  Project:    WebcamLib
+//
+//  Defines the per-frame search for QR codes and EAN-13 barcodes and their tracking
+//*****************************************************************************************
+
+#include <windows.h>
+#include <math.h>
+
+#include "WorkerPool.h"
+#include "CodeScanner.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Rows binarised and read for barcodes as one work item
+#define CODE_BAND_ROWS				32
+
+// The threshold window reaches this fraction of the frame's smaller side around each pixel,
+// and at least the minimum; pixels an eighth darker than the window's mean are dark
+#define CODE_RADIUS_DIVISOR			16
+#define CODE_MINIMUM_RADIUS			8
+
+// Finder patterns are searched on every other row, barcodes read on every other row
+#define CODE_QR_ROW_STEP			2
+#define CODE_BARCODE_ROW_STEP		2
+
+// A barcode counts once it is read alike on this many rows, each at most the gap below the last
+#define CODE_BARCODE_QUORUM			2
+#define CODE_BARCODE_ROW_GAP		8
+
+namespace
+{
+	// Outline of the code the finders of a candidate frame: each finder's outer edge is 3.5
+	// modules out from its centre
+	void GetCandidateBounds(const QrCandidate& candidate, int* pnLeft, int* pnTop, int* pnRight, int* pnBottom)
+	{
+		float fAcrossX = candidate.topRight.fX - candidate.topLeft.fX;
+		float fAcrossY = candidate.topRight.fY - candidate.topLeft.fY;
+		float fDownX = candidate.bottomLeft.fX - candidate.topLeft.fX;
+		float fDownY = candidate.bottomLeft.fY - candidate.topLeft.fY;
+
+		float fAcross = sqrt(fAcrossX * fAcrossX + fAcrossY * fAcrossY);
+		float fDown = sqrt(fDownX * fDownX + fDownY * fDownY);
+
+		float fReach = 3.5f * candidate.fModuleSize;
+		float fUX = fAcross > 0.0f ? fAcrossX / fAcross * fReach : 0.0f;
+		float fUY = fAcross > 0.0f ? fAcrossY / fAcross * fReach : 0.0f;
+		float fVX = fDown > 0.0f ? fDownX / fDown * fReach : 0.0f;
+		float fVY = fDown > 0.0f ? fDownY / fDown * fReach : 0.0f;
+
+		float afX[4] =
+		{
+			candidate.topLeft.fX - fUX - fVX,
+			candidate.topRight.fX + fUX - fVX,
+			candidate.topRight.fX + fDownX + fUX + fVX,
+			candidate.bottomLeft.fX - fUX + fVX,
+		};
+
+		float afY[4] =
+		{
+			candidate.topLeft.fY - fUY - fVY,
+			candidate.topRight.fY + fUY - fVY,
+			candidate.topRight.fY + fDownY + fUY + fVY,
+			candidate.bottomLeft.fY - fUY + fVY,
+		};
+
+		float fLeft = afX[0], fRight = afX[0], fTop = afY[0], fBottom = afY[0];
+		for (int n = 1; n < 4; n++)
+		{
+			fLeft = min(fLeft, afX[n]);
+			fRight = max(fRight, afX[n]);
+			fTop = min(fTop, afY[n]);
+			fBottom = max(fBottom, afY[n]);
+		}
+
+		*pnLeft = static_cast<int>(floor(fLeft));
+		*pnTop = static_cast<int>(floor(fTop));
+		*pnRight = static_cast<int>(ceil(fRight));
+		*pnBottom = static_cast<int>(ceil(fBottom));
+	}
+}
+
+CodeScanner::CodeScanner()
+{
+	m_nRetention = 5;
+	m_nVerifyInterval = 15;
+	m_pPool = NULL;
+	m_nNextId = 1;
+	m_nRadius = 0;
+	m_nBands = 0;
+}
+
+void CodeScanner::Reset()
+{
+	m_aTracks.clear();
+	m_anSeen.clear();
+	m_anRemoved.clear();
+}
+
+HRESULT CodeScanner::Scan(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, int* pnCodes)
+{
+	m_anSeen.clear();
+	m_anRemoved.clear();
+	if (pnCodes != NULL)
+	{
+		*pnCodes = 0;
+	}
+
+	HRESULT hr = m_luma.Extract(pTop, nWidth, nHeight, nStride, nBitsPerPixel);
+	if (FAILED(hr))
+		return hr;
+
+	hr = m_integral.Build(m_luma.GetData(), nWidth, nHeight, nWidth, false);
+	if (FAILED(hr))
+		return hr;
+
+	m_nRadius = max(CODE_MINIMUM_RADIUS, min(nWidth, nHeight) / CODE_RADIUS_DIVISOR);
+
+	size_t cPixels = static_cast<size_t>(nWidth) * nHeight;
+	if (m_abBinary.size() < cPixels)
+	{
+		m_abBinary.resize(cPixels);
+	}
+
+	m_nBands = (nHeight + CODE_BAND_ROWS - 1) / CODE_BAND_ROWS;
+	if (static_cast<int>(m_aReaders.size()) < m_nBands)
+	{
+		m_aReaders.resize(m_nBands);
+	}
+
+	if (m_pPool != NULL && m_nBands > 1)
+	{
+		m_pPool->Run(ProcessBandProc, this, m_nBands);
+	}
+	else
+	{
+		for (int n = 0; n < m_nBands; n++)
+		{
+			ProcessBand(n);
+		}
+	}
+
+	for (size_t n = 0; n < m_aTracks.size(); n++)
+	{
+		m_aTracks[n].bSeen = false;
+		m_aTracks[n].bNew = false;
+	}
+
+	ScanQrCodes();
+	GroupBarcodes();
+
+	// Drop the codes gone for too long and list the ones seen
+	size_t cKept = 0;
+	for (size_t n = 0; n < m_aTracks.size(); n++)
+	{
+		CodeTrack& track = m_aTracks[n];
+
+		if (!track.bSeen && ++track.nMissed > m_nRetention)
+		{
+			m_anRemoved.push_back(track.nId);
+			continue;
+		}
+
+		if (cKept != n)
+		{
+			m_aTracks[cKept] = track;
+		}
+
+		if (m_aTracks[cKept].bSeen)
+		{
+			m_anSeen.push_back(static_cast<int>(cKept));
+		}
+
+		cKept++;
+	}
+
+	m_aTracks.resize(cKept);
+
+	if (pnCodes != NULL)
+	{
+		*pnCodes = GetCodeCount();
+	}
+
+	return S_OK;
+}
+
+void CodeScanner::ProcessBandProc(void* pContext, int nBand)
+{
+	static_cast<CodeScanner*>(pContext)->ProcessBand(nBand);
+}
+
+void CodeScanner::ProcessBand(int nBand)
+{
+	int nWidth = m_luma.GetWidth();
+	int nHeight = m_luma.GetHeight();
+	int nFirstRow = nBand * CODE_BAND_ROWS;
+	int nEndRow = min(nFirstRow + CODE_BAND_ROWS, nHeight);
+
+	const BYTE* pLuma = m_luma.GetData();
+	const int* pnSums = m_integral.GetSums();
+	int nTableStride = m_integral.GetStride();
+
+	Ean13Reader& reader = m_aReaders[nBand];
+	reader.Clear();
+
+	for (int y = nFirstRow; y < nEndRow; y++)
+	{
+		int nTop = max(0, y - m_nRadius);
+		int nBottom = min(nHeight, y + m_nRadius + 1);
+		const int* pnAbove = pnSums + nTop * nTableStride;
+		const int* pnBelow = pnSums + nBottom * nTableStride;
+
+		const BYTE* pSource = pLuma + static_cast<size_t>(y) * nWidth;
+		BYTE* pTarget = &m_abBinary[static_cast<size_t>(y) * nWidth];
+
+		for (int x = 0; x < nWidth; x++)
+		{
+			int nLeft = max(0, x - m_nRadius);
+			int nRight = min(nWidth, x + m_nRadius + 1);
+
+			int nArea = (nRight - nLeft) * (nBottom - nTop);
+			int nSum = pnBelow[nRight] - pnAbove[nRight] - pnBelow[nLeft] + pnAbove[nLeft];
+
+			pTarget[x] = pSource[x] * nArea * 8 <= nSum * 7 ? 1 : 0;
+		}
+
+		// The rows read lie on one grid whichever band they fall in
+		if (y % CODE_BARCODE_ROW_STEP == 0)
+		{
+			reader.ReadRow(pTarget, nWidth, y);
+		}
+	}
+}
+
+void CodeScanner::ScanQrCodes()
+{
+	int nWidth = m_luma.GetWidth();
+	int nHeight = m_luma.GetHeight();
+
+	m_finder.Find(&m_abBinary[0], nWidth, nHeight, CODE_QR_ROW_STEP);
+
+	for (int n = 0; n < m_finder.GetCandidateCount(); n++)
+	{
+		const QrCandidate& candidate = m_finder.GetCandidate(n);
+
+		int nLeft, nTop, nRight, nBottom;
+		GetCandidateBounds(candidate, &nLeft, &nTop, &nRight, &nBottom);
+
+		// A candidate over a code read recently is taken to be that code without decoding it
+		int nCenterX = (nLeft + nRight) / 2;
+		int nCenterY = (nTop + nBottom) / 2;
+		bool bTracked = false;
+
+		for (size_t i = 0; i < m_aTracks.size() && !bTracked; i++)
+		{
+			CodeTrack& track = m_aTracks[i];
+
+			if (track.eType != CodeType_Qr || track.bSeen || track.nSinceDecoded + 1 >= m_nVerifyInterval)
+				continue;
+
+			if (nCenterX >= track.nLeft && nCenterX <= track.nRight && nCenterY >= track.nTop && nCenterY <= track.nBottom)
+			{
+				track.nSinceDecoded++;
+				MarkSeen(track, nLeft, nTop, nRight, nBottom);
+				bTracked = true;
+			}
+		}
+
+		if (bTracked)
+			continue;
+
+		QrPoint apCorners[4];
+		if (m_decoder.Decode(&m_abBinary[0], nWidth, nHeight, candidate, &m_abData, apCorners) != S_OK)
+			continue;
+
+		float fLeft = apCorners[0].fX, fRight = apCorners[0].fX, fTop = apCorners[0].fY, fBottom = apCorners[0].fY;
+		for (int i = 1; i < 4; i++)
+		{
+			fLeft = min(fLeft, apCorners[i].fX);
+			fRight = max(fRight, apCorners[i].fX);
+			fTop = min(fTop, apCorners[i].fY);
+			fBottom = max(fBottom, apCorners[i].fY);
+		}
+
+		int nTrack = Observe(CodeType_Qr, m_abData, static_cast<int>(floor(fLeft)), static_cast<int>(floor(fTop)), static_cast<int>(ceil(fRight)), static_cast<int>(ceil(fBottom)));
+		m_aTracks[nTrack].nSinceDecoded = 0;
+	}
+}
+
+void CodeScanner::GroupBarcodes()
+{
+	// Bands are in order, so the reads are by row
+	m_aReads.clear();
+	for (int n = 0; n < m_nBands; n++)
+	{
+		const Ean13Reader& reader = m_aReaders[n];
+
+		for (int i = 0; i < reader.GetReadCount(); i++)
+		{
+			m_aReads.push_back(reader.GetRead(i));
+		}
+	}
+
+	m_abGrouped.assign(m_aReads.size(), false);
+
+	for (size_t n = 0; n < m_aReads.size(); n++)
+	{
+		if (m_abGrouped[n])
+			continue;
+
+		const Ean13Read& first = m_aReads[n];
+		int nLeft = first.nLeft;
+		int nRight = first.nRight;
+		int nTop = first.nRow;
+		int nBottom = first.nRow;
+		int nRows = 1;
+
+		// The same digits across the same columns on the rows below
+		for (size_t i = n + 1; i < m_aReads.size() && m_aReads[i].nRow <= nBottom + CODE_BARCODE_ROW_GAP; i++)
+		{
+			const Ean13Read& read = m_aReads[i];
+
+			if (m_abGrouped[i] || read.nRight < nLeft || read.nLeft > nRight || memcmp(read.acDigits, first.acDigits, sizeof(first.acDigits)) != 0)
+				continue;
+
+			m_abGrouped[i] = true;
+			nLeft = min(nLeft, read.nLeft);
+			nRight = max(nRight, read.nRight);
+			nBottom = read.nRow;
+			nRows++;
+		}
+
+		if (nRows < CODE_BARCODE_QUORUM)
+			continue;
+
+		m_abData.assign(first.acDigits, first.acDigits + sizeof(first.acDigits));
+		Observe(CodeType_Ean13, m_abData, nLeft, nTop, nRight, nBottom);
+	}
+}
+
+int CodeScanner::Observe(CodeType eType, const std::vector<BYTE>& abData, int nLeft, int nTop, int nRight, int nBottom)
+{
+	for (size_t n = 0; n < m_aTracks.size(); n++)
+	{
+		CodeTrack& track = m_aTracks[n];
+
+		if (track.eType == eType && !track.bSeen && track.abData == abData)
+		{
+			MarkSeen(track, nLeft, nTop, nRight, nBottom);
+			return static_cast<int>(n);
+		}
+	}
+
+	m_aTracks.push_back(CodeTrack());
+
+	CodeTrack& track = m_aTracks.back();
+	track.nId = m_nNextId++;
+	track.eType = eType;
+	track.abData = abData;
+	track.bNew = true;
+	track.nSinceDecoded = 0;
+	MarkSeen(track, nLeft, nTop, nRight, nBottom);
+
+	return static_cast<int>(m_aTracks.size()) - 1;
+}
+
+void CodeScanner::MarkSeen(CodeTrack& track, int nLeft, int nTop, int nRight, int nBottom)
+{
+	track.nLeft = nLeft;
+	track.nTop = nTop;
+	track.nRight = nRight;
+	track.nBottom = nBottom;
+	track.bSeen = true;
+	track.nMissed = 0;
+}
+
+#pragma managed(pop)
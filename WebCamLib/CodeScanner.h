@@ -0,0 +1,174 @@
+//*****************************************************************************************
+//  File:       CodeScanner.h
+//  Project:    WebcamLib
+//
+//  Declares the per-frame search for QR codes and EAN-13 barcodes and their tracking
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#include "LumaPlane.h"
+#include "IntegralImage.h"
+#include "QrFinder.h"
+#include "QrDecoder.h"
+#include "Ean13Reader.h"
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	class WorkerPool;
+
+	enum CodeType
+	{
+		CodeType_Qr,
+		CodeType_Ean13,
+	};
+
+	/// <summary>
+	/// A code followed from frame to frame: its content, its bounds in the last frame it was seen
+	/// in, in pixels, and whether that frame was its first
+	/// </summary>
+	struct CodeTrack
+	{
+		int nId;
+		CodeType eType;
+		std::vector<BYTE> abData;
+		int nLeft;
+		int nTop;
+		int nRight;
+		int nBottom;
+		bool bNew;
+		bool bSeen;
+		int nMissed;				// frames since it was last seen
+		int nSinceDecoded;			// frames since its content was last read, for QR codes
+	};
+
+	/// <summary>
+	/// Finds codes in the luma plane of each frame. An adaptive threshold against the mean of each
+	/// pixel's neighbourhood binarises the frame in bands of rows, reading the bands' rows for
+	/// barcodes as it goes, on a pool when one is set. QR finder patterns are then grouped into
+	/// candidates and only the candidates that do not lie on a code already tracked are decoded;
+	/// tracked codes are read again every few frames in case they were swapped. Codes unseen for
+	/// a few frames are dropped.
+	/// </summary>
+	class CodeScanner
+	{
+	public:
+		CodeScanner();
+
+		/// <summary>
+		/// Frames a code may go unseen before it is dropped; 5 by default
+		/// </summary>
+		void SetRetention(int nFrames)
+		{
+			m_nRetention = nFrames;
+		}
+
+		int GetRetention() const
+		{
+			return m_nRetention;
+		}
+
+		/// <summary>
+		/// Frames a tracked QR code goes without being decoded again; 15 by default, 1 decodes every frame
+		/// </summary>
+		void SetVerifyInterval(int nFrames)
+		{
+			m_nVerifyInterval = nFrames;
+		}
+
+		int GetVerifyInterval() const
+		{
+			return m_nVerifyInterval;
+		}
+
+		/// <summary>
+		/// Pool used to binarise and read the bands of rows in parallel, NULL to work on the calling thread
+		/// </summary>
+		void SetWorkerPool(WorkerPool* pPool)
+		{
+			m_pPool = pPool;
+		}
+
+		/// <summary>
+		/// Searches an 8 bit grey, 24 or 32 bit BGR image given by its top row and signed stride,
+		/// returning the number of codes seen in it
+		/// </summary>
+		HRESULT Scan(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, int* pnCodes);
+
+		/// <summary>
+		/// Codes seen in the last frame
+		/// </summary>
+		int GetCodeCount() const
+		{
+			return static_cast<int>(m_anSeen.size());
+		}
+
+		const CodeTrack& GetCode(int nIndex) const
+		{
+			return m_aTracks[m_anSeen[nIndex]];
+		}
+
+		/// <summary>
+		/// Identifiers of the codes dropped in the last frame
+		/// </summary>
+		int GetRemovedCount() const
+		{
+			return static_cast<int>(m_anRemoved.size());
+		}
+
+		int GetRemovedId(int nIndex) const
+		{
+			return m_anRemoved[nIndex];
+		}
+
+		/// <summary>
+		/// Forgets every code without reporting them as removed
+		/// </summary>
+		void Reset();
+
+	private:
+		CodeScanner(const CodeScanner&);
+		CodeScanner& operator=(const CodeScanner&);
+
+		static void ProcessBandProc(void* pContext, int nBand);
+
+		void ProcessBand(int nBand);
+
+		void ScanQrCodes();
+
+		void GroupBarcodes();
+
+		// Index of the track a code was seen as, created when none holds the same content
+		int Observe(CodeType eType, const std::vector<BYTE>& abData, int nLeft, int nTop, int nRight, int nBottom);
+
+		void MarkSeen(CodeTrack& track, int nLeft, int nTop, int nRight, int nBottom);
+
+		int m_nRetention;
+		int m_nVerifyInterval;
+		WorkerPool* m_pPool;
+		int m_nNextId;
+
+		LumaPlane m_luma;
+		IntegralImage m_integral;
+		int m_nRadius;
+		std::vector<BYTE> m_abBinary;
+		int m_nBands;
+		std::vector<Ean13Reader> m_aReaders;
+
+		QrFinder m_finder;
+		QrDecoder m_decoder;
+		std::vector<BYTE> m_abData;
+		std::vector<Ean13Read> m_aReads;
+		std::vector<bool> m_abGrouped;
+
+		std::vector<CodeTrack> m_aTracks;
+		std::vector<int> m_anSeen;
+		std::vector<int> m_anRemoved;
+	};
+}
+
+#pragma managed(pop)
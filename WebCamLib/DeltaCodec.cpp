@@ -0,0 +1,405 @@
+//*****************************************************************************************
+//  File:       DeltaCodec.cpp
+//  Project:    WebcamLib
+//
+//  Defines the inter-frame codec storing only the tiles that changed since the last frame
+//*****************************************************************************************
+
+#include <windows.h>
+#include <emmintrin.h>
+
+#include "DeltaCodec.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+namespace
+{
+	void CopyRows(const BYTE* pFrom, ptrdiff_t nFromStride, BYTE* pTo, ptrdiff_t nToStride, int nRows, size_t cbRow)
+	{
+		for (int y = 0; y < nRows; y++, pFrom += nFromStride, pTo += nToStride)
+			CopyMemory(pTo, pFrom, cbRow);
+	}
+
+	/// <summary>
+	/// Sum of absolute differences of two byte runs, 16 at a time; also raises the largest difference
+	/// seen so far, so a small but strong change is not averaged away
+	/// </summary>
+	__forceinline DWORD SumDifferences(const BYTE* pFirst, const BYTE* pSecond, size_t cbLength, BYTE* pbPeak)
+	{
+		__m128i sums = _mm_setzero_si128();
+		__m128i peaks = _mm_setzero_si128();
+		size_t n = 0;
+
+		for (; n + 16 <= cbLength; n += 16)
+		{
+			__m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pFirst + n));
+			__m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSecond + n));
+			sums = _mm_add_epi64(sums, _mm_sad_epu8(first, second));
+			peaks = _mm_max_epu8(peaks, _mm_or_si128(_mm_subs_epu8(first, second), _mm_subs_epu8(second, first)));
+		}
+
+		DWORD dwSum = _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+
+		peaks = _mm_max_epu8(peaks, _mm_srli_si128(peaks, 8));
+		peaks = _mm_max_epu8(peaks, _mm_srli_si128(peaks, 4));
+		peaks = _mm_max_epu8(peaks, _mm_srli_si128(peaks, 2));
+		peaks = _mm_max_epu8(peaks, _mm_srli_si128(peaks, 1));
+		BYTE bPeak = static_cast<BYTE>(_mm_cvtsi128_si32(peaks));
+
+		for (; n < cbLength; n++)
+		{
+			BYTE bDifference = static_cast<BYTE>(pFirst[n] > pSecond[n] ? pFirst[n] - pSecond[n] : pSecond[n] - pFirst[n]);
+			dwSum += bDifference;
+			bPeak = bDifference > bPeak ? bDifference : bPeak;
+		}
+
+		if (bPeak > *pbPeak)
+			*pbPeak = bPeak;
+
+		return dwSum;
+	}
+}
+
+DeltaCodec::DeltaCodec()
+{
+	m_nWidth = 0;
+	m_nHeight = 0;
+	m_nBitsPerPixel = 0;
+	m_nTilesAcross = 0;
+	m_nTilesDown = 0;
+	m_dwChangedTiles = 0;
+	m_bHasReference = false;
+}
+
+DWORD DeltaCodec::GetMaxEncodedSize(int nWidth, int nHeight)
+{
+	if (nWidth <= 0 || nHeight <= 0)
+		return sizeof(DeltaFrameHeader);
+
+	ULONGLONG ullTiles = static_cast<ULONGLONG>((nWidth + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE) * ((nHeight + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE);
+	DWORD dwKeyframe = LosslessCodec::GetMaxEncodedSize(nWidth, nHeight);
+
+	// Partial tiles at the edges are stored whole, so the stacked tiles can outgrow the frame
+	DWORD dwTiles = ullTiles * DELTA_TILE_SIZE <= MAXLONG ? LosslessCodec::GetMaxEncodedSize(DELTA_TILE_SIZE, static_cast<int>(ullTiles * DELTA_TILE_SIZE)) : MAXDWORD;
+
+	ULONGLONG ullSize = sizeof(DeltaFrameHeader) + (ullTiles + 7) / 8 + (dwKeyframe > dwTiles ? dwKeyframe : dwTiles);
+
+	return ullSize < MAXDWORD ? static_cast<DWORD>(ullSize) : MAXDWORD;
+}
+
+bool DeltaCodec::ReadHeader(const BYTE* pSource, DWORD dwLength, DeltaFrameHeader* pHeader)
+{
+	if (pSource == NULL || dwLength < sizeof(DeltaFrameHeader))
+		return false;
+
+	CopyMemory(pHeader, pSource, sizeof(DeltaFrameHeader));
+
+	if (pHeader->dwMagic != DELTA_MAGIC || pHeader->wVersion != DELTA_VERSION || pHeader->wTileSize != DELTA_TILE_SIZE ||
+		(pHeader->wBitsPerPixel != 24 && pHeader->wBitsPerPixel != 32) ||
+		pHeader->nWidth <= 0 || pHeader->nHeight <= 0)
+		return false;
+
+	if (pHeader->wFlags & DELTA_KEYFRAME)
+		return true;
+
+	ULONGLONG ullTiles = static_cast<ULONGLONG>((pHeader->nWidth + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE) * ((pHeader->nHeight + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE);
+
+	return pHeader->dwChangedTiles <= ullTiles && (ullTiles + 7) / 8 <= dwLength - sizeof(DeltaFrameHeader);
+}
+
+void DeltaCodec::Reset()
+{
+	m_bHasReference = false;
+	m_dwChangedTiles = 0;
+}
+
+void DeltaCodec::SetFormat(int nWidth, int nHeight, int nBitsPerPixel)
+{
+	if (nWidth == m_nWidth && nHeight == m_nHeight && nBitsPerPixel == m_nBitsPerPixel)
+		return;
+
+	m_nWidth = nWidth;
+	m_nHeight = nHeight;
+	m_nBitsPerPixel = nBitsPerPixel;
+	m_nTilesAcross = (nWidth + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE;
+	m_nTilesDown = (nHeight + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE;
+	m_bHasReference = false;
+
+	m_aReference.resize(static_cast<size_t>(nWidth) * nHeight * (nBitsPerPixel / 8));
+	m_aChangeMap.resize((GetTileCount() + 7) / 8);
+	m_aTileSums.resize(m_nTilesAcross);
+	m_aTilePeaks.resize(m_nTilesAcross);
+
+	// The column of stacked tiles only grows as far as the frames need
+	m_aTiles.clear();
+}
+
+void DeltaCodec::GetTileBounds(DWORD dwTile, int* pnLeft, int* pnTop, int* pnWidth, int* pnHeight) const
+{
+	*pnLeft = static_cast<int>(dwTile % m_nTilesAcross) * DELTA_TILE_SIZE;
+	*pnTop = static_cast<int>(dwTile / m_nTilesAcross) * DELTA_TILE_SIZE;
+	*pnWidth = m_nWidth - *pnLeft < DELTA_TILE_SIZE ? m_nWidth - *pnLeft : DELTA_TILE_SIZE;
+	*pnHeight = m_nHeight - *pnTop < DELTA_TILE_SIZE ? m_nHeight - *pnTop : DELTA_TILE_SIZE;
+}
+
+DWORD DeltaCodec::FindChangedTiles(const BYTE* pTop, int nStride, DWORD dwThreshold, BYTE bPeakThreshold)
+{
+	const int nBytesPerPixel = m_nBitsPerPixel / 8;
+	const size_t cbRow = static_cast<size_t>(m_nWidth) * nBytesPerPixel;
+	const size_t cbTileRow = DELTA_TILE_SIZE * nBytesPerPixel;
+
+	ZeroMemory(&m_aChangeMap[0], m_aChangeMap.size());
+	DWORD dwChanged = 0;
+
+	for (int nTileRow = 0; nTileRow < m_nTilesDown; nTileRow++)
+	{
+		int nTop = nTileRow * DELTA_TILE_SIZE;
+		int nRows = m_nHeight - nTop < DELTA_TILE_SIZE ? m_nHeight - nTop : DELTA_TILE_SIZE;
+
+		ZeroMemory(&m_aTileSums[0], m_aTileSums.size() * sizeof(DWORD));
+		ZeroMemory(&m_aTilePeaks[0], m_aTilePeaks.size());
+
+		// Row by row across the whole band, so both images are read in memory order
+		for (int y = nTop; y < nTop + nRows; y++)
+		{
+			const BYTE* pCurrent = pTop + static_cast<ptrdiff_t>(y) * nStride;
+			const BYTE* pReference = &m_aReference[0] + y * cbRow;
+
+			for (int nColumn = 0; nColumn < m_nTilesAcross; nColumn++)
+			{
+				size_t nOffset = nColumn * cbTileRow;
+				size_t cbLength = cbRow - nOffset < cbTileRow ? cbRow - nOffset : cbTileRow;
+
+				m_aTileSums[nColumn] += SumDifferences(pCurrent + nOffset, pReference + nOffset, cbLength, &m_aTilePeaks[nColumn]);
+			}
+		}
+
+		for (int nColumn = 0; nColumn < m_nTilesAcross; nColumn++)
+		{
+			size_t nOffset = nColumn * cbTileRow;
+			size_t cbTile = (cbRow - nOffset < cbTileRow ? cbRow - nOffset : cbTileRow) * nRows;
+
+			if (m_aTileSums[nColumn] > dwThreshold * cbTile || m_aTilePeaks[nColumn] > bPeakThreshold)
+			{
+				DWORD dwTile = static_cast<DWORD>(nTileRow) * m_nTilesAcross + nColumn;
+				m_aChangeMap[dwTile >> 3] |= static_cast<BYTE>(1 << (dwTile & 7));
+				dwChanged++;
+			}
+		}
+	}
+
+	return dwChanged;
+}
+
+HRESULT DeltaCodec::Encode(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, bool bKeyframe,
+	DWORD dwThreshold, BYTE bPeakThreshold, BYTE* pDestination, DWORD dwCapacity, DWORD* pdwSize)
+{
+	if (pTop == NULL || pDestination == NULL || pdwSize == NULL || nWidth <= 0 || nHeight <= 0 ||
+		(nBitsPerPixel != 24 && nBitsPerPixel != 32))
+		return E_INVALIDARG;
+
+	*pdwSize = 0;
+
+	if (dwCapacity < sizeof(DeltaFrameHeader))
+		return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+
+	SetFormat(nWidth, nHeight, nBitsPerPixel);
+
+	const int nBytesPerPixel = nBitsPerPixel / 8;
+	const size_t cbRow = static_cast<size_t>(nWidth) * nBytesPerPixel;
+
+	DeltaFrameHeader header;
+	header.dwMagic = DELTA_MAGIC;
+	header.wVersion = DELTA_VERSION;
+	header.wFlags = 0;
+	header.nWidth = nWidth;
+	header.nHeight = nHeight;
+	header.wBitsPerPixel = static_cast<WORD>(nBitsPerPixel);
+	header.wTileSize = DELTA_TILE_SIZE;
+
+	BYTE* pNext = pDestination + sizeof(DeltaFrameHeader);
+	DWORD dwRemaining = dwCapacity - sizeof(DeltaFrameHeader);
+	DWORD dwSize = 0;
+	HRESULT hr = S_OK;
+
+	if (bKeyframe || !m_bHasReference)
+	{
+		header.wFlags = DELTA_KEYFRAME;
+		header.dwChangedTiles = GetTileCount();
+
+		hr = m_codec.Encode(pTop, nWidth, nHeight, nStride, nBitsPerPixel, pNext, dwRemaining, &dwSize);
+
+		if (FAILED(hr))
+			return hr;
+
+		CopyRows(pTop, nStride, &m_aReference[0], cbRow, nHeight, cbRow);
+	}
+	else
+	{
+		header.dwChangedTiles = FindChangedTiles(pTop, nStride, dwThreshold, bPeakThreshold);
+
+		DWORD cbMap = static_cast<DWORD>(m_aChangeMap.size());
+		if (dwRemaining < cbMap)
+			return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+
+		CopyMemory(pNext, &m_aChangeMap[0], cbMap);
+		dwSize = cbMap;
+
+		if (header.dwChangedTiles > 0)
+		{
+			const size_t cbTileRow = DELTA_TILE_SIZE * nBytesPerPixel;
+			const size_t cbTile = cbTileRow * DELTA_TILE_SIZE;
+
+			// Padding of partial tiles is zero, which costs next to nothing to code
+			m_aTiles.resize(header.dwChangedTiles * cbTile);
+			ZeroMemory(&m_aTiles[0], m_aTiles.size());
+
+			BYTE* pTile = &m_aTiles[0];
+			for (DWORD dwTile = 0; dwTile < GetTileCount(); dwTile++)
+			{
+				if (!(m_aChangeMap[dwTile >> 3] & (1 << (dwTile & 7))))
+					continue;
+
+				int nLeft, nTileTop, nTileWidth, nTileHeight;
+				GetTileBounds(dwTile, &nLeft, &nTileTop, &nTileWidth, &nTileHeight);
+
+				const BYTE* pSource = pTop + static_cast<ptrdiff_t>(nTileTop) * nStride + nLeft * nBytesPerPixel;
+				CopyRows(pSource, nStride, pTile, cbTileRow, nTileHeight, nTileWidth * nBytesPerPixel);
+				pTile += cbTile;
+			}
+
+			DWORD dwTiles = 0;
+			hr = m_codec.Encode(&m_aTiles[0], DELTA_TILE_SIZE, header.dwChangedTiles * DELTA_TILE_SIZE, static_cast<int>(cbTileRow), nBitsPerPixel,
+				pNext + cbMap, dwRemaining - cbMap, &dwTiles);
+
+			if (FAILED(hr))
+				return hr;
+
+			dwSize += dwTiles;
+
+			// Only now the frame is written does the decoder's copy move on
+			pTile = &m_aTiles[0];
+			for (DWORD dwTile = 0; dwTile < GetTileCount(); dwTile++)
+			{
+				if (!(m_aChangeMap[dwTile >> 3] & (1 << (dwTile & 7))))
+					continue;
+
+				int nLeft, nTileTop, nTileWidth, nTileHeight;
+				GetTileBounds(dwTile, &nLeft, &nTileTop, &nTileWidth, &nTileHeight);
+
+				BYTE* pReference = &m_aReference[0] + nTileTop * cbRow + nLeft * nBytesPerPixel;
+				CopyRows(pTile, cbTileRow, pReference, cbRow, nTileHeight, nTileWidth * nBytesPerPixel);
+				pTile += cbTile;
+			}
+		}
+	}
+
+	CopyMemory(pDestination, &header, sizeof(DeltaFrameHeader));
+	*pdwSize = sizeof(DeltaFrameHeader) + dwSize;
+
+	m_dwChangedTiles = header.dwChangedTiles;
+	m_bHasReference = true;
+
+	return S_OK;
+}
+
+HRESULT DeltaCodec::Decode(const BYTE* pSource, DWORD dwLength, BYTE* pTop, int nStride)
+{
+	DeltaFrameHeader header;
+
+	if (pTop == NULL)
+		return E_INVALIDARG;
+
+	if (!ReadHeader(pSource, dwLength, &header))
+		return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+	const BYTE* pNext = pSource + sizeof(DeltaFrameHeader);
+	DWORD dwRemaining = dwLength - sizeof(DeltaFrameHeader);
+	HRESULT hr = S_OK;
+
+	if (header.wFlags & DELTA_KEYFRAME)
+	{
+		SetFormat(header.nWidth, header.nHeight, header.wBitsPerPixel);
+
+		LosslessFrameHeader frame;
+		if (!LosslessCodec::ReadHeader(pNext, dwRemaining, &frame) ||
+			frame.nWidth != header.nWidth || frame.nHeight != header.nHeight || frame.wBitsPerPixel != header.wBitsPerPixel)
+			return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+		// The reference is only whole again once this succeeds
+		m_bHasReference = false;
+
+		hr = m_codec.Decode(pNext, dwRemaining, &m_aReference[0], header.nWidth * (header.wBitsPerPixel / 8));
+
+		if (FAILED(hr))
+			return hr;
+
+		m_dwChangedTiles = GetTileCount();
+	}
+	else
+	{
+		if (!m_bHasReference || header.nWidth != m_nWidth || header.nHeight != m_nHeight || header.wBitsPerPixel != m_nBitsPerPixel)
+			return HRESULT_FROM_WIN32(ERROR_INVALID_STATE);
+
+		DWORD cbMap = static_cast<DWORD>(m_aChangeMap.size());
+		CopyMemory(&m_aChangeMap[0], pNext, cbMap);
+
+		DWORD dwMarked = 0;
+		for (DWORD dwTile = 0; dwTile < GetTileCount(); dwTile++)
+		{
+			if (m_aChangeMap[dwTile >> 3] & (1 << (dwTile & 7)))
+				dwMarked++;
+		}
+
+		if (dwMarked != header.dwChangedTiles)
+			return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+		if (dwMarked > 0)
+		{
+			const int nBytesPerPixel = m_nBitsPerPixel / 8;
+			const size_t cbRow = static_cast<size_t>(m_nWidth) * nBytesPerPixel;
+			const size_t cbTileRow = DELTA_TILE_SIZE * nBytesPerPixel;
+			const size_t cbTile = cbTileRow * DELTA_TILE_SIZE;
+
+			LosslessFrameHeader tiles;
+			if (!LosslessCodec::ReadHeader(pNext + cbMap, dwRemaining - cbMap, &tiles) ||
+				tiles.nWidth != DELTA_TILE_SIZE || static_cast<DWORD>(tiles.nHeight) != dwMarked * DELTA_TILE_SIZE ||
+				tiles.wBitsPerPixel != header.wBitsPerPixel)
+				return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+			m_aTiles.resize(dwMarked * cbTile);
+
+			hr = m_codec.Decode(pNext + cbMap, dwRemaining - cbMap, &m_aTiles[0], static_cast<int>(cbTileRow));
+
+			if (FAILED(hr))
+				return hr;
+
+			const BYTE* pTile = &m_aTiles[0];
+			for (DWORD dwTile = 0; dwTile < GetTileCount(); dwTile++)
+			{
+				if (!(m_aChangeMap[dwTile >> 3] & (1 << (dwTile & 7))))
+					continue;
+
+				int nLeft, nTileTop, nTileWidth, nTileHeight;
+				GetTileBounds(dwTile, &nLeft, &nTileTop, &nTileWidth, &nTileHeight);
+
+				BYTE* pReference = &m_aReference[0] + nTileTop * cbRow + nLeft * nBytesPerPixel;
+				CopyRows(pTile, cbTileRow, pReference, cbRow, nTileHeight, nTileWidth * nBytesPerPixel);
+				pTile += cbTile;
+			}
+		}
+
+		m_dwChangedTiles = dwMarked;
+	}
+
+	const size_t cbRow = static_cast<size_t>(m_nWidth) * (m_nBitsPerPixel / 8);
+	CopyRows(&m_aReference[0], cbRow, pTop, nStride, m_nHeight, cbRow);
+
+	m_bHasReference = true;
+
+	return S_OK;
+}
+
+#pragma managed(pop)
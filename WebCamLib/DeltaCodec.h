@@ -0,0 +1,125 @@
+//*****************************************************************************************
+//  File:       DeltaCodec.h
+//  Project:    WebcamLib
+//
+//  Declares the inter-frame codec storing only the tiles that changed since the last frame
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#include "LosslessCodec.h"
+
+#pragma managed(push, off)
+
+#define DELTA_MAGIC			0x43534C44	// "DLSC"
+#define DELTA_VERSION		1
+#define DELTA_TILE_SIZE		16
+
+#define DELTA_KEYFRAME		0x0001
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// Start of a delta encoded frame. A keyframe is followed by a whole LosslessCodec frame.
+	/// Any other frame is followed by a bit map of the changed tiles, row by row, then by a
+	/// LosslessCodec frame holding those tiles stacked into a column, DELTA_TILE_SIZE pixels wide.
+	/// </summary>
+	struct DeltaFrameHeader
+	{
+		DWORD dwMagic;
+		WORD wVersion;
+		WORD wFlags;
+		int nWidth;
+		int nHeight;
+		WORD wBitsPerPixel;
+		WORD wTileSize;
+		DWORD dwChangedTiles;
+	};
+
+	/// <summary>
+	/// Codec for recording mostly static scenes. Between keyframes it keeps only the tiles that
+	/// differ from the previous frame by more than a threshold, found by SSE2 block SAD, and stores
+	/// those without loss. The comparison is with the frame as the decoder will have it, so a slow change
+	/// adds up until its tile is sent rather than being lost frame by frame.
+	/// An instance is either an encoder or a decoder, as each keeps the last frame it saw.
+	/// </summary>
+	class DeltaCodec
+	{
+	public:
+		DeltaCodec();
+
+		/// <summary>
+		/// Upper bound of an encoded frame, for sizing the destination
+		/// </summary>
+		static DWORD GetMaxEncodedSize(int nWidth, int nHeight);
+
+		/// <summary>
+		/// Validates and copies out the header of an encoded frame
+		/// </summary>
+		static bool ReadHeader(const BYTE* pSource, DWORD dwLength, DeltaFrameHeader* pHeader);
+
+		/// <summary>
+		/// Encodes an image given by its top row and the signed offset to the row below. A tile counts
+		/// as changed when its mean absolute difference per byte exceeds dwThreshold, or any one byte
+		/// differs by more than bPeakThreshold. The frame becomes a keyframe when asked for, or when
+		/// there is no previous frame of the same size and depth.
+		/// </summary>
+		HRESULT Encode(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, bool bKeyframe,
+			DWORD dwThreshold, BYTE bPeakThreshold, BYTE* pDestination, DWORD dwCapacity, DWORD* pdwSize);
+
+		/// <summary>
+		/// Decodes into an image of the encoded size and depth. A frame other than a keyframe needs the
+		/// frame before it decoded first, and fails with ERROR_INVALID_STATE when it was not.
+		/// </summary>
+		HRESULT Decode(const BYTE* pSource, DWORD dwLength, BYTE* pTop, int nStride);
+
+		/// <summary>
+		/// Forgets the previous frame, so the next one encoded is a keyframe
+		/// </summary>
+		void Reset();
+
+		/// <summary>
+		/// Tiles stored by the last frame encoded or decoded
+		/// </summary>
+		DWORD GetChangedTiles() const
+		{
+			return m_dwChangedTiles;
+		}
+
+		DWORD GetTileCount() const
+		{
+			return static_cast<DWORD>(m_nTilesAcross) * m_nTilesDown;
+		}
+
+	private:
+		DeltaCodec(const DeltaCodec&);
+		DeltaCodec& operator=(const DeltaCodec&);
+
+		void SetFormat(int nWidth, int nHeight, int nBitsPerPixel);
+		DWORD FindChangedTiles(const BYTE* pTop, int nStride, DWORD dwThreshold, BYTE bPeakThreshold);
+		void GetTileBounds(DWORD dwTile, int* pnLeft, int* pnTop, int* pnWidth, int* pnHeight) const;
+
+		LosslessCodec m_codec;
+
+		int m_nWidth;
+		int m_nHeight;
+		int m_nBitsPerPixel;
+		int m_nTilesAcross;
+		int m_nTilesDown;
+		DWORD m_dwChangedTiles;
+		bool m_bHasReference;
+
+		// The previous frame as the decoder has it, rows packed and top down
+		std::vector<BYTE> m_aReference;
+
+		// One bit per tile, then the changed tiles stacked into a column
+		std::vector<BYTE> m_aChangeMap;
+		std::vector<BYTE> m_aTiles;
+		std::vector<DWORD> m_aTileSums;
+		std::vector<BYTE> m_aTilePeaks;
+	};
+}
+
+#pragma managed(pop)
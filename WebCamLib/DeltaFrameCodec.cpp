@@ -0,0 +1,202 @@
+//*****************************************************************************************
+//  File:       DeltaFrameCodec.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed inter-frame codec for recording static scenes
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "DeltaCodec.h"
+#include "DeltaFrameCodec.h"
+#include "PooledFrame.h"
+
+using namespace System::Runtime::InteropServices;
+using namespace WebCamLib;
+
+DeltaFrameCodec::DeltaFrameCodec()
+{
+	pCodec = new DeltaCodec();
+	changeThreshold = 2;
+	peakThreshold = 24;
+}
+
+DeltaFrameCodec::~DeltaFrameCodec()
+{
+	this->!DeltaFrameCodec();
+}
+
+DeltaFrameCodec::!DeltaFrameCodec()
+{
+	if( pCodec != NULL )
+	{
+		delete pCodec;
+		pCodec = NULL;
+	}
+}
+
+DeltaCodec* DeltaFrameCodec::GetCodec()
+{
+	if( pCodec == NULL )
+		throw gcnew ObjectDisposedException( "DeltaFrameCodec" );
+
+	return pCodec;
+}
+
+int DeltaFrameCodec::GetMaximumEncodedSize( int width, int height )
+{
+	if( width <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "width" );
+
+	if( height <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "height" );
+
+	DWORD dwSize = DeltaCodec::GetMaxEncodedSize( width, height );
+
+	if( dwSize > static_cast<DWORD>( Int32::MaxValue ) )
+		throw gcnew ArgumentException( "The frame is too large to encode into an array." );
+
+	return static_cast<int>( dwSize );
+}
+
+Tuple<int, int, int>^ DeltaFrameCodec::GetFrameSize( array<Byte>^ source, int offset, int length )
+{
+	if( source == nullptr )
+		throw gcnew ArgumentNullException( "source" );
+
+	if( offset < 0 || length <= 0 || offset > source->Length - length )
+		throw gcnew ArgumentOutOfRangeException( "length" );
+
+	DeltaFrameHeader header;
+	pin_ptr<Byte> pSource = &source[offset];
+
+	if( !DeltaCodec::ReadHeader( pSource, length, &header ) )
+		throw gcnew ArgumentException( "The data is not an encoded frame.", "source" );
+
+	return gcnew Tuple<int, int, int>( header.nWidth, header.nHeight, header.wBitsPerPixel );
+}
+
+bool DeltaFrameCodec::IsKeyframe( array<Byte>^ source, int offset, int length )
+{
+	if( source == nullptr )
+		throw gcnew ArgumentNullException( "source" );
+
+	if( offset < 0 || length <= 0 || offset > source->Length - length )
+		throw gcnew ArgumentOutOfRangeException( "length" );
+
+	DeltaFrameHeader header;
+	pin_ptr<Byte> pSource = &source[offset];
+
+	if( !DeltaCodec::ReadHeader( pSource, length, &header ) )
+		throw gcnew ArgumentException( "The data is not an encoded frame.", "source" );
+
+	return ( header.wFlags & DELTA_KEYFRAME ) != 0;
+}
+
+int DeltaFrameCodec::Encode( PooledFrame^ frame, bool keyframe, array<Byte>^ destination, int offset )
+{
+	if( frame == nullptr )
+		throw gcnew ArgumentNullException( "frame" );
+
+	return Encode( frame->Scan0, frame->Width, frame->Height, frame->Stride, frame->BitsPerPixel, keyframe, destination, offset );
+}
+
+int DeltaFrameCodec::Encode( IntPtr scan0, int width, int height, int stride, int bitsPerPixel, bool keyframe, array<Byte>^ destination, int offset )
+{
+	if( scan0 == IntPtr::Zero )
+		throw gcnew ArgumentNullException( "scan0" );
+
+	if( destination == nullptr )
+		throw gcnew ArgumentNullException( "destination" );
+
+	if( offset < 0 || offset >= destination->Length )
+		throw gcnew ArgumentOutOfRangeException( "offset" );
+
+	if( width <= 0 || height <= 0 )
+		throw gcnew ArgumentException( "The image has no pixels." );
+
+	if( bitsPerPixel != 24 && bitsPerPixel != 32 )
+		throw gcnew ArgumentException( "Only 24 and 32 bit images can be encoded.", "bitsPerPixel" );
+
+	DeltaCodec* pEncoder = GetCodec();
+	pin_ptr<Byte> pDestination = &destination[offset];
+	DWORD dwSize = 0;
+
+	HRESULT hr = pEncoder->Encode( static_cast<const BYTE*>( scan0.ToPointer() ), width, height, stride, bitsPerPixel, keyframe,
+		changeThreshold, static_cast<BYTE>( peakThreshold ), pDestination, destination->Length - offset, &dwSize );
+
+	if( hr == HRESULT_FROM_WIN32( ERROR_INSUFFICIENT_BUFFER ) )
+		throw gcnew ArgumentException( "Destination is smaller than GetMaximumEncodedSize.", "destination" );
+
+	if( FAILED( hr ) )
+		throw gcnew COMException( "Unable to encode frame", hr );
+
+	return static_cast<int>( dwSize );
+}
+
+void DeltaFrameCodec::Decode( array<Byte>^ source, int offset, int length, IntPtr scan0, int stride )
+{
+	if( source == nullptr )
+		throw gcnew ArgumentNullException( "source" );
+
+	if( offset < 0 || length <= 0 || offset > source->Length - length )
+		throw gcnew ArgumentOutOfRangeException( "length" );
+
+	if( scan0 == IntPtr::Zero )
+		throw gcnew ArgumentNullException( "scan0" );
+
+	DeltaCodec* pDecoder = GetCodec();
+	pin_ptr<Byte> pSource = &source[offset];
+
+	HRESULT hr = pDecoder->Decode( pSource, length, static_cast<BYTE*>( scan0.ToPointer() ), stride );
+
+	if( hr == HRESULT_FROM_WIN32( ERROR_INVALID_DATA ) )
+		throw gcnew ArgumentException( "The data is not an encoded frame.", "source" );
+
+	if( hr == HRESULT_FROM_WIN32( ERROR_INVALID_STATE ) )
+		throw gcnew InvalidOperationException( "The frame before this one has not been decoded; start from a keyframe." );
+
+	if( FAILED( hr ) )
+		throw gcnew COMException( "Unable to decode frame", hr );
+}
+
+void DeltaFrameCodec::Reset()
+{
+	GetCodec()->Reset();
+}
+
+int DeltaFrameCodec::ChangeThreshold::get()
+{
+	return changeThreshold;
+}
+
+void DeltaFrameCodec::ChangeThreshold::set( int value )
+{
+	if( value < 0 || value > 255 )
+		throw gcnew ArgumentOutOfRangeException( "value" );
+
+	changeThreshold = value;
+}
+
+int DeltaFrameCodec::PeakThreshold::get()
+{
+	return peakThreshold;
+}
+
+void DeltaFrameCodec::PeakThreshold::set( int value )
+{
+	if( value < 0 || value > 255 )
+		throw gcnew ArgumentOutOfRangeException( "value" );
+
+	peakThreshold = value;
+}
+
+int DeltaFrameCodec::ChangedTiles::get()
+{
+	return static_cast<int>( GetCodec()->GetChangedTiles() );
+}
+
+int DeltaFrameCodec::TileCount::get()
+{
+	return static_cast<int>( GetCodec()->GetTileCount() );
+}
@@ -0,0 +1,111 @@
+//*****************************************************************************************
+//  File:       DeltaFrameCodec.h
+//  Project:    WebcamLib
+//
+//  Declares the managed inter-frame codec for recording static scenes
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+
+namespace WebCamLib
+{
+	class DeltaCodec;
+	ref class PooledFrame;
+
+	/// <summary>
+	/// Records mostly static scenes by storing keyframes and, in between, only the 16 by 16 tiles
+	/// that changed since the previous frame; changed tiles are kept without loss. Frames must be
+	/// decoded in the order they were encoded, starting from a keyframe. Use one instance to encode
+	/// and another to decode, as each remembers the last frame it saw.
+	/// </summary>
+	public ref class DeltaFrameCodec
+	{
+	public:
+		DeltaFrameCodec();
+
+		/// <summary>
+		/// Destination size that any frame of these dimensions is guaranteed to fit in
+		/// </summary>
+		static int GetMaximumEncodedSize( int width, int height );
+
+		/// <summary>
+		/// Width, height and bits per pixel of an encoded frame; throws when it is not one
+		/// </summary>
+		static Tuple<int, int, int>^ GetFrameSize( array<Byte>^ source, int offset, int length );
+
+		/// <summary>
+		/// True when the encoded frame decodes on its own
+		/// </summary>
+		static bool IsKeyframe( array<Byte>^ source, int offset, int length );
+
+		/// <summary>
+		/// Encodes a captured frame at offset into the destination; returns the bytes written.
+		/// The frame is a keyframe when asked for, or when the size or depth changed.
+		/// </summary>
+		int Encode( PooledFrame^ frame, bool keyframe, array<Byte>^ destination, int offset );
+
+		/// <summary>
+		/// Encodes an image given by its top row and the signed offset to the row below, as in BitmapData
+		/// </summary>
+		int Encode( IntPtr scan0, int width, int height, int stride, int bitsPerPixel, bool keyframe, array<Byte>^ destination, int offset );
+
+		/// <summary>
+		/// Decodes the next frame into an image of its size and depth, given as in BitmapData
+		/// </summary>
+		void Decode( array<Byte>^ source, int offset, int length, IntPtr scan0, int stride );
+
+		/// <summary>
+		/// Forgets the previous frame, so the next one encoded is a keyframe
+		/// </summary>
+		void Reset();
+
+		/// <summary>
+		/// Mean absolute difference per byte above which a tile is stored; 2 by default, which is
+		/// above the sensor noise of most cameras in daylight
+		/// </summary>
+		property int ChangeThreshold
+		{
+			int get();
+			void set( int value );
+		}
+
+		/// <summary>
+		/// Difference of a single byte above which its tile is stored whatever the mean; 24 by default
+		/// </summary>
+		property int PeakThreshold
+		{
+			int get();
+			void set( int value );
+		}
+
+		/// <summary>
+		/// Tiles stored by the last frame encoded or decoded
+		/// </summary>
+		property int ChangedTiles
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Tiles in a frame of the current size
+		/// </summary>
+		property int TileCount
+		{
+			int get();
+		}
+
+		~DeltaFrameCodec();
+
+	protected:
+		!DeltaFrameCodec();
+
+	private:
+		DeltaCodec* GetCodec();
+
+		DeltaCodec* pCodec;
+		int changeThreshold;
+		int peakThreshold;
+	};
+}
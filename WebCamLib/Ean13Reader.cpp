@@ -0,0 +1,233 @@
+//*****************************************************************************************
+//  File:       Ean13Reader.cpp
+//  Project:    WebcamLib
+//
+//  Defines the reading of EAN-13 and UPC-A barcodes along rows of a binarised frame
+//*****************************************************************************************
+
+#include <windows.h>
+#include <math.h>
+
+#include "Ean13Reader.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Guard, 6 digits of 4 runs, middle guard, 6 digits, guard
+#define EAN13_RUNS					59
+
+// Acceptable mismatch of a digit's runs, as a fraction of its width overall and per run
+#define EAN13_MAXIMUM_VARIANCE		0.48f
+#define EAN13_MAXIMUM_RUN_VARIANCE	0.7f
+
+// Light needed either side of the guards, in modules
+#define EAN13_QUIET_MODULES			3
+
+namespace
+{
+	// Module widths of the L patterns, light first; G patterns are them reversed, and R patterns
+	// the same widths dark first
+	const BYTE s_aabDigits[10][4] =
+	{
+		{ 3, 2, 1, 1 }, { 2, 2, 2, 1 }, { 2, 1, 2, 2 }, { 1, 4, 1, 1 }, { 1, 1, 3, 2 },
+		{ 1, 2, 3, 1 }, { 1, 1, 1, 4 }, { 1, 3, 1, 2 }, { 1, 2, 1, 3 }, { 3, 1, 1, 2 },
+	};
+
+	// Which of the left half's digits use G patterns, first digit last, for each leading digit
+	const BYTE s_abParities[10] = { 0x00, 0x0B, 0x0D, 0x0E, 0x13, 0x19, 0x1C, 0x15, 0x16, 0x1A };
+
+	// Mismatch of runs against module widths relative to their total, or more than 1 for none
+	float GetVariance(const int* pnRuns, int nStep, const BYTE* pbWidths, int nWidths, bool bReversed)
+	{
+		int nTotal = 0;
+		int nModules = 0;
+
+		for (int n = 0; n < nWidths; n++)
+		{
+			nTotal += pnRuns[n * nStep];
+			nModules += pbWidths[n];
+		}
+
+		if (nTotal < nModules)
+			return 2.0f;
+
+		float fModule = static_cast<float>(nTotal) / nModules;
+		float fMaximum = EAN13_MAXIMUM_RUN_VARIANCE * fModule;
+		float fVariance = 0.0f;
+
+		for (int n = 0; n < nWidths; n++)
+		{
+			float fDelta = fabs(pnRuns[n * nStep] - pbWidths[bReversed ? nWidths - 1 - n : n] * fModule);
+			if (fDelta > fMaximum)
+				return 2.0f;
+
+			fVariance += fDelta;
+		}
+
+		return fVariance / nTotal;
+	}
+}
+
+Ean13Reader::Ean13Reader()
+{
+}
+
+int Ean13Reader::MatchDigit(const int* pnRuns, int nStep, bool bEven)
+{
+	float fBest = EAN13_MAXIMUM_VARIANCE;
+	int nBest = -1;
+
+	for (int nDigit = 0; nDigit < 10; nDigit++)
+	{
+		float fVariance = GetVariance(pnRuns, nStep, s_aabDigits[nDigit], 4, false);
+		if (fVariance < fBest)
+		{
+			fBest = fVariance;
+			nBest = nDigit;
+		}
+
+		if (bEven)
+		{
+			fVariance = GetVariance(pnRuns, nStep, s_aabDigits[nDigit], 4, true);
+			if (fVariance < fBest)
+			{
+				fBest = fVariance;
+				nBest = nDigit + 10;
+			}
+		}
+	}
+
+	return nBest;
+}
+
+bool Ean13Reader::Decode(const int* pnRuns, int nStep, char* pcDigits)
+{
+	static const BYTE s_abGuard[3] = { 1, 1, 1 };
+	static const BYTE s_abMiddle[5] = { 1, 1, 1, 1, 1 };
+
+	if (GetVariance(pnRuns, nStep, s_abGuard, 3, false) > EAN13_MAXIMUM_VARIANCE)
+		return false;
+
+	const int* pnRun = pnRuns + 3 * nStep;
+	int nParity = 0;
+
+	for (int n = 0; n < 6; n++, pnRun += 4 * nStep)
+	{
+		int nDigit = MatchDigit(pnRun, nStep, true);
+		if (nDigit < 0)
+			return false;
+
+		if (nDigit >= 10)
+		{
+			nParity |= 1 << (5 - n);
+			nDigit -= 10;
+		}
+
+		pcDigits[n + 1] = static_cast<char>('0' + nDigit);
+	}
+
+	if (GetVariance(pnRun, nStep, s_abMiddle, 5, false) > EAN13_MAXIMUM_VARIANCE)
+		return false;
+
+	pnRun += 5 * nStep;
+
+	for (int n = 6; n < 12; n++, pnRun += 4 * nStep)
+	{
+		int nDigit = MatchDigit(pnRun, nStep, false);
+		if (nDigit < 0)
+			return false;
+
+		pcDigits[n + 1] = static_cast<char>('0' + nDigit);
+	}
+
+	if (GetVariance(pnRun, nStep, s_abGuard, 3, false) > EAN13_MAXIMUM_VARIANCE)
+		return false;
+
+	// The leading digit is only encoded in the left half's mix of L and G patterns
+	int nFirst = 0;
+	while (nFirst < 10 && s_abParities[nFirst] != nParity)
+	{
+		nFirst++;
+	}
+
+	if (nFirst == 10)
+		return false;
+
+	pcDigits[0] = static_cast<char>('0' + nFirst);
+
+	// Digits alternate weights of 1 and 3 from the left, check digit included
+	int nSum = 0;
+	for (int n = 0; n < 13; n++)
+	{
+		nSum += (pcDigits[n] - '0') * ((n & 1) != 0 ? 3 : 1);
+	}
+
+	return nSum % 10 == 0;
+}
+
+void Ean13Reader::ReadRow(const BYTE* pRow, int nWidth, int nRow)
+{
+	// Runs of alternating colour, the first light; a row starting dark gets an empty light run
+	m_anRuns.clear();
+	m_anStarts.clear();
+
+	bool bDark = false;
+	int nStart = 0;
+
+	for (int x = 0; x <= nWidth; x++)
+	{
+		if (x == nWidth || (pRow[x] != 0) != bDark)
+		{
+			m_anRuns.push_back(x - nStart);
+			m_anStarts.push_back(nStart);
+			nStart = x;
+			bDark = !bDark;
+		}
+	}
+
+	int nRuns = static_cast<int>(m_anRuns.size());
+
+	// Dark runs have odd indices; each is tried as the first guard bar reading right, and as the
+	// first guard bar of an upside down code reading left
+	for (int n = 1; n < nRuns; n += 2)
+	{
+		for (int nStep = 1; nStep >= -1; nStep -= 2)
+		{
+			int nLast = n + (EAN13_RUNS - 1) * nStep;
+			int nBefore = n - nStep;
+			int nAfter = nLast + nStep;
+
+			if (nAfter < 0 || nAfter >= nRuns)
+				continue;
+
+			// Quiet zones of a few modules, judged by the guard
+			int nGuard = m_anRuns[n] + m_anRuns[n + nStep] + m_anRuns[n + 2 * nStep];
+			if (m_anRuns[nBefore] * 3 < nGuard * EAN13_QUIET_MODULES || m_anRuns[nAfter] * 3 < nGuard * EAN13_QUIET_MODULES)
+				continue;
+
+			Ean13Read read;
+			if (!Decode(&m_anRuns[n], nStep, read.acDigits))
+				continue;
+
+			int nFirst = min(n, nLast);
+			int nEnd = max(n, nLast);
+
+			read.nRow = nRow;
+			read.nLeft = m_anStarts[nFirst];
+			read.nRight = m_anStarts[nEnd] + m_anRuns[nEnd];
+
+			m_aReads.push_back(read);
+
+			// Nothing else fits inside this code
+			if (nStep > 0)
+			{
+				n = nLast;
+			}
+
+			break;
+		}
+	}
+}
+
+#pragma managed(pop)
@@ -0,0 +1,74 @@
+//*****************************************************************************************
+//  File:       Ean13Reader.h
+//  Project:    WebcamLib
+//
+//  Declares the reading of EAN-13 and UPC-A barcodes along rows of a binarised frame
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// One barcode read along one row: the pixel columns of its guard bars and its 13 digits
+	/// as characters, UPC-A codes having a leading zero
+	/// </summary>
+	struct Ean13Read
+	{
+		int nRow;
+		int nLeft;
+		int nRight;
+		char acDigits[13];
+	};
+
+	/// <summary>
+	/// Splits a row of a binary image into runs and looks for the 59 runs of an EAN-13 barcode
+	/// between quiet zones, in either direction so upside down codes read too. Digits are the
+	/// closest of the L, G and R patterns; a read only counts when its check digit agrees.
+	/// </summary>
+	class Ean13Reader
+	{
+	public:
+		Ean13Reader();
+
+		/// <summary>
+		/// Forgets the reads of the last frame
+		/// </summary>
+		void Clear()
+		{
+			m_aReads.clear();
+		}
+
+		/// <summary>
+		/// Reads one tightly packed binary row, non-zero for dark, adding what it finds
+		/// </summary>
+		void ReadRow(const BYTE* pRow, int nWidth, int nRow);
+
+		int GetReadCount() const
+		{
+			return static_cast<int>(m_aReads.size());
+		}
+
+		const Ean13Read& GetRead(int nIndex) const
+		{
+			return m_aReads[nIndex];
+		}
+
+	private:
+		// Closest digit to 4 runs, with 10 added for the G patterns when bEven is set, or -1
+		static int MatchDigit(const int* pnRuns, int nStep, bool bEven);
+
+		// Decodes the 59 runs from the first guard bar at pnRuns, walking nStep runs at a time
+		static bool Decode(const int* pnRuns, int nStep, char* pcDigits);
+
+		std::vector<int> m_anRuns;
+		std::vector<int> m_anStarts;
+		std::vector<Ean13Read> m_aReads;
+	};
+}
+
+#pragma managed(pop)
@@ -0,0 +1,461 @@
+//*****************************************************************************************
+//  File:       ExposureController.cpp
+//  Project:    WebcamLib
+//
+//  Defines the software auto-exposure and white balance control loop
+//*****************************************************************************************
+
+#include <dshow.h>
+#include <math.h>
+
+#include "ExposureController.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Luma is gamma encoded, so one stop of light moves it by much less than a factor of two
+#define LUMA_GAMMA 2.2
+
+// Gain ranges are device specific; assume the full range spans this many stops
+#define GAIN_RANGE_STOPS 4.0
+
+// However fine the steps of a property, it may move this many stops per update
+#define MINIMUM_STOPS_PER_UPDATE 0.5
+
+// Share of the white balance range one stop of blue/red imbalance is corrected with
+#define WHITE_BALANCE_RANGE_STOPS 2.0
+
+// Blue/red imbalance, in stops, which is left alone
+#define WHITE_BALANCE_TOLERANCE 0.03
+
+// Frames this dark or bright carry too little colour to judge white balance from
+#define WHITE_BALANCE_MIN_LUMA 32.0
+#define WHITE_BALANCE_MAX_LUMA 224.0
+
+#pragma region DirectShowExposureDevice
+static bool GetCameraControlProperty(ExposureChannel eChannel, long* plProperty)
+{
+	bool result = eChannel == ExposureChannel_Exposure;
+
+	if (result)
+		*plProperty = CameraControl_Exposure;
+
+	return result;
+}
+
+static long GetVideoProcAmpProperty(ExposureChannel eChannel)
+{
+	return eChannel == ExposureChannel_Gain ? VideoProcAmp_Gain : VideoProcAmp_WhiteBalance;
+}
+
+DirectShowExposureDevice::DirectShowExposureDevice(IBaseFilter* pFilter)
+{
+	m_pCameraControl = NULL;
+	m_pProcAmp = NULL;
+
+	if (pFilter != NULL)
+	{
+		if (FAILED(pFilter->QueryInterface(IID_IAMCameraControl, (void**)&m_pCameraControl)))
+			m_pCameraControl = NULL;
+
+		if (FAILED(pFilter->QueryInterface(IID_IAMVideoProcAmp, (void**)&m_pProcAmp)))
+			m_pProcAmp = NULL;
+	}
+}
+
+DirectShowExposureDevice::~DirectShowExposureDevice()
+{
+	if (m_pCameraControl != NULL)
+	{
+		m_pCameraControl->Release();
+		m_pCameraControl = NULL;
+	}
+
+	if (m_pProcAmp != NULL)
+	{
+		m_pProcAmp->Release();
+		m_pProcAmp = NULL;
+	}
+}
+
+bool DirectShowExposureDevice::GetRange(ExposureChannel eChannel, PropertyRange* pRange)
+{
+	HRESULT hr = E_NOINTERFACE;
+	long lProperty, lFlags;
+
+	if (GetCameraControlProperty(eChannel, &lProperty))
+	{
+		if (m_pCameraControl != NULL)
+			hr = m_pCameraControl->GetRange(lProperty, &pRange->lMinimum, &pRange->lMaximum, &pRange->lStep, &pRange->lDefault, &lFlags);
+	}
+	else if (m_pProcAmp != NULL)
+	{
+		hr = m_pProcAmp->GetRange(GetVideoProcAmpProperty(eChannel), &pRange->lMinimum, &pRange->lMaximum, &pRange->lStep, &pRange->lDefault, &lFlags);
+	}
+
+	return SUCCEEDED(hr) && pRange->lMaximum > pRange->lMinimum;
+}
+
+bool DirectShowExposureDevice::GetValue(ExposureChannel eChannel, long* plValue, bool* pbAutomatic)
+{
+	HRESULT hr = E_NOINTERFACE;
+	long lProperty, lFlags = 0;
+
+	if (GetCameraControlProperty(eChannel, &lProperty))
+	{
+		if (m_pCameraControl != NULL)
+			hr = m_pCameraControl->Get(lProperty, plValue, &lFlags);
+
+		*pbAutomatic = (lFlags & CameraControl_Flags_Auto) != 0;
+	}
+	else
+	{
+		if (m_pProcAmp != NULL)
+			hr = m_pProcAmp->Get(GetVideoProcAmpProperty(eChannel), plValue, &lFlags);
+
+		*pbAutomatic = (lFlags & VideoProcAmp_Flags_Auto) != 0;
+	}
+
+	return SUCCEEDED(hr);
+}
+
+bool DirectShowExposureDevice::SetValue(ExposureChannel eChannel, long lValue)
+{
+	HRESULT hr = E_NOINTERFACE;
+	long lProperty;
+
+	if (GetCameraControlProperty(eChannel, &lProperty))
+	{
+		if (m_pCameraControl != NULL)
+			hr = m_pCameraControl->Set(lProperty, lValue, CameraControl_Flags_Manual);
+	}
+	else if (m_pProcAmp != NULL)
+	{
+		hr = m_pProcAmp->Set(GetVideoProcAmpProperty(eChannel), lValue, VideoProcAmp_Flags_Manual);
+	}
+
+	return SUCCEEDED(hr);
+}
+
+bool DirectShowExposureDevice::SetAutomatic(ExposureChannel eChannel)
+{
+	HRESULT hr = E_NOINTERFACE;
+	long lProperty, lValue, lFlags;
+
+	if (GetCameraControlProperty(eChannel, &lProperty))
+	{
+		if (m_pCameraControl != NULL)
+			hr = m_pCameraControl->Get(lProperty, &lValue, &lFlags);
+
+		if (SUCCEEDED(hr))
+			hr = m_pCameraControl->Set(lProperty, lValue, CameraControl_Flags_Auto);
+	}
+	else
+	{
+		if (m_pProcAmp != NULL)
+			hr = m_pProcAmp->Get(GetVideoProcAmpProperty(eChannel), &lValue, &lFlags);
+
+		if (SUCCEEDED(hr))
+			hr = m_pProcAmp->Set(GetVideoProcAmpProperty(eChannel), lValue, VideoProcAmp_Flags_Auto);
+	}
+
+	return SUCCEEDED(hr);
+}
+#pragma endregion
+
+#pragma region ExposureController
+ExposureController::ExposureController()
+{
+	InitializeCriticalSection(&m_cs);
+
+	m_pDevice = NULL;
+	ZeroMemory(m_aChannels, sizeof(m_aChannels));
+
+	m_dTargetLuma = 118.0;
+	m_dTolerance = 6.0;
+	m_dLoopGain = 0.5;
+	m_nMaximumSteps = 2;
+	m_dwMinimumInterval = 100;
+	m_lExposureLimit = 0;
+	m_bExposureLimitSet = false;
+	m_bExposureEnabled = true;
+	m_bWhiteBalanceEnabled = false;
+
+	m_bUpdated = false;
+	m_dwLastUpdate = 0;
+	m_dwWriteCount = 0;
+}
+
+ExposureController::~ExposureController()
+{
+	Detach();
+	DeleteCriticalSection(&m_cs);
+}
+
+bool ExposureController::Attach(IExposureDevice* pDevice)
+{
+	Detach();
+
+	bool result = false;
+
+	EnterCriticalSection(&m_cs);
+
+	m_pDevice = pDevice;
+	m_bUpdated = false;
+	m_dwWriteCount = 0;
+
+	// Ranges are read once here; the control loop never queries the device again
+	for (int n = 0; n < ExposureChannel_Count; n++)
+	{
+		ExposureChannel eChannel = static_cast<ExposureChannel>(n);
+		ChannelState& channel = m_aChannels[n];
+		ZeroMemory(&channel, sizeof(ChannelState));
+
+		if (pDevice != NULL && pDevice->GetRange(eChannel, &channel.range))
+		{
+			if (channel.range.lStep <= 0)
+				channel.range.lStep = 1;
+
+			if (!pDevice->GetValue(eChannel, &channel.lInitialValue, &channel.bInitiallyAutomatic))
+			{
+				channel.lInitialValue = channel.range.lDefault;
+				channel.bInitiallyAutomatic = true;
+			}
+
+			channel.lApplied = channel.lInitialValue;
+			channel.dSetPoint = channel.lInitialValue;
+			channel.bAvailable = true;
+
+			result = true;
+		}
+	}
+
+	// Nothing to drive; do not keep the device around as if it were attached
+	if (!result)
+	{
+		delete m_pDevice;
+		m_pDevice = NULL;
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return result;
+}
+
+void ExposureController::Detach()
+{
+	EnterCriticalSection(&m_cs);
+
+	if (m_pDevice != NULL)
+	{
+		for (int n = 0; n < ExposureChannel_Count; n++)
+		{
+			ExposureChannel eChannel = static_cast<ExposureChannel>(n);
+			ChannelState& channel = m_aChannels[n];
+
+			if (channel.bWritten)
+			{
+				if (channel.bInitiallyAutomatic)
+					m_pDevice->SetAutomatic(eChannel);
+				else
+					m_pDevice->SetValue(eChannel, channel.lInitialValue);
+			}
+		}
+
+		delete m_pDevice;
+		m_pDevice = NULL;
+	}
+
+	ZeroMemory(m_aChannels, sizeof(m_aChannels));
+
+	LeaveCriticalSection(&m_cs);
+}
+
+bool ExposureController::Update(const ImageStatistics& statistics, DWORD dwTimeMs)
+{
+	// Runs on the capture thread; rather drop a frame than wait for Attach or Detach
+	if (!TryEnterCriticalSection(&m_cs))
+		return false;
+
+	bool result = false;
+
+	if (m_pDevice != NULL && statistics.dwSamples > 0 && (!m_bUpdated || dwTimeMs - m_dwLastUpdate >= m_dwMinimumInterval))
+	{
+		if (m_bExposureEnabled)
+			result |= UpdateExposure(statistics);
+
+		if (m_bWhiteBalanceEnabled)
+			result |= UpdateWhiteBalance(statistics);
+
+		// The interval runs from the last write, so the camera has time to apply it before the next look
+		if (result)
+		{
+			m_bUpdated = true;
+			m_dwLastUpdate = dwTimeMs;
+		}
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return result;
+}
+
+bool ExposureController::UpdateExposure(const ImageStatistics& statistics)
+{
+	double dMeasured = statistics.dMeanLuma < 1.0 ? 1.0 : statistics.dMeanLuma;
+
+	if (fabs(m_dTargetLuma - dMeasured) <= m_dTolerance)
+		return false;
+
+	double dStops = log(m_dTargetLuma / dMeasured) / log(2.0) * LUMA_GAMMA * m_dLoopGain;
+
+	// Brighten with exposure time before gain to keep noise down; darken by shedding gain first
+	ExposureChannel aeOrder[2];
+	aeOrder[0] = dStops > 0.0 ? ExposureChannel_Exposure : ExposureChannel_Gain;
+	aeOrder[1] = dStops > 0.0 ? ExposureChannel_Gain : ExposureChannel_Exposure;
+
+	bool result = false;
+
+	for (int n = 0; n < 2 && dStops != 0.0; n++)
+	{
+		ExposureChannel eChannel = aeOrder[n];
+		ChannelState& channel = m_aChannels[eChannel];
+
+		if (!channel.bAvailable)
+			continue;
+
+		double dUnitsPerStop = GetUnitsPerStop(eChannel);
+
+		// A property moving by less than a whole step would overshoot and hunt between two steps
+		// whenever the other one could have taken the error instead. Without the other property it
+		// moves once the error is half a step, and when the other one is stuck at the end of its
+		// range, e.g. darkening with no gain left to shed, any error moves it.
+		ExposureChannel eOther = aeOrder[1 - n];
+		const ChannelState& other = m_aChannels[eOther];
+
+		double dThreshold = 0.5;
+		if (other.bAvailable)
+		{
+			bool bOtherHasRoom = dStops > 0.0 ? other.dSetPoint < GetUpperLimit(eOther) : other.dSetPoint > other.range.lMinimum;
+			dThreshold = bOtherHasRoom ? 1.0 : 0.0;
+		}
+
+		if (m_dLoopGain > 0.0 && fabs(dStops / m_dLoopGain * dUnitsPerStop) < dThreshold * channel.range.lStep)
+		{
+			channel.dSetPoint = channel.lApplied;
+			continue;
+		}
+
+		double dBlocked;
+		result |= MoveSetPoint(eChannel, dStops * dUnitsPerStop, dUnitsPerStop, GetUpperLimit(eChannel), &dBlocked);
+
+		// Only what the range refused spills over to the other channel, not what the step limit held back
+		dStops = dBlocked / dUnitsPerStop;
+	}
+
+	return result;
+}
+
+bool ExposureController::UpdateWhiteBalance(const ImageStatistics& statistics)
+{
+	const ChannelState& channel = m_aChannels[ExposureChannel_WhiteBalance];
+
+	if (!channel.bAvailable || statistics.dMeanLuma < WHITE_BALANCE_MIN_LUMA || statistics.dMeanLuma > WHITE_BALANCE_MAX_LUMA)
+		return false;
+
+	double dRed = statistics.dMeanRed < 1.0 ? 1.0 : statistics.dMeanRed;
+	double dBlue = statistics.dMeanBlue < 1.0 ? 1.0 : statistics.dMeanBlue;
+
+	// Grey world: a red cast means the light is warmer than the white balance assumes, so lower it
+	double dCast = log(dBlue / dRed) / log(2.0);
+
+	if (fabs(dCast) <= WHITE_BALANCE_TOLERANCE)
+		return false;
+
+	double dUnitsPerStop = GetUnitsPerStop(ExposureChannel_WhiteBalance);
+
+	double dBlocked;
+	return MoveSetPoint(ExposureChannel_WhiteBalance, dCast * dUnitsPerStop * m_dLoopGain, dUnitsPerStop, channel.range.lMaximum, &dBlocked);
+}
+
+bool ExposureController::MoveSetPoint(ExposureChannel eChannel, double dDelta, double dUnitsPerStop, double dUpperLimit, double* pdBlocked)
+{
+	ChannelState& channel = m_aChannels[eChannel];
+	const PropertyRange& range = channel.range;
+
+	// Never pull a set point the camera chose itself down to the limit just because it lies above it
+	double dUpper = channel.dSetPoint > dUpperLimit ? channel.dSetPoint : dUpperLimit;
+	double dSetPoint = channel.dSetPoint + dDelta;
+
+	if (dSetPoint > dUpper)
+		dSetPoint = dUpper;
+	if (dSetPoint < range.lMinimum)
+		dSetPoint = range.lMinimum;
+
+	*pdBlocked = dDelta - (dSetPoint - channel.dSetPoint);
+
+	// The step limit only slows the move down; what it holds back is measured again next time.
+	// Fine grained gain and white balance ranges would take hundreds of updates without a floor.
+	double dMaximumDelta = max(static_cast<double>(m_nMaximumSteps) * range.lStep, MINIMUM_STOPS_PER_UPDATE * dUnitsPerStop);
+
+	if (dSetPoint > channel.dSetPoint + dMaximumDelta)
+		dSetPoint = channel.dSetPoint + dMaximumDelta;
+	if (dSetPoint < channel.dSetPoint - dMaximumDelta)
+		dSetPoint = channel.dSetPoint - dMaximumDelta;
+
+	channel.dSetPoint = dSetPoint;
+
+	long lSteps = static_cast<long>(floor((dSetPoint - range.lMinimum) / range.lStep + 0.5));
+	long lValue = range.lMinimum + lSteps * range.lStep;
+
+	if (lValue > range.lMaximum)
+		lValue = range.lMaximum;
+
+	bool result = false;
+
+	if (lValue != channel.lApplied)
+	{
+		if (m_pDevice->SetValue(eChannel, lValue))
+		{
+			channel.lApplied = lValue;
+			channel.bWritten = true;
+			m_dwWriteCount++;
+
+			result = true;
+		}
+		else
+		{
+			// A property which refuses writes would otherwise be retried on every frame
+			channel.bAvailable = false;
+		}
+	}
+
+	return result;
+}
+
+double ExposureController::GetUnitsPerStop(ExposureChannel eChannel) const
+{
+	const PropertyRange& range = m_aChannels[eChannel].range;
+
+	// Exposure_lgSec is log2 seconds, so one unit is one stop
+	if (eChannel == ExposureChannel_Exposure)
+		return 1.0;
+
+	return (range.lMaximum - range.lMinimum) / (eChannel == ExposureChannel_Gain ? GAIN_RANGE_STOPS : WHITE_BALANCE_RANGE_STOPS);
+}
+
+double ExposureController::GetUpperLimit(ExposureChannel eChannel) const
+{
+	const PropertyRange& range = m_aChannels[eChannel].range;
+
+	double result = range.lMaximum;
+
+	if (eChannel == ExposureChannel_Exposure && m_bExposureLimitSet && m_lExposureLimit < range.lMaximum)
+		result = m_lExposureLimit;
+
+	return result;
+}
+#pragma endregion
+
+#pragma managed(pop)
@@ -0,0 +1,233 @@
+//*****************************************************************************************
+//  File:       ExposureController.h
+//  Project:    WebcamLib
+//
+//  Declares the software auto-exposure and white balance control loop
+//*****************************************************************************************
+
+#pragma once
+
+#include "ImageStatistics.h"
+
+#pragma managed(push, off)
+
+struct IBaseFilter;
+struct IAMCameraControl;
+struct IAMVideoProcAmp;
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// Device properties driven by the ExposureController
+	/// </summary>
+	enum ExposureChannel
+	{
+		ExposureChannel_Exposure,
+		ExposureChannel_Gain,
+		ExposureChannel_WhiteBalance,
+		ExposureChannel_Count
+	};
+
+	struct PropertyRange
+	{
+		long lMinimum;
+		long lMaximum;
+		long lStep;
+		long lDefault;
+	};
+
+	/// <summary>
+	/// Where the controller reads ranges from and writes values to.
+	/// Implemented over DirectShow for real cameras; a simulated device can stand in for it.
+	/// </summary>
+	class IExposureDevice
+	{
+	public:
+		virtual ~IExposureDevice() {}
+
+		virtual bool GetRange(ExposureChannel eChannel, PropertyRange* pRange) = 0;
+
+		virtual bool GetValue(ExposureChannel eChannel, long* plValue, bool* pbAutomatic) = 0;
+
+		/// <summary>
+		/// Writes a value and switches the property to manual control
+		/// </summary>
+		virtual bool SetValue(ExposureChannel eChannel, long lValue) = 0;
+
+		/// <summary>
+		/// Hands the property back to the camera's own automatic control
+		/// </summary>
+		virtual bool SetAutomatic(ExposureChannel eChannel) = 0;
+	};
+
+	/// <summary>
+	/// IExposureDevice over the IAMCameraControl and IAMVideoProcAmp interfaces of a capture filter
+	/// </summary>
+	class DirectShowExposureDevice : public IExposureDevice
+	{
+	public:
+		DirectShowExposureDevice(IBaseFilter* pFilter);
+		virtual ~DirectShowExposureDevice();
+
+		virtual bool GetRange(ExposureChannel eChannel, PropertyRange* pRange);
+		virtual bool GetValue(ExposureChannel eChannel, long* plValue, bool* pbAutomatic);
+		virtual bool SetValue(ExposureChannel eChannel, long lValue);
+		virtual bool SetAutomatic(ExposureChannel eChannel);
+
+	private:
+		IAMCameraControl* m_pCameraControl;
+		IAMVideoProcAmp* m_pProcAmp;
+	};
+
+	/// <summary>
+	/// Drives exposure, gain and white balance toward a target from per-frame ImageStatistics.
+	/// Each property is tracked as a continuous set point within its cached range, and the device
+	/// is only written when the set point crosses into another step of that range. Corrections
+	/// are damped, capped per update and spaced out in time so the USB control pipe stays quiet.
+	/// </summary>
+	class ExposureController
+	{
+	public:
+		ExposureController();
+		~ExposureController();
+
+		/// <summary>
+		/// Takes ownership of the device and caches its ranges and current values.
+		/// Returns false, and deletes the device, when it offers neither exposure, gain nor white balance.
+		/// </summary>
+		bool Attach(IExposureDevice* pDevice);
+
+		/// <summary>
+		/// Restores every property the controller wrote to its value and mode from before
+		/// Attach, then deletes the device
+		/// </summary>
+		void Detach();
+
+		/// <summary>
+		/// Feeds the statistics of one frame; returns true when a property was written to the device
+		/// </summary>
+		bool Update(const ImageStatistics& statistics, DWORD dwTimeMs);
+
+		void SetTargetLuma(double dTargetLuma)
+		{
+			m_dTargetLuma = dTargetLuma;
+		}
+
+		double GetTargetLuma() const
+		{
+			return m_dTargetLuma;
+		}
+
+		/// <summary>
+		/// Luma error, in levels, which is left alone
+		/// </summary>
+		void SetTolerance(double dTolerance)
+		{
+			m_dTolerance = dTolerance;
+		}
+
+		/// <summary>
+		/// Share of the measured error corrected per update, between 0 and 1
+		/// </summary>
+		void SetLoopGain(double dLoopGain)
+		{
+			m_dLoopGain = dLoopGain < 0.0 ? 0.0 : (dLoopGain > 1.0 ? 1.0 : dLoopGain);
+		}
+
+		/// <summary>
+		/// Largest change of a property per update, in steps of its range; a property with fine
+		/// steps may still move by half a stop
+		/// </summary>
+		void SetMaximumSteps(int nSteps)
+		{
+			m_nMaximumSteps = nSteps < 1 ? 1 : nSteps;
+		}
+
+		/// <summary>
+		/// Shortest time between two updates, so the camera has applied the last write
+		/// </summary>
+		void SetMinimumInterval(DWORD dwIntervalMs)
+		{
+			m_dwMinimumInterval = dwIntervalMs;
+		}
+
+		/// <summary>
+		/// Longest exposure the loop may choose before it raises gain instead, in Exposure_lgSec units
+		/// </summary>
+		void SetExposureLimit(long lExposureLimit)
+		{
+			m_lExposureLimit = lExposureLimit;
+			m_bExposureLimitSet = true;
+		}
+
+		void EnableExposure(bool bEnable)
+		{
+			m_bExposureEnabled = bEnable;
+		}
+
+		void EnableWhiteBalance(bool bEnable)
+		{
+			m_bWhiteBalanceEnabled = bEnable;
+		}
+
+		bool IsAttached() const
+		{
+			return m_pDevice != NULL;
+		}
+
+		/// <summary>
+		/// Number of values written to the device since it was attached
+		/// </summary>
+		DWORD GetWriteCount() const
+		{
+			return m_dwWriteCount;
+		}
+
+	private:
+		struct ChannelState
+		{
+			bool bAvailable;
+			bool bWritten;
+			bool bInitiallyAutomatic;
+			long lInitialValue;
+			PropertyRange range;
+			double dSetPoint;
+			long lApplied;
+		};
+
+		bool UpdateExposure(const ImageStatistics& statistics);
+		bool UpdateWhiteBalance(const ImageStatistics& statistics);
+
+		/// <summary>
+		/// Moves a set point by at most the step limit and writes it if it lands on another step
+		/// </summary>
+		bool MoveSetPoint(ExposureChannel eChannel, double dDelta, double dUnitsPerStop, double dUpperLimit, double* pdBlocked);
+
+		/// <summary>
+		/// Units of a property's range which change the picture by one stop, or correct one stop of cast
+		/// </summary>
+		double GetUnitsPerStop(ExposureChannel eChannel) const;
+
+		double GetUpperLimit(ExposureChannel eChannel) const;
+
+		CRITICAL_SECTION m_cs;
+		IExposureDevice* m_pDevice;
+		ChannelState m_aChannels[ExposureChannel_Count];
+
+		double m_dTargetLuma;
+		double m_dTolerance;
+		double m_dLoopGain;
+		int m_nMaximumSteps;
+		DWORD m_dwMinimumInterval;
+		long m_lExposureLimit;
+		bool m_bExposureLimitSet;
+		bool m_bExposureEnabled;
+		bool m_bWhiteBalanceEnabled;
+
+		bool m_bUpdated;
+		DWORD m_dwLastUpdate;
+		DWORD m_dwWriteCount;
+	};
+}
+
+#pragma managed(pop)
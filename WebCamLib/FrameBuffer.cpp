@@ -0,0 +1,185 @@
+//*****************************************************************************************
+//  File:       FrameBuffer.cpp
+//  Project:    WebcamLib
+//
+//  Defines the reference counted frame buffers and the pool they are recycled through
+//*****************************************************************************************
+
+#include <windows.h>
+#include <malloc.h>
+#include <new>
+
+#include "FrameBuffer.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+#pragma region FrameBuffer
+FrameBuffer::FrameBuffer(FramePool* pPool, DWORD dwCapacity)
+{
+	m_entry.Next = NULL;
+	m_pPool = pPool;
+	m_nRefCount = 0;
+
+	// 16 byte alignment lets the SSE2 kernels read straight from pooled frames
+	m_pData = static_cast<BYTE*>(_aligned_malloc(dwCapacity, 16));
+	m_dwCapacity = m_pData != NULL ? dwCapacity : 0;
+
+	m_nWidth = 0;
+	m_nHeight = 0;
+	m_nStride = 0;
+	m_nBitsPerPixel = 0;
+	m_bBottomUp = true;
+	m_llTimestamp = 0;
+	m_dSampleTime = 0.0;
+	m_bStatisticsValid = false;
+}
+
+FrameBuffer::~FrameBuffer()
+{
+	_aligned_free(m_pData);
+	m_pData = NULL;
+}
+
+LONG FrameBuffer::AddRef()
+{
+	return InterlockedIncrement(&m_nRefCount);
+}
+
+LONG FrameBuffer::Release()
+{
+	LONG result = InterlockedDecrement(&m_nRefCount);
+
+	if (result == 0)
+	{
+		m_pPool->Recycle(this);
+	}
+
+	return result;
+}
+
+void FrameBuffer::SetStatistics(const ImageStatistics* pStatistics)
+{
+	m_bStatisticsValid = pStatistics != NULL;
+
+	if (m_bStatisticsValid)
+	{
+		CopyMemory(&m_statistics, pStatistics, sizeof(ImageStatistics));
+	}
+}
+#pragma endregion
+
+#pragma region FramePool
+FramePool::FramePool(int nMaximumFree)
+{
+	InitializeSListHead(&m_freeList);
+	m_nRefCount = 1;
+	m_nFree = 0;
+	m_nOutstanding = 0;
+	m_nAllocated = 0;
+	m_nMaximumFree = nMaximumFree < 1 ? 1 : nMaximumFree;
+}
+
+FramePool::~FramePool()
+{
+	PSLIST_ENTRY pEntry = InterlockedFlushSList(&m_freeList);
+
+	while (pEntry != NULL)
+	{
+		FrameBuffer* pBuffer = reinterpret_cast<FrameBuffer*>(pEntry);
+		pEntry = pEntry->Next;
+
+		delete pBuffer;
+	}
+}
+
+LONG FramePool::AddRef()
+{
+	return InterlockedIncrement(&m_nRefCount);
+}
+
+LONG FramePool::Release()
+{
+	LONG result = InterlockedDecrement(&m_nRefCount);
+
+	if (result == 0)
+	{
+		delete this;
+	}
+
+	return result;
+}
+
+FrameBuffer* FramePool::Acquire(int nWidth, int nHeight, int nBitsPerPixel)
+{
+	int nRows = nHeight < 0 ? -nHeight : nHeight;
+	int nStride = ((nWidth * nBitsPerPixel + 31) / 32) * 4;
+	DWORD dwSize = static_cast<DWORD>(nStride) * nRows;
+
+	FrameBuffer* pBuffer = reinterpret_cast<FrameBuffer*>(InterlockedPopEntrySList(&m_freeList));
+
+	if (pBuffer != NULL)
+	{
+		InterlockedDecrement(&m_nFree);
+
+		// Left over from a larger or smaller format; only happens right after a format change
+		if (pBuffer->m_dwCapacity < dwSize)
+		{
+			delete pBuffer;
+			pBuffer = NULL;
+		}
+	}
+
+	if (pBuffer == NULL)
+	{
+		pBuffer = new (std::nothrow) FrameBuffer(this, dwSize);
+
+		if (pBuffer != NULL && pBuffer->m_pData == NULL)
+		{
+			delete pBuffer;
+			pBuffer = NULL;
+		}
+
+		if (pBuffer == NULL)
+			return NULL;
+
+		InterlockedIncrement(&m_nAllocated);
+	}
+
+	pBuffer->m_nWidth = nWidth;
+	pBuffer->m_nHeight = nRows;
+	pBuffer->m_nStride = nStride;
+	pBuffer->m_nBitsPerPixel = nBitsPerPixel;
+	pBuffer->m_bBottomUp = nHeight > 0;
+	pBuffer->m_llTimestamp = 0;
+	pBuffer->m_dSampleTime = 0.0;
+	pBuffer->m_bStatisticsValid = false;
+	pBuffer->m_nRefCount = 1;
+
+	AddRef();
+	InterlockedIncrement(&m_nOutstanding);
+
+	return pBuffer;
+}
+
+void FramePool::Recycle(FrameBuffer* pBuffer)
+{
+	InterlockedDecrement(&m_nOutstanding);
+
+	// Consumers holding on to frames make the pool grow; trim it back once they let go
+	if (InterlockedIncrement(&m_nFree) <= m_nMaximumFree)
+	{
+		InterlockedPushEntrySList(&m_freeList, &pBuffer->m_entry);
+	}
+	else
+	{
+		InterlockedDecrement(&m_nFree);
+		delete pBuffer;
+	}
+
+	Release();
+}
+#pragma endregion
+
+#pragma managed(pop)
@@ -0,0 +1,183 @@
+//*****************************************************************************************
+//  File:       FrameBuffer.h
+//  Project:    WebcamLib
+//
+//  Declares the reference counted frame buffers and the pool they are recycled through
+//*****************************************************************************************
+
+#pragma once
+
+#include "ImageStatistics.h"
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	class FramePool;
+
+	/// <summary>
+	/// One captured frame in native memory, shared by reference count.
+	/// The last Release hands the buffer back to its pool instead of freeing it.
+	/// </summary>
+	class FrameBuffer
+	{
+	public:
+		LONG AddRef();
+		LONG Release();
+
+		BYTE* GetData() const
+		{
+			return m_pData;
+		}
+
+		/// <summary>
+		/// Bytes of pixel data in use, always a whole number of rows
+		/// </summary>
+		DWORD GetSize() const
+		{
+			return static_cast<DWORD>(m_nStride) * m_nHeight;
+		}
+
+		int GetWidth() const
+		{
+			return m_nWidth;
+		}
+
+		int GetHeight() const
+		{
+			return m_nHeight;
+		}
+
+		/// <summary>
+		/// Bytes per row, rows padded to 32 bits as in a DIB
+		/// </summary>
+		int GetStride() const
+		{
+			return m_nStride;
+		}
+
+		int GetBitsPerPixel() const
+		{
+			return m_nBitsPerPixel;
+		}
+
+		/// <summary>
+		/// True when the first row in memory is the bottom row of the image, as for RGB DIBs
+		/// </summary>
+		bool IsBottomUp() const
+		{
+			return m_bBottomUp;
+		}
+
+		/// <summary>
+		/// QueryPerformanceCounter value taken when the frame arrived
+		/// </summary>
+		LONGLONG GetTimestamp() const
+		{
+			return m_llTimestamp;
+		}
+
+		/// <summary>
+		/// Stream time of the sample in seconds, as reported by DirectShow
+		/// </summary>
+		double GetSampleTime() const
+		{
+			return m_dSampleTime;
+		}
+
+		void SetTimestamp(LONGLONG llTimestamp, double dSampleTime)
+		{
+			m_llTimestamp = llTimestamp;
+			m_dSampleTime = dSampleTime;
+		}
+
+		/// <summary>
+		/// Statistics of this frame, NULL when none were computed
+		/// </summary>
+		const ImageStatistics* GetStatistics() const
+		{
+			return m_bStatisticsValid ? &m_statistics : NULL;
+		}
+
+		void SetStatistics(const ImageStatistics* pStatistics);
+
+	private:
+		friend class FramePool;
+
+		FrameBuffer(FramePool* pPool, DWORD dwCapacity);
+		~FrameBuffer();
+
+		// Must stay first: the pool links free buffers through it. Heap blocks are aligned to
+		// MEMORY_ALLOCATION_ALIGNMENT, which is what the interlocked list needs.
+		SLIST_ENTRY m_entry;
+
+		FramePool* m_pPool;
+		volatile LONG m_nRefCount;
+
+		BYTE* m_pData;
+		DWORD m_dwCapacity;
+		int m_nWidth;
+		int m_nHeight;
+		int m_nStride;
+		int m_nBitsPerPixel;
+		bool m_bBottomUp;
+
+		LONGLONG m_llTimestamp;
+		double m_dSampleTime;
+
+		bool m_bStatisticsValid;
+		ImageStatistics m_statistics;
+	};
+
+	/// <summary>
+	/// Lock-free pool of FrameBuffers for the capture thread.
+	/// The pool is reference counted as well and every outstanding buffer holds a reference,
+	/// so buffers still held by consumers stay valid after the capture is torn down.
+	/// </summary>
+	class FramePool
+	{
+	public:
+		explicit FramePool(int nMaximumFree = 4);
+
+		LONG AddRef();
+		LONG Release();
+
+		/// <summary>
+		/// Returns a buffer sized for the format with a reference count of one, or NULL when out of memory.
+		/// A negative height marks a top-down image, as in BITMAPINFOHEADER.
+		/// </summary>
+		FrameBuffer* Acquire(int nWidth, int nHeight, int nBitsPerPixel);
+
+		/// <summary>
+		/// Buffers currently handed out and not yet released
+		/// </summary>
+		LONG GetOutstandingCount() const
+		{
+			return m_nOutstanding;
+		}
+
+		/// <summary>
+		/// Buffers allocated over the life of the pool; stays flat once the pool has warmed up
+		/// </summary>
+		LONG GetAllocatedCount() const
+		{
+			return m_nAllocated;
+		}
+
+	private:
+		friend class FrameBuffer;
+
+		~FramePool();
+
+		void Recycle(FrameBuffer* pBuffer);
+
+		SLIST_HEADER m_freeList;
+		volatile LONG m_nRefCount;
+		volatile LONG m_nFree;
+		volatile LONG m_nOutstanding;
+		volatile LONG m_nAllocated;
+		int m_nMaximumFree;
+	};
+}
+
+#pragma managed(pop)
@@ -0,0 +1,510 @@
+//*****************************************************************************************
+//  File:       FrameBus.cpp
+//  Project:    WebcamLib
+//
+//  Defines the shared memory ring captured frames are published through to other processes
+//*****************************************************************************************
+
+#include <windows.h>
+#include <strsafe.h>
+
+#include "FrameBuffer.h"
+#include "FrameBus.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Readers retry a torn read this often before giving up until the next frame
+#define FRAMEBUS_READ_ATTEMPTS	4
+
+// Name of the event a reader registered in entry nReader waits on
+static HRESULT GetReaderEventName(LPCWSTR wszBusName, int nReader, LPWSTR wszEventName)
+{
+	return StringCchPrintfW(wszEventName, MAX_PATH, L"%s.Reader%d", wszBusName, nReader);
+}
+
+// True only when the process is known to be gone; one we may not open is taken to be alive
+static bool HasProcessExited(DWORD dwProcessId)
+{
+	HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, dwProcessId);
+	if (hProcess == NULL)
+		return GetLastError() == ERROR_INVALID_PARAMETER;
+
+	DWORD dwExitCode = STILL_ACTIVE;
+	bool bExited = GetExitCodeProcess(hProcess, &dwExitCode) && dwExitCode != STILL_ACTIVE;
+
+	CloseHandle(hProcess);
+
+	return bExited;
+}
+
+FrameBusWriter::FrameBusWriter()
+{
+	m_hMapping = NULL;
+	m_pView = NULL;
+	m_pHeader = NULL;
+	m_wszName[0] = L'\0';
+	m_nNextSlot = 0;
+	m_nFrame = 0;
+	m_nDropped = 0;
+
+	for (int n = 0; n < FRAMEBUS_MAX_READERS; n++)
+		m_ahReaderEvents[n] = NULL;
+}
+
+FrameBusWriter::~FrameBusWriter()
+{
+	Close();
+}
+
+HRESULT FrameBusWriter::Create(LPCWSTR wszName, int nSlotCount, DWORD dwSlotCapacity)
+{
+	Close();
+
+	if (wszName == NULL || nSlotCount < 2 || dwSlotCapacity == 0)
+		return E_INVALIDARG;
+
+	HRESULT hr = StringCchCopyW(m_wszName, MAX_PATH, wszName);
+
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+
+	DWORD dwGranularity = info.dwAllocationGranularity;
+	DWORD dwDataOffset = ((sizeof(FrameBusHeader) + dwGranularity - 1) / dwGranularity) * dwGranularity;
+	ULONGLONG ullSlotStride = (static_cast<ULONGLONG>(FRAMEBUS_SLOT_HEADER) + dwSlotCapacity + 63) & ~static_cast<ULONGLONG>(63);
+	ULONGLONG ullSize = dwDataOffset + ullSlotStride * nSlotCount;
+
+	if (SUCCEEDED(hr) && ullSlotStride > MAXDWORD)
+		hr = E_INVALIDARG;
+
+	bool bExisting = false;
+	if (SUCCEEDED(hr))
+	{
+		m_hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+			static_cast<DWORD>(ullSize >> 32), static_cast<DWORD>(ullSize), wszName);
+
+		if (m_hMapping == NULL)
+			hr = HRESULT_FROM_WIN32(GetLastError());
+		else
+			bExisting = (GetLastError() == ERROR_ALREADY_EXISTS);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		m_pView = static_cast<BYTE*>(MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, 0));
+		if (m_pView == NULL)
+			hr = HRESULT_FROM_WIN32(GetLastError());
+		else
+			m_pHeader = reinterpret_cast<FrameBusHeader*>(m_pView);
+	}
+
+	if (SUCCEEDED(hr) && bExisting)
+	{
+		// Readers outlived the previous writer and still hold the mapping open. Carry on where
+		// it stopped if the geometry matches, so they keep reading without reconnecting.
+		if (m_pHeader->dwMagic != FRAMEBUS_MAGIC || m_pHeader->dwVersion != FRAMEBUS_VERSION ||
+			m_pHeader->dwSlotCount != static_cast<DWORD>(nSlotCount) ||
+			m_pHeader->dwSlotStride != static_cast<DWORD>(ullSlotStride) ||
+			m_pHeader->dwDataOffset != dwDataOffset)
+		{
+			hr = HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+		}
+		else if (!ReclaimWriter(m_pHeader) && InterlockedCompareExchange(&m_pHeader->nWriterActive, 1, 0) != 0)
+		{
+			hr = HRESULT_FROM_WIN32(ERROR_BUSY);
+		}
+		else
+		{
+			m_pHeader->dwWriterProcessId = GetCurrentProcessId();
+			m_nFrame = m_pHeader->nFrameCount;
+			m_nNextSlot = (m_pHeader->nLatestSlot + 1) % nSlotCount;
+
+			// A writer which died in the middle of a copy left that slot's sequence odd; the next
+			// publish into it would turn it even while copying, so settle it first. The latest
+			// slot was complete before that copy began, so readers never take this one.
+			for (int n = 0; n < nSlotCount; n++)
+			{
+				FrameBusSlot* pSlot = reinterpret_cast<FrameBusSlot*>(m_pView + dwDataOffset + static_cast<size_t>(n) * m_pHeader->dwSlotStride);
+
+				if ((pSlot->nSequence & 1) != 0)
+					InterlockedIncrement(&pSlot->nSequence);
+			}
+		}
+	}
+	else if (SUCCEEDED(hr))
+	{
+		// Fresh page file backed mappings are zero filled; the magic goes in last so a reader
+		// opening the bus in the meantime rejects it rather than reading half a header
+		m_pHeader->dwVersion = FRAMEBUS_VERSION;
+		m_pHeader->dwSlotCount = static_cast<DWORD>(nSlotCount);
+		m_pHeader->dwSlotCapacity = dwSlotCapacity;
+		m_pHeader->dwSlotStride = static_cast<DWORD>(ullSlotStride);
+		m_pHeader->dwDataOffset = dwDataOffset;
+		m_pHeader->nLatestSlot = -1;
+		m_pHeader->nFrameCount = 0;
+		m_pHeader->nWriterActive = 1;
+		m_pHeader->dwWriterProcessId = GetCurrentProcessId();
+
+		MemoryBarrier();
+		m_pHeader->dwMagic = FRAMEBUS_MAGIC;
+	}
+
+	if (FAILED(hr))
+	{
+		// Do not give up a writer claim that was never ours
+		m_pHeader = NULL;
+		Close();
+	}
+
+	return hr;
+}
+
+void FrameBusWriter::Close()
+{
+	for (int n = 0; n < FRAMEBUS_MAX_READERS; n++)
+	{
+		if (m_ahReaderEvents[n] != NULL)
+		{
+			CloseHandle(m_ahReaderEvents[n]);
+			m_ahReaderEvents[n] = NULL;
+		}
+	}
+
+	if (m_pHeader != NULL)
+	{
+		m_pHeader->dwWriterProcessId = 0;
+		InterlockedExchange(&m_pHeader->nWriterActive, 0);
+		m_pHeader = NULL;
+	}
+
+	if (m_pView != NULL)
+	{
+		UnmapViewOfFile(m_pView);
+		m_pView = NULL;
+	}
+
+	if (m_hMapping != NULL)
+	{
+		CloseHandle(m_hMapping);
+		m_hMapping = NULL;
+	}
+
+	m_nNextSlot = 0;
+	m_nFrame = 0;
+}
+
+bool FrameBusWriter::Publish(const FrameBuffer* pFrame)
+{
+	if (m_pHeader == NULL)
+		return false;
+
+	DWORD dwSize = pFrame->GetSize();
+	if (dwSize > m_pHeader->dwSlotCapacity)
+	{
+		m_nDropped++;
+		return false;
+	}
+
+	// With two slots or more the next one is never the latest, so a reader that just looked up
+	// the latest frame finds it whole unless the writer laps the entire ring first
+	FrameBusSlot* pSlot = reinterpret_cast<FrameBusSlot*>(m_pView + m_pHeader->dwDataOffset +
+		static_cast<size_t>(m_nNextSlot) * m_pHeader->dwSlotStride);
+
+	// Odd sequence: readers holding this slot see it change under them
+	InterlockedIncrement(&pSlot->nSequence);
+
+	pSlot->nFrame = m_nFrame;
+	pSlot->nWidth = pFrame->GetWidth();
+	pSlot->nHeight = pFrame->GetHeight();
+	pSlot->nStride = pFrame->GetStride();
+	pSlot->nBitsPerPixel = pFrame->GetBitsPerPixel();
+	pSlot->bBottomUp = pFrame->IsBottomUp() ? TRUE : FALSE;
+	pSlot->dwSize = dwSize;
+	pSlot->llTimestamp = pFrame->GetTimestamp();
+	pSlot->dSampleTime = pFrame->GetSampleTime();
+
+	CopyMemory(reinterpret_cast<BYTE*>(pSlot) + FRAMEBUS_SLOT_HEADER, pFrame->GetData(), dwSize);
+
+	// Even again; the interlocked increments are full barriers around the copy
+	InterlockedIncrement(&pSlot->nSequence);
+
+	InterlockedExchange(&m_pHeader->nLatestSlot, m_nNextSlot);
+	InterlockedIncrement(&m_pHeader->nFrameCount);
+
+	m_nNextSlot = (m_nNextSlot + 1) % static_cast<int>(m_pHeader->dwSlotCount);
+	m_nFrame++;
+
+	SignalReaders();
+
+	return true;
+}
+
+bool FrameBusWriter::ReclaimWriter(FrameBusHeader* pHeader)
+{
+	// No process id: free, or claimed a moment ago and about to be given one
+	DWORD dwProcessId = pHeader->dwWriterProcessId;
+	if (pHeader->nWriterActive == 0 || dwProcessId == 0 || !HasProcessExited(dwProcessId))
+		return false;
+
+	// Clearing the id first lets only one of several writers starting at once have the claim.
+	// It is handed over as it is rather than released, so no third writer can slip in between.
+	return InterlockedCompareExchange(reinterpret_cast<volatile LONG*>(&pHeader->dwWriterProcessId), 0, static_cast<LONG>(dwProcessId)) == static_cast<LONG>(dwProcessId);
+}
+
+void FrameBusWriter::SignalReaders()
+{
+	WCHAR wszEventName[MAX_PATH];
+
+	for (int n = 0; n < FRAMEBUS_MAX_READERS; n++)
+	{
+		if (m_pHeader->aReaders[n].nInUse != 0)
+		{
+			// A reader creates its event before claiming the entry, so it is there to open
+			if (m_ahReaderEvents[n] == NULL && SUCCEEDED(GetReaderEventName(m_wszName, n, wszEventName)))
+				m_ahReaderEvents[n] = OpenEventW(EVENT_MODIFY_STATE, FALSE, wszEventName);
+
+			if (m_ahReaderEvents[n] != NULL)
+				SetEvent(m_ahReaderEvents[n]);
+		}
+		else if (m_ahReaderEvents[n] != NULL)
+		{
+			// The reader left; the next one in this entry brings a new event
+			CloseHandle(m_ahReaderEvents[n]);
+			m_ahReaderEvents[n] = NULL;
+		}
+	}
+}
+
+FrameBusClient::FrameBusClient()
+{
+	m_hMapping = NULL;
+	m_pHeader = NULL;
+	m_pSlots = NULL;
+	m_nReader = -1;
+	m_hEvent = NULL;
+	m_nLastFrame = 0;
+	m_bAnyRead = false;
+	m_nMissed = 0;
+}
+
+FrameBusClient::~FrameBusClient()
+{
+	Close();
+}
+
+HRESULT FrameBusClient::Open(LPCWSTR wszName)
+{
+	Close();
+
+	if (wszName == NULL)
+		return E_INVALIDARG;
+
+	HRESULT hr = S_OK;
+
+	m_hMapping = OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, wszName);
+	if (m_hMapping == NULL)
+		hr = HRESULT_FROM_WIN32(GetLastError());
+
+	if (SUCCEEDED(hr))
+	{
+		m_pHeader = static_cast<FrameBusHeader*>(MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, sizeof(FrameBusHeader)));
+		if (m_pHeader == NULL)
+			hr = HRESULT_FROM_WIN32(GetLastError());
+		else if (m_pHeader->dwMagic != FRAMEBUS_MAGIC || m_pHeader->dwVersion != FRAMEBUS_VERSION)
+			hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+	}
+
+	// The slots are only ever read here, so map them read-only
+	if (SUCCEEDED(hr))
+	{
+		MemoryBarrier();
+
+		SIZE_T cbSlots = static_cast<SIZE_T>(m_pHeader->dwSlotStride) * m_pHeader->dwSlotCount;
+		m_pSlots = static_cast<const BYTE*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, m_pHeader->dwDataOffset, cbSlots));
+		if (m_pSlots == NULL)
+			hr = HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		WCHAR wszEventName[MAX_PATH];
+
+		// Readers that crashed never released their entries
+		ReclaimReaders(m_pHeader);
+
+		hr = HRESULT_FROM_WIN32(ERROR_NO_MORE_ITEMS);
+		for (int n = 0; n < FRAMEBUS_MAX_READERS && m_nReader == -1; n++)
+		{
+			if (m_pHeader->aReaders[n].nInUse != 0 || FAILED(GetReaderEventName(wszName, n, wszEventName)))
+				continue;
+
+			HANDLE hEvent = CreateEventW(NULL, FALSE, FALSE, wszEventName);
+			if (hEvent == NULL)
+				continue;
+
+			if (InterlockedCompareExchange(&m_pHeader->aReaders[n].nInUse, 1, 0) == 0)
+			{
+				m_pHeader->aReaders[n].dwProcessId = GetCurrentProcessId();
+				m_nReader = n;
+				m_hEvent = hEvent;
+				hr = S_OK;
+			}
+			else
+			{
+				CloseHandle(hEvent);
+			}
+		}
+	}
+
+	if (FAILED(hr))
+		Close();
+
+	return hr;
+}
+
+void FrameBusClient::Close()
+{
+	if (m_nReader != -1)
+	{
+		m_pHeader->aReaders[m_nReader].dwProcessId = 0;
+		InterlockedExchange(&m_pHeader->aReaders[m_nReader].nInUse, 0);
+		m_nReader = -1;
+	}
+
+	if (m_hEvent != NULL)
+	{
+		CloseHandle(m_hEvent);
+		m_hEvent = NULL;
+	}
+
+	if (m_pSlots != NULL)
+	{
+		UnmapViewOfFile(m_pSlots);
+		m_pSlots = NULL;
+	}
+
+	if (m_pHeader != NULL)
+	{
+		UnmapViewOfFile(m_pHeader);
+		m_pHeader = NULL;
+	}
+
+	if (m_hMapping != NULL)
+	{
+		CloseHandle(m_hMapping);
+		m_hMapping = NULL;
+	}
+
+	m_nLastFrame = 0;
+	m_bAnyRead = false;
+	m_nMissed = 0;
+}
+
+int FrameBusClient::ReclaimReaders(FrameBusHeader* pHeader)
+{
+	int nReclaimed = 0;
+
+	for (int n = 0; n < FRAMEBUS_MAX_READERS; n++)
+	{
+		FrameBusReaderEntry& entry = pHeader->aReaders[n];
+
+		// No process id: free, or claimed a moment ago and about to be given one
+		DWORD dwProcessId = entry.dwProcessId;
+		if (entry.nInUse == 0 || dwProcessId == 0 || !HasProcessExited(dwProcessId))
+			continue;
+
+		// Clearing the id first lets only one of several readers opening at once free the entry,
+		// and none of them free it again once a new reader has claimed it
+		if (InterlockedCompareExchange(reinterpret_cast<volatile LONG*>(&entry.dwProcessId), 0, static_cast<LONG>(dwProcessId)) == static_cast<LONG>(dwProcessId))
+		{
+			InterlockedExchange(&entry.nInUse, 0);
+			nReclaimed++;
+		}
+	}
+
+	return nReclaimed;
+}
+
+bool FrameBusClient::WaitForFrame(DWORD dwTimeoutMs)
+{
+	if (m_pHeader == NULL)
+		return false;
+
+	// Frames published since the last read are waiting already; the event may have been
+	// consumed by an earlier wait that found nothing new, so do not rely on it alone
+	LONG nFrameCount = m_pHeader->nFrameCount;
+	if (nFrameCount > 0 && (!m_bAnyRead || nFrameCount - 1 - m_nLastFrame > 0))
+		return true;
+
+	return WaitForSingleObject(m_hEvent, dwTimeoutMs) == WAIT_OBJECT_0;
+}
+
+bool FrameBusClient::ReadLatest(FrameBusFrame* pFrame)
+{
+	if (m_pHeader == NULL)
+		return false;
+
+	for (int nAttempt = 0; nAttempt < FRAMEBUS_READ_ATTEMPTS; nAttempt++)
+	{
+		LONG nSlot = m_pHeader->nLatestSlot;
+		if (nSlot < 0 || nSlot >= static_cast<LONG>(m_pHeader->dwSlotCount))
+			return false;
+
+		const FrameBusSlot* pSlot = GetSlot(nSlot);
+
+		// Odd: the writer lapped the ring and is refilling this slot; the latest index has moved on
+		LONG nSequence = pSlot->nSequence;
+		if (nSequence & 1)
+			continue;
+
+		MemoryBarrier();
+
+		pFrame->nSlot = nSlot;
+		pFrame->nSequence = nSequence;
+		pFrame->nFrame = pSlot->nFrame;
+		pFrame->nWidth = pSlot->nWidth;
+		pFrame->nHeight = pSlot->nHeight;
+		pFrame->nStride = pSlot->nStride;
+		pFrame->nBitsPerPixel = pSlot->nBitsPerPixel;
+		pFrame->bBottomUp = pSlot->bBottomUp != FALSE;
+		pFrame->dwSize = pSlot->dwSize;
+		pFrame->llTimestamp = pSlot->llTimestamp;
+		pFrame->dSampleTime = pSlot->dSampleTime;
+		pFrame->pData = reinterpret_cast<const BYTE*>(pSlot) + FRAMEBUS_SLOT_HEADER;
+
+		MemoryBarrier();
+
+		if (pSlot->nSequence != nSequence || pFrame->dwSize > m_pHeader->dwSlotCapacity)
+			continue;
+
+		if (m_bAnyRead)
+		{
+			LONG nAdvance = pFrame->nFrame - m_nLastFrame;
+			if (nAdvance <= 0)
+				return false;
+
+			m_nMissed += nAdvance - 1;
+		}
+
+		m_nLastFrame = pFrame->nFrame;
+		m_bAnyRead = true;
+
+		return true;
+	}
+
+	return false;
+}
+
+bool FrameBusClient::IsIntact(const FrameBusFrame& frame) const
+{
+	if (m_pHeader == NULL)
+		return false;
+
+	// Order the caller's reads of the pixels before the sequence check
+	MemoryBarrier();
+
+	return GetSlot(frame.nSlot)->nSequence == frame.nSequence;
+}
+
+#pragma managed(pop)
@@ -0,0 +1,225 @@
+//*****************************************************************************************
+//  File:       FrameBus.h
+//  Project:    WebcamLib
+//
+//  Declares the shared memory ring captured frames are published through to other processes
+//*****************************************************************************************
+
+#pragma once
+
+#pragma managed(push, off)
+
+#define FRAMEBUS_MAGIC			0x53554246	// "FBUS"
+#define FRAMEBUS_VERSION		2
+#define FRAMEBUS_MAX_READERS	32
+
+// Pixels start this far into a slot, keeping them cache line and SSE aligned
+#define FRAMEBUS_SLOT_HEADER	64
+
+namespace WebCamLib
+{
+	class FrameBuffer;
+
+	/// <summary>
+	/// A registered reader. dwProcessId is set just after nInUse is claimed and cleared just before
+	/// it is released, so an entry whose process has exited can be told and taken back.
+	/// </summary>
+	struct FrameBusReaderEntry
+	{
+		volatile LONG nInUse;
+		volatile DWORD dwProcessId;
+	};
+
+	/// <summary>
+	/// Control block at the start of the mapping. It fills a whole allocation granule so
+	/// readers can map it writable, to register, and the slots behind it read-only.
+	/// </summary>
+	struct FrameBusHeader
+	{
+		DWORD dwMagic;
+		DWORD dwVersion;
+		DWORD dwSlotCount;
+		DWORD dwSlotCapacity;		// pixel bytes a slot holds
+		DWORD dwSlotStride;			// bytes from one slot to the next
+		DWORD dwDataOffset;			// offset of the first slot in the mapping
+
+		volatile LONG nLatestSlot;	// slot of the newest complete frame, -1 before the first
+		volatile LONG nFrameCount;	// frames published so far
+		volatile LONG nWriterActive;	// a writer has the bus open; a restarted one takes it over
+
+		// Set just after nWriterActive is claimed and cleared just before it is released, like a
+		// reader entry, so a writer restarted after a crash can take over from the one which died
+		volatile DWORD dwWriterProcessId;
+
+		FrameBusReaderEntry aReaders[FRAMEBUS_MAX_READERS];
+	};
+
+	/// <summary>
+	/// Header of a slot, followed by the pixels at FRAMEBUS_SLOT_HEADER.
+	/// nSequence is a seqlock: odd while the writer fills the slot, moved on by two per frame.
+	/// </summary>
+	struct FrameBusSlot
+	{
+		volatile LONG nSequence;
+		LONG nFrame;
+		int nWidth;
+		int nHeight;
+		int nStride;
+		int nBitsPerPixel;
+		BOOL bBottomUp;
+		DWORD dwSize;
+		LONGLONG llTimestamp;		// QueryPerformanceCounter on arrival, comparable across processes
+		double dSampleTime;
+	};
+
+	/// <summary>
+	/// A frame as a reader sees it: a copy of the slot header and a pointer into the mapping
+	/// </summary>
+	struct FrameBusFrame
+	{
+		int nSlot;
+		LONG nSequence;
+		LONG nFrame;
+		int nWidth;
+		int nHeight;
+		int nStride;
+		int nBitsPerPixel;
+		bool bBottomUp;
+		DWORD dwSize;
+		LONGLONG llTimestamp;
+		double dSampleTime;
+		const BYTE* pData;
+	};
+
+	/// <summary>
+	/// Writing end of a frame bus: a named mapping holding a ring of fixed-size slots.
+	/// Each frame is copied once into the next slot; readers in any process then use it in place.
+	/// Publishing never waits on readers, who detect a slot being overwritten from its seqlock.
+	/// </summary>
+	class FrameBusWriter
+	{
+	public:
+		FrameBusWriter();
+		~FrameBusWriter();
+
+		/// <summary>
+		/// Creates the mapping, or takes over one left by a previous writer that readers still hold
+		/// open, provided it has the same geometry. Fails while another writer has the bus open,
+		/// unless that writer's process has exited without closing it.
+		/// </summary>
+		HRESULT Create(LPCWSTR wszName, int nSlotCount, DWORD dwSlotCapacity);
+
+		void Close();
+
+		/// <summary>
+		/// Copies a frame into the next slot and wakes the readers. Frames larger than a slot are dropped.
+		/// </summary>
+		bool Publish(const FrameBuffer* pFrame);
+
+		LONG GetDroppedCount() const
+		{
+			return m_nDropped;
+		}
+
+	private:
+		FrameBusWriter(const FrameBusWriter&);
+		FrameBusWriter& operator=(const FrameBusWriter&);
+
+		void SignalReaders();
+
+		/// <summary>
+		/// Frees the writer claim of a process which exited without closing the bus
+		/// </summary>
+		static bool ReclaimWriter(FrameBusHeader* pHeader);
+
+		HANDLE m_hMapping;
+		BYTE* m_pView;
+		FrameBusHeader* m_pHeader;
+
+		WCHAR m_wszName[MAX_PATH];
+		HANDLE m_ahReaderEvents[FRAMEBUS_MAX_READERS];
+
+		int m_nNextSlot;
+		LONG m_nFrame;
+		LONG m_nDropped;
+	};
+
+	/// <summary>
+	/// Reading end of a frame bus, usable from any process on the machine.
+	/// Frames are read in place; check IsIntact after using one, since the writer may have
+	/// lapped the ring and reused the slot in the meantime.
+	/// </summary>
+	class FrameBusClient
+	{
+	public:
+		FrameBusClient();
+		~FrameBusClient();
+
+		/// <summary>
+		/// Maps an existing bus and registers for wake-ups
+		/// </summary>
+		HRESULT Open(LPCWSTR wszName);
+
+		void Close();
+
+		/// <summary>
+		/// Frees the entries of readers whose process exited without closing, returning how many
+		/// </summary>
+		static int ReclaimReaders(FrameBusHeader* pHeader);
+
+		/// <summary>
+		/// Waits until a frame newer than the last one read is published. Returns false on timeout.
+		/// </summary>
+		bool WaitForFrame(DWORD dwTimeoutMs);
+
+		/// <summary>
+		/// Maps the newest frame if it is newer than the last one read
+		/// </summary>
+		bool ReadLatest(FrameBusFrame* pFrame);
+
+		/// <summary>
+		/// True while the frame's slot still holds it
+		/// </summary>
+		bool IsIntact(const FrameBusFrame& frame) const;
+
+		/// <summary>
+		/// Frames published that this reader never got to see
+		/// </summary>
+		LONG GetMissedCount() const
+		{
+			return m_nMissed;
+		}
+
+		int GetSlotCount() const
+		{
+			return m_pHeader != NULL ? static_cast<int>(m_pHeader->dwSlotCount) : 0;
+		}
+
+		bool IsWriterActive() const
+		{
+			return m_pHeader != NULL && m_pHeader->nWriterActive != 0;
+		}
+
+	private:
+		FrameBusClient(const FrameBusClient&);
+		FrameBusClient& operator=(const FrameBusClient&);
+
+		const FrameBusSlot* GetSlot(int nSlot) const
+		{
+			return reinterpret_cast<const FrameBusSlot*>(m_pSlots + static_cast<size_t>(nSlot) * m_pHeader->dwSlotStride);
+		}
+
+		HANDLE m_hMapping;
+		FrameBusHeader* m_pHeader;
+		const BYTE* m_pSlots;
+
+		int m_nReader;
+		HANDLE m_hEvent;
+
+		LONG m_nLastFrame;
+		bool m_bAnyRead;
+		LONG m_nMissed;
+	};
+}
+
+#pragma managed(pop)
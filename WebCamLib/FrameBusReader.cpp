@@ -0,0 +1,193 @@
+//*****************************************************************************************
+//  File:       FrameBusReader.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed reading end of a frame bus, for processes consuming another's capture
+//*****************************************************************************************
+
+#include <windows.h>
+#include <vcclr.h>
+
+#include "FrameBus.h"
+#include "FrameBusReader.h"
+
+using namespace System::Runtime::InteropServices;
+using namespace WebCamLib;
+
+FrameBusView::FrameBusView( FrameBusReader^ reader, const FrameBusFrame& frame )
+{
+	this->reader = reader;
+
+	slot = frame.nSlot;
+	sequence = frame.nSequence;
+	frameNumber = frame.nFrame;
+	width = frame.nWidth;
+	height = frame.nHeight;
+	stride = frame.nStride;
+	bitsPerPixel = frame.nBitsPerPixel;
+	bottomUp = frame.bBottomUp;
+	size = static_cast<int>( frame.dwSize );
+	timestamp = frame.llTimestamp;
+	sampleTime = frame.dSampleTime;
+	data = IntPtr( const_cast<BYTE*>( frame.pData ) );
+}
+
+int FrameBusView::Width::get()
+{
+	return width;
+}
+
+int FrameBusView::Height::get()
+{
+	return height;
+}
+
+int FrameBusView::BitsPerPixel::get()
+{
+	return bitsPerPixel;
+}
+
+IntPtr FrameBusView::Scan0::get()
+{
+	if( !bottomUp )
+		return data;
+
+	return IntPtr( static_cast<BYTE*>( data.ToPointer() ) + static_cast<ptrdiff_t>( height - 1 ) * stride );
+}
+
+int FrameBusView::Stride::get()
+{
+	return bottomUp ? -stride : stride;
+}
+
+IntPtr FrameBusView::Data::get()
+{
+	return data;
+}
+
+int FrameBusView::Size::get()
+{
+	return size;
+}
+
+int FrameBusView::FrameNumber::get()
+{
+	return frameNumber;
+}
+
+long long FrameBusView::Timestamp::get()
+{
+	return timestamp;
+}
+
+double FrameBusView::SampleTime::get()
+{
+	return sampleTime;
+}
+
+bool FrameBusView::IsValid::get()
+{
+	FrameBusFrame frame;
+	frame.nSlot = slot;
+	frame.nSequence = sequence;
+
+	if( !reader->IsOpen() )
+		return false;
+
+	return reader->GetClient()->IsIntact( frame );
+}
+
+bool FrameBusView::CopyTo( array<Byte>^ destination )
+{
+	if( destination == nullptr )
+		throw gcnew ArgumentNullException( "destination" );
+
+	if( destination->Length < size )
+		throw gcnew ArgumentException( "Destination is smaller than the frame." );
+
+	// The view's pointer is into the reader's mapping, which is gone once the reader is disposed
+	if( !IsValid )
+		return false;
+
+	Marshal::Copy( data, destination, 0, size );
+
+	return IsValid;
+}
+
+FrameBusReader::FrameBusReader( String^ name )
+{
+	if( name == nullptr )
+		throw gcnew ArgumentNullException( "name" );
+
+	FrameBusClient* pNewClient = new FrameBusClient();
+
+	pin_ptr<const wchar_t> wszName = PtrToStringChars( name );
+	HRESULT hr = pNewClient->Open( wszName );
+
+	if( FAILED( hr ) )
+	{
+		delete pNewClient;
+		throw gcnew COMException( "Unable to open frame bus: " + name, hr );
+	}
+
+	pClient = pNewClient;
+}
+
+FrameBusReader::~FrameBusReader()
+{
+	this->!FrameBusReader();
+}
+
+FrameBusReader::!FrameBusReader()
+{
+	if( pClient != NULL )
+	{
+		delete pClient;
+		pClient = NULL;
+	}
+}
+
+bool FrameBusReader::IsOpen()
+{
+	return pClient != NULL;
+}
+
+FrameBusClient* FrameBusReader::GetClient()
+{
+	if( pClient == NULL )
+		throw gcnew ObjectDisposedException( "FrameBusReader" );
+
+	return pClient;
+}
+
+bool FrameBusReader::WaitForFrame( int millisecondsTimeout )
+{
+	DWORD dwTimeout = millisecondsTimeout < 0 ? INFINITE : static_cast<DWORD>( millisecondsTimeout );
+
+	return GetClient()->WaitForFrame( dwTimeout );
+}
+
+FrameBusView^ FrameBusReader::ReadLatest()
+{
+	FrameBusFrame frame;
+
+	if( !GetClient()->ReadLatest( &frame ) )
+		return nullptr;
+
+	return gcnew FrameBusView( this, frame );
+}
+
+int FrameBusReader::MissedFrames::get()
+{
+	return GetClient()->GetMissedCount();
+}
+
+int FrameBusReader::SlotCount::get()
+{
+	return GetClient()->GetSlotCount();
+}
+
+bool FrameBusReader::IsWriterActive::get()
+{
+	return GetClient()->IsWriterActive();
+}
@@ -0,0 +1,188 @@
+//*****************************************************************************************
+//  File:       FrameBusReader.h
+//  Project:    WebcamLib
+//
+//  Declares the managed reading end of a frame bus, for processes consuming another's capture
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+
+namespace WebCamLib
+{
+	class FrameBusClient;
+	struct FrameBusFrame;
+	ref class FrameBusReader;
+
+	/// <summary>
+	/// A frame read in place from a frame bus. The pixels stay in the shared mapping and the
+	/// writer may reuse their slot at any time, so check IsValid after using them, or use CopyTo.
+	/// </summary>
+	public ref class FrameBusView
+	{
+	internal:
+		FrameBusView( FrameBusReader^ reader, const FrameBusFrame& frame );
+
+	public:
+		property int Width
+		{
+			int get();
+		}
+
+		property int Height
+		{
+			int get();
+		}
+
+		property int BitsPerPixel
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Address of the top row of the image
+		/// </summary>
+		property IntPtr Scan0
+		{
+			IntPtr get();
+		}
+
+		/// <summary>
+		/// Byte offset from one row to the row below it; negative for bottom-up buffers, as in BitmapData
+		/// </summary>
+		property int Stride
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Address of the first byte of the buffer, which is the bottom row for bottom-up buffers
+		/// </summary>
+		property IntPtr Data
+		{
+			IntPtr get();
+		}
+
+		property int Size
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Number of the frame since the bus was created
+		/// </summary>
+		property int FrameNumber
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Stopwatch ticks, taken when the frame arrived from the driver in the capturing process
+		/// </summary>
+		property long long Timestamp
+		{
+			long long get();
+		}
+
+		/// <summary>
+		/// Stream time of the sample in seconds, as reported by DirectShow
+		/// </summary>
+		property double SampleTime
+		{
+			double get();
+		}
+
+		/// <summary>
+		/// True while the slot still holds this frame; false once the writer has started to reuse it
+		/// or the reader has been disposed
+		/// </summary>
+		property bool IsValid
+		{
+			bool get();
+		}
+
+		/// <summary>
+		/// Copies the raw buffer, in memory order, into an array of at least Size bytes.
+		/// Returns false when the frame was overwritten during the copy, leaving the array undefined,
+		/// and without copying when the frame is already gone or the reader has been disposed.
+		/// </summary>
+		bool CopyTo( array<Byte>^ destination );
+
+	private:
+		FrameBusReader^ reader;
+
+		int slot;
+		int sequence;
+		int frameNumber;
+		int width;
+		int height;
+		int stride;
+		int bitsPerPixel;
+		bool bottomUp;
+		int size;
+		long long timestamp;
+		double sampleTime;
+		IntPtr data;
+	};
+
+	/// <summary>
+	/// Attaches to a frame bus opened by CameraMethods.OpenFrameBus, in this or any other process.
+	/// Readers never slow the capture down; one that falls behind skips to the newest frame.
+	/// </summary>
+	public ref class FrameBusReader
+	{
+	public:
+		/// <summary>
+		/// Opens the bus of that name; throws when there is none or every reader entry is taken
+		/// </summary>
+		FrameBusReader( String^ name );
+
+		/// <summary>
+		/// Waits until a frame newer than the last one read arrives. Returns false on timeout.
+		/// </summary>
+		bool WaitForFrame( int millisecondsTimeout );
+
+		/// <summary>
+		/// Returns the newest frame, or null when there is none newer than the last one read
+		/// </summary>
+		FrameBusView^ ReadLatest();
+
+		/// <summary>
+		/// Frames published that this reader skipped
+		/// </summary>
+		property int MissedFrames
+		{
+			int get();
+		}
+
+		property int SlotCount
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// False once the capturing process has closed the bus; a new writer of the same name resumes it
+		/// </summary>
+		property bool IsWriterActive
+		{
+			bool get();
+		}
+
+		~FrameBusReader();
+
+	protected:
+		!FrameBusReader();
+
+	internal:
+		FrameBusClient* GetClient();
+
+		/// <summary>
+		/// False once the reader has been disposed or finalized and its mapping released
+		/// </summary>
+		bool IsOpen();
+
+	private:
+		FrameBusClient* pClient;
+	};
+}
@@ -0,0 +1,317 @@
+//*****************************************************************************************
+//  File:       FrameProcessingPipeline.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed view of the native stage graph run over each captured frame
+//*****************************************************************************************
+
+#include <windows.h>
+#include <vcclr.h>
+
+#include "FrameBuffer.h"
+#include "FrameRing.h"
+#include "ProcessingPipeline.h"
+#include "ProcessingStages.h"
+#include "PooledFrame.h"
+#include "PreEventBuffer.h"
+#include "RemapTable.h"
+#include "RemapOptions.h"
+#include "TemporalDenoiser.h"
+#include "VideoStabiliser.h"
+#include "ThreadPlacement.h"
+#include "ThreadPlacementOptions.h"
+#include "FrameProcessingPipeline.h"
+
+using namespace System::Diagnostics;
+using namespace System::Runtime::InteropServices;
+using namespace WebCamLib;
+
+#pragma region PipelineStageTiming
+PipelineStageTiming::PipelineStageTiming( String^ name, PipelineStageKind kind, int branch, bool fused, const StageTiming& timing )
+{
+	this->name = name;
+	this->kind = kind;
+	this->branch = branch;
+	this->fused = fused;
+
+	double millisecondsPerTick = 1000.0 / Stopwatch::Frequency;
+
+	frameCount = timing.nFrames;
+	failures = timing.nFailures;
+	averageMilliseconds = timing.nFrames > 0 ? timing.llTotalTicks * millisecondsPerTick / timing.nFrames : 0.0;
+	maximumMilliseconds = timing.llMaximumTicks * millisecondsPerTick;
+	lastMilliseconds = timing.llLastTicks * millisecondsPerTick;
+}
+
+String^ PipelineStageTiming::Name::get()
+{
+	return name;
+}
+
+PipelineStageKind PipelineStageTiming::Kind::get()
+{
+	return kind;
+}
+
+int PipelineStageTiming::Branch::get()
+{
+	return branch;
+}
+
+bool PipelineStageTiming::Fused::get()
+{
+	return fused;
+}
+
+int PipelineStageTiming::FrameCount::get()
+{
+	return frameCount;
+}
+
+int PipelineStageTiming::Failures::get()
+{
+	return failures;
+}
+
+double PipelineStageTiming::AverageMilliseconds::get()
+{
+	return averageMilliseconds;
+}
+
+double PipelineStageTiming::MaximumMilliseconds::get()
+{
+	return maximumMilliseconds;
+}
+
+double PipelineStageTiming::LastMilliseconds::get()
+{
+	return lastMilliseconds;
+}
+#pragma endregion
+
+#pragma region FrameProcessingPipeline
+FrameProcessingPipeline::FrameProcessingPipeline()
+{
+	pPipeline = new ProcessingPipeline();
+	sinkCallbacks = gcnew List<SinkCallbackDelegate^>();
+}
+
+FrameProcessingPipeline::~FrameProcessingPipeline()
+{
+	this->!FrameProcessingPipeline();
+}
+
+FrameProcessingPipeline::!FrameProcessingPipeline()
+{
+	// A camera still running the pipeline holds a reference on it, and on this object for the sink delegates
+	if( pPipeline != NULL )
+	{
+		pPipeline->Release();
+		pPipeline = NULL;
+	}
+}
+
+ProcessingPipeline* FrameProcessingPipeline::GetNative()
+{
+	if( pPipeline == NULL )
+		throw gcnew ObjectDisposedException( "FrameProcessingPipeline" );
+
+	return pPipeline;
+}
+
+int FrameProcessingPipeline::AddBranch()
+{
+	return GetNative()->AddBranch();
+}
+
+void FrameProcessingPipeline::AddStage( int branch, ProcessingStage* pStage )
+{
+	HRESULT hr = GetNative()->AddStage( branch, pStage );
+
+	if( FAILED( hr ) )
+	{
+		delete pStage;
+
+		if( hr == E_INVALIDARG )
+			throw gcnew ArgumentOutOfRangeException( "branch", "The pipeline has no such branch." );
+
+		throw gcnew COMException( "Unable to add the stage.", hr );
+	}
+}
+
+void FrameProcessingPipeline::AddConvert( int branch, int bitsPerPixel )
+{
+	if( bitsPerPixel != 24 && bitsPerPixel != 32 )
+		throw gcnew ArgumentOutOfRangeException( "bitsPerPixel", "Frames can only be converted to 24 or 32 bits per pixel." );
+
+	AddStage( branch, new ConvertStage( bitsPerPixel ) );
+}
+
+void FrameProcessingPipeline::AddMirror( int branch )
+{
+	AddStage( branch, new MirrorStage() );
+}
+
+void FrameProcessingPipeline::AddFlip( int branch )
+{
+	AddStage( branch, new FlipStage() );
+}
+
+void FrameProcessingPipeline::AddRemap( int branch, RemapOptions^ options )
+{
+	if( options == nullptr )
+		throw gcnew ArgumentNullException( "options" );
+
+	RemapParameters parameters;
+	options->ToNative( &parameters );
+
+	RemapStage* pStage = new RemapStage();
+
+	HRESULT hr = pStage->SetParameters( parameters );
+	if( FAILED( hr ) )
+	{
+		delete pStage;
+		throw gcnew ArgumentException( "The lens has no focal length in one direction, or the homography cannot be inverted.", "options" );
+	}
+
+	AddStage( branch, pStage );
+}
+
+void FrameProcessingPipeline::AddTemporalDenoise( int branch, double strength, int noiseThreshold, int motionRange )
+{
+	if( !( strength >= 0.0 && strength <= 1.0 ) )
+		throw gcnew ArgumentOutOfRangeException( "strength" );
+	if( noiseThreshold < 0 || noiseThreshold > 255 )
+		throw gcnew ArgumentOutOfRangeException( "noiseThreshold" );
+	if( motionRange < 1 || motionRange > 255 )
+		throw gcnew ArgumentOutOfRangeException( "motionRange" );
+
+	TemporalDenoiseStage* pStage = new TemporalDenoiseStage();
+	pStage->SetParameters( strength, noiseThreshold, motionRange );
+
+	AddStage( branch, pStage );
+}
+
+void FrameProcessingPipeline::AddStabilisation( int branch, double margin, int smoothingFrames )
+{
+	if( !( margin > 0.0 && margin <= 0.25 ) )
+		throw gcnew ArgumentOutOfRangeException( "margin" );
+	if( smoothingFrames < 1 )
+		throw gcnew ArgumentOutOfRangeException( "smoothingFrames" );
+
+	StabiliseStage* pStage = new StabiliseStage();
+	pStage->SetParameters( margin, smoothingFrames );
+
+	AddStage( branch, pStage );
+}
+
+void FrameProcessingPipeline::AddStatistics( int branch, int gridStep )
+{
+	if( gridStep < 1 )
+		throw gcnew ArgumentOutOfRangeException( "gridStep" );
+
+	AddStage( branch, new StatisticsStage( gridStep ) );
+}
+
+void FrameProcessingPipeline::AddSink( int branch, String^ name, FrameSinkHandler^ handler )
+{
+	if( handler == nullptr )
+		throw gcnew ArgumentNullException( "handler" );
+
+	SinkThunk^ thunk = gcnew SinkThunk( handler );
+	SinkCallbackDelegate^ callback = gcnew SinkCallbackDelegate( thunk, &SinkThunk::Invoke );
+
+	CallbackSink* pStage = new CallbackSink(
+		static_cast<CallbackSink::PFN_SinkCallback>( Marshal::GetFunctionPointerForDelegate( callback ).ToPointer() ) );
+
+	if( name != nullptr )
+	{
+		pin_ptr<const wchar_t> wszName = PtrToStringChars( name );
+		pStage->SetName( wszName );
+	}
+
+	AddStage( branch, pStage );
+	sinkCallbacks->Add( callback );
+}
+
+void FrameProcessingPipeline::AddPreEventBuffer( int branch, PreEventBuffer^ buffer )
+{
+	if( buffer == nullptr )
+		throw gcnew ArgumentNullException( "buffer" );
+
+	AddStage( branch, new FrameRingSink( buffer->GetNative() ) );
+}
+
+array<PipelineStageTiming^>^ FrameProcessingPipeline::GetStageTimings()
+{
+	ProcessingPipeline* pNative = GetNative();
+
+	List<PipelineStageTiming^>^ result = gcnew List<PipelineStageTiming^>();
+
+	const WCHAR* szName;
+	StageKind eKind;
+	int nBranch;
+	bool bFused;
+	StageTiming timing;
+
+	// Stages are only ever added, so this stops at the count at the time of the last call
+	for( int n = 0; pNative->GetStageInfo( n, &szName, &eKind, &nBranch, &bFused, &timing ); n++ )
+	{
+		result->Add( gcnew PipelineStageTiming( gcnew String( szName ), static_cast<PipelineStageKind>( eKind ), nBranch, bFused, timing ) );
+	}
+
+	return result->ToArray();
+}
+
+void FrameProcessingPipeline::ResetTimings()
+{
+	GetNative()->ResetTimings();
+}
+
+ThreadPlacementOptions^ FrameProcessingPipeline::WorkerThreadPlacement::get()
+{
+	return workerThreadPlacement;
+}
+
+void FrameProcessingPipeline::WorkerThreadPlacement::set( ThreadPlacementOptions^ value )
+{
+	if( value != nullptr )
+	{
+		ThreadPlacement placement;
+		value->ToNative( &placement );
+
+		HRESULT hr = GetNative()->SetWorkerPlacement( placement );
+		if( FAILED( hr ) )
+			throw gcnew COMException( "Unable to apply the worker thread placement.", hr );
+	}
+
+	workerThreadPlacement = value;
+}
+#pragma endregion
+
+#pragma region SinkThunk
+FrameProcessingPipeline::SinkThunk::SinkThunk( FrameSinkHandler^ handler )
+{
+	this->handler = handler;
+}
+
+int FrameProcessingPipeline::SinkThunk::Invoke( IntPtr pFrame )
+{
+	PooledFrame^ frame = gcnew PooledFrame( static_cast<FrameBuffer*>( pFrame.ToPointer() ) );
+
+	// Exceptions must not unwind into the native worker threads
+	try
+	{
+		handler( frame );
+		return S_OK;
+	}
+	catch( Exception^ e )
+	{
+		return Marshal::GetHRForException( e );
+	}
+	finally
+	{
+		delete frame;
+	}
+}
+#pragma endregion
@@ -0,0 +1,247 @@
+//*****************************************************************************************
+//  File:       FrameProcessingPipeline.h
+//  Project:    WebcamLib
+//
+//  Declares the managed view of the native stage graph run over each captured frame
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+using namespace System::Collections::Generic;
+
+namespace WebCamLib
+{
+	class ProcessingPipeline;
+	class ProcessingStage;
+	ref class PooledFrame;
+	ref class PreEventBuffer;
+	ref class RemapOptions;
+	ref class ThreadPlacementOptions;
+
+	/// <summary>
+	/// What a pipeline stage is for
+	/// </summary>
+	public enum class PipelineStageKind : int
+	{
+		Convert = StageKind_Convert,
+		Transform = StageKind_Transform,
+		Analyse = StageKind_Analyse,
+		Sink = StageKind_Sink,
+	};
+
+	/// <summary>
+	/// Handles a frame at the end of a branch. The frame is only valid during the call; take
+	/// AddReference on it to keep it. Runs on the capture thread or a pipeline worker thread.
+	/// </summary>
+	public delegate void FrameSinkHandler( PooledFrame^ frame );
+
+	/// <summary>
+	/// Time one stage has taken so far
+	/// </summary>
+	public ref class PipelineStageTiming
+	{
+	internal:
+		PipelineStageTiming( String^ name, PipelineStageKind kind, int branch, bool fused, const StageTiming& timing );
+
+	public:
+		property String^ Name
+		{
+			String^ get();
+		}
+
+		property PipelineStageKind Kind
+		{
+			PipelineStageKind get();
+		}
+
+		property int Branch
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// True when the stage runs in one pass over the frame with the row-local stages next to it.
+		/// Its times are then those spent in it summed over the threads the pass ran on.
+		/// </summary>
+		property bool Fused
+		{
+			bool get();
+		}
+
+		property int FrameCount
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Frames the stage failed on; a failure in the main chain skips the frame
+		/// </summary>
+		property int Failures
+		{
+			int get();
+		}
+
+		property double AverageMilliseconds
+		{
+			double get();
+		}
+
+		property double MaximumMilliseconds
+		{
+			double get();
+		}
+
+		property double LastMilliseconds
+		{
+			double get();
+		}
+
+	private:
+		String^ name;
+		PipelineStageKind kind;
+		int branch;
+		bool fused;
+		int frameCount;
+		int failures;
+		double averageMilliseconds;
+		double maximumMilliseconds;
+		double lastMilliseconds;
+	};
+
+	/// <summary>
+	/// Stages declared once and run natively over every captured frame before it is delivered,
+	/// through CameraMethods.Pipeline. The main branch runs on the capture thread and its output
+	/// is the frame OnFrameCapture, the latest frame and the frame bus get. Branches added with
+	/// AddBranch start from that output and run in parallel with each other, each ending in a
+	/// sink, e.g. one feeding a recorder while another runs detection. Stages may be added while
+	/// the pipeline runs; they take effect from the next frame.
+	/// </summary>
+	public ref class FrameProcessingPipeline
+	{
+	public:
+		FrameProcessingPipeline();
+
+		/// <summary>
+		/// The branch whose output the camera delivers
+		/// </summary>
+		literal int MainBranch = 0;
+
+		/// <summary>
+		/// Adds a branch starting from the main branch's output and returns its number
+		/// </summary>
+		int AddBranch();
+
+		/// <summary>
+		/// Converts frames to 24 or 32 bits per pixel
+		/// </summary>
+		void AddConvert( int branch, int bitsPerPixel );
+
+		/// <summary>
+		/// Mirrors frames left to right, in place
+		/// </summary>
+		void AddMirror( int branch );
+
+		/// <summary>
+		/// Turns frames upside down, in place
+		/// </summary>
+		void AddFlip( int branch );
+
+		/// <summary>
+		/// Undistorts and rectifies frames into new ones of the same size and depth, sampling
+		/// bilinearly; pixels with nothing behind them are black. The lookup table is built on the
+		/// first frame and again only when the camera is started at another size. 24 and 32 bit frames only.
+		/// </summary>
+		void AddRemap( int branch, RemapOptions^ options );
+
+		/// <summary>
+		/// Averages sensor noise over frames, in place, for cameras run at a high gain. Each pixel is
+		/// blended into the average of the frames before it, more lightly the further it is from it:
+		/// differences up to noiseThreshold levels count as noise, and beyond that the frame is taken
+		/// more and more as it is, fully motionRange levels further on, so what moves does not smear.
+		/// Strength goes from 0, no averaging, to 1, still pixels averaged over about 30 frames.
+		/// Add it to the branch whose frames should be denoised, leaving the others as captured.
+		/// </summary>
+		void AddTemporalDenoise( int branch, double strength, int noiseThreshold, int motionRange );
+
+		/// <summary>
+		/// Steadies frames from a shaking camera. The shift of the image since the last frame is
+		/// found by block matching on a reduced luma plane, the camera's path is averaged over about
+		/// smoothingFrames frames, and each frame is shifted onto the averaged path and cropped by
+		/// margin, a fraction of its width and height up to 0.25, on every side. Frames come out
+		/// that much smaller; only translation is corrected. 24 and 32 bit frames only.
+		/// </summary>
+		void AddStabilisation( int branch, double margin, int smoothingFrames );
+
+		/// <summary>
+		/// Computes PooledFrame.Statistics, sampling every gridStep pixels in both directions
+		/// </summary>
+		void AddStatistics( int branch, int gridStep );
+
+		/// <summary>
+		/// Hands every frame reaching this point of the branch to a handler. An exception thrown
+		/// by the handler is counted as a failure of the stage.
+		/// </summary>
+		void AddSink( int branch, String^ name, FrameSinkHandler^ handler );
+
+		/// <summary>
+		/// Keeps every frame reaching this point of the branch in a pre-event buffer. Best put on a
+		/// branch of its own, so compressing frames runs alongside the other branches.
+		/// </summary>
+		void AddPreEventBuffer( int branch, PreEventBuffer^ buffer );
+
+		/// <summary>
+		/// Timings of every stage, in the order they were added
+		/// </summary>
+		array<PipelineStageTiming^>^ GetStageTimings();
+
+		void ResetTimings();
+
+		/// <summary>
+		/// Placement of the threads the branches run on. These belong to the pipeline, not to the
+		/// pool CameraMethods.WorkerThreadPlacement applies to.
+		/// </summary>
+		property ThreadPlacementOptions^ WorkerThreadPlacement
+		{
+			ThreadPlacementOptions^ get();
+			void set( ThreadPlacementOptions^ value );
+		}
+
+		~FrameProcessingPipeline();
+
+	internal:
+		/// <summary>
+		/// The native pipeline, without a reference of its own
+		/// </summary>
+		ProcessingPipeline* GetNative();
+
+	protected:
+		!FrameProcessingPipeline();
+
+	private:
+		/// <summary>
+		/// Native entry point of a sink, one per AddSink
+		/// </summary>
+		delegate int SinkCallbackDelegate( IntPtr pFrame );
+
+		ref class SinkThunk
+		{
+		public:
+			SinkThunk( FrameSinkHandler^ handler );
+
+			int Invoke( IntPtr pFrame );
+
+		private:
+			FrameSinkHandler^ handler;
+		};
+
+		void AddStage( int branch, ProcessingStage* pStage );
+
+		ProcessingPipeline* pPipeline;
+
+		// Keeps the sink delegates alive for as long as native code may call them
+		List<SinkCallbackDelegate^>^ sinkCallbacks;
+
+		ThreadPlacementOptions^ workerThreadPlacement;
+	};
+}
@@ -0,0 +1,466 @@
+//*****************************************************************************************
+//  File:       FrameRing.cpp
+//  Project:    WebcamLib
+//
+//  Defines the in-memory ring holding the last seconds of capture ahead of an event
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "FrameBuffer.h"
+#include "FrameRing.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+static DWORD AlignRecord(DWORD dwSize)
+{
+	return (dwSize + FRAMERING_ALIGNMENT - 1) & ~static_cast<DWORD>(FRAMERING_ALIGNMENT - 1);
+}
+
+#pragma region FrameRing
+FrameRing::FrameRing()
+{
+	m_nRefCount = 1;
+	InitializeCriticalSection(&m_cs);
+	InitializeCriticalSection(&m_csWrite);
+
+	m_pArena = NULL;
+	m_dwCapacity = 0;
+	m_llMaximumAge = 0;
+	m_eEncoding = FrameRingEncoding_Raw;
+
+	m_ullTail = 0;
+	m_ullHead = 0;
+	m_nFrames = 0;
+	m_nFramesWritten = 0;
+	m_nFramesTooLarge = 0;
+	m_llNewestTimestamp = 0;
+
+	m_hWritten = CreateEvent(NULL, TRUE, FALSE, NULL);
+}
+
+FrameRing::~FrameRing()
+{
+	if (m_pArena != NULL)
+	{
+		VirtualFree(m_pArena, 0, MEM_RELEASE);
+	}
+
+	if (m_hWritten != NULL)
+	{
+		CloseHandle(m_hWritten);
+	}
+
+	DeleteCriticalSection(&m_csWrite);
+	DeleteCriticalSection(&m_cs);
+}
+
+LONG FrameRing::AddRef()
+{
+	return InterlockedIncrement(&m_nRefCount);
+}
+
+LONG FrameRing::Release()
+{
+	LONG result = InterlockedDecrement(&m_nRefCount);
+
+	if (result == 0)
+	{
+		delete this;
+	}
+
+	return result;
+}
+
+HRESULT FrameRing::Create(DWORD dwCapacity, LONGLONG llMaximumAge, FrameRingEncoding eEncoding)
+{
+	if (m_pArena != NULL)
+		return HRESULT_FROM_WIN32(ERROR_ALREADY_INITIALIZED);
+
+	if (m_hWritten == NULL)
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	dwCapacity &= ~static_cast<DWORD>(FRAMERING_ALIGNMENT - 1);
+	if (dwCapacity < sizeof(FrameRingRecord) || llMaximumAge < 0)
+		return E_INVALIDARG;
+
+	// Committed once, so the ring never grows or shrinks with the frames it holds
+	m_pArena = static_cast<BYTE*>(VirtualAlloc(NULL, dwCapacity, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+	if (m_pArena == NULL)
+		return E_OUTOFMEMORY;
+
+	m_dwCapacity = dwCapacity;
+	m_llMaximumAge = llMaximumAge;
+	m_eEncoding = eEncoding;
+
+	return S_OK;
+}
+
+HRESULT FrameRing::Write(const FrameBuffer* pFrame)
+{
+	const BYTE* pTop = pFrame->GetData();
+	int nStride = pFrame->GetStride();
+
+	if (pFrame->IsBottomUp())
+	{
+		pTop += static_cast<ptrdiff_t>(pFrame->GetHeight() - 1) * nStride;
+		nStride = -nStride;
+	}
+
+	return Write(pTop, pFrame->GetWidth(), pFrame->GetHeight(), nStride, pFrame->GetBitsPerPixel(), pFrame->GetTimestamp(), pFrame->GetSampleTime());
+}
+
+HRESULT FrameRing::Write(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, LONGLONG llTimestamp, double dSampleTime)
+{
+	if (m_pArena == NULL)
+		return E_UNEXPECTED;
+
+	if (pTop == NULL || nWidth <= 0 || nHeight <= 0 || nBitsPerPixel <= 0)
+		return E_INVALIDARG;
+
+	FrameRingEncoding eEncoding = m_eEncoding == FrameRingEncoding_Lossless && (nBitsPerPixel == 24 || nBitsPerPixel == 32) ? FrameRingEncoding_Lossless : FrameRingEncoding_Raw;
+
+	ULONGLONG ullRowBytes = (static_cast<ULONGLONG>(nWidth) * nBitsPerPixel + 7) / 8;
+	ULONGLONG ullMaximumData = eEncoding == FrameRingEncoding_Raw ? ullRowBytes * nHeight : LosslessCodec::GetMaxEncodedSize(nWidth, nHeight);
+
+	if (sizeof(FrameRingRecord) + ullMaximumData > m_dwCapacity)
+	{
+		InterlockedIncrement(&m_nFramesTooLarge);
+		return S_FALSE;
+	}
+
+	DWORD dwReserve = AlignRecord(static_cast<DWORD>(sizeof(FrameRingRecord) + ullMaximumData));
+
+	EnterCriticalSection(&m_csWrite);
+
+	// Reserve room for the largest the frame can take, dropping the oldest frames to make it
+	EnterCriticalSection(&m_cs);
+
+	ULONGLONG ullStart = m_ullHead;
+	DWORD dwOffset = static_cast<DWORD>(ullStart % m_dwCapacity);
+	DWORD dwPadOffset = 0;
+	bool bPadMarker = false;
+
+	// A record never wraps; the end of the ring is skipped instead
+	if (dwOffset + dwReserve > m_dwCapacity)
+	{
+		bPadMarker = m_dwCapacity - dwOffset >= sizeof(FrameRingRecord);
+		dwPadOffset = dwOffset;
+		ullStart += m_dwCapacity - dwOffset;
+		dwOffset = 0;
+	}
+
+	while (m_ullTail < m_ullHead)
+	{
+		ULONGLONG ullRecord = SkipPadding(m_ullTail);
+		if (ullRecord >= m_ullHead)
+		{
+			m_ullTail = m_ullHead;
+			break;
+		}
+
+		const FrameRingRecord* pRecord = GetRecord(ullRecord);
+		bool bInTheWay = ullStart + dwReserve > ullRecord + m_dwCapacity;
+		bool bTooOld = m_llMaximumAge > 0 && llTimestamp - pRecord->llTimestamp > m_llMaximumAge;
+
+		if (!bInTheWay && !bTooOld)
+		{
+			m_ullTail = ullRecord;
+			break;
+		}
+
+		m_ullTail = ullRecord + pRecord->dwRecordSize;
+		m_nFrames--;
+	}
+
+	if (m_ullTail >= m_ullHead)
+	{
+		m_ullTail = ullStart;
+	}
+
+	if (bPadMarker)
+	{
+		reinterpret_cast<FrameRingRecord*>(m_pArena + dwPadOffset)->dwRecordSize = 0;
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	// Readers never look past the head, so the record is filled without holding them up
+	FrameRingRecord* pRecord = reinterpret_cast<FrameRingRecord*>(m_pArena + dwOffset);
+	BYTE* pData = reinterpret_cast<BYTE*>(pRecord + 1);
+	DWORD dwDataSize = 0;
+	HRESULT hr = S_OK;
+
+	if (eEncoding == FrameRingEncoding_Lossless)
+	{
+		hr = m_encoder.Encode(pTop, nWidth, nHeight, nStride, nBitsPerPixel, pData, static_cast<DWORD>(ullMaximumData), &dwDataSize);
+	}
+	else
+	{
+		for (int y = 0; y < nHeight; y++)
+		{
+			CopyMemory(pData + y * ullRowBytes, pTop + static_cast<ptrdiff_t>(y) * nStride, static_cast<SIZE_T>(ullRowBytes));
+		}
+
+		dwDataSize = static_cast<DWORD>(ullMaximumData);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		pRecord->dwRecordSize = AlignRecord(sizeof(FrameRingRecord) + dwDataSize);
+		pRecord->dwDataSize = dwDataSize;
+		pRecord->nEncoding = eEncoding;
+		pRecord->nWidth = nWidth;
+		pRecord->nHeight = nHeight;
+		pRecord->nBitsPerPixel = nBitsPerPixel;
+		pRecord->nReserved = 0;
+		pRecord->llTimestamp = llTimestamp;
+		pRecord->dSampleTime = dSampleTime;
+
+		EnterCriticalSection(&m_cs);
+
+		pRecord->nSequence = m_nFramesWritten++;
+		m_ullHead = ullStart + pRecord->dwRecordSize;
+		m_nFrames++;
+		m_llNewestTimestamp = llTimestamp;
+
+		SetEvent(m_hWritten);
+
+		LeaveCriticalSection(&m_cs);
+	}
+
+	LeaveCriticalSection(&m_csWrite);
+
+	return hr;
+}
+
+ULONGLONG FrameRing::GetOldestPosition()
+{
+	EnterCriticalSection(&m_cs);
+	ULONGLONG result = m_ullTail;
+	LeaveCriticalSection(&m_cs);
+
+	return result;
+}
+
+HRESULT FrameRing::Peek(ULONGLONG ullPosition, FrameRingFrame* pFrame)
+{
+	HRESULT hr = S_FALSE;
+
+	EnterCriticalSection(&m_cs);
+
+	if (ullPosition < m_ullTail)
+	{
+		ullPosition = m_ullTail;
+	}
+
+	if (ullPosition < m_ullHead)
+	{
+		ullPosition = SkipPadding(ullPosition);
+	}
+
+	if (ullPosition < m_ullHead)
+	{
+		pFrame->record = *GetRecord(ullPosition);
+		pFrame->ullPosition = ullPosition;
+		pFrame->ullNext = ullPosition + pFrame->record.dwRecordSize;
+		hr = S_OK;
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return hr;
+}
+
+bool FrameRing::WaitForFrame(ULONGLONG ullPosition, DWORD dwMilliseconds)
+{
+	DWORD dwStart = GetTickCount();
+
+	for (;;)
+	{
+		EnterCriticalSection(&m_cs);
+
+		bool bWritten = m_ullHead > ullPosition;
+		if (!bWritten)
+		{
+			// Writers set it under the same lock, so nothing written from here on is missed
+			ResetEvent(m_hWritten);
+		}
+
+		LeaveCriticalSection(&m_cs);
+
+		if (bWritten)
+			return true;
+
+		DWORD dwElapsed = GetTickCount() - dwStart;
+		if (dwMilliseconds != INFINITE && dwElapsed >= dwMilliseconds)
+			return false;
+
+		WaitForSingleObject(m_hWritten, dwMilliseconds == INFINITE ? INFINITE : dwMilliseconds - dwElapsed);
+	}
+}
+
+HRESULT FrameRing::CopyData(const FrameRingFrame& frame, BYTE* pDestination)
+{
+	if (!IsHeld(frame.ullPosition))
+		return S_FALSE;
+
+	CopyMemory(pDestination, GetRecord(frame.ullPosition) + 1, frame.record.dwDataSize);
+
+	// The writer drops a frame before it overwrites it, so one still held was copied whole
+	return IsHeld(frame.ullPosition) ? S_OK : S_FALSE;
+}
+
+HRESULT FrameRing::CopyRows(const FrameRingFrame& frame, BYTE* pTop, int nStride)
+{
+	if (frame.record.nEncoding != FrameRingEncoding_Raw)
+		return E_INVALIDARG;
+
+	if (!IsHeld(frame.ullPosition))
+		return S_FALSE;
+
+	const BYTE* pData = reinterpret_cast<const BYTE*>(GetRecord(frame.ullPosition) + 1);
+	SIZE_T nRowBytes = frame.record.dwDataSize / frame.record.nHeight;
+
+	for (int y = 0; y < frame.record.nHeight; y++)
+	{
+		CopyMemory(pTop + static_cast<ptrdiff_t>(y) * nStride, pData + y * nRowBytes, nRowBytes);
+	}
+
+	return IsHeld(frame.ullPosition) ? S_OK : S_FALSE;
+}
+
+void FrameRing::GetStatus(FrameRingStatus* pStatus)
+{
+	EnterCriticalSection(&m_cs);
+
+	pStatus->dwCapacity = m_dwCapacity;
+	pStatus->dwBytesUsed = static_cast<DWORD>(m_ullHead - m_ullTail);
+	pStatus->nFrames = m_nFrames;
+	pStatus->nFramesWritten = m_nFramesWritten;
+	pStatus->nFramesTooLarge = m_nFramesTooLarge;
+	pStatus->llNewestTimestamp = m_llNewestTimestamp;
+	pStatus->llOldestTimestamp = m_nFrames > 0 ? GetRecord(SkipPadding(m_ullTail))->llTimestamp : m_llNewestTimestamp;
+
+	LeaveCriticalSection(&m_cs);
+}
+
+const FrameRingRecord* FrameRing::GetRecord(ULONGLONG ullPosition) const
+{
+	return reinterpret_cast<const FrameRingRecord*>(m_pArena + ullPosition % m_dwCapacity);
+}
+
+/// <summary>
+/// Moves a position at the padding before the end of the ring on to the start of the next lap
+/// </summary>
+ULONGLONG FrameRing::SkipPadding(ULONGLONG ullPosition) const
+{
+	DWORD dwOffset = static_cast<DWORD>(ullPosition % m_dwCapacity);
+
+	if (m_dwCapacity - dwOffset < sizeof(FrameRingRecord) || GetRecord(ullPosition)->dwRecordSize == 0)
+		return ullPosition + (m_dwCapacity - dwOffset);
+
+	return ullPosition;
+}
+
+bool FrameRing::IsHeld(ULONGLONG ullPosition)
+{
+	EnterCriticalSection(&m_cs);
+	bool result = ullPosition >= m_ullTail;
+	LeaveCriticalSection(&m_cs);
+
+	return result;
+}
+#pragma endregion
+
+#pragma region FrameRingReader
+FrameRingReader::FrameRingReader(FrameRing* pRing)
+{
+	m_pRing = pRing;
+	m_pRing->AddRef();
+
+	m_ullPosition = m_pRing->GetOldestPosition();
+	m_bHasCurrent = false;
+	m_nNextSequence = -1;
+	m_nLost = 0;
+}
+
+FrameRingReader::~FrameRingReader()
+{
+	m_pRing->Release();
+}
+
+bool FrameRingReader::MoveNext(DWORD dwMilliseconds)
+{
+	ULONGLONG ullPosition = m_bHasCurrent ? m_current.ullNext : m_ullPosition;
+
+	if (m_pRing->Peek(ullPosition, &m_current) != S_OK)
+	{
+		if (!m_pRing->WaitForFrame(ullPosition, dwMilliseconds) || m_pRing->Peek(ullPosition, &m_current) != S_OK)
+		{
+			m_ullPosition = ullPosition;
+			m_bHasCurrent = false;
+			return false;
+		}
+	}
+
+	// Peek moves on past frames dropped while this reader was behind; the sequence tells how many
+	if (m_nNextSequence != -1 && m_current.record.nSequence > m_nNextSequence)
+	{
+		m_nLost += m_current.record.nSequence - m_nNextSequence;
+	}
+
+	m_nNextSequence = m_current.record.nSequence + 1;
+	m_bHasCurrent = true;
+
+	return true;
+}
+
+HRESULT FrameRingReader::Decode(BYTE* pTop, int nStride)
+{
+	if (!m_bHasCurrent || pTop == NULL)
+		return E_UNEXPECTED;
+
+	HRESULT hr;
+
+	if (m_current.record.nEncoding == FrameRingEncoding_Raw)
+	{
+		hr = m_pRing->CopyRows(m_current, pTop, nStride);
+	}
+	else
+	{
+		if (m_aEncoded.size() < m_current.record.dwDataSize)
+		{
+			m_aEncoded.resize(m_current.record.dwDataSize);
+		}
+
+		hr = m_pRing->CopyData(m_current, &m_aEncoded[0]);
+
+		if (hr == S_OK)
+		{
+			// The data was copied whole, but check it decodes to the image the caller sized
+			LosslessFrameHeader header;
+			if (!LosslessCodec::ReadHeader(&m_aEncoded[0], m_current.record.dwDataSize, &header) ||
+				header.nWidth != m_current.record.nWidth || header.nHeight != m_current.record.nHeight || header.wBitsPerPixel != m_current.record.nBitsPerPixel)
+			{
+				hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+			}
+			else
+			{
+				hr = m_decoder.Decode(&m_aEncoded[0], m_current.record.dwDataSize, pTop, nStride);
+			}
+		}
+	}
+
+	if (hr == S_FALSE)
+	{
+		m_nLost++;
+	}
+
+	return hr;
+}
+#pragma endregion
+
+#pragma managed(pop)
@@ -0,0 +1,218 @@
+//*****************************************************************************************
+//  File:       FrameRing.h
+//  Project:    WebcamLib
+//
+//  Declares the in-memory ring holding the last seconds of capture ahead of an event
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#include "LosslessCodec.h"
+
+#pragma managed(push, off)
+
+// Records start on this boundary
+#define FRAMERING_ALIGNMENT		8
+
+namespace WebCamLib
+{
+	class FrameBuffer;
+
+	enum FrameRingEncoding
+	{
+		FrameRingEncoding_Raw,
+		FrameRingEncoding_Lossless,		// 24 and 32 bit frames only; others are kept raw
+	};
+
+	/// <summary>
+	/// Header of a record in the ring, followed by its data. Rows are always stored top down.
+	/// A dwRecordSize of 0 marks the rest of the ring as padding, as does an end too short for a header.
+	/// </summary>
+	struct FrameRingRecord
+	{
+		DWORD dwRecordSize;			// bytes to the next record, header included
+		DWORD dwDataSize;
+		LONG nSequence;				// frames written before this one
+		int nEncoding;
+		int nWidth;
+		int nHeight;
+		int nBitsPerPixel;
+		int nReserved;
+		LONGLONG llTimestamp;		// QueryPerformanceCounter on arrival
+		double dSampleTime;
+	};
+
+	/// <summary>
+	/// A frame as a reader sees it: a copy of the record header and where it is in the ring.
+	/// Positions count bytes written over the life of the ring, so they never repeat.
+	/// </summary>
+	struct FrameRingFrame
+	{
+		ULONGLONG ullPosition;
+		ULONGLONG ullNext;
+		FrameRingRecord record;
+	};
+
+	struct FrameRingStatus
+	{
+		DWORD dwCapacity;
+		DWORD dwBytesUsed;
+		LONG nFrames;
+		LONG nFramesWritten;
+		LONG nFramesTooLarge;
+		LONGLONG llOldestTimestamp;
+		LONGLONG llNewestTimestamp;
+	};
+
+	/// <summary>
+	/// Keeps the most recent frames, raw or compressed, in one block of memory allocated up front.
+	/// Writing drops the oldest frames to make room, and those older than the maximum age, so the
+	/// ring holds as many seconds as fit whatever the resolution. A writer never waits on readers:
+	/// a frame overwritten while it is read is reported lost to its reader instead.
+	/// The ring is reference counted.
+	/// </summary>
+	class FrameRing
+	{
+	public:
+		FrameRing();
+
+		LONG AddRef();
+		LONG Release();
+
+		/// <summary>
+		/// Allocates dwCapacity bytes; llMaximumAge is in QueryPerformanceCounter ticks, 0 for no limit
+		/// </summary>
+		HRESULT Create(DWORD dwCapacity, LONGLONG llMaximumAge, FrameRingEncoding eEncoding);
+
+		/// <summary>
+		/// Stores a frame; S_FALSE when it would not fit even in the empty ring
+		/// </summary>
+		HRESULT Write(const FrameBuffer* pFrame);
+
+		/// <summary>
+		/// Stores an image given by its top row and the signed offset to the row below
+		/// </summary>
+		HRESULT Write(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, LONGLONG llTimestamp, double dSampleTime);
+
+		/// <summary>
+		/// Position of the oldest frame held, or where the next one goes when the ring is empty
+		/// </summary>
+		ULONGLONG GetOldestPosition();
+
+		/// <summary>
+		/// Finds the first frame held at or after a position; S_FALSE when none has been written there yet
+		/// </summary>
+		HRESULT Peek(ULONGLONG ullPosition, FrameRingFrame* pFrame);
+
+		/// <summary>
+		/// Waits until something is written at or after a position; false on timeout
+		/// </summary>
+		bool WaitForFrame(ULONGLONG ullPosition, DWORD dwMilliseconds);
+
+		/// <summary>
+		/// Copies the data of a frame out as stored, dwDataSize bytes; S_FALSE when it was
+		/// overwritten before the copy completed
+		/// </summary>
+		HRESULT CopyData(const FrameRingFrame& frame, BYTE* pDestination);
+
+		/// <summary>
+		/// Copies the rows of a raw frame into an image given by its top row and row offset
+		/// </summary>
+		HRESULT CopyRows(const FrameRingFrame& frame, BYTE* pTop, int nStride);
+
+		void GetStatus(FrameRingStatus* pStatus);
+
+	private:
+		FrameRing(const FrameRing&);
+		FrameRing& operator=(const FrameRing&);
+
+		~FrameRing();
+
+		const FrameRingRecord* GetRecord(ULONGLONG ullPosition) const;
+		ULONGLONG SkipPadding(ULONGLONG ullPosition) const;
+		bool IsHeld(ULONGLONG ullPosition);
+
+		volatile LONG m_nRefCount;
+
+		// Guards the positions and counters; never held while data is written or read
+		CRITICAL_SECTION m_cs;
+
+		// Lets one writer at a time reserve and fill a record
+		CRITICAL_SECTION m_csWrite;
+
+		BYTE* m_pArena;
+		DWORD m_dwCapacity;
+		LONGLONG m_llMaximumAge;
+		FrameRingEncoding m_eEncoding;
+
+		// Frames held are those from m_ullTail up to m_ullHead
+		ULONGLONG m_ullTail;
+		ULONGLONG m_ullHead;
+		LONG m_nFrames;
+		LONG m_nFramesWritten;
+		LONG m_nFramesTooLarge;
+		LONGLONG m_llNewestTimestamp;
+
+		// Set after every write, for readers waiting on the live end
+		HANDLE m_hWritten;
+
+		LosslessCodec m_encoder;
+	};
+
+	/// <summary>
+	/// Walks a ring from the oldest frame it held when opened on into the frames written after,
+	/// e.g. to record the seconds before an event and what follows. Use one per thread.
+	/// </summary>
+	class FrameRingReader
+	{
+	public:
+		explicit FrameRingReader(FrameRing* pRing);
+		~FrameRingReader();
+
+		/// <summary>
+		/// Moves to the next frame, waiting up to dwMilliseconds for one to be written
+		/// </summary>
+		bool MoveNext(DWORD dwMilliseconds);
+
+		/// <summary>
+		/// The frame MoveNext moved to
+		/// </summary>
+		const FrameRingRecord& GetCurrent() const
+		{
+			return m_current.record;
+		}
+
+		/// <summary>
+		/// Decodes the current frame into an image of its size and depth, given by its top row and
+		/// row offset; S_FALSE when it was overwritten first, in which case it is counted lost
+		/// </summary>
+		HRESULT Decode(BYTE* pTop, int nStride);
+
+		/// <summary>
+		/// Frames dropped from the ring before they could be read
+		/// </summary>
+		LONG GetLostCount() const
+		{
+			return m_nLost;
+		}
+
+	private:
+		FrameRingReader(const FrameRingReader&);
+		FrameRingReader& operator=(const FrameRingReader&);
+
+		FrameRing* m_pRing;
+		ULONGLONG m_ullPosition;
+		FrameRingFrame m_current;
+		bool m_bHasCurrent;
+		LONG m_nNextSequence;
+		LONG m_nLost;
+
+		// Encoded data is copied out before it is decoded, so a writer cannot change it halfway
+		std::vector<BYTE> m_aEncoded;
+		LosslessCodec m_decoder;
+	};
+}
+
+#pragma managed(pop)
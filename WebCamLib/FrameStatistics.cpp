@@ -0,0 +1,106 @@
+//*****************************************************************************************
+//  File:       FrameStatistics.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed view of the per-frame image statistics
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "ImageStatistics.h"
+#include "FrameStatistics.h"
+
+using namespace WebCamLib;
+
+FrameStatistics::FrameStatistics( const ImageStatistics& statistics )
+{
+	sampleCount = static_cast<int>( statistics.dwSamples );
+	meanLuma = statistics.dMeanLuma;
+	lumaVariance = statistics.dLumaVariance;
+	meanRed = statistics.dMeanRed;
+	meanGreen = statistics.dMeanGreen;
+	meanBlue = statistics.dMeanBlue;
+	darkClipRatio = statistics.dDarkClipRatio;
+	brightClipRatio = statistics.dBrightClipRatio;
+	sharpness = statistics.dSharpness;
+
+	lumaHistogram = CopyHistogram( statistics.adwLumaHistogram );
+	redHistogram = CopyHistogram( statistics.adwRedHistogram );
+	greenHistogram = CopyHistogram( statistics.adwGreenHistogram );
+	blueHistogram = CopyHistogram( statistics.adwBlueHistogram );
+}
+
+array<int>^ FrameStatistics::CopyHistogram( const DWORD* pHistogram )
+{
+	array<int>^ result = gcnew array<int>( 256 );
+
+	pin_ptr<int> pResult = &result[0];
+	memcpy( pResult, pHistogram, 256 * sizeof( DWORD ) );
+
+	return result;
+}
+
+int FrameStatistics::SampleCount::get()
+{
+	return sampleCount;
+}
+
+double FrameStatistics::MeanLuma::get()
+{
+	return meanLuma;
+}
+
+double FrameStatistics::LumaVariance::get()
+{
+	return lumaVariance;
+}
+
+double FrameStatistics::MeanRed::get()
+{
+	return meanRed;
+}
+
+double FrameStatistics::MeanGreen::get()
+{
+	return meanGreen;
+}
+
+double FrameStatistics::MeanBlue::get()
+{
+	return meanBlue;
+}
+
+double FrameStatistics::DarkClipRatio::get()
+{
+	return darkClipRatio;
+}
+
+double FrameStatistics::BrightClipRatio::get()
+{
+	return brightClipRatio;
+}
+
+double FrameStatistics::Sharpness::get()
+{
+	return sharpness;
+}
+
+array<int>^ FrameStatistics::GetLumaHistogram()
+{
+	return static_cast<array<int>^>( lumaHistogram->Clone() );
+}
+
+array<int>^ FrameStatistics::GetRedHistogram()
+{
+	return static_cast<array<int>^>( redHistogram->Clone() );
+}
+
+array<int>^ FrameStatistics::GetGreenHistogram()
+{
+	return static_cast<array<int>^>( greenHistogram->Clone() );
+}
+
+array<int>^ FrameStatistics::GetBlueHistogram()
+{
+	return static_cast<array<int>^>( blueHistogram->Clone() );
+}
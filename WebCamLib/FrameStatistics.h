@@ -0,0 +1,101 @@
+//*****************************************************************************************
+//  File:       FrameStatistics.h
+//  Project:    WebcamLib
+//
+//  Declares the managed view of the per-frame image statistics
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+
+namespace WebCamLib
+{
+	struct ImageStatistics;
+
+	/// <summary>
+	/// Histograms, means, clipping and sharpness of a captured frame, computed once in the native layer
+	/// </summary>
+	public ref class FrameStatistics
+	{
+	internal:
+		FrameStatistics( const ImageStatistics& statistics );
+
+	public:
+		/// <summary>
+		/// Number of pixels sampled to build the statistics
+		/// </summary>
+		property int SampleCount
+		{
+			int get();
+		}
+
+		property double MeanLuma
+		{
+			double get();
+		}
+
+		property double LumaVariance
+		{
+			double get();
+		}
+
+		property double MeanRed
+		{
+			double get();
+		}
+
+		property double MeanGreen
+		{
+			double get();
+		}
+
+		property double MeanBlue
+		{
+			double get();
+		}
+
+		/// <summary>
+		/// Share of the samples crushed to black
+		/// </summary>
+		property double DarkClipRatio
+		{
+			double get();
+		}
+
+		/// <summary>
+		/// Share of the samples blown out to white
+		/// </summary>
+		property double BrightClipRatio
+		{
+			double get();
+		}
+
+		/// <summary>
+		/// Variance of the Laplacian of the luma samples; higher is sharper
+		/// </summary>
+		property double Sharpness
+		{
+			double get();
+		}
+
+		array<int>^ GetLumaHistogram();
+
+		array<int>^ GetRedHistogram();
+
+		array<int>^ GetGreenHistogram();
+
+		array<int>^ GetBlueHistogram();
+
+	private:
+		static array<int>^ CopyHistogram( const DWORD* pHistogram );
+
+		int sampleCount;
+		double meanLuma, lumaVariance, meanRed, meanGreen, meanBlue;
+		double darkClipRatio, brightClipRatio, sharpness;
+		array<int>^ lumaHistogram;
+		array<int>^ redHistogram;
+		array<int>^ greenHistogram;
+		array<int>^ blueHistogram;
+	};
+}
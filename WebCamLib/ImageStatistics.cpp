@@ -0,0 +1,174 @@
+//*****************************************************************************************
+//  File:       ImageStatistics.cpp
+//  Project:    WebcamLib
+//
+//  Defines the native per-frame image statistics kernel
+//*****************************************************************************************
+
+#include <windows.h>
+#include <emmintrin.h>
+
+#include "ImageStatistics.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+ImageStatisticsCalculator::ImageStatisticsCalculator()
+{
+	m_nGridStep = 4;
+	m_bDarkClip = 2;
+	m_bBrightClip = 253;
+}
+
+bool ImageStatisticsCalculator::Compute(const BYTE* pBits, int nWidth, int nHeight, int nStride, int nBitsPerPixel, ImageStatistics* pStats)
+{
+	ZeroMemory(pStats, sizeof(ImageStatistics));
+
+	if (pBits == NULL || nWidth <= 0 || nHeight <= 0 || (nBitsPerPixel != 24 && nBitsPerPixel != 32))
+		return false;
+
+	const int nBytesPerPixel = nBitsPerPixel / 8;
+	const int nColumns = (nWidth + m_nGridStep - 1) / m_nGridStep;
+	const int nPadded = (nColumns + 7) & ~7;
+
+	// Padding lanes stay zero so the vector loops never need a scalar tail for conversion
+	m_aChannels.assign(nPadded * 3, 0);
+	m_aLuma.assign(nPadded * 3, 0);
+
+	short* pRed = &m_aChannels[0];
+	short* pGreen = pRed + nPadded;
+	short* pBlue = pGreen + nPadded;
+
+	const __m128i redWeight = _mm_set1_epi16(77);
+	const __m128i greenWeight = _mm_set1_epi16(150);
+	const __m128i blueWeight = _mm_set1_epi16(29);
+	const __m128i rounding = _mm_set1_epi16(128);
+	const __m128i four = _mm_set1_epi16(4);
+	const __m128i ones = _mm_set1_epi16(1);
+
+	long long llLaplacianSum = 0;
+	long long llLaplacianSquares = 0;
+	long long llLaplacianSamples = 0;
+	int nRows = 0;
+
+	for (int y = 0; y < nHeight; y += m_nGridStep, nRows++)
+	{
+		const BYTE* pLine = pBits + static_cast<ptrdiff_t>(y) * nStride;
+
+		for (int i = 0; i < nColumns; i++)
+		{
+			const BYTE* pPixel = pLine + i * m_nGridStep * nBytesPerPixel;
+			pBlue[i] = pPixel[0];
+			pGreen[i] = pPixel[1];
+			pRed[i] = pPixel[2];
+
+			pStats->adwBlueHistogram[pPixel[0]]++;
+			pStats->adwGreenHistogram[pPixel[1]]++;
+			pStats->adwRedHistogram[pPixel[2]]++;
+		}
+
+		// BT.601 luma in 8.8 fixed point; the largest intermediate still fits an unsigned 16 bit lane
+		short* pLuma = &m_aLuma[(nRows % 3) * nPadded];
+		for (int i = 0; i < nPadded; i += 8)
+		{
+			__m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRed + i));
+			__m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pGreen + i));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBlue + i));
+
+			__m128i luma = _mm_add_epi16(_mm_mullo_epi16(r, redWeight), _mm_mullo_epi16(g, greenWeight));
+			luma = _mm_add_epi16(luma, _mm_mullo_epi16(b, blueWeight));
+			luma = _mm_srli_epi16(_mm_add_epi16(luma, rounding), 8);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pLuma + i), luma);
+		}
+
+		for (int i = 0; i < nColumns; i++)
+		{
+			pStats->adwLumaHistogram[pLuma[i]]++;
+		}
+
+		// Once three rows are in the ring, take the Laplacian of the middle one
+		if (nRows >= 2 && nColumns >= 3)
+		{
+			const short* pUp = &m_aLuma[((nRows - 2) % 3) * nPadded];
+			const short* pCentre = &m_aLuma[((nRows - 1) % 3) * nPadded];
+			const short* pDown = pLuma;
+
+			__m128i sum = _mm_setzero_si128();
+			__m128i squares = _mm_setzero_si128();
+
+			int i = 1;
+			for (; i + 8 <= nColumns - 1; i += 8)
+			{
+				__m128i centre = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCentre + i));
+				__m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCentre + i - 1));
+				__m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCentre + i + 1));
+				__m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pUp + i));
+				__m128i down = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDown + i));
+
+				__m128i laplacian = _mm_mullo_epi16(centre, four);
+				laplacian = _mm_sub_epi16(laplacian, _mm_add_epi16(left, right));
+				laplacian = _mm_sub_epi16(laplacian, _mm_add_epi16(up, down));
+
+				sum = _mm_add_epi32(sum, _mm_madd_epi16(laplacian, ones));
+				squares = _mm_add_epi32(squares, _mm_madd_epi16(laplacian, laplacian));
+			}
+
+			// Per row partial sums stay well inside 32 bits; fold them into 64 bits here
+			int anSum[4], anSquares[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(anSum), sum);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(anSquares), squares);
+			llLaplacianSum += static_cast<long long>(anSum[0]) + anSum[1] + anSum[2] + anSum[3];
+			llLaplacianSquares += static_cast<long long>(static_cast<unsigned int>(anSquares[0])) + static_cast<unsigned int>(anSquares[1])
+				+ static_cast<unsigned int>(anSquares[2]) + static_cast<unsigned int>(anSquares[3]);
+
+			for (; i < nColumns - 1; i++)
+			{
+				int nLaplacian = 4 * pCentre[i] - pCentre[i - 1] - pCentre[i + 1] - pUp[i] - pDown[i];
+				llLaplacianSum += nLaplacian;
+				llLaplacianSquares += nLaplacian * nLaplacian;
+			}
+
+			llLaplacianSamples += nColumns - 2;
+		}
+	}
+
+	pStats->dwSamples = static_cast<DWORD>(nRows) * nColumns;
+
+	double dSamples = pStats->dwSamples;
+	double dLumaSum = 0.0, dLumaSquares = 0.0, dRedSum = 0.0, dGreenSum = 0.0, dBlueSum = 0.0;
+	DWORD dwDark = 0, dwBright = 0;
+
+	for (int v = 0; v < 256; v++)
+	{
+		dLumaSum += static_cast<double>(v) * pStats->adwLumaHistogram[v];
+		dLumaSquares += static_cast<double>(v) * v * pStats->adwLumaHistogram[v];
+		dRedSum += static_cast<double>(v) * pStats->adwRedHistogram[v];
+		dGreenSum += static_cast<double>(v) * pStats->adwGreenHistogram[v];
+		dBlueSum += static_cast<double>(v) * pStats->adwBlueHistogram[v];
+
+		if (v <= m_bDarkClip)
+			dwDark += pStats->adwLumaHistogram[v];
+		if (v >= m_bBrightClip)
+			dwBright += pStats->adwLumaHistogram[v];
+	}
+
+	pStats->dMeanLuma = dLumaSum / dSamples;
+	pStats->dLumaVariance = dLumaSquares / dSamples - pStats->dMeanLuma * pStats->dMeanLuma;
+	pStats->dMeanRed = dRedSum / dSamples;
+	pStats->dMeanGreen = dGreenSum / dSamples;
+	pStats->dMeanBlue = dBlueSum / dSamples;
+	pStats->dDarkClipRatio = dwDark / dSamples;
+	pStats->dBrightClipRatio = dwBright / dSamples;
+
+	if (llLaplacianSamples > 0)
+	{
+		double dMean = static_cast<double>(llLaplacianSum) / llLaplacianSamples;
+		pStats->dSharpness = static_cast<double>(llLaplacianSquares) / llLaplacianSamples - dMean * dMean;
+	}
+
+	return true;
+}
+
+#pragma managed(pop)
@@ -0,0 +1,80 @@
+//*****************************************************************************************
+//  File:       ImageStatistics.h
+//  Project:    WebcamLib
+//
+//  Declares the native per-frame image statistics kernel
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// Histograms and summary figures of one frame, gathered on a subsampled grid
+	/// </summary>
+	struct ImageStatistics
+	{
+		DWORD adwLumaHistogram[256];
+		DWORD adwRedHistogram[256];
+		DWORD adwGreenHistogram[256];
+		DWORD adwBlueHistogram[256];
+		DWORD dwSamples;
+		double dMeanLuma;
+		double dLumaVariance;
+		double dMeanRed;
+		double dMeanGreen;
+		double dMeanBlue;
+		double dDarkClipRatio;		// share of samples with luma at or below the dark clip level
+		double dBrightClipRatio;	// share of samples with luma at or above the bright clip level
+		double dSharpness;			// variance of the Laplacian of the luma grid
+	};
+
+	/// <summary>
+	/// Computes ImageStatistics from 24 or 32 bit BGR frames.
+	/// Only every n-th pixel of every n-th row is visited; the samples are deinterleaved into
+	/// planar rows so luma conversion and the Laplacian run eight samples at a time with SSE2.
+	/// </summary>
+	class ImageStatisticsCalculator
+	{
+	public:
+		ImageStatisticsCalculator();
+
+		/// <summary>
+		/// Distance in pixels between samples, both horizontally and vertically
+		/// </summary>
+		void SetGridStep(int nGridStep)
+		{
+			m_nGridStep = nGridStep < 1 ? 1 : nGridStep;
+		}
+
+		int GetGridStep() const
+		{
+			return m_nGridStep;
+		}
+
+		void SetClipLevels(BYTE bDark, BYTE bBright)
+		{
+			m_bDarkClip = bDark;
+			m_bBrightClip = bBright;
+		}
+
+		/// <summary>
+		/// Fills pStats; returns false for formats other than 24 and 32 bits per pixel
+		/// </summary>
+		bool Compute(const BYTE* pBits, int nWidth, int nHeight, int nStride, int nBitsPerPixel, ImageStatistics* pStats);
+
+	private:
+		int m_nGridStep;
+		BYTE m_bDarkClip;
+		BYTE m_bBrightClip;
+
+		std::vector<short> m_aChannels;	// planar red, green and blue samples of the current row
+		std::vector<short> m_aLuma;		// three rows of luma samples, used as a ring
+	};
+}
+
+#pragma managed(pop)
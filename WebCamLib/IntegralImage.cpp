@@ -0,0 +1,154 @@
+//*****************************************************************************************
+//  File:       IntegralImage.cpp
+//  Project:    WebcamLib
+//
+//  Defines the summed area tables sliding window detectors sum rectangles with
+//*****************************************************************************************
+
+#include <windows.h>
+#include <emmintrin.h>
+
+#include "IntegralImage.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Sums are kept in 32 bits, which 255 times this many pixels still fits, as do the
+// squares of a row this wide
+#define INTEGRAL_MAXIMUM_PIXELS		(8 * 1024 * 1024)
+#define INTEGRAL_MAXIMUM_WIDTH		65535
+
+namespace
+{
+	// Running sums of four 32 bit lanes, continuing from the last lane of carry
+	inline __m128i PrefixSum(__m128i values, __m128i& carry)
+	{
+		values = _mm_add_epi32(values, _mm_slli_si128(values, 4));
+		values = _mm_add_epi32(values, _mm_slli_si128(values, 8));
+		values = _mm_add_epi32(values, carry);
+		carry = _mm_shuffle_epi32(values, _MM_SHUFFLE(3, 3, 3, 3));
+		return values;
+	}
+
+	inline void StoreSums(int* pRow, const int* pAbove, __m128i sums)
+	{
+		__m128i above = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pAbove));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow), _mm_add_epi32(sums, above));
+	}
+
+	// The row's running sums of squares fit 32 bits unsigned; they are widened for the table
+	inline void StoreSquares(LONGLONG* pRow, const LONGLONG* pAbove, __m128i sums)
+	{
+		const __m128i zero = _mm_setzero_si128();
+
+		__m128i low = _mm_add_epi64(_mm_unpacklo_epi32(sums, zero), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pAbove)));
+		__m128i high = _mm_add_epi64(_mm_unpackhi_epi32(sums, zero), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pAbove + 2)));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow), low);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + 2), high);
+	}
+}
+
+IntegralImage::IntegralImage()
+{
+	m_nWidth = 0;
+	m_nHeight = 0;
+	m_bSquares = false;
+}
+
+HRESULT IntegralImage::Build(const BYTE* pTop, int nWidth, int nHeight, int nStride, bool bSquares)
+{
+	if (nWidth <= 0 || nHeight <= 0 || nWidth > INTEGRAL_MAXIMUM_WIDTH || static_cast<LONGLONG>(nWidth) * nHeight > INTEGRAL_MAXIMUM_PIXELS)
+		return E_INVALIDARG;
+
+	int nTableStride = nWidth + 1;
+	size_t cEntries = static_cast<size_t>(nTableStride) * (nHeight + 1);
+
+	m_nWidth = nWidth;
+	m_nHeight = nHeight;
+	m_bSquares = bSquares;
+
+	if (m_anSums.size() < cEntries)
+	{
+		m_anSums.resize(cEntries);
+	}
+
+	if (bSquares && m_allSquares.size() < cEntries)
+	{
+		m_allSquares.resize(cEntries);
+	}
+
+	// Nothing lies above the first row or left of the first column
+	ZeroMemory(&m_anSums[0], nTableStride * sizeof(int));
+	if (bSquares)
+	{
+		ZeroMemory(&m_allSquares[0], nTableStride * sizeof(LONGLONG));
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+
+	for (int y = 0; y < nHeight; y++)
+	{
+		const BYTE* pSource = pTop + static_cast<ptrdiff_t>(y) * nStride;
+
+		int* pSums = &m_anSums[static_cast<size_t>(y + 1) * nTableStride];
+		const int* pSumsAbove = pSums - nTableStride;
+		pSums[0] = 0;
+		pSums++;
+		pSumsAbove++;
+
+		LONGLONG* pSquares = NULL;
+		const LONGLONG* pSquaresAbove = NULL;
+		if (bSquares)
+		{
+			pSquares = &m_allSquares[static_cast<size_t>(y + 1) * nTableStride];
+			pSquaresAbove = pSquares - nTableStride;
+			pSquares[0] = 0;
+			pSquares++;
+			pSquaresAbove++;
+		}
+
+		__m128i carry = zero;
+		__m128i carrySquares = zero;
+
+		int x = 0;
+		for (; x + 8 <= nWidth; x += 8)
+		{
+			__m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pSource + x)), zero);
+
+			StoreSums(pSums + x, pSumsAbove + x, PrefixSum(_mm_unpacklo_epi16(pixels, zero), carry));
+			StoreSums(pSums + x + 4, pSumsAbove + x + 4, PrefixSum(_mm_unpackhi_epi16(pixels, zero), carry));
+
+			if (bSquares)
+			{
+				// 255 squared still fits 16 bits unsigned
+				__m128i squares = _mm_mullo_epi16(pixels, pixels);
+
+				StoreSquares(pSquares + x, pSquaresAbove + x, PrefixSum(_mm_unpacklo_epi16(squares, zero), carrySquares));
+				StoreSquares(pSquares + x + 4, pSquaresAbove + x + 4, PrefixSum(_mm_unpackhi_epi16(squares, zero), carrySquares));
+			}
+		}
+
+		int nRowSum = _mm_cvtsi128_si32(carry);
+		DWORD dwRowSquares = static_cast<DWORD>(_mm_cvtsi128_si32(carrySquares));
+
+		for (; x < nWidth; x++)
+		{
+			int nPixel = pSource[x];
+
+			nRowSum += nPixel;
+			pSums[x] = pSumsAbove[x] + nRowSum;
+
+			if (bSquares)
+			{
+				dwRowSquares += nPixel * nPixel;
+				pSquares[x] = pSquaresAbove[x] + dwRowSquares;
+			}
+		}
+	}
+
+	return S_OK;
+}
+
+#pragma managed(pop)
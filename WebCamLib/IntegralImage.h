@@ -0,0 +1,74 @@
+//*****************************************************************************************
+//  File:       IntegralImage.h
+//  Project:    WebcamLib
+//
+//  Declares the summed area tables sliding window detectors sum rectangles with
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// Integral and squared integral of an 8 bit grey image: entry (x, y) holds the sum of the
+	/// pixels, or of their squares, above and left of pixel (x, y), so the tables are a row and a
+	/// column larger than the image and any rectangle sums with four lookups. Built with SSE2
+	/// into buffers kept from one image to the next.
+	/// </summary>
+	class IntegralImage
+	{
+	public:
+		IntegralImage();
+
+		/// <summary>
+		/// Builds the tables for an image given by its top row and the signed offset to the row below;
+		/// the squares are only built when asked for. Images of up to 8 million pixels and 65535 across.
+		/// </summary>
+		HRESULT Build(const BYTE* pTop, int nWidth, int nHeight, int nStride, bool bSquares);
+
+		int GetWidth() const
+		{
+			return m_nWidth;
+		}
+
+		int GetHeight() const
+		{
+			return m_nHeight;
+		}
+
+		/// <summary>
+		/// Entries from one row of the tables to the next, nWidth + 1
+		/// </summary>
+		int GetStride() const
+		{
+			return m_nWidth + 1;
+		}
+
+		const int* GetSums() const
+		{
+			return &m_anSums[0];
+		}
+
+		/// <summary>
+		/// NULL when the last Build left the squares out
+		/// </summary>
+		const LONGLONG* GetSquares() const
+		{
+			return m_bSquares ? &m_allSquares[0] : NULL;
+		}
+
+	private:
+		int m_nWidth;
+		int m_nHeight;
+		bool m_bSquares;
+
+		std::vector<int> m_anSums;
+		std::vector<LONGLONG> m_allSquares;
+	};
+}
+
+#pragma managed(pop)
@@ -0,0 +1,125 @@
+//*****************************************************************************************
+//  File:       LatestFrameSlot.cpp
+//  Project:    WebcamLib
+//
+//  Defines the lock-free hand-over of the newest captured frame to any number of readers
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "LatestFrameSlot.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Next value of the latest word: generation moved on by one, wrapping quietly, pointing at nSlot
+static LONG NextLatest(LONG nLatest, int nSlot)
+{
+	ULONG ulGeneration = (static_cast<ULONG>(nLatest) & ~static_cast<ULONG>(3)) + 4;
+
+	return static_cast<LONG>(ulGeneration | nSlot);
+}
+
+LatestFrameSlot::LatestFrameSlot()
+{
+	m_nLatest = NO_SLOT;
+	m_nDropped = 0;
+
+	for (int n = 0; n < SLOT_COUNT; n++)
+	{
+		m_anPins[n] = 0;
+		m_apFrames[n] = NULL;
+	}
+}
+
+LatestFrameSlot::~LatestFrameSlot()
+{
+	Clear();
+}
+
+bool LatestFrameSlot::Publish(FrameBuffer* pFrame)
+{
+	LONG nLatest = m_nLatest;
+	int nCurrent = nLatest & SLOT_MASK;
+
+	// Any slot but the latest one is free once no reader has it pinned. A pin taken after this
+	// check belongs to a reader which will see the generation move on and let go again.
+	int nSlot = NO_SLOT;
+	for (int n = 0; n < SLOT_COUNT && nSlot == NO_SLOT; n++)
+	{
+		if (n != nCurrent && m_anPins[n] == 0)
+			nSlot = n;
+	}
+
+	if (nSlot == NO_SLOT)
+	{
+		InterlockedIncrement(&m_nDropped);
+		return false;
+	}
+
+	FrameBuffer* pPrevious = m_apFrames[nSlot];
+
+	pFrame->AddRef();
+	m_apFrames[nSlot] = pFrame;
+
+	// The interlocked exchange is a full barrier, so readers never see the index before the frame
+	InterlockedExchange(&m_nLatest, NextLatest(nLatest, nSlot));
+
+	if (pPrevious != NULL)
+		pPrevious->Release();
+
+	return true;
+}
+
+FrameBuffer* LatestFrameSlot::Acquire()
+{
+	FrameBuffer* result = NULL;
+
+	for (;;)
+	{
+		LONG nLatest = m_nLatest;
+		int nSlot = nLatest & SLOT_MASK;
+
+		if (nSlot == NO_SLOT)
+			break;
+
+		InterlockedIncrement(&m_anPins[nSlot]);
+
+		// Unchanged generation: the slot was the latest one from before the pin until now, so
+		// the producer cannot have touched it, and the pin keeps it from doing so from here on
+		if (InterlockedCompareExchange(&m_nLatest, nLatest, nLatest) == nLatest)
+		{
+			result = m_apFrames[nSlot];
+			result->AddRef();
+		}
+
+		InterlockedDecrement(&m_anPins[nSlot]);
+
+		if (result != NULL)
+			break;
+	}
+
+	return result;
+}
+
+void LatestFrameSlot::Clear()
+{
+	LONG nLatest = m_nLatest;
+	InterlockedExchange(&m_nLatest, NextLatest(nLatest, NO_SLOT));
+
+	for (int n = 0; n < SLOT_COUNT; n++)
+	{
+		// Readers hold a pin for a handful of instructions only
+		while (m_anPins[n] != 0)
+			YieldProcessor();
+
+		if (m_apFrames[n] != NULL)
+		{
+			m_apFrames[n]->Release();
+			m_apFrames[n] = NULL;
+		}
+	}
+}
+
+#pragma managed(pop)
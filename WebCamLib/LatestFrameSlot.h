@@ -0,0 +1,73 @@
+//*****************************************************************************************
+//  File:       LatestFrameSlot.h
+//  Project:    WebcamLib
+//
+//  Declares the lock-free hand-over of the newest captured frame to any number of readers
+//*****************************************************************************************
+
+#pragma once
+
+#include "FrameBuffer.h"
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// Triple-buffered slot holding a reference on the newest complete frame.
+	/// The single producer publishes into a slot that is neither the latest one nor pinned by a
+	/// reader, so it never waits. Readers pin the latest slot, check that nothing was published
+	/// in between, and leave with a reference of their own rather than a copy. A reader tries again
+	/// when a publish slipped in, so readers are lock-free rather than wait-free: one only repeats
+	/// because the producer made progress.
+	/// </summary>
+	class LatestFrameSlot
+	{
+	public:
+		LatestFrameSlot();
+		~LatestFrameSlot();
+
+		/// <summary>
+		/// Producer side: makes the frame the latest one and takes a reference on it.
+		/// Returns false, without blocking, when readers had every spare slot pinned; the
+		/// previous frame then stays the latest one.
+		/// </summary>
+		bool Publish(FrameBuffer* pFrame);
+
+		/// <summary>
+		/// Returns the newest frame with a reference the caller must Release, or NULL when empty
+		/// </summary>
+		FrameBuffer* Acquire();
+
+		/// <summary>
+		/// Drops every held frame. Must not run concurrently with Publish.
+		/// </summary>
+		void Clear();
+
+		/// <summary>
+		/// Frames Publish had to drop because no slot was free
+		/// </summary>
+		LONG GetDroppedCount() const
+		{
+			return m_nDropped;
+		}
+
+	private:
+		enum
+		{
+			SLOT_COUNT = 3,
+			NO_SLOT = 3,
+			SLOT_MASK = 3
+		};
+
+		// Low bits hold the latest slot, the rest a generation bumped by every publish
+		volatile LONG m_nLatest;
+
+		volatile LONG m_anPins[SLOT_COUNT];
+		FrameBuffer* volatile m_apFrames[SLOT_COUNT];
+
+		volatile LONG m_nDropped;
+	};
+}
+
+#pragma managed(pop)
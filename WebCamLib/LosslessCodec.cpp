@@ -0,0 +1,573 @@
+//*****************************************************************************************
+//  File:       LosslessCodec.cpp
+//  Project:    WebcamLib
+//
+//  Defines the lossless intra-frame codec used to record raw camera frames
+//*****************************************************************************************
+
+#include <windows.h>
+#include <intrin.h>
+#include <emmintrin.h>
+
+#include "LosslessCodec.h"
+#include "WorkerPool.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Residuals per Rice block, and the bits spent on each block's parameter
+#define RICE_BLOCK			16
+#define RICE_PARAMETER_BITS	3
+#define RICE_MAX_PARAMETER	7
+
+// Quotients from this on are escaped: that many one bits, then the residual verbatim
+#define RICE_ESCAPE			12
+
+// Widest code: the escape, or a quotient just below it with the largest parameter
+#define RICE_MAX_CODE_BITS	(RICE_ESCAPE + 8)
+
+// Rows decoded and reconstructed at a time; a whole number of Rice blocks at any width, and
+// small enough for the strip's residuals to stay in cache
+#define DECODE_STRIP_ROWS	RICE_BLOCK
+
+namespace
+{
+	/// <summary>
+	/// Appends codes least significant bit first. Every put stores a whole 32 bit word and only
+	/// moves on once it is full, so there is no branch to mispredict; the destination must have
+	/// room for the longest possible stream plus one word.
+	/// </summary>
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(BYTE* pStart)
+		{
+			m_pNext = pStart;
+			m_ullBits = 0;
+			m_nBits = 0;
+		}
+
+		// At most 32 bits at once
+		__forceinline void Put(DWORD dwValue, int nBits)
+		{
+			m_ullBits |= static_cast<ULONGLONG>(dwValue) << m_nBits;
+			m_nBits += nBits;
+
+			DWORD dwWord = static_cast<DWORD>(m_ullBits);
+			CopyMemory(m_pNext, &dwWord, sizeof(DWORD));
+
+			int nFull = m_nBits >> 5;
+			m_pNext += nFull * sizeof(DWORD);
+			m_ullBits >>= nFull * 32;
+			m_nBits &= 31;
+		}
+
+		/// <summary>
+		/// Stores the bits of the last, partial word; returns the end of the stream
+		/// </summary>
+		BYTE* Flush()
+		{
+			DWORD dwWord = static_cast<DWORD>(m_ullBits);
+			CopyMemory(m_pNext, &dwWord, sizeof(DWORD));
+
+			return m_pNext + (m_nBits + 7) / 8;
+		}
+
+	private:
+		BYTE* m_pNext;
+		ULONGLONG m_ullBits;
+		int m_nBits;
+	};
+
+	/// <summary>
+	/// Reads what BitWriter wrote through a 64 bit buffer, topped up with one unaligned load and
+	/// no branch on the number of bits left. Past the end of the stream it reads zeros, so a
+	/// damaged frame decodes to garbage but never reads out of bounds.
+	/// </summary>
+	class BitReader
+	{
+	public:
+		BitReader(const BYTE* pStart, const BYTE* pEnd)
+		{
+			m_pStart = pStart;
+			m_cbLength = pEnd - pStart;
+			m_nNext = 0;
+			m_ullBits = 0;
+			m_nBits = 0;
+		}
+
+		/// <summary>
+		/// Buffers at least 56 bits. Bytes already partly buffered are loaded again, which ORs in
+		/// the same bits.
+		/// </summary>
+		__forceinline void Refill()
+		{
+			ULONGLONG ullWord = 0;
+
+			if (m_nNext + sizeof(ULONGLONG) <= m_cbLength)
+			{
+				CopyMemory(&ullWord, m_pStart + m_nNext, sizeof(ULONGLONG));
+			}
+			else
+			{
+				for (size_t n = m_nNext; n < m_cbLength; n++)
+					ullWord |= static_cast<ULONGLONG>(m_pStart[n]) << ((n - m_nNext) * 8);
+			}
+
+			m_ullBits |= ullWord << m_nBits;
+			m_nNext += (63 - m_nBits) >> 3;
+			m_nBits |= 56;
+		}
+
+		// The next 32 bits, of which only as many as were refilled and not skipped are valid
+		__forceinline DWORD Peek() const
+		{
+			return static_cast<DWORD>(m_ullBits);
+		}
+
+		__forceinline void Skip(int nBits)
+		{
+			m_ullBits >>= nBits;
+			m_nBits -= nBits;
+		}
+
+	private:
+		const BYTE* m_pStart;
+		size_t m_cbLength;
+		size_t m_nNext;
+		ULONGLONG m_ullBits;
+		int m_nBits;
+	};
+
+	// The median edge detector is the median of a, b and a + b - c; written that way it needs no branches
+	__forceinline BYTE PredictMed(int a, int b, int c)
+	{
+		int nMin = a < b ? a : b;
+		int nMax = a < b ? b : a;
+		int nGradient = a + b - c;
+
+		nMax = nGradient < nMax ? nGradient : nMax;
+
+		return static_cast<BYTE>(nMin > nMax ? nMin : nMax);
+	}
+
+	// Small residuals of either sign to small codes: 0, -1, 1, -2, 2, ... become 0, 1, 2, 3, 4, ...
+	__forceinline BYTE ZigZag(BYTE bResidual)
+	{
+		return static_cast<BYTE>((bResidual << 1) ^ (static_cast<signed char>(bResidual) >> 7));
+	}
+
+	__forceinline BYTE UnZigZag(BYTE bCode)
+	{
+		return static_cast<BYTE>((bCode >> 1) ^ (0 - (bCode & 1)));
+	}
+
+	__forceinline __m128i Select(__m128i mask, __m128i a, __m128i b)
+	{
+		return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+	}
+
+	/// <summary>
+	/// Zigzagged median prediction residuals of a row. The first column is predicted from the
+	/// pixel above; pPrevious is a row of zeros for the first row.
+	/// </summary>
+	void PredictRow(const BYTE* pCurrent, const BYTE* pPrevious, int nWidth, BYTE* pResiduals)
+	{
+		pResiduals[0] = ZigZag(static_cast<BYTE>(pCurrent[0] - pPrevious[0]));
+
+		const __m128i zero = _mm_setzero_si128();
+
+		// Every input is known up front when encoding, so whole vectors predict at once
+		int x = 1;
+		for (; x + 16 <= nWidth; x += 16)
+		{
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCurrent + x - 1));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPrevious + x));
+			__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPrevious + x - 1));
+			__m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCurrent + x));
+
+			__m128i minimum = _mm_min_epu8(a, b);
+			__m128i maximum = _mm_max_epu8(a, b);
+			__m128i cAtLeastMaximum = _mm_cmpeq_epi8(_mm_max_epu8(c, maximum), c);
+			__m128i cAtMostMinimum = _mm_cmpeq_epi8(_mm_min_epu8(c, minimum), c);
+
+			// Between the two a + b - c stays in range, so byte arithmetic wrapping is harmless
+			__m128i prediction = _mm_sub_epi8(_mm_add_epi8(a, b), c);
+			prediction = Select(cAtMostMinimum, maximum, prediction);
+			prediction = Select(cAtLeastMaximum, minimum, prediction);
+
+			__m128i residual = _mm_sub_epi8(value, prediction);
+			__m128i code = _mm_xor_si128(_mm_add_epi8(residual, residual), _mm_cmpgt_epi8(zero, residual));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pResiduals + x), code);
+		}
+
+		for (; x < nWidth; x++)
+			pResiduals[x] = ZigZag(static_cast<BYTE>(pCurrent[x] - PredictMed(pCurrent[x - 1], pPrevious[x], pPrevious[x - 1])));
+	}
+
+	void ReconstructRow(const BYTE* pResiduals, const BYTE* pPrevious, int nWidth, BYTE* pCurrent)
+	{
+		// Each pixel is predicted from the one before, so carry it in a register rather than
+		// reading back the byte just stored
+		int a = static_cast<BYTE>(pPrevious[0] + UnZigZag(pResiduals[0]));
+		int c = pPrevious[0];
+		pCurrent[0] = static_cast<BYTE>(a);
+
+		for (int x = 1; x < nWidth; x++)
+		{
+			int b = pPrevious[x];
+
+			a = static_cast<BYTE>(PredictMed(a, b, c) + UnZigZag(pResiduals[x]));
+			pCurrent[x] = static_cast<BYTE>(a);
+			c = b;
+		}
+	}
+
+	void EncodeResiduals(const BYTE* pResiduals, DWORD dwCount, BitWriter& writer)
+	{
+		const __m128i zero = _mm_setzero_si128();
+
+		for (DWORD i = 0; i < dwCount; i += RICE_BLOCK)
+		{
+			const BYTE* pBlock = pResiduals + i;
+			DWORD dwBlock = dwCount - i < RICE_BLOCK ? dwCount - i : RICE_BLOCK;
+			DWORD dwSum = 0;
+
+			if (dwBlock == RICE_BLOCK)
+			{
+				__m128i sums = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pBlock)), zero);
+				dwSum = _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+			}
+			else
+			{
+				for (DWORD n = 0; n < dwBlock; n++)
+					dwSum += pBlock[n];
+			}
+
+			// Smallest parameter whose divisor reaches the block's mean
+			int k = 0;
+			while (k < RICE_MAX_PARAMETER && (dwBlock << k) < dwSum)
+				k++;
+
+			writer.Put(k, RICE_PARAMETER_BITS);
+
+			DWORD dwMask = (1 << k) - 1;
+			for (DWORD n = 0; n < dwBlock; n++)
+			{
+				DWORD dwValue = pBlock[n];
+				DWORD dwQuotient = dwValue >> k;
+
+				// Quotient in unary as one bits ending in a zero, then the remainder
+				if (dwQuotient < RICE_ESCAPE)
+					writer.Put(((dwValue & dwMask) << (dwQuotient + 1)) | ((1 << dwQuotient) - 1), dwQuotient + 1 + k);
+				else
+					writer.Put((dwValue << RICE_ESCAPE) | ((1 << RICE_ESCAPE) - 1), RICE_ESCAPE + 8);
+			}
+		}
+	}
+
+	// One residual, which takes at most RICE_MAX_CODE_BITS of those buffered
+	__forceinline BYTE DecodeResidual(BitReader& reader, int k, DWORD dwMask)
+	{
+		DWORD dwBits = reader.Peek();
+
+		unsigned long ulQuotient;
+		if (!_BitScanForward(&ulQuotient, ~dwBits))
+			ulQuotient = 32;
+
+		if (ulQuotient < RICE_ESCAPE)
+		{
+			reader.Skip(ulQuotient + 1 + k);
+			return static_cast<BYTE>((ulQuotient << k) | ((dwBits >> (ulQuotient + 1)) & dwMask));
+		}
+
+		reader.Skip(RICE_ESCAPE + 8);
+		return static_cast<BYTE>(dwBits >> RICE_ESCAPE);
+	}
+
+	void DecodeResiduals(BitReader& reader, DWORD dwCount, BYTE* pResiduals)
+	{
+		for (DWORD i = 0; i < dwCount; i += RICE_BLOCK)
+		{
+			BYTE* pBlock = pResiduals + i;
+			DWORD dwBlock = dwCount - i < RICE_BLOCK ? dwCount - i : RICE_BLOCK;
+
+			reader.Refill();
+			int k = reader.Peek() & ((1 << RICE_PARAMETER_BITS) - 1);
+			reader.Skip(RICE_PARAMETER_BITS);
+
+			DWORD dwMask = (1 << k) - 1;
+			DWORD n = 0;
+
+			// A refill leaves room for two of the widest codes
+			for (; n + 2 <= dwBlock; n += 2)
+			{
+				reader.Refill();
+				pBlock[n] = DecodeResidual(reader, k, dwMask);
+				pBlock[n + 1] = DecodeResidual(reader, k, dwMask);
+			}
+
+			if (n < dwBlock)
+			{
+				reader.Refill();
+				pBlock[n] = DecodeResidual(reader, k, dwMask);
+			}
+		}
+	}
+}
+
+LosslessCodec::LosslessCodec()
+{
+	m_pPool = NULL;
+	m_apPlanes[0] = m_apPlanes[1] = m_apPlanes[2] = NULL;
+	m_pResiduals = NULL;
+	m_pZeroRow = NULL;
+}
+
+// Longest bit stream of a plane, in bytes
+static ULONGLONG GetMaxPlaneSize(ULONGLONG ullSamples)
+{
+	ULONGLONG ullBits = ullSamples * RICE_MAX_CODE_BITS + ((ullSamples + RICE_BLOCK - 1) / RICE_BLOCK) * RICE_PARAMETER_BITS;
+
+	return (ullBits + 7) / 8;
+}
+
+// Shortest bit stream of a plane, in bytes: every residual takes at least the one bit ending its quotient
+static ULONGLONG GetMinPlaneSize(ULONGLONG ullSamples)
+{
+	ULONGLONG ullBits = ullSamples + ((ullSamples + RICE_BLOCK - 1) / RICE_BLOCK) * RICE_PARAMETER_BITS;
+
+	return (ullBits + 7) / 8;
+}
+
+DWORD LosslessCodec::GetMaxEncodedSize(int nWidth, int nHeight)
+{
+	if (nWidth <= 0 || nHeight <= 0)
+		return sizeof(LosslessFrameHeader);
+
+	// BitWriter stores whole words, so the last one may reach past the end of the stream
+	ULONGLONG ullSamples = static_cast<ULONGLONG>(nWidth) * nHeight;
+	ULONGLONG ullSize = sizeof(LosslessFrameHeader) + 3 * GetMaxPlaneSize(ullSamples) + sizeof(DWORD);
+
+	return ullSize < MAXDWORD ? static_cast<DWORD>(ullSize) : MAXDWORD;
+}
+
+bool LosslessCodec::ReadHeader(const BYTE* pSource, DWORD dwLength, LosslessFrameHeader* pHeader)
+{
+	if (pSource == NULL || dwLength < sizeof(LosslessFrameHeader))
+		return false;
+
+	CopyMemory(pHeader, pSource, sizeof(LosslessFrameHeader));
+
+	if (pHeader->dwMagic != LOSSLESS_MAGIC || pHeader->wVersion != LOSSLESS_VERSION ||
+		(pHeader->wBitsPerPixel != 24 && pHeader->wBitsPerPixel != 32) ||
+		pHeader->nWidth <= 0 || pHeader->nHeight <= 0 ||
+		pHeader->nWidth > LOSSLESS_MAX_SIDE || pHeader->nHeight > LOSSLESS_MAX_SIDE)
+		return false;
+
+	ULONGLONG ullStreams = static_cast<ULONGLONG>(pHeader->adwPlaneSize[0]) + pHeader->adwPlaneSize[1] + pHeader->adwPlaneSize[2];
+
+	if (ullStreams > dwLength - sizeof(LosslessFrameHeader))
+		return false;
+
+	// A stream too short for the size claimed means the size is wrong; checked before anything is reserved for it
+	ULONGLONG ullMinPlaneSize = GetMinPlaneSize(static_cast<ULONGLONG>(pHeader->nWidth) * pHeader->nHeight);
+
+	for (int n = 0; n < 3; n++)
+	{
+		if (pHeader->adwPlaneSize[n] < ullMinPlaneSize)
+			return false;
+	}
+
+	return true;
+}
+
+void LosslessCodec::Reserve(int nWidth, int nHeight)
+{
+	size_t cbPlane = static_cast<size_t>(nWidth) * nHeight;
+	size_t cbStrips = 3 * static_cast<size_t>(nWidth) * DECODE_STRIP_ROWS;
+	size_t cbTotal = 3 * cbPlane + max(cbPlane, cbStrips) + nWidth;
+
+	if (m_aPlanes.size() < cbTotal)
+		m_aPlanes.resize(cbTotal);
+
+	BYTE* pStart = &m_aPlanes[0];
+
+	for (int n = 0; n < 3; n++)
+		m_apPlanes[n] = pStart + n * cbPlane;
+
+	m_pResiduals = pStart + 3 * cbPlane;
+	m_pZeroRow = m_pResiduals + max(cbPlane, cbStrips);
+
+	ZeroMemory(m_pZeroRow, nWidth);
+}
+
+HRESULT LosslessCodec::Encode(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, BYTE* pDestination, DWORD dwCapacity, DWORD* pdwSize)
+{
+	if (pTop == NULL || pDestination == NULL || pdwSize == NULL || nWidth <= 0 || nHeight <= 0 ||
+		nWidth > LOSSLESS_MAX_SIDE || nHeight > LOSSLESS_MAX_SIDE || (nBitsPerPixel != 24 && nBitsPerPixel != 32))
+		return E_INVALIDARG;
+
+	*pdwSize = 0;
+
+	Reserve(nWidth, nHeight);
+
+	// Colour decorrelation: green, then red and blue as differences from it, all modulo 256
+	const int nBytesPerPixel = nBitsPerPixel / 8;
+	for (int y = 0; y < nHeight; y++)
+	{
+		const BYTE* pLine = pTop + static_cast<ptrdiff_t>(y) * nStride;
+		size_t nOffset = static_cast<size_t>(y) * nWidth;
+		BYTE* pGreen = m_apPlanes[0] + nOffset;
+		BYTE* pRed = m_apPlanes[1] + nOffset;
+		BYTE* pBlue = m_apPlanes[2] + nOffset;
+
+		for (int x = 0; x < nWidth; x++, pLine += nBytesPerPixel)
+		{
+			BYTE bGreen = pLine[1];
+			pGreen[x] = bGreen;
+			pRed[x] = static_cast<BYTE>(pLine[2] - bGreen);
+			pBlue[x] = static_cast<BYTE>(pLine[0] - bGreen);
+		}
+	}
+
+	LosslessFrameHeader header;
+	header.dwMagic = LOSSLESS_MAGIC;
+	header.wVersion = LOSSLESS_VERSION;
+	header.wBitsPerPixel = static_cast<WORD>(nBitsPerPixel);
+	header.nWidth = nWidth;
+	header.nHeight = nHeight;
+
+	BYTE* pNext = pDestination + sizeof(LosslessFrameHeader);
+	BYTE* pEnd = pDestination + dwCapacity;
+	DWORD dwSamples = static_cast<DWORD>(nWidth) * nHeight;
+
+	for (int n = 0; n < 3; n++)
+	{
+		const BYTE* pPlane = m_apPlanes[n];
+
+		for (int y = 0; y < nHeight; y++)
+		{
+			const BYTE* pCurrent = pPlane + static_cast<size_t>(y) * nWidth;
+			const BYTE* pPrevious = y > 0 ? pCurrent - nWidth : m_pZeroRow;
+
+			PredictRow(pCurrent, pPrevious, nWidth, m_pResiduals + static_cast<size_t>(y) * nWidth);
+		}
+
+		// The writer does not check as it goes, so make sure the worst case fits before starting
+		if (static_cast<ULONGLONG>(pEnd - pNext) < GetMaxPlaneSize(dwSamples) + sizeof(DWORD))
+			return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+
+		BitWriter writer(pNext);
+		EncodeResiduals(m_pResiduals, dwSamples, writer);
+		BYTE* pPlaneEnd = writer.Flush();
+
+		header.adwPlaneSize[n] = static_cast<DWORD>(pPlaneEnd - pNext);
+		pNext = pPlaneEnd;
+	}
+
+	CopyMemory(pDestination, &header, sizeof(LosslessFrameHeader));
+	*pdwSize = static_cast<DWORD>(pNext - pDestination);
+
+	return S_OK;
+}
+
+HRESULT LosslessCodec::Decode(const BYTE* pSource, DWORD dwLength, BYTE* pTop, int nStride)
+{
+	LosslessFrameHeader header;
+
+	if (pTop == NULL)
+		return E_INVALIDARG;
+
+	if (!ReadHeader(pSource, dwLength, &header))
+		return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+	const int nWidth = header.nWidth;
+	const int nHeight = header.nHeight;
+
+	Reserve(nWidth, nHeight);
+
+	DecodeContext context;
+	context.pCodec = this;
+	context.nWidth = nWidth;
+	context.nHeight = nHeight;
+
+	const BYTE* pNext = pSource + sizeof(LosslessFrameHeader);
+
+	for (int n = 0; n < 3; n++)
+	{
+		context.apStreams[n] = pNext;
+		context.adwStreamSizes[n] = header.adwPlaneSize[n];
+		pNext += header.adwPlaneSize[n];
+	}
+
+	// The planes' streams are byte aligned and coded independently, so each is a work item of its own
+	if (m_pPool != NULL)
+	{
+		m_pPool->Run(DecodePlaneProc, &context, 3);
+	}
+	else
+	{
+		for (int n = 0; n < 3; n++)
+			DecodePlane(context, n);
+	}
+
+	const int nBytesPerPixel = header.wBitsPerPixel / 8;
+	for (int y = 0; y < nHeight; y++)
+	{
+		BYTE* pLine = pTop + static_cast<ptrdiff_t>(y) * nStride;
+		size_t nOffset = static_cast<size_t>(y) * nWidth;
+		const BYTE* pGreen = m_apPlanes[0] + nOffset;
+		const BYTE* pRed = m_apPlanes[1] + nOffset;
+		const BYTE* pBlue = m_apPlanes[2] + nOffset;
+
+		for (int x = 0; x < nWidth; x++, pLine += nBytesPerPixel)
+		{
+			BYTE bGreen = pGreen[x];
+			pLine[0] = static_cast<BYTE>(pBlue[x] + bGreen);
+			pLine[1] = bGreen;
+			pLine[2] = static_cast<BYTE>(pRed[x] + bGreen);
+
+			if (nBytesPerPixel == 4)
+				pLine[3] = 0xFF;
+		}
+	}
+
+	return S_OK;
+}
+
+void LosslessCodec::DecodePlaneProc(void* pContext, int nItem)
+{
+	const DecodeContext* pDecode = static_cast<const DecodeContext*>(pContext);
+
+	pDecode->pCodec->DecodePlane(*pDecode, nItem);
+}
+
+void LosslessCodec::DecodePlane(const DecodeContext& context, int nPlane)
+{
+	const int nWidth = context.nWidth;
+	const int nHeight = context.nHeight;
+
+	BitReader reader(context.apStreams[nPlane], context.apStreams[nPlane] + context.adwStreamSizes[nPlane]);
+	BYTE* pPlane = m_apPlanes[nPlane];
+	BYTE* pResiduals = m_pResiduals + static_cast<size_t>(nPlane) * nWidth * DECODE_STRIP_ROWS;
+
+	for (int nTop = 0; nTop < nHeight; nTop += DECODE_STRIP_ROWS)
+	{
+		int nRows = min(DECODE_STRIP_ROWS, nHeight - nTop);
+
+		DecodeResiduals(reader, static_cast<DWORD>(nRows) * nWidth, pResiduals);
+
+		for (int y = nTop; y < nTop + nRows; y++)
+		{
+			BYTE* pCurrent = pPlane + static_cast<size_t>(y) * nWidth;
+			const BYTE* pPrevious = y > 0 ? pCurrent - nWidth : m_pZeroRow;
+
+			ReconstructRow(pResiduals + static_cast<size_t>(y - nTop) * nWidth, pPrevious, nWidth, pCurrent);
+		}
+	}
+}
+
+#pragma managed(pop)
@@ -0,0 +1,113 @@
+//*****************************************************************************************
+//  File:       LosslessCodec.h
+//  Project:    WebcamLib
+//
+//  Declares the lossless intra-frame codec used to record raw camera frames
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+#define LOSSLESS_MAGIC		0x43534C4C	// "LLSC"
+#define LOSSLESS_VERSION	1
+
+// Widest and tallest frame the codec takes
+#define LOSSLESS_MAX_SIDE	16384
+
+namespace WebCamLib
+{
+	class WorkerPool;
+
+	/// <summary>
+	/// Start of an encoded frame. The bit streams of the three planes follow in order, each
+	/// byte aligned, so a decoder may also take them on separate threads.
+	/// </summary>
+	struct LosslessFrameHeader
+	{
+		DWORD dwMagic;
+		WORD wVersion;
+		WORD wBitsPerPixel;
+		int nWidth;
+		int nHeight;
+		DWORD adwPlaneSize[3];
+	};
+
+	/// <summary>
+	/// Lossless codec for 24 and 32 bit RGB frames, built to keep up with capture on one core.
+	/// Colour is decorrelated to G, R-G and B-G; each plane is predicted with the LOCO-I median
+	/// edge detector, and the residuals Rice coded in blocks of 16 whose parameter is picked from
+	/// the block's sum. Prediction and block sums run on SSE2. Decoding is the same in reverse,
+	/// a strip of rows at a time, with the three planes on a worker pool when one is set.
+	/// The unused byte of 32 bit pixels is not kept and decodes as 0xFF.
+	/// An instance keeps its scratch planes between frames; use one per thread.
+	/// </summary>
+	class LosslessCodec
+	{
+	public:
+		LosslessCodec();
+
+		/// <summary>
+		/// Upper bound of an encoded frame, for sizing the destination
+		/// </summary>
+		static DWORD GetMaxEncodedSize(int nWidth, int nHeight);
+
+		/// <summary>
+		/// Validates and copies out the header of an encoded frame. The size it gives is within
+		/// LOSSLESS_MAX_SIDE and no larger than the plane streams that follow could hold, so a
+		/// damaged header cannot have the decoder reserve more than a small multiple of its input.
+		/// </summary>
+		static bool ReadHeader(const BYTE* pSource, DWORD dwLength, LosslessFrameHeader* pHeader);
+
+		/// <summary>
+		/// Encodes an image given by its top row and the signed offset to the row below.
+		/// The destination should hold GetMaxEncodedSize bytes; whether a smaller one suffices is
+		/// only known once the first planes are coded.
+		/// </summary>
+		HRESULT Encode(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, BYTE* pDestination, DWORD dwCapacity, DWORD* pdwSize);
+
+		/// <summary>
+		/// Decodes into an image of the encoded size and depth, given by its top row and row offset
+		/// </summary>
+		HRESULT Decode(const BYTE* pSource, DWORD dwLength, BYTE* pTop, int nStride);
+
+		/// <summary>
+		/// Pool used to decode the three planes in parallel, NULL to decode them on the calling thread
+		/// </summary>
+		void SetWorkerPool(WorkerPool* pPool)
+		{
+			m_pPool = pPool;
+		}
+
+	private:
+		struct DecodeContext
+		{
+			LosslessCodec* pCodec;
+			const BYTE* apStreams[3];
+			DWORD adwStreamSizes[3];
+			int nWidth;
+			int nHeight;
+		};
+
+		LosslessCodec(const LosslessCodec&);
+		LosslessCodec& operator=(const LosslessCodec&);
+
+		static void DecodePlaneProc(void* pContext, int nItem);
+
+		void Reserve(int nWidth, int nHeight);
+		void DecodePlane(const DecodeContext& context, int nPlane);
+
+		WorkerPool* m_pPool;
+
+		// G, R-G and B-G planes, then the residuals of the plane being encoded, or of a strip of
+		// each plane being decoded, then a row of zeros standing in for the row above the first one
+		std::vector<BYTE> m_aPlanes;
+		BYTE* m_apPlanes[3];
+		BYTE* m_pResiduals;
+		BYTE* m_pZeroRow;
+	};
+}
+
+#pragma managed(pop)
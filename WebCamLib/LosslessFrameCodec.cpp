@@ -0,0 +1,178 @@
+//*****************************************************************************************
+//  File:       LosslessFrameCodec.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed lossless codec for recording raw frames
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "LosslessCodec.h"
+#include "LosslessFrameCodec.h"
+#include "PooledFrame.h"
+#include "WorkerPool.h"
+
+using namespace System::Diagnostics;
+using namespace System::Runtime::InteropServices;
+using namespace WebCamLib;
+
+LosslessFrameCodec::LosslessFrameCodec()
+{
+	pCodec = new LosslessCodec();
+	pCodec->SetWorkerPool( WorkerPool::GetShared() );
+}
+
+LosslessFrameCodec::~LosslessFrameCodec()
+{
+	this->!LosslessFrameCodec();
+}
+
+LosslessFrameCodec::!LosslessFrameCodec()
+{
+	if( pCodec != NULL )
+	{
+		delete pCodec;
+		pCodec = NULL;
+	}
+}
+
+LosslessCodec* LosslessFrameCodec::GetCodec()
+{
+	if( pCodec == NULL )
+		throw gcnew ObjectDisposedException( "LosslessFrameCodec" );
+
+	return pCodec;
+}
+
+int LosslessFrameCodec::GetMaximumEncodedSize( int width, int height )
+{
+	if( width <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "width" );
+
+	if( height <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "height" );
+
+	DWORD dwSize = LosslessCodec::GetMaxEncodedSize( width, height );
+
+	if( dwSize > static_cast<DWORD>( Int32::MaxValue ) )
+		throw gcnew ArgumentException( "The frame is too large to encode into an array." );
+
+	return static_cast<int>( dwSize );
+}
+
+Tuple<int, int, int>^ LosslessFrameCodec::GetFrameSize( array<Byte>^ source, int offset, int length )
+{
+	if( source == nullptr )
+		throw gcnew ArgumentNullException( "source" );
+
+	if( offset < 0 || length <= 0 || offset > source->Length - length )
+		throw gcnew ArgumentOutOfRangeException( "length" );
+
+	LosslessFrameHeader header;
+	pin_ptr<Byte> pSource = &source[offset];
+
+	if( !LosslessCodec::ReadHeader( pSource, length, &header ) )
+		throw gcnew ArgumentException( "The data is not an encoded frame.", "source" );
+
+	return gcnew Tuple<int, int, int>( header.nWidth, header.nHeight, header.wBitsPerPixel );
+}
+
+int LosslessFrameCodec::Encode( PooledFrame^ frame, array<Byte>^ destination, int offset )
+{
+	if( frame == nullptr )
+		throw gcnew ArgumentNullException( "frame" );
+
+	return Encode( frame->Scan0, frame->Width, frame->Height, frame->Stride, frame->BitsPerPixel, destination, offset );
+}
+
+int LosslessFrameCodec::Encode( IntPtr scan0, int width, int height, int stride, int bitsPerPixel, array<Byte>^ destination, int offset )
+{
+	if( scan0 == IntPtr::Zero )
+		throw gcnew ArgumentNullException( "scan0" );
+
+	if( destination == nullptr )
+		throw gcnew ArgumentNullException( "destination" );
+
+	if( offset < 0 || offset >= destination->Length )
+		throw gcnew ArgumentOutOfRangeException( "offset" );
+
+	if( width <= 0 || height <= 0 )
+		throw gcnew ArgumentException( "The image has no pixels." );
+
+	if( bitsPerPixel != 24 && bitsPerPixel != 32 )
+		throw gcnew ArgumentException( "Only 24 and 32 bit images can be encoded.", "bitsPerPixel" );
+
+	LosslessCodec* pEncoder = GetCodec();
+	long long start = Stopwatch::GetTimestamp();
+
+	pin_ptr<Byte> pDestination = &destination[offset];
+	DWORD dwSize = 0;
+
+	HRESULT hr = pEncoder->Encode( static_cast<const BYTE*>( scan0.ToPointer() ), width, height, stride, bitsPerPixel,
+		pDestination, destination->Length - offset, &dwSize );
+
+	if( hr == HRESULT_FROM_WIN32( ERROR_INSUFFICIENT_BUFFER ) )
+		throw gcnew ArgumentException( "Destination is smaller than GetMaximumEncodedSize.", "destination" );
+
+	if( FAILED( hr ) )
+		throw gcnew COMException( "Unable to encode frame", hr );
+
+	encodeTicks += Stopwatch::GetTimestamp() - start;
+	framesEncoded++;
+	bytesIn += static_cast<long long>( width ) * height * ( bitsPerPixel / 8 );
+	bytesOut += dwSize;
+
+	return static_cast<int>( dwSize );
+}
+
+void LosslessFrameCodec::Decode( array<Byte>^ source, int offset, int length, IntPtr scan0, int stride )
+{
+	if( source == nullptr )
+		throw gcnew ArgumentNullException( "source" );
+
+	if( offset < 0 || length <= 0 || offset > source->Length - length )
+		throw gcnew ArgumentOutOfRangeException( "length" );
+
+	if( scan0 == IntPtr::Zero )
+		throw gcnew ArgumentNullException( "scan0" );
+
+	LosslessCodec* pDecoder = GetCodec();
+	long long start = Stopwatch::GetTimestamp();
+
+	pin_ptr<Byte> pSource = &source[offset];
+	HRESULT hr = pDecoder->Decode( pSource, length, static_cast<BYTE*>( scan0.ToPointer() ), stride );
+
+	if( hr == HRESULT_FROM_WIN32( ERROR_INVALID_DATA ) )
+		throw gcnew ArgumentException( "The data is not an encoded frame.", "source" );
+
+	if( FAILED( hr ) )
+		throw gcnew COMException( "Unable to decode frame", hr );
+
+	decodeTicks += Stopwatch::GetTimestamp() - start;
+	framesDecoded++;
+}
+
+long long LosslessFrameCodec::BytesIn::get()
+{
+	return bytesIn;
+}
+
+long long LosslessFrameCodec::BytesOut::get()
+{
+	return bytesOut;
+}
+
+double LosslessFrameCodec::CompressionRatio::get()
+{
+	return bytesOut > 0 ? static_cast<double>( bytesIn ) / bytesOut : 0.0;
+}
+
+double LosslessFrameCodec::AverageEncodeTime::get()
+{
+	return framesEncoded > 0 ? encodeTicks * 1000.0 / Stopwatch::Frequency / framesEncoded : 0.0;
+}
+
+double LosslessFrameCodec::AverageDecodeTime::get()
+{
+	return framesDecoded > 0 ? decodeTicks * 1000.0 / Stopwatch::Frequency / framesDecoded : 0.0;
+}
@@ -0,0 +1,109 @@
+//*****************************************************************************************
+//  File:       LosslessFrameCodec.h
+//  Project:    WebcamLib
+//
+//  Declares the managed lossless codec for recording raw frames
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+
+namespace WebCamLib
+{
+	class LosslessCodec;
+	ref class PooledFrame;
+
+	/// <summary>
+	/// Compresses raw 24 and 32 bit frames without loss, fast enough to record 1080p on one core
+	/// where PNG cannot keep up. Each encoded frame stands alone. An instance is not thread safe;
+	/// use one for recording and another for playback.
+	/// </summary>
+	public ref class LosslessFrameCodec
+	{
+	public:
+		LosslessFrameCodec();
+
+		/// <summary>
+		/// Destination size that any frame of these dimensions is guaranteed to fit in
+		/// </summary>
+		static int GetMaximumEncodedSize( int width, int height );
+
+		/// <summary>
+		/// Width, height and bits per pixel of an encoded frame; throws when it is not one
+		/// </summary>
+		static Tuple<int, int, int>^ GetFrameSize( array<Byte>^ source, int offset, int length );
+
+		/// <summary>
+		/// Encodes a captured frame at offset into the destination; returns the bytes written
+		/// </summary>
+		int Encode( PooledFrame^ frame, array<Byte>^ destination, int offset );
+
+		/// <summary>
+		/// Encodes an image given by its top row and the signed offset to the row below, as in BitmapData
+		/// </summary>
+		int Encode( IntPtr scan0, int width, int height, int stride, int bitsPerPixel, array<Byte>^ destination, int offset );
+
+		/// <summary>
+		/// Decodes a frame into an image of its size and depth, given as in BitmapData
+		/// </summary>
+		void Decode( array<Byte>^ source, int offset, int length, IntPtr scan0, int stride );
+
+		/// <summary>
+		/// Raw bytes encoded so far
+		/// </summary>
+		property long long BytesIn
+		{
+			long long get();
+		}
+
+		/// <summary>
+		/// Encoded bytes produced so far
+		/// </summary>
+		property long long BytesOut
+		{
+			long long get();
+		}
+
+		/// <summary>
+		/// Raw size over encoded size, over all frames encoded so far
+		/// </summary>
+		property double CompressionRatio
+		{
+			double get();
+		}
+
+		/// <summary>
+		/// Average time to encode a frame, in milliseconds
+		/// </summary>
+		property double AverageEncodeTime
+		{
+			double get();
+		}
+
+		/// <summary>
+		/// Average time to decode a frame, in milliseconds
+		/// </summary>
+		property double AverageDecodeTime
+		{
+			double get();
+		}
+
+		~LosslessFrameCodec();
+
+	protected:
+		!LosslessFrameCodec();
+
+	private:
+		LosslessCodec* GetCodec();
+
+		LosslessCodec* pCodec;
+
+		long long bytesIn;
+		long long bytesOut;
+		int framesEncoded;
+		int framesDecoded;
+		long long encodeTicks;
+		long long decodeTicks;
+	};
+}
@@ -0,0 +1,99 @@
+//*****************************************************************************************
+//  File:       LumaPlane.cpp
+//  Project:    WebcamLib
+//
+//  Defines the 8 bit luma plane the detectors search frames in
+//*****************************************************************************************
+
+#include <windows.h>
+#include <emmintrin.h>
+
+#include "LumaPlane.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+LumaPlane::LumaPlane()
+{
+	m_nWidth = 0;
+	m_nHeight = 0;
+}
+
+HRESULT LumaPlane::Extract(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel)
+{
+	if (pTop == NULL || nWidth <= 0 || nHeight <= 0 || (nBitsPerPixel != 8 && nBitsPerPixel != 24 && nBitsPerPixel != 32))
+		return E_INVALIDARG;
+
+	m_nWidth = nWidth;
+	m_nHeight = nHeight;
+
+	size_t cPixels = static_cast<size_t>(nWidth) * nHeight;
+	if (m_abLuma.size() < cPixels)
+	{
+		m_abLuma.resize(cPixels);
+	}
+
+	int nBytes = nBitsPerPixel / 8;
+
+	for (int y = 0; y < nHeight; y++)
+	{
+		const BYTE* pSource = pTop + static_cast<ptrdiff_t>(y) * nStride;
+		BYTE* pLuma = &m_abLuma[static_cast<size_t>(y) * nWidth];
+
+		if (nBytes == 1)
+		{
+			CopyMemory(pLuma, pSource, nWidth);
+			continue;
+		}
+
+		for (int x = 0; x < nWidth; x++, pSource += nBytes)
+		{
+			pLuma[x] = static_cast<BYTE>((29 * pSource[0] + 150 * pSource[1] + 77 * pSource[2] + 128) >> 8);
+		}
+	}
+
+	return S_OK;
+}
+
+void LumaPlane::Halve(const BYTE* pSource, int nWidth, int nHeight, BYTE* pTarget)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi16(1);
+	const __m128i two = _mm_set1_epi32(2);
+
+	int nTargetWidth = nWidth / 2;
+	int nTargetHeight = nHeight / 2;
+
+	for (int y = 0; y < nTargetHeight; y++)
+	{
+		const BYTE* pUpper = pSource + static_cast<size_t>(2 * y) * nWidth;
+		const BYTE* pLower = pUpper + nWidth;
+		BYTE* pRow = pTarget + static_cast<size_t>(y) * nTargetWidth;
+		int x = 0;
+
+		// 16 source pixels of both rows to 8 target pixels: the rows are added as 16 bit lanes,
+		// then neighbouring lanes by multiplying and adding with ones
+		for (; x + 8 <= nTargetWidth; x += 8)
+		{
+			__m128i upper = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pUpper + 2 * x));
+			__m128i lower = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pLower + 2 * x));
+
+			__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(upper, zero), _mm_unpacklo_epi8(lower, zero));
+			__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(upper, zero), _mm_unpackhi_epi8(lower, zero));
+
+			low = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(low, ones), two), 2);
+			high = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(high, ones), two), 2);
+
+			__m128i packed = _mm_packs_epi32(low, high);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(pRow + x), _mm_packus_epi16(packed, packed));
+		}
+
+		for (; x < nTargetWidth; x++)
+		{
+			pRow[x] = static_cast<BYTE>((pUpper[2 * x] + pUpper[2 * x + 1] + pLower[2 * x] + pLower[2 * x + 1] + 2) >> 2);
+		}
+	}
+}
+
+#pragma managed(pop)
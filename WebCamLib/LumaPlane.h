@@ -0,0 +1,61 @@
+//*****************************************************************************************
+//  File:       LumaPlane.h
+//  Project:    WebcamLib
+//
+//  Declares the 8 bit luma plane the detectors search frames in
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// Tightly packed 8 bit luma of a frame, using the same fixed point Rec. 601 weights as the
+	/// frame statistics. The buffer is kept from one frame to the next.
+	/// </summary>
+	class LumaPlane
+	{
+	public:
+		LumaPlane();
+
+		/// <summary>
+		/// Extracts the luma of an 8 bit grey, 24 or 32 bit BGR image given by its top row and signed stride
+		/// </summary>
+		HRESULT Extract(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel);
+
+		int GetWidth() const
+		{
+			return m_nWidth;
+		}
+
+		int GetHeight() const
+		{
+			return m_nHeight;
+		}
+
+		/// <summary>
+		/// The top row; rows follow each other GetWidth() bytes apart
+		/// </summary>
+		const BYTE* GetData() const
+		{
+			return &m_abLuma[0];
+		}
+
+		/// <summary>
+		/// Halves a tightly packed plane, rounding the mean of each 2 by 2 block into pTarget,
+		/// which is nWidth / 2 pixels across; an odd last row or column is left out
+		/// </summary>
+		static void Halve(const BYTE* pSource, int nWidth, int nHeight, BYTE* pTarget);
+
+	private:
+		int m_nWidth;
+		int m_nHeight;
+		std::vector<BYTE> m_abLuma;
+	};
+}
+
+#pragma managed(pop)
@@ -0,0 +1,134 @@
+//*****************************************************************************************
+//  File:       PooledFrame.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed handle on a pooled native frame buffer
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "FrameBuffer.h"
+#include "FrameStatistics.h"
+#include "PooledFrame.h"
+
+using namespace System::Runtime::InteropServices;
+using namespace WebCamLib;
+
+PooledFrame::PooledFrame( FrameBuffer* pBuffer )
+{
+	pBuffer->AddRef();
+	this->pBuffer = pBuffer;
+
+	// The collector cannot see the pixels, so tell it how much an unreleased reference keeps alive
+	GC::AddMemoryPressure( pBuffer->GetSize() );
+}
+
+PooledFrame::~PooledFrame()
+{
+	this->!PooledFrame();
+}
+
+PooledFrame::!PooledFrame()
+{
+	if( pBuffer != NULL )
+	{
+		GC::RemoveMemoryPressure( pBuffer->GetSize() );
+
+		pBuffer->Release();
+		pBuffer = NULL;
+	}
+}
+
+FrameBuffer* PooledFrame::GetBuffer()
+{
+	if( pBuffer == NULL )
+		throw gcnew ObjectDisposedException( "PooledFrame" );
+
+	return pBuffer;
+}
+
+PooledFrame^ PooledFrame::AddReference()
+{
+	return gcnew PooledFrame( GetBuffer() );
+}
+
+int PooledFrame::Width::get()
+{
+	return GetBuffer()->GetWidth();
+}
+
+int PooledFrame::Height::get()
+{
+	return GetBuffer()->GetHeight();
+}
+
+int PooledFrame::BitsPerPixel::get()
+{
+	return GetBuffer()->GetBitsPerPixel();
+}
+
+IntPtr PooledFrame::Scan0::get()
+{
+	FrameBuffer* pFrame = GetBuffer();
+	BYTE* pTop = pFrame->GetData();
+
+	if( pFrame->IsBottomUp() )
+		pTop += static_cast<ptrdiff_t>( pFrame->GetHeight() - 1 ) * pFrame->GetStride();
+
+	return IntPtr( pTop );
+}
+
+int PooledFrame::Stride::get()
+{
+	FrameBuffer* pFrame = GetBuffer();
+
+	return pFrame->IsBottomUp() ? -pFrame->GetStride() : pFrame->GetStride();
+}
+
+IntPtr PooledFrame::Data::get()
+{
+	return IntPtr( GetBuffer()->GetData() );
+}
+
+int PooledFrame::Size::get()
+{
+	return static_cast<int>( GetBuffer()->GetSize() );
+}
+
+long long PooledFrame::Timestamp::get()
+{
+	return GetBuffer()->GetTimestamp();
+}
+
+double PooledFrame::SampleTime::get()
+{
+	return GetBuffer()->GetSampleTime();
+}
+
+FrameStatistics^ PooledFrame::Statistics::get()
+{
+	const ImageStatistics* pStatistics = GetBuffer()->GetStatistics();
+
+	if( statistics == nullptr && pStatistics != NULL )
+		statistics = gcnew FrameStatistics( *pStatistics );
+
+	return statistics;
+}
+
+bool PooledFrame::IsDisposed::get()
+{
+	return pBuffer == NULL;
+}
+
+void PooledFrame::CopyTo( array<Byte>^ destination )
+{
+	FrameBuffer* pFrame = GetBuffer();
+
+	if( destination == nullptr )
+		throw gcnew ArgumentNullException( "destination" );
+
+	if( static_cast<DWORD>( destination->Length ) < pFrame->GetSize() )
+		throw gcnew ArgumentException( "Destination is smaller than the frame." );
+
+	Marshal::Copy( IntPtr( pFrame->GetData() ), destination, 0, static_cast<int>( pFrame->GetSize() ) );
+}
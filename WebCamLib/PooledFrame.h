@@ -0,0 +1,125 @@
+//*****************************************************************************************
+//  File:       PooledFrame.h
+//  Project:    WebcamLib
+//
+//  Declares the managed handle on a pooled native frame buffer
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+
+namespace WebCamLib
+{
+	class FrameBuffer;
+	ref class FrameStatistics;
+
+	/// <summary>
+	/// One reference on a captured frame held in native memory.
+	/// The frame passed to CameraMethods.OnFrameCapture is only valid during the event;
+	/// call AddReference to keep it, and Dispose each reference once done with it.
+	/// </summary>
+	public ref class PooledFrame
+	{
+	internal:
+		/// <summary>
+		/// Takes a reference of its own on the buffer
+		/// </summary>
+		PooledFrame( FrameBuffer* pBuffer );
+
+	public:
+		/// <summary>
+		/// Returns another reference on the same pixels, which must be disposed separately
+		/// </summary>
+		PooledFrame^ AddReference();
+
+		property int Width
+		{
+			int get();
+		}
+
+		property int Height
+		{
+			int get();
+		}
+
+		property int BitsPerPixel
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Address of the top row of the image
+		/// </summary>
+		property IntPtr Scan0
+		{
+			IntPtr get();
+		}
+
+		/// <summary>
+		/// Byte offset from one row to the row below it; negative for bottom-up buffers, as in BitmapData
+		/// </summary>
+		property int Stride
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Address of the first byte of the buffer, which is the bottom row for bottom-up buffers
+		/// </summary>
+		property IntPtr Data
+		{
+			IntPtr get();
+		}
+
+		property int Size
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Stopwatch ticks, taken when the frame arrived from the driver
+		/// </summary>
+		property long long Timestamp
+		{
+			long long get();
+		}
+
+		/// <summary>
+		/// Stream time of the sample in seconds, as reported by DirectShow
+		/// </summary>
+		property double SampleTime
+		{
+			double get();
+		}
+
+		/// <summary>
+		/// Statistics computed by the capture callback, null when they were not enabled
+		/// </summary>
+		property FrameStatistics^ Statistics
+		{
+			FrameStatistics^ get();
+		}
+
+		property bool IsDisposed
+		{
+			bool get();
+		}
+
+		/// <summary>
+		/// Copies the raw buffer, in memory order, into an array of at least Size bytes
+		/// </summary>
+		void CopyTo( array<Byte>^ destination );
+
+		~PooledFrame();
+
+	protected:
+		!PooledFrame();
+
+	private:
+		FrameBuffer* GetBuffer();
+
+		FrameBuffer* pBuffer;
+		FrameStatistics^ statistics;
+	};
+}
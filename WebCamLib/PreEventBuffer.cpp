@@ -0,0 +1,251 @@
+//*****************************************************************************************
+//  File:       PreEventBuffer.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed ring of the last seconds of capture and its readers
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "FrameRing.h"
+#include "PooledFrame.h"
+#include "PreEventBuffer.h"
+
+using namespace System::Diagnostics;
+using namespace System::Runtime::InteropServices;
+using namespace System::Threading;
+using namespace WebCamLib;
+
+#pragma region PreEventBuffer
+PreEventBuffer::PreEventBuffer( int capacity, double seconds, PreEventEncoding encoding )
+{
+	if( capacity <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "capacity" );
+
+	if( seconds < 0.0 || Double::IsNaN( seconds ) )
+		throw gcnew ArgumentOutOfRangeException( "seconds" );
+
+	pRing = new FrameRing();
+	this->encoding = encoding;
+
+	HRESULT hr = pRing->Create( static_cast<DWORD>( capacity ), static_cast<LONGLONG>( seconds * Stopwatch::Frequency ), static_cast<FrameRingEncoding>( encoding ) );
+
+	if( FAILED( hr ) )
+	{
+		pRing->Release();
+		pRing = NULL;
+
+		if( hr == E_INVALIDARG )
+			throw gcnew ArgumentOutOfRangeException( "capacity", "The buffer is too small to hold a frame." );
+
+		throw gcnew COMException( "Unable to allocate the pre-event buffer.", hr );
+	}
+}
+
+PreEventBuffer::~PreEventBuffer()
+{
+	this->!PreEventBuffer();
+}
+
+PreEventBuffer::!PreEventBuffer()
+{
+	// Pipelines and readers still using the ring hold references of their own
+	if( pRing != NULL )
+	{
+		pRing->Release();
+		pRing = NULL;
+	}
+}
+
+FrameRing* PreEventBuffer::GetNative()
+{
+	if( pRing == NULL )
+		throw gcnew ObjectDisposedException( "PreEventBuffer" );
+
+	return pRing;
+}
+
+void PreEventBuffer::Write( PooledFrame^ frame )
+{
+	if( frame == nullptr )
+		throw gcnew ArgumentNullException( "frame" );
+
+	FrameRing* pNative = GetNative();
+
+	HRESULT hr = pNative->Write( static_cast<const BYTE*>( frame->Scan0.ToPointer() ), frame->Width, frame->Height, frame->Stride, frame->BitsPerPixel, frame->Timestamp, frame->SampleTime );
+	if( FAILED( hr ) )
+		throw gcnew COMException( "Unable to store the frame.", hr );
+}
+
+void PreEventBuffer::Write( IntPtr scan0, int width, int height, int stride, int bitsPerPixel, long long timestamp )
+{
+	if( scan0 == IntPtr::Zero )
+		throw gcnew ArgumentNullException( "scan0" );
+
+	if( width <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "width" );
+
+	if( height <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "height" );
+
+	if( bitsPerPixel <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "bitsPerPixel" );
+
+	HRESULT hr = GetNative()->Write( static_cast<const BYTE*>( scan0.ToPointer() ), width, height, stride, bitsPerPixel, timestamp, 0.0 );
+	if( FAILED( hr ) )
+		throw gcnew COMException( "Unable to store the frame.", hr );
+}
+
+PreEventReader^ PreEventBuffer::OpenReader()
+{
+	return gcnew PreEventReader( GetNative() );
+}
+
+PreEventEncoding PreEventBuffer::Encoding::get()
+{
+	return encoding;
+}
+
+int PreEventBuffer::Capacity::get()
+{
+	FrameRingStatus status;
+	GetNative()->GetStatus( &status );
+
+	return static_cast<int>( status.dwCapacity );
+}
+
+int PreEventBuffer::BytesUsed::get()
+{
+	FrameRingStatus status;
+	GetNative()->GetStatus( &status );
+
+	return static_cast<int>( status.dwBytesUsed );
+}
+
+int PreEventBuffer::FrameCount::get()
+{
+	FrameRingStatus status;
+	GetNative()->GetStatus( &status );
+
+	return status.nFrames;
+}
+
+double PreEventBuffer::BufferedSeconds::get()
+{
+	FrameRingStatus status;
+	GetNative()->GetStatus( &status );
+
+	return static_cast<double>( status.llNewestTimestamp - status.llOldestTimestamp ) / Stopwatch::Frequency;
+}
+
+int PreEventBuffer::FramesTooLarge::get()
+{
+	FrameRingStatus status;
+	GetNative()->GetStatus( &status );
+
+	return status.nFramesTooLarge;
+}
+#pragma endregion
+
+#pragma region PreEventReader
+PreEventReader::PreEventReader( FrameRing* pRing )
+{
+	pReader = new FrameRingReader( pRing );
+	hasCurrent = false;
+}
+
+PreEventReader::~PreEventReader()
+{
+	this->!PreEventReader();
+}
+
+PreEventReader::!PreEventReader()
+{
+	if( pReader != NULL )
+	{
+		delete pReader;
+		pReader = NULL;
+	}
+}
+
+FrameRingReader* PreEventReader::GetReader()
+{
+	if( pReader == NULL )
+		throw gcnew ObjectDisposedException( "PreEventReader" );
+
+	return pReader;
+}
+
+const FrameRingRecord& PreEventReader::GetCurrent()
+{
+	FrameRingReader* pNative = GetReader();
+
+	if( !hasCurrent )
+		throw gcnew InvalidOperationException( "MoveNext has not moved to a frame." );
+
+	return pNative->GetCurrent();
+}
+
+bool PreEventReader::MoveNext( int millisecondsTimeout )
+{
+	if( millisecondsTimeout < Timeout::Infinite )
+		throw gcnew ArgumentOutOfRangeException( "millisecondsTimeout" );
+
+	hasCurrent = GetReader()->MoveNext( static_cast<DWORD>( millisecondsTimeout ) );
+
+	return hasCurrent;
+}
+
+int PreEventReader::Width::get()
+{
+	return GetCurrent().nWidth;
+}
+
+int PreEventReader::Height::get()
+{
+	return GetCurrent().nHeight;
+}
+
+int PreEventReader::BitsPerPixel::get()
+{
+	return GetCurrent().nBitsPerPixel;
+}
+
+long long PreEventReader::Timestamp::get()
+{
+	return GetCurrent().llTimestamp;
+}
+
+double PreEventReader::SampleTime::get()
+{
+	return GetCurrent().dSampleTime;
+}
+
+int PreEventReader::Sequence::get()
+{
+	return GetCurrent().nSequence;
+}
+
+int PreEventReader::LostFrames::get()
+{
+	return GetReader()->GetLostCount();
+}
+
+bool PreEventReader::Decode( IntPtr scan0, int stride )
+{
+	if( scan0 == IntPtr::Zero )
+		throw gcnew ArgumentNullException( "scan0" );
+
+	const FrameRingRecord& current = GetCurrent();
+
+	int rowBytes = ( current.nWidth * current.nBitsPerPixel + 7 ) / 8;
+	if( Math::Abs( stride ) < rowBytes )
+		throw gcnew ArgumentOutOfRangeException( "stride", "The rows are too short for the frame." );
+
+	HRESULT hr = GetReader()->Decode( static_cast<BYTE*>( scan0.ToPointer() ), stride );
+	if( FAILED( hr ) )
+		throw gcnew COMException( "Unable to decode the frame.", hr );
+
+	return hr == S_OK;
+}
+#pragma endregion
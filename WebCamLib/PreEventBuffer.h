@@ -0,0 +1,198 @@
+//*****************************************************************************************
+//  File:       PreEventBuffer.h
+//  Project:    WebcamLib
+//
+//  Declares the managed ring of the last seconds of capture and its readers
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+
+namespace WebCamLib
+{
+	class FrameRing;
+	class FrameRingReader;
+	ref class PooledFrame;
+	ref class PreEventReader;
+
+	/// <summary>
+	/// How frames are kept in a PreEventBuffer
+	/// </summary>
+	public enum class PreEventEncoding : int
+	{
+		/// <summary>
+		/// As captured; cheapest to write, fewest seconds per byte
+		/// </summary>
+		Raw = FrameRingEncoding_Raw,
+
+		/// <summary>
+		/// Compressed with the lossless codec, typically two to three times the seconds in the same memory.
+		/// Formats other than 24 and 32 bit RGB are kept raw.
+		/// </summary>
+		Lossless = FrameRingEncoding_Lossless,
+	};
+
+	/// <summary>
+	/// Holds the last seconds of capture in a fixed amount of memory, so that footage from before
+	/// a trigger can be recorded. Frames go in through FrameProcessingPipeline.AddPreEventBuffer
+	/// or Write; the oldest are dropped as the budget or the age limit requires, so a change of
+	/// resolution only changes how many frames fit. On a trigger, OpenReader walks the frames
+	/// held and then the live ones that follow, without copying the ring or holding up capture.
+	/// </summary>
+	public ref class PreEventBuffer
+	{
+	public:
+		/// <summary>
+		/// Allocates capacity bytes up front and keeps at most seconds of frames; 0 seconds keeps
+		/// as many as fit
+		/// </summary>
+		PreEventBuffer( int capacity, double seconds, PreEventEncoding encoding );
+
+		/// <summary>
+		/// Stores a captured frame, stamped with its capture time
+		/// </summary>
+		void Write( PooledFrame^ frame );
+
+		/// <summary>
+		/// Stores an image given as in BitmapData, stamped with Stopwatch ticks
+		/// </summary>
+		void Write( IntPtr scan0, int width, int height, int stride, int bitsPerPixel, long long timestamp );
+
+		/// <summary>
+		/// Starts reading at the oldest frame held
+		/// </summary>
+		PreEventReader^ OpenReader();
+
+		property PreEventEncoding Encoding
+		{
+			PreEventEncoding get();
+		}
+
+		property int Capacity
+		{
+			int get();
+		}
+
+		property int BytesUsed
+		{
+			int get();
+		}
+
+		property int FrameCount
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Time from the oldest frame held to the newest
+		/// </summary>
+		property double BufferedSeconds
+		{
+			double get();
+		}
+
+		/// <summary>
+		/// Frames skipped because even the empty buffer could not hold them
+		/// </summary>
+		property int FramesTooLarge
+		{
+			int get();
+		}
+
+		~PreEventBuffer();
+
+	internal:
+		/// <summary>
+		/// The native ring, without a reference of its own
+		/// </summary>
+		FrameRing* GetNative();
+
+	protected:
+		!PreEventBuffer();
+
+	private:
+		FrameRing* pRing;
+		PreEventEncoding encoding;
+	};
+
+	/// <summary>
+	/// Walks a PreEventBuffer from the oldest frame it held when opened into the live frames
+	/// after it. A reader falling more than the buffer behind skips the frames it missed and
+	/// counts them in LostFrames. Not thread safe; use one per thread.
+	/// </summary>
+	public ref class PreEventReader
+	{
+	internal:
+		PreEventReader( FrameRing* pRing );
+
+	public:
+		/// <summary>
+		/// Moves to the next frame, waiting up to millisecondsTimeout for one to be written;
+		/// false when none was
+		/// </summary>
+		bool MoveNext( int millisecondsTimeout );
+
+		property int Width
+		{
+			int get();
+		}
+
+		property int Height
+		{
+			int get();
+		}
+
+		property int BitsPerPixel
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Stopwatch ticks, taken when the frame was captured
+		/// </summary>
+		property long long Timestamp
+		{
+			long long get();
+		}
+
+		property double SampleTime
+		{
+			double get();
+		}
+
+		/// <summary>
+		/// Frames written to the buffer before this one
+		/// </summary>
+		property int Sequence
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Frames dropped from the buffer before this reader got to them
+		/// </summary>
+		property int LostFrames
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Decodes the current frame into an image of its size and depth, given as in BitmapData;
+		/// false when it was dropped from the buffer first
+		/// </summary>
+		bool Decode( IntPtr scan0, int stride );
+
+		~PreEventReader();
+
+	protected:
+		!PreEventReader();
+
+	private:
+		FrameRingReader* GetReader();
+		const FrameRingRecord& GetCurrent();
+
+		FrameRingReader* pReader;
+		bool hasCurrent;
+	};
+}
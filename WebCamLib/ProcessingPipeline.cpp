@@ -0,0 +1,542 @@
+//*****************************************************************************************
+//  File:       ProcessingPipeline.cpp
+//  Project:    WebcamLib
+//
+//  Defines the native stage graph run over each captured frame before it is delivered
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "FrameBuffer.h"
+#include "WorkerPool.h"
+#include "ProcessingPipeline.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+#pragma region ProcessingStage
+ProcessingStage::ProcessingStage(StageKind eKind, StageAccess eAccess, const WCHAR* szName)
+{
+	m_eKind = eKind;
+	m_eAccess = eAccess;
+	m_strName = szName;
+}
+
+ProcessingStage::~ProcessingStage()
+{
+}
+
+void ProcessingStage::GetOutputFormat(int nWidth, int nHeight, int nBitsPerPixel, int* pnWidth, int* pnHeight, int* pnBitsPerPixel) const
+{
+	*pnWidth = nWidth;
+	*pnHeight = nHeight;
+	*pnBitsPerPixel = nBitsPerPixel;
+}
+
+bool ProcessingStage::IsRowLocal() const
+{
+	return false;
+}
+
+HRESULT ProcessingStage::BeginFrame(FrameBuffer* pFrame)
+{
+	return S_OK;
+}
+
+void ProcessingStage::ProcessRows(FrameBuffer* pFrame, int nFirstRow, int nRows)
+{
+}
+#pragma endregion
+
+#pragma region ProcessingPipeline
+ProcessingPipeline::ProcessingPipeline()
+{
+	m_nRefCount = 1;
+	InitializeCriticalSection(&m_cs);
+
+	m_aBranches.resize(1);
+	m_aBranches[0].bNeedsCopy = false;
+	m_aBranches[0].pCopyPool = NULL;
+	m_bCompiled = false;
+
+	m_pWorkers = NULL;
+	m_bWorkerPlacementSet = false;
+
+	m_pBranchInput = NULL;
+}
+
+ProcessingPipeline::~ProcessingPipeline()
+{
+	delete m_pWorkers;
+
+	// Frames still held by consumers keep their pools alive until they are released
+	for (size_t n = 0; n < m_aStages.size(); n++)
+	{
+		delete m_aStages[n].pStage;
+
+		if (m_aStages[n].pOutputPool != NULL)
+		{
+			m_aStages[n].pOutputPool->Release();
+		}
+	}
+
+	for (size_t n = 0; n < m_aBranches.size(); n++)
+	{
+		if (m_aBranches[n].pCopyPool != NULL)
+		{
+			m_aBranches[n].pCopyPool->Release();
+		}
+	}
+
+	DeleteCriticalSection(&m_cs);
+}
+
+LONG ProcessingPipeline::AddRef()
+{
+	return InterlockedIncrement(&m_nRefCount);
+}
+
+LONG ProcessingPipeline::Release()
+{
+	LONG result = InterlockedDecrement(&m_nRefCount);
+
+	if (result == 0)
+	{
+		delete this;
+	}
+
+	return result;
+}
+
+int ProcessingPipeline::AddBranch()
+{
+	EnterCriticalSection(&m_cs);
+
+	m_aBranches.resize(m_aBranches.size() + 1);
+	m_aBranches.back().bNeedsCopy = false;
+	m_aBranches.back().pCopyPool = NULL;
+	m_bCompiled = false;
+	int result = static_cast<int>(m_aBranches.size()) - 1;
+
+	LeaveCriticalSection(&m_cs);
+
+	return result;
+}
+
+int ProcessingPipeline::GetBranchCount()
+{
+	EnterCriticalSection(&m_cs);
+	int result = static_cast<int>(m_aBranches.size());
+	LeaveCriticalSection(&m_cs);
+
+	return result;
+}
+
+HRESULT ProcessingPipeline::AddStage(int nBranch, ProcessingStage* pStage)
+{
+	if (pStage == NULL)
+		return E_POINTER;
+
+	HRESULT hr = S_OK;
+
+	EnterCriticalSection(&m_cs);
+
+	if (nBranch < 0 || nBranch >= static_cast<int>(m_aBranches.size()))
+	{
+		hr = E_INVALIDARG;
+	}
+	else
+	{
+		StageEntry entry;
+		entry.pStage = pStage;
+		entry.nBranch = nBranch;
+		entry.bFused = false;
+		entry.pOutputPool = pStage->GetAccess() == StageAccess_OutOfPlace ? new FramePool() : NULL;
+		ZeroMemory(&entry.timing, sizeof(entry.timing));
+
+		m_aStages.push_back(entry);
+		m_aBranches[nBranch].aStages.push_back(static_cast<int>(m_aStages.size()) - 1);
+		m_bCompiled = false;
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return hr;
+}
+
+int ProcessingPipeline::GetStageCount()
+{
+	EnterCriticalSection(&m_cs);
+	int result = static_cast<int>(m_aStages.size());
+	LeaveCriticalSection(&m_cs);
+
+	return result;
+}
+
+bool ProcessingPipeline::GetStageInfo(int nStage, const WCHAR** pszName, StageKind* peKind, int* pnBranch, bool* pbFused, StageTiming* pTiming)
+{
+	bool result = false;
+
+	EnterCriticalSection(&m_cs);
+
+	if (nStage >= 0 && nStage < static_cast<int>(m_aStages.size()))
+	{
+		if (!m_bCompiled)
+		{
+			Compile();
+		}
+
+		const StageEntry& entry = m_aStages[nStage];
+		*pszName = entry.pStage->GetName();
+		*peKind = entry.pStage->GetKind();
+		*pnBranch = entry.nBranch;
+		*pbFused = entry.bFused;
+		*pTiming = entry.timing;
+		result = true;
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return result;
+}
+
+void ProcessingPipeline::ResetTimings()
+{
+	EnterCriticalSection(&m_cs);
+
+	for (size_t n = 0; n < m_aStages.size(); n++)
+	{
+		ZeroMemory(&m_aStages[n].timing, sizeof(StageTiming));
+	}
+
+	LeaveCriticalSection(&m_cs);
+}
+
+HRESULT ProcessingPipeline::SetWorkerPlacement(const ThreadPlacement& placement)
+{
+	HRESULT hr = S_OK;
+
+	EnterCriticalSection(&m_cs);
+
+	m_workerPlacement = placement;
+	m_bWorkerPlacementSet = true;
+
+	if (m_pWorkers != NULL)
+	{
+		hr = m_pWorkers->SetPlacement(placement);
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return hr;
+}
+
+FrameBuffer* ProcessingPipeline::Run(FrameBuffer* pSource)
+{
+	EnterCriticalSection(&m_cs);
+
+	if (!m_bCompiled)
+	{
+		Compile();
+	}
+
+	pSource->AddRef();
+	FrameBuffer* pOutput = RunBranch(m_aBranches[0], pSource, true);
+
+	int nBranches = static_cast<int>(m_aBranches.size()) - 1;
+	if (pOutput != NULL && nBranches > 0)
+	{
+		m_pBranchInput = pOutput;
+
+		// The branches take the worker threads, so their own fused passes run on one thread each
+		GetWorkers()->Run(BranchProc, this, nBranches);
+
+		m_pBranchInput = NULL;
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return pOutput;
+}
+
+/// <summary>
+/// Splits every branch into steps, fusing runs of in-place row-local stages, and works out which
+/// branches have to copy the shared frame before changing it
+/// </summary>
+void ProcessingPipeline::Compile()
+{
+	for (size_t n = 0; n < m_aStages.size(); n++)
+	{
+		m_aStages[n].bFused = false;
+	}
+
+	for (size_t b = 0; b < m_aBranches.size(); b++)
+	{
+		Branch& branch = m_aBranches[b];
+		branch.aSteps.clear();
+		branch.bNeedsCopy = false;
+
+		bool bOwnsFrame = b == 0;
+
+		for (size_t n = 0; n < branch.aStages.size(); n++)
+		{
+			ProcessingStage* pStage = m_aStages[branch.aStages[n]].pStage;
+
+			if (pStage->GetAccess() == StageAccess_OutOfPlace)
+			{
+				bOwnsFrame = true;
+			}
+			else if (pStage->GetAccess() == StageAccess_InPlace && !bOwnsFrame)
+			{
+				branch.bNeedsCopy = true;
+				bOwnsFrame = true;
+
+				if (branch.pCopyPool == NULL)
+				{
+					branch.pCopyPool = new FramePool();
+				}
+			}
+
+			bool bFusable = pStage->GetAccess() == StageAccess_InPlace && pStage->IsRowLocal();
+
+			if (bFusable && !branch.aSteps.empty())
+			{
+				Step& last = branch.aSteps.back();
+				ProcessingStage* pLast = m_aStages[branch.aStages[last.nLast]].pStage;
+
+				if (pLast->GetAccess() == StageAccess_InPlace && pLast->IsRowLocal())
+				{
+					last.nLast = static_cast<int>(n);
+
+					for (int i = last.nFirst; i <= last.nLast; i++)
+					{
+						m_aStages[branch.aStages[i]].bFused = true;
+					}
+
+					continue;
+				}
+			}
+
+			Step step;
+			step.nFirst = static_cast<int>(n);
+			step.nLast = static_cast<int>(n);
+			branch.aSteps.push_back(step);
+		}
+	}
+
+	m_bCompiled = true;
+}
+
+WorkerPool* ProcessingPipeline::GetWorkers()
+{
+	// Not the shared pool: a sink running on it might well fan out to the shared pool itself
+	if (m_pWorkers == NULL)
+	{
+		m_pWorkers = new WorkerPool();
+
+		if (m_bWorkerPlacementSet)
+		{
+			m_pWorkers->SetPlacement(m_workerPlacement);
+		}
+	}
+
+	return m_pWorkers;
+}
+
+void ProcessingPipeline::BranchProc(void* pContext, int nItem)
+{
+	ProcessingPipeline* pPipeline = static_cast<ProcessingPipeline*>(pContext);
+	const Branch& branch = pPipeline->m_aBranches[nItem + 1];
+
+	FrameBuffer* pFrame = pPipeline->m_pBranchInput;
+	pFrame->AddRef();
+
+	if (branch.bNeedsCopy)
+	{
+		FrameBuffer* pCopy = AcquireLike(branch.pCopyPool, pFrame, pFrame->GetWidth(), pFrame->GetHeight(), pFrame->GetBitsPerPixel());
+		if (pCopy != NULL)
+		{
+			CopyMemory(pCopy->GetData(), pFrame->GetData(), pFrame->GetSize());
+		}
+
+		pFrame->Release();
+		pFrame = pCopy;
+	}
+
+	if (pFrame != NULL)
+	{
+		pFrame = pPipeline->RunBranch(branch, pFrame, false);
+	}
+
+	if (pFrame != NULL)
+	{
+		pFrame->Release();
+	}
+}
+
+/// <summary>
+/// Runs the steps of a branch over a frame it holds a reference on; returns the reference on the
+/// last frame written, or NULL when a stage failed
+/// </summary>
+FrameBuffer* ProcessingPipeline::RunBranch(const Branch& branch, FrameBuffer* pFrame, bool bParallel)
+{
+	for (size_t n = 0; n < branch.aSteps.size() && pFrame != NULL; n++)
+	{
+		if (!RunStep(branch, branch.aSteps[n], &pFrame, bParallel))
+		{
+			pFrame->Release();
+			pFrame = NULL;
+		}
+	}
+
+	return pFrame;
+}
+
+bool ProcessingPipeline::RunStep(const Branch& branch, const Step& step, FrameBuffer** ppFrame, bool bParallel)
+{
+	FrameBuffer* pFrame = *ppFrame;
+
+	int nStage = branch.aStages[step.nFirst];
+	ProcessingStage* pStage = m_aStages[nStage].pStage;
+
+	for (int n = step.nFirst; n <= step.nLast; n++)
+	{
+		if (FAILED(m_aStages[branch.aStages[n]].pStage->BeginFrame(pFrame)))
+		{
+			RecordTiming(branch.aStages[n], 0, false);
+			return false;
+		}
+	}
+
+	if (pStage->GetAccess() == StageAccess_InPlace && pStage->IsRowLocal())
+	{
+		// Every band goes through all the fused stages while it is still in the cache
+		int nStages = step.nLast - step.nFirst + 1;
+		std::vector<LONGLONG> aTicks(nStages, 0);
+		volatile LONGLONG* pllTicks = &aTicks[0];
+
+		BandContext context;
+		context.pPipeline = this;
+		context.pBranch = &branch;
+		context.pStep = &step;
+		context.pFrame = pFrame;
+		context.pllTicks = pllTicks;
+
+		int nBands = (pFrame->GetHeight() + PIPELINE_BAND_ROWS - 1) / PIPELINE_BAND_ROWS;
+
+		if (bParallel)
+		{
+			GetWorkers()->Run(BandProc, &context, nBands);
+		}
+		else
+		{
+			for (int n = 0; n < nBands; n++)
+			{
+				BandProc(&context, n);
+			}
+		}
+
+		for (int n = 0; n < nStages; n++)
+		{
+			RecordTiming(branch.aStages[step.nFirst + n], pllTicks[n], true);
+		}
+
+		return true;
+	}
+
+	LARGE_INTEGER liStart, liEnd;
+	QueryPerformanceCounter(&liStart);
+
+	HRESULT hr = S_OK;
+
+	switch (pStage->GetAccess())
+	{
+	case StageAccess_Read:
+		hr = pStage->Process(pFrame, NULL);
+		break;
+
+	case StageAccess_InPlace:
+		hr = pStage->Process(pFrame, pFrame);
+		break;
+
+	case StageAccess_OutOfPlace:
+		{
+			int nWidth, nHeight, nBitsPerPixel;
+			pStage->GetOutputFormat(pFrame->GetWidth(), pFrame->GetHeight(), pFrame->GetBitsPerPixel(), &nWidth, &nHeight, &nBitsPerPixel);
+
+			FrameBuffer* pOutput = AcquireLike(m_aStages[nStage].pOutputPool, pFrame, nWidth, nHeight, nBitsPerPixel);
+			if (pOutput == NULL)
+			{
+				hr = E_OUTOFMEMORY;
+			}
+			else
+			{
+				hr = pStage->Process(pFrame, pOutput);
+
+				pFrame->Release();
+				*ppFrame = pOutput;
+			}
+		}
+		break;
+	}
+
+	QueryPerformanceCounter(&liEnd);
+	RecordTiming(nStage, liEnd.QuadPart - liStart.QuadPart, SUCCEEDED(hr));
+
+	return SUCCEEDED(hr);
+}
+
+void ProcessingPipeline::BandProc(void* pContext, int nItem)
+{
+	BandContext* pBand = static_cast<BandContext*>(pContext);
+	ProcessingPipeline* pPipeline = pBand->pPipeline;
+
+	int nFirstRow = nItem * PIPELINE_BAND_ROWS;
+	int nRows = min(PIPELINE_BAND_ROWS, pBand->pFrame->GetHeight() - nFirstRow);
+
+	for (int n = pBand->pStep->nFirst; n <= pBand->pStep->nLast; n++)
+	{
+		ProcessingStage* pStage = pPipeline->m_aStages[pBand->pBranch->aStages[n]].pStage;
+
+		LARGE_INTEGER liStart, liEnd;
+		QueryPerformanceCounter(&liStart);
+
+		pStage->ProcessRows(pBand->pFrame, nFirstRow, nRows);
+
+		QueryPerformanceCounter(&liEnd);
+		InterlockedExchangeAdd64(&pBand->pllTicks[n - pBand->pStep->nFirst], liEnd.QuadPart - liStart.QuadPart);
+	}
+}
+
+void ProcessingPipeline::RecordTiming(int nStage, LONGLONG llTicks, bool bSucceeded)
+{
+	// Branches record concurrently, but each into its own stages
+	StageTiming& timing = m_aStages[nStage].timing;
+
+	timing.nFrames++;
+	timing.llTotalTicks += llTicks;
+	timing.llLastTicks = llTicks;
+	timing.llMaximumTicks = max(timing.llMaximumTicks, llTicks);
+
+	if (!bSucceeded)
+	{
+		timing.nFailures++;
+	}
+}
+#pragma endregion
+
+FrameBuffer* WebCamLib::AcquireLike(FramePool* pPool, const FrameBuffer* pTemplate, int nWidth, int nHeight, int nBitsPerPixel)
+{
+	FrameBuffer* result = pPool->Acquire(nWidth, pTemplate->IsBottomUp() ? nHeight : -nHeight, nBitsPerPixel);
+
+	if (result != NULL)
+	{
+		result->SetTimestamp(pTemplate->GetTimestamp(), pTemplate->GetSampleTime());
+		result->SetStatistics(pTemplate->GetStatistics());
+	}
+
+	return result;
+}
+
+#pragma managed(pop)
@@ -0,0 +1,247 @@
+//*****************************************************************************************
+//  File:       ProcessingPipeline.h
+//  Project:    WebcamLib
+//
+//  Declares the native stage graph run over each captured frame before it is delivered
+//*****************************************************************************************
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ThreadPlacement.h"
+
+#pragma managed(push, off)
+
+// Rows a fused pass hands to every stage before moving on; small enough to stay in the L1 cache
+#define PIPELINE_BAND_ROWS		16
+
+namespace WebCamLib
+{
+	class FrameBuffer;
+	class FramePool;
+	class WorkerPool;
+
+	/// <summary>
+	/// What a stage is for. The capture itself is the source every pipeline starts from.
+	/// </summary>
+	enum StageKind
+	{
+		StageKind_Convert,
+		StageKind_Transform,
+		StageKind_Analyse,
+		StageKind_Sink,
+	};
+
+	/// <summary>
+	/// How a stage treats the frame it is given
+	/// </summary>
+	enum StageAccess
+	{
+		StageAccess_Read,			// only looks at the frame
+		StageAccess_InPlace,		// changes the frame it is given
+		StageAccess_OutOfPlace,		// writes a new frame, of the format GetOutputFormat reports
+	};
+
+	/// <summary>
+	/// One step of a ProcessingPipeline. Stages are owned by the pipeline they are added to and
+	/// only ever run one frame at a time, though ProcessRows may run on several threads at once.
+	/// </summary>
+	class ProcessingStage
+	{
+	public:
+		ProcessingStage(StageKind eKind, StageAccess eAccess, const WCHAR* szName);
+		virtual ~ProcessingStage();
+
+		StageKind GetKind() const
+		{
+			return m_eKind;
+		}
+
+		StageAccess GetAccess() const
+		{
+			return m_eAccess;
+		}
+
+		const WCHAR* GetName() const
+		{
+			return m_strName.c_str();
+		}
+
+		void SetName(const WCHAR* szName)
+		{
+			m_strName = szName;
+		}
+
+		/// <summary>
+		/// Format an out-of-place stage writes for an input of the given format; by default the same
+		/// </summary>
+		virtual void GetOutputFormat(int nWidth, int nHeight, int nBitsPerPixel, int* pnWidth, int* pnHeight, int* pnBitsPerPixel) const;
+
+		/// <summary>
+		/// True for in-place stages whose every row only depends on the same row. These are run
+		/// through ProcessRows band by band, spread over the worker threads in the main chain, and
+		/// such stages next to each other are fused into a single pass over the frame.
+		/// </summary>
+		virtual bool IsRowLocal() const;
+
+		/// <summary>
+		/// Called with every frame before Process or ProcessRows, on the thread running the branch,
+		/// for stages to ready what they keep between frames; a failure fails the frame
+		/// </summary>
+		virtual HRESULT BeginFrame(FrameBuffer* pFrame);
+
+		/// <summary>
+		/// Processes a whole frame. pOutput is NULL for stages which read, the input itself for
+		/// in-place stages, and a frame of the output format for out-of-place ones.
+		/// </summary>
+		virtual HRESULT Process(FrameBuffer* pInput, FrameBuffer* pOutput) = 0;
+
+		/// <summary>
+		/// Processes nRows rows from nFirstRow on, counted in memory order
+		/// </summary>
+		virtual void ProcessRows(FrameBuffer* pFrame, int nFirstRow, int nRows);
+
+	private:
+		ProcessingStage(const ProcessingStage&);
+		ProcessingStage& operator=(const ProcessingStage&);
+
+		StageKind m_eKind;
+		StageAccess m_eAccess;
+		std::wstring m_strName;
+	};
+
+	/// <summary>
+	/// Time spent in a stage, in QueryPerformanceCounter ticks
+	/// </summary>
+	struct StageTiming
+	{
+		LONG nFrames;
+		LONG nFailures;
+		LONGLONG llTotalTicks;
+		LONGLONG llMaximumTicks;
+		LONGLONG llLastTicks;
+	};
+
+	/// <summary>
+	/// Stages declared once and run over every frame of a session. Branch 0 is the main chain,
+	/// run on the capture thread; its output is what the capture delivers. Every other branch
+	/// starts from that output and they all run in parallel on the pipeline's own worker threads,
+	/// e.g. one recording while another detects. A branch only copies the shared frame when a
+	/// stage would change it before anything has written a frame of the branch's own. Each
+	/// out-of-place stage and each copying branch recycles its frames through a pool of its own,
+	/// so no pool ever churns between formats. The pipeline is reference counted.
+	/// </summary>
+	class ProcessingPipeline
+	{
+	public:
+		ProcessingPipeline();
+
+		LONG AddRef();
+		LONG Release();
+
+		/// <summary>
+		/// Adds an empty branch starting from the main chain's output and returns its number
+		/// </summary>
+		int AddBranch();
+
+		int GetBranchCount();
+
+		/// <summary>
+		/// Appends a stage to a branch, which takes it over; E_INVALIDARG for a branch that does not exist
+		/// </summary>
+		HRESULT AddStage(int nBranch, ProcessingStage* pStage);
+
+		int GetStageCount();
+
+		/// <summary>
+		/// Copies out what is known about a stage; false when there is no such stage
+		/// </summary>
+		bool GetStageInfo(int nStage, const WCHAR** pszName, StageKind* peKind, int* pnBranch, bool* pbFused, StageTiming* pTiming);
+
+		void ResetTimings();
+
+		/// <summary>
+		/// Placement of the worker threads, applied now when they exist and otherwise once they are created
+		/// </summary>
+		HRESULT SetWorkerPlacement(const ThreadPlacement& placement);
+
+		/// <summary>
+		/// Runs the frame through every branch and returns the main chain's output with a reference of
+		/// its own, which may be the source itself; NULL when a stage of the main chain failed.
+		/// Returns once every branch is done with the frame.
+		/// </summary>
+		FrameBuffer* Run(FrameBuffer* pSource);
+
+	private:
+		ProcessingPipeline(const ProcessingPipeline&);
+		ProcessingPipeline& operator=(const ProcessingPipeline&);
+
+		~ProcessingPipeline();
+
+		struct StageEntry
+		{
+			ProcessingStage* pStage;
+			int nBranch;
+			bool bFused;
+			FramePool* pOutputPool;
+			StageTiming timing;
+		};
+
+		// Stages nFirst to nLast of a branch, more than one only for a fused run of row-local stages
+		struct Step
+		{
+			int nFirst;
+			int nLast;
+		};
+
+		struct Branch
+		{
+			std::vector<int> aStages;
+			std::vector<Step> aSteps;
+			bool bNeedsCopy;
+			FramePool* pCopyPool;
+		};
+
+		struct BandContext
+		{
+			ProcessingPipeline* pPipeline;
+			const Branch* pBranch;
+			const Step* pStep;
+			FrameBuffer* pFrame;
+			volatile LONGLONG* pllTicks;
+		};
+
+		static void BranchProc(void* pContext, int nItem);
+		static void BandProc(void* pContext, int nItem);
+
+		void Compile();
+		WorkerPool* GetWorkers();
+		FrameBuffer* RunBranch(const Branch& branch, FrameBuffer* pFrame, bool bParallel);
+		bool RunStep(const Branch& branch, const Step& step, FrameBuffer** ppFrame, bool bParallel);
+		void RecordTiming(int nStage, LONGLONG llTicks, bool bSucceeded);
+
+		volatile LONG m_nRefCount;
+		CRITICAL_SECTION m_cs;
+
+		std::vector<StageEntry> m_aStages;
+		std::vector<Branch> m_aBranches;
+		bool m_bCompiled;
+
+		WorkerPool* m_pWorkers;
+		ThreadPlacement m_workerPlacement;
+		bool m_bWorkerPlacementSet;
+
+		// The frame the branches being run start from
+		FrameBuffer* m_pBranchInput;
+	};
+
+	/// <summary>
+	/// Allocates a frame of the given format from a pool, with the timing and statistics of another
+	/// and rows in the same order
+	/// </summary>
+	FrameBuffer* AcquireLike(FramePool* pPool, const FrameBuffer* pTemplate, int nWidth, int nHeight, int nBitsPerPixel);
+}
+
+#pragma managed(pop)
@@ -0,0 +1,335 @@
+//*****************************************************************************************
+//  File:       ProcessingStages.cpp
+//  Project:    WebcamLib
+//
+//  Defines the stages ProcessingPipeline comes with
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "FrameBuffer.h"
+#include "FrameRing.h"
+#include "WorkerPool.h"
+#include "ProcessingStages.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+#pragma region ConvertStage
+ConvertStage::ConvertStage(int nBitsPerPixel)
+	: ProcessingStage(StageKind_Convert, StageAccess_OutOfPlace, L"Convert")
+{
+	m_nBitsPerPixel = nBitsPerPixel;
+}
+
+void ConvertStage::GetOutputFormat(int nWidth, int nHeight, int nBitsPerPixel, int* pnWidth, int* pnHeight, int* pnBitsPerPixel) const
+{
+	*pnWidth = nWidth;
+	*pnHeight = nHeight;
+	*pnBitsPerPixel = m_nBitsPerPixel;
+}
+
+HRESULT ConvertStage::Process(FrameBuffer* pInput, FrameBuffer* pOutput)
+{
+	int nInputBytes = pInput->GetBitsPerPixel() / 8;
+	int nOutputBytes = pOutput->GetBitsPerPixel() / 8;
+
+	if ((nInputBytes != 3 && nInputBytes != 4) || (nOutputBytes != 3 && nOutputBytes != 4))
+		return E_INVALIDARG;
+
+	int nWidth = pInput->GetWidth();
+
+	for (int y = 0; y < pInput->GetHeight(); y++)
+	{
+		const BYTE* pSource = pInput->GetData() + y * pInput->GetStride();
+		BYTE* pDestination = pOutput->GetData() + y * pOutput->GetStride();
+
+		if (nInputBytes == nOutputBytes)
+		{
+			CopyMemory(pDestination, pSource, nWidth * nInputBytes);
+		}
+		else if (nOutputBytes == 4)
+		{
+			for (int x = 0; x < nWidth; x++, pSource += 3, pDestination += 4)
+			{
+				pDestination[0] = pSource[0];
+				pDestination[1] = pSource[1];
+				pDestination[2] = pSource[2];
+				pDestination[3] = 0xFF;
+			}
+		}
+		else
+		{
+			for (int x = 0; x < nWidth; x++, pSource += 4, pDestination += 3)
+			{
+				pDestination[0] = pSource[0];
+				pDestination[1] = pSource[1];
+				pDestination[2] = pSource[2];
+			}
+		}
+	}
+
+	return S_OK;
+}
+#pragma endregion
+
+#pragma region MirrorStage
+MirrorStage::MirrorStage()
+	: ProcessingStage(StageKind_Transform, StageAccess_InPlace, L"Mirror")
+{
+}
+
+bool MirrorStage::IsRowLocal() const
+{
+	return true;
+}
+
+HRESULT MirrorStage::Process(FrameBuffer* pInput, FrameBuffer* pOutput)
+{
+	ProcessRows(pInput, 0, pInput->GetHeight());
+	return S_OK;
+}
+
+void MirrorStage::ProcessRows(FrameBuffer* pFrame, int nFirstRow, int nRows)
+{
+	int nBytes = pFrame->GetBitsPerPixel() / 8;
+	int nWidth = pFrame->GetWidth();
+
+	for (int y = nFirstRow; y < nFirstRow + nRows; y++)
+	{
+		BYTE* pLeft = pFrame->GetData() + y * pFrame->GetStride();
+		BYTE* pRight = pLeft + (nWidth - 1) * nBytes;
+
+		if (nBytes == 4)
+		{
+			for (; pLeft < pRight; pLeft += 4, pRight -= 4)
+			{
+				DWORD dwPixel = *reinterpret_cast<DWORD*>(pLeft);
+				*reinterpret_cast<DWORD*>(pLeft) = *reinterpret_cast<DWORD*>(pRight);
+				*reinterpret_cast<DWORD*>(pRight) = dwPixel;
+			}
+		}
+		else
+		{
+			for (; pLeft < pRight; pLeft += nBytes, pRight -= nBytes)
+			{
+				for (int n = 0; n < nBytes; n++)
+				{
+					BYTE b = pLeft[n];
+					pLeft[n] = pRight[n];
+					pRight[n] = b;
+				}
+			}
+		}
+	}
+}
+#pragma endregion
+
+#pragma region FlipStage
+FlipStage::FlipStage()
+	: ProcessingStage(StageKind_Transform, StageAccess_InPlace, L"Flip")
+{
+}
+
+HRESULT FlipStage::Process(FrameBuffer* pInput, FrameBuffer* pOutput)
+{
+	int nStride = pInput->GetStride();
+	BYTE* pTop = pInput->GetData();
+	BYTE* pBottom = pTop + (pInput->GetHeight() - 1) * nStride;
+
+	std::vector<BYTE> aRow(nStride);
+
+	for (; pTop < pBottom; pTop += nStride, pBottom -= nStride)
+	{
+		CopyMemory(&aRow[0], pTop, nStride);
+		CopyMemory(pTop, pBottom, nStride);
+		CopyMemory(pBottom, &aRow[0], nStride);
+	}
+
+	return S_OK;
+}
+#pragma endregion
+
+#pragma region StatisticsStage
+StatisticsStage::StatisticsStage(int nGridStep)
+	: ProcessingStage(StageKind_Analyse, StageAccess_InPlace, L"Statistics")
+{
+	m_calculator.SetGridStep(nGridStep);
+}
+
+HRESULT StatisticsStage::Process(FrameBuffer* pInput, FrameBuffer* pOutput)
+{
+	if (!m_calculator.Compute(pInput->GetData(), pInput->GetWidth(), pInput->GetHeight(), pInput->GetStride(), pInput->GetBitsPerPixel(), &m_statistics))
+		return E_INVALIDARG;
+
+	pInput->SetStatistics(&m_statistics);
+
+	return S_OK;
+}
+#pragma endregion
+
+#pragma region CallbackSink
+CallbackSink::CallbackSink(PFN_SinkCallback pfnCallback)
+	: ProcessingStage(StageKind_Sink, StageAccess_Read, L"Sink")
+{
+	m_pfnCallback = pfnCallback;
+}
+
+HRESULT CallbackSink::Process(FrameBuffer* pInput, FrameBuffer* pOutput)
+{
+	return m_pfnCallback(pInput);
+}
+#pragma endregion
+
+#pragma region RemapStage
+RemapStage::RemapStage()
+	: ProcessingStage(StageKind_Transform, StageAccess_OutOfPlace, L"Remap")
+{
+	m_table.SetWorkerPool(WorkerPool::GetShared());
+}
+
+HRESULT RemapStage::SetParameters(const RemapParameters& parameters)
+{
+	return m_table.SetParameters(parameters);
+}
+
+HRESULT RemapStage::Process(FrameBuffer* pInput, FrameBuffer* pOutput)
+{
+	int nHeight = pInput->GetHeight();
+
+	const BYTE* pSourceTop = pInput->GetData();
+	int nSourceStride = pInput->GetStride();
+	if (pInput->IsBottomUp())
+	{
+		pSourceTop += static_cast<ptrdiff_t>(nHeight - 1) * nSourceStride;
+		nSourceStride = -nSourceStride;
+	}
+
+	BYTE* pOutputTop = pOutput->GetData();
+	int nOutputStride = pOutput->GetStride();
+	if (pOutput->IsBottomUp())
+	{
+		pOutputTop += static_cast<ptrdiff_t>(nHeight - 1) * nOutputStride;
+		nOutputStride = -nOutputStride;
+	}
+
+	if (!m_table.Matches(pInput->GetWidth(), nHeight, pInput->GetBitsPerPixel(), nSourceStride))
+	{
+		HRESULT hr = m_table.Build(pInput->GetWidth(), nHeight, pInput->GetBitsPerPixel(), nSourceStride);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	return m_table.Apply(pSourceTop, pOutputTop, nOutputStride);
+}
+#pragma endregion
+
+#pragma region TemporalDenoiseStage
+TemporalDenoiseStage::TemporalDenoiseStage()
+	: ProcessingStage(StageKind_Transform, StageAccess_InPlace, L"Temporal denoise")
+{
+	m_bBottomUp = false;
+}
+
+HRESULT TemporalDenoiseStage::SetParameters(double dStrength, int nNoiseThreshold, int nMotionRange)
+{
+	return m_denoiser.SetParameters(dStrength, nNoiseThreshold, nMotionRange);
+}
+
+bool TemporalDenoiseStage::IsRowLocal() const
+{
+	return true;
+}
+
+HRESULT TemporalDenoiseStage::BeginFrame(FrameBuffer* pFrame)
+{
+	// Rows are filtered in memory order, which only lines up with the average in the same orientation
+	if (pFrame->IsBottomUp() != m_bBottomUp)
+	{
+		m_denoiser.Reset();
+		m_bBottomUp = pFrame->IsBottomUp();
+	}
+
+	return m_denoiser.BeginFrame(pFrame->GetWidth() * pFrame->GetBitsPerPixel() / 8, pFrame->GetHeight());
+}
+
+HRESULT TemporalDenoiseStage::Process(FrameBuffer* pInput, FrameBuffer* pOutput)
+{
+	ProcessRows(pInput, 0, pInput->GetHeight());
+	return S_OK;
+}
+
+void TemporalDenoiseStage::ProcessRows(FrameBuffer* pFrame, int nFirstRow, int nRows)
+{
+	for (int y = nFirstRow; y < nFirstRow + nRows; y++)
+	{
+		m_denoiser.FilterRow(pFrame->GetData() + y * pFrame->GetStride(), y);
+	}
+}
+#pragma endregion
+
+#pragma region StabiliseStage
+StabiliseStage::StabiliseStage()
+	: ProcessingStage(StageKind_Transform, StageAccess_OutOfPlace, L"Stabilise")
+{
+	m_stabiliser.SetWorkerPool(WorkerPool::GetShared());
+}
+
+HRESULT StabiliseStage::SetParameters(double dMargin, int nSmoothingFrames)
+{
+	return m_stabiliser.SetParameters(dMargin, nSmoothingFrames);
+}
+
+void StabiliseStage::GetOutputFormat(int nWidth, int nHeight, int nBitsPerPixel, int* pnWidth, int* pnHeight, int* pnBitsPerPixel) const
+{
+	m_stabiliser.GetOutputSize(nWidth, nHeight, pnWidth, pnHeight);
+	*pnBitsPerPixel = nBitsPerPixel;
+}
+
+HRESULT StabiliseStage::Process(FrameBuffer* pInput, FrameBuffer* pOutput)
+{
+	const BYTE* pSourceTop = pInput->GetData();
+	int nSourceStride = pInput->GetStride();
+	if (pInput->IsBottomUp())
+	{
+		pSourceTop += static_cast<ptrdiff_t>(pInput->GetHeight() - 1) * nSourceStride;
+		nSourceStride = -nSourceStride;
+	}
+
+	BYTE* pOutputTop = pOutput->GetData();
+	int nOutputStride = pOutput->GetStride();
+	if (pOutput->IsBottomUp())
+	{
+		pOutputTop += static_cast<ptrdiff_t>(pOutput->GetHeight() - 1) * nOutputStride;
+		nOutputStride = -nOutputStride;
+	}
+
+	return m_stabiliser.Stabilise(pSourceTop, nSourceStride, pInput->GetWidth(), pInput->GetHeight(), pInput->GetBitsPerPixel(),
+		pOutputTop, nOutputStride);
+}
+#pragma endregion
+
+#pragma region FrameRingSink
+FrameRingSink::FrameRingSink(FrameRing* pRing)
+	: ProcessingStage(StageKind_Sink, StageAccess_Read, L"Pre-event ring")
+{
+	m_pRing = pRing;
+	m_pRing->AddRef();
+}
+
+FrameRingSink::~FrameRingSink()
+{
+	m_pRing->Release();
+}
+
+HRESULT FrameRingSink::Process(FrameBuffer* pInput, FrameBuffer* pOutput)
+{
+	// A frame too large for the ring is counted there rather than failing the branch
+	HRESULT hr = m_pRing->Write(pInput);
+
+	return SUCCEEDED(hr) ? S_OK : hr;
+}
+#pragma endregion
+
+#pragma managed(pop)
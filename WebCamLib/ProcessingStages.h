@@ -0,0 +1,175 @@
+//*****************************************************************************************
+//  File:       ProcessingStages.h
+//  Project:    WebcamLib
+//
+//  Declares the stages ProcessingPipeline comes with
+//*****************************************************************************************
+
+#pragma once
+
+#include "ImageStatistics.h"
+#include "ProcessingPipeline.h"
+#include "RemapTable.h"
+#include "TemporalDenoiser.h"
+#include "VideoStabiliser.h"
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// Converts between 24 and 32 bit BGR; the unused byte of 32 bit pixels is set to 0xFF
+	/// </summary>
+	class ConvertStage : public ProcessingStage
+	{
+	public:
+		explicit ConvertStage(int nBitsPerPixel);
+
+		virtual void GetOutputFormat(int nWidth, int nHeight, int nBitsPerPixel, int* pnWidth, int* pnHeight, int* pnBitsPerPixel) const;
+		virtual HRESULT Process(FrameBuffer* pInput, FrameBuffer* pOutput);
+
+	private:
+		int m_nBitsPerPixel;
+	};
+
+	/// <summary>
+	/// Mirrors the image left to right
+	/// </summary>
+	class MirrorStage : public ProcessingStage
+	{
+	public:
+		MirrorStage();
+
+		virtual bool IsRowLocal() const;
+		virtual HRESULT Process(FrameBuffer* pInput, FrameBuffer* pOutput);
+		virtual void ProcessRows(FrameBuffer* pFrame, int nFirstRow, int nRows);
+	};
+
+	/// <summary>
+	/// Turns the image upside down
+	/// </summary>
+	class FlipStage : public ProcessingStage
+	{
+	public:
+		FlipStage();
+
+		virtual HRESULT Process(FrameBuffer* pInput, FrameBuffer* pOutput);
+	};
+
+	/// <summary>
+	/// Computes the frame's statistics and stores them with it, for the stages and consumers after it
+	/// </summary>
+	class StatisticsStage : public ProcessingStage
+	{
+	public:
+		explicit StatisticsStage(int nGridStep);
+
+		virtual HRESULT Process(FrameBuffer* pInput, FrameBuffer* pOutput);
+
+	private:
+		ImageStatisticsCalculator m_calculator;
+		ImageStatistics m_statistics;
+	};
+
+	/// <summary>
+	/// Hands each frame to a callback, which may take references of its own on it
+	/// </summary>
+	class CallbackSink : public ProcessingStage
+	{
+	public:
+		typedef HRESULT (__stdcall *PFN_SinkCallback)(FrameBuffer* pFrame);
+
+		explicit CallbackSink(PFN_SinkCallback pfnCallback);
+
+		virtual HRESULT Process(FrameBuffer* pInput, FrameBuffer* pOutput);
+
+	private:
+		PFN_SinkCallback m_pfnCallback;
+	};
+
+	/// <summary>
+	/// Undistorts and rectifies frames through a RemapTable, rebuilt only when the frame format
+	/// changes, i.e. when the camera is started at another size
+	/// </summary>
+	class RemapStage : public ProcessingStage
+	{
+	public:
+		RemapStage();
+
+		/// <summary>
+		/// E_INVALIDARG for parameters the table rejects
+		/// </summary>
+		HRESULT SetParameters(const RemapParameters& parameters);
+
+		virtual HRESULT Process(FrameBuffer* pInput, FrameBuffer* pOutput);
+
+	private:
+		RemapTable m_table;
+	};
+
+	/// <summary>
+	/// Averages sensor noise over frames, leaving what moves alone; see TemporalDenoiser.
+	/// Each stage keeps the average of the frames which pass through it, so it belongs in the
+	/// branch whose output should be denoised.
+	/// </summary>
+	class TemporalDenoiseStage : public ProcessingStage
+	{
+	public:
+		TemporalDenoiseStage();
+
+		/// <summary>
+		/// E_INVALIDARG for values out of range
+		/// </summary>
+		HRESULT SetParameters(double dStrength, int nNoiseThreshold, int nMotionRange);
+
+		virtual bool IsRowLocal() const;
+		virtual HRESULT BeginFrame(FrameBuffer* pFrame);
+		virtual HRESULT Process(FrameBuffer* pInput, FrameBuffer* pOutput);
+		virtual void ProcessRows(FrameBuffer* pFrame, int nFirstRow, int nRows);
+
+	private:
+		TemporalDenoiser m_denoiser;
+		bool m_bBottomUp;
+	};
+
+	/// <summary>
+	/// Steadies the frames of a shaking camera into frames cropped by the stabiliser's margin;
+	/// see VideoStabiliser. The camera's path is followed from frame to frame, so the stage
+	/// belongs on a branch every frame passes through.
+	/// </summary>
+	class StabiliseStage : public ProcessingStage
+	{
+	public:
+		StabiliseStage();
+
+		/// <summary>
+		/// E_INVALIDARG for values out of range
+		/// </summary>
+		HRESULT SetParameters(double dMargin, int nSmoothingFrames);
+
+		virtual void GetOutputFormat(int nWidth, int nHeight, int nBitsPerPixel, int* pnWidth, int* pnHeight, int* pnBitsPerPixel) const;
+		virtual HRESULT Process(FrameBuffer* pInput, FrameBuffer* pOutput);
+
+	private:
+		VideoStabiliser m_stabiliser;
+	};
+
+	class FrameRing;
+
+	/// <summary>
+	/// Keeps every frame in a FrameRing, for the seconds ahead of an event
+	/// </summary>
+	class FrameRingSink : public ProcessingStage
+	{
+	public:
+		explicit FrameRingSink(FrameRing* pRing);
+		virtual ~FrameRingSink();
+
+		virtual HRESULT Process(FrameBuffer* pInput, FrameBuffer* pOutput);
+
+	private:
+		FrameRing* m_pRing;
+	};
+}
+
+#pragma managed(pop)
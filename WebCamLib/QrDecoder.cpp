@@ -0,0 +1,1196 @@
+//*****************************************************************************************
+//  File:       QrDecoder.cpp
+//  Project:    WebcamLib
+//
+//  Defines the sampling and decoding of one QR code located by its finder patterns
+//*****************************************************************************************
+
+#include <windows.h>
+#include <math.h>
+
+#include "QrDecoder.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Format and version words are accepted this many bits away from a valid one
+#define QR_MAXIMUM_BIT_ERRORS		3
+
+// Data modules make 1:1:1 runs often enough, but rarely more than this many of the 25 modules
+// of an alignment pattern; perspective costs a few of the real one's
+#define QR_MAXIMUM_ALIGNMENT_MISMATCHES	4
+
+namespace
+{
+	// Error correction codewords per block, then the number of blocks and data codewords of the
+	// shorter blocks and of the blocks one longer, for error correction levels L, M, Q and H
+	struct BlockLayout
+	{
+		BYTE bCorrection;
+		BYTE bShortBlocks;
+		BYTE bShortData;
+		BYTE bLongBlocks;
+		BYTE bLongData;
+	};
+
+	const BlockLayout s_aLayouts[40][4] =
+	{
+		{ { 7, 1, 19, 0, 0 }, { 10, 1, 16, 0, 0 }, { 13, 1, 13, 0, 0 }, { 17, 1, 9, 0, 0 } },
+		{ { 10, 1, 34, 0, 0 }, { 16, 1, 28, 0, 0 }, { 22, 1, 22, 0, 0 }, { 28, 1, 16, 0, 0 } },
+		{ { 15, 1, 55, 0, 0 }, { 26, 1, 44, 0, 0 }, { 18, 2, 17, 0, 0 }, { 22, 2, 13, 0, 0 } },
+		{ { 20, 1, 80, 0, 0 }, { 18, 2, 32, 0, 0 }, { 26, 2, 24, 0, 0 }, { 16, 4, 9, 0, 0 } },
+		{ { 26, 1, 108, 0, 0 }, { 24, 2, 43, 0, 0 }, { 18, 2, 15, 2, 16 }, { 22, 2, 11, 2, 12 } },
+		{ { 18, 2, 68, 0, 0 }, { 16, 4, 27, 0, 0 }, { 24, 4, 19, 0, 0 }, { 28, 4, 15, 0, 0 } },
+		{ { 20, 2, 78, 0, 0 }, { 18, 4, 31, 0, 0 }, { 18, 2, 14, 4, 15 }, { 26, 4, 13, 1, 14 } },
+		{ { 24, 2, 97, 0, 0 }, { 22, 2, 38, 2, 39 }, { 22, 4, 18, 2, 19 }, { 26, 4, 14, 2, 15 } },
+		{ { 30, 2, 116, 0, 0 }, { 22, 3, 36, 2, 37 }, { 20, 4, 16, 4, 17 }, { 24, 4, 12, 4, 13 } },
+		{ { 18, 2, 68, 2, 69 }, { 26, 4, 43, 1, 44 }, { 24, 6, 19, 2, 20 }, { 28, 6, 15, 2, 16 } },
+		{ { 20, 4, 81, 0, 0 }, { 30, 1, 50, 4, 51 }, { 28, 4, 22, 4, 23 }, { 24, 3, 12, 8, 13 } },
+		{ { 24, 2, 92, 2, 93 }, { 22, 6, 36, 2, 37 }, { 26, 4, 20, 6, 21 }, { 28, 7, 14, 4, 15 } },
+		{ { 26, 4, 107, 0, 0 }, { 22, 8, 37, 1, 38 }, { 24, 8, 20, 4, 21 }, { 22, 12, 11, 4, 12 } },
+		{ { 30, 3, 115, 1, 116 }, { 24, 4, 40, 5, 41 }, { 20, 11, 16, 5, 17 }, { 24, 11, 12, 5, 13 } },
+		{ { 22, 5, 87, 1, 88 }, { 24, 5, 41, 5, 42 }, { 30, 5, 24, 7, 25 }, { 24, 11, 12, 7, 13 } },
+		{ { 24, 5, 98, 1, 99 }, { 28, 7, 45, 3, 46 }, { 24, 15, 19, 2, 20 }, { 30, 3, 15, 13, 16 } },
+		{ { 28, 1, 107, 5, 108 }, { 28, 10, 46, 1, 47 }, { 28, 1, 22, 15, 23 }, { 28, 2, 14, 17, 15 } },
+		{ { 30, 5, 120, 1, 121 }, { 26, 9, 43, 4, 44 }, { 28, 17, 22, 1, 23 }, { 28, 2, 14, 19, 15 } },
+		{ { 28, 3, 113, 4, 114 }, { 26, 3, 44, 11, 45 }, { 26, 17, 21, 4, 22 }, { 26, 9, 13, 16, 14 } },
+		{ { 28, 3, 107, 5, 108 }, { 26, 3, 41, 13, 42 }, { 30, 15, 24, 5, 25 }, { 28, 15, 15, 10, 16 } },
+		{ { 28, 4, 116, 4, 117 }, { 26, 17, 42, 0, 0 }, { 28, 17, 22, 6, 23 }, { 30, 19, 16, 6, 17 } },
+		{ { 28, 2, 111, 7, 112 }, { 28, 17, 46, 0, 0 }, { 30, 7, 24, 16, 25 }, { 24, 34, 13, 0, 0 } },
+		{ { 30, 4, 121, 5, 122 }, { 28, 4, 47, 14, 48 }, { 30, 11, 24, 14, 25 }, { 30, 16, 15, 14, 16 } },
+		{ { 30, 6, 117, 4, 118 }, { 28, 6, 45, 14, 46 }, { 30, 11, 24, 16, 25 }, { 30, 30, 16, 2, 17 } },
+		{ { 26, 8, 106, 4, 107 }, { 28, 8, 47, 13, 48 }, { 30, 7, 24, 22, 25 }, { 30, 22, 15, 13, 16 } },
+		{ { 28, 10, 114, 2, 115 }, { 28, 19, 46, 4, 47 }, { 28, 28, 22, 6, 23 }, { 30, 33, 16, 4, 17 } },
+		{ { 30, 8, 122, 4, 123 }, { 28, 22, 45, 3, 46 }, { 30, 8, 23, 26, 24 }, { 30, 12, 15, 28, 16 } },
+		{ { 30, 3, 117, 10, 118 }, { 28, 3, 45, 23, 46 }, { 30, 4, 24, 31, 25 }, { 30, 11, 15, 31, 16 } },
+		{ { 30, 7, 116, 7, 117 }, { 28, 21, 45, 7, 46 }, { 30, 1, 23, 37, 24 }, { 30, 19, 15, 26, 16 } },
+		{ { 30, 5, 115, 10, 116 }, { 28, 19, 47, 10, 48 }, { 30, 15, 24, 25, 25 }, { 30, 23, 15, 25, 16 } },
+		{ { 30, 13, 115, 3, 116 }, { 28, 2, 46, 29, 47 }, { 30, 42, 24, 1, 25 }, { 30, 23, 15, 28, 16 } },
+		{ { 30, 17, 115, 0, 0 }, { 28, 10, 46, 23, 47 }, { 30, 10, 24, 35, 25 }, { 30, 19, 15, 35, 16 } },
+		{ { 30, 17, 115, 1, 116 }, { 28, 14, 46, 21, 47 }, { 30, 29, 24, 19, 25 }, { 30, 11, 15, 46, 16 } },
+		{ { 30, 13, 115, 6, 116 }, { 28, 14, 46, 23, 47 }, { 30, 44, 24, 7, 25 }, { 30, 59, 16, 1, 17 } },
+		{ { 30, 12, 121, 7, 122 }, { 28, 12, 47, 26, 48 }, { 30, 39, 24, 14, 25 }, { 30, 22, 15, 41, 16 } },
+		{ { 30, 6, 121, 14, 122 }, { 28, 6, 47, 34, 48 }, { 30, 46, 24, 10, 25 }, { 30, 2, 15, 64, 16 } },
+		{ { 30, 17, 122, 4, 123 }, { 28, 29, 46, 14, 47 }, { 30, 49, 24, 10, 25 }, { 30, 24, 15, 46, 16 } },
+		{ { 30, 4, 122, 18, 123 }, { 28, 13, 46, 32, 47 }, { 30, 48, 24, 14, 25 }, { 30, 42, 15, 32, 16 } },
+		{ { 30, 20, 117, 4, 118 }, { 28, 40, 47, 7, 48 }, { 30, 43, 24, 22, 25 }, { 30, 10, 15, 67, 16 } },
+		{ { 30, 19, 118, 6, 119 }, { 28, 18, 47, 31, 48 }, { 30, 34, 24, 34, 25 }, { 30, 20, 15, 61, 16 } },
+	};
+
+	const char s_szAlphanumeric[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+	inline int Round(double dValue)
+	{
+		return static_cast<int>(floor(dValue + 0.5));
+	}
+
+	inline int CountBits(int nValue)
+	{
+		int nCount = 0;
+		for (; nValue != 0; nValue &= nValue - 1)
+		{
+			nCount++;
+		}
+
+		return nCount;
+	}
+
+	// BCH(15, 5) format word of 2 bits of error correction level and 3 of mask, as stored
+	int GetFormatWord(int nData)
+	{
+		int nRemainder = nData << 10;
+		for (int nBit = 14; nBit >= 10; nBit--)
+		{
+			if ((nRemainder & (1 << nBit)) != 0)
+			{
+				nRemainder ^= 0x537 << (nBit - 10);
+			}
+		}
+
+		return ((nData << 10) | nRemainder) ^ 0x5412;
+	}
+
+	// BCH(18, 6) version word
+	int GetVersionWord(int nVersion)
+	{
+		int nRemainder = nVersion << 12;
+		for (int nBit = 17; nBit >= 12; nBit--)
+		{
+			if ((nRemainder & (1 << nBit)) != 0)
+			{
+				nRemainder ^= 0x1F25 << (nBit - 12);
+			}
+		}
+
+		return (nVersion << 12) | nRemainder;
+	}
+
+	// Centres of the alignment patterns along either axis, returning how many there are
+	int GetAlignmentCenters(int nVersion, int* anCenters)
+	{
+		if (nVersion == 1)
+			return 0;
+
+		int nCount = nVersion / 7 + 2;
+		int nStep = nVersion == 32 ? 26 : (nVersion * 4 + nCount * 2 + 1) / (nCount * 2 - 2) * 2;
+
+		anCenters[0] = 6;
+		for (int n = nCount - 1, nPosition = nVersion * 4 + 10; n >= 1; n--, nPosition -= nStep)
+		{
+			anCenters[n] = nPosition;
+		}
+
+		return nCount;
+	}
+
+	bool IsMasked(int nMask, int nRow, int nColumn)
+	{
+		switch (nMask)
+		{
+		case 0: return ((nRow + nColumn) & 1) == 0;
+		case 1: return (nRow & 1) == 0;
+		case 2: return nColumn % 3 == 0;
+		case 3: return (nRow + nColumn) % 3 == 0;
+		case 4: return ((nRow / 2 + nColumn / 3) & 1) == 0;
+		case 5: return (nRow * nColumn) % 2 + (nRow * nColumn) % 3 == 0;
+		case 6: return (((nRow * nColumn) % 2 + (nRow * nColumn) % 3) & 1) == 0;
+		default: return (((nRow + nColumn) % 2 + (nRow * nColumn) % 3) & 1) == 0;
+		}
+	}
+
+	void SetRegion(std::vector<BYTE>& abModules, int nDimension, int nLeft, int nTop, int nWidth, int nHeight)
+	{
+		for (int y = nTop; y < nTop + nHeight; y++)
+		{
+			for (int x = nLeft; x < nLeft + nWidth; x++)
+			{
+				abModules[y * nDimension + x] = 1;
+			}
+		}
+	}
+
+	// Reads the segments' bit stream most significant bit first
+	class BitReader
+	{
+	public:
+		BitReader(const BYTE* pData, int nBytes)
+		{
+			m_pData = pData;
+			m_nBits = nBytes * 8;
+			m_nPosition = 0;
+		}
+
+		int GetAvailable() const
+		{
+			return m_nBits - m_nPosition;
+		}
+
+		bool Read(int nBits, int* pnValue)
+		{
+			if (nBits > GetAvailable())
+				return false;
+
+			int nValue = 0;
+			for (int n = 0; n < nBits; n++, m_nPosition++)
+			{
+				nValue = (nValue << 1) | ((m_pData[m_nPosition >> 3] >> (7 - (m_nPosition & 7))) & 1);
+			}
+
+			*pnValue = nValue;
+			return true;
+		}
+
+	private:
+		const BYTE* m_pData;
+		int m_nBits;
+		int m_nPosition;
+	};
+}
+
+QrDecoder::QrDecoder()
+{
+	m_pBinary = NULL;
+	m_nWidth = 0;
+	m_nHeight = 0;
+	m_nDimension = 0;
+
+	// Powers of the generator 2 modulo x^8 + x^4 + x^3 + x^2 + 1, doubled up so products need no modulo
+	int nValue = 1;
+	for (int n = 0; n < 255; n++)
+	{
+		m_abExp[n] = m_abExp[n + 255] = static_cast<BYTE>(nValue);
+		m_anLog[nValue] = n;
+
+		nValue <<= 1;
+		if (nValue & 0x100)
+		{
+			nValue ^= 0x11D;
+		}
+	}
+
+	m_abExp[510] = m_abExp[511] = m_abExp[0];
+	m_anLog[0] = 0;
+}
+
+HRESULT QrDecoder::Decode(const BYTE* pBinary, int nWidth, int nHeight, const QrCandidate& candidate, std::vector<BYTE>* pData, QrPoint* apCorners)
+{
+	m_pBinary = pBinary;
+	m_nWidth = nWidth;
+	m_nHeight = nHeight;
+
+	// Finder centres are the dimension less 7 modules apart
+	double dTop = sqrt((candidate.topRight.fX - candidate.topLeft.fX) * (candidate.topRight.fX - candidate.topLeft.fX) + (candidate.topRight.fY - candidate.topLeft.fY) * (candidate.topRight.fY - candidate.topLeft.fY));
+	double dLeft = sqrt((candidate.bottomLeft.fX - candidate.topLeft.fX) * (candidate.bottomLeft.fX - candidate.topLeft.fX) + (candidate.bottomLeft.fY - candidate.topLeft.fY) * (candidate.bottomLeft.fY - candidate.topLeft.fY));
+
+	// The module size is good to a few percent, which can put a large code between two versions;
+	// when the nearer one's grid does not decode the other is tried
+	float fModuleSize = MeasureModuleSize(candidate);
+	double dVersion = ((dTop + dLeft) / (2.0 * fModuleSize) - 10.0) / 4.0;
+
+	int anVersions[2];
+	anVersions[0] = Round(dVersion);
+	anVersions[1] = dVersion >= anVersions[0] ? anVersions[0] + 1 : anVersions[0] - 1;
+
+	for (int n = 0; n < 2; n++)
+	{
+		int nVersion = anVersions[n];
+		if (nVersion < 1 || nVersion > 40)
+			continue;
+
+		if (!Sample(candidate, nVersion * 4 + 17, fModuleSize, apCorners))
+			continue;
+
+		// From version 7 on the version is written out, which beats the estimate
+		if (nVersion >= 7)
+		{
+			int nWritten = ReadVersion();
+
+			if (nWritten > 0 && nWritten != nVersion)
+			{
+				nVersion = nWritten;
+
+				if (!Sample(candidate, nVersion * 4 + 17, fModuleSize, apCorners))
+					continue;
+			}
+		}
+
+		if (DecodeModules(nVersion, pData))
+			return S_OK;
+	}
+
+	return S_FALSE;
+}
+
+bool QrDecoder::Solve(const double* pdSource, const double* pdTarget, Transform* pTransform)
+{
+	// Eight equations in the first eight coefficients, the last being one
+	double aadSystem[8][9];
+
+	for (int n = 0; n < 4; n++)
+	{
+		double dU = pdSource[n * 2];
+		double dV = pdSource[n * 2 + 1];
+		double dX = pdTarget[n * 2];
+		double dY = pdTarget[n * 2 + 1];
+
+		double adRowX[9] = { dU, dV, 1.0, 0.0, 0.0, 0.0, -dU * dX, -dV * dX, dX };
+		double adRowY[9] = { 0.0, 0.0, 0.0, dU, dV, 1.0, -dU * dY, -dV * dY, dY };
+
+		CopyMemory(aadSystem[n * 2], adRowX, sizeof(adRowX));
+		CopyMemory(aadSystem[n * 2 + 1], adRowY, sizeof(adRowY));
+	}
+
+	for (int nColumn = 0; nColumn < 8; nColumn++)
+	{
+		int nPivot = nColumn;
+		for (int nRow = nColumn + 1; nRow < 8; nRow++)
+		{
+			if (fabs(aadSystem[nRow][nColumn]) > fabs(aadSystem[nPivot][nColumn]))
+			{
+				nPivot = nRow;
+			}
+		}
+
+		if (fabs(aadSystem[nPivot][nColumn]) < 1e-12)
+			return false;
+
+		for (int n = 0; n < 9; n++)
+		{
+			double dSwap = aadSystem[nColumn][n];
+			aadSystem[nColumn][n] = aadSystem[nPivot][n];
+			aadSystem[nPivot][n] = dSwap;
+		}
+
+		for (int nRow = 0; nRow < 8; nRow++)
+		{
+			if (nRow == nColumn)
+				continue;
+
+			double dFactor = aadSystem[nRow][nColumn] / aadSystem[nColumn][nColumn];
+			for (int n = nColumn; n < 9; n++)
+			{
+				aadSystem[nRow][n] -= dFactor * aadSystem[nColumn][n];
+			}
+		}
+	}
+
+	for (int n = 0; n < 8; n++)
+	{
+		pTransform->adH[n] = aadSystem[n][8] / aadSystem[n][n];
+	}
+
+	pTransform->adH[8] = 1.0;
+
+	return true;
+}
+
+float QrDecoder::MeasureFinder(const QrPoint& center, float fDX, float fDY) const
+{
+	// Dark core, light ring, dark ring, then light again
+	int nState = 0;
+
+	for (float fStep = 0.0f; ; fStep += 0.5f)
+	{
+		int x = static_cast<int>(center.fX + fDX * fStep);
+		int y = static_cast<int>(center.fY + fDY * fStep);
+
+		if (x < 0 || y < 0 || x >= m_nWidth || y >= m_nHeight)
+			return -1.0f;
+
+		bool bDark = m_pBinary[y * m_nWidth + x] != 0;
+		if (bDark == ((nState & 1) != 0))
+		{
+			if (++nState == 3)
+				return fStep;
+		}
+	}
+}
+
+float QrDecoder::MeasureModuleSize(const QrCandidate& candidate) const
+{
+	const QrPoint* apLines[2][2] = { { &candidate.topLeft, &candidate.topRight }, { &candidate.topLeft, &candidate.bottomLeft } };
+	float fTotal = 0.0f;
+	int nMeasured = 0;
+
+	// Across each end of both sides, through the centre, is 7 modules
+	for (int nLine = 0; nLine < 2; nLine++)
+	{
+		for (int nEnd = 0; nEnd < 2; nEnd++)
+		{
+			const QrPoint& from = *apLines[nLine][nEnd];
+			const QrPoint& to = *apLines[nLine][1 - nEnd];
+
+			float fLength = sqrt((to.fX - from.fX) * (to.fX - from.fX) + (to.fY - from.fY) * (to.fY - from.fY));
+			if (fLength < 1.0f)
+				continue;
+
+			float fDX = (to.fX - from.fX) / fLength;
+			float fDY = (to.fY - from.fY) / fLength;
+
+			float fForward = MeasureFinder(from, fDX, fDY);
+			float fBackward = MeasureFinder(from, -fDX, -fDY);
+
+			if (fForward > 0.0f && fBackward > 0.0f)
+			{
+				fTotal += (fForward + fBackward) / 7.0f;
+				nMeasured++;
+			}
+		}
+	}
+
+	return nMeasured > 0 ? fTotal / nMeasured : candidate.fModuleSize;
+}
+
+bool QrDecoder::FindAlignment(float fX, float fY, float fModuleSize, const float* afAxes, QrPoint* pAlignment) const
+{
+	// Widen the search until something alignment pattern like turns up near the estimate
+	// The next alignment pattern is at least 16 modules on, so the search stops short of it
+	for (int nFactor = 4; nFactor <= 8; nFactor *= 2)
+	{
+		int nAllowance = static_cast<int>(nFactor * fModuleSize);
+		int nLeft = max(0, static_cast<int>(fX) - nAllowance);
+		int nRight = min(m_nWidth - 1, static_cast<int>(fX) + nAllowance);
+		int nTop = max(0, static_cast<int>(fY) - nAllowance);
+		int nBottom = min(m_nHeight - 1, static_cast<int>(fY) + nAllowance);
+
+		if (nRight - nLeft < fModuleSize * 3 || nBottom - nTop < fModuleSize * 3)
+			return false;
+
+		float fBestDistance = -1.0f;
+		int nBestMismatches = 0;
+
+		for (int y = nTop; y <= nBottom; y++)
+		{
+			const BYTE* pRow = m_pBinary + y * m_nWidth;
+
+			// Light, dark and light runs of a module each; the leading light run is not measured
+			int anRuns[3] = { 0, 0, 0 };
+			int nState = 0;
+			int x = nLeft;
+
+			while (x <= nRight && pRow[x] == 0)
+			{
+				x++;
+			}
+
+			for (; x <= nRight + 1; x++)
+			{
+				bool bDark = x <= nRight && pRow[x] != 0;
+
+				if (x > nRight || (bDark && nState == 2))
+				{
+					bool bMatch = true;
+					for (int n = 0; n < 3; n++)
+					{
+						bMatch = bMatch && fabs(fModuleSize - anRuns[n]) < fModuleSize / 2.0f;
+					}
+
+					if (bMatch)
+					{
+						int nTotal = anRuns[0] + anRuns[1] + anRuns[2];
+						float fCenterX = x - anRuns[2] - anRuns[1] / 2.0f;
+						float fCenterY = CrossCheckAlignment(static_cast<int>(fCenterX), y, 2 * anRuns[1], nTotal);
+
+						int nMismatches = fCenterY >= 0.0f ? CountAlignmentMismatches(fCenterX, fCenterY, afAxes) : QR_MAXIMUM_ALIGNMENT_MISMATCHES + 1;
+
+						if (nMismatches <= QR_MAXIMUM_ALIGNMENT_MISMATCHES)
+						{
+							float fDistance = (fCenterX - fX) * (fCenterX - fX) + (fCenterY - fY) * (fCenterY - fY);
+
+							// The best formed pattern, and of those the nearest
+							if (fBestDistance < 0.0f || nMismatches < nBestMismatches || (nMismatches == nBestMismatches && fDistance < fBestDistance))
+							{
+								nBestMismatches = nMismatches;
+								fBestDistance = fDistance;
+								pAlignment->fX = fCenterX;
+								pAlignment->fY = fCenterY;
+							}
+						}
+					}
+
+					if (x > nRight)
+						break;
+
+					anRuns[0] = anRuns[2];
+					anRuns[1] = 1;
+					anRuns[2] = 0;
+					nState = 1;
+				}
+				else if (bDark)
+				{
+					if (nState == 0)
+					{
+						nState = 1;
+					}
+
+					anRuns[1]++;
+				}
+				else
+				{
+					if (nState == 1)
+					{
+						nState = 2;
+					}
+
+					anRuns[nState]++;
+				}
+			}
+		}
+
+		if (fBestDistance >= 0.0f)
+			return true;
+
+		// Small rotated modules break up into runs too uneven to pass, but the pattern still matches
+		if (MatchAlignment(nLeft, nTop, nRight, nBottom, fModuleSize, afAxes, pAlignment))
+			return true;
+	}
+
+	return false;
+}
+
+bool QrDecoder::MatchAlignment(int nLeft, int nTop, int nRight, int nBottom, float fModuleSize, const float* afAxes, QrPoint* pAlignment) const
+{
+	int nBest = QR_MAXIMUM_ALIGNMENT_MISMATCHES + 1;
+	int nBestX = 0;
+	int nBestY = 0;
+
+	for (int y = nTop; y <= nBottom; y++)
+	{
+		for (int x = nLeft; x <= nRight; x++)
+		{
+			int nMismatches = CountAlignmentMismatches(x + 0.5f, y + 0.5f, afAxes);
+
+			if (nMismatches < nBest)
+			{
+				nBest = nMismatches;
+				nBestX = x;
+				nBestY = y;
+			}
+		}
+	}
+
+	if (nBest > QR_MAXIMUM_ALIGNMENT_MISMATCHES)
+		return false;
+
+	// Every position matching as well within a module lies on the centre module; their mean is its centre
+	int nReach = static_cast<int>(fModuleSize);
+	float fSumX = 0.0f;
+	float fSumY = 0.0f;
+	int nCount = 0;
+
+	for (int y = max(nTop, nBestY - nReach); y <= min(nBottom, nBestY + nReach); y++)
+	{
+		for (int x = max(nLeft, nBestX - nReach); x <= min(nRight, nBestX + nReach); x++)
+		{
+			if (CountAlignmentMismatches(x + 0.5f, y + 0.5f, afAxes) == nBest)
+			{
+				fSumX += x + 0.5f;
+				fSumY += y + 0.5f;
+				nCount++;
+			}
+		}
+	}
+
+	pAlignment->fX = fSumX / nCount;
+	pAlignment->fY = fSumY / nCount;
+
+	return true;
+}
+
+int QrDecoder::CountAlignmentMismatches(float fX, float fY, const float* afAxes) const
+{
+	int nMismatches = 0;
+
+	for (int nRow = -2; nRow <= 2; nRow++)
+	{
+		for (int nColumn = -2; nColumn <= 2; nColumn++)
+		{
+			int x = static_cast<int>(fX + nColumn * afAxes[0] + nRow * afAxes[2]);
+			int y = static_cast<int>(fY + nColumn * afAxes[1] + nRow * afAxes[3]);
+
+			if (x < 0 || y < 0 || x >= m_nWidth || y >= m_nHeight)
+				return 25;
+
+			bool bDark = max(abs(nRow), abs(nColumn)) != 1;
+			if ((m_pBinary[y * m_nWidth + x] != 0) != bDark)
+			{
+				nMismatches++;
+			}
+		}
+	}
+
+	return nMismatches;
+}
+
+float QrDecoder::CrossCheckAlignment(int nX, int nY, int nMaximumRun, int nTotal) const
+{
+	int anRuns[3] = { 0, 0, 0 };
+
+	int y = nY;
+	while (y >= 0 && m_pBinary[y * m_nWidth + nX] != 0 && anRuns[1] <= nMaximumRun)
+	{
+		anRuns[1]++;
+		y--;
+	}
+
+	if (y < 0 || anRuns[1] > nMaximumRun)
+		return -1.0f;
+
+	while (y >= 0 && m_pBinary[y * m_nWidth + nX] == 0 && anRuns[0] <= nMaximumRun)
+	{
+		anRuns[0]++;
+		y--;
+	}
+
+	if (anRuns[0] > nMaximumRun)
+		return -1.0f;
+
+	y = nY + 1;
+	while (y < m_nHeight && m_pBinary[y * m_nWidth + nX] != 0 && anRuns[1] <= nMaximumRun)
+	{
+		anRuns[1]++;
+		y++;
+	}
+
+	if (y == m_nHeight || anRuns[1] > nMaximumRun)
+		return -1.0f;
+
+	while (y < m_nHeight && m_pBinary[y * m_nWidth + nX] == 0 && anRuns[2] <= nMaximumRun)
+	{
+		anRuns[2]++;
+		y++;
+	}
+
+	if (anRuns[2] > nMaximumRun)
+		return -1.0f;
+
+	int nCrossTotal = anRuns[0] + anRuns[1] + anRuns[2];
+	if (5 * abs(nCrossTotal - nTotal) >= 2 * nTotal)
+		return -1.0f;
+
+	float fModuleSize = nTotal / 3.0f;
+	for (int n = 0; n < 3; n++)
+	{
+		if (fabs(fModuleSize - anRuns[n]) >= fModuleSize / 2.0f)
+			return -1.0f;
+	}
+
+	return y - anRuns[2] - anRuns[1] / 2.0f;
+}
+
+bool QrDecoder::Sample(const QrCandidate& candidate, int nDimension, float fModuleSize, QrPoint* apCorners)
+{
+	m_nDimension = nDimension;
+
+	double dFar = nDimension - 3.5;
+	double adSource[8] = { 3.5, 3.5, dFar, 3.5, dFar, dFar, 3.5, dFar };
+	double adTarget[8] =
+	{
+		candidate.topLeft.fX, candidate.topLeft.fY,
+		candidate.topRight.fX, candidate.topRight.fY,
+		candidate.topRight.fX + candidate.bottomLeft.fX - candidate.topLeft.fX, candidate.topRight.fY + candidate.bottomLeft.fY - candidate.topLeft.fY,
+		candidate.bottomLeft.fX, candidate.bottomLeft.fY,
+	};
+
+	// The bottom right alignment pattern sits 3 modules in from where a fourth finder would be;
+	// without it the code is taken to be a parallelogram
+	if (nDimension >= 25)
+	{
+		double dInset = 1.0 - 3.0 / (nDimension - 7);
+		float fEstimateX = static_cast<float>(candidate.topLeft.fX + dInset * (adTarget[4] - candidate.topLeft.fX));
+		float fEstimateY = static_cast<float>(candidate.topLeft.fY + dInset * (adTarget[5] - candidate.topLeft.fY));
+
+		float fSpan = static_cast<float>(nDimension - 7);
+		float afAxes[4] =
+		{
+			(candidate.topRight.fX - candidate.topLeft.fX) / fSpan, (candidate.topRight.fY - candidate.topLeft.fY) / fSpan,
+			(candidate.bottomLeft.fX - candidate.topLeft.fX) / fSpan, (candidate.bottomLeft.fY - candidate.topLeft.fY) / fSpan,
+		};
+
+		QrPoint alignment;
+		if (FindAlignment(fEstimateX, fEstimateY, fModuleSize, afAxes, &alignment))
+		{
+			adSource[4] = adSource[5] = nDimension - 6.5;
+			adTarget[4] = alignment.fX;
+			adTarget[5] = alignment.fY;
+		}
+	}
+
+	Transform transform;
+	if (!Solve(adSource, adTarget, &transform))
+		return false;
+
+	m_abModules.resize(nDimension * nDimension);
+
+	for (int nRow = 0; nRow < nDimension; nRow++)
+	{
+		for (int nColumn = 0; nColumn < nDimension; nColumn++)
+		{
+			double dX, dY;
+			transform.Map(nColumn + 0.5, nRow + 0.5, &dX, &dY);
+
+			// Modules a pixel outside the image are pulled in; any further means a wrong guess
+			int x = static_cast<int>(floor(dX));
+			int y = static_cast<int>(floor(dY));
+
+			if (x < -1 || y < -1 || x > m_nWidth || y > m_nHeight)
+				return false;
+
+			x = min(max(x, 0), m_nWidth - 1);
+			y = min(max(y, 0), m_nHeight - 1);
+
+			m_abModules[nRow * nDimension + nColumn] = m_pBinary[y * m_nWidth + x];
+		}
+	}
+
+	double dSize = nDimension;
+	const double adCorners[8] = { 0.0, 0.0, dSize, 0.0, dSize, dSize, 0.0, dSize };
+	for (int n = 0; n < 4; n++)
+	{
+		double dX, dY;
+		transform.Map(adCorners[n * 2], adCorners[n * 2 + 1], &dX, &dY);
+
+		apCorners[n].fX = static_cast<float>(dX);
+		apCorners[n].fY = static_cast<float>(dY);
+	}
+
+	return true;
+}
+
+int QrDecoder::ReadFormat() const
+{
+	int nDimension = m_nDimension;
+
+	// Around the top left finder, and split between the other two
+	int nFirst = 0;
+	for (int n = 0; n < 6; n++)
+	{
+		nFirst = (nFirst << 1) | (IsModuleDark(n, 8) ? 1 : 0);
+	}
+
+	nFirst = (nFirst << 1) | (IsModuleDark(7, 8) ? 1 : 0);
+	nFirst = (nFirst << 1) | (IsModuleDark(8, 8) ? 1 : 0);
+	nFirst = (nFirst << 1) | (IsModuleDark(8, 7) ? 1 : 0);
+
+	for (int n = 5; n >= 0; n--)
+	{
+		nFirst = (nFirst << 1) | (IsModuleDark(8, n) ? 1 : 0);
+	}
+
+	int nSecond = 0;
+	for (int n = nDimension - 1; n >= nDimension - 7; n--)
+	{
+		nSecond = (nSecond << 1) | (IsModuleDark(8, n) ? 1 : 0);
+	}
+
+	for (int n = nDimension - 8; n < nDimension; n++)
+	{
+		nSecond = (nSecond << 1) | (IsModuleDark(n, 8) ? 1 : 0);
+	}
+
+	int nBest = -1;
+	int nBestErrors = QR_MAXIMUM_BIT_ERRORS + 1;
+
+	for (int nData = 0; nData < 32; nData++)
+	{
+		int nWord = GetFormatWord(nData);
+		int nErrors = min(CountBits(nWord ^ nFirst), CountBits(nWord ^ nSecond));
+
+		if (nErrors < nBestErrors)
+		{
+			nBest = nData;
+			nBestErrors = nErrors;
+		}
+	}
+
+	return nBest;
+}
+
+int QrDecoder::ReadVersion() const
+{
+	int nDimension = m_nDimension;
+
+	// Above the bottom left finder and left of the top right one, transposed
+	int nFirst = 0;
+	int nSecond = 0;
+
+	for (int j = 5; j >= 0; j--)
+	{
+		for (int i = nDimension - 9; i >= nDimension - 11; i--)
+		{
+			nFirst = (nFirst << 1) | (IsModuleDark(i, j) ? 1 : 0);
+			nSecond = (nSecond << 1) | (IsModuleDark(j, i) ? 1 : 0);
+		}
+	}
+
+	int nBest = -1;
+	int nBestErrors = QR_MAXIMUM_BIT_ERRORS + 1;
+
+	for (int nVersion = 7; nVersion <= 40; nVersion++)
+	{
+		int nWord = GetVersionWord(nVersion);
+		int nErrors = min(CountBits(nWord ^ nFirst), CountBits(nWord ^ nSecond));
+
+		if (nErrors < nBestErrors)
+		{
+			nBest = nVersion;
+			nBestErrors = nErrors;
+		}
+	}
+
+	return nBest;
+}
+
+void QrDecoder::BuildFunctionPattern(int nVersion)
+{
+	int nDimension = m_nDimension;
+
+	m_abFunction.assign(nDimension * nDimension, 0);
+
+	// Finders with their separators and the format
+	SetRegion(m_abFunction, nDimension, 0, 0, 9, 9);
+	SetRegion(m_abFunction, nDimension, nDimension - 8, 0, 8, 9);
+	SetRegion(m_abFunction, nDimension, 0, nDimension - 8, 9, 8);
+
+	int anCenters[7];
+	int nCenters = GetAlignmentCenters(nVersion, anCenters);
+
+	for (int i = 0; i < nCenters; i++)
+	{
+		for (int j = 0; j < nCenters; j++)
+		{
+			// None where the finders are
+			if ((i == 0 && (j == 0 || j == nCenters - 1)) || (i == nCenters - 1 && j == 0))
+				continue;
+
+			SetRegion(m_abFunction, nDimension, anCenters[i] - 2, anCenters[j] - 2, 5, 5);
+		}
+	}
+
+	// Timing patterns
+	SetRegion(m_abFunction, nDimension, 6, 9, 1, nDimension - 17);
+	SetRegion(m_abFunction, nDimension, 9, 6, nDimension - 17, 1);
+
+	if (nVersion >= 7)
+	{
+		SetRegion(m_abFunction, nDimension, nDimension - 11, 0, 3, 6);
+		SetRegion(m_abFunction, nDimension, 0, nDimension - 11, 6, 3);
+	}
+}
+
+bool QrDecoder::DecodeModules(int nVersion, std::vector<BYTE>* pData)
+{
+	int nFormat = ReadFormat();
+	if (nFormat < 0)
+		return false;
+
+	// Levels are stored as M, L, H, Q
+	const BlockLayout& layout = s_aLayouts[nVersion - 1][(nFormat >> 3) ^ 1];
+	int nMask = nFormat & 7;
+	int nDimension = m_nDimension;
+
+	BuildFunctionPattern(nVersion);
+
+	int nBlocks = layout.bShortBlocks + layout.bLongBlocks;
+	int nTotal = layout.bShortBlocks * (layout.bShortData + layout.bCorrection) + layout.bLongBlocks * (layout.bLongData + layout.bCorrection);
+
+	// Codewords run in two module wide columns from the bottom right, up and down in turn,
+	// stepping over the vertical timing pattern
+	m_abCodewords.assign(nTotal, 0);
+
+	int nBits = 0;
+	bool bUpwards = true;
+
+	for (int nRight = nDimension - 1; nRight > 0 && nBits < nTotal * 8; nRight -= 2)
+	{
+		if (nRight == 6)
+		{
+			nRight--;
+		}
+
+		for (int nCount = 0; nCount < nDimension; nCount++)
+		{
+			int nRow = bUpwards ? nDimension - 1 - nCount : nCount;
+
+			for (int nColumn = nRight; nColumn > nRight - 2; nColumn--)
+			{
+				if (m_abFunction[nRow * nDimension + nColumn] != 0 || nBits >= nTotal * 8)
+					continue;
+
+				bool bDark = IsModuleDark(nColumn, nRow) != IsMasked(nMask, nRow, nColumn);
+				if (bDark)
+				{
+					m_abCodewords[nBits >> 3] |= 0x80 >> (nBits & 7);
+				}
+
+				nBits++;
+			}
+		}
+
+		bUpwards = !bUpwards;
+	}
+
+	// Blocks are interleaved codeword by codeword; the long blocks' extra data codeword comes last
+	int nLongest = layout.bLongBlocks > 0 ? layout.bLongData : layout.bShortData;
+	m_abBlock.resize(nLongest + layout.bCorrection);
+	m_abData.clear();
+
+	for (int nBlock = 0; nBlock < nBlocks; nBlock++)
+	{
+		bool bLong = nBlock >= layout.bShortBlocks;
+		int nData = bLong ? layout.bLongData : layout.bShortData;
+
+		for (int n = 0; n < nData; n++)
+		{
+			// The extra codewords follow the full rounds of the short blocks' data
+			int nIndex = n < layout.bShortData ? n * nBlocks + nBlock : layout.bShortData * nBlocks + (nBlock - layout.bShortBlocks);
+			m_abBlock[n] = m_abCodewords[nIndex];
+		}
+
+		int nDataTotal = layout.bShortData * layout.bShortBlocks + layout.bLongData * layout.bLongBlocks;
+		for (int n = 0; n < layout.bCorrection; n++)
+		{
+			m_abBlock[nData + n] = m_abCodewords[nDataTotal + n * nBlocks + nBlock];
+		}
+
+		if (!CorrectBlock(&m_abBlock[0], nData + layout.bCorrection, layout.bCorrection))
+			return false;
+
+		m_abData.insert(m_abData.end(), m_abBlock.begin(), m_abBlock.begin() + nData);
+	}
+
+	return ParseSegments(nVersion, pData);
+}
+
+bool QrDecoder::CorrectBlock(BYTE* pBlock, int nTotal, int nCorrection)
+{
+	// Syndromes are the block evaluated at the generator's roots, 2^0 upwards
+	BYTE abSyndromes[64];
+	bool bClean = true;
+
+	for (int i = 0; i < nCorrection; i++)
+	{
+		BYTE bValue = 0;
+		for (int n = 0; n < nTotal; n++)
+		{
+			bValue = Multiply(bValue, m_abExp[i]) ^ pBlock[n];
+		}
+
+		abSyndromes[i] = bValue;
+		bClean = bClean && bValue == 0;
+	}
+
+	if (bClean)
+		return true;
+
+	// Berlekamp-Massey for the error locator
+	BYTE abLocator[65] = { 1 };
+	BYTE abPrevious[65] = { 1 };
+	BYTE abSaved[65];
+	int nErrors = 0;
+	int nShift = 1;
+	BYTE bLastDiscrepancy = 1;
+
+	for (int n = 0; n < nCorrection; n++)
+	{
+		BYTE bDiscrepancy = abSyndromes[n];
+		for (int i = 1; i <= nErrors; i++)
+		{
+			bDiscrepancy ^= Multiply(abLocator[i], abSyndromes[n - i]);
+		}
+
+		if (bDiscrepancy == 0)
+		{
+			nShift++;
+			continue;
+		}
+
+		BYTE bFactor = Divide(bDiscrepancy, bLastDiscrepancy);
+		bool bGrow = 2 * nErrors <= n;
+
+		if (bGrow)
+		{
+			CopyMemory(abSaved, abLocator, sizeof(abSaved));
+		}
+
+		for (int i = 0; i + nShift <= nCorrection; i++)
+		{
+			abLocator[i + nShift] ^= Multiply(bFactor, abPrevious[i]);
+		}
+
+		if (bGrow)
+		{
+			nErrors = n + 1 - nErrors;
+			CopyMemory(abPrevious, abSaved, sizeof(abPrevious));
+			bLastDiscrepancy = bDiscrepancy;
+			nShift = 1;
+		}
+		else
+		{
+			nShift++;
+		}
+	}
+
+	if (2 * nErrors > nCorrection)
+		return false;
+
+	// Error evaluator: syndromes times locator, modulo x^nCorrection
+	BYTE abEvaluator[64];
+	for (int k = 0; k < nCorrection; k++)
+	{
+		BYTE bValue = 0;
+		for (int i = 0; i <= min(k, nErrors); i++)
+		{
+			bValue ^= Multiply(abLocator[i], abSyndromes[k - i]);
+		}
+
+		abEvaluator[k] = bValue;
+	}
+
+	// Chien search for the locator's roots, Forney for the error values
+	int nFound = 0;
+
+	for (int n = 0; n < nTotal; n++)
+	{
+		int nPower = nTotal - 1 - n;
+		BYTE bInverse = m_abExp[(255 - nPower) % 255];
+
+		BYTE bLocator = 0;
+		for (int i = nErrors; i >= 0; i--)
+		{
+			bLocator = Multiply(bLocator, bInverse) ^ abLocator[i];
+		}
+
+		if (bLocator != 0)
+			continue;
+
+		BYTE bEvaluator = 0;
+		for (int i = nCorrection - 1; i >= 0; i--)
+		{
+			bEvaluator = Multiply(bEvaluator, bInverse) ^ abEvaluator[i];
+		}
+
+		// The formal derivative keeps the odd terms
+		BYTE bDerivative = 0;
+		for (int i = 1; i <= nErrors; i += 2)
+		{
+			bDerivative ^= Multiply(abLocator[i], m_abExp[((255 - nPower) * (i - 1)) % 255]);
+		}
+
+		if (bDerivative == 0)
+			return false;
+
+		pBlock[n] ^= Multiply(m_abExp[nPower], Divide(bEvaluator, bDerivative));
+		nFound++;
+	}
+
+	return nFound == nErrors;
+}
+
+bool QrDecoder::ParseSegments(int nVersion, std::vector<BYTE>* pData)
+{
+	pData->clear();
+
+	// Character count widths of numeric, alphanumeric, byte and kanji segments by version band
+	int nBand = nVersion <= 9 ? 0 : (nVersion <= 26 ? 1 : 2);
+	const int aanCountBits[3][4] = { { 10, 9, 8, 8 }, { 12, 11, 16, 10 }, { 14, 13, 16, 12 } };
+
+	BitReader reader(&m_abData[0], static_cast<int>(m_abData.size()));
+
+	while (reader.GetAvailable() >= 4)
+	{
+		int nMode, nCount, nValue;
+		reader.Read(4, &nMode);
+
+		switch (nMode)
+		{
+		case 0x0:
+			// Terminator
+			return true;
+
+		case 0x1:
+			if (!reader.Read(aanCountBits[nBand][0], &nCount))
+				return false;
+
+			for (; nCount >= 3; nCount -= 3)
+			{
+				if (!reader.Read(10, &nValue) || nValue >= 1000)
+					return false;
+
+				pData->push_back(static_cast<BYTE>('0' + nValue / 100));
+				pData->push_back(static_cast<BYTE>('0' + nValue / 10 % 10));
+				pData->push_back(static_cast<BYTE>('0' + nValue % 10));
+			}
+
+			if (nCount == 2)
+			{
+				if (!reader.Read(7, &nValue) || nValue >= 100)
+					return false;
+
+				pData->push_back(static_cast<BYTE>('0' + nValue / 10));
+				pData->push_back(static_cast<BYTE>('0' + nValue % 10));
+			}
+			else if (nCount == 1)
+			{
+				if (!reader.Read(4, &nValue) || nValue >= 10)
+					return false;
+
+				pData->push_back(static_cast<BYTE>('0' + nValue));
+			}
+			break;
+
+		case 0x2:
+			if (!reader.Read(aanCountBits[nBand][1], &nCount))
+				return false;
+
+			for (; nCount >= 2; nCount -= 2)
+			{
+				if (!reader.Read(11, &nValue) || nValue >= 45 * 45)
+					return false;
+
+				pData->push_back(static_cast<BYTE>(s_szAlphanumeric[nValue / 45]));
+				pData->push_back(static_cast<BYTE>(s_szAlphanumeric[nValue % 45]));
+			}
+
+			if (nCount == 1)
+			{
+				if (!reader.Read(6, &nValue) || nValue >= 45)
+					return false;
+
+				pData->push_back(static_cast<BYTE>(s_szAlphanumeric[nValue]));
+			}
+			break;
+
+		case 0x4:
+			if (!reader.Read(aanCountBits[nBand][2], &nCount))
+				return false;
+
+			for (; nCount > 0; nCount--)
+			{
+				if (!reader.Read(8, &nValue))
+					return false;
+
+				pData->push_back(static_cast<BYTE>(nValue));
+			}
+			break;
+
+		case 0x8:
+			if (!reader.Read(aanCountBits[nBand][3], &nCount))
+				return false;
+
+			// Thirteen bits per character, expanded back to Shift JIS
+			for (; nCount > 0; nCount--)
+			{
+				if (!reader.Read(13, &nValue))
+					return false;
+
+				int nCode = ((nValue / 0xC0) << 8) | (nValue % 0xC0);
+				nCode += nCode < 0x1F00 ? 0x8140 : 0xC140;
+
+				pData->push_back(static_cast<BYTE>(nCode >> 8));
+				pData->push_back(static_cast<BYTE>(nCode));
+			}
+			break;
+
+		case 0x7:
+			// ECI designator of one to three bytes, which only says how to read the bytes
+			if (!reader.Read(8, &nValue))
+				return false;
+
+			if ((nValue & 0xC0) == 0x80)
+			{
+				if (!reader.Read(8, &nValue))
+					return false;
+			}
+			else if ((nValue & 0xE0) == 0xC0)
+			{
+				if (!reader.Read(16, &nValue))
+					return false;
+			}
+			break;
+
+		case 0x3:
+			// Structured append header: position, total and parity
+			if (!reader.Read(16, &nValue))
+				return false;
+			break;
+
+		case 0x5:
+			break;
+
+		case 0x9:
+			// FNC1 in second position carries an application indicator
+			if (!reader.Read(8, &nValue))
+				return false;
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#pragma managed(pop)
@@ -0,0 +1,121 @@
+//*****************************************************************************************
+//  File:       QrDecoder.h
+//  Project:    WebcamLib
+//
+//  Declares the sampling and decoding of one QR code located by its finder patterns
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#include "QrFinder.h"
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// Reads the QR code a candidate's finder patterns frame: estimates the version from their
+	/// spacing, locks onto the bottom right alignment pattern to undo perspective, samples the
+	/// module grid and decodes it with Reed-Solomon error correction. Numeric, alphanumeric, byte
+	/// and kanji segments are supported; the content comes out as the bytes they encode.
+	/// </summary>
+	class QrDecoder
+	{
+	public:
+		QrDecoder();
+
+		/// <summary>
+		/// Decodes the code into pData and its four corners, clockwise from the top left, into
+		/// apCorners; S_FALSE when the candidate cannot be read
+		/// </summary>
+		HRESULT Decode(const BYTE* pBinary, int nWidth, int nHeight, const QrCandidate& candidate, std::vector<BYTE>* pData, QrPoint* apCorners);
+
+	private:
+		QrDecoder(const QrDecoder&);
+		QrDecoder& operator=(const QrDecoder&);
+
+		// Grid position to image position, as a projective transform
+		struct Transform
+		{
+			double adH[9];
+
+			void Map(double dU, double dV, double* pdX, double* pdY) const
+			{
+				double dW = adH[6] * dU + adH[7] * dV + adH[8];
+				*pdX = (adH[0] * dU + adH[1] * dV + adH[2]) / dW;
+				*pdY = (adH[3] * dU + adH[4] * dV + adH[5]) / dW;
+			}
+		};
+
+		static bool Solve(const double* pdSource, const double* pdTarget, Transform* pTransform);
+
+		// Distance from a finder centre to the end of its outer dark ring along a direction, 3.5
+		// modules, or a negative value when the image ends first
+		float MeasureFinder(const QrPoint& center, float fDX, float fDY) const;
+
+		// Module size along the lines joining the finders, which a rotation does not stretch
+		float MeasureModuleSize(const QrCandidate& candidate) const;
+
+		// Searches around the estimate; afAxes are the steps of one module along a row and a column
+		bool FindAlignment(float fX, float fY, float fModuleSize, const float* afAxes, QrPoint* pAlignment) const;
+
+		// Slides the pattern itself over the window, for when its runs are too ragged to find
+		bool MatchAlignment(int nLeft, int nTop, int nRight, int nBottom, float fModuleSize, const float* afAxes, QrPoint* pAlignment) const;
+
+		// Samples the 5 by 5 modules around a point, counting those unlike the alignment pattern's
+		// dark centre, light ring and dark ring
+		int CountAlignmentMismatches(float fX, float fY, const float* afAxes) const;
+
+		float CrossCheckAlignment(int nX, int nY, int nMaximumRun, int nTotal) const;
+
+		bool Sample(const QrCandidate& candidate, int nDimension, float fModuleSize, QrPoint* apCorners);
+
+		bool IsModuleDark(int nColumn, int nRow) const
+		{
+			return m_abModules[nRow * m_nDimension + nColumn] != 0;
+		}
+
+		// Error correction level and mask, or -1 when neither copy of the format is readable
+		int ReadFormat() const;
+
+		// Version from the blocks beside the finders, or -1 when neither is readable
+		int ReadVersion() const;
+
+		void BuildFunctionPattern(int nVersion);
+
+		bool DecodeModules(int nVersion, std::vector<BYTE>* pData);
+
+		bool CorrectBlock(BYTE* pBlock, int nTotal, int nCorrection);
+
+		bool ParseSegments(int nVersion, std::vector<BYTE>* pData);
+
+		BYTE Multiply(BYTE a, BYTE b) const
+		{
+			return a == 0 || b == 0 ? 0 : m_abExp[m_anLog[a] + m_anLog[b]];
+		}
+
+		BYTE Divide(BYTE a, BYTE b) const
+		{
+			return a == 0 ? 0 : m_abExp[m_anLog[a] + 255 - m_anLog[b]];
+		}
+
+		const BYTE* m_pBinary;
+		int m_nWidth;
+		int m_nHeight;
+
+		int m_nDimension;
+		std::vector<BYTE> m_abModules;
+		std::vector<BYTE> m_abFunction;
+		std::vector<BYTE> m_abCodewords;
+		std::vector<BYTE> m_abBlock;
+		std::vector<BYTE> m_abData;
+
+		// GF(256) with the QR code polynomial
+		BYTE m_abExp[512];
+		int m_anLog[256];
+	};
+}
+
+#pragma managed(pop)
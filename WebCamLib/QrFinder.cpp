@@ -0,0 +1,372 @@
+//*****************************************************************************************
+//  File:       QrFinder.cpp
+//  Project:    WebcamLib
+//
+//  Defines the search for QR code finder patterns in a binarised frame
+//*****************************************************************************************
+
+#include <algorithm>
+#include <windows.h>
+#include <math.h>
+
+#include "QrFinder.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Patterns confirmed on fewer rows are too likely to be noise
+#define QR_PATTERN_QUORUM			2
+
+// Patterns beyond this many are not grouped, to bound the search for triples
+#define QR_MAXIMUM_PATTERNS			32
+
+// Finder centres are 14 modules apart in version 1 codes and 170 in version 40 ones; runs along
+// the rows of a rotated code overstate the module size by up to a factor of 1.4
+#define QR_MINIMUM_SPAN				9.0f
+#define QR_MAXIMUM_SPAN				180.0f
+
+// Tolerated skew: the ratio of the two sides and the error of Pythagoras, relative
+#define QR_MAXIMUM_SIDE_RATIO		1.3f
+#define QR_MAXIMUM_ANGLE_ERROR		0.3f
+#define QR_MAXIMUM_MODULE_RATIO		1.5f
+
+namespace
+{
+	inline float DistanceSquared(float fX1, float fY1, float fX2, float fY2)
+	{
+		return (fX1 - fX2) * (fX1 - fX2) + (fY1 - fY2) * (fY1 - fY2);
+	}
+}
+
+QrFinder::QrFinder()
+{
+	m_pBinary = NULL;
+	m_nWidth = 0;
+	m_nHeight = 0;
+}
+
+bool QrFinder::IsFinderRatio(const int* anRuns)
+{
+	int nTotal = 0;
+
+	for (int n = 0; n < 5; n++)
+	{
+		if (anRuns[n] == 0)
+			return false;
+
+		nTotal += anRuns[n];
+	}
+
+	if (nTotal < 7)
+		return false;
+
+	float fModule = nTotal / 7.0f;
+	float fVariance = fModule / 2.0f;
+
+	return fabs(fModule - anRuns[0]) < fVariance && fabs(fModule - anRuns[1]) < fVariance &&
+		fabs(3.0f * fModule - anRuns[2]) < 3.0f * fVariance &&
+		fabs(fModule - anRuns[3]) < fVariance && fabs(fModule - anRuns[4]) < fVariance;
+}
+
+void QrFinder::Find(const BYTE* pBinary, int nWidth, int nHeight, int nRowStep)
+{
+	m_pBinary = pBinary;
+	m_nWidth = nWidth;
+	m_nHeight = nHeight;
+
+	m_aPatterns.clear();
+	m_aCandidates.clear();
+
+	if (nRowStep < 1)
+	{
+		nRowStep = 1;
+	}
+
+	for (int y = nRowStep / 2; y < nHeight; y += nRowStep)
+	{
+		const BYTE* pRow = pBinary + y * nWidth;
+
+		// Runs of the current dark, light, dark, light, dark attempt; even states count dark pixels
+		int anRuns[5] = { 0, 0, 0, 0, 0 };
+		int nState = 0;
+
+		for (int x = 0; x < nWidth; x++)
+		{
+			if (pRow[x] != 0)
+			{
+				if ((nState & 1) != 0)
+				{
+					nState++;
+				}
+
+				anRuns[nState]++;
+			}
+			else if ((nState & 1) == 0)
+			{
+				if (nState == 4)
+				{
+					if (IsFinderRatio(anRuns))
+					{
+						AddCandidate(anRuns, y, x);
+					}
+
+					// Keep the last dark, light, dark as the start of the next attempt
+					anRuns[0] = anRuns[2];
+					anRuns[1] = anRuns[3];
+					anRuns[2] = anRuns[4];
+					anRuns[3] = 1;
+					anRuns[4] = 0;
+					nState = 3;
+				}
+				else
+				{
+					anRuns[++nState]++;
+				}
+			}
+			else
+			{
+				anRuns[nState]++;
+			}
+		}
+
+		if (nState == 4 && IsFinderRatio(anRuns))
+		{
+			AddCandidate(anRuns, y, nWidth);
+		}
+	}
+
+	GroupPatterns();
+}
+
+void QrFinder::AddCandidate(const int* anRuns, int nRow, int nEnd)
+{
+	int nTotal = anRuns[0] + anRuns[1] + anRuns[2] + anRuns[3] + anRuns[4];
+	float fX = nEnd - anRuns[4] - anRuns[3] - anRuns[2] / 2.0f;
+
+	float fY = CrossCheck(static_cast<int>(fX), nRow, true, anRuns[2], nTotal);
+	if (fY < 0.0f)
+		return;
+
+	// Recentre along the row through the corrected centre
+	fX = CrossCheck(static_cast<int>(fX), static_cast<int>(fY), false, anRuns[2], nTotal);
+	if (fX < 0.0f)
+		return;
+
+	float fModule = nTotal / 7.0f;
+
+	for (size_t n = 0; n < m_aPatterns.size(); n++)
+	{
+		Pattern& pattern = m_aPatterns[n];
+
+		if (fabs(pattern.fX - fX) <= fModule && fabs(pattern.fY - fY) <= fModule &&
+			(fabs(pattern.fModuleSize - fModule) <= 1.0f || fabs(pattern.fModuleSize - fModule) <= pattern.fModuleSize))
+		{
+			float fCount = static_cast<float>(pattern.nCount);
+			pattern.fX = (pattern.fX * fCount + fX) / (fCount + 1.0f);
+			pattern.fY = (pattern.fY * fCount + fY) / (fCount + 1.0f);
+			pattern.fModuleSize = (pattern.fModuleSize * fCount + fModule) / (fCount + 1.0f);
+			pattern.nCount++;
+			return;
+		}
+	}
+
+	Pattern pattern;
+	pattern.fX = fX;
+	pattern.fY = fY;
+	pattern.fModuleSize = fModule;
+	pattern.nCount = 1;
+	pattern.bUsed = false;
+
+	m_aPatterns.push_back(pattern);
+}
+
+float QrFinder::CrossCheck(int nX, int nY, bool bVertical, int nMaximumRun, int nTotal) const
+{
+	const BYTE* pLine = bVertical ? m_pBinary + nX : m_pBinary + nY * m_nWidth;
+	int nStep = bVertical ? m_nWidth : 1;
+	int nLength = bVertical ? m_nHeight : m_nWidth;
+	int nCenter = bVertical ? nY : nX;
+
+	int anRuns[5] = { 0, 0, 0, 0, 0 };
+
+	// Out from the centre: the dark core, the light ring and the dark ring, on either side
+	int n = nCenter;
+	while (n >= 0 && pLine[n * nStep] != 0)
+	{
+		anRuns[2]++;
+		n--;
+	}
+
+	while (n >= 0 && pLine[n * nStep] == 0 && anRuns[1] <= nMaximumRun)
+	{
+		anRuns[1]++;
+		n--;
+	}
+
+	if (n < 0 || anRuns[1] > nMaximumRun)
+		return -1.0f;
+
+	while (n >= 0 && pLine[n * nStep] != 0 && anRuns[0] <= nMaximumRun)
+	{
+		anRuns[0]++;
+		n--;
+	}
+
+	if (anRuns[0] > nMaximumRun)
+		return -1.0f;
+
+	n = nCenter + 1;
+	while (n < nLength && pLine[n * nStep] != 0)
+	{
+		anRuns[2]++;
+		n++;
+	}
+
+	while (n < nLength && pLine[n * nStep] == 0 && anRuns[3] <= nMaximumRun)
+	{
+		anRuns[3]++;
+		n++;
+	}
+
+	if (n == nLength || anRuns[3] > nMaximumRun)
+		return -1.0f;
+
+	while (n < nLength && pLine[n * nStep] != 0 && anRuns[4] <= nMaximumRun)
+	{
+		anRuns[4]++;
+		n++;
+	}
+
+	if (anRuns[4] > nMaximumRun)
+		return -1.0f;
+
+	// The pattern is square, so it spans about as much this way as the other
+	int nCrossTotal = anRuns[0] + anRuns[1] + anRuns[2] + anRuns[3] + anRuns[4];
+	if (5 * abs(nCrossTotal - nTotal) >= 2 * nTotal)
+		return -1.0f;
+
+	if (!IsFinderRatio(anRuns))
+		return -1.0f;
+
+	return n - anRuns[4] - anRuns[3] - anRuns[2] / 2.0f;
+}
+
+bool QrFinder::CompareCount(const Pattern& a, const Pattern& b)
+{
+	return a.nCount > b.nCount;
+}
+
+bool QrFinder::CompareScore(const Triple& a, const Triple& b)
+{
+	return a.fScore < b.fScore;
+}
+
+void QrFinder::GroupPatterns()
+{
+	// Patterns confirmed on several rows first, and only as many as are worth pairing up
+	size_t cKept = 0;
+	for (size_t n = 0; n < m_aPatterns.size(); n++)
+	{
+		if (m_aPatterns[n].nCount >= QR_PATTERN_QUORUM)
+		{
+			m_aPatterns[cKept++] = m_aPatterns[n];
+		}
+	}
+
+	m_aPatterns.resize(cKept);
+	std::stable_sort(m_aPatterns.begin(), m_aPatterns.end(), CompareCount);
+
+	if (m_aPatterns.size() > QR_MAXIMUM_PATTERNS)
+	{
+		m_aPatterns.resize(QR_MAXIMUM_PATTERNS);
+	}
+
+	int nPatterns = static_cast<int>(m_aPatterns.size());
+	m_aTriples.clear();
+
+	for (int i = 0; i < nPatterns; i++)
+	{
+		for (int j = i + 1; j < nPatterns; j++)
+		{
+			for (int k = j + 1; k < nPatterns; k++)
+			{
+				const Pattern* apPatterns[3] = { &m_aPatterns[i], &m_aPatterns[j], &m_aPatterns[k] };
+				int anIndices[3] = { i, j, k };
+
+				float fSmallest = min(apPatterns[0]->fModuleSize, min(apPatterns[1]->fModuleSize, apPatterns[2]->fModuleSize));
+				float fLargest = max(apPatterns[0]->fModuleSize, max(apPatterns[1]->fModuleSize, apPatterns[2]->fModuleSize));
+
+				if (fLargest > fSmallest * QR_MAXIMUM_MODULE_RATIO)
+					continue;
+
+				// The corner is the pattern facing the longest side
+				float afSides[3];
+				for (int n = 0; n < 3; n++)
+				{
+					const Pattern* pA = apPatterns[(n + 1) % 3];
+					const Pattern* pB = apPatterns[(n + 2) % 3];
+					afSides[n] = DistanceSquared(pA->fX, pA->fY, pB->fX, pB->fY);
+				}
+
+				int nCorner = afSides[0] >= afSides[1] ? (afSides[0] >= afSides[2] ? 0 : 2) : (afSides[1] >= afSides[2] ? 1 : 2);
+				float fSideA = afSides[(nCorner + 1) % 3];
+				float fSideB = afSides[(nCorner + 2) % 3];
+
+				float fSideRatio = sqrt(max(fSideA, fSideB) / min(fSideA, fSideB));
+				float fAngleError = fabs(afSides[nCorner] - fSideA - fSideB) / (fSideA + fSideB);
+
+				if (fSideRatio > QR_MAXIMUM_SIDE_RATIO || fAngleError > QR_MAXIMUM_ANGLE_ERROR)
+					continue;
+
+				float fModule = (apPatterns[0]->fModuleSize + apPatterns[1]->fModuleSize + apPatterns[2]->fModuleSize) / 3.0f;
+				float fSpan = sqrt(min(fSideA, fSideB)) / fModule;
+
+				if (fSpan < QR_MINIMUM_SPAN || fSpan > QR_MAXIMUM_SPAN)
+					continue;
+
+				Triple triple;
+				triple.anPatterns[0] = anIndices[nCorner];
+				triple.anPatterns[1] = anIndices[(nCorner + 1) % 3];
+				triple.anPatterns[2] = anIndices[(nCorner + 2) % 3];
+				triple.fScore = (fSideRatio - 1.0f) + fAngleError;
+
+				m_aTriples.push_back(triple);
+			}
+		}
+	}
+
+	// The squarest triples claim their patterns first
+	std::sort(m_aTriples.begin(), m_aTriples.end(), CompareScore);
+
+	for (size_t n = 0; n < m_aTriples.size(); n++)
+	{
+		const Triple& triple = m_aTriples[n];
+		Pattern& corner = m_aPatterns[triple.anPatterns[0]];
+		Pattern& first = m_aPatterns[triple.anPatterns[1]];
+		Pattern& second = m_aPatterns[triple.anPatterns[2]];
+
+		if (corner.bUsed || first.bUsed || second.bUsed)
+			continue;
+
+		corner.bUsed = first.bUsed = second.bUsed = true;
+
+		// With y pointing down, the top right pattern lies clockwise from the bottom left one
+		bool bFirstIsRight = (first.fX - corner.fX) * (second.fY - corner.fY) - (first.fY - corner.fY) * (second.fX - corner.fX) > 0.0f;
+		const Pattern& topRight = bFirstIsRight ? first : second;
+		const Pattern& bottomLeft = bFirstIsRight ? second : first;
+
+		QrCandidate candidate;
+		candidate.topLeft.fX = corner.fX;
+		candidate.topLeft.fY = corner.fY;
+		candidate.topRight.fX = topRight.fX;
+		candidate.topRight.fY = topRight.fY;
+		candidate.bottomLeft.fX = bottomLeft.fX;
+		candidate.bottomLeft.fY = bottomLeft.fY;
+		candidate.fModuleSize = (corner.fModuleSize + topRight.fModuleSize + bottomLeft.fModuleSize) / 3.0f;
+
+		m_aCandidates.push_back(candidate);
+	}
+}
+
+#pragma managed(pop)
@@ -0,0 +1,103 @@
+//*****************************************************************************************
+//  File:       QrFinder.h
+//  Project:    WebcamLib
+//
+//  Declares the search for QR code finder patterns in a binarised frame
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	struct QrPoint
+	{
+		float fX;
+		float fY;
+	};
+
+	/// <summary>
+	/// Three finder patterns laid out as the corners of one QR code, centres in pixels
+	/// </summary>
+	struct QrCandidate
+	{
+		QrPoint topLeft;
+		QrPoint topRight;
+		QrPoint bottomLeft;
+		float fModuleSize;
+	};
+
+	/// <summary>
+	/// Finds the 1:1:3:1:1 dark and light runs of QR finder patterns along rows of a binary image,
+	/// confirms each across the column and the row through its centre, and groups the patterns into
+	/// candidate codes: three of a size forming a right angle. Nothing is decoded here.
+	/// </summary>
+	class QrFinder
+	{
+	public:
+		QrFinder();
+
+		/// <summary>
+		/// Searches a tightly packed binary image, non-zero for dark, every nRowStep rows
+		/// </summary>
+		void Find(const BYTE* pBinary, int nWidth, int nHeight, int nRowStep);
+
+		int GetCandidateCount() const
+		{
+			return static_cast<int>(m_aCandidates.size());
+		}
+
+		const QrCandidate& GetCandidate(int nIndex) const
+		{
+			return m_aCandidates[nIndex];
+		}
+
+	private:
+		struct Pattern
+		{
+			float fX;
+			float fY;
+			float fModuleSize;
+			int nCount;				// rows it was found on
+			bool bUsed;
+		};
+
+		struct Triple
+		{
+			int anPatterns[3];		// top left first
+			float fScore;
+		};
+
+		static bool IsFinderRatio(const int* anRuns);
+
+		static bool CompareCount(const Pattern& a, const Pattern& b);
+
+		static bool CompareScore(const Triple& a, const Triple& b);
+
+		bool IsDark(int x, int y) const
+		{
+			return m_pBinary[y * m_nWidth + x] != 0;
+		}
+
+		void AddCandidate(const int* anRuns, int nRow, int nEnd);
+
+		// Measures the pattern along a column (bVertical) or a row through the point, returning the
+		// centre along that line, or a negative value when the runs are not a finder pattern's
+		float CrossCheck(int nX, int nY, bool bVertical, int nMaximumRun, int nTotal) const;
+
+		void GroupPatterns();
+
+		const BYTE* m_pBinary;
+		int m_nWidth;
+		int m_nHeight;
+
+		std::vector<Pattern> m_aPatterns;
+		std::vector<Triple> m_aTriples;
+		std::vector<QrCandidate> m_aCandidates;
+	};
+}
+
+#pragma managed(pop)
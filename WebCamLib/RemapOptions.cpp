@@ -0,0 +1,57 @@
+//*****************************************************************************************
+//  File:       RemapOptions.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed description of a lens undistortion and perspective remap
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "RemapTable.h"
+#include "RemapOptions.h"
+
+using namespace WebCamLib;
+
+RemapOptions::RemapOptions()
+{
+	homography = nullptr;
+}
+
+array<double>^ RemapOptions::Homography::get()
+{
+	return homography;
+}
+
+void RemapOptions::Homography::set( array<double>^ value )
+{
+	if( value != nullptr && value->Length != 9 )
+		throw gcnew ArgumentException( "A homography is a 3x3 matrix of nine elements.", "value" );
+
+	homography = value != nullptr ? safe_cast<array<double>^>( value->Clone() ) : nullptr;
+}
+
+void RemapOptions::ToNative( RemapParameters* pParameters )
+{
+	ZeroMemory( pParameters, sizeof( RemapParameters ) );
+
+	pParameters->nReferenceWidth = ReferenceWidth;
+	pParameters->nReferenceHeight = ReferenceHeight;
+
+	pParameters->bLens = FocalLengthX != 0.0 || FocalLengthY != 0.0;
+	pParameters->lens.dFocalX = FocalLengthX;
+	pParameters->lens.dFocalY = FocalLengthY;
+	pParameters->lens.dCenterX = PrincipalPointX;
+	pParameters->lens.dCenterY = PrincipalPointY;
+	pParameters->lens.dK1 = K1;
+	pParameters->lens.dK2 = K2;
+	pParameters->lens.dK3 = K3;
+	pParameters->lens.dP1 = P1;
+	pParameters->lens.dP2 = P2;
+
+	pParameters->bHomography = homography != nullptr;
+	if( homography != nullptr )
+	{
+		for( int n = 0; n < 9; n++ )
+			pParameters->adHomography[n] = homography[n];
+	}
+}
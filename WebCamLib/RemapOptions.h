@@ -0,0 +1,86 @@
+//*****************************************************************************************
+//  File:       RemapOptions.h
+//  Project:    WebcamLib
+//
+//  Declares the managed description of a lens undistortion and perspective remap
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+
+namespace WebCamLib
+{
+	struct RemapParameters;
+
+	/// <summary>
+	/// What FrameProcessingPipeline.AddRemap undoes: a lens, described by the camera matrix and
+	/// distortion coefficients OpenCV's calibrateCamera reports, a perspective, given as a
+	/// homography, or both. Everything is in pixels of ReferenceWidth by ReferenceHeight, the
+	/// size the camera was calibrated at, and scaled to the size it is started at.
+	/// </summary>
+	public ref class RemapOptions
+	{
+	public:
+		RemapOptions();
+
+		/// <summary>
+		/// Size the parameters are given for; 0 takes them as given for the frames' own size
+		/// </summary>
+		property int ReferenceWidth;
+
+		property int ReferenceHeight;
+
+		/// <summary>
+		/// fx of the camera matrix; 0, as it starts out, leaves the lens alone
+		/// </summary>
+		property double FocalLengthX;
+
+		/// <summary>
+		/// fy of the camera matrix
+		/// </summary>
+		property double FocalLengthY;
+
+		/// <summary>
+		/// cx of the camera matrix
+		/// </summary>
+		property double PrincipalPointX;
+
+		/// <summary>
+		/// cy of the camera matrix
+		/// </summary>
+		property double PrincipalPointY;
+
+		/// <summary>
+		/// Radial distortion coefficients
+		/// </summary>
+		property double K1;
+
+		property double K2;
+
+		property double K3;
+
+		/// <summary>
+		/// Tangential distortion coefficients
+		/// </summary>
+		property double P1;
+
+		property double P2;
+
+		/// <summary>
+		/// Row major 3x3 matrix mapping undistorted image pixels onto output pixels, e.g. to look
+		/// straight down on a tilted work surface; null for none
+		/// </summary>
+		property array<double>^ Homography
+		{
+			array<double>^ get();
+			void set( array<double>^ value );
+		}
+
+	internal:
+		void ToNative( RemapParameters* pParameters );
+
+	private:
+		array<double>^ homography;
+	};
+}
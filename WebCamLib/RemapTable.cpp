@@ -0,0 +1,309 @@
+//*****************************************************************************************
+//  File:       RemapTable.cpp
+//  Project:    WebcamLib
+//
+//  Defines the precomputed lookup table for lens undistortion and perspective remapping
+//*****************************************************************************************
+
+#include <windows.h>
+#include <math.h>
+#include <emmintrin.h>
+
+#include "WorkerPool.h"
+#include "RemapTable.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+#define REMAP_ONE			(1 << REMAP_FRACTION_BITS)
+
+RemapTable::RemapTable()
+{
+	ZeroMemory(&m_parameters, sizeof(m_parameters));
+	ZeroMemory(m_adInverse, sizeof(m_adInverse));
+	m_pPool = NULL;
+
+	m_bBuilt = false;
+	m_nWidth = 0;
+	m_nHeight = 0;
+	m_nBitsPerPixel = 0;
+	m_nStride = 0;
+}
+
+HRESULT RemapTable::SetParameters(const RemapParameters& parameters)
+{
+	if (parameters.nReferenceWidth < 0 || parameters.nReferenceHeight < 0)
+		return E_INVALIDARG;
+
+	if (parameters.bLens && (parameters.lens.dFocalX == 0.0 || parameters.lens.dFocalY == 0.0))
+		return E_INVALIDARG;
+
+	double adInverse[9] = { 1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 };
+
+	if (parameters.bHomography)
+	{
+		// Output pixels are looked up in the source, so the homography is needed the other way round
+		const double* h = parameters.adHomography;
+		double dDeterminant = h[0] * (h[4] * h[8] - h[5] * h[7]) - h[1] * (h[3] * h[8] - h[5] * h[6]) + h[2] * (h[3] * h[7] - h[4] * h[6]);
+
+		if (fabs(dDeterminant) < 1e-12)
+			return E_INVALIDARG;
+
+		adInverse[0] = (h[4] * h[8] - h[5] * h[7]) / dDeterminant;
+		adInverse[1] = (h[2] * h[7] - h[1] * h[8]) / dDeterminant;
+		adInverse[2] = (h[1] * h[5] - h[2] * h[4]) / dDeterminant;
+		adInverse[3] = (h[5] * h[6] - h[3] * h[8]) / dDeterminant;
+		adInverse[4] = (h[0] * h[8] - h[2] * h[6]) / dDeterminant;
+		adInverse[5] = (h[2] * h[3] - h[0] * h[5]) / dDeterminant;
+		adInverse[6] = (h[3] * h[7] - h[4] * h[6]) / dDeterminant;
+		adInverse[7] = (h[1] * h[6] - h[0] * h[7]) / dDeterminant;
+		adInverse[8] = (h[0] * h[4] - h[1] * h[3]) / dDeterminant;
+	}
+
+	m_parameters = parameters;
+	CopyMemory(m_adInverse, adInverse, sizeof(m_adInverse));
+	m_bBuilt = false;
+
+	return S_OK;
+}
+
+HRESULT RemapTable::Build(int nWidth, int nHeight, int nBitsPerPixel, int nStride)
+{
+	if (nWidth < 2 || nHeight < 2 || (nBitsPerPixel != 24 && nBitsPerPixel != 32))
+		return E_INVALIDARG;
+
+	m_bBuilt = false;
+	m_nWidth = nWidth;
+	m_nHeight = nHeight;
+	m_nBitsPerPixel = nBitsPerPixel;
+	m_nStride = nStride;
+
+	size_t nPixels = static_cast<size_t>(nWidth) * nHeight;
+	m_aOffsets.resize(nPixels);
+	m_aWeights.resize(nPixels);
+
+	int nItems = (nHeight + REMAP_TILE_ROWS - 1) / REMAP_TILE_ROWS;
+
+	if (m_pPool != NULL)
+	{
+		m_pPool->Run(BuildRowsProc, this, nItems);
+	}
+	else
+	{
+		BuildRows(0, nHeight);
+	}
+
+	m_bBuilt = true;
+
+	return S_OK;
+}
+
+void RemapTable::BuildRowsProc(void* pContext, int nItem)
+{
+	RemapTable* pTable = static_cast<RemapTable*>(pContext);
+	int nFirstRow = nItem * REMAP_TILE_ROWS;
+
+	pTable->BuildRows(nFirstRow, min(REMAP_TILE_ROWS, pTable->m_nHeight - nFirstRow));
+}
+
+void RemapTable::BuildRows(int nFirstRow, int nRows)
+{
+	const LensDistortion& lens = m_parameters.lens;
+	const double* m = m_adInverse;
+
+	// The parameters are in pixels of the reference size; pixel centres line up between the two
+	double dScaleX = m_parameters.nReferenceWidth > 0 ? static_cast<double>(m_nWidth) / m_parameters.nReferenceWidth : 1.0;
+	double dScaleY = m_parameters.nReferenceHeight > 0 ? static_cast<double>(m_nHeight) / m_parameters.nReferenceHeight : 1.0;
+	int nBytesPerPixel = m_nBitsPerPixel / 8;
+
+	for (int v = nFirstRow; v < nFirstRow + nRows; v++)
+	{
+		size_t nIndex = static_cast<size_t>(v) * m_nWidth;
+
+		for (int u = 0; u < m_nWidth; u++, nIndex++)
+		{
+			double x = (u + 0.5) / dScaleX - 0.5;
+			double y = (v + 0.5) / dScaleY - 0.5;
+			bool bInside = true;
+
+			if (m_parameters.bHomography)
+			{
+				double w = m[6] * x + m[7] * y + m[8];
+				bInside = w > 0.0;
+
+				double xh = (m[0] * x + m[1] * y + m[2]) / w;
+				double yh = (m[3] * x + m[4] * y + m[5]) / w;
+				x = xh;
+				y = yh;
+			}
+
+			if (m_parameters.bLens)
+			{
+				double xn = (x - lens.dCenterX) / lens.dFocalX;
+				double yn = (y - lens.dCenterY) / lens.dFocalY;
+				double r2 = xn * xn + yn * yn;
+				double dRadial = 1.0 + r2 * (lens.dK1 + r2 * (lens.dK2 + r2 * lens.dK3));
+				double xd = xn * dRadial + 2.0 * lens.dP1 * xn * yn + lens.dP2 * (r2 + 2.0 * xn * xn);
+				double yd = yn * dRadial + lens.dP1 * (r2 + 2.0 * yn * yn) + 2.0 * lens.dP2 * xn * yn;
+
+				x = xd * lens.dFocalX + lens.dCenterX;
+				y = yd * lens.dFocalY + lens.dCenterY;
+			}
+
+			x = (x + 0.5) * dScaleX - 0.5;
+			y = (y + 0.5) * dScaleY - 0.5;
+
+			if (!bInside || !(x >= 0.0 && y >= 0.0 && x <= m_nWidth - 1 && y <= m_nHeight - 1))
+			{
+				m_aOffsets[nIndex] = 0;
+				m_aWeights[nIndex] = REMAP_OUTSIDE;
+				continue;
+			}
+
+			int nX = static_cast<int>(x * REMAP_ONE + 0.5);
+			int nY = static_cast<int>(y * REMAP_ONE + 0.5);
+			int nLeft = nX >> REMAP_FRACTION_BITS;
+			int nTop = nY >> REMAP_FRACTION_BITS;
+			int nRight = nX & (REMAP_ONE - 1);
+			int nLower = nY & (REMAP_ONE - 1);
+
+			// The last column and row are sampled as all right or lower weight, so that the
+			// neighbours read always lie inside the frame
+			if (nLeft >= m_nWidth - 1)
+			{
+				nLeft = m_nWidth - 2;
+				nRight = REMAP_ONE;
+			}
+
+			if (nTop >= m_nHeight - 1)
+			{
+				nTop = m_nHeight - 2;
+				nLower = REMAP_ONE;
+			}
+
+			m_aOffsets[nIndex] = nTop * m_nStride + nLeft * nBytesPerPixel;
+			m_aWeights[nIndex] = static_cast<WORD>(nRight | (nLower << (REMAP_FRACTION_BITS + 1)));
+		}
+	}
+}
+
+HRESULT RemapTable::Apply(const BYTE* pSourceTop, BYTE* pOutputTop, int nOutputStride)
+{
+	if (!m_bBuilt)
+		return E_UNEXPECTED;
+
+	if (pSourceTop == NULL || pOutputTop == NULL)
+		return E_POINTER;
+
+	ApplyContext context;
+	context.pTable = this;
+	context.pSourceTop = pSourceTop;
+	context.pOutputTop = pOutputTop;
+	context.nOutputStride = nOutputStride;
+
+	int nBands = (m_nHeight + REMAP_TILE_ROWS - 1) / REMAP_TILE_ROWS;
+
+	if (m_pPool != NULL)
+	{
+		m_pPool->Run(ApplyBandProc, &context, nBands);
+	}
+	else
+	{
+		ApplyBand(context, 0, m_nHeight);
+	}
+
+	return S_OK;
+}
+
+void RemapTable::ApplyBandProc(void* pContext, int nItem)
+{
+	const ApplyContext* pApply = static_cast<const ApplyContext*>(pContext);
+	int nFirstRow = nItem * REMAP_TILE_ROWS;
+
+	pApply->pTable->ApplyBand(*pApply, nFirstRow, min(REMAP_TILE_ROWS, pApply->pTable->m_nHeight - nFirstRow));
+}
+
+/// <summary>
+/// Loads a pixel and its right neighbour as [c0 c1] pairs of 16 bit channels, ready for pmaddwd
+/// </summary>
+static __forceinline __m128i LoadPair(const BYTE* p, int nBytesPerPixel, __m128i zero)
+{
+	__m128i pixels;
+
+	if (nBytesPerPixel == 4)
+	{
+		pixels = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+	}
+	else
+	{
+		// Two overlapping loads, so nothing past the right neighbour is touched
+		pixels = _mm_unpacklo_epi32(_mm_cvtsi32_si128(*reinterpret_cast<const int*>(p)),
+			_mm_cvtsi32_si128(static_cast<int>(*reinterpret_cast<const DWORD*>(p + 2) >> 8)));
+	}
+
+	pixels = _mm_unpacklo_epi8(pixels, zero);
+
+	return _mm_unpacklo_epi16(pixels, _mm_srli_si128(pixels, 8));
+}
+
+void RemapTable::ApplyBand(const ApplyContext& context, int nFirstRow, int nRows) const
+{
+	const int nBytesPerPixel = m_nBitsPerPixel / 8;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(1 << (2 * REMAP_FRACTION_BITS - 1));
+
+	// Across in tiles, so the rows of the band read neighbouring source rather than whole rows of it
+	for (int nTileLeft = 0; nTileLeft < m_nWidth; nTileLeft += REMAP_TILE_COLUMNS)
+	{
+		int nTileRight = min(nTileLeft + REMAP_TILE_COLUMNS, m_nWidth);
+
+		for (int y = nFirstRow; y < nFirstRow + nRows; y++)
+		{
+			size_t nIndex = static_cast<size_t>(y) * m_nWidth + nTileLeft;
+			BYTE* pOutput = context.pOutputTop + static_cast<ptrdiff_t>(y) * context.nOutputStride + nTileLeft * nBytesPerPixel;
+
+			for (int x = nTileLeft; x < nTileRight; x++, nIndex++, pOutput += nBytesPerPixel)
+			{
+				int nWeights = m_aWeights[nIndex];
+				DWORD dwPixel = 0;
+
+				if (nWeights != REMAP_OUTSIDE)
+				{
+					int nRight = nWeights & ((REMAP_ONE << 1) - 1);
+					int nLower = nWeights >> (REMAP_FRACTION_BITS + 1);
+
+					const BYTE* pSource = context.pSourceTop + m_aOffsets[nIndex];
+					__m128i top = LoadPair(pSource, nBytesPerPixel, zero);
+					__m128i bottom = LoadPair(pSource + m_nStride, nBytesPerPixel, zero);
+
+					int nTopLeft = (REMAP_ONE - nRight) * (REMAP_ONE - nLower);
+					int nTopRight = nRight * (REMAP_ONE - nLower);
+					int nBottomLeft = (REMAP_ONE - nRight) * nLower;
+					int nBottomRight = nRight * nLower;
+
+					__m128i sum = _mm_add_epi32(
+						_mm_madd_epi16(top, _mm_set1_epi32(nTopLeft | (nTopRight << 16))),
+						_mm_madd_epi16(bottom, _mm_set1_epi32(nBottomLeft | (nBottomRight << 16))));
+					sum = _mm_srli_epi32(_mm_add_epi32(sum, round), 2 * REMAP_FRACTION_BITS);
+					sum = _mm_packs_epi32(sum, sum);
+
+					dwPixel = static_cast<DWORD>(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+				}
+
+				if (nBytesPerPixel == 4)
+				{
+					*reinterpret_cast<DWORD*>(pOutput) = dwPixel;
+				}
+				else
+				{
+					pOutput[0] = static_cast<BYTE>(dwPixel);
+					pOutput[1] = static_cast<BYTE>(dwPixel >> 8);
+					pOutput[2] = static_cast<BYTE>(dwPixel >> 16);
+				}
+			}
+		}
+	}
+}
+
+#pragma managed(pop)
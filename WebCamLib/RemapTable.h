@@ -0,0 +1,132 @@
+//*****************************************************************************************
+//  File:       RemapTable.h
+//  Project:    WebcamLib
+//
+//  Declares the precomputed lookup table for lens undistortion and perspective remapping
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+// Fractional steps between two source pixels; a weight index of REMAP_OUTSIDE marks output
+// pixels whose source lies outside the frame
+#define REMAP_FRACTION_BITS		5
+#define REMAP_OUTSIDE			0xFFFF
+
+// Output pixels sampled together, small enough for the source they cover to stay in the L1 cache
+#define REMAP_TILE_ROWS			16
+#define REMAP_TILE_COLUMNS		64
+
+namespace WebCamLib
+{
+	class WorkerPool;
+
+	/// <summary>
+	/// Pinhole camera with Brown-Conrady distortion, as OpenCV calibrates it: radial k1, k2, k3
+	/// and tangential p1, p2, all in pixels of the reference size
+	/// </summary>
+	struct LensDistortion
+	{
+		double dFocalX;
+		double dFocalY;
+		double dCenterX;
+		double dCenterY;
+		double dK1;
+		double dK2;
+		double dK3;
+		double dP1;
+		double dP2;
+	};
+
+	/// <summary>
+	/// What a remap undoes. The homography maps undistorted image pixels onto output pixels,
+	/// row major; with a lens as well it is applied after the undistortion. Both are given in
+	/// pixels of a reference size and scaled to the size of the frames, 0 meaning that size.
+	/// </summary>
+	struct RemapParameters
+	{
+		int nReferenceWidth;
+		int nReferenceHeight;
+		bool bLens;
+		LensDistortion lens;
+		bool bHomography;
+		double adHomography[9];
+	};
+
+	/// <summary>
+	/// For every output pixel, the source pixel to sample and where between its neighbours, in
+	/// fixed point: a byte offset into the source and the right and lower weights in 1/32 steps,
+	/// six bytes a pixel. Built once per frame format, then applied to every frame with SSE2
+	/// bilinear sampling, tile by tile, spread over a worker pool. 24 and 32 bit frames only.
+	/// </summary>
+	class RemapTable
+	{
+	public:
+		RemapTable();
+
+		/// <summary>
+		/// Takes new parameters, dropping the table; E_INVALIDARG for a homography that cannot be inverted
+		/// </summary>
+		HRESULT SetParameters(const RemapParameters& parameters);
+
+		/// <summary>
+		/// Pool used to build and apply the table in parallel, NULL to do so on the calling thread
+		/// </summary>
+		void SetWorkerPool(WorkerPool* pPool)
+		{
+			m_pPool = pPool;
+		}
+
+		/// <summary>
+		/// True when the table was built for frames of this format
+		/// </summary>
+		bool Matches(int nWidth, int nHeight, int nBitsPerPixel, int nStride) const
+		{
+			return m_bBuilt && nWidth == m_nWidth && nHeight == m_nHeight && nBitsPerPixel == m_nBitsPerPixel && nStride == m_nStride;
+		}
+
+		/// <summary>
+		/// Builds the table for sources given by their top row and the signed offset to the row below
+		/// </summary>
+		HRESULT Build(int nWidth, int nHeight, int nBitsPerPixel, int nStride);
+
+		/// <summary>
+		/// Samples a source of the format the table was built for into an output of the same size;
+		/// pixels with no source are black
+		/// </summary>
+		HRESULT Apply(const BYTE* pSourceTop, BYTE* pOutputTop, int nOutputStride);
+
+	private:
+		struct ApplyContext
+		{
+			const RemapTable* pTable;
+			const BYTE* pSourceTop;
+			BYTE* pOutputTop;
+			int nOutputStride;
+		};
+
+		static void BuildRowsProc(void* pContext, int nItem);
+		static void ApplyBandProc(void* pContext, int nItem);
+
+		void BuildRows(int nFirstRow, int nRows);
+		void ApplyBand(const ApplyContext& context, int nFirstRow, int nRows) const;
+
+		RemapParameters m_parameters;
+		double m_adInverse[9];
+		WorkerPool* m_pPool;
+
+		bool m_bBuilt;
+		int m_nWidth;
+		int m_nHeight;
+		int m_nBitsPerPixel;
+		int m_nStride;
+
+		std::vector<int> m_aOffsets;
+		std::vector<WORD> m_aWeights;
+	};
+}
+
+#pragma managed(pop)
@@ -0,0 +1,95 @@
+//*****************************************************************************************
+//  File:       StreamHealth.cpp
+//  Project:    WebcamLib
+//
+//  Defines the per-frame fingerprint and arrival record the stream watchdog reads
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "StreamHealth.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Words hashed from each frame. Sensor noise changes most of them from one real frame to the
+// next, so the sample only has to be large enough that a repeat is not a coincidence.
+#define STREAM_SAMPLE_WORDS		1024
+
+// 64 bit FNV-1a, taken a word at a time rather than a byte at a time
+#define STREAM_FNV_OFFSET		0xcbf29ce484222325ULL
+#define STREAM_FNV_PRIME		0x00000100000001b3ULL
+
+StreamHealth::StreamHealth()
+{
+	Reset(GetTickCount());
+}
+
+void StreamHealth::Reset(DWORD dwTick)
+{
+	m_ullLastFingerprint = 0;
+	m_bHasFingerprint = false;
+
+	m_dwLastFrameTick = dwTick;
+	m_dwLastChangeTick = dwTick;
+	m_nChanges = 0;
+	m_nDuplicates = 0;
+}
+
+bool StreamHealth::Observe(const BYTE* pBuffer, DWORD dwLength, bool bFingerprint, DWORD dwTick)
+{
+	m_dwLastFrameTick = dwTick;
+
+	bool bDuplicate = false;
+
+	if (bFingerprint)
+	{
+		ULONGLONG ullFingerprint = Fingerprint(pBuffer, dwLength);
+
+		bDuplicate = m_bHasFingerprint && ullFingerprint == m_ullLastFingerprint;
+		m_ullLastFingerprint = ullFingerprint;
+		m_bHasFingerprint = true;
+	}
+	else
+	{
+		// The next fingerprint has nothing recent to be compared with
+		m_bHasFingerprint = false;
+	}
+
+	if (bDuplicate)
+	{
+		m_nDuplicates++;
+	}
+	else
+	{
+		m_dwLastChangeTick = dwTick;
+		m_nChanges++;
+	}
+
+	return bDuplicate;
+}
+
+ULONGLONG StreamHealth::Fingerprint(const BYTE* pBuffer, DWORD dwLength)
+{
+	ULONGLONG ullHash = (STREAM_FNV_OFFSET ^ dwLength) * STREAM_FNV_PRIME;
+
+	DWORD dwWords = dwLength / sizeof(DWORD);
+	if (dwWords == 0)
+		return ullHash;
+
+	// Evenly spaced words, so the sample spans every row whatever the stride; a buffer of fewer
+	// words than the sample is hashed whole
+	DWORD dwSamples = min(dwWords, static_cast<DWORD>(STREAM_SAMPLE_WORDS));
+	DWORD dwStep = dwWords / dwSamples;
+	const DWORD* pdwWords = reinterpret_cast<const DWORD*>(pBuffer);
+
+	for (DWORD i = 0; i < dwSamples; i++)
+	{
+		ullHash = (ullHash ^ pdwWords[i * dwStep]) * STREAM_FNV_PRIME;
+	}
+
+	return ullHash;
+}
+
+#pragma managed(pop)
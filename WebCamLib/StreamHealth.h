@@ -0,0 +1,87 @@
+//*****************************************************************************************
+//  File:       StreamHealth.h
+//  Project:    WebcamLib
+//
+//  Declares the per-frame fingerprint and arrival record the stream watchdog reads
+//*****************************************************************************************
+
+#pragma once
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// Record of when the capture thread last got a frame and last got one with a new picture.
+	/// A picture is told from the last one by a 64 bit hash of a sparse sample of the buffer,
+	/// a thousand or so words spread evenly over it, so a frame costs a few microseconds however
+	/// large it is. Written by the capture thread alone; the ticks and counts are single aligned
+	/// words, so a watchdog on another thread reads them without locking.
+	/// </summary>
+	class StreamHealth
+	{
+	public:
+		StreamHealth();
+
+		/// <summary>
+		/// Forgets the last picture and counts the stream as having just delivered a new one,
+		/// which gives a starting camera the full timeouts before it is suspect
+		/// </summary>
+		void Reset(DWORD dwTick);
+
+		/// <summary>
+		/// Notes the arrival of a frame and, when bFingerprint, compares its sample with the last
+		/// one's; true when they match, that is when the frame repeats the last picture. Without a
+		/// fingerprint every frame counts as a new picture.
+		/// </summary>
+		bool Observe(const BYTE* pBuffer, DWORD dwLength, bool bFingerprint, DWORD dwTick);
+
+		/// <summary>
+		/// Tick count at the last frame, and at the last frame with a new picture
+		/// </summary>
+		DWORD GetLastFrameTick() const
+		{
+			return m_dwLastFrameTick;
+		}
+
+		DWORD GetLastChangeTick() const
+		{
+			return m_dwLastChangeTick;
+		}
+
+		/// <summary>
+		/// Frames with a new picture since the last Reset
+		/// </summary>
+		LONG GetChangeCount() const
+		{
+			return m_nChanges;
+		}
+
+		/// <summary>
+		/// Frames found to repeat the last picture since the last Reset
+		/// </summary>
+		LONG GetDuplicateCount() const
+		{
+			return m_nDuplicates;
+		}
+
+		/// <summary>
+		/// Hash of the sample of a buffer, which covers its length too
+		/// </summary>
+		static ULONGLONG Fingerprint(const BYTE* pBuffer, DWORD dwLength);
+
+	private:
+		StreamHealth(const StreamHealth&);
+		StreamHealth& operator=(const StreamHealth&);
+
+		ULONGLONG m_ullLastFingerprint;
+		bool m_bHasFingerprint;
+
+		volatile DWORD m_dwLastFrameTick;
+		volatile DWORD m_dwLastChangeTick;
+		volatile LONG m_nChanges;
+		volatile LONG m_nDuplicates;
+	};
+}
+
+#pragma managed(pop)
@@ -0,0 +1,527 @@
+//*****************************************************************************************
+//  File:       TemplateMatcher.cpp
+//  Project:    WebcamLib
+//
+//  Defines the coarse to fine search for templates in frames
+//*****************************************************************************************
+
+#include <windows.h>
+#include <emmintrin.h>
+#include <math.h>
+
+#include "WorkerPool.h"
+#include "TemplateMatcher.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Windows of the coarsest level followed down the pyramid; more than one so a near miss at the
+// coarse level does not hide the true match
+#define TEMPLATE_CANDIDATES			3
+
+// Pixels around twice a candidate's position searched at each finer level
+#define TEMPLATE_REFINE_RADIUS		2
+
+// Fall in score from one frame to the next beyond which a match near the last one is doubted
+#define TEMPLATE_SCORE_DROP			0.05f
+
+namespace
+{
+	inline int HorizontalSum(__m128i sums)
+	{
+		sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2)));
+		sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtsi128_si32(sums);
+	}
+
+	// Sum of the products of a row of the image and the template's widened row
+	inline int MultiplyRow(const BYTE* pImage, const short* pTemplate, int nWidth)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i sums = _mm_setzero_si128();
+		int x = 0;
+
+		for (; x + 16 <= nWidth; x += 16)
+		{
+			__m128i image = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pImage + x));
+			__m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTemplate + x));
+			__m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTemplate + x + 8));
+
+			sums = _mm_add_epi32(sums, _mm_madd_epi16(_mm_unpacklo_epi8(image, zero), low));
+			sums = _mm_add_epi32(sums, _mm_madd_epi16(_mm_unpackhi_epi8(image, zero), high));
+		}
+
+		if (x + 8 <= nWidth)
+		{
+			__m128i image = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pImage + x)), zero);
+			sums = _mm_add_epi32(sums, _mm_madd_epi16(image, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTemplate + x))));
+			x += 8;
+		}
+
+		int nSum = HorizontalSum(sums);
+
+		for (; x < nWidth; x++)
+		{
+			nSum += pImage[x] * pTemplate[x];
+		}
+
+		return nSum;
+	}
+
+	// Sum of a row and of its squares, for levels without an integral image
+	inline void SumRow(const BYTE* pImage, int nWidth, int* pnSum, int* pnSquares)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i sums = _mm_setzero_si128();
+		__m128i squares = _mm_setzero_si128();
+		int x = 0;
+
+		for (; x + 16 <= nWidth; x += 16)
+		{
+			__m128i image = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pImage + x));
+			__m128i low = _mm_unpacklo_epi8(image, zero);
+			__m128i high = _mm_unpackhi_epi8(image, zero);
+
+			sums = _mm_add_epi64(sums, _mm_sad_epu8(image, zero));
+			squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+		}
+
+		int nSum = _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+		int nSquares = HorizontalSum(squares);
+
+		for (; x < nWidth; x++)
+		{
+			nSum += pImage[x];
+			nSquares += pImage[x] * pImage[x];
+		}
+
+		*pnSum += nSum;
+		*pnSquares += nSquares;
+	}
+
+	inline int DifferenceRow(const BYTE* pImage, const BYTE* pTemplate, int nWidth)
+	{
+		__m128i sums = _mm_setzero_si128();
+		int x = 0;
+
+		for (; x + 16 <= nWidth; x += 16)
+		{
+			__m128i image = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pImage + x));
+			__m128i pattern = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTemplate + x));
+			sums = _mm_add_epi64(sums, _mm_sad_epu8(image, pattern));
+		}
+
+		if (x + 8 <= nWidth)
+		{
+			__m128i image = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pImage + x));
+			__m128i pattern = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pTemplate + x));
+			sums = _mm_add_epi64(sums, _mm_sad_epu8(image, pattern));
+			x += 8;
+		}
+
+		int nSum = _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+
+		for (; x < nWidth; x++)
+		{
+			nSum += abs(pImage[x] - pTemplate[x]);
+		}
+
+		return nSum;
+	}
+}
+
+TemplateMatcher::TemplateMatcher()
+{
+	m_eScoring = TemplateScoring_Correlation;
+	m_fMinimumScore = 0.8f;
+	m_nSearchRadius = 32;
+	m_pPool = NULL;
+	m_nLevels = 0;
+}
+
+HRESULT TemplateMatcher::AddTemplate(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, int* pnIndex)
+{
+	Slot slot;
+
+	HRESULT hr = slot.model.Create(pTop, nWidth, nHeight, nStride, nBitsPerPixel);
+	if (FAILED(hr))
+		return hr;
+
+	ZeroMemory(&slot.match, sizeof(slot.match));
+	slot.match.nWidth = nWidth;
+	slot.match.nHeight = nHeight;
+
+	m_aSlots.push_back(slot);
+
+	if (pnIndex != NULL)
+	{
+		*pnIndex = GetTemplateCount() - 1;
+	}
+
+	return S_OK;
+}
+
+HRESULT TemplateMatcher::SetMinimumScore(float fMinimumScore)
+{
+	if (!(fMinimumScore <= 1.0f))
+		return E_INVALIDARG;
+
+	m_fMinimumScore = fMinimumScore;
+
+	return S_OK;
+}
+
+HRESULT TemplateMatcher::SetSearchRadius(int nSearchRadius)
+{
+	if (nSearchRadius < 0)
+		return E_INVALIDARG;
+
+	m_nSearchRadius = nSearchRadius;
+
+	return S_OK;
+}
+
+void TemplateMatcher::ResetTracking()
+{
+	for (size_t i = 0; i < m_aSlots.size(); i++)
+	{
+		m_aSlots[i].match.bFound = false;
+		m_aSlots[i].match.fScore = 0.0f;
+	}
+}
+
+HRESULT TemplateMatcher::Match(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, int* pnFound)
+{
+	if (pnFound != NULL)
+	{
+		*pnFound = 0;
+	}
+
+	HRESULT hr = m_luma.Extract(pTop, nWidth, nHeight, nStride, nBitsPerPixel);
+	if (FAILED(hr))
+		return hr;
+
+	int nSlots = GetTemplateCount();
+	if (nSlots == 0)
+		return S_OK;
+
+	// Only as many levels as the deepest template pyramid
+	int nLevels = 0;
+	for (int i = 0; i < nSlots; i++)
+	{
+		nLevels = max(nLevels, m_aSlots[i].model.GetLevelCount());
+	}
+
+	if (static_cast<int>(m_aLevels.size()) < nLevels)
+	{
+		m_aLevels.resize(nLevels);
+	}
+
+	for (m_nLevels = 0; m_nLevels < nLevels; m_nLevels++)
+	{
+		FrameLevel& level = m_aLevels[m_nLevels];
+
+		if (m_nLevels == 0)
+		{
+			level.nWidth = nWidth;
+			level.nHeight = nHeight;
+			level.pPixels = m_luma.GetData();
+		}
+		else
+		{
+			const FrameLevel& above = m_aLevels[m_nLevels - 1];
+
+			if (above.nWidth < 2 || above.nHeight < 2)
+				break;
+
+			level.nWidth = above.nWidth / 2;
+			level.nHeight = above.nHeight / 2;
+			level.abPixels.resize(level.nWidth * level.nHeight);
+			LumaPlane::Halve(above.pPixels, above.nWidth, above.nHeight, &level.abPixels[0]);
+			level.pPixels = &level.abPixels[0];
+		}
+
+		level.bIntegral = false;
+	}
+
+	// Correlation needs every window's sum and sum of squares; an integral image pays off on the
+	// levels searched whole, while refining sums its few windows directly
+	if (m_eScoring == TemplateScoring_Correlation)
+	{
+		for (int i = 0; i < nSlots; i++)
+		{
+			FrameLevel& level = m_aLevels[GetSearchLevel(m_aSlots[i])];
+
+			if (!level.bIntegral)
+			{
+				hr = level.integral.Build(level.pPixels, level.nWidth, level.nHeight, level.nWidth, true);
+				if (FAILED(hr))
+					return hr;
+
+				level.bIntegral = true;
+			}
+		}
+	}
+
+	if (m_pPool != NULL && nSlots > 1)
+	{
+		m_pPool->Run(SearchProc, this, nSlots);
+	}
+	else
+	{
+		for (int i = 0; i < nSlots; i++)
+		{
+			Search(m_aSlots[i]);
+		}
+	}
+
+	if (pnFound != NULL)
+	{
+		for (int i = 0; i < nSlots; i++)
+		{
+			if (m_aSlots[i].match.bFound)
+			{
+				(*pnFound)++;
+			}
+		}
+	}
+
+	return S_OK;
+}
+
+void TemplateMatcher::SearchProc(void* pContext, int nSlot)
+{
+	TemplateMatcher* pMatcher = static_cast<TemplateMatcher*>(pContext);
+	pMatcher->Search(pMatcher->m_aSlots[nSlot]);
+}
+
+void TemplateMatcher::Search(Slot& slot)
+{
+	TemplateMatch& match = slot.match;
+	bool bTracking = match.bFound && m_nSearchRadius > 0;
+	int nLastX = match.nX;
+	int nLastY = match.nY;
+	float fLastScore = match.fScore;
+
+	match.bFound = false;
+	match.fScore = 0.0f;
+
+	if (slot.model.GetWidth() > m_aLevels[0].nWidth || slot.model.GetHeight() > m_aLevels[0].nHeight)
+		return;
+
+	int nLevel = GetSearchLevel(slot);
+
+	if (bTracking)
+	{
+		int nRadius = (m_nSearchRadius >> nLevel) + 1;
+		int nX = nLastX >> nLevel;
+		int nY = nLastY >> nLevel;
+
+		FindCandidates(slot, nLevel, nX - nRadius, nY - nRadius, nX + nRadius, nY + nRadius);
+
+		// A score that falls off sharply means the template jumped out of the window and the
+		// window only holds something like it, so the whole frame is searched as well
+		if (RefineCandidates(slot, nLevel) && match.fScore >= fLastScore - TEMPLATE_SCORE_DROP)
+			return;
+	}
+
+	TemplateMatch tracked = match;
+
+	FindCandidates(slot, nLevel, 0, 0, MAXLONG, MAXLONG);
+	RefineCandidates(slot, nLevel);
+
+	if (bTracking && tracked.fScore > match.fScore)
+	{
+		match = tracked;
+	}
+}
+
+void TemplateMatcher::FindCandidates(Slot& slot, int nLevel, int nLeft, int nTop, int nRight, int nBottom)
+{
+	const FrameLevel& frame = m_aLevels[nLevel];
+	const TemplateLevel& pattern = slot.model.GetLevel(nLevel);
+
+	slot.aCandidates.clear();
+
+	nLeft = max(nLeft, 0);
+	nTop = max(nTop, 0);
+	nRight = min(nRight, frame.nWidth - pattern.nWidth);
+	nBottom = min(nBottom, frame.nHeight - pattern.nHeight);
+
+	if (nLeft > nRight || nTop > nBottom)
+		return;
+
+	int nColumns = nRight - nLeft + 1;
+	int nRows = nBottom - nTop + 1;
+
+	if (static_cast<int>(slot.afScores.size()) < nColumns * nRows)
+	{
+		slot.afScores.resize(nColumns * nRows);
+	}
+
+	float* pfScores = &slot.afScores[0];
+
+	for (int y = 0; y < nRows; y++)
+	{
+		for (int x = 0; x < nColumns; x++)
+		{
+			pfScores[y * nColumns + x] = Score(nLevel, pattern, nLeft + x, nTop + y);
+		}
+	}
+
+	// The best windows in turn, each clearing the windows overlapping it by more than half
+	int nSuppress = max(1, min(pattern.nWidth, pattern.nHeight) / 2);
+
+	for (int n = 0; n < TEMPLATE_CANDIDATES; n++)
+	{
+		int nBest = -1;
+		float fBest = -2.0f;
+
+		for (int i = 0; i < nColumns * nRows; i++)
+		{
+			if (pfScores[i] > fBest)
+			{
+				fBest = pfScores[i];
+				nBest = i;
+			}
+		}
+
+		if (nBest < 0)
+			break;
+
+		Candidate candidate;
+		candidate.nX = nLeft + nBest % nColumns;
+		candidate.nY = nTop + nBest / nColumns;
+		candidate.fScore = fBest;
+		slot.aCandidates.push_back(candidate);
+
+		int nX = nBest % nColumns;
+		int nY = nBest / nColumns;
+
+		for (int y = max(0, nY - nSuppress); y <= min(nRows - 1, nY + nSuppress); y++)
+		{
+			for (int x = max(0, nX - nSuppress); x <= min(nColumns - 1, nX + nSuppress); x++)
+			{
+				pfScores[y * nColumns + x] = -3.0f;
+			}
+		}
+	}
+}
+
+bool TemplateMatcher::RefineCandidates(Slot& slot, int nLevel)
+{
+	TemplateMatch& match = slot.match;
+
+	for (size_t i = 0; i < slot.aCandidates.size(); i++)
+	{
+		Candidate candidate = slot.aCandidates[i];
+
+		for (int n = nLevel - 1; n >= 0; n--)
+		{
+			const FrameLevel& frame = m_aLevels[n];
+			const TemplateLevel& pattern = slot.model.GetLevel(n);
+
+			int nCenterX = 2 * candidate.nX;
+			int nCenterY = 2 * candidate.nY;
+			int nLeft = max(0, nCenterX - TEMPLATE_REFINE_RADIUS);
+			int nTop = max(0, nCenterY - TEMPLATE_REFINE_RADIUS);
+			int nRight = min(frame.nWidth - pattern.nWidth, nCenterX + TEMPLATE_REFINE_RADIUS);
+			int nBottom = min(frame.nHeight - pattern.nHeight, nCenterY + TEMPLATE_REFINE_RADIUS);
+
+			candidate.fScore = -2.0f;
+
+			for (int y = nTop; y <= nBottom; y++)
+			{
+				for (int x = nLeft; x <= nRight; x++)
+				{
+					float fScore = Score(n, pattern, x, y);
+
+					if (fScore > candidate.fScore)
+					{
+						candidate.fScore = fScore;
+						candidate.nX = x;
+						candidate.nY = y;
+					}
+				}
+			}
+		}
+
+		if (i == 0 || candidate.fScore > match.fScore)
+		{
+			match.nX = candidate.nX;
+			match.nY = candidate.nY;
+			match.fScore = candidate.fScore;
+		}
+	}
+
+	match.bFound = !slot.aCandidates.empty() && match.fScore >= m_fMinimumScore;
+
+	return match.bFound;
+}
+
+float TemplateMatcher::Score(int nLevel, const TemplateLevel& level, int x, int y) const
+{
+	const FrameLevel& frame = m_aLevels[nLevel];
+	const BYTE* pWindow = frame.pPixels + static_cast<size_t>(y) * frame.nWidth + x;
+	int nWidth = level.nWidth;
+	int nHeight = level.nHeight;
+	LONGLONG llPixels = nWidth * nHeight;
+
+	if (m_eScoring == TemplateScoring_AbsoluteDifference)
+	{
+		LONGLONG llDifference = 0;
+
+		for (int nRow = 0; nRow < nHeight; nRow++)
+		{
+			llDifference += DifferenceRow(pWindow + nRow * frame.nWidth, &level.abPixels[nRow * nWidth], nWidth);
+		}
+
+		return 1.0f - static_cast<float>(static_cast<double>(llDifference) / (255.0 * llPixels));
+	}
+
+	LONGLONG llSum = 0;
+	LONGLONG llSquares = 0;
+
+	if (frame.bIntegral)
+	{
+		int nStride = frame.integral.GetStride();
+		int nTopLeft = y * nStride + x;
+		int nBottomLeft = nTopLeft + nHeight * nStride;
+
+		const int* pnSums = frame.integral.GetSums();
+		const LONGLONG* pllSquares = frame.integral.GetSquares();
+
+		llSum = pnSums[nBottomLeft + nWidth] - pnSums[nTopLeft + nWidth] - pnSums[nBottomLeft] + pnSums[nTopLeft];
+		llSquares = pllSquares[nBottomLeft + nWidth] - pllSquares[nTopLeft + nWidth] - pllSquares[nBottomLeft] + pllSquares[nTopLeft];
+	}
+	else
+	{
+		for (int nRow = 0; nRow < nHeight; nRow++)
+		{
+			int nSum = 0;
+			int nSquares = 0;
+
+			SumRow(pWindow + nRow * frame.nWidth, nWidth, &nSum, &nSquares);
+
+			llSum += nSum;
+			llSquares += nSquares;
+		}
+	}
+
+	// A flat window matches nothing
+	double dVariance = static_cast<double>(llPixels * llSquares - llSum * llSum);
+	if (dVariance <= 0.0)
+		return 0.0f;
+
+	LONGLONG llProducts = 0;
+
+	for (int nRow = 0; nRow < nHeight; nRow++)
+	{
+		llProducts += MultiplyRow(pWindow + nRow * frame.nWidth, &level.asPixels[nRow * nWidth], nWidth);
+	}
+
+	return static_cast<float>(static_cast<double>(llPixels * llProducts - llSum * level.llSum) / (sqrt(dVariance) * level.dDeviation));
+}
+
+#pragma managed(pop)
@@ -0,0 +1,191 @@
+//*****************************************************************************************
+//  File:       TemplateMatcher.h
+//  Project:    WebcamLib
+//
+//  Declares the coarse to fine search for templates in frames
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#include "LumaPlane.h"
+#include "IntegralImage.h"
+#include "TemplateModel.h"
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	class WorkerPool;
+
+	enum TemplateScoring
+	{
+		TemplateScoring_Correlation,		// normalised cross correlation, from -1 to 1
+		TemplateScoring_AbsoluteDifference	// 1 less the mean absolute difference over 255, from 0 to 1
+	};
+
+	/// <summary>
+	/// Where a template was last found, in pixels of the frame, and how well it matched there
+	/// </summary>
+	struct TemplateMatch
+	{
+		int nX;
+		int nY;
+		int nWidth;
+		int nHeight;
+		float fScore;
+		bool bFound;
+	};
+
+	/// <summary>
+	/// Finds each of a set of templates in frames by scoring every window of the coarsest level
+	/// both pyramids share, then refining the best few a level at a time within two pixels of
+	/// twice their position. A template found in the last frame is first looked for only within
+	/// the search radius of where it was, and the whole frame is searched again only when that
+	/// fails. Templates are searched in parallel on a pool; the frame's pyramid and the sums of
+	/// its windows are built once for all of them, into buffers kept from one frame to the next.
+	/// </summary>
+	class TemplateMatcher
+	{
+	public:
+		TemplateMatcher();
+
+		/// <summary>
+		/// Adds a template from an 8 bit grey, 24 or 32 bit BGR image given by its top row and
+		/// signed stride; E_INVALIDARG when it is smaller than 8 pixels a side or of a single grey
+		/// </summary>
+		HRESULT AddTemplate(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, int* pnIndex);
+
+		void ClearTemplates()
+		{
+			m_aSlots.clear();
+		}
+
+		int GetTemplateCount() const
+		{
+			return static_cast<int>(m_aSlots.size());
+		}
+
+		/// <summary>
+		/// Correlation by default, which ignores changes of brightness and contrast; absolute
+		/// differences are cheaper but do not
+		/// </summary>
+		void SetScoring(TemplateScoring eScoring)
+		{
+			m_eScoring = eScoring;
+		}
+
+		TemplateScoring GetScoring() const
+		{
+			return m_eScoring;
+		}
+
+		/// <summary>
+		/// Score below which a template counts as not found, at most 1; 0.8 by default
+		/// </summary>
+		HRESULT SetMinimumScore(float fMinimumScore);
+
+		float GetMinimumScore() const
+		{
+			return m_fMinimumScore;
+		}
+
+		/// <summary>
+		/// Pixels around its last position a found template is first looked for within; zero
+		/// searches the whole frame every time. 32 by default.
+		/// </summary>
+		HRESULT SetSearchRadius(int nSearchRadius);
+
+		int GetSearchRadius() const
+		{
+			return m_nSearchRadius;
+		}
+
+		/// <summary>
+		/// Pool the templates are searched on in parallel, NULL to work on the calling thread
+		/// </summary>
+		void SetWorkerPool(WorkerPool* pPool)
+		{
+			m_pPool = pPool;
+		}
+
+		/// <summary>
+		/// Searches an 8 bit grey, 24 or 32 bit BGR image given by its top row and signed stride
+		/// for every template, returning the number found
+		/// </summary>
+		HRESULT Match(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel, int* pnFound);
+
+		const TemplateMatch& GetMatch(int nIndex) const
+		{
+			return m_aSlots[nIndex].match;
+		}
+
+		/// <summary>
+		/// Forgets where the templates were, so the next frame is searched whole
+		/// </summary>
+		void ResetTracking();
+
+	private:
+		TemplateMatcher(const TemplateMatcher&);
+		TemplateMatcher& operator=(const TemplateMatcher&);
+
+		struct FrameLevel
+		{
+			int nWidth;
+			int nHeight;
+			const BYTE* pPixels;
+			std::vector<BYTE> abPixels;		// unused at level 0, which is the luma plane
+			bool bIntegral;					// built for levels searched whole; the rest sum each window
+			IntegralImage integral;
+		};
+
+		struct Candidate
+		{
+			int nX;
+			int nY;
+			float fScore;
+		};
+
+		// A template and the state and scratch its search needs, so templates can be searched
+		// on several threads at once
+		struct Slot
+		{
+			TemplateModel model;
+			TemplateMatch match;
+			std::vector<float> afScores;
+			std::vector<Candidate> aCandidates;
+		};
+
+		static void SearchProc(void* pContext, int nSlot);
+
+		void Search(Slot& slot);
+
+		// Scores every window with its top left corner within the rectangle, clipped to the level,
+		// and keeps the best few that are not beside a better one
+		void FindCandidates(Slot& slot, int nLevel, int nLeft, int nTop, int nRight, int nBottom);
+
+		// Follows the candidates down to level 0, leaving the best in the slot's match
+		bool RefineCandidates(Slot& slot, int nLevel);
+
+		int GetSearchLevel(const Slot& slot) const
+		{
+			return min(slot.model.GetLevelCount(), m_nLevels) - 1;
+		}
+
+		float Score(int nLevel, const TemplateLevel& level, int x, int y) const;
+
+		TemplateScoring m_eScoring;
+		float m_fMinimumScore;
+		int m_nSearchRadius;
+		WorkerPool* m_pPool;
+
+		LumaPlane m_luma;
+		std::vector<FrameLevel> m_aLevels;
+		int m_nLevels;
+
+		std::vector<Slot> m_aSlots;
+	};
+}
+
+#pragma managed(pop)
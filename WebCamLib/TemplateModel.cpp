@@ -0,0 +1,96 @@
+//*****************************************************************************************
+//  File:       TemplateModel.cpp
+//  Project:    WebcamLib
+//
+//  Defines the precomputed pyramid of an image searched for by the template matcher
+//*****************************************************************************************
+
+#include <windows.h>
+#include <math.h>
+
+#include "LumaPlane.h"
+#include "TemplateModel.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Levels stop once a side would fall below this many pixels, where a window stops telling
+// one place from another
+#define TEMPLATE_MINIMUM_SIZE		8
+#define TEMPLATE_MAXIMUM_LEVELS		5
+
+TemplateModel::TemplateModel()
+{
+}
+
+HRESULT TemplateModel::Create(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel)
+{
+	m_aLevels.clear();
+
+	if (nWidth < TEMPLATE_MINIMUM_SIZE || nHeight < TEMPLATE_MINIMUM_SIZE)
+		return E_INVALIDARG;
+
+	LumaPlane luma;
+	HRESULT hr = luma.Extract(pTop, nWidth, nHeight, nStride, nBitsPerPixel);
+	if (FAILED(hr))
+		return hr;
+
+	m_aLevels.resize(1);
+	m_aLevels[0].nWidth = nWidth;
+	m_aLevels[0].nHeight = nHeight;
+	m_aLevels[0].abPixels.assign(luma.GetData(), luma.GetData() + nWidth * nHeight);
+	FinishLevel(m_aLevels[0]);
+
+	// A template of one grey correlates with nothing
+	if (m_aLevels[0].dDeviation <= 0.0)
+	{
+		m_aLevels.clear();
+		return E_INVALIDARG;
+	}
+
+	while (static_cast<int>(m_aLevels.size()) < TEMPLATE_MAXIMUM_LEVELS)
+	{
+		const TemplateLevel& last = m_aLevels.back();
+
+		if (last.nWidth / 2 < TEMPLATE_MINIMUM_SIZE || last.nHeight / 2 < TEMPLATE_MINIMUM_SIZE)
+			break;
+
+		TemplateLevel level;
+		level.nWidth = last.nWidth / 2;
+		level.nHeight = last.nHeight / 2;
+		level.abPixels.resize(level.nWidth * level.nHeight);
+		LumaPlane::Halve(&last.abPixels[0], last.nWidth, last.nHeight, &level.abPixels[0]);
+		FinishLevel(level);
+
+		// Shrinking can blur fine detail to a flat grey; search no coarser than that
+		if (level.dDeviation <= 0.0)
+			break;
+
+		m_aLevels.push_back(level);
+	}
+
+	return S_OK;
+}
+
+void TemplateModel::FinishLevel(TemplateLevel& level)
+{
+	int nPixels = level.nWidth * level.nHeight;
+	LONGLONG llSum = 0;
+	LONGLONG llSquares = 0;
+
+	level.asPixels.resize(nPixels);
+
+	for (int i = 0; i < nPixels; i++)
+	{
+		int nValue = level.abPixels[i];
+		level.asPixels[i] = static_cast<short>(nValue);
+		llSum += nValue;
+		llSquares += nValue * nValue;
+	}
+
+	level.llSum = llSum;
+	level.dDeviation = sqrt(static_cast<double>(nPixels * llSquares - llSum * llSum));
+}
+
+#pragma managed(pop)
@@ -0,0 +1,75 @@
+//*****************************************************************************************
+//  File:       TemplateModel.h
+//  Project:    WebcamLib
+//
+//  Declares the precomputed pyramid of an image searched for by the template matcher
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// One level of a template's pyramid, with the statistics its scores need
+	/// </summary>
+	struct TemplateLevel
+	{
+		int nWidth;
+		int nHeight;
+		std::vector<BYTE> abPixels;		// for the absolute differences
+		std::vector<short> asPixels;	// widened, for the correlation's multiply and add
+		LONGLONG llSum;
+		double dDeviation;				// sqrt(n * sum of squares - sum * sum)
+	};
+
+	/// <summary>
+	/// The luma of a template and its halvings, each pixel of a level the mean of a 2 by 2 block
+	/// of the one below, down to the last level still at least 8 pixels on each side. The sums a
+	/// normalised cross correlation needs are worked out once here rather than for every window.
+	/// </summary>
+	class TemplateModel
+	{
+	public:
+		TemplateModel();
+
+		/// <summary>
+		/// Builds the pyramid of an 8 bit grey, 24 or 32 bit BGR image given by its top row and
+		/// signed stride; E_INVALIDARG when it is smaller than 8 pixels a side or of a single grey
+		/// </summary>
+		HRESULT Create(const BYTE* pTop, int nWidth, int nHeight, int nStride, int nBitsPerPixel);
+
+		int GetWidth() const
+		{
+			return m_aLevels.empty() ? 0 : m_aLevels[0].nWidth;
+		}
+
+		int GetHeight() const
+		{
+			return m_aLevels.empty() ? 0 : m_aLevels[0].nHeight;
+		}
+
+		int GetLevelCount() const
+		{
+			return static_cast<int>(m_aLevels.size());
+		}
+
+		/// <summary>
+		/// Level 0 is the template itself; each one after is half the size of the last
+		/// </summary>
+		const TemplateLevel& GetLevel(int nLevel) const
+		{
+			return m_aLevels[nLevel];
+		}
+
+	private:
+		static void FinishLevel(TemplateLevel& level);
+
+		std::vector<TemplateLevel> m_aLevels;
+	};
+}
+
+#pragma managed(pop)
@@ -0,0 +1,191 @@
+//*****************************************************************************************
+//  File:       TemplateTracker.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed entry point to the native template matcher
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "WorkerPool.h"
+#include "TemplateMatcher.h"
+#include "PooledFrame.h"
+#include "TemplateTracker.h"
+
+using namespace System::Runtime::InteropServices;
+using namespace WebCamLib;
+
+#pragma region TemplateLocation
+TemplateLocation::TemplateLocation( int index, int x, int y, int width, int height, float score, bool found )
+{
+	this->index = index;
+	this->x = x;
+	this->y = y;
+	this->width = width;
+	this->height = height;
+	this->score = score;
+	this->found = found;
+}
+#pragma endregion
+
+#pragma region TemplateTracker
+TemplateTracker::TemplateTracker()
+{
+	pMatcher = new TemplateMatcher();
+}
+
+TemplateTracker::TemplateTracker( bool parallel )
+{
+	pMatcher = new TemplateMatcher();
+
+	if( parallel )
+		pMatcher->SetWorkerPool( WorkerPool::GetShared() );
+}
+
+TemplateTracker::~TemplateTracker()
+{
+	this->!TemplateTracker();
+}
+
+TemplateTracker::!TemplateTracker()
+{
+	delete pMatcher;
+	pMatcher = NULL;
+}
+
+TemplateMatcher* TemplateTracker::GetMatcher()
+{
+	if( pMatcher == NULL )
+		throw gcnew ObjectDisposedException( "TemplateTracker" );
+
+	return pMatcher;
+}
+
+int TemplateTracker::AddTemplate( IntPtr scan0, int width, int height, int stride, int bitsPerPixel )
+{
+	TemplateMatcher* pNative = GetMatcher();
+
+	if( scan0 == IntPtr::Zero )
+		throw gcnew ArgumentNullException( "scan0" );
+
+	if( width < 8 || height < 8 )
+		throw gcnew ArgumentOutOfRangeException( "A template must be at least 8 by 8 pixels." );
+
+	if( bitsPerPixel != 8 && bitsPerPixel != 24 && bitsPerPixel != 32 )
+		throw gcnew ArgumentException( "Only 8 bit grey and 24 or 32 bit BGR images are supported." );
+
+	int index = 0;
+	HRESULT hr = pNative->AddTemplate( static_cast<const BYTE*>( scan0.ToPointer() ), width, height, stride, bitsPerPixel, &index );
+	if( hr == E_INVALIDARG )
+		throw gcnew ArgumentException( "The template is a single shade and cannot be matched." );
+	if( FAILED( hr ) )
+		throw gcnew COMException( "Unable to add the template.", hr );
+
+	return index;
+}
+
+void TemplateTracker::ClearTemplates()
+{
+	GetMatcher()->ClearTemplates();
+}
+
+int TemplateTracker::TemplateCount::get()
+{
+	return GetMatcher()->GetTemplateCount();
+}
+
+TemplateMetric TemplateTracker::Metric::get()
+{
+	return static_cast<TemplateMetric>( GetMatcher()->GetScoring() );
+}
+
+void TemplateTracker::Metric::set( TemplateMetric value )
+{
+	if( value != TemplateMetric::Correlation && value != TemplateMetric::AbsoluteDifference )
+		throw gcnew ArgumentOutOfRangeException( "Metric is not a known TemplateMetric." );
+
+	GetMatcher()->SetScoring( static_cast<TemplateScoring>( value ) );
+}
+
+float TemplateTracker::MinimumScore::get()
+{
+	return GetMatcher()->GetMinimumScore();
+}
+
+void TemplateTracker::MinimumScore::set( float value )
+{
+	if( FAILED( GetMatcher()->SetMinimumScore( value ) ) )
+		throw gcnew ArgumentOutOfRangeException( "MinimumScore cannot be more than 1." );
+}
+
+int TemplateTracker::SearchRadius::get()
+{
+	return GetMatcher()->GetSearchRadius();
+}
+
+void TemplateTracker::SearchRadius::set( int value )
+{
+	if( FAILED( GetMatcher()->SetSearchRadius( value ) ) )
+		throw gcnew ArgumentOutOfRangeException( "SearchRadius cannot be negative." );
+}
+
+int TemplateTracker::Match( IntPtr scan0, int width, int height, int stride, int bitsPerPixel )
+{
+	TemplateMatcher* pNative = GetMatcher();
+
+	if( scan0 == IntPtr::Zero )
+		throw gcnew ArgumentNullException( "scan0" );
+
+	if( width <= 0 || height <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "The image is empty." );
+
+	if( bitsPerPixel != 8 && bitsPerPixel != 24 && bitsPerPixel != 32 )
+		throw gcnew ArgumentException( "Only 8 bit grey and 24 or 32 bit BGR images are supported." );
+
+	int found = 0;
+	HRESULT hr = pNative->Match( static_cast<const BYTE*>( scan0.ToPointer() ), width, height, stride, bitsPerPixel, &found );
+	if( FAILED( hr ) )
+		throw gcnew COMException( "Unable to search the image.", hr );
+
+	return found;
+}
+
+int TemplateTracker::Match( PooledFrame^ frame )
+{
+	if( frame == nullptr )
+		throw gcnew ArgumentNullException( "frame" );
+
+	return Match( frame->Scan0, frame->Width, frame->Height, frame->Stride, frame->BitsPerPixel );
+}
+
+TemplateLocation TemplateTracker::GetLocation( int index )
+{
+	if( index < 0 || index >= TemplateCount )
+		throw gcnew ArgumentOutOfRangeException( "Template index is out of bounds: " + TemplateCount.ToString() );
+
+	const TemplateMatch& match = pMatcher->GetMatch( index );
+
+	return TemplateLocation( index, match.nX, match.nY, match.nWidth, match.nHeight, match.fScore, match.bFound );
+}
+
+void TemplateTracker::GetFound( IList<TemplateLocation>^ locations )
+{
+	if( locations == nullptr )
+		throw gcnew ArgumentNullException( "locations" );
+
+	locations->Clear();
+
+	for( int i = 0; i < TemplateCount; ++i )
+	{
+		TemplateLocation location = GetLocation( i );
+
+		if( location.Found )
+			locations->Add( location );
+	}
+}
+
+void TemplateTracker::ResetTracking()
+{
+	GetMatcher()->ResetTracking();
+}
+#pragma endregion
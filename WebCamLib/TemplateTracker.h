@@ -0,0 +1,167 @@
+//*****************************************************************************************
+//  File:       TemplateTracker.h
+//  Project:    WebcamLib
+//
+//  Declares the managed entry point to the native template matcher
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+using namespace System::Collections::Generic;
+
+namespace WebCamLib
+{
+	class TemplateMatcher;
+	ref class PooledFrame;
+
+	public enum class TemplateMetric : int
+	{
+		/// <summary>
+		/// Normalised cross correlation, from -1 to 1; unaffected by brightness and contrast
+		/// </summary>
+		Correlation = TemplateScoring_Correlation,
+
+		/// <summary>
+		/// 1 less the mean absolute difference over 255, from 0 to 1; cheaper, but only for steady lighting
+		/// </summary>
+		AbsoluteDifference = TemplateScoring_AbsoluteDifference,
+	};
+
+	/// <summary>
+	/// Where a template was found in the last frame, in pixels, and how well it matched
+	/// </summary>
+	public value struct TemplateLocation
+	{
+	public:
+		TemplateLocation( int index, int x, int y, int width, int height, float score, bool found );
+
+		property int Index
+		{
+			int get() { return index; }
+		}
+
+		property int X
+		{
+			int get() { return x; }
+		}
+
+		property int Y
+		{
+			int get() { return y; }
+		}
+
+		property int Width
+		{
+			int get() { return width; }
+		}
+
+		property int Height
+		{
+			int get() { return height; }
+		}
+
+		property float Score
+		{
+			float get() { return score; }
+		}
+
+		/// <summary>
+		/// Whether the score reached MinimumScore; when not, the location is only the best guess
+		/// </summary>
+		property bool Found
+		{
+			bool get() { return found; }
+		}
+
+	private:
+		int index;
+		int x, y, width, height;
+		float score;
+		bool found;
+	};
+
+	/// <summary>
+	/// Finds a set of template images in frames with a coarse to fine search over image pyramids,
+	/// looking for each template near where it was last found before searching the whole frame
+	/// </summary>
+	public ref class TemplateTracker
+	{
+	public:
+		TemplateTracker();
+
+		/// <summary>
+		/// When parallel is set, the templates are searched on the shared worker pool
+		/// </summary>
+		TemplateTracker( bool parallel );
+
+		~TemplateTracker();
+
+		/// <summary>
+		/// Adds an 8 bit grey, 24 or 32 bit BGR image of at least 8 by 8 pixels and returns its index
+		/// </summary>
+		int AddTemplate( IntPtr scan0, int width, int height, int stride, int bitsPerPixel );
+
+		void ClearTemplates();
+
+		property int TemplateCount
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Correlation by default
+		/// </summary>
+		property TemplateMetric Metric
+		{
+			TemplateMetric get();
+			void set( TemplateMetric value );
+		}
+
+		/// <summary>
+		/// Score a template must reach to count as found, at most 1; 0.8 by default
+		/// </summary>
+		property float MinimumScore
+		{
+			float get();
+			void set( float value );
+		}
+
+		/// <summary>
+		/// Pixels around its last location a found template is looked for within before the whole
+		/// frame is searched; zero always searches the whole frame. 32 by default.
+		/// </summary>
+		property int SearchRadius
+		{
+			int get();
+			void set( int value );
+		}
+
+		/// <summary>
+		/// Searches an 8 bit grey, 24 or 32 bit BGR image for every template and returns the number found
+		/// </summary>
+		int Match( IntPtr scan0, int width, int height, int stride, int bitsPerPixel );
+
+		int Match( PooledFrame^ frame );
+
+		TemplateLocation GetLocation( int index );
+
+		/// <summary>
+		/// Replaces the contents of the list with the templates found in the last frame
+		/// </summary>
+		void GetFound( IList<TemplateLocation>^ locations );
+
+		/// <summary>
+		/// Forgets where the templates were, so the next frame is searched whole
+		/// </summary>
+		void ResetTracking();
+
+	protected:
+		!TemplateTracker();
+
+	private:
+		TemplateMatcher* GetMatcher();
+
+		TemplateMatcher* pMatcher;
+	};
+}
@@ -0,0 +1,162 @@
+//*****************************************************************************************
+//  File:       TemporalDenoiser.cpp
+//  Project:    WebcamLib
+//
+//  Defines the motion-adaptive recursive filter which averages sensor noise over frames
+//*****************************************************************************************
+
+#include <windows.h>
+#include <stdlib.h>
+#include <emmintrin.h>
+
+#include "TemporalDenoiser.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Strength 1 keeps this much of every new frame; the average then spans 2 * 256 / 16 - 1 frames
+#define DENOISE_WEIGHT_FLOOR	16
+
+namespace
+{
+	struct FilterConstants
+	{
+		__m128i minimumWeight;
+		__m128i noiseThreshold;
+		__m128i slope;
+		__m128i one;
+		__m128i blendRounding;
+		__m128i levelRounding;
+	};
+
+	// Blends eight samples, widened to 16 bits, into their state and returns them filtered
+	inline __m128i FilterEight(__m128i samples, short* pState, const FilterConstants& k)
+	{
+		__m128i current = _mm_slli_epi16(samples, DENOISE_FRACTION_BITS);
+		__m128i state = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pState));
+
+		// Both fit in 15 bits, so the signed difference cannot overflow
+		__m128i distance = _mm_max_epi16(_mm_sub_epi16(current, state), _mm_sub_epi16(state, current));
+		__m128i levels = _mm_srli_epi16(distance, DENOISE_FRACTION_BITS);
+
+		// The product stays below 255 * 128; the saturating add keeps the sum from wrapping
+		__m128i excess = _mm_subs_epu16(levels, k.noiseThreshold);
+		__m128i weight = _mm_min_epi16(_mm_adds_epi16(k.minimumWeight, _mm_mullo_epi16(excess, k.slope)), k.one);
+		__m128i keep = _mm_sub_epi16(k.one, weight);
+
+		__m128i low = _mm_madd_epi16(_mm_unpacklo_epi16(state, current), _mm_unpacklo_epi16(keep, weight));
+		__m128i high = _mm_madd_epi16(_mm_unpackhi_epi16(state, current), _mm_unpackhi_epi16(keep, weight));
+		low = _mm_srai_epi32(_mm_add_epi32(low, k.blendRounding), 8);
+		high = _mm_srai_epi32(_mm_add_epi32(high, k.blendRounding), 8);
+
+		state = _mm_packs_epi32(low, high);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pState), state);
+
+		return _mm_srli_epi16(_mm_add_epi16(state, k.levelRounding), DENOISE_FRACTION_BITS);
+	}
+}
+
+TemporalDenoiser::TemporalDenoiser()
+{
+	m_nRowBytes = 0;
+	m_nRows = 0;
+	m_bHasState = false;
+	m_bFirstFrame = true;
+
+	SetParameters(0.5, 4, 16);
+}
+
+HRESULT TemporalDenoiser::SetParameters(double dStrength, int nNoiseThreshold, int nMotionRange)
+{
+	if (!(dStrength >= 0.0 && dStrength <= 1.0) || nNoiseThreshold < 0 || nNoiseThreshold > 255 || nMotionRange < 1 || nMotionRange > 255)
+		return E_INVALIDARG;
+
+	m_nMinimumWeight = DENOISE_WEIGHT_ONE - static_cast<int>(dStrength * (DENOISE_WEIGHT_ONE - DENOISE_WEIGHT_FLOOR) + 0.5);
+	m_nNoiseThreshold = nNoiseThreshold;
+
+	// Rounded up so the weight reaches one within the range; capped so the product fits 16 bits
+	m_nSlope = min((DENOISE_WEIGHT_ONE - m_nMinimumWeight + nMotionRange - 1) / nMotionRange, 128);
+
+	return S_OK;
+}
+
+HRESULT TemporalDenoiser::BeginFrame(int nRowBytes, int nRows)
+{
+	if (nRowBytes <= 0 || nRows <= 0)
+		return E_INVALIDARG;
+
+	if (!m_bHasState || nRowBytes != m_nRowBytes || nRows != m_nRows)
+	{
+		m_aState.resize(static_cast<size_t>(nRowBytes) * nRows);
+		m_nRowBytes = nRowBytes;
+		m_nRows = nRows;
+		m_bFirstFrame = true;
+	}
+	else
+	{
+		m_bFirstFrame = false;
+	}
+
+	// The first frame's rows fill the state as they are filtered
+	m_bHasState = true;
+
+	return S_OK;
+}
+
+void TemporalDenoiser::Reset()
+{
+	m_bHasState = false;
+}
+
+void TemporalDenoiser::FilterRow(BYTE* pRow, int nRow)
+{
+	short* pState = &m_aState[static_cast<size_t>(nRow) * m_nRowBytes];
+	int nBytes = m_nRowBytes;
+
+	if (m_bFirstFrame)
+	{
+		for (int x = 0; x < nBytes; x++)
+		{
+			pState[x] = static_cast<short>(pRow[x] << DENOISE_FRACTION_BITS);
+		}
+		return;
+	}
+
+	FilterConstants k;
+	k.minimumWeight = _mm_set1_epi16(static_cast<short>(m_nMinimumWeight));
+	k.noiseThreshold = _mm_set1_epi16(static_cast<short>(m_nNoiseThreshold));
+	k.slope = _mm_set1_epi16(static_cast<short>(m_nSlope));
+	k.one = _mm_set1_epi16(DENOISE_WEIGHT_ONE);
+	k.blendRounding = _mm_set1_epi32(DENOISE_WEIGHT_ONE / 2);
+	k.levelRounding = _mm_set1_epi16(1 << (DENOISE_FRACTION_BITS - 1));
+
+	const __m128i zero = _mm_setzero_si128();
+
+	int x = 0;
+	for (; x + 16 <= nBytes; x += 16)
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + x));
+
+		__m128i low = FilterEight(_mm_unpacklo_epi8(pixels, zero), pState + x, k);
+		__m128i high = FilterEight(_mm_unpackhi_epi8(pixels, zero), pState + x + 8, k);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + x), _mm_packus_epi16(low, high));
+	}
+
+	// The same arithmetic for the bytes left over
+	for (; x < nBytes; x++)
+	{
+		int nCurrent = pRow[x] << DENOISE_FRACTION_BITS;
+		int nState = pState[x];
+
+		int nLevels = abs(nCurrent - nState) >> DENOISE_FRACTION_BITS;
+		int nWeight = min(m_nMinimumWeight + max(nLevels - m_nNoiseThreshold, 0) * m_nSlope, DENOISE_WEIGHT_ONE);
+
+		nState = (nState * (DENOISE_WEIGHT_ONE - nWeight) + nCurrent * nWeight + DENOISE_WEIGHT_ONE / 2) >> 8;
+		pState[x] = static_cast<short>(nState);
+		pRow[x] = static_cast<BYTE>((nState + (1 << (DENOISE_FRACTION_BITS - 1))) >> DENOISE_FRACTION_BITS);
+	}
+}
+
+#pragma managed(pop)
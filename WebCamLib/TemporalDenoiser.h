@@ -0,0 +1,72 @@
+//*****************************************************************************************
+//  File:       TemporalDenoiser.h
+//  Project:    WebcamLib
+//
+//  Declares the motion-adaptive recursive filter which averages sensor noise over frames
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+// The filter state keeps this many bits below each 8 bit level, so slow averages do not band
+#define DENOISE_FRACTION_BITS	7
+
+// Blend weight of the new frame which takes it as it is
+#define DENOISE_WEIGHT_ONE		256
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// Blends every frame into a running average of the ones before it, sample by sample, with a
+	/// weight for the new frame that grows with how far it is from the average: differences up to
+	/// the noise threshold get the minimum weight, and the weight then rises to take the new frame
+	/// as it is over the motion range, so what moves does not smear. The average is kept in fixed
+	/// point, one 16 bit sample for every byte of the frame, in a buffer reused from frame to frame
+	/// and started over when the format changes. Rows are filtered with SSE2 and may be filtered
+	/// on several threads at once, between calls to BeginFrame.
+	/// </summary>
+	class TemporalDenoiser
+	{
+	public:
+		TemporalDenoiser();
+
+		/// <summary>
+		/// dStrength from 0, which leaves frames as they are, to 1, which averages still pixels over
+		/// about 30 frames; thresholds are in 8 bit levels. E_INVALIDARG for values out of range.
+		/// </summary>
+		HRESULT SetParameters(double dStrength, int nNoiseThreshold, int nMotionRange);
+
+		/// <summary>
+		/// Readies the state for a frame of nRows rows of nRowBytes bytes, before any of its rows
+		/// are filtered; a frame of another format than the last starts the average over
+		/// </summary>
+		HRESULT BeginFrame(int nRowBytes, int nRows);
+
+		/// <summary>
+		/// Drops the average, so the next frame starts it over
+		/// </summary>
+		void Reset();
+
+		/// <summary>
+		/// Filters row nRow of the frame in place
+		/// </summary>
+		void FilterRow(BYTE* pRow, int nRow);
+
+	private:
+		int m_nMinimumWeight;
+		int m_nNoiseThreshold;
+		int m_nSlope;
+
+		int m_nRowBytes;
+		int m_nRows;
+		bool m_bHasState;
+		bool m_bFirstFrame;
+
+		std::vector<short> m_aState;
+	};
+}
+
+#pragma managed(pop)
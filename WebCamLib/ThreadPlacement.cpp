@@ -0,0 +1,132 @@
+//*****************************************************************************************
+//  File:       ThreadPlacement.cpp
+//  Project:    WebcamLib
+//
+//  Defines the affinity, priority and name settings applied to capture and worker threads
+//*****************************************************************************************
+
+#include <windows.h>
+#include <strsafe.h>
+
+#include "ThreadPlacement.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Windows 10 1607 and later name threads for every tool; older systems only tell an attached debugger
+typedef HRESULT (WINAPI *PFN_SetThreadDescription)(HANDLE hThread, PCWSTR lpThreadDescription);
+
+#define MS_VC_EXCEPTION 0x406D1388
+
+#pragma pack(push, 8)
+struct THREADNAME_INFO
+{
+	DWORD dwType;		// 0x1000
+	LPCSTR szName;
+	DWORD dwThreadID;
+	DWORD dwFlags;
+};
+#pragma pack(pop)
+
+static void NameThreadForDebugger(DWORD dwThreadId, PCWSTR szName)
+{
+	char szAnsiName[THREAD_PLACEMENT_MAX_NAME + 8];
+	if (WideCharToMultiByte(CP_ACP, 0, szName, -1, szAnsiName, sizeof(szAnsiName), NULL, NULL) == 0)
+		return;
+
+	THREADNAME_INFO info;
+	info.dwType = 0x1000;
+	info.szName = szAnsiName;
+	info.dwThreadID = dwThreadId;
+	info.dwFlags = 0;
+
+	__try
+	{
+		RaiseException(MS_VC_EXCEPTION, 0, sizeof(info) / sizeof(ULONG_PTR), reinterpret_cast<ULONG_PTR*>(&info));
+	}
+	__except (EXCEPTION_EXECUTE_HANDLER)
+	{
+	}
+}
+
+static HRESULT NameThread(HANDLE hThread, PCWSTR szName)
+{
+	static PFN_SetThreadDescription pfnSetThreadDescription = reinterpret_cast<PFN_SetThreadDescription>(
+		GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription"));
+
+	HRESULT hr = S_OK;
+
+	if (pfnSetThreadDescription != NULL)
+	{
+		hr = pfnSetThreadDescription(hThread, szName);
+	}
+
+	if (IsDebuggerPresent())
+	{
+		NameThreadForDebugger(GetThreadId(hThread), szName);
+	}
+
+	return hr;
+}
+
+ThreadPlacement::ThreadPlacement()
+{
+	dwAffinityMask = 0;
+	nPriority = THREAD_PLACEMENT_KEEP_PRIORITY;
+	szName[0] = L'\0';
+}
+
+HRESULT WebCamLib::ApplyThreadPlacement(HANDLE hThread, const ThreadPlacement& placement, int nIndex)
+{
+	HRESULT hr = S_OK;
+
+	if (placement.dwAffinityMask != 0)
+	{
+		DWORD_PTR dwProcessMask = 0;
+		DWORD_PTR dwSystemMask = 0;
+		if (!GetProcessAffinityMask(GetCurrentProcess(), &dwProcessMask, &dwSystemMask))
+		{
+			hr = HRESULT_FROM_WIN32(GetLastError());
+		}
+		else if ((placement.dwAffinityMask & dwProcessMask) == 0)
+		{
+			hr = E_INVALIDARG;
+		}
+		else if (SetThreadAffinityMask(hThread, placement.dwAffinityMask & dwProcessMask) == 0)
+		{
+			hr = HRESULT_FROM_WIN32(GetLastError());
+		}
+	}
+
+	if (SUCCEEDED(hr) && placement.nPriority != THREAD_PLACEMENT_KEEP_PRIORITY)
+	{
+		if (!SetThreadPriority(hThread, placement.nPriority))
+		{
+			hr = HRESULT_FROM_WIN32(GetLastError());
+		}
+	}
+
+	if (SUCCEEDED(hr) && placement.szName[0] != L'\0')
+	{
+		WCHAR szName[THREAD_PLACEMENT_MAX_NAME + 16];
+
+		if (nIndex >= 0)
+		{
+			hr = StringCchPrintfW(szName, ARRAYSIZE(szName), L"%s #%d", placement.szName, nIndex);
+		}
+		else
+		{
+			hr = StringCchCopyW(szName, ARRAYSIZE(szName), placement.szName);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = NameThread(hThread, szName);
+		}
+	}
+
+	return hr;
+}
+
+#pragma managed(pop)
@@ -0,0 +1,39 @@
+//*****************************************************************************************
+//  File:       ThreadPlacement.h
+//  Project:    WebcamLib
+//
+//  Declares the affinity, priority and name settings applied to capture and worker threads
+//*****************************************************************************************
+
+#pragma once
+
+#pragma managed(push, off)
+
+// Priority value which leaves a thread's priority as it is
+#define THREAD_PLACEMENT_KEEP_PRIORITY	MAXLONG
+
+#define THREAD_PLACEMENT_MAX_NAME		64
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// Where a thread may run and how it competes for the processor. The defaults change nothing.
+	/// </summary>
+	struct ThreadPlacement
+	{
+		ThreadPlacement();
+
+		DWORD_PTR dwAffinityMask;				// processors the thread may run on, 0 for any
+		int nPriority;							// THREAD_PRIORITY_* value
+		WCHAR szName[THREAD_PLACEMENT_MAX_NAME];	// shown by debuggers and profilers, empty to keep
+	};
+
+	/// <summary>
+	/// Applies a placement to a thread. Threads of a pool pass their position, which is appended to
+	/// the name; others pass -1. The affinity is limited to the processors of the process, and fails
+	/// with E_INVALIDARG when that leaves none.
+	/// </summary>
+	HRESULT ApplyThreadPlacement(HANDLE hThread, const ThreadPlacement& placement, int nIndex);
+}
+
+#pragma managed(pop)
@@ -0,0 +1,86 @@
+//*****************************************************************************************
+//  File:       ThreadPlacementOptions.cpp
+//  Project:    WebcamLib
+//
+//  Defines the managed view of the placement given to capture and worker threads
+//*****************************************************************************************
+
+#include <windows.h>
+#include <strsafe.h>
+#include <vcclr.h>
+
+#include "ThreadPlacement.h"
+#include "ThreadPlacementOptions.h"
+
+using namespace System::Runtime::InteropServices;
+using namespace System::Threading;
+using namespace WebCamLib;
+
+ThreadPlacementOptions::ThreadPlacementOptions()
+{
+	affinityMask = 0;
+	priority = NativeThreadPriority::Unchanged;
+	name = nullptr;
+}
+
+long long ThreadPlacementOptions::AffinityMask::get()
+{
+	return affinityMask;
+}
+
+void ThreadPlacementOptions::AffinityMask::set( long long value )
+{
+	if( static_cast<long long>( static_cast<DWORD_PTR>( value ) ) != value )
+		throw gcnew ArgumentOutOfRangeException( "value", "The mask names processors this process cannot address." );
+
+	affinityMask = value;
+}
+
+NativeThreadPriority ThreadPlacementOptions::Priority::get()
+{
+	return priority;
+}
+
+void ThreadPlacementOptions::Priority::set( NativeThreadPriority value )
+{
+	priority = value;
+}
+
+String^ ThreadPlacementOptions::Name::get()
+{
+	return name;
+}
+
+void ThreadPlacementOptions::Name::set( String^ value )
+{
+	if( value != nullptr && value->Length >= THREAD_PLACEMENT_MAX_NAME )
+		throw gcnew ArgumentException( "Thread names are limited to " + ( THREAD_PLACEMENT_MAX_NAME - 1 ).ToString() + " characters.", "value" );
+
+	name = value;
+}
+
+void ThreadPlacementOptions::ApplyToCurrentThread()
+{
+	ThreadPlacement placement;
+	ToNative( &placement );
+
+	// Affinity and priority belong to the OS thread, so the runtime must not move this code off it
+	Thread::BeginThreadAffinity();
+
+	HRESULT hr = ApplyThreadPlacement( GetCurrentThread(), placement, -1 );
+	if( FAILED( hr ) )
+		throw gcnew COMException( "Unable to apply the thread placement.", hr );
+}
+
+void ThreadPlacementOptions::ToNative( ThreadPlacement* pPlacement )
+{
+	pPlacement->dwAffinityMask = static_cast<DWORD_PTR>( affinityMask );
+	pPlacement->nPriority = static_cast<int>( priority );
+	pPlacement->szName[0] = L'\0';
+
+	if( name != nullptr )
+	{
+		pin_ptr<const wchar_t> pszName = PtrToStringChars( name );
+		StringCchCopyW( pPlacement->szName, THREAD_PLACEMENT_MAX_NAME, pszName );
+	}
+}
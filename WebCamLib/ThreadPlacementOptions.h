@@ -0,0 +1,81 @@
+//*****************************************************************************************
+//  File:       ThreadPlacementOptions.h
+//  Project:    WebcamLib
+//
+//  Declares the managed view of the placement given to capture and worker threads
+//*****************************************************************************************
+
+#pragma once
+
+using namespace System;
+
+namespace WebCamLib
+{
+	struct ThreadPlacement;
+
+	/// <summary>
+	/// Win32 thread priorities, which go beyond System.Threading.ThreadPriority at both ends
+	/// </summary>
+	public enum class NativeThreadPriority : int
+	{
+		/// <summary>
+		/// Leaves the priority the thread has
+		/// </summary>
+		Unchanged = THREAD_PLACEMENT_KEEP_PRIORITY,
+
+		Idle = THREAD_PRIORITY_IDLE,
+		Lowest = THREAD_PRIORITY_LOWEST,
+		BelowNormal = THREAD_PRIORITY_BELOW_NORMAL,
+		Normal = THREAD_PRIORITY_NORMAL,
+		AboveNormal = THREAD_PRIORITY_ABOVE_NORMAL,
+		Highest = THREAD_PRIORITY_HIGHEST,
+		TimeCritical = THREAD_PRIORITY_TIME_CRITICAL,
+	};
+
+	/// <summary>
+	/// Processors a thread may run on, its priority and its name, e.g. to keep the capture thread
+	/// off the cores a noisy workload runs on. The defaults leave a thread as it is.
+	/// </summary>
+	public ref class ThreadPlacementOptions
+	{
+	public:
+		ThreadPlacementOptions();
+
+		/// <summary>
+		/// Bit n allows processor n; 0 allows every processor of the process
+		/// </summary>
+		property long long AffinityMask
+		{
+			long long get();
+			void set( long long value );
+		}
+
+		property NativeThreadPriority Priority
+		{
+			NativeThreadPriority get();
+			void set( NativeThreadPriority value );
+		}
+
+		/// <summary>
+		/// Shown by debuggers and profilers; threads of a pool get their number appended. Null keeps the name.
+		/// </summary>
+		property String^ Name
+		{
+			String^ get();
+			void set( String^ value );
+		}
+
+		/// <summary>
+		/// Applies the placement to the calling thread, which a managed caller stays on from then on
+		/// </summary>
+		void ApplyToCurrentThread();
+
+	internal:
+		void ToNative( ThreadPlacement* pPlacement );
+
+	private:
+		long long affinityMask;
+		NativeThreadPriority priority;
+		String^ name;
+	};
+}
@@ -0,0 +1,229 @@
+//*****************************************************************************************
+//  File:       ToneMapper.cpp
+//  Project:    WebcamLib
+//
+//  Defines the software stand-in for brightness, contrast, gamma, hue and saturation
+//*****************************************************************************************
+
+#include <windows.h>
+#include <math.h>
+
+#include "ToneMapper.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+namespace
+{
+	const PropertyRange s_aRanges[ToneProperty_Count] =
+	{
+		{ -100, 100, 1, 0 },
+		{ 0, 200, 1, 100 },
+		{ -180, 180, 1, 0 },
+		{ 0, 200, 1, 100 },
+		{ 1, 500, 1, 100 },
+	};
+
+	// Luma weights the hue rotation and saturation keep grey along
+	const double s_dLumaRed = 0.213;
+	const double s_dLumaGreen = 0.715;
+	const double s_dLumaBlue = 0.072;
+}
+
+ToneMapper::ToneMapper()
+{
+	InitializeCriticalSection(&m_cs);
+
+	for (int n = 0; n < ToneProperty_Count; n++)
+	{
+		m_alValues[n] = s_aRanges[n].lDefault;
+		m_abEmulated[n] = false;
+	}
+
+	m_nVersion = 0;
+	m_nBuiltVersion = -1;
+	m_bIdentity = true;
+	m_bMixColours = false;
+}
+
+ToneMapper::~ToneMapper()
+{
+	DeleteCriticalSection(&m_cs);
+}
+
+void ToneMapper::GetRange(ToneProperty eProperty, PropertyRange* pRange)
+{
+	*pRange = s_aRanges[eProperty];
+}
+
+long ToneMapper::GetValue(ToneProperty eProperty)
+{
+	EnterCriticalSection(&m_cs);
+	long lValue = m_alValues[eProperty];
+	LeaveCriticalSection(&m_cs);
+
+	return lValue;
+}
+
+HRESULT ToneMapper::SetValue(ToneProperty eProperty, long lValue)
+{
+	if (lValue < s_aRanges[eProperty].lMinimum || lValue > s_aRanges[eProperty].lMaximum)
+		return E_INVALIDARG;
+
+	EnterCriticalSection(&m_cs);
+	if (m_alValues[eProperty] != lValue)
+	{
+		m_alValues[eProperty] = lValue;
+		InterlockedIncrement(&m_nVersion);
+	}
+	LeaveCriticalSection(&m_cs);
+
+	return S_OK;
+}
+
+bool ToneMapper::IsEmulated(ToneProperty eProperty)
+{
+	EnterCriticalSection(&m_cs);
+	bool bEmulated = m_abEmulated[eProperty];
+	LeaveCriticalSection(&m_cs);
+
+	return bEmulated;
+}
+
+void ToneMapper::SetEmulated(ToneProperty eProperty, bool bEmulated)
+{
+	EnterCriticalSection(&m_cs);
+	if (m_abEmulated[eProperty] != bEmulated)
+	{
+		m_abEmulated[eProperty] = bEmulated;
+		InterlockedIncrement(&m_nVersion);
+	}
+	LeaveCriticalSection(&m_cs);
+}
+
+void ToneMapper::Apply(BYTE* pData, int nWidth, int nHeight, int nStride, int nBitsPerPixel)
+{
+	if (m_nVersion != m_nBuiltVersion)
+	{
+		Rebuild();
+	}
+
+	if (m_bIdentity || (nBitsPerPixel != 24 && nBitsPerPixel != 32))
+		return;
+
+	int nBytes = nBitsPerPixel / 8;
+
+	for (int y = 0; y < nHeight; y++)
+	{
+		BYTE* p = pData + y * nStride;
+		BYTE* pEnd = p + nWidth * nBytes;
+
+		if (!m_bMixColours)
+		{
+			for (; p < pEnd; p += nBytes)
+			{
+				p[0] = m_abLevels[p[0]];
+				p[1] = m_abLevels[p[1]];
+				p[2] = m_abLevels[p[2]];
+			}
+		}
+		else
+		{
+			const int nRounding = 1 << (TONE_MIX_BITS - 1);
+
+			for (; p < pEnd; p += nBytes)
+			{
+				int nBlue = p[0];
+				int nGreen = p[1];
+				int nRed = p[2];
+
+				for (int c = 0; c < 3; c++)
+				{
+					int nLevel = (m_anMix[c][0][nBlue] + m_anMix[c][1][nGreen] + m_anMix[c][2][nRed] + nRounding) >> TONE_MIX_BITS;
+					p[c] = static_cast<BYTE>(nLevel < 0 ? 0 : (nLevel > 255 ? 255 : nLevel));
+				}
+			}
+		}
+	}
+}
+
+void ToneMapper::Rebuild()
+{
+	long alValues[ToneProperty_Count];
+
+	EnterCriticalSection(&m_cs);
+	m_nBuiltVersion = m_nVersion;
+	for (int n = 0; n < ToneProperty_Count; n++)
+	{
+		alValues[n] = m_abEmulated[n] ? m_alValues[n] : s_aRanges[n].lDefault;
+	}
+	LeaveCriticalSection(&m_cs);
+
+	double dBrightness = alValues[ToneProperty_Brightness] / 200.0;
+	double dContrast = alValues[ToneProperty_Contrast] / 100.0;
+	double dExponent = 100.0 / alValues[ToneProperty_Gamma];
+
+	bool bIdentityLevels = true;
+
+	for (int n = 0; n < 256; n++)
+	{
+		double dLevel = (n / 255.0 - 0.5) * dContrast + 0.5 + dBrightness;
+		dLevel = pow(min(max(dLevel, 0.0), 1.0), dExponent);
+
+		m_abLevels[n] = static_cast<BYTE>(dLevel * 255.0 + 0.5);
+		bIdentityLevels = bIdentityLevels && m_abLevels[n] == n;
+	}
+
+	m_bMixColours = alValues[ToneProperty_Hue] != s_aRanges[ToneProperty_Hue].lDefault || alValues[ToneProperty_Saturation] != s_aRanges[ToneProperty_Saturation].lDefault;
+	m_bIdentity = bIdentityLevels && !m_bMixColours;
+
+	if (!m_bMixColours)
+		return;
+
+	// Rows give red, green and blue out of red, green and blue in: the hue rotation, then the saturation
+	const double adLuma[3] = { s_dLumaRed, s_dLumaGreen, s_dLumaBlue };
+	double dAngle = alValues[ToneProperty_Hue] * 3.14159265358979323846 / 180.0;
+	double dCos = cos(dAngle);
+	double dSin = sin(dAngle);
+
+	const double adHue[3][3] =
+	{
+		{ s_dLumaRed + dCos * (1 - s_dLumaRed) - dSin * s_dLumaRed, s_dLumaGreen - dCos * s_dLumaGreen - dSin * s_dLumaGreen, s_dLumaBlue - dCos * s_dLumaBlue + dSin * (1 - s_dLumaBlue) },
+		{ s_dLumaRed - dCos * s_dLumaRed + dSin * 0.143, s_dLumaGreen + dCos * (1 - s_dLumaGreen) + dSin * 0.140, s_dLumaBlue - dCos * s_dLumaBlue - dSin * 0.283 },
+		{ s_dLumaRed - dCos * s_dLumaRed - dSin * (1 - s_dLumaRed), s_dLumaGreen - dCos * s_dLumaGreen + dSin * s_dLumaGreen, s_dLumaBlue + dCos * (1 - s_dLumaBlue) + dSin * s_dLumaBlue },
+	};
+
+	double dSaturation = alValues[ToneProperty_Saturation] / 100.0;
+	double adMatrix[3][3];
+
+	for (int r = 0; r < 3; r++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			double dSum = 0.0;
+			for (int k = 0; k < 3; k++)
+			{
+				double dSaturate = adLuma[k] * (1.0 - dSaturation) + (r == k ? dSaturation : 0.0);
+				dSum += dSaturate * adHue[k][c];
+			}
+			adMatrix[r][c] = dSum;
+		}
+	}
+
+	// Frames are BGR, so channel 0 is the matrix's last row and column
+	for (int nOutput = 0; nOutput < 3; nOutput++)
+	{
+		for (int nInput = 0; nInput < 3; nInput++)
+		{
+			double dWeight = adMatrix[2 - nOutput][2 - nInput] * (1 << TONE_MIX_BITS);
+
+			for (int n = 0; n < 256; n++)
+			{
+				m_anMix[nOutput][nInput][n] = static_cast<int>(floor(dWeight * m_abLevels[n] + 0.5));
+			}
+		}
+	}
+}
+
+#pragma managed(pop)
@@ -0,0 +1,88 @@
+//*****************************************************************************************
+//  File:       ToneMapper.h
+//  Project:    WebcamLib
+//
+//  Declares the software stand-in for brightness, contrast, gamma, hue and saturation
+//*****************************************************************************************
+
+#pragma once
+
+#include "ExposureController.h"
+
+#pragma managed(push, off)
+
+// Fixed point of the colour mixing tables
+#define TONE_MIX_BITS		12
+
+namespace WebCamLib
+{
+	/// <summary>
+	/// Picture controls the ToneMapper can emulate, with the ranges and defaults DirectShow
+	/// drivers commonly report for them
+	/// </summary>
+	enum ToneProperty
+	{
+		ToneProperty_Brightness,		// -100 to 100, shifting levels by up to half the range
+		ToneProperty_Contrast,			// 0 to 200 percent about mid grey
+		ToneProperty_Hue,				// -180 to 180 degrees about the grey axis
+		ToneProperty_Saturation,		// 0 to 200 percent, 0 being grey
+		ToneProperty_Gamma,				// 1 to 500, 100 being 1.0; higher values lighten the mid tones
+		ToneProperty_Count
+	};
+
+	/// <summary>
+	/// Adjusts frames in place for the picture controls a camera lacks. Brightness, contrast and
+	/// gamma fold into one table of the 256 levels; hue and saturation are a colour matrix about
+	/// the grey axis, folded with that table into a table per input and output channel, so a pixel
+	/// costs table lookups and additions only. The tables are rebuilt by the thread applying them,
+	/// and only after a value changes; values may be set from any thread meanwhile.
+	/// </summary>
+	class ToneMapper
+	{
+	public:
+		ToneMapper();
+		~ToneMapper();
+
+		static void GetRange(ToneProperty eProperty, PropertyRange* pRange);
+
+		long GetValue(ToneProperty eProperty);
+
+		/// <summary>
+		/// E_INVALIDARG for a value outside the property's range
+		/// </summary>
+		HRESULT SetValue(ToneProperty eProperty, long lValue);
+
+		/// <summary>
+		/// Only emulated properties are applied; the others are left to the camera's own controls
+		/// and their values kept for when a camera lacking them is started
+		/// </summary>
+		bool IsEmulated(ToneProperty eProperty);
+		void SetEmulated(ToneProperty eProperty, bool bEmulated);
+
+		/// <summary>
+		/// Adjusts a 24 or 32 bit image in place; returns at once when every emulated property is at its default
+		/// </summary>
+		void Apply(BYTE* pData, int nWidth, int nHeight, int nStride, int nBitsPerPixel);
+
+	private:
+		ToneMapper(const ToneMapper&);
+		ToneMapper& operator=(const ToneMapper&);
+
+		void Rebuild();
+
+		// Guards the values and emulated flags
+		CRITICAL_SECTION m_cs;
+		long m_alValues[ToneProperty_Count];
+		bool m_abEmulated[ToneProperty_Count];
+		volatile LONG m_nVersion;
+
+		// Built from the values of m_nBuiltVersion, and only touched by the thread calling Apply
+		LONG m_nBuiltVersion;
+		bool m_bIdentity;
+		bool m_bMixColours;
+		BYTE m_abLevels[256];
+		int m_anMix[3][3][256];			// output channel, input channel, level; BGR order
+	};
+}
+
+#pragma managed(pop)
@@ -0,0 +1,497 @@
+//*****************************************************************************************
+//  File:       VideoStabiliser.cpp
+//  Project:    WebcamLib
+//
+//  Defines the global motion estimate and compensating crop which steady a shaking camera
+//*****************************************************************************************
+
+#include <algorithm>
+#include <windows.h>
+#include <emmintrin.h>
+#include <math.h>
+
+#include "WorkerPool.h"
+#include "LumaPlane.h"
+#include "VideoStabiliser.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Blocks matched on the quarter plane, in pixels, and how far they are searched each way; the
+// search reaches 32 pixels of the frame
+#define STABILISE_BLOCK				16
+#define STABILISE_SEARCH			8
+
+// Pixels of the half plane searched each way around the quarter plane's offset
+#define STABILISE_REFINE			2
+
+#define STABILISE_GRID_COLUMNS		8
+#define STABILISE_GRID_ROWS			6
+
+// Summed absolute difference between neighbouring pixels, across and down, a block needs in
+// both directions to be matched: an average of 2 levels a pixel
+#define STABILISE_MINIMUM_TEXTURE	(2 * STABILISE_BLOCK * (STABILISE_BLOCK - 1))
+
+// Blocks which must agree on the motion, within a pixel of the half plane, for it to be trusted
+#define STABILISE_MINIMUM_BLOCKS	4
+
+// Output rows sampled as one work item, and the bits of the bilinear weights
+#define STABILISE_BAND_ROWS			32
+#define STABILISE_WEIGHT_BITS		7
+
+namespace
+{
+	// Sum of absolute differences of two 16 by 16 blocks
+	inline int BlockDifference(const BYTE* pA, int nStrideA, const BYTE* pB, int nStrideB)
+	{
+		__m128i sums = _mm_setzero_si128();
+
+		for (int y = 0; y < STABILISE_BLOCK; y++)
+		{
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pA + y * nStrideA));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pB + y * nStrideB));
+			sums = _mm_add_epi64(sums, _mm_sad_epu8(a, b));
+		}
+
+		return _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+	}
+
+	// Vertex of the parabola through three samples, from -0.5 to 0.5 around the middle one
+	inline float FitParabola(int nBefore, int nAt, int nAfter)
+	{
+		int nCurvature = nBefore - 2 * nAt + nAfter;
+		if (nCurvature <= 0)
+			return 0.0f;
+
+		float fOffset = 0.5f * (nBefore - nAfter) / nCurvature;
+		return max(-0.5f, min(0.5f, fOffset));
+	}
+
+	inline float Median(std::vector<float>& afValues)
+	{
+		std::vector<float>::iterator middle = afValues.begin() + afValues.size() / 2;
+		std::nth_element(afValues.begin(), middle, afValues.end());
+		return *middle;
+	}
+}
+
+VideoStabiliser::VideoStabiliser()
+{
+	m_dMargin = 0.05;
+	m_nSmoothingFrames = 15;
+	m_pPool = NULL;
+	m_nCurrent = 0;
+	m_nWidth = 0;
+	m_nHeight = 0;
+	m_nBitsPerPixel = 0;
+
+	Reset();
+}
+
+HRESULT VideoStabiliser::SetParameters(double dMargin, int nSmoothingFrames)
+{
+	if (!(dMargin > 0.0 && dMargin <= 0.25) || nSmoothingFrames < 1)
+		return E_INVALIDARG;
+
+	m_dMargin = dMargin;
+	m_nSmoothingFrames = nSmoothingFrames;
+
+	return S_OK;
+}
+
+void VideoStabiliser::GetOutputSize(int nWidth, int nHeight, int* pnWidth, int* pnHeight) const
+{
+	// At least two pixels, so a shift of one still has a neighbour to sample
+	int nMarginX = max(2, static_cast<int>(nWidth * m_dMargin));
+	int nMarginY = max(2, static_cast<int>(nHeight * m_dMargin));
+
+	*pnWidth = max(0, nWidth - 2 * nMarginX);
+	*pnHeight = max(0, nHeight - 2 * nMarginY);
+}
+
+void VideoStabiliser::Reset()
+{
+	m_bHasLast = false;
+	m_fMotionX = 0.0f;
+	m_fMotionY = 0.0f;
+	m_dPathX = 0.0;
+	m_dPathY = 0.0;
+	m_dSmoothX = 0.0;
+	m_dSmoothY = 0.0;
+}
+
+HRESULT VideoStabiliser::Stabilise(const BYTE* pSourceTop, int nSourceStride, int nWidth, int nHeight, int nBitsPerPixel,
+	BYTE* pOutputTop, int nOutputStride)
+{
+	if (pSourceTop == NULL || pOutputTop == NULL || (nBitsPerPixel != 24 && nBitsPerPixel != 32))
+		return E_INVALIDARG;
+
+	int nOutputWidth;
+	int nOutputHeight;
+	GetOutputSize(nWidth, nHeight, &nOutputWidth, &nOutputHeight);
+
+	if (nOutputWidth <= 0 || nOutputHeight <= 0)
+		return E_INVALIDARG;
+
+	if (nWidth != m_nWidth || nHeight != m_nHeight || nBitsPerPixel != m_nBitsPerPixel)
+	{
+		Reset();
+		m_nWidth = nWidth;
+		m_nHeight = nHeight;
+		m_nBitsPerPixel = nBitsPerPixel;
+	}
+
+	m_nCurrent = 1 - m_nCurrent;
+	BuildPlanes(pSourceTop, nSourceStride, nWidth, nHeight, nBitsPerPixel);
+
+	float fMotionX = 0.0f;
+	float fMotionY = 0.0f;
+
+	// Motion that cannot be told, as when the view is flat or changes whole, counts as none
+	if (m_bHasLast && EstimateMotion(&fMotionX, &fMotionY))
+	{
+		fMotionX *= 2.0f;
+		fMotionY *= 2.0f;
+	}
+	else
+	{
+		fMotionX = 0.0f;
+		fMotionY = 0.0f;
+	}
+
+	m_bHasLast = true;
+	m_fMotionX = fMotionX;
+	m_fMotionY = fMotionY;
+
+	// The path follows the motion; the smoothed path trails it, but never by more than the
+	// margin, so a steady pan is followed rather than cropped away
+	int nMarginX = (nWidth - nOutputWidth) / 2;
+	int nMarginY = (nHeight - nOutputHeight) / 2;
+
+	m_dPathX += fMotionX;
+	m_dPathY += fMotionY;
+	m_dSmoothX += (m_dPathX - m_dSmoothX) / m_nSmoothingFrames;
+	m_dSmoothY += (m_dPathY - m_dSmoothY) / m_nSmoothingFrames;
+
+	double dCorrectionX = max(static_cast<double>(1 - nMarginX), min(static_cast<double>(nMarginX - 1), m_dSmoothX - m_dPathX));
+	double dCorrectionY = max(static_cast<double>(1 - nMarginY), min(static_cast<double>(nMarginY - 1), m_dSmoothY - m_dPathY));
+
+	m_dSmoothX = m_dPathX + dCorrectionX;
+	m_dSmoothY = m_dPathY + dCorrectionY;
+
+	// Output pixel (x, y) samples the frame at (x, y) plus the margin less the correction
+	double dSourceX = nMarginX - dCorrectionX;
+	double dSourceY = nMarginY - dCorrectionY;
+
+	int nSourceX = static_cast<int>(floor(dSourceX));
+	int nSourceY = static_cast<int>(floor(dSourceY));
+	int nWeightX = static_cast<int>((dSourceX - nSourceX) * (1 << STABILISE_WEIGHT_BITS) + 0.5);
+	int nWeightY = static_cast<int>((dSourceY - nSourceY) * (1 << STABILISE_WEIGHT_BITS) + 0.5);
+
+	if (nWeightX == (1 << STABILISE_WEIGHT_BITS))
+	{
+		nSourceX++;
+		nWeightX = 0;
+	}
+
+	if (nWeightY == (1 << STABILISE_WEIGHT_BITS))
+	{
+		nSourceY++;
+		nWeightY = 0;
+	}
+
+	int nOne = 1 << STABILISE_WEIGHT_BITS;
+	int nHalf = nOne / 2;
+
+	m_anWeights[0] = ((nOne - nWeightX) * (nOne - nWeightY) + nHalf) >> STABILISE_WEIGHT_BITS;
+	m_anWeights[1] = (nWeightX * (nOne - nWeightY) + nHalf) >> STABILISE_WEIGHT_BITS;
+	m_anWeights[2] = ((nOne - nWeightX) * nWeightY + nHalf) >> STABILISE_WEIGHT_BITS;
+	m_anWeights[3] = nOne - m_anWeights[0] - m_anWeights[1] - m_anWeights[2];
+
+	m_pSourceTop = pSourceTop + static_cast<ptrdiff_t>(nSourceY) * nSourceStride + nSourceX * (nBitsPerPixel / 8);
+	m_nSourceStride = nSourceStride;
+	m_pOutputTop = pOutputTop;
+	m_nOutputStride = nOutputStride;
+	m_nOutputWidth = nOutputWidth;
+	m_nOutputHeight = nOutputHeight;
+
+	int nBands = (nOutputHeight + STABILISE_BAND_ROWS - 1) / STABILISE_BAND_ROWS;
+
+	if (m_pPool != NULL && nBands > 1)
+	{
+		m_pPool->Run(WarpBandProc, this, nBands);
+	}
+	else
+	{
+		for (int n = 0; n < nBands; n++)
+		{
+			WarpBand(n);
+		}
+	}
+
+	return S_OK;
+}
+
+void VideoStabiliser::BuildPlanes(const BYTE* pSourceTop, int nSourceStride, int nWidth, int nHeight, int nBitsPerPixel)
+{
+	Plane& half = m_aHalf[m_nCurrent];
+	Plane& quarter = m_aQuarter[m_nCurrent];
+
+	half.nWidth = nWidth / 2;
+	half.nHeight = nHeight / 2;
+	half.abPixels.resize(half.nWidth * half.nHeight);
+
+	int nBytes = nBitsPerPixel / 8;
+
+	for (int y = 0; y < half.nHeight; y++)
+	{
+		const BYTE* pUpper = pSourceTop + static_cast<ptrdiff_t>(2 * y) * nSourceStride;
+		const BYTE* pLower = pUpper + nSourceStride;
+		BYTE* pRow = &half.abPixels[y * half.nWidth];
+
+		for (int x = 0; x < half.nWidth; x++, pUpper += 2 * nBytes, pLower += 2 * nBytes)
+		{
+			int nBlue = pUpper[0] + pUpper[nBytes] + pLower[0] + pLower[nBytes];
+			int nGreen = pUpper[1] + pUpper[nBytes + 1] + pLower[1] + pLower[nBytes + 1];
+			int nRed = pUpper[2] + pUpper[nBytes + 2] + pLower[2] + pLower[nBytes + 2];
+
+			// The weights of LumaPlane, over four pixels
+			pRow[x] = static_cast<BYTE>((29 * nBlue + 150 * nGreen + 77 * nRed + 512) >> 10);
+		}
+	}
+
+	quarter.nWidth = half.nWidth / 2;
+	quarter.nHeight = half.nHeight / 2;
+	quarter.abPixels.resize(max(1, quarter.nWidth * quarter.nHeight));
+
+	if (quarter.nWidth > 0 && quarter.nHeight > 0)
+	{
+		LumaPlane::Halve(&half.abPixels[0], half.nWidth, half.nHeight, &quarter.abPixels[0]);
+	}
+}
+
+bool VideoStabiliser::EstimateMotion(float* pfX, float* pfY)
+{
+	const Plane& quarter = m_aQuarter[m_nCurrent];
+
+	// Blocks sit far enough in for their whole search window, and a pixel more for the texture
+	// measure, to lie within the plane
+	int nSpanX = quarter.nWidth - 2 * STABILISE_SEARCH - STABILISE_BLOCK - 1;
+	int nSpanY = quarter.nHeight - 2 * STABILISE_SEARCH - STABILISE_BLOCK - 1;
+
+	if (nSpanX < 0 || nSpanY < 0)
+		return false;
+
+	m_afMotionX.clear();
+	m_afMotionY.clear();
+
+	for (int nRow = 0; nRow < STABILISE_GRID_ROWS; nRow++)
+	{
+		for (int nColumn = 0; nColumn < STABILISE_GRID_COLUMNS; nColumn++)
+		{
+			int x = STABILISE_SEARCH + nSpanX * nColumn / (STABILISE_GRID_COLUMNS - 1);
+			int y = STABILISE_SEARCH + nSpanY * nRow / (STABILISE_GRID_ROWS - 1);
+			float fX;
+			float fY;
+
+			if (MatchBlock(x, y, &fX, &fY))
+			{
+				m_afMotionX.push_back(fX);
+				m_afMotionY.push_back(fY);
+			}
+		}
+	}
+
+	int nBlocks = static_cast<int>(m_afMotionX.size());
+	if (nBlocks < STABILISE_MINIMUM_BLOCKS)
+		return false;
+
+	// The median outvotes what moves in front of the camera; the blocks near it are then averaged
+	m_afSorted.assign(m_afMotionX.begin(), m_afMotionX.end());
+	float fMedianX = Median(m_afSorted);
+
+	m_afSorted.assign(m_afMotionY.begin(), m_afMotionY.end());
+	float fMedianY = Median(m_afSorted);
+
+	float fSumX = 0.0f;
+	float fSumY = 0.0f;
+	int nInliers = 0;
+
+	for (int i = 0; i < nBlocks; i++)
+	{
+		if (fabs(m_afMotionX[i] - fMedianX) <= 1.0f && fabs(m_afMotionY[i] - fMedianY) <= 1.0f)
+		{
+			fSumX += m_afMotionX[i];
+			fSumY += m_afMotionY[i];
+			nInliers++;
+		}
+	}
+
+	if (nInliers < STABILISE_MINIMUM_BLOCKS || 2 * nInliers < nBlocks)
+		return false;
+
+	*pfX = fSumX / nInliers;
+	*pfY = fSumY / nInliers;
+
+	return true;
+}
+
+bool VideoStabiliser::MatchBlock(int nX, int nY, float* pfX, float* pfY) const
+{
+	const Plane& lastQuarter = m_aQuarter[1 - m_nCurrent];
+	const Plane& quarter = m_aQuarter[m_nCurrent];
+	int nStride = quarter.nWidth;
+
+	const BYTE* pBlock = &lastQuarter.abPixels[nY * nStride + nX];
+
+	// A block without texture across or down cannot tell motion that way
+	int nAcross = BlockDifference(pBlock, nStride, pBlock + 1, nStride);
+	int nDown = BlockDifference(pBlock, nStride, pBlock + nStride, nStride);
+
+	if (nAcross < STABILISE_MINIMUM_TEXTURE || nDown < STABILISE_MINIMUM_TEXTURE)
+		return false;
+
+	int nBestX = 0;
+	int nBestY = 0;
+	int nBest = MAXLONG;
+
+	for (int dy = -STABILISE_SEARCH; dy <= STABILISE_SEARCH; dy++)
+	{
+		const BYTE* pRow = &quarter.abPixels[(nY + dy) * nStride + nX];
+
+		for (int dx = -STABILISE_SEARCH; dx <= STABILISE_SEARCH; dx++)
+		{
+			int nDifference = BlockDifference(pBlock, nStride, pRow + dx, nStride);
+
+			if (nDifference < nBest)
+			{
+				nBest = nDifference;
+				nBestX = dx;
+				nBestY = dy;
+			}
+		}
+	}
+
+	// The best offset on the edge of the window may lie beyond it
+	if (abs(nBestX) == STABILISE_SEARCH || abs(nBestY) == STABILISE_SEARCH)
+		return false;
+
+	// The middle of the block on the half plane, around twice the offset
+	const Plane& lastHalf = m_aHalf[1 - m_nCurrent];
+	const Plane& half = m_aHalf[m_nCurrent];
+	int nHalfStride = half.nWidth;
+	int nHalfX = 2 * nX + STABILISE_BLOCK / 2;
+	int nHalfY = 2 * nY + STABILISE_BLOCK / 2;
+
+	const BYTE* pHalfBlock = &lastHalf.abPixels[nHalfY * nHalfStride + nHalfX];
+
+	const int nSide = 2 * STABILISE_REFINE + 1;
+	int anDifferences[nSide * nSide];
+	int nRefined = 0;
+
+	for (int dy = -STABILISE_REFINE; dy <= STABILISE_REFINE; dy++)
+	{
+		for (int dx = -STABILISE_REFINE; dx <= STABILISE_REFINE; dx++)
+		{
+			int nOffset = (nHalfY + 2 * nBestY + dy) * nHalfStride + nHalfX + 2 * nBestX + dx;
+			int n = (dy + STABILISE_REFINE) * nSide + dx + STABILISE_REFINE;
+
+			anDifferences[n] = BlockDifference(pHalfBlock, nHalfStride, &half.abPixels[nOffset], nHalfStride);
+
+			if (anDifferences[n] < anDifferences[nRefined])
+			{
+				nRefined = n;
+			}
+		}
+	}
+
+	int nRefinedX = nRefined % nSide;
+	int nRefinedY = nRefined / nSide;
+
+	float fX = static_cast<float>(2 * nBestX + nRefinedX - STABILISE_REFINE);
+	float fY = static_cast<float>(2 * nBestY + nRefinedY - STABILISE_REFINE);
+
+	if (nRefinedX > 0 && nRefinedX < nSide - 1)
+	{
+		fX += FitParabola(anDifferences[nRefined - 1], anDifferences[nRefined], anDifferences[nRefined + 1]);
+	}
+
+	if (nRefinedY > 0 && nRefinedY < nSide - 1)
+	{
+		fY += FitParabola(anDifferences[nRefined - nSide], anDifferences[nRefined], anDifferences[nRefined + nSide]);
+	}
+
+	*pfX = fX;
+	*pfY = fY;
+
+	return true;
+}
+
+void VideoStabiliser::WarpBandProc(void* pContext, int nBand)
+{
+	static_cast<VideoStabiliser*>(pContext)->WarpBand(nBand);
+}
+
+void VideoStabiliser::WarpBand(int nBand)
+{
+	int nFirstRow = nBand * STABILISE_BAND_ROWS;
+	int nEndRow = min(nFirstRow + STABILISE_BAND_ROWS, m_nOutputHeight);
+	int nBytes = m_nBitsPerPixel / 8;
+	int nRowBytes = m_nOutputWidth * nBytes;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(1 << (STABILISE_WEIGHT_BITS - 1));
+	const __m128i weight00 = _mm_set1_epi16(static_cast<short>(m_anWeights[0]));
+	const __m128i weight01 = _mm_set1_epi16(static_cast<short>(m_anWeights[1]));
+	const __m128i weight10 = _mm_set1_epi16(static_cast<short>(m_anWeights[2]));
+	const __m128i weight11 = _mm_set1_epi16(static_cast<short>(m_anWeights[3]));
+
+	for (int y = nFirstRow; y < nEndRow; y++)
+	{
+		const BYTE* pUpper = m_pSourceTop + static_cast<ptrdiff_t>(y) * m_nSourceStride;
+		const BYTE* pLower = pUpper + m_nSourceStride;
+		BYTE* pRow = m_pOutputTop + static_cast<ptrdiff_t>(y) * m_nOutputStride;
+
+		// A whole pixel shift is a plain copy
+		if (m_anWeights[0] == (1 << STABILISE_WEIGHT_BITS))
+		{
+			CopyMemory(pRow, pUpper, nRowBytes);
+			continue;
+		}
+
+		// The weights are the same for every pixel, so bytes are blended with their neighbours a
+		// pixel to the right and a row down whatever the channel
+		int x = 0;
+
+		for (; x + 16 <= nRowBytes; x += 16)
+		{
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pUpper + x));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pUpper + x + nBytes));
+			__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pLower + x));
+			__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pLower + x + nBytes));
+
+			__m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), weight00), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), weight01));
+			low = _mm_add_epi16(low, _mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), weight10));
+			low = _mm_add_epi16(low, _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), weight11));
+			low = _mm_srli_epi16(_mm_add_epi16(low, round), STABILISE_WEIGHT_BITS);
+
+			__m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), weight00), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), weight01));
+			high = _mm_add_epi16(high, _mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), weight10));
+			high = _mm_add_epi16(high, _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), weight11));
+			high = _mm_srli_epi16(_mm_add_epi16(high, round), STABILISE_WEIGHT_BITS);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + x), _mm_packus_epi16(low, high));
+		}
+
+		for (; x < nRowBytes; x++)
+		{
+			int nValue = pUpper[x] * m_anWeights[0] + pUpper[x + nBytes] * m_anWeights[1] +
+				pLower[x] * m_anWeights[2] + pLower[x + nBytes] * m_anWeights[3];
+
+			pRow[x] = static_cast<BYTE>((nValue + (1 << (STABILISE_WEIGHT_BITS - 1))) >> STABILISE_WEIGHT_BITS);
+		}
+	}
+}
+
+#pragma managed(pop)
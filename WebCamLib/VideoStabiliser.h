@@ -0,0 +1,151 @@
+//*****************************************************************************************
+//  File:       VideoStabiliser.h
+//  Project:    WebcamLib
+//
+//  Declares the global motion estimate and compensating crop which steady a shaking camera
+//*****************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	class WorkerPool;
+
+	/// <summary>
+	/// Steadies the frames of a shaking camera. The shift of the whole image from the last frame
+	/// is found by block matching a grid of textured blocks on a quarter size luma plane, refined
+	/// to a fraction of a pixel on the half size plane, and taken as the median of the blocks so
+	/// that things moving in front of the camera are outvoted. The camera's path is smoothed by a
+	/// running average, and each frame is shifted by the difference between its place on the
+	/// smoothed path and where it is, then cropped by a margin on every side, which bounds the
+	/// shift. Only translation is corrected. The shift is sampled bilinearly with SSE2, in bands
+	/// spread over a worker pool; the planes are kept from one frame to the next.
+	/// </summary>
+	class VideoStabiliser
+	{
+	public:
+		VideoStabiliser();
+
+		/// <summary>
+		/// dMargin is the fraction of the width and height cropped from each side, up to 0.25;
+		/// the path is averaged over about nSmoothingFrames frames. E_INVALIDARG out of range.
+		/// </summary>
+		HRESULT SetParameters(double dMargin, int nSmoothingFrames);
+
+		/// <summary>
+		/// Pool the output is sampled on in parallel, NULL to work on the calling thread
+		/// </summary>
+		void SetWorkerPool(WorkerPool* pPool)
+		{
+			m_pPool = pPool;
+		}
+
+		/// <summary>
+		/// Size of the output for frames of the given size; zero when they are too small to crop
+		/// </summary>
+		void GetOutputSize(int nWidth, int nHeight, int* pnWidth, int* pnHeight) const;
+
+		/// <summary>
+		/// Forgets the last frame and the path, so the next frame is taken as it is
+		/// </summary>
+		void Reset();
+
+		/// <summary>
+		/// Estimates the motion since the last frame and writes the steadied frame, of the size
+		/// GetOutputSize reports; both images are given by their top row and signed stride.
+		/// 24 and 32 bit frames only.
+		/// </summary>
+		HRESULT Stabilise(const BYTE* pSourceTop, int nSourceStride, int nWidth, int nHeight, int nBitsPerPixel,
+			BYTE* pOutputTop, int nOutputStride);
+
+		/// <summary>
+		/// Motion of the image found in the last frame, in pixels; zero when it could not be told
+		/// </summary>
+		float GetMotionX() const
+		{
+			return m_fMotionX;
+		}
+
+		float GetMotionY() const
+		{
+			return m_fMotionY;
+		}
+
+		/// <summary>
+		/// Shift applied to the last frame, in pixels
+		/// </summary>
+		float GetCorrectionX() const
+		{
+			return static_cast<float>(m_dSmoothX - m_dPathX);
+		}
+
+		float GetCorrectionY() const
+		{
+			return static_cast<float>(m_dSmoothY - m_dPathY);
+		}
+
+	private:
+		VideoStabiliser(const VideoStabiliser&);
+		VideoStabiliser& operator=(const VideoStabiliser&);
+
+		struct Plane
+		{
+			int nWidth;
+			int nHeight;
+			std::vector<BYTE> abPixels;
+		};
+
+		static void WarpBandProc(void* pContext, int nBand);
+
+		// Half size luma of the frame into the current half plane, each pixel from a 2 by 2 block
+		void BuildPlanes(const BYTE* pSourceTop, int nSourceStride, int nWidth, int nHeight, int nBitsPerPixel);
+
+		// Motion from the last planes to the current ones, in pixels of the half plane
+		bool EstimateMotion(float* pfX, float* pfY);
+
+		// Best offset of one block within the search window of the quarter planes, refined on the half
+		// planes; false for a block without texture in both directions or whose best offset is unsure
+		bool MatchBlock(int nX, int nY, float* pfX, float* pfY) const;
+
+		void WarpBand(int nBand);
+
+		double m_dMargin;
+		int m_nSmoothingFrames;
+		WorkerPool* m_pPool;
+
+		// Two of each plane, last and current, swapped every frame
+		Plane m_aHalf[2];
+		Plane m_aQuarter[2];
+		int m_nCurrent;
+		bool m_bHasLast;
+		int m_nWidth;
+		int m_nHeight;
+		int m_nBitsPerPixel;
+
+		std::vector<float> m_afMotionX;
+		std::vector<float> m_afMotionY;
+		std::vector<float> m_afSorted;
+
+		float m_fMotionX;
+		float m_fMotionY;
+		double m_dPathX;
+		double m_dPathY;
+		double m_dSmoothX;
+		double m_dSmoothY;
+
+		// The frame being warped, for the bands
+		const BYTE* m_pSourceTop;
+		int m_nSourceStride;
+		BYTE* m_pOutputTop;
+		int m_nOutputStride;
+		int m_nOutputWidth;
+		int m_nOutputHeight;
+		int m_anWeights[4];
+	};
+}
+
+#pragma managed(pop)
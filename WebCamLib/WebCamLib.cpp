@@ -9,6 +9,8 @@
 
 #include <dshow.h>
 #include <strsafe.h>
+#include <vcclr.h>
+#include <msclr/lock.h>
 #define __IDxtCompositor_INTERFACE_DEFINED__
 #define __IDxtAlphaSetter_INTERFACE_DEFINED__
 #define __IDxtJpeg_INTERFACE_DEFINED__
@@ -17,6 +19,21 @@
 #pragma include_alias( "dxtrans.h", "qedit.h" )
 
 #include "qedit.h"
+#include "ImageStatistics.h"
+#include "FrameStatistics.h"
+#include "FrameBuffer.h"
+#include "LatestFrameSlot.h"
+#include "PooledFrame.h"
+#include "ExposureController.h"
+#include "ToneMapper.h"
+#include "CaptureFormatTable.h"
+#include "FrameBus.h"
+#include "ThreadPlacement.h"
+#include "ThreadPlacementOptions.h"
+#include "WorkerPool.h"
+#include "ProcessingPipeline.h"
+#include "FrameProcessingPipeline.h"
+#include "StreamHealth.h"
 #include "WebCamLib.h"
 
 using namespace System;
@@ -134,17 +151,63 @@ struct CameraInfoStruct
 {
 	BSTR bstrName;
 	IMoniker* pMoniker;
+	CaptureFormatTable* pFormats;	// read on first use, NULL until then
 };
 
 
-// Private global variables
-IGraphBuilder* g_pGraphBuilder = NULL;
-IMediaControl* g_pMediaControl = NULL;
-ICaptureGraphBuilder2* g_pCaptureGraphBuilder = NULL;
-IBaseFilter* g_pIBaseFilterCam = NULL;
-IBaseFilter* g_pIBaseFilterSampleGrabber = NULL;
-IBaseFilter* g_pIBaseFilterNullRenderer = NULL;
-CameraInfoStruct g_aCameraInfo[MAX_CAMERAS] = {0};
+CaptureSession::CaptureSession()
+{
+	pGraphBuilder = NULL;
+	pMediaControl = NULL;
+	pCaptureGraphBuilder = NULL;
+	pIBaseFilterCam = NULL;
+	pIBaseFilterSampleGrabber = NULL;
+	pIBaseFilterNullRenderer = NULL;
+
+	nWarmCameraIndex = -1;
+	ZeroMemory(&warmRequest, sizeof(warmRequest));
+	llCaptureFrameInterval = 0;
+
+	pfnCaptureCallback = NULL;
+	pfnFrameCallback = NULL;
+	bFrameCaptureEnabled = false;
+	pFramePool = NULL;
+	pLatestFrame = NULL;
+	bLatestFrameOpen = FALSE;
+	nLatestFrameUsers = 0;
+	pFrameBus = NULL;
+	nFrameBusUsers = 0;
+
+	nCaptureWidth = 0;
+	nCaptureHeight = 0;
+	nCaptureBitsPerPixel = 0;
+
+	bStatisticsEnabled = false;
+	pStatisticsCalculator = NULL;
+	ZeroMemory(&currentStatistics, sizeof(currentStatistics));
+	bCurrentStatisticsValid = false;
+
+	bExposureControlActive = false;
+	pExposureController = NULL;
+	bSoftwareExposureEnabled = false;
+	bSoftwareWhiteBalanceEnabled = false;
+
+	pToneMapper = NULL;
+
+	pPendingCapturePlacement = NULL;
+
+	pPipeline = NULL;
+	nPipelineUsers = 0;
+
+	pStreamHealth = NULL;
+	bFingerprintFrames = false;
+	bSuppressDuplicates = false;
+}
+
+CaptureSession::~CaptureSession()
+{
+	delete pPendingCapturePlacement;
+}
 
 
 // http://social.msdn.microsoft.com/Forums/sk/windowsdirectshowdevelopment/thread/052d6a15-f092-4913-b52d-d28f9a51e3b6
@@ -167,6 +230,90 @@ void MyDeleteMediaType(AM_MEDIA_TYPE *pmt) {
 	}
 }
 
+// Reads the formats of a camera the first time they are needed. pCap is the camera filter when
+// one is already bound; otherwise the moniker is bound just for this.
+HRESULT GetFormatTable(CameraInfoStruct& info, IBaseFilter* pCap, CaptureFormatTable** ppFormats)
+{
+	*ppFormats = info.pFormats;
+	if (info.pFormats != NULL)
+		return S_OK;
+
+	HRESULT hr = S_OK;
+
+	IBaseFilter* pFilter = pCap;
+	if (pFilter != NULL)
+		pFilter->AddRef();
+	else
+		hr = info.pMoniker->BindToObject(NULL, NULL, IID_IBaseFilter, (LPVOID*)&pFilter);
+
+	ICaptureGraphBuilder2* pBuilder = NULL;
+	if (SUCCEEDED(hr))
+	{
+		hr = CoCreateInstance(CLSID_CaptureGraphBuilder2,
+			NULL,
+			CLSCTX_INPROC,
+			IID_ICaptureGraphBuilder2,
+			(LPVOID*)&pBuilder);
+	}
+
+	IAMStreamConfig* pConfig = NULL;
+	if (SUCCEEDED(hr))
+	{
+		hr = pBuilder->FindInterface(&PIN_CATEGORY_CAPTURE, &MEDIATYPE_Video, pFilter, IID_IAMStreamConfig, (void**)&pConfig);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		CaptureFormatTable* pFormats = new CaptureFormatTable();
+
+		hr = pFormats->Build(pConfig);
+		if (SUCCEEDED(hr))
+		{
+			info.pFormats = pFormats;
+			*ppFormats = pFormats;
+		}
+		else
+		{
+			delete pFormats;
+		}
+	}
+
+	if (pConfig != NULL)
+		pConfig->Release();
+
+	if (pBuilder != NULL)
+		pBuilder->Release();
+
+	if (pFilter != NULL)
+		pFilter->Release();
+
+	return hr;
+}
+
+// Breaks every connection of a filter, from both ends
+void DisconnectPins(IGraphBuilder* pGraph, IBaseFilter* pFilter)
+{
+	IEnumPins* pEnum = NULL;
+	if (SUCCEEDED(pFilter->EnumPins(&pEnum)))
+	{
+		IPin* pPin = NULL;
+		while (pEnum->Next(1, &pPin, NULL) == S_OK)
+		{
+			IPin* pConnected = NULL;
+			if (SUCCEEDED(pPin->ConnectedTo(&pConnected)))
+			{
+				pGraph->Disconnect(pConnected);
+				pConnected->Release();
+			}
+
+			pGraph->Disconnect(pPin);
+			pPin->Release();
+		}
+
+		pEnum->Release();
+	}
+}
+
 
 /// <summary>
 /// Initializes information about all web cams connected to machine
@@ -176,6 +323,27 @@ CameraMethods::CameraMethods()
 	// Set to not disposed
 	this->disposed = false;
 
+	this->activeCameraIndex = -1;
+	this->keepSessionWarm = false;
+	this->lastStartKind = CaptureStartKind::None;
+	this->lastStartDuration = 0.0;
+
+	this->sessionLock = gcnew Object();
+	this->streamWatchdogEnabled = false;
+	this->streamStallTimeout = 2000;
+	this->streamFrozenTimeout = 5000;
+	this->autoRestartStream = false;
+	this->ownerContext = nullptr;
+	this->restartPosted = false;
+	this->streamState = StreamState::Healthy;
+	this->streamStateChanges = 0;
+	this->streamRestartCount = 0;
+
+	// Each instance captures on its own graph, so several cameras can run at once
+	this->pSession = new CaptureSession();
+	this->aCameraInfo = new CameraInfoStruct[MAX_CAMERAS];
+	ZeroMemory(this->aCameraInfo, MAX_CAMERAS * sizeof(CameraInfoStruct));
+
 	// Get and cache camera info
 	RefreshCameraList();
 }
@@ -185,8 +353,7 @@ CameraMethods::CameraMethods()
 /// </summary>
 CameraMethods::~CameraMethods()
 {
-	Cleanup();
-	disposed = true;
+	this->!CameraMethods();
 }
 
 /// <summary>
@@ -197,9 +364,23 @@ CameraMethods::!CameraMethods()
 	if (!disposed)
 	{
 		Cleanup();
+		disposed = true;
+
+		// The graph is gone, and with it the grabber callback pointing at the session
+		delete pSession;
+		pSession = NULL;
+
+		delete[] aCameraInfo;
+		aCameraInfo = NULL;
 	}
 }
 
+void CameraMethods::ThrowIfDisposed()
+{
+	if( disposed )
+		throw gcnew ObjectDisposedException( "CameraMethods" );
+}
+
 /// <summary>
 /// Initialize information about webcams installed on machine
 /// </summary>
@@ -236,8 +417,8 @@ void CameraMethods::RefreshCameraList()
 
 		while (SUCCEEDED(hr) && (count) < MAX_CAMERAS && pclassEnum->Next(1, apIMoniker, &ulCount) == S_OK)
 		{
-			g_aCameraInfo[count].pMoniker = apIMoniker[0];
-			g_aCameraInfo[count].pMoniker->AddRef();
+			aCameraInfo[count].pMoniker = apIMoniker[0];
+			aCameraInfo[count].pMoniker->AddRef();
 
 			IPropertyBag *pPropBag;
 			hr = apIMoniker[0]->BindToStorage(NULL, NULL, IID_IPropertyBag, (void **)&pPropBag);
@@ -249,7 +430,7 @@ void CameraMethods::RefreshCameraList()
 				hr = pPropBag->Read(L"FriendlyName", &varName, 0);
 				if (SUCCEEDED(hr) && varName.vt == VT_BSTR)
 				{
-					g_aCameraInfo[count].bstrName = SysAllocString(varName.bstrVal);
+					aCameraInfo[count].bstrName = SysAllocString(varName.bstrVal);
 				}
 				VariantClear(&varName);
 
@@ -277,10 +458,10 @@ CameraInfo^ CameraMethods::GetCameraInfo(int camIndex)
 	if (camIndex >= Count)
 		throw gcnew ArgumentOutOfRangeException("Camera index is out of bounds: " + Count.ToString());
 
-	if (g_aCameraInfo[camIndex].pMoniker == NULL)
+	if (aCameraInfo[camIndex].pMoniker == NULL)
 		throw gcnew ArgumentException("There is no camera at index: " + camIndex.ToString());
 
-	CameraInfo^ camInfo = gcnew CameraInfo( camIndex, Marshal::PtrToStringBSTR((IntPtr)g_aCameraInfo[camIndex].bstrName) );
+	CameraInfo^ camInfo = gcnew CameraInfo( camIndex, Marshal::PtrToStringBSTR((IntPtr)aCameraInfo[camIndex].bstrName) );
 
 	return camInfo;
 }
@@ -298,15 +479,42 @@ void CameraMethods::StartCamera(int camIndex, interior_ptr<int> width, interior_
 /// </summary>
 bool CameraMethods::StartCamera(int camIndex, interior_ptr<int> width, interior_ptr<int> height, interior_ptr<int> bpp)
 {
+	double fps = 0.0;
+
+	return StartCamera( camIndex, width, height, bpp, &fps, FormatPreference::Exact );
+}
+
+/// <summary>
+/// Start the camera in the format best meeting a size and frame rate
+/// </summary>
+void CameraMethods::StartCamera(int camIndex, interior_ptr<int> width, interior_ptr<int> height, interior_ptr<int> bpp, interior_ptr<double> fps, FormatPreference preference, interior_ptr<bool> successful)
+{
+	*successful = StartCamera( camIndex, width, height, bpp, fps, preference );
+}
+
+/// <summary>
+/// Start the camera in the format best meeting a size and frame rate
+/// </summary>
+bool CameraMethods::StartCamera(int camIndex, interior_ptr<int> width, interior_ptr<int> height, interior_ptr<int> bpp, interior_ptr<double> fps, FormatPreference preference)
+{
+	msclr::lock sessionGuard(sessionLock);
+
 	if (camIndex >= Count)
 		throw gcnew ArgumentException("Camera index is out of bounds: " + Count.ToString());
 
-	if (g_aCameraInfo[camIndex].pMoniker == NULL)
+	if (aCameraInfo[camIndex].pMoniker == NULL)
 		throw gcnew ArgumentException("There is no camera at index: " + camIndex.ToString());
 
-	if (g_pGraphBuilder != NULL)
+	// A graph kept warm for another camera is of no use to this one
+	if (pSession->nWarmCameraIndex != -1 && pSession->nWarmCameraIndex != camIndex)
+		ReleaseSession();
+
+	if (pSession->pGraphBuilder != NULL && pSession->nWarmCameraIndex == -1)
 		throw gcnew ArgumentException("Graph Builder was null");
 
+	LARGE_INTEGER liStart;
+	QueryPerformanceCounter(&liStart);
+
 	// Setup up function callback -- through evil reflection on private members
 	Type^ baseType = this->GetType();
 	FieldInfo^ field = baseType->GetField("<backing_store>OnImageCapture", BindingFlags::NonPublic | BindingFlags::Instance | BindingFlags::IgnoreCase);
@@ -319,15 +527,129 @@ bool CameraMethods::StartCamera(int camIndex, interior_ptr<int> width, interior_
 			if (del != nullptr)
 			{
 				ppCaptureCallback = GCHandle::Alloc(del);
-				g_pfnCaptureCallback =
+				pSession->pfnCaptureCallback =
 					static_cast<PFN_CaptureCallback>(Marshal::GetFunctionPointerForDelegate(del).ToPointer());
 			}
 		}
 	}
 
+	// Pooled frames are always wired up; OnFrameCapture decides whether they are filled
+	if (pSession->pFramePool == NULL)
+	{
+		pSession->pFramePool = new FramePool();
+	}
+
+	if (pSession->pLatestFrame == NULL)
+	{
+		pSession->pLatestFrame = new LatestFrameSlot();
+	}
+
+	InterlockedExchange(&pSession->bLatestFrameOpen, TRUE);
+
+	if (pSession->pStreamHealth == NULL)
+	{
+		pSession->pStreamHealth = new StreamHealth();
+	}
+
+	if (!ppFrameCallback.IsAllocated)
+	{
+		FrameBufferCallbackDelegate^ frameCallback = gcnew FrameBufferCallbackDelegate(this, &CameraMethods::OnFrameBuffer);
+		ppFrameCallback = GCHandle::Alloc(frameCallback);
+	}
+
+	pSession->pfnFrameCallback =
+		static_cast<PFN_FrameCallback>(Marshal::GetFunctionPointerForDelegate(safe_cast<Delegate^>(ppFrameCallback.Target)).ToPointer());
+
 	bool result = false;
+	HRESULT hr = S_OK;
+
+	// The format asked for, which may differ from the one the camera ends up delivering
+	FormatRequest request;
+	request.nWidth = *width;
+	request.nHeight = *height;
+	request.nBitsPerPixel = *bpp;
+	request.llFrameInterval = *fps > 0.0 ? static_cast<LONGLONG>(10000000.0 / *fps + 0.5) : 0;
+	request.ePriority = static_cast<FormatPriority>(preference);
+
+	CaptureStartKind kind = CaptureStartKind::Cold;
+
+	if (pSession->nWarmCameraIndex == camIndex)
+	{
+		// The graph is still built and paused; it only needs reconnecting for another format
+		pSession->nWarmCameraIndex = -1;
+
+		if (request.nWidth == pSession->warmRequest.nWidth && request.nHeight == pSession->warmRequest.nHeight && request.nBitsPerPixel == pSession->warmRequest.nBitsPerPixel &&
+			request.llFrameInterval == pSession->warmRequest.llFrameInterval && request.ePriority == pSession->warmRequest.ePriority)
+		{
+			kind = CaptureStartKind::Resume;
+
+			*width = pSession->nCaptureWidth;
+			*height = pSession->nCaptureHeight;
+			*bpp = pSession->nCaptureBitsPerPixel;
+		}
+		else
+		{
+			kind = CaptureStartKind::FormatChange;
+			hr = ReconnectGraph(camIndex, request, width, height, bpp);
+		}
+	}
+	else
+	{
+		hr = BuildGraph(camIndex, request, width, height, bpp);
+	}
+
+	// Whatever the path, report the rate the camera was actually set to
+	if (SUCCEEDED(hr) && kind != CaptureStartKind::Resume)
+	{
+		pSession->llCaptureFrameInterval = GetNegotiatedFrameInterval();
+	}
+
+	// Start the capture; the graph may stream on another thread than last time
+	if (SUCCEEDED(hr))
+	{
+		QueueCaptureThreadPlacement();
+		pSession->pStreamHealth->Reset(GetTickCount());
+		hr = pSession->pMediaControl->Run();
+	}
+
+	// If init fails then ensure that you cleanup
+	if (FAILED(hr))
+	{
+		StopCamera();
+	}
+	else
+	{
+		hr = S_OK;  // Make sure we return S_OK for success
+	}
+
+	if( result = SUCCEEDED( hr ) )
+	{
+		pSession->warmRequest = request;
+		*fps = pSession->llCaptureFrameInterval > 0 ? 10000000.0 / pSession->llCaptureFrameInterval : 0.0;
+
+		this->activeCameraIndex = camIndex;
+		this->streamState = StreamState::Healthy;
+		this->ownerContext = System::Threading::SynchronizationContext::Current;
+		UpdateExposureControl();
+		UpdateToneEmulation();
+
+		LARGE_INTEGER liEnd, liFrequency;
+		QueryPerformanceCounter(&liEnd);
+		QueryPerformanceFrequency(&liFrequency);
+
+		lastStartKind = kind;
+		lastStartDuration = 1000.0 * (liEnd.QuadPart - liStart.QuadPart) / liFrequency.QuadPart;
+	}
+
+	return result;
+}
 
-	IMoniker *pMoniker = g_aCameraInfo[camIndex].pMoniker;
+/// <summary>
+/// Builds the capture graph for a camera from scratch and connects it in the requested format
+/// </summary>
+HRESULT CameraMethods::BuildGraph(int camIndex, const FormatRequest& request, interior_ptr<int> width, interior_ptr<int> height, interior_ptr<int> bpp)
+{
+	IMoniker *pMoniker = aCameraInfo[camIndex].pMoniker;
 	pMoniker->AddRef();
 
 	HRESULT hr = S_OK;
@@ -339,12 +661,12 @@ bool CameraMethods::StartCamera(int camIndex, interior_ptr<int> width, interior_
 			NULL,
 			CLSCTX_INPROC,
 			IID_IGraphBuilder,
-			(LPVOID*)&g_pGraphBuilder);
+			(LPVOID*)&pSession->pGraphBuilder);
 	}
 
 	if (SUCCEEDED(hr))
 	{
-		hr = g_pGraphBuilder->QueryInterface(IID_IMediaControl, (LPVOID*)&g_pMediaControl);
+		hr = pSession->pGraphBuilder->QueryInterface(IID_IMediaControl, (LPVOID*)&pSession->pMediaControl);
 	}
 
 	if (SUCCEEDED(hr))
@@ -353,147 +675,279 @@ bool CameraMethods::StartCamera(int camIndex, interior_ptr<int> width, interior_
 			NULL,
 			CLSCTX_INPROC,
 			IID_ICaptureGraphBuilder2,
-			(LPVOID*)&g_pCaptureGraphBuilder);
+			(LPVOID*)&pSession->pCaptureGraphBuilder);
 	}
 
 	// Setup the filter graph
 	if (SUCCEEDED(hr))
 	{
-		hr = g_pCaptureGraphBuilder->SetFiltergraph(g_pGraphBuilder);
+		hr = pSession->pCaptureGraphBuilder->SetFiltergraph(pSession->pGraphBuilder);
 	}
 
 	// Build the camera from the moniker
 	if (SUCCEEDED(hr))
 	{
-		hr = pMoniker->BindToObject(NULL, NULL, IID_IBaseFilter, (LPVOID*)&g_pIBaseFilterCam);
+		hr = pMoniker->BindToObject(NULL, NULL, IID_IBaseFilter, (LPVOID*)&pSession->pIBaseFilterCam);
 	}
 
 	// Add the camera to the filter graph
 	if (SUCCEEDED(hr))
 	{
-		hr = g_pGraphBuilder->AddFilter(g_pIBaseFilterCam, L"WebCam");
+		hr = pSession->pGraphBuilder->AddFilter(pSession->pIBaseFilterCam, L"WebCam");
 	}
 
 	// Set the resolution
 	if (SUCCEEDED(hr)) {
-		hr = SetCaptureFormat(g_pIBaseFilterCam, *width, *height, *bpp);
+		hr = SetCaptureFormat(camIndex, pSession->pIBaseFilterCam, request);
 	}
 
 	// Create a SampleGrabber
 	if (SUCCEEDED(hr))
 	{
-		hr = CoCreateInstance(CLSID_SampleGrabber, NULL, CLSCTX_INPROC_SERVER, IID_IBaseFilter, (void**)&g_pIBaseFilterSampleGrabber);
+		hr = CoCreateInstance(CLSID_SampleGrabber, NULL, CLSCTX_INPROC_SERVER, IID_IBaseFilter, (void**)&pSession->pIBaseFilterSampleGrabber);
 	}
 
 	// Configure the Sample Grabber
 	if (SUCCEEDED(hr))
 	{
-		hr = ConfigureSampleGrabber(g_pIBaseFilterSampleGrabber);
+		hr = ConfigureSampleGrabber(pSession->pIBaseFilterSampleGrabber);
 	}
 
 	// Add Sample Grabber to the filter graph
 	if (SUCCEEDED(hr))
 	{
-		hr = g_pGraphBuilder->AddFilter(g_pIBaseFilterSampleGrabber, L"SampleGrabber");
+		hr = pSession->pGraphBuilder->AddFilter(pSession->pIBaseFilterSampleGrabber, L"SampleGrabber");
 	}
 
 	// Create the NullRender
 	if (SUCCEEDED(hr))
 	{
-		hr = CoCreateInstance(CLSID_NullRenderer, NULL, CLSCTX_INPROC_SERVER, IID_IBaseFilter, (void**)&g_pIBaseFilterNullRenderer);
+		hr = CoCreateInstance(CLSID_NullRenderer, NULL, CLSCTX_INPROC_SERVER, IID_IBaseFilter, (void**)&pSession->pIBaseFilterNullRenderer);
 	}
 
 	// Add the Null Render to the filter graph
 	if (SUCCEEDED(hr))
 	{
-		hr = g_pGraphBuilder->AddFilter(g_pIBaseFilterNullRenderer, L"NullRenderer");
+		hr = pSession->pGraphBuilder->AddFilter(pSession->pIBaseFilterNullRenderer, L"NullRenderer");
 	}
 
 	// Configure the render stream
 	if (SUCCEEDED(hr))
 	{
-		hr = g_pCaptureGraphBuilder->RenderStream(&PIN_CATEGORY_CAPTURE, &MEDIATYPE_Video, g_pIBaseFilterCam, g_pIBaseFilterSampleGrabber, g_pIBaseFilterNullRenderer);
+		hr = pSession->pCaptureGraphBuilder->RenderStream(&PIN_CATEGORY_CAPTURE, &MEDIATYPE_Video, pSession->pIBaseFilterCam, pSession->pIBaseFilterSampleGrabber, pSession->pIBaseFilterNullRenderer);
 	}
 
 	// Grab the capture width and height
 	if (SUCCEEDED(hr))
 	{
-		ISampleGrabber* pGrabber = NULL;
-		hr = g_pIBaseFilterSampleGrabber->QueryInterface(IID_ISampleGrabber, (LPVOID*)&pGrabber);
+		hr = ReadConnectedFormat(width, height, bpp);
+	}
+
+	// Cleanup
+	if (pMoniker != NULL)
+	{
+		pMoniker->Release();
+		pMoniker = NULL;
+	}
+
+	return hr;
+}
+
+/// <summary>
+/// Reads the format the sample grabber ended up connected with
+/// </summary>
+HRESULT CameraMethods::ReadConnectedFormat(interior_ptr<int> width, interior_ptr<int> height, interior_ptr<int> bpp)
+{
+	ISampleGrabber* pGrabber = NULL;
+	HRESULT hr = pSession->pIBaseFilterSampleGrabber->QueryInterface(IID_ISampleGrabber, (LPVOID*)&pGrabber);
+	if (SUCCEEDED(hr))
+	{
+		AM_MEDIA_TYPE mt;
+		hr = pGrabber->GetConnectedMediaType(&mt);
 		if (SUCCEEDED(hr))
 		{
-			AM_MEDIA_TYPE mt;
-			hr = pGrabber->GetConnectedMediaType(&mt);
-			if (SUCCEEDED(hr))
+			VIDEOINFOHEADER *pVih;
+			if ((mt.formattype == FORMAT_VideoInfo) &&
+				(mt.cbFormat >= sizeof(VIDEOINFOHEADER)) &&
+				(mt.pbFormat != NULL) )
 			{
-				VIDEOINFOHEADER *pVih;
-				if ((mt.formattype == FORMAT_VideoInfo) &&
-					(mt.cbFormat >= sizeof(VIDEOINFOHEADER)) &&
-					(mt.pbFormat != NULL) )
-				{
-					pVih = (VIDEOINFOHEADER*)mt.pbFormat;
-					*width = pVih->bmiHeader.biWidth;
-					*height = pVih->bmiHeader.biHeight;
-					*bpp = pVih->bmiHeader.biBitCount;
-				}
-				else
-				{
-					hr = E_FAIL;  // Wrong format
-				}
+				pVih = (VIDEOINFOHEADER*)mt.pbFormat;
+				*width = pVih->bmiHeader.biWidth;
+				*height = pVih->bmiHeader.biHeight;
+				*bpp = pVih->bmiHeader.biBitCount;
+
+				pSession->nCaptureWidth = *width;
+				pSession->nCaptureHeight = *height;
+				pSession->nCaptureBitsPerPixel = *bpp;
+			}
+			else
+			{
+				hr = E_FAIL;  // Wrong format
+			}
 
-				// FreeMediaType(mt); (from MSDN)
-				if (mt.cbFormat != 0)
-				{
-					CoTaskMemFree((PVOID)mt.pbFormat);
-					mt.cbFormat = 0;
-					mt.pbFormat = NULL;
-				}
-				if (mt.pUnk != NULL)
-				{
-					// Unecessary because pUnk should not be used, but safest.
-					mt.pUnk->Release();
-					mt.pUnk = NULL;
-				}
+			// FreeMediaType(mt); (from MSDN)
+			if (mt.cbFormat != 0)
+			{
+				CoTaskMemFree((PVOID)mt.pbFormat);
+				mt.cbFormat = 0;
+				mt.pbFormat = NULL;
+			}
+			if (mt.pUnk != NULL)
+			{
+				// Unecessary because pUnk should not be used, but safest.
+				mt.pUnk->Release();
+				mt.pUnk = NULL;
 			}
 		}
+	}
+
+	if (pGrabber != NULL)
+	{
+		pGrabber->Release();
+		pGrabber = NULL;
+	}
+
+	return hr;
+}
+
+/// <summary>
+/// Reconnects a warm graph in another format, keeping the camera, grabber and renderer filters
+/// </summary>
+HRESULT CameraMethods::ReconnectGraph(int camIndex, const FormatRequest& request, interior_ptr<int> width, interior_ptr<int> height, interior_ptr<int> bpp)
+{
+	// Pins only reconnect on a stopped graph
+	HRESULT hr = pSession->pMediaControl->Stop();
+
+	// Disconnect everything and drop the decoders RenderStream put in between
+	IEnumFilters* pEnum = NULL;
+	if (SUCCEEDED(hr))
+	{
+		hr = pSession->pGraphBuilder->EnumFilters(&pEnum);
+	}
 
-		if (pGrabber != NULL)
+	if (SUCCEEDED(hr))
+	{
+		IBaseFilter* pFilter = NULL;
+		while (pEnum->Next(1, &pFilter, NULL) == S_OK)
 		{
-			pGrabber->Release();
-			pGrabber = NULL;
+			DisconnectPins(pSession->pGraphBuilder, pFilter);
+
+			if (pFilter != pSession->pIBaseFilterCam && pFilter != pSession->pIBaseFilterSampleGrabber && pFilter != pSession->pIBaseFilterNullRenderer)
+			{
+				pSession->pGraphBuilder->RemoveFilter(pFilter);
+
+				// Removing a filter puts the enumerator out of sync
+				pEnum->Reset();
+			}
+
+			pFilter->Release();
 		}
+
+		pEnum->Release();
 	}
 
-	// Start the capture
+	// Set the resolution
 	if (SUCCEEDED(hr))
 	{
-		hr = g_pMediaControl->Run();
+		hr = SetCaptureFormat(camIndex, pSession->pIBaseFilterCam, request);
 	}
 
-	// If init fails then ensure that you cleanup
-	if (FAILED(hr))
+	// Configure the render stream
+	if (SUCCEEDED(hr))
 	{
-		StopCamera();
+		hr = pSession->pCaptureGraphBuilder->RenderStream(&PIN_CATEGORY_CAPTURE, &MEDIATYPE_Video, pSession->pIBaseFilterCam, pSession->pIBaseFilterSampleGrabber, pSession->pIBaseFilterNullRenderer);
 	}
-	else
+
+	// Grab the capture width and height
+	if (SUCCEEDED(hr))
 	{
-		hr = S_OK;  // Make sure we return S_OK for success
+		hr = ReadConnectedFormat(width, height, bpp);
 	}
 
-	// Cleanup
-	if (pMoniker != NULL)
+	return hr;
+}
+
+#pragma region Pooled Frames
+void CameraMethods::OnFrameCapture::add( FrameCaptureDelegate^ handler )
+{
+	ThrowIfDisposed();
+
+	frameCaptureHandlers = static_cast<FrameCaptureDelegate^>( Delegate::Combine( frameCaptureHandlers, handler ) );
+	pSession->bFrameCaptureEnabled = frameCaptureHandlers != nullptr;
+}
+
+void CameraMethods::OnFrameCapture::remove( FrameCaptureDelegate^ handler )
+{
+	frameCaptureHandlers = static_cast<FrameCaptureDelegate^>( Delegate::Remove( frameCaptureHandlers, handler ) );
+
+	// Unsubscribing is still allowed once disposed, when there is no session left to tell
+	if( !disposed )
+		pSession->bFrameCaptureEnabled = frameCaptureHandlers != nullptr;
+}
+
+void CameraMethods::OnFrameBuffer( IntPtr pFrame )
+{
+	FrameCaptureDelegate^ handlers = frameCaptureHandlers;
+
+	if( handlers != nullptr )
 	{
-		pMoniker->Release();
-		pMoniker = NULL;
+		PooledFrame^ frame = gcnew PooledFrame( static_cast<FrameBuffer*>( pFrame.ToPointer() ) );
+
+		try
+		{
+			handlers( frame );
+		}
+		finally
+		{
+			delete frame;
+		}
 	}
+}
 
-	if( result = SUCCEEDED( hr ) )
-		this->activeCameraIndex = camIndex;
+PooledFrame^ CameraMethods::GetLatestFrame()
+{
+	if( pSession->pLatestFrame == NULL )
+		return nullptr;
+
+	FrameBuffer* pFrame = pSession->pLatestFrame->Acquire();
+	if( pFrame == NULL )
+		return nullptr;
+
+	// The managed handle takes a reference of its own, so hand back the one Acquire gave us
+	PooledFrame^ result = gcnew PooledFrame( pFrame );
+	pFrame->Release();
 
 	return result;
 }
+#pragma endregion
 
 #pragma region Camera Property Support
+// The picture controls ToneMapper can stand in for
+static bool GetToneProperty( CameraProperty prop, ToneProperty* peTone )
+{
+	switch( prop )
+	{
+	case CameraProperty::Brightness: *peTone = ToneProperty_Brightness; return true;
+	case CameraProperty::Contrast: *peTone = ToneProperty_Contrast; return true;
+	case CameraProperty::Hue: *peTone = ToneProperty_Hue; return true;
+	case CameraProperty::Saturation: *peTone = ToneProperty_Saturation; return true;
+	case CameraProperty::Gamma: *peTone = ToneProperty_Gamma; return true;
+	default: return false;
+	}
+}
+
+static CameraProperty GetCameraProperty( ToneProperty eTone )
+{
+	switch( eTone )
+	{
+	case ToneProperty_Brightness: return CameraProperty::Brightness;
+	case ToneProperty_Contrast: return CameraProperty::Contrast;
+	case ToneProperty_Hue: return CameraProperty::Hue;
+	case ToneProperty_Saturation: return CameraProperty::Saturation;
+	default: return CameraProperty::Gamma;
+	}
+}
+
 inline void CameraMethods::IsPropertySupported( CameraProperty prop, interior_ptr<bool> result )
 {
 	*result = IsPropertySupported( prop );
@@ -503,7 +957,9 @@ inline bool CameraMethods::IsPropertySupported( CameraProperty prop )
 {
 	bool result = false;
 
-	if( IsCameraControlProperty( prop ) )
+	if( IsPropertyEmulated( prop ) )
+		result = true;
+	else if( IsCameraControlProperty( prop ) )
 		result = IsPropertySupported( GetCameraControlProperty( prop ) );
 	else if( IsVideoProcAmpProperty( prop ) )
 		result = IsPropertySupported( GetVideoProcAmpProperty( prop ) );
@@ -516,7 +972,7 @@ bool CameraMethods::IsPropertySupported( WebCamLib::CameraControlProperty prop )
 	bool result = false;
 
 	IAMCameraControl * cameraControl = NULL;
-	HRESULT hr = g_pIBaseFilterCam->QueryInterface(IID_IAMCameraControl, (void**)&cameraControl);
+	HRESULT hr = pSession->pIBaseFilterCam->QueryInterface(IID_IAMCameraControl, (void**)&cameraControl);
 
 	if(SUCCEEDED(hr))
 	{
@@ -537,7 +993,7 @@ bool CameraMethods::IsPropertySupported( WebCamLib::VideoProcAmpProperty prop )
 	bool result = false;
 
 	IAMVideoProcAmp * pProcAmp = NULL;
-	HRESULT hr = g_pIBaseFilterCam->QueryInterface(IID_IAMVideoProcAmp, (void**)&pProcAmp);
+	HRESULT hr = pSession->pIBaseFilterCam->QueryInterface(IID_IAMVideoProcAmp, (void**)&pProcAmp);
 
 	if(SUCCEEDED(hr))
 	{
@@ -621,8 +1077,15 @@ inline void CameraMethods::GetProperty_value( CameraProperty prop, interior_ptr<
 inline bool CameraMethods::GetProperty_value( CameraProperty prop, interior_ptr<long> value, interior_ptr<bool> bAuto)
 {
 	bool result = false;
+	ToneProperty eTone;
 
-	if( IsCameraControlProperty( prop ) )
+	if( IsPropertyEmulated( prop ) && GetToneProperty( prop, &eTone ) )
+	{
+		*value = pSession->pToneMapper->GetValue( eTone );
+		*bAuto = false;
+		result = true;
+	}
+	else if( IsCameraControlProperty( prop ) )
 		result = GetProperty_value( GetCameraControlProperty( prop ), value, bAuto );
 	else if( IsVideoProcAmpProperty( prop ) )
 		result = GetProperty_value( GetVideoProcAmpProperty( prop ), value, bAuto );
@@ -689,7 +1152,12 @@ inline bool CameraMethods::SetProperty_value( CameraProperty prop, long value, b
 
 	if( ValidatePropertyValue( prop, value ) )
 	{
-		if( IsCameraControlProperty( prop ) )
+		ToneProperty eTone;
+
+		// Software has no automatic mode to hand the property to
+		if( IsPropertyEmulated( prop ) && GetToneProperty( prop, &eTone ) )
+			result = !bAuto && SUCCEEDED( pSession->pToneMapper->SetValue( eTone, value ) );
+		else if( IsCameraControlProperty( prop ) )
 			result = SetProperty_value( GetCameraControlProperty( prop ), value, bAuto );
 		else if( IsVideoProcAmpProperty( prop ) )
 			result = SetProperty_value( GetVideoProcAmpProperty( prop ), value, bAuto );
@@ -735,8 +1203,21 @@ inline void CameraMethods::GetPropertyRange( CameraProperty prop, interior_ptr<l
 inline bool CameraMethods::GetPropertyRange( CameraProperty prop, interior_ptr<long> min, interior_ptr<long> max, interior_ptr<long> steppingDelta, interior_ptr<long> defaults, interior_ptr<bool> bAuto)
 {
 	bool result = false;
+	ToneProperty eTone;
 
-	if( IsCameraControlProperty( prop ) )
+	if( IsPropertyEmulated( prop ) && GetToneProperty( prop, &eTone ) )
+	{
+		PropertyRange range;
+		ToneMapper::GetRange( eTone, &range );
+
+		*min = range.lMinimum;
+		*max = range.lMaximum;
+		*steppingDelta = range.lStep;
+		*defaults = range.lDefault;
+		*bAuto = false;
+		result = true;
+	}
+	else if( IsCameraControlProperty( prop ) )
 		result = GetPropertyRange( GetCameraControlProperty( prop ), min, max, steppingDelta, defaults, bAuto );
 	else if( IsVideoProcAmpProperty( prop ) )
 		result = GetPropertyRange( GetVideoProcAmpProperty( prop ), min, max, steppingDelta, defaults, bAuto );
@@ -749,7 +1230,7 @@ bool CameraMethods::GetPropertyRange( WebCamLib::CameraControlProperty prop, int
 	bool result = false;
 
 	IAMCameraControl * cameraControl = NULL;
-	HRESULT hr = g_pIBaseFilterCam->QueryInterface(IID_IAMCameraControl, (void**)&cameraControl);
+	HRESULT hr = pSession->pIBaseFilterCam->QueryInterface(IID_IAMCameraControl, (void**)&cameraControl);
 
 	if( SUCCEEDED( hr ) )
 	{
@@ -777,7 +1258,7 @@ bool CameraMethods::GetPropertyRange( WebCamLib::VideoProcAmpProperty prop, inte
 	bool result = false;
 
 	IAMVideoProcAmp * pProcAmp = NULL;
-	HRESULT hr = g_pIBaseFilterCam->QueryInterface(IID_IAMVideoProcAmp, (void**)&pProcAmp);
+	HRESULT hr = pSession->pIBaseFilterCam->QueryInterface(IID_IAMVideoProcAmp, (void**)&pProcAmp);
 
 	if( SUCCEEDED( hr ) )
 	{
@@ -802,13 +1283,13 @@ bool CameraMethods::GetPropertyRange( WebCamLib::VideoProcAmpProperty prop, inte
 
 bool CameraMethods::GetProperty_value( WebCamLib::CameraControlProperty prop, interior_ptr<long> value, interior_ptr<bool> bAuto )
 {
-	if( g_pIBaseFilterCam == NULL )
+	if( pSession->pIBaseFilterCam == NULL )
 		throw gcnew InvalidOperationException( "No camera started." );
 
 	bool result = false;
 
 	IAMCameraControl * cameraControl = NULL;
-	HRESULT hr = g_pIBaseFilterCam->QueryInterface(IID_IAMCameraControl, (void**)&cameraControl);
+	HRESULT hr = pSession->pIBaseFilterCam->QueryInterface(IID_IAMCameraControl, (void**)&cameraControl);
 
 	if( SUCCEEDED( hr ) )
 	{
@@ -828,13 +1309,13 @@ bool CameraMethods::GetProperty_value( WebCamLib::CameraControlProperty prop, in
 
 bool CameraMethods::GetProperty_value( WebCamLib::VideoProcAmpProperty prop, interior_ptr<long> value, interior_ptr<bool> bAuto )
 {
-	if( g_pIBaseFilterCam == NULL )
+	if( pSession->pIBaseFilterCam == NULL )
 		throw gcnew InvalidOperationException( "No camera started." );
 
 	bool result = false;
 
 	IAMVideoProcAmp * pProcAmp = NULL;
-	HRESULT hr = g_pIBaseFilterCam->QueryInterface(IID_IAMVideoProcAmp, (void**)&pProcAmp);
+	HRESULT hr = pSession->pIBaseFilterCam->QueryInterface(IID_IAMVideoProcAmp, (void**)&pProcAmp);
 
 	if( SUCCEEDED( hr ) )
 	{
@@ -854,14 +1335,14 @@ bool CameraMethods::GetProperty_value( WebCamLib::VideoProcAmpProperty prop, int
 
 bool CameraMethods::SetProperty_value( WebCamLib::CameraControlProperty prop, long value, bool bAuto )
 {
-	if( g_pIBaseFilterCam == NULL )
+	if( pSession->pIBaseFilterCam == NULL )
 		throw gcnew InvalidOperationException( "No camera started." );
 
 	bool result = false;
 
 	// Query the capture filter for the IAMCameraControl interface.
 	IAMCameraControl * cameraControl = NULL;
-	HRESULT hr = g_pIBaseFilterCam->QueryInterface(IID_IAMCameraControl, (void**)&cameraControl);
+	HRESULT hr = pSession->pIBaseFilterCam->QueryInterface(IID_IAMCameraControl, (void**)&cameraControl);
 
 	if( SUCCEEDED( hr ) )
 	{
@@ -876,14 +1357,14 @@ bool CameraMethods::SetProperty_value( WebCamLib::CameraControlProperty prop, lo
 
 bool CameraMethods::SetProperty_value( WebCamLib::VideoProcAmpProperty prop, long value, bool bAuto )
 {
-	if( g_pIBaseFilterCam == NULL )
+	if( pSession->pIBaseFilterCam == NULL )
 		throw gcnew InvalidOperationException( "No camera started." );
 
 	bool result = false;
 
 	// Query the capture filter for the IAMVideoProcAmp interface.
 	IAMVideoProcAmp * pProcAmp = NULL;
-	HRESULT hr = g_pIBaseFilterCam->QueryInterface(IID_IAMVideoProcAmp, (void**)&pProcAmp);
+	HRESULT hr = pSession->pIBaseFilterCam->QueryInterface(IID_IAMVideoProcAmp, (void**)&pProcAmp);
 
 	if( SUCCEEDED( hr ) )
 	{
@@ -929,6 +1410,41 @@ bool CameraMethods::ValidatePropertyValue( CameraProperty prop, long value )
 	return result;
 }
 
+bool CameraMethods::IsPropertyEmulated( CameraProperty prop )
+{
+	ToneProperty eTone;
+
+	// Like the camera's own properties, these are only there while a camera filter is
+	return pSession->pToneMapper != NULL && pSession->pIBaseFilterCam != NULL && GetToneProperty( prop, &eTone ) && pSession->pToneMapper->IsEmulated( eTone );
+}
+
+void CameraMethods::UpdateToneEmulation()
+{
+	if( pSession->pToneMapper == NULL )
+		pSession->pToneMapper = new ToneMapper();
+
+	IAMVideoProcAmp * pProcAmp = NULL;
+	if( FAILED( pSession->pIBaseFilterCam->QueryInterface( IID_IAMVideoProcAmp, (void**)&pProcAmp ) ) )
+		pProcAmp = NULL;
+
+	for( int n = 0; n < ToneProperty_Count; n++ )
+	{
+		ToneProperty eTone = static_cast<ToneProperty>( n );
+
+		bool supported = false;
+		if( pProcAmp != NULL )
+		{
+			long value, flags;
+			supported = SUCCEEDED( pProcAmp->Get( static_cast< long >( GetVideoProcAmpProperty( GetCameraProperty( eTone ) ) ), &value, &flags ) );
+		}
+
+		pSession->pToneMapper->SetEmulated( eTone, !supported );
+	}
+
+	if( pProcAmp != NULL )
+		pProcAmp->Release();
+}
+
 CameraPropertyCapabilities^ CameraMethods::GetPropertyCapability( CameraProperty prop )
 {
 	long value;
@@ -968,14 +1484,55 @@ IDictionary<CameraProperty, CameraPropertyCapabilities^> ^ CameraMethods::Proper
 /// </summary>
 void CameraMethods::Cleanup()
 {
+	msclr::lock sessionGuard(sessionLock);
+
 	StopCamera();
+	ReleaseGraph();
 	CleanupCameraInfo();
+	CloseFrameBus();
+	Pipeline = nullptr;
+
+	pSession->bStatisticsEnabled = false;
+	delete pSession->pStatisticsCalculator;
+	pSession->pStatisticsCalculator = NULL;
+
+	delete pSession->pExposureController;
+	pSession->pExposureController = NULL;
+
+	delete pSession->pToneMapper;
+	pSession->pToneMapper = NULL;
+
+	delete pSession->pLatestFrame;
+	pSession->pLatestFrame = NULL;
+
+	// Stopped after the camera, so a tick already running finds no camera to look at
+	if (streamWatchdog != nullptr)
+	{
+		delete streamWatchdog;
+		streamWatchdog = nullptr;
+	}
+	streamWatchdogEnabled = false;
+
+	delete pSession->pStreamHealth;
+	pSession->pStreamHealth = NULL;
+
+	// Frames still held by consumers keep the pool alive until they are released
+	if (pSession->pFramePool != NULL)
+	{
+		pSession->pFramePool->Release();
+		pSession->pFramePool = NULL;
+	}
 
 	// Clean up pinned pointer to callback delegate
 	if (ppCaptureCallback.IsAllocated)
 	{
 		ppCaptureCallback.Free();
 	}
+
+	if (ppFrameCallback.IsAllocated)
+	{
+		ppFrameCallback.Free();
+	}
 }
 
 /// <summary>
@@ -983,46 +1540,103 @@ void CameraMethods::Cleanup()
 /// </summary>
 void CameraMethods::StopCamera()
 {
-	if (g_pMediaControl != NULL)
+	msclr::lock sessionGuard(sessionLock);
+
+	// A paused graph restarts far quicker than one built from the moniker up
+	bool bKeepWarm = keepSessionWarm && pSession->pMediaControl != NULL && (activeCameraIndex != -1 || pSession->nWarmCameraIndex != -1);
+
+	if (pSession->pMediaControl != NULL)
+	{
+		if (bKeepWarm)
+		{
+			pSession->pMediaControl->Pause();
+		}
+		else
+		{
+			pSession->pMediaControl->Stop();
+		}
+	}
+
+	pSession->pfnCaptureCallback = NULL;
+	pSession->pfnFrameCallback = NULL;
+
+	// A BufferCB still running may be about to publish, and Clear must not run alongside it.
+	// Closing the slot first means a publisher counted in after the wait sees it closed.
+	InterlockedExchange(&pSession->bLatestFrameOpen, FALSE);
+	while (pSession->nLatestFrameUsers != 0)
+		YieldProcessor();
+
+	// Readers keep whatever references they took
+	if (pSession->pLatestFrame != NULL)
+	{
+		pSession->pLatestFrame->Clear();
+	}
+
+	// The graph is stopped, so hand the properties back while the camera filter is still alive
+	pSession->bExposureControlActive = false;
+	if (pSession->pExposureController != NULL)
+	{
+		pSession->pExposureController->Detach();
+	}
+
+	if (bKeepWarm)
 	{
-		g_pMediaControl->Stop();
-		g_pMediaControl->Release();
-		g_pMediaControl = NULL;
+		if (activeCameraIndex != -1)
+		{
+			pSession->nWarmCameraIndex = activeCameraIndex;
+		}
+	}
+	else
+	{
+		ReleaseGraph();
 	}
 
-	g_pfnCaptureCallback = NULL;
+	this->activeCameraIndex = -1;
+}
+
+/// <summary>
+/// Releases every object of the capture graph
+/// </summary>
+void CameraMethods::ReleaseGraph()
+{
+	pSession->nWarmCameraIndex = -1;
 
-	if (g_pIBaseFilterNullRenderer != NULL)
+	if (pSession->pMediaControl != NULL)
 	{
-		g_pIBaseFilterNullRenderer->Release();
-		g_pIBaseFilterNullRenderer = NULL;
+		pSession->pMediaControl->Stop();
+		pSession->pMediaControl->Release();
+		pSession->pMediaControl = NULL;
 	}
 
-	if (g_pIBaseFilterSampleGrabber != NULL)
+	if (pSession->pIBaseFilterNullRenderer != NULL)
 	{
-		g_pIBaseFilterSampleGrabber->Release();
-		g_pIBaseFilterSampleGrabber = NULL;
+		pSession->pIBaseFilterNullRenderer->Release();
+		pSession->pIBaseFilterNullRenderer = NULL;
 	}
 
-	if (g_pIBaseFilterCam != NULL)
+	if (pSession->pIBaseFilterSampleGrabber != NULL)
 	{
-		g_pIBaseFilterCam->Release();
-		g_pIBaseFilterCam = NULL;
+		pSession->pIBaseFilterSampleGrabber->Release();
+		pSession->pIBaseFilterSampleGrabber = NULL;
 	}
 
-	if (g_pGraphBuilder != NULL)
+	if (pSession->pIBaseFilterCam != NULL)
 	{
-		g_pGraphBuilder->Release();
-		g_pGraphBuilder = NULL;
+		pSession->pIBaseFilterCam->Release();
+		pSession->pIBaseFilterCam = NULL;
 	}
 
-	if (g_pCaptureGraphBuilder != NULL)
+	if (pSession->pGraphBuilder != NULL)
 	{
-		g_pCaptureGraphBuilder->Release();
-		g_pCaptureGraphBuilder = NULL;
+		pSession->pGraphBuilder->Release();
+		pSession->pGraphBuilder = NULL;
 	}
 
-	this->activeCameraIndex = -1;
+	if (pSession->pCaptureGraphBuilder != NULL)
+	{
+		pSession->pCaptureGraphBuilder->Release();
+		pSession->pCaptureGraphBuilder = NULL;
+	}
 }
 
 /// <summary>
@@ -1033,13 +1647,13 @@ void CameraMethods::DisplayCameraPropertiesDialog(int camIndex)
 	if (camIndex >= Count)
 		throw gcnew ArgumentException("Camera index is out of bounds: " + Count.ToString());
 
-	if (g_aCameraInfo[camIndex].pMoniker == NULL)
+	if (aCameraInfo[camIndex].pMoniker == NULL)
 		throw gcnew ArgumentException("There is no camera at index: " + camIndex.ToString());
 
 	HRESULT hr = S_OK;
 	IBaseFilter *pFilter = NULL;
 	ISpecifyPropertyPages *pProp = NULL;
-	IMoniker *pMoniker = g_aCameraInfo[camIndex].pMoniker;
+	IMoniker *pMoniker = aCameraInfo[camIndex].pMoniker;
 	pMoniker->AddRef();
 
 	// Create a filter graph for the moniker
@@ -1120,13 +1734,16 @@ void CameraMethods::CleanupCameraInfo()
 {
 	for (int n = 0; n < MAX_CAMERAS; n++)
 	{
-		SysFreeString(g_aCameraInfo[n].bstrName);
-		g_aCameraInfo[n].bstrName = NULL;
-		if (g_aCameraInfo[n].pMoniker != NULL)
+		SysFreeString(aCameraInfo[n].bstrName);
+		aCameraInfo[n].bstrName = NULL;
+		if (aCameraInfo[n].pMoniker != NULL)
 		{
-			g_aCameraInfo[n].pMoniker->Release();
-			g_aCameraInfo[n].pMoniker = NULL;
+			aCameraInfo[n].pMoniker->Release();
+			aCameraInfo[n].pMoniker = NULL;
 		}
+
+		delete aCameraInfo[n].pFormats;
+		aCameraInfo[n].pFormats = NULL;
 	}
 }
 
@@ -1153,7 +1770,7 @@ HRESULT CameraMethods::ConfigureSampleGrabber(IBaseFilter *pIBaseFilter)
 
 	if (SUCCEEDED(hr))
 	{
-		hr = pGrabber->SetCallback(new SampleGrabberCB(), 1);
+		hr = pGrabber->SetCallback(new SampleGrabberCB(pSession), 1);
 	}
 
 	if (pGrabber != NULL)
@@ -1169,157 +1786,715 @@ void CameraMethods::GetCaptureSizes(int index, IList<Tuple<int,int,int>^> ^ size
 {
 	sizes->Clear();
 
-	HRESULT hr = S_OK;
+	if (index >= Count)
+		throw gcnew ArgumentException("Camera index is out of bounds: " + Count.ToString());
+
+	if (aCameraInfo[index].pMoniker == NULL)
+		throw gcnew ArgumentException("There is no camera at index: " + index.ToString());
+
+	CaptureFormatTable* pFormats = NULL;
+	if (SUCCEEDED(GetFormatTable(aCameraInfo[index], NULL, &pFormats)))
+	{
+		for (int n = 0; n < pFormats->GetCount(); n++)
+		{
+			const CaptureFormat& format = pFormats->GetFormat(n);
+
+			sizes->Add( gcnew Tuple<int,int,int>( format.nWidth, format.nHeight, format.nBitsPerPixel ) );
+		}
+	}
+}
 
+Tuple<int,int,int>^ CameraMethods::FindCaptureSize(int index, int width, int height, int bpp)
+{
 	if (index >= Count)
 		throw gcnew ArgumentException("Camera index is out of bounds: " + Count.ToString());
 
-	if (g_aCameraInfo[index].pMoniker == NULL)
+	if (aCameraInfo[index].pMoniker == NULL)
 		throw gcnew ArgumentException("There is no camera at index: " + index.ToString());
 
-	if (g_pGraphBuilder != NULL)
-		throw gcnew ArgumentException("Graph Builder was null");
+	CaptureFormatTable* pFormats = NULL;
+	if (FAILED(GetFormatTable(aCameraInfo[index], NULL, &pFormats)))
+		return nullptr;
 
-	IMoniker *pMoniker = g_aCameraInfo[index].pMoniker;
-	pMoniker->AddRef();
+	int nFormat = pFormats->FindExact(width, height, bpp);
+	if (nFormat == -1)
+		nFormat = pFormats->FindAtLeast(width, height, bpp);
 
-	IBaseFilter* pCap = NULL;
-	// Build the camera from the moniker
-	if (SUCCEEDED(hr))
-		hr = pMoniker->BindToObject(NULL, NULL, IID_IBaseFilter, (LPVOID*)&pCap);
+	if (nFormat == -1)
+		return nullptr;
 
-	ICaptureGraphBuilder2* captureGraphBuilder = NULL;
-	if (SUCCEEDED(hr))
+	const CaptureFormat& format = pFormats->GetFormat(nFormat);
+
+	return gcnew Tuple<int,int,int>( format.nWidth, format.nHeight, format.nBitsPerPixel );
+}
+
+double CameraMethods::GetMaximumFrameRate(int index, int width, int height, int bpp)
+{
+	if (index >= Count)
+		throw gcnew ArgumentException("Camera index is out of bounds: " + Count.ToString());
+
+	if (aCameraInfo[index].pMoniker == NULL)
+		throw gcnew ArgumentException("There is no camera at index: " + index.ToString());
+
+	CaptureFormatTable* pFormats = NULL;
+	if (FAILED(GetFormatTable(aCameraInfo[index], NULL, &pFormats)))
+		return 0.0;
+
+	int nFormat = pFormats->FindFastest(width, height, bpp);
+	if (nFormat == -1 || pFormats->GetFormat(nFormat).llMinFrameInterval <= 0)
+		return 0.0;
+
+	// Frame intervals are in 100 ns units
+	return 10000000.0 / pFormats->GetFormat(nFormat).llMinFrameInterval;
+}
+
+IList<Tuple<int,int,int>^> ^ CameraMethods::CaptureSizes::get()
+{
+	IList<Tuple<int,int,int>^> ^ result = gcnew List<Tuple<int,int,int>^>();
+
+	GetCaptureSizes( ActiveCameraIndex, result );
+
+	return result;
+}
+
+#pragma region Frame Statistics
+bool CameraMethods::StatisticsEnabled::get()
+{
+	ThrowIfDisposed();
+
+	return pSession->bStatisticsEnabled;
+}
+
+void CameraMethods::StatisticsEnabled::set( bool value )
+{
+	ThrowIfDisposed();
+
+	// The calculator outlives every capture once created, so the callback never sees it go away
+	if( value && pSession->pStatisticsCalculator == NULL )
+		pSession->pStatisticsCalculator = new ImageStatisticsCalculator();
+
+	pSession->bStatisticsEnabled = value;
+}
+
+int CameraMethods::StatisticsGridStep::get()
+{
+	ThrowIfDisposed();
+
+	if( pSession->pStatisticsCalculator == NULL )
+		pSession->pStatisticsCalculator = new ImageStatisticsCalculator();
+
+	return pSession->pStatisticsCalculator->GetGridStep();
+}
+
+void CameraMethods::StatisticsGridStep::set( int value )
+{
+	ThrowIfDisposed();
+
+	if( value < 1 )
+		throw gcnew ArgumentOutOfRangeException( "Grid step must be at least one pixel." );
+
+	if( pSession->pStatisticsCalculator == NULL )
+		pSession->pStatisticsCalculator = new ImageStatisticsCalculator();
+
+	pSession->pStatisticsCalculator->SetGridStep( value );
+}
+
+FrameStatistics^ CameraMethods::CurrentFrameStatistics::get()
+{
+	ThrowIfDisposed();
+
+	FrameStatistics^ result = nullptr;
+
+	if( pSession->bStatisticsEnabled && pSession->bCurrentStatisticsValid )
+		result = gcnew FrameStatistics( pSession->currentStatistics );
+
+	return result;
+}
+#pragma endregion
+
+#pragma region Software Exposure Control
+bool CameraMethods::SoftwareExposureEnabled::get()
+{
+	ThrowIfDisposed();
+
+	return pSession->bSoftwareExposureEnabled;
+}
+
+void CameraMethods::SoftwareExposureEnabled::set( bool value )
+{
+	ThrowIfDisposed();
+
+	pSession->bSoftwareExposureEnabled = value;
+	UpdateExposureControl();
+}
+
+bool CameraMethods::SoftwareWhiteBalanceEnabled::get()
+{
+	ThrowIfDisposed();
+
+	return pSession->bSoftwareWhiteBalanceEnabled;
+}
+
+void CameraMethods::SoftwareWhiteBalanceEnabled::set( bool value )
+{
+	ThrowIfDisposed();
+
+	pSession->bSoftwareWhiteBalanceEnabled = value;
+	UpdateExposureControl();
+}
+
+double CameraMethods::ExposureTargetLuma::get()
+{
+	ThrowIfDisposed();
+
+	if( pSession->pExposureController == NULL )
+		pSession->pExposureController = new ExposureController();
+
+	return pSession->pExposureController->GetTargetLuma();
+}
+
+void CameraMethods::ExposureTargetLuma::set( double value )
+{
+	ThrowIfDisposed();
+
+	if( value < 0.0 || value > 255.0 )
+		throw gcnew ArgumentOutOfRangeException( "Target luma must be between 0 and 255." );
+
+	if( pSession->pExposureController == NULL )
+		pSession->pExposureController = new ExposureController();
+
+	pSession->pExposureController->SetTargetLuma( value );
+}
+
+int CameraMethods::ExposureControlWriteCount::get()
+{
+	ThrowIfDisposed();
+
+	return pSession->pExposureController != NULL ? static_cast<int>( pSession->pExposureController->GetWriteCount() ) : 0;
+}
+
+void CameraMethods::UpdateExposureControl()
+{
+	bool enabled = pSession->bSoftwareExposureEnabled || pSession->bSoftwareWhiteBalanceEnabled;
+
+	if( enabled && pSession->pExposureController == NULL )
+		pSession->pExposureController = new ExposureController();
+
+	if( pSession->pExposureController == NULL )
+		return;
+
+	pSession->pExposureController->EnableExposure( pSession->bSoftwareExposureEnabled );
+	pSession->pExposureController->EnableWhiteBalance( pSession->bSoftwareWhiteBalanceEnabled );
+
+	// A warm graph keeps its camera filter, but the loop only runs while frames arrive
+	if( enabled && pSession->pIBaseFilterCam != NULL && activeCameraIndex != -1 )
 	{
-		hr = CoCreateInstance(CLSID_CaptureGraphBuilder2,
-			NULL,
-			CLSCTX_INPROC,
-			IID_ICaptureGraphBuilder2,
-			(LPVOID*)&captureGraphBuilder);
+		if( !pSession->pExposureController->IsAttached() )
+		{
+			if( pSession->pStatisticsCalculator == NULL )
+				pSession->pStatisticsCalculator = new ImageStatisticsCalculator();
+
+			// Ranges are cached by Attach, so the capture thread never queries them
+			pSession->bExposureControlActive = pSession->pExposureController->Attach( new DirectShowExposureDevice( pSession->pIBaseFilterCam ) );
+		}
+	}
+	else
+	{
+		pSession->bExposureControlActive = false;
+		pSession->pExposureController->Detach();
 	}
+}
+#pragma endregion
 
-	IAMStreamConfig *pConfig = NULL;
-	if(SUCCEEDED(hr))
-		hr = captureGraphBuilder->FindInterface(
-		&PIN_CATEGORY_CAPTURE,
-		&MEDIATYPE_Video, 
-		pCap, // Pointer to the capture filter.
-		IID_IAMStreamConfig, (void**)&pConfig);
+#pragma region Warm Session
+bool CameraMethods::KeepSessionWarm::get()
+{
+	return keepSessionWarm;
+}
 
-	int iCount = 0, iSize = 0;
-	if(SUCCEEDED(hr))
-		hr = pConfig->GetNumberOfCapabilities(&iCount, &iSize);
+void CameraMethods::KeepSessionWarm::set( bool value )
+{
+	ThrowIfDisposed();
+
+	keepSessionWarm = value;
+
+	if( !value )
+		ReleaseSession();
+}
+
+int CameraMethods::WarmCameraIndex::get()
+{
+	ThrowIfDisposed();
+
+	return pSession->nWarmCameraIndex;
+}
+
+CaptureStartKind CameraMethods::LastStartKind::get()
+{
+	return lastStartKind;
+}
+
+double CameraMethods::LastStartDuration::get()
+{
+	return lastStartDuration;
+}
 
-	// Check the size to make sure we pass in the correct structure.
-	if (SUCCEEDED(hr) && iSize == sizeof(VIDEO_STREAM_CONFIG_CAPS))
+void CameraMethods::ReleaseSession()
+{
+	if( activeCameraIndex == -1 )
+		ReleaseGraph();
+}
+#pragma endregion
+
+#pragma region Stream Health
+bool CameraMethods::SuppressDuplicateFrames::get()
+{
+	ThrowIfDisposed();
+
+	return pSession->bSuppressDuplicates;
+}
+
+void CameraMethods::SuppressDuplicateFrames::set( bool value )
+{
+	ThrowIfDisposed();
+
+	pSession->bSuppressDuplicates = value;
+	UpdateStreamWatchdog();
+}
+
+int CameraMethods::DuplicateFrameCount::get()
+{
+	ThrowIfDisposed();
+
+	return pSession->pStreamHealth != NULL ? pSession->pStreamHealth->GetDuplicateCount() : 0;
+}
+
+bool CameraMethods::StreamWatchdogEnabled::get()
+{
+	return streamWatchdogEnabled;
+}
+
+void CameraMethods::StreamWatchdogEnabled::set( bool value )
+{
+	ThrowIfDisposed();
+
+	streamWatchdogEnabled = value;
+	UpdateStreamWatchdog();
+}
+
+int CameraMethods::StreamStallTimeout::get()
+{
+	return streamStallTimeout;
+}
+
+void CameraMethods::StreamStallTimeout::set( int value )
+{
+	ThrowIfDisposed();
+
+	if( value <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "value", "Stall timeout must be positive." );
+
+	streamStallTimeout = value;
+	UpdateStreamWatchdog();
+}
+
+int CameraMethods::StreamFrozenTimeout::get()
+{
+	return streamFrozenTimeout;
+}
+
+void CameraMethods::StreamFrozenTimeout::set( int value )
+{
+	ThrowIfDisposed();
+
+	if( value < 0 )
+		throw gcnew ArgumentOutOfRangeException( "value", "Frozen timeout cannot be negative." );
+
+	streamFrozenTimeout = value;
+	UpdateStreamWatchdog();
+}
+
+bool CameraMethods::AutoRestartStream::get()
+{
+	return autoRestartStream;
+}
+
+void CameraMethods::AutoRestartStream::set( bool value )
+{
+	autoRestartStream = value;
+}
+
+StreamState CameraMethods::CurrentStreamState::get()
+{
+	return streamState;
+}
+
+int CameraMethods::StreamRestartCount::get()
+{
+	return streamRestartCount;
+}
+
+void CameraMethods::UpdateStreamWatchdog()
+{
+	pSession->bFingerprintFrames = pSession->bSuppressDuplicates || ( streamWatchdogEnabled && streamFrozenTimeout > 0 );
+
+	if( !streamWatchdogEnabled )
 	{
-		// Use the video capabilities structure.
-		for (int iFormat = 0; iFormat < iCount; iFormat++)
+		if( streamWatchdog != nullptr )
 		{
-			VIDEO_STREAM_CONFIG_CAPS scc;
-			AM_MEDIA_TYPE *pmt;
-			/* Note:  Use of the VIDEO_STREAM_CONFIG_CAPS structure to configure a video device is 
-			deprecated. Although the caller must allocate the buffer, it should ignore the 
-			contents after the method returns. The capture device will return its supported 
-			formats through the pmt parameter. */
-			hr = pConfig->GetStreamCaps(iFormat, &pmt, (BYTE*)&scc);
-			if (SUCCEEDED(hr))
-			{
-				/* Examine the format, and possibly use it. */
-				if (pmt->formattype == FORMAT_VideoInfo) {
-					// Check the buffer size.
-					if (pmt->cbFormat >= sizeof(VIDEOINFOHEADER))
-					{
-						VIDEOINFOHEADER *pVih =  reinterpret_cast<VIDEOINFOHEADER*>(pmt->pbFormat);
-						BITMAPINFOHEADER *bmiHeader = &pVih->bmiHeader;
-
-						int width = bmiHeader->biWidth;
-						int height = bmiHeader->biHeight;
-						int bitCount = bmiHeader->biBitCount;
-
-						sizes->Add( gcnew Tuple<int,int,int>( width, height, bitCount ) );
-					}
-				}
+			delete streamWatchdog;
+			streamWatchdog = nullptr;
+		}
 
-				// Delete the media type when you are done.
-				MyDeleteMediaType(pmt);
-			}
+		streamState = StreamState::Healthy;
+		return;
+	}
+
+	// A few looks per timeout, so a stall is reported within a quarter of one late
+	int timeout = streamFrozenTimeout > 0 ? min( streamStallTimeout, streamFrozenTimeout ) : streamStallTimeout;
+	int period = max( 50, min( 1000, timeout / 4 ) );
+
+	if( streamWatchdog == nullptr )
+		streamWatchdog = gcnew System::Threading::Timer( gcnew System::Threading::TimerCallback( this, &CameraMethods::OnStreamWatchdog ), nullptr, period, period );
+	else
+		streamWatchdog->Change( period, period );
+}
+
+void CameraMethods::OnStreamWatchdog( Object^ state )
+{
+	StreamState reported;
+	bool changed = false;
+	System::Threading::SynchronizationContext^ restartContext = nullptr;
+
+	{
+		// Never wait here: a start or restart holds the lock while it builds a graph, and the next
+		// look comes soon enough
+		msclr::lock sessionGuard( sessionLock, msclr::lock_later );
+		if( !sessionGuard.try_acquire( 0 ) )
+			return;
+
+		if( disposed || !streamWatchdogEnabled || activeCameraIndex == -1 || pSession->pStreamHealth == NULL )
+			return;
+
+		StreamHealth* pHealth = pSession->pStreamHealth;
+		DWORD dwNow = GetTickCount();
+		int changes = pHealth->GetChangeCount();
+
+		StreamState detected = StreamState::Healthy;
+		if( dwNow - pHealth->GetLastFrameTick() >= static_cast<DWORD>( streamStallTimeout ) )
+			detected = StreamState::Stalled;
+		else if( streamFrozenTimeout > 0 && dwNow - pHealth->GetLastChangeTick() >= static_cast<DWORD>( streamFrozenTimeout ) )
+			detected = StreamState::Frozen;
+
+		// A restart or a new start gives the stream the full timeouts again, which is not the same
+		// as having shown a new picture
+		reported = detected;
+		if( detected == StreamState::Healthy && streamState != StreamState::Healthy && changes == streamStateChanges )
+			reported = streamState;
+
+		// The graph belongs to the thread which started it, so the restart is left to that thread
+		if( detected != StreamState::Healthy && autoRestartStream && ownerContext != nullptr && !restartPosted )
+		{
+			restartPosted = true;
+			restartContext = ownerContext;
+		}
+
+		if( reported != streamState )
+		{
+			if( reported != StreamState::Healthy )
+				streamStateChanges = changes;
+
+			streamState = reported;
+			changed = true;
 		}
 	}
 
-	// Cleanup
-	if (pMoniker != NULL)
+	if( restartContext != nullptr )
 	{
-		pMoniker->Release();
-		pMoniker = NULL;
+		try
+		{
+			restartContext->Post( gcnew System::Threading::SendOrPostCallback( this, &CameraMethods::OnRestartPosted ), nullptr );
+		}
+		catch( InvalidOperationException^ )
+		{
+			// The owner's message loop has gone, so there is nothing left to restart on
+			msclr::lock sessionGuard( sessionLock );
+
+			if( ownerContext == restartContext )
+				ownerContext = nullptr;
+
+			restartPosted = false;
+		}
 	}
+
+	// Outside the lock, so a handler may stop or start the camera
+	if( changed )
+		OnStreamStateChanged( reported );
 }
 
-IList<Tuple<int,int,int>^> ^ CameraMethods::CaptureSizes::get()
+void CameraMethods::OnRestartPosted( Object^ state )
 {
-	IList<Tuple<int,int,int>^> ^ result = gcnew List<Tuple<int,int,int>^>();
+	msclr::lock sessionGuard( sessionLock );
 
-	GetCaptureSizes( ActiveCameraIndex, result );
+	restartPosted = false;
 
-	return result;
+	// Stopped, disposed, switched off or healthy again while the restart waited its turn
+	if( disposed || !autoRestartStream || activeCameraIndex == -1 || streamState == StreamState::Healthy )
+		return;
+
+	RestartStream();
 }
 
-// If bpp is -1, the first format matching the width and height is selected.
+void CameraMethods::RestartStream()
+{
+	{
+		msclr::lock sessionGuard( sessionLock );
+
+		if( disposed || activeCameraIndex == -1 )
+			return;
+
+		int camIndex = activeCameraIndex;
+		FormatRequest request = pSession->warmRequest;
+		StreamState state = streamState;
+
+		// Whatever stopped the stream may be in the graph itself, so it is built again from nothing
+		bool keepWarm = keepSessionWarm;
+		keepSessionWarm = false;
+		StopCamera();
+		keepSessionWarm = keepWarm;
+
+		int width = request.nWidth;
+		int height = request.nHeight;
+		int bpp = request.nBitsPerPixel;
+		double fps = request.llFrameInterval > 0 ? 10000000.0 / request.llFrameInterval : 0.0;
+
+		if( StartCamera( camIndex, &width, &height, &bpp, &fps, static_cast<FormatPreference>( request.ePriority ) ) )
+		{
+			streamRestartCount++;
+
+			// Still unhealthy until the restarted camera shows a new picture, which it has not yet
+			streamState = state;
+			streamStateChanges = 0;
+			return;
+		}
+
+		// The camera stays stopped, so the watchdog will not look at it again
+		streamState = StreamState::Stalled;
+	}
+
+	// Outside the lock, as the watchdog raises it, so a handler may try to start the camera again
+	OnStreamStateChanged( StreamState::Stalled );
+}
+#pragma endregion
+
+#pragma region Frame Bus
+void CameraMethods::OpenFrameBus( String^ name, int slotCount, int slotSize )
+{
+	if( name == nullptr )
+		throw gcnew ArgumentNullException( "name" );
+
+	if( slotCount < 2 )
+		throw gcnew ArgumentOutOfRangeException( "slotCount", "A frame bus needs at least two slots." );
+
+	if( slotSize <= 0 )
+		throw gcnew ArgumentOutOfRangeException( "slotSize" );
+
+	// Readers of a bus being reopened under the same name stay attached across the swap
+	CloseFrameBus();
+
+	FrameBusWriter* pWriter = new FrameBusWriter();
+
+	pin_ptr<const wchar_t> wszName = PtrToStringChars( name );
+	HRESULT hr = pWriter->Create( wszName, slotCount, static_cast<DWORD>( slotSize ) );
+
+	if( FAILED( hr ) )
+	{
+		delete pWriter;
+		throw gcnew COMException( "Unable to open frame bus: " + name, hr );
+	}
+
+	InterlockedExchangePointer( reinterpret_cast<PVOID volatile*>( &pSession->pFrameBus ), pWriter );
+}
+
+void CameraMethods::CloseFrameBus()
+{
+	FrameBusWriter* pWriter = static_cast<FrameBusWriter*>( InterlockedExchangePointer( reinterpret_cast<PVOID volatile*>( &pSession->pFrameBus ), NULL ) );
+
+	if( pWriter != NULL )
+	{
+		// The capture thread holds on to the writer for one publish at most
+		while( pSession->nFrameBusUsers != 0 )
+			YieldProcessor();
+
+		delete pWriter;
+	}
+}
+
+int CameraMethods::FrameBusDroppedFrames::get()
+{
+	ThrowIfDisposed();
+
+	InterlockedIncrement( &pSession->nFrameBusUsers );
+	FrameBusWriter* pWriter = pSession->pFrameBus;
+	int dropped = pWriter != NULL ? pWriter->GetDroppedCount() : 0;
+	InterlockedDecrement( &pSession->nFrameBusUsers );
+
+	return dropped;
+}
+#pragma endregion
+
+#pragma region Thread Placement
+ThreadPlacementOptions^ CameraMethods::CaptureThreadPlacement::get()
+{
+	return captureThreadPlacement;
+}
+
+void CameraMethods::CaptureThreadPlacement::set( ThreadPlacementOptions^ value )
+{
+	ThrowIfDisposed();
+
+	captureThreadPlacement = value;
+
+	if( activeCameraIndex != -1 )
+		QueueCaptureThreadPlacement();
+}
+
+void CameraMethods::QueueCaptureThreadPlacement()
+{
+	ThreadPlacement* pPlacement = NULL;
+
+	if( captureThreadPlacement != nullptr )
+	{
+		pPlacement = new ThreadPlacement();
+		captureThreadPlacement->ToNative( pPlacement );
+	}
+
+	// A placement the grabber has not taken yet is superseded by this one
+	delete static_cast<ThreadPlacement*>( InterlockedExchangePointer( reinterpret_cast<PVOID volatile*>( &pSession->pPendingCapturePlacement ), pPlacement ) );
+}
+
+ThreadPlacementOptions^ CameraMethods::WorkerThreadPlacement::get()
+{
+	return workerThreadPlacement;
+}
+
+void CameraMethods::WorkerThreadPlacement::set( ThreadPlacementOptions^ value )
+{
+	if( value != nullptr )
+	{
+		ThreadPlacement placement;
+		value->ToNative( &placement );
+
+		HRESULT hr = WorkerPool::GetShared()->SetPlacement( placement );
+		if( FAILED( hr ) )
+			throw gcnew COMException( "Unable to apply the worker thread placement.", hr );
+	}
+
+	workerThreadPlacement = value;
+}
+#pragma endregion
+
+#pragma region Processing Pipeline
+FrameProcessingPipeline^ CameraMethods::Pipeline::get()
+{
+	return pipeline;
+}
+
+void CameraMethods::Pipeline::set( FrameProcessingPipeline^ value )
+{
+	ThrowIfDisposed();
+
+	ProcessingPipeline* pNative = NULL;
+
+	if( value != nullptr )
+	{
+		pNative = value->GetNative();
+		pNative->AddRef();
+	}
+
+	ProcessingPipeline* pPrevious = static_cast<ProcessingPipeline*>( InterlockedExchangePointer( reinterpret_cast<PVOID volatile*>( &pSession->pPipeline ), pNative ) );
+
+	if( pPrevious != NULL )
+	{
+		// The capture thread holds on to the pipeline for one frame at most
+		while( pSession->nPipelineUsers != 0 )
+			YieldProcessor();
+
+		pPrevious->Release();
+	}
+
+	pipeline = value;
+}
+#pragma endregion
+
+// With FormatPriority_Exact and a bpp of -1, the first format matching the width and height is selected.
 // based on http://stackoverflow.com/questions/7383372/cant-make-iamstreamconfig-setformat-to-work-with-lifecam-studio
-HRESULT CameraMethods::SetCaptureFormat(IBaseFilter* pCap, int width, int height, int bpp)
+HRESULT CameraMethods::SetCaptureFormat(int camIndex, IBaseFilter* pCap, const FormatRequest& request)
 {
-	HRESULT hr = S_OK;
+	// The capabilities are only walked once per camera; after that picking one is a lookup
+	CaptureFormatTable* pFormats = NULL;
+	HRESULT hr = GetFormatTable(aCameraInfo[camIndex], pCap, &pFormats);
+	if (!SUCCEEDED(hr)) return hr;
+
+	int nFormat = pFormats->FindBest(request);
+	if (nFormat == -1) return hr;
 
 	IAMStreamConfig *pConfig = NULL;
-	hr = g_pCaptureGraphBuilder->FindInterface(
+	hr = pSession->pCaptureGraphBuilder->FindInterface(
 		&PIN_CATEGORY_CAPTURE,
 		&MEDIATYPE_Video, 
 		pCap, // Pointer to the capture filter.
 		IID_IAMStreamConfig, (void**)&pConfig);
 	if (!SUCCEEDED(hr)) return hr;
 
-	int iCount = 0, iSize = 0;
-	hr = pConfig->GetNumberOfCapabilities(&iCount, &iSize);
-	if (!SUCCEEDED(hr)) return hr;
+	// AvgTimePerFrame left alone means whatever rate the driver defaults to, often far below what the format allows
+	hr = pFormats->Apply(pConfig, nFormat, pFormats->GetFrameInterval(nFormat, request));
 
-	// Check the size to make sure we pass in the correct structure.
-	if (iSize == sizeof(VIDEO_STREAM_CONFIG_CAPS))
+	pConfig->Release();
+
+	return hr;
+}
+
+/// <summary>
+/// Frame interval the camera's capture pin is set to, 0 when it does not say
+/// </summary>
+LONGLONG CameraMethods::GetNegotiatedFrameInterval()
+{
+	LONGLONG result = 0;
+
+	IAMStreamConfig *pConfig = NULL;
+	HRESULT hr = pSession->pCaptureGraphBuilder->FindInterface(&PIN_CATEGORY_CAPTURE, &MEDIATYPE_Video, pSession->pIBaseFilterCam, IID_IAMStreamConfig, (void**)&pConfig);
+
+	AM_MEDIA_TYPE *pmt = NULL;
+	if (SUCCEEDED(hr))
+	{
+		hr = pConfig->GetFormat(&pmt);
+	}
+
+	if (SUCCEEDED(hr))
 	{
-		// Use the video capabilities structure.
-		for (int iFormat = 0; iFormat < iCount; iFormat++)
+		if (pmt->formattype == FORMAT_VideoInfo && pmt->cbFormat >= sizeof(VIDEOINFOHEADER) && pmt->pbFormat != NULL)
 		{
-				VIDEO_STREAM_CONFIG_CAPS scc;
-				AM_MEDIA_TYPE *pmt;
-				/* Note:  Use of the VIDEO_STREAM_CONFIG_CAPS structure to configure a video device is 
-				deprecated. Although the caller must allocate the buffer, it should ignore the 
-				contents after the method returns. The capture device will return its supported 
-				formats through the pmt parameter. */
-				hr = pConfig->GetStreamCaps(iFormat, &pmt, (BYTE*)&scc);
-				if (SUCCEEDED(hr))
-				{
-					/* Examine the format, and possibly use it. */
-					if (pmt->formattype == FORMAT_VideoInfo) {
-						// Check the buffer size.
-						if (pmt->cbFormat >= sizeof(VIDEOINFOHEADER))
-						{
-								VIDEOINFOHEADER *pVih =  reinterpret_cast<VIDEOINFOHEADER*>(pmt->pbFormat);
-								BITMAPINFOHEADER *bmiHeader = &pVih->bmiHeader;
-
-								/* Access VIDEOINFOHEADER members through pVih. */
-								if( bmiHeader->biWidth == width && bmiHeader->biHeight == height && ( bmiHeader->biBitCount == -1 || bmiHeader->biBitCount == bpp) )
-								{
-									hr = pConfig->SetFormat(pmt);
-
-									break;
-								}
-						}
-					}
-
-					// Delete the media type when you are done.
-					MyDeleteMediaType(pmt);
-				}
+			result = reinterpret_cast<VIDEOINFOHEADER*>(pmt->pbFormat)->AvgTimePerFrame;
 		}
+
+		MyDeleteMediaType(pmt);
 	}
 
-	return hr;
+	if (pConfig != NULL)
+	{
+		pConfig->Release();
+	}
+
+	return result;
+}
+
+double CameraMethods::CaptureFrameRate::get()
+{
+	ThrowIfDisposed();
+
+	if( activeCameraIndex == -1 || pSession->llCaptureFrameInterval <= 0 )
+		return 0.0;
+
+	return 10000000.0 / pSession->llCaptureFrameInterval;
 }
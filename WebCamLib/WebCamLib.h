@@ -13,8 +13,14 @@ using namespace System;
 using namespace System::Collections::Generic;
 using namespace System::Runtime::InteropServices;
 
+struct CameraInfoStruct;
+
 namespace WebCamLib
 {
+	struct CaptureSession;
+	ref class ThreadPlacementOptions;
+	ref class FrameProcessingPipeline;
+
 	/// <summary>
 	/// Store webcam name, index
 	/// </summary>
@@ -96,6 +102,64 @@ namespace WebCamLib
 		Gain = WebCamLib::VideoProcAmpProperty::Gain | PropertyTypeMask::VideoProcAmpPropertyMask,
 	};
 
+	/// <summary>
+	/// How much of the capture graph StartCamera had to build
+	/// </summary>
+	public enum class CaptureStartKind : int
+	{
+		None,
+		Cold,
+		Resume,
+		FormatChange,
+	};
+
+	/// <summary>
+	/// What the stream watchdog last made of the running camera's frames
+	/// </summary>
+	public enum class StreamState : int
+	{
+		/// <summary>
+		/// Frames with new pictures are arriving
+		/// </summary>
+		Healthy,
+
+		/// <summary>
+		/// No frame has arrived for the stall timeout
+		/// </summary>
+		Stalled,
+
+		/// <summary>
+		/// Frames arrive, but have repeated one picture for the frozen timeout
+		/// </summary>
+		Frozen,
+	};
+
+	/// <summary>
+	/// What StartCamera gives up last when no format meets size, frame rate and bit depth at once
+	/// </summary>
+	public enum class FormatPreference : int
+	{
+		/// <summary>
+		/// The exact size and bit depth or the driver's default format, at the driver's default rate
+		/// </summary>
+		Exact = FormatPriority_Exact,
+
+		/// <summary>
+		/// The closest size, preferring larger ones, then the frame rate, then the cheapest format
+		/// </summary>
+		Resolution = FormatPriority_Resolution,
+
+		/// <summary>
+		/// The frame rate, then the closest size, then the cheapest format
+		/// </summary>
+		FrameRate = FormatPriority_FrameRate,
+
+		/// <summary>
+		/// The closest size, then formats needing no decoder, then the frame rate
+		/// </summary>
+		FormatCost = FormatPriority_Cost,
+	};
+
 	public ref class CameraPropertyCapabilities
 	{
 	public:
@@ -170,6 +234,27 @@ namespace WebCamLib
 		/// </summary>
 		event CaptureCallbackDelegate^ OnImageCapture;
 
+		/// <summary>
+		/// Delegate used to pass captured frames without copying them into managed memory
+		/// </summary>
+		delegate void FrameCaptureDelegate( PooledFrame^ frame );
+
+		/// <summary>
+		/// Event raised with every captured frame held in a pooled native buffer.
+		/// The frame is released when the handlers return; handlers call AddReference to keep it.
+		/// </summary>
+		event FrameCaptureDelegate^ OnFrameCapture
+		{
+			void add( FrameCaptureDelegate^ handler );
+			void remove( FrameCaptureDelegate^ handler );
+		}
+
+		/// <summary>
+		/// Returns a reference on the newest frame delivered through OnFrameCapture, or null before the first one.
+		/// Never blocks the capture thread; dispose the frame once done with it.
+		/// </summary>
+		PooledFrame^ GetLatestFrame();
+
 		/// <summary>
 		/// Retrieve information about a specific camera
 		/// Use the count property to determine valid indicies to pass in
@@ -186,6 +271,25 @@ namespace WebCamLib
 		/// </summary>
 		void StartCamera(int camIndex, interior_ptr<int> width, interior_ptr<int> height, interior_ptr<int> bpp, interior_ptr<bool> successful);
 
+		/// <summary>
+		/// Start the camera in the format best meeting a size and frame rate; fps 0 asks for the fastest.
+		/// Width, height, bpp and fps come back as negotiated, fps 0 when the driver does not tell.
+		/// </summary>
+		bool StartCamera(int camIndex, interior_ptr<int> width, interior_ptr<int> height, interior_ptr<int> bpp, interior_ptr<double> fps, FormatPreference preference);
+
+		/// <summary>
+		/// Start the camera in the format best meeting a size and frame rate
+		/// </summary>
+		void StartCamera(int camIndex, interior_ptr<int> width, interior_ptr<int> height, interior_ptr<int> bpp, interior_ptr<double> fps, FormatPreference preference, interior_ptr<bool> successful);
+
+		/// <summary>
+		/// Frame rate the running camera was negotiated at, 0 when not running or unknown
+		/// </summary>
+		property double CaptureFrameRate
+		{
+			double get();
+		}
+
 		#pragma region Camera Property Support
 		void IsPropertySupported( CameraProperty prop, interior_ptr<bool> result );
 
@@ -231,6 +335,14 @@ namespace WebCamLib
 
 		bool ValidatePropertyValue( CameraProperty prop, long value );
 
+		/// <summary>
+		/// True when the running camera lacks the property and it is applied to the frames in software
+		/// instead. Brightness, Contrast, Hue, Saturation and Gamma are, with the ranges ToneMapper
+		/// gives them; the calls above read and set them like any other property, but never automatic.
+		/// Statistics and software exposure control still see the frames as the camera sent them.
+		/// </summary>
+		bool IsPropertyEmulated( CameraProperty prop );
+
 		CameraPropertyCapabilities^ GetPropertyCapability( CameraProperty prop );
 
 		property IDictionary<CameraProperty, CameraPropertyCapabilities^> ^ PropertyCapabilities
@@ -239,13 +351,294 @@ namespace WebCamLib
 		}
 		#pragma endregion
 
+		/// <summary>
+		/// Sizes the camera offers, in the driver's order; read from the driver once per camera
+		/// </summary>
 		void GetCaptureSizes(int index, IList<Tuple<int,int,int>^> ^ sizes);
 
+		/// <summary>
+		/// The requested size if the camera offers it, otherwise the smallest one covering it; null when none does.
+		/// A bpp of -1 matches any bit depth.
+		/// </summary>
+		Tuple<int,int,int>^ FindCaptureSize(int index, int width, int height, int bpp);
+
+		/// <summary>
+		/// Highest frame rate the camera offers at this size, 0 when it does not offer the size
+		/// </summary>
+		double GetMaximumFrameRate(int index, int width, int height, int bpp);
+
 		property IList<Tuple<int,int,int>^> ^ CaptureSizes
 		{
 			IList<Tuple<int,int,int>^> ^ get();
 		}
 
+		#pragma region Frame Statistics
+		/// <summary>
+		/// Computes image statistics for every captured frame before OnImageCapture is raised
+		/// </summary>
+		property bool StatisticsEnabled
+		{
+			bool get();
+			void set( bool value );
+		}
+
+		/// <summary>
+		/// Distance in pixels between the samples the statistics are computed from
+		/// </summary>
+		property int StatisticsGridStep
+		{
+			int get();
+			void set( int value );
+		}
+
+		/// <summary>
+		/// Statistics of the frame being delivered through OnImageCapture, null when disabled.
+		/// Only meaningful from within an OnImageCapture handler.
+		/// </summary>
+		property FrameStatistics^ CurrentFrameStatistics
+		{
+			FrameStatistics^ get();
+		}
+		#pragma endregion
+
+		#pragma region Software Exposure Control
+		/// <summary>
+		/// Drives Exposure_lgSec and Gain from the luma of each frame instead of the camera's own auto-exposure
+		/// </summary>
+		property bool SoftwareExposureEnabled
+		{
+			bool get();
+			void set( bool value );
+		}
+
+		/// <summary>
+		/// Drives WhiteBalance toward a grey world from the colour means of each frame
+		/// </summary>
+		property bool SoftwareWhiteBalanceEnabled
+		{
+			bool get();
+			void set( bool value );
+		}
+
+		/// <summary>
+		/// Mean luma, 0 to 255, the software exposure control aims for
+		/// </summary>
+		property double ExposureTargetLuma
+		{
+			double get();
+			void set( double value );
+		}
+
+		/// <summary>
+		/// Number of property writes the software control has sent to the running camera
+		/// </summary>
+		property int ExposureControlWriteCount
+		{
+			int get();
+		}
+		#pragma endregion
+
+		#pragma region Warm Session
+		/// <summary>
+		/// Pauses the filter graph in StopCamera instead of releasing it, so the next StartCamera
+		/// on the same camera resumes it, or only reconnects it when the format changed
+		/// </summary>
+		property bool KeepSessionWarm
+		{
+			bool get();
+			void set( bool value );
+		}
+
+		/// <summary>
+		/// Camera whose graph is kept paused, -1 for none
+		/// </summary>
+		property int WarmCameraIndex
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// What the last successful StartCamera had to do
+		/// </summary>
+		property CaptureStartKind LastStartKind
+		{
+			CaptureStartKind get();
+		}
+
+		/// <summary>
+		/// Milliseconds the last successful StartCamera took
+		/// </summary>
+		property double LastStartDuration
+		{
+			double get();
+		}
+
+		/// <summary>
+		/// Releases a graph kept paused by KeepSessionWarm; does nothing while a camera runs
+		/// </summary>
+		void ReleaseSession();
+		#pragma endregion
+
+		#pragma region Stream Health
+		/// <summary>
+		/// Drops a frame whose sampled content matches the last frame's before anything sees it,
+		/// so consumers are not handed the same picture again by a camera repeating itself.
+		/// A still picture without sensor noise, such as a covered lens, also repeats.
+		/// </summary>
+		property bool SuppressDuplicateFrames
+		{
+			bool get();
+			void set( bool value );
+		}
+
+		/// <summary>
+		/// Frames found to repeat the last picture since the camera was started; counted while
+		/// duplicates are suppressed or the watchdog looks for frozen streams
+		/// </summary>
+		property int DuplicateFrameCount
+		{
+			int get();
+		}
+
+		/// <summary>
+		/// Delegate used to report a change of StreamState
+		/// </summary>
+		delegate void StreamStateDelegate( StreamState state );
+
+		/// <summary>
+		/// Raised on a timer thread when the watchdog finds the running stream stalled or frozen,
+		/// and again with Healthy once a new picture arrives after that. The watchdog itself never
+		/// stops or starts the camera; see AutoRestartStream and RestartStream.
+		/// </summary>
+		event StreamStateDelegate^ OnStreamStateChanged;
+
+		/// <summary>
+		/// Checks the running stream from a timer a few times per timeout. Off by default.
+		/// </summary>
+		property bool StreamWatchdogEnabled
+		{
+			bool get();
+			void set( bool value );
+		}
+
+		/// <summary>
+		/// Milliseconds without a frame after which the stream counts as stalled; 2000 by default
+		/// </summary>
+		property int StreamStallTimeout
+		{
+			int get();
+			void set( int value );
+		}
+
+		/// <summary>
+		/// Milliseconds of frames repeating one picture after which the stream counts as frozen;
+		/// 5000 by default, 0 not to look for frozen streams
+		/// </summary>
+		property int StreamFrozenTimeout
+		{
+			int get();
+			void set( int value );
+		}
+
+		/// <summary>
+		/// Has the watchdog post RestartStream to the SynchronizationContext of the thread which
+		/// started the camera, such as a Windows Forms or WPF UI thread, whenever it finds the stream
+		/// stalled or frozen; tried again each time a timeout runs out with nothing new. When that
+		/// thread has no context, nothing is restarted automatically: handle OnStreamStateChanged
+		/// and call RestartStream from the thread which owns the camera.
+		/// </summary>
+		property bool AutoRestartStream
+		{
+			bool get();
+			void set( bool value );
+		}
+
+		/// <summary>
+		/// Stops the running camera, releasing its graph even when KeepSessionWarm is set, and starts
+		/// it again with the format it was last started with. Call it from the thread which started
+		/// the camera. A camera that fails to start stays stopped and is reported Stalled through
+		/// OnStreamStateChanged; nothing happens when none runs.
+		/// </summary>
+		void RestartStream();
+
+		/// <summary>
+		/// State the watchdog last reported, Healthy when it is off or no camera runs
+		/// </summary>
+		property StreamState CurrentStreamState
+		{
+			StreamState get();
+		}
+
+		/// <summary>
+		/// Restarts made by RestartStream, asked for or automatic, which started the camera again, since
+		/// this instance was created
+		/// </summary>
+		property int StreamRestartCount
+		{
+			int get();
+		}
+		#pragma endregion
+
+		#pragma region Thread Placement
+		/// <summary>
+		/// Affinity, priority and name of the DirectShow streaming thread, which runs the capture
+		/// callback and every OnFrameCapture handler. The thread is only ours while it delivers a
+		/// frame, so the placement is applied on the first frame after it is set or the camera is
+		/// started. Null stops applying one; a thread keeps a placement it was already given.
+		/// </summary>
+		property ThreadPlacementOptions^ CaptureThreadPlacement
+		{
+			ThreadPlacementOptions^ get();
+			void set( ThreadPlacementOptions^ value );
+		}
+
+		/// <summary>
+		/// Placement of the worker threads the image kernels, such as blob extraction, fan out to.
+		/// The pool is shared by every camera in the process.
+		/// </summary>
+		static property ThreadPlacementOptions^ WorkerThreadPlacement
+		{
+			ThreadPlacementOptions^ get();
+			void set( ThreadPlacementOptions^ value );
+		}
+		#pragma endregion
+
+		#pragma region Processing Pipeline
+		/// <summary>
+		/// Stages run natively over every frame on the capture thread, ahead of OnFrameCapture,
+		/// GetLatestFrame and the frame bus, which all get the main branch's output. Null runs none.
+		/// Once set returns the previous pipeline's sinks are not called again, so it must not be
+		/// set from one of them.
+		/// </summary>
+		property FrameProcessingPipeline^ Pipeline
+		{
+			FrameProcessingPipeline^ get();
+			void set( FrameProcessingPipeline^ value );
+		}
+		#pragma endregion
+
+		#pragma region Frame Bus
+		/// <summary>
+		/// Publishes every captured frame into a named shared memory ring of slotCount slots of
+		/// slotSize bytes, which FrameBusReader opens from any process. Frames larger than a slot
+		/// are skipped. Replaces a bus already open.
+		/// </summary>
+		void OpenFrameBus( String^ name, int slotCount, int slotSize );
+
+		/// <summary>
+		/// Stops publishing; readers keep their mapping until they close it
+		/// </summary>
+		void CloseFrameBus();
+
+		/// <summary>
+		/// Frames too large for a slot of the open bus
+		/// </summary>
+		property int FrameBusDroppedFrames
+		{
+			int get();
+		}
+		#pragma endregion
+
 		/// <summary>
 		/// Stops the currently running camera and cleans up any global resources
 		/// </summary>
@@ -323,6 +716,20 @@ namespace WebCamLib
 		/// </summary>
 		GCHandle ppCaptureCallback;
 
+		/// <summary>
+		/// Native entry point for pooled frames, kept alive by ppFrameCallback
+		/// </summary>
+		delegate void FrameBufferCallbackDelegate( IntPtr pFrame );
+
+		GCHandle ppFrameCallback;
+
+		FrameCaptureDelegate^ frameCaptureHandlers;
+
+		/// <summary>
+		/// Wraps a pooled buffer for the duration of the OnFrameCapture handlers
+		/// </summary>
+		void OnFrameBuffer( IntPtr pFrame );
+
 		/// <summary>
 		/// Initialize information about webcams installed on machine
 		/// </summary>
@@ -333,6 +740,11 @@ namespace WebCamLib
 		/// </summary>
 		bool disposed;
 
+		/// <summary>
+		/// Throws ObjectDisposedException once disposed, for the members which reach the session
+		/// </summary>
+		void ThrowIfDisposed();
+
 		/// <summary>
 		/// Which camera is running? -1 for none
 		/// </summary>
@@ -348,12 +760,200 @@ namespace WebCamLib
 		/// </summary>
 		HRESULT ConfigureSampleGrabber(IBaseFilter *pIBaseFilter);
 
-		HRESULT SetCaptureFormat(IBaseFilter* pCap, int width, int height, int bpp );
+		HRESULT SetCaptureFormat(int camIndex, IBaseFilter* pCap, const FormatRequest& request);
+
+		LONGLONG GetNegotiatedFrameInterval();
+
+		/// <summary>
+		/// Builds the whole capture graph for a camera
+		/// </summary>
+		HRESULT BuildGraph(int camIndex, const FormatRequest& request, interior_ptr<int> width, interior_ptr<int> height, interior_ptr<int> bpp);
+
+		/// <summary>
+		/// Reconnects a warm graph in another format
+		/// </summary>
+		HRESULT ReconnectGraph(int camIndex, const FormatRequest& request, interior_ptr<int> width, interior_ptr<int> height, interior_ptr<int> bpp);
+
+		HRESULT ReadConnectedFormat(interior_ptr<int> width, interior_ptr<int> height, interior_ptr<int> bpp);
+
+		/// <summary>
+		/// Releases the capture graph, warm or not
+		/// </summary>
+		void ReleaseGraph();
+
+		bool keepSessionWarm;
+
+		CaptureStartKind lastStartKind;
+
+		double lastStartDuration;
+
+		/// <summary>
+		/// Attaches the exposure controller to the running camera, or detaches it, to match the enabled flags
+		/// </summary>
+		void UpdateExposureControl();
+
+		/// <summary>
+		/// Marks the picture controls the started camera lacks for software emulation
+		/// </summary>
+		void UpdateToneEmulation();
+
+		/// <summary>
+		/// Hands the capture thread placement to the grabber, to be applied on its next frame
+		/// </summary>
+		void QueueCaptureThreadPlacement();
+
+		ThreadPlacementOptions^ captureThreadPlacement;
+
+		static ThreadPlacementOptions^ workerThreadPlacement;
+
+		FrameProcessingPipeline^ pipeline;
+
+		/// <summary>
+		/// Held by StartCamera, StopCamera and RestartStream. The watchdog only tries for it, and
+		/// skips a look rather than wait on a graph being built.
+		/// </summary>
+		Object^ sessionLock;
+
+		/// <summary>
+		/// Context of the thread which last started the camera, which automatic restarts are posted
+		/// to; null when that thread has none
+		/// </summary>
+		System::Threading::SynchronizationContext^ ownerContext;
+
+		/// <summary>
+		/// An automatic restart is posted to ownerContext and has not run yet
+		/// </summary>
+		bool restartPosted;
+
+		System::Threading::Timer^ streamWatchdog;
+
+		bool streamWatchdogEnabled;
+
+		int streamStallTimeout;
+
+		int streamFrozenTimeout;
+
+		bool autoRestartStream;
+
+		StreamState streamState;
+
+		/// <summary>
+		/// New pictures the stream had delivered when it was last found stalled or frozen
+		/// </summary>
+		int streamStateChanges;
+
+		int streamRestartCount;
+
+		/// <summary>
+		/// Creates, reschedules or disposes of the watchdog timer, and tells the capture thread
+		/// whether frames need fingerprinting, to match the stream health settings
+		/// </summary>
+		void UpdateStreamWatchdog();
+
+		void OnStreamWatchdog( Object^ state );
+
+		/// <summary>
+		/// Runs on the owner's thread: restarts the camera unless it was stopped, or came back by
+		/// itself, since the restart was posted
+		/// </summary>
+		void OnRestartPosted( Object^ state );
+
+		/// <summary>
+		/// Graph and capture state of this instance's camera
+		/// </summary>
+		CaptureSession* pSession;
+
+		/// <summary>
+		/// Cameras found by RefreshCameraList, MAX_CAMERAS entries
+		/// </summary>
+		CameraInfoStruct* aCameraInfo;
 	};
 
 	// Forward declarations of callbacks
 	typedef void (__stdcall *PFN_CaptureCallback)(DWORD dwSize, BYTE* pbData);
-	PFN_CaptureCallback g_pfnCaptureCallback = NULL;
+
+	// Pooled frame delivery, only taken while OnFrameCapture has handlers
+	typedef void (__stdcall *PFN_FrameCallback)(FrameBuffer* pFrame);
+
+	/// <summary>
+	/// Everything one camera needs while it captures. Each CameraMethods owns one, so several
+	/// cameras can run side by side; the capture thread reaches it through its SampleGrabberCB.
+	/// </summary>
+	struct CaptureSession
+	{
+		CaptureSession();
+		~CaptureSession();
+
+		// Capture graph
+		IGraphBuilder* pGraphBuilder;
+		IMediaControl* pMediaControl;
+		ICaptureGraphBuilder2* pCaptureGraphBuilder;
+		IBaseFilter* pIBaseFilterCam;
+		IBaseFilter* pIBaseFilterSampleGrabber;
+		IBaseFilter* pIBaseFilterNullRenderer;
+
+		// Camera whose graph KeepSessionWarm left paused, -1 for none, and the format it was started with
+		int nWarmCameraIndex;
+		FormatRequest warmRequest;
+
+		// Frame interval the running camera was set to, 100 ns units, 0 when unknown
+		LONGLONG llCaptureFrameInterval;
+
+		PFN_CaptureCallback pfnCaptureCallback;
+		PFN_FrameCallback pfnFrameCallback;
+		volatile bool bFrameCaptureEnabled;
+		FramePool* pFramePool;
+
+		// Newest pooled frame, for readers polling rather than handling OnFrameCapture. Neither
+		// Pause nor Stop waits for a BufferCB already running, so the capture thread counts itself
+		// in while it publishes; StopCamera closes the slot and waits for the count to drop before
+		// clearing it.
+		LatestFrameSlot* pLatestFrame;
+		volatile LONG bLatestFrameOpen;
+		volatile LONG nLatestFrameUsers;
+
+		// Shared memory fan-out to other processes. The capture thread counts itself in while it
+		// publishes, so CloseFrameBus can swap the writer out and wait for it to be let go.
+		FrameBusWriter* volatile pFrameBus;
+		volatile LONG nFrameBusUsers;
+
+		// Format of the running capture, needed to walk the raw buffers
+		int nCaptureWidth;
+		int nCaptureHeight;
+		int nCaptureBitsPerPixel;
+
+		// Per-frame statistics, computed on the capture thread just ahead of the callback
+		volatile bool bStatisticsEnabled;
+		ImageStatisticsCalculator* pStatisticsCalculator;
+		ImageStatistics currentStatistics;
+		bool bCurrentStatisticsValid;
+
+		// Software exposure control, fed from the same statistics while it is attached to a running camera
+		volatile bool bExposureControlActive;
+		ExposureController* pExposureController;
+
+		// Requested state, kept across StartCamera and StopCamera
+		bool bSoftwareExposureEnabled;
+		bool bSoftwareWhiteBalanceEnabled;
+
+		// Picture controls the camera lacks, applied to the buffer on the capture thread; values
+		// are kept across StartCamera and StopCamera
+		ToneMapper* pToneMapper;
+
+		// Placement for the streaming thread, taken and applied by the grabber on its next frame
+		ThreadPlacement* volatile pPendingCapturePlacement;
+
+		// Stages run over every frame before it is delivered. The capture thread counts itself in for
+		// the whole run, so once the pipeline is swapped out and the count drops none of its sinks runs.
+		ProcessingPipeline* volatile pPipeline;
+		volatile LONG nPipelineUsers;
+
+		// Arrival and fingerprint record for the watchdog. Frames are only fingerprinted when
+		// duplicates are suppressed or the watchdog looks for frozen streams.
+		StreamHealth* pStreamHealth;
+		volatile bool bFingerprintFrames;
+		volatile bool bSuppressDuplicates;
+	};
 
 	/// <summary>
 	/// Lightweight SampleGrabber callback interface
@@ -361,9 +961,10 @@ namespace WebCamLib
 	class SampleGrabberCB : public ISampleGrabberCB
 	{
 	public:
-		SampleGrabberCB()
+		SampleGrabberCB(CaptureSession* pSession)
 		{
 			m_nRefCount = 0;
+			m_pSession = pSession;
 		}
 
 		virtual HRESULT STDMETHODCALLTYPE SampleCB(double SampleTime, IMediaSample *pSample)
@@ -373,9 +974,108 @@ namespace WebCamLib
 
 		virtual HRESULT STDMETHODCALLTYPE BufferCB(double SampleTime, BYTE *pBuffer, long BufferLen)
 		{
-			if (g_pfnCaptureCallback != NULL)
+			LARGE_INTEGER liArrival;
+			QueryPerformanceCounter(&liArrival);
+
+			CaptureSession& session = *m_pSession;
+
+			if (session.pPendingCapturePlacement != NULL)
+			{
+				ThreadPlacement* pPlacement = static_cast<ThreadPlacement*>(InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&session.pPendingCapturePlacement), NULL));
+				if (pPlacement != NULL)
+				{
+					ApplyThreadPlacement(GetCurrentThread(), *pPlacement, -1);
+					delete pPlacement;
+				}
+			}
+
+			// Ahead of everything else, so a repeated picture costs no more than its sample
+			if (session.pStreamHealth != NULL)
+			{
+				bool bDuplicate = session.pStreamHealth->Observe(pBuffer, static_cast<DWORD>(BufferLen), session.bFingerprintFrames, GetTickCount());
+				if (bDuplicate && session.bSuppressDuplicates)
+				{
+					return S_OK;
+				}
+			}
+
+			if ((session.bStatisticsEnabled || session.bExposureControlActive) && session.pStatisticsCalculator != NULL)
+			{
+				int nStride = ((session.nCaptureWidth * session.nCaptureBitsPerPixel + 31) / 32) * 4;
+				session.bCurrentStatisticsValid = session.pStatisticsCalculator->Compute(pBuffer, session.nCaptureWidth, abs(session.nCaptureHeight), nStride, session.nCaptureBitsPerPixel, &session.currentStatistics);
+			}
+			else
+			{
+				session.bCurrentStatisticsValid = false;
+			}
+
+			if (session.bExposureControlActive && session.bCurrentStatisticsValid)
+			{
+				session.pExposureController->Update(session.currentStatistics, GetTickCount());
+			}
+
+			// After the statistics, so exposure control works from what the sensor delivered
+			if (session.pToneMapper != NULL)
+			{
+				int nStride = ((session.nCaptureWidth * session.nCaptureBitsPerPixel + 31) / 32) * 4;
+				session.pToneMapper->Apply(pBuffer, session.nCaptureWidth, abs(session.nCaptureHeight), nStride, session.nCaptureBitsPerPixel);
+			}
+
+			if (session.pfnCaptureCallback != NULL)
+			{
+				session.pfnCaptureCallback(BufferLen, pBuffer);
+			}
+
+			bool bDeliverFrame = session.bFrameCaptureEnabled && session.pfnFrameCallback != NULL;
+
+			if (bDeliverFrame || session.pFrameBus != NULL || session.pPipeline != NULL)
 			{
-				g_pfnCaptureCallback(BufferLen, pBuffer);
+				// The grabber reuses pBuffer once we return, so this is the one copy a frame needs
+				FrameBuffer* pFrame = session.pFramePool->Acquire(session.nCaptureWidth, session.nCaptureHeight, session.nCaptureBitsPerPixel);
+				if (pFrame != NULL)
+				{
+					DWORD dwSize = min(static_cast<DWORD>(BufferLen), pFrame->GetSize());
+					CopyMemory(pFrame->GetData(), pBuffer, dwSize);
+					pFrame->SetTimestamp(liArrival.QuadPart, SampleTime);
+					pFrame->SetStatistics(session.bStatisticsEnabled && session.bCurrentStatisticsValid ? &session.currentStatistics : NULL);
+
+					// Consumers get the main chain's output; a frame it failed on goes nowhere
+					InterlockedIncrement(&session.nPipelineUsers);
+					ProcessingPipeline* pPipeline = session.pPipeline;
+					if (pPipeline != NULL)
+					{
+						FrameBuffer* pOutput = pPipeline->Run(pFrame);
+						pFrame->Release();
+						pFrame = pOutput;
+					}
+					InterlockedDecrement(&session.nPipelineUsers);
+				}
+
+				if (pFrame != NULL)
+				{
+					// Never waits on readers; if they have every spare slot pinned the frame is only skipped there
+					InterlockedIncrement(&session.nLatestFrameUsers);
+					if (session.bLatestFrameOpen && session.pLatestFrame != NULL)
+					{
+						session.pLatestFrame->Publish(pFrame);
+					}
+					InterlockedDecrement(&session.nLatestFrameUsers);
+
+					InterlockedIncrement(&session.nFrameBusUsers);
+					FrameBusWriter* pFrameBus = session.pFrameBus;
+					if (pFrameBus != NULL)
+					{
+						pFrameBus->Publish(pFrame);
+					}
+					InterlockedDecrement(&session.nFrameBusUsers);
+
+					if (bDeliverFrame)
+					{
+						session.pfnFrameCallback(pFrame);
+					}
+
+					pFrame->Release();
+				}
 			}
 
 			return S_OK;
@@ -403,5 +1103,6 @@ namespace WebCamLib
 
 	private:
 		int m_nRefCount;
+		CaptureSession* m_pSession;
 	};
 }
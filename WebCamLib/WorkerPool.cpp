@@ -0,0 +1,200 @@
+//*****************************************************************************************
+//  File:       WorkerPool.cpp
+//  Project:    WebcamLib
+//
+//  Defines a small native fork/join thread pool used by the image kernels
+//*****************************************************************************************
+
+#include <windows.h>
+
+#include "ThreadPlacement.h"
+#include "WorkerPool.h"
+
+#pragma managed(push, off)
+
+using namespace WebCamLib;
+
+// Index parked in m_llNextItem between jobs so a late waking thread never claims an item
+#define CLOSED_ITEM_INDEX LONG_MAX
+
+// m_llNextItem holds the job's generation in its upper half and the next item in its lower half
+#define MAKE_ITEM_CLAIM(nGeneration, nItem) ((static_cast<LONGLONG>(nGeneration) << 32) | static_cast<ULONG>(nItem))
+#define CLAIM_ITEM(llClaim) static_cast<LONG>((llClaim) & 0xffffffff)
+
+static WorkerPool* volatile g_pSharedWorkerPool = NULL;
+
+WorkerPool::WorkerPool(int nThreads)
+{
+	if (nThreads <= 0)
+	{
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		nThreads = static_cast<int>(si.dwNumberOfProcessors) - 1;
+	}
+
+	m_nThreads = 0;
+	m_phThreads = NULL;
+	m_pfnProc = NULL;
+	m_pContext = NULL;
+	m_nItems = 0;
+	m_nGeneration = 0;
+	m_llNextItem = MAKE_ITEM_CLAIM(0, CLOSED_ITEM_INDEX);
+	m_nPendingItems = 0;
+	m_bShutdown = FALSE;
+
+	InitializeCriticalSection(&m_csRun);
+	m_hWorkAvailable = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+	m_hWorkDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (nThreads > 0 && m_hWorkAvailable != NULL && m_hWorkDone != NULL)
+	{
+		m_phThreads = new HANDLE[nThreads];
+		for (int n = 0; n < nThreads; n++)
+		{
+			HANDLE hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+			if (hThread == NULL)
+				break;
+
+			m_phThreads[m_nThreads++] = hThread;
+		}
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	InterlockedExchange(&m_bShutdown, TRUE);
+
+	if (m_nThreads > 0)
+	{
+		ReleaseSemaphore(m_hWorkAvailable, m_nThreads, NULL);
+		WaitForMultipleObjects(m_nThreads, m_phThreads, TRUE, INFINITE);
+
+		for (int n = 0; n < m_nThreads; n++)
+		{
+			CloseHandle(m_phThreads[n]);
+		}
+	}
+
+	delete [] m_phThreads;
+
+	if (m_hWorkAvailable != NULL)
+		CloseHandle(m_hWorkAvailable);
+
+	if (m_hWorkDone != NULL)
+		CloseHandle(m_hWorkDone);
+
+	DeleteCriticalSection(&m_csRun);
+}
+
+WorkerPool* WorkerPool::GetShared()
+{
+	if (g_pSharedWorkerPool == NULL)
+	{
+		WorkerPool* pPool = new WorkerPool();
+		if (InterlockedCompareExchangePointer((PVOID volatile*)&g_pSharedWorkerPool, pPool, NULL) != NULL)
+		{
+			// Lost the race, somebody else installed theirs first
+			delete pPool;
+		}
+	}
+
+	return g_pSharedWorkerPool;
+}
+
+void WorkerPool::Run(WorkItemProc pfnProc, void* pContext, int nItems)
+{
+	if (nItems <= 0)
+		return;
+
+	// Nothing to fan out, keep it on the calling thread
+	if (nItems == 1 || m_nThreads == 0)
+	{
+		for (int n = 0; n < nItems; n++)
+		{
+			pfnProc(pContext, n);
+		}
+		return;
+	}
+
+	EnterCriticalSection(&m_csRun);
+
+	m_pfnProc = pfnProc;
+	m_pContext = pContext;
+	m_nItems = nItems;
+	m_nPendingItems = nItems;
+	ResetEvent(m_hWorkDone);
+
+	// Opening the job is the barrier which publishes the fields above to the workers. The new
+	// generation keeps a claim a worker read during an earlier job from passing for one of this job.
+	m_nGeneration++;
+	InterlockedExchange64(&m_llNextItem, MAKE_ITEM_CLAIM(m_nGeneration, 0));
+
+	ReleaseSemaphore(m_hWorkAvailable, min(m_nThreads, nItems - 1), NULL);
+
+	DrainItems();
+
+	WaitForSingleObject(m_hWorkDone, INFINITE);
+
+	InterlockedExchange64(&m_llNextItem, MAKE_ITEM_CLAIM(m_nGeneration, CLOSED_ITEM_INDEX));
+
+	LeaveCriticalSection(&m_csRun);
+}
+
+HRESULT WorkerPool::SetPlacement(const ThreadPlacement& placement)
+{
+	HRESULT hr = S_OK;
+
+	for (int n = 0; n < m_nThreads && SUCCEEDED(hr); n++)
+	{
+		hr = ApplyThreadPlacement(m_phThreads[n], placement, n);
+	}
+
+	return hr;
+}
+
+void WorkerPool::DrainItems()
+{
+	for (;;)
+	{
+		// Read as one, since a 32 bit process cannot load the two halves together otherwise
+		LONGLONG llClaim = InterlockedCompareExchange64(&m_llNextItem, 0, 0);
+		LONG nItem = CLAIM_ITEM(llClaim);
+
+		// These may already belong to a later job; they are only used once the exchange below
+		// proves the claim's job was still open after they were read. Stopping early on a stale
+		// count is harmless, as the thread in Run() drains what is left.
+		WorkItemProc pfnProc = m_pfnProc;
+		void* pContext = m_pContext;
+		LONG nItems = m_nItems;
+
+		if (nItem >= nItems)
+			break;
+
+		if (InterlockedCompareExchange64(&m_llNextItem, llClaim + 1, llClaim) != llClaim)
+			continue;
+
+		pfnProc(pContext, nItem);
+
+		if (InterlockedDecrement(&m_nPendingItems) == 0)
+		{
+			SetEvent(m_hWorkDone);
+		}
+	}
+}
+
+DWORD WINAPI WorkerPool::ThreadProc(LPVOID pParameter)
+{
+	WorkerPool* pPool = static_cast<WorkerPool*>(pParameter);
+
+	while (WaitForSingleObject(pPool->m_hWorkAvailable, INFINITE) == WAIT_OBJECT_0)
+	{
+		if (pPool->m_bShutdown)
+			break;
+
+		pPool->DrainItems();
+	}
+
+	return 0;
+}
+
+#pragma managed(pop)
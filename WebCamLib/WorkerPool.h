@@ -0,0 +1,81 @@
+//*****************************************************************************************
+//  File:       WorkerPool.h
+//  Project:    WebcamLib
+//
+//  Declares a small native fork/join thread pool used by the image kernels
+//*****************************************************************************************
+
+#pragma once
+
+#pragma managed(push, off)
+
+namespace WebCamLib
+{
+	struct ThreadPlacement;
+
+	/// <summary>
+	/// Fixed set of native worker threads which execute indexed work items in parallel.
+	/// Run() blocks until every item has completed; the calling thread takes part in the work.
+	/// </summary>
+	class WorkerPool
+	{
+	public:
+		typedef void (*WorkItemProc)(void* pContext, int nItem);
+
+		/// <summary>
+		/// Creates the pool; a thread count of zero uses one thread less than the processor count
+		/// </summary>
+		explicit WorkerPool(int nThreads = 0);
+
+		~WorkerPool();
+
+		/// <summary>
+		/// Number of threads taking part in Run(), including the caller
+		/// </summary>
+		int GetConcurrency() const
+		{
+			return m_nThreads + 1;
+		}
+
+		/// <summary>
+		/// Executes pfnProc(pContext, n) for n in [0, nItems) and waits for all of them
+		/// </summary>
+		void Run(WorkItemProc pfnProc, void* pContext, int nItems);
+
+		/// <summary>
+		/// Applies a placement to the pool's own threads, numbering their names. The thread calling
+		/// Run() also works on the items and keeps its own placement.
+		/// </summary>
+		HRESULT SetPlacement(const ThreadPlacement& placement);
+
+		/// <summary>
+		/// Process-wide pool shared by kernels which do not own one
+		/// </summary>
+		static WorkerPool* GetShared();
+
+	private:
+		WorkerPool(const WorkerPool&);
+		WorkerPool& operator=(const WorkerPool&);
+
+		static DWORD WINAPI ThreadProc(LPVOID pParameter);
+
+		void DrainItems();
+
+		HANDLE* m_phThreads;
+		int m_nThreads;
+
+		HANDLE m_hWorkAvailable;
+		HANDLE m_hWorkDone;
+		CRITICAL_SECTION m_csRun;
+
+		WorkItemProc volatile m_pfnProc;
+		void* volatile m_pContext;
+		volatile LONG m_nItems;
+		ULONG m_nGeneration;
+		volatile LONGLONG m_llNextItem;
+		volatile LONG m_nPendingItems;
+		volatile LONG m_bShutdown;
+	};
+}
+
+#pragma managed(pop)
@@ -2,7 +2,7 @@
 using System.Collections.Generic;
 using System.Drawing;
 using System.Drawing.Imaging;
-using System.Runtime.InteropServices;
+using Touchless.Vision.Contracts;
 using WebCamLib;
 
 namespace Touchless.Vision.Camera
@@ -18,8 +18,8 @@ namespace Touchless.Vision.Camera
       FocalLength_mm = WebCamLib.CameraProperty.FocalLength_mm,
       Flash = WebCamLib.CameraProperty.Flash,
       Brightness = WebCamLib.CameraProperty.Brightness,
-      Contrast = WebCamLib.CameraProperty.Brightness,
-      Hue = WebCamLib.CameraProperty.Contrast,
+      Contrast = WebCamLib.CameraProperty.Contrast,
+      Hue = WebCamLib.CameraProperty.Hue,
       Saturation = WebCamLib.CameraProperty.Saturation,
       Sharpness = WebCamLib.CameraProperty.Sharpness,
       Gamma = WebCamLib.CameraProperty.Gamma,
@@ -509,6 +509,9 @@ namespace Touchless.Vision.Camera
       private readonly CameraMethods _cameraMethods;
       private RotateFlipType _rotateFlip = RotateFlipType.RotateNoneFlipNone;
 
+      /// <summary>
+      /// The camera takes ownership of its capture session, cameraMethods, and disposes it with itself
+      /// </summary>
       public Camera( CameraMethods cameraMethods, string name, int index )
       {
          _name = name;
@@ -517,7 +520,7 @@ namespace Touchless.Vision.Camera
          lock( CameraMethodsLock )
          {
             _cameraMethods = cameraMethods;
-            _cameraMethods.OnImageCapture += CaptureCallbackProc;
+            _cameraMethods.OnStreamStateChanged += StreamStateProc;
          }
       }
 
@@ -575,6 +578,49 @@ namespace Touchless.Vision.Camera
          }
       }
 
+      /// <summary>
+      /// Frame rate to ask the camera for when capture starts, 0 for the fastest the chosen format offers,
+      /// or for the driver's default rate when FormatPreference is Exact
+      /// </summary>
+      public double CaptureFrameRate
+      {
+         get
+         {
+            return _captureFps;
+         }
+         set
+         {
+            _captureFps = value;
+         }
+      }
+
+      /// <summary>
+      /// How the capture format is chosen when none has the requested size and frame rate at once.
+      /// Exact keeps the driver's default format and rate unless the size matches exactly.
+      /// </summary>
+      public FormatPreference FormatPreference
+      {
+         get
+         {
+            return _formatPreference;
+         }
+         set
+         {
+            _formatPreference = value;
+         }
+      }
+
+      /// <summary>
+      /// Frame rate the camera was set to when capture started, 0 when the driver does not tell
+      /// </summary>
+      public double NegotiatedFrameRate
+      {
+         get
+         {
+            return _negotiatedFps;
+         }
+      }
+
       /// <summary>
       /// Defines the bits per pixel of image captured.
       /// </summary>
@@ -591,6 +637,340 @@ namespace Touchless.Vision.Camera
          }
       }
 
+      /// <summary>
+      /// Computes histograms, exposure and sharpness figures for every frame in the native layer
+      /// and attaches them to the captured frames
+      /// </summary>
+      public bool ComputeStatistics
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.StatisticsEnabled;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.StatisticsEnabled = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Distance in pixels between the samples the frame statistics are computed from
+      /// </summary>
+      public int StatisticsGridStep
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.StatisticsGridStep;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.StatisticsGridStep = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Replaces the camera's own auto-exposure with a control loop driven by the luma of each frame
+      /// </summary>
+      public bool SoftwareExposure
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.SoftwareExposureEnabled;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.SoftwareExposureEnabled = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Replaces the camera's own white balance with a grey world control loop
+      /// </summary>
+      public bool SoftwareWhiteBalance
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.SoftwareWhiteBalanceEnabled;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.SoftwareWhiteBalanceEnabled = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Mean luma, 0 to 255, the software exposure aims for
+      /// </summary>
+      public double ExposureTarget
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.ExposureTargetLuma;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.ExposureTargetLuma = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Keeps the capture graph paused between StopCapture and StartCapture, so restarting the same
+      /// camera skips building it again; only a new capture size makes it reconnect
+      /// </summary>
+      public bool KeepSessionWarm
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.KeepSessionWarm;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.KeepSessionWarm = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Milliseconds the last StartCapture took to get the camera running
+      /// </summary>
+      public double LastStartDuration
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.LastStartDuration;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Whether the last StartCapture built the graph, resumed it or reconnected it for a new format
+      /// </summary>
+      public CaptureStartKind LastStartKind
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.LastStartKind;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Processors, priority and name for the thread delivering this camera's frames, which also
+      /// runs every OnImageCaptured handler; null leaves the thread to DirectShow
+      /// </summary>
+      public ThreadPlacementOptions CaptureThreadPlacement
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.CaptureThreadPlacement;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.CaptureThreadPlacement = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Native stages run over every frame before it reaches this camera's handlers, e.g. to
+      /// convert, mirror or fan frames out to a recorder; null runs none
+      /// </summary>
+      public FrameProcessingPipeline Pipeline
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.Pipeline;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.Pipeline = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Drops frames repeating the last picture before OnImageCaptured sees them
+      /// </summary>
+      public bool SuppressDuplicateFrames
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.SuppressDuplicateFrames;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.SuppressDuplicateFrames = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Watches the running capture for stalls and frozen pictures, raising OnStreamStateChanged
+      /// </summary>
+      public bool StreamWatchdog
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.StreamWatchdogEnabled;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.StreamWatchdogEnabled = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Milliseconds without a frame before the capture counts as stalled
+      /// </summary>
+      public int StallTimeout
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.StreamStallTimeout;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.StreamStallTimeout = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Milliseconds of one repeated picture before the capture counts as frozen, 0 for never
+      /// </summary>
+      public int FrozenTimeout
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.StreamFrozenTimeout;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.StreamFrozenTimeout = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// Restarts a stalled or frozen capture in the size it was started with, on the thread which
+      /// started it, through its SynchronizationContext. Where that thread has none, handle
+      /// OnStreamStateChanged and call RestartCapture from it instead.
+      /// </summary>
+      public bool AutoRestart
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.AutoRestartStream;
+            }
+         }
+
+         set
+         {
+            lock( CameraMethodsLock )
+            {
+               _cameraMethods.AutoRestartStream = value;
+            }
+         }
+      }
+
+      /// <summary>
+      /// What the watchdog last made of the capture
+      /// </summary>
+      public StreamState StreamState
+      {
+         get
+         {
+            lock( CameraMethodsLock )
+            {
+               return _cameraMethods.CurrentStreamState;
+            }
+         }
+      }
+
       public bool HasFrameLimit
       {
          get
@@ -684,29 +1064,105 @@ namespace Touchless.Vision.Camera
       /// </summary>
       public void Dispose()
       {
+         lock( CameraMethodsLock )
+         {
+            if( _disposed )
+            {
+               return;
+            }
+
+            _disposed = true;
+         }
+
          StopCapture();
+
+         lock( CameraMethodsLock )
+         {
+            if( _cameraMethods.WarmCameraIndex == _index )
+            {
+               _cameraMethods.ReleaseSession();
+            }
+
+            _cameraMethods.OnStreamStateChanged -= StreamStateProc;
+            _cameraMethods.Dispose();
+         }
       }
 
       #endregion
 
+      /// <summary>
+      /// Starts the running capture again from a new graph, in the size it was started with.
+      /// Call it from the thread which started the capture.
+      /// </summary>
+      public void RestartCapture()
+      {
+         lock( CameraMethodsLock )
+         {
+            _cameraMethods.RestartStream();
+         }
+      }
+
       /// <summary>
       /// Returns the last image acquired from the camera
       /// </summary>
       /// <returns>A bitmap of the last image acquired from the camera</returns>
       public Bitmap GetCurrentImage()
       {
-         Bitmap b = null;
-         lock( _bitmapLock )
+         using( PooledFrame frame = GetCurrentFrame() )
          {
-            if( _bitmap == null )
+            if( frame == null )
             {
                return null;
             }
 
-            b = new Bitmap( _bitmap );
+            using( Bitmap view = Frame.CreateView( frame, _rotateFlip ) )
+            {
+               return new Bitmap( view );
+            }
+         }
+      }
+
+      /// <summary>
+      /// Returns a reference on the last frame acquired from the camera, without copying it
+      /// </summary>
+      /// <returns>The frame, to be disposed by the caller, or null when the camera is not capturing</returns>
+      public PooledFrame GetCurrentFrame()
+      {
+         // Lock free: the capture thread keeps publishing while readers take their references
+         if( _cameraMethods.ActiveCameraIndex != _index )
+         {
+            return null;
          }
 
-         return b;
+         return _cameraMethods.GetLatestFrame();
+      }
+
+      /// <summary>
+      /// Publishes the captured frames through shared memory, for FrameBusReader to pick up in other
+      /// processes without a copy per reader. Slots are sized for the current capture format.
+      /// </summary>
+      /// <param name="name">Name of the bus, such as "Local\Camera0"</param>
+      /// <param name="slotCount">Frames the ring holds; more slots give slow readers longer to finish with one</param>
+      public void OpenFrameBus( string name, int slotCount )
+      {
+         int bitsPerPixel = _bpp == IgnoredBitsPerPixel ? 32 : _bpp;
+         int stride = ( ( _width * bitsPerPixel + 31 ) / 32 ) * 4;
+
+         lock( CameraMethodsLock )
+         {
+            _cameraMethods.OpenFrameBus( name, slotCount, stride * _height );
+         }
+      }
+
+      /// <summary>
+      /// Stops publishing frames to the bus opened by OpenFrameBus
+      /// </summary>
+      public void CloseFrameBus()
+      {
+         lock( CameraMethodsLock )
+         {
+            _cameraMethods.CloseFrameBus();
+         }
       }
 
       public void ShowPropertiesDialog()
@@ -738,6 +1194,17 @@ namespace Touchless.Vision.Camera
          return result;
       }
 
+      /// <summary>
+      /// True when the camera lacks the property and it is applied to the frames in software instead
+      /// </summary>
+      public bool IsCameraPropertyEmulated( CameraProperty property )
+      {
+         lock( CameraMethodsLock )
+         {
+            return _cameraMethods.IsPropertyEmulated( ( WebCamLib.CameraProperty ) property );
+         }
+      }
+
       public bool SetCameraProperty( CameraProperty property, CameraPropertyValue value )
       {
          bool result;
@@ -960,11 +1427,50 @@ namespace Touchless.Vision.Camera
          }
       }
 
+      /// <summary>
+      /// Returns the requested size when the camera offers it, otherwise the smallest size covering it
+      /// </summary>
+      /// <param name="colorDepth">Bits per pixel, or -1 for any</param>
+      /// <returns>The size, or null when the camera has nothing that large</returns>
+      public CaptureSize FindCaptureSize( int width, int height, int colorDepth )
+      {
+         Tuple<int, int, int> size;
+
+         lock( CameraMethodsLock )
+         {
+            size = _cameraMethods.FindCaptureSize( _index, width, height, colorDepth );
+         }
+
+         return size != null ? new CaptureSize( size.Item1, size.Item2, size.Item3 ) : null;
+      }
+
+      /// <summary>
+      /// Highest frame rate the camera offers at a size, 0 when it does not offer the size
+      /// </summary>
+      public double GetMaximumFrameRate( CaptureSize size )
+      {
+         if( size == null )
+         {
+            throw new ArgumentNullException( "size" );
+         }
+
+         lock( CameraMethodsLock )
+         {
+            return _cameraMethods.GetMaximumFrameRate( _index, size.Width, size.Height, size.ColorDepth );
+         }
+      }
+
       /// <summary>
       /// Event fired when an image from the camera is captured
       /// </summary>
       public event EventHandler<CameraEventArgs> OnImageCaptured;
 
+      /// <summary>
+      /// Event fired on a timer thread when the watchdog finds the capture stalled, frozen or healthy again.
+      /// Marshal to the thread which started the capture before stopping or restarting it.
+      /// </summary>
+      public event EventHandler<StreamStateEventArgs> OnStreamStateChanged;
+
       /// <summary>
       /// Returns the camera name as the ToString implementation
       /// </summary>
@@ -976,10 +1482,25 @@ namespace Touchless.Vision.Camera
 
       #region Internal Implementation
 
-      private readonly object _bitmapLock = new object();
+      internal int Index
+      {
+         get
+         {
+            return _index;
+         }
+      }
+
+      internal bool IsDisposed
+      {
+         get
+         {
+            return _disposed;
+         }
+      }
+
       private readonly int _index;
       private readonly string _name;
-      private Bitmap _bitmap;
+      private volatile bool _disposed;
       private DateTime _dtLastCap = DateTime.MinValue;
       private int _fpslimit = -1;
       private int _height = 240;
@@ -987,6 +1508,9 @@ namespace Touchless.Vision.Camera
       private double _timeBetweenFrames;
       private int _width = 320;
       private int _bpp = 24;
+      private double _captureFps;
+      private double _negotiatedFps;
+      private FormatPreference _formatPreference = FormatPreference.Exact;
 
       internal bool StartCapture()
       {
@@ -994,7 +1518,15 @@ namespace Touchless.Vision.Camera
 
          lock( CameraMethodsLock )
          {
-            _cameraMethods.StartCamera( _index, ref _width, ref _height, ref _bpp, ref result );
+            _cameraMethods.OnFrameCapture += FrameCaptureProc;
+            double fps = _captureFps;
+            _cameraMethods.StartCamera( _index, ref _width, ref _height, ref _bpp, ref fps, _formatPreference, ref result );
+            _negotiatedFps = result ? fps : 0.0;
+
+            if( !result )
+            {
+               _cameraMethods.OnFrameCapture -= FrameCaptureProc;
+            }
          }
 
          return result;
@@ -1005,42 +1537,18 @@ namespace Touchless.Vision.Camera
          lock( CameraMethodsLock )
          {
             _cameraMethods.StopCamera();
+            _cameraMethods.OnFrameCapture -= FrameCaptureProc;
          }
       }
 
       /// <summary>
-      /// Here is where the images come in as they are collected, as fast as they can and on a background thread
+      /// Here is where the frames come in as they are collected, as fast as they can and on a background thread.
+      /// The frame stays in its native buffer; nothing is copied unless a consumer asks for a Bitmap.
       /// </summary>
-      private void CaptureCallbackProc( int dataSize, byte[] data )
-      {
-         // Do the magic to create a bitmap
-         int stride = _width * 3;
-         GCHandle handle = GCHandle.Alloc( data, GCHandleType.Pinned );
-         var scan0 = handle.AddrOfPinnedObject();
-         scan0 += ( _height - 1 ) * stride;
-         var b = new Bitmap( _width, _height, -stride, PixelFormat.Format24bppRgb, scan0 );
-         b.RotateFlip( _rotateFlip );
-         // NOTE: It seems that bntr has made that resolution property work properly
-         var copyBitmap = ( Bitmap ) b.Clone();
-         // Copy the image using the Thumbnail function to also resize if needed
-         //var copyBitmap = (Bitmap)b.GetThumbnailImage(_width, _height, null, IntPtr.Zero);
-
-         // Now you can free the handle
-         handle.Free();
-
-         ImageCaptured( copyBitmap );
-      }
-
-      private void ImageCaptured( Bitmap bitmap )
+      private void FrameCaptureProc( PooledFrame frame )
       {
          DateTime dtCap = DateTime.Now;
 
-         // Always save the bitmap
-         lock( _bitmapLock )
-         {
-            _bitmap = bitmap;
-         }
-
          // FPS affects the callbacks only
          if( _fpslimit != -1 )
          {
@@ -1068,31 +1576,94 @@ namespace Touchless.Vision.Camera
          if ( handler != null )
          {
             var fps = ( int ) ( 1 / dtCap.Subtract( _dtLastCap ).TotalSeconds );
-            handler.Invoke( this, new CameraEventArgs( bitmap, fps ) );
+            handler.Invoke( this, new CameraEventArgs( frame, _rotateFlip, fps ) );
          }
 
          _dtLastCap = dtCap;
       }
 
+      private void StreamStateProc( StreamState state )
+      {
+         var handler = OnStreamStateChanged;
+
+         if( handler != null )
+         {
+            handler.Invoke( this, new StreamStateEventArgs( state ) );
+         }
+      }
+
+      #endregion
+   }
+
+   /// <summary>
+   /// The state the stream watchdog found a camera's capture in
+   /// </summary>
+   public class StreamStateEventArgs : EventArgs
+   {
+      public StreamState State
+      {
+         get
+         {
+            return _state;
+         }
+      }
+
+      #region Internal Implementation
+
+      private readonly StreamState _state;
+
+      internal StreamStateEventArgs( StreamState state )
+      {
+         _state = state;
+      }
+
       #endregion
    }
 
    /// <summary>
-   /// Camera specific EventArgs that provides the Image being captured
+   /// Camera specific EventArgs that provides the Image being captured.
+   /// The frame is only valid while the event is being raised.
    /// </summary>
    public class CameraEventArgs : EventArgs
    {
       /// <summary>
-      /// Current Camera Image
+      /// Current Camera Image, copied out of the frame the first time it is asked for during the event
       /// </summary>
       public Bitmap Image
       {
          get
          {
+            if( _image == null )
+            {
+               _image = Contracts.Frame.CreateImage( _frame, _rotateFlip );
+            }
+
             return _image;
          }
       }
 
+      /// <summary>
+      /// The captured frame in its native buffer; call AddReference to keep it beyond the event
+      /// </summary>
+      public PooledFrame Frame
+      {
+         get
+         {
+            return _frame;
+         }
+      }
+
+      /// <summary>
+      /// Rotation and flip the camera applies to its images
+      /// </summary>
+      public RotateFlipType RotateFlip
+      {
+         get
+         {
+            return _rotateFlip;
+         }
+      }
+
       public int CameraFps
       {
          get
@@ -1101,14 +1672,28 @@ namespace Touchless.Vision.Camera
          }
       }
 
+      /// <summary>
+      /// Statistics computed by the native layer, null unless the camera computes statistics
+      /// </summary>
+      public FrameStatistics Statistics
+      {
+         get
+         {
+            return _frame.Statistics;
+         }
+      }
+
       #region Internal Implementation
 
       private readonly int _cameraFps;
-      private readonly Bitmap _image;
+      private readonly PooledFrame _frame;
+      private readonly RotateFlipType _rotateFlip;
+      private Bitmap _image;
 
-      internal CameraEventArgs( Bitmap i, int fps )
+      internal CameraEventArgs( PooledFrame frame, RotateFlipType rotateFlip, int fps )
       {
-         _image = i;
+         _frame = frame;
+         _rotateFlip = rotateFlip;
          _cameraFps = fps;
       }
 
@@ -73,8 +73,18 @@ namespace Touchless.Vision.Camera
             var handler = this.NewFrame;
             if (IsCapturing && handler != null)
             {
-                var frame = new Frame(e.Image);
-                handler(this, frame, e.CameraFps);
+                // Shares the camera's native buffer; pixels are only copied if a consumer asks for Frame.Image.
+                // Handlers keeping the frame took references of their own, so the buffer goes back to the
+                // pool as soon as they return.
+                var frame = new Frame(e.Frame.AddReference(), e.RotateFlip);
+                try
+                {
+                    handler(this, frame, e.CameraFps);
+                }
+                finally
+                {
+                    frame.Dispose();
+                }
             }
         }
 
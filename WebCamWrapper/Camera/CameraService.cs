@@ -8,15 +8,18 @@ using System.ComponentModel.Composition;
 namespace Touchless.Vision.Camera
 {
     public static class CameraService
-    {
+    {
+        private static readonly object _syncObject = new object();
+
+        // Used to enumerate the devices only; every camera has a capture session of its own
         private static WebCamLib.CameraMethods _cameraMethods;
-
+
         private static WebCamLib.CameraMethods CameraMethods
         {
             get
             {
                 if (_cameraMethods == null)
-                {
+                {
                     _cameraMethods = new WebCamLib.CameraMethods();
                 }
 
@@ -31,16 +34,61 @@ namespace Touchless.Vision.Camera
         }
 
         private static List<Camera> _availableCameras;
+
+        /// <summary>
+        /// One camera per device, each created once with its own capture session and kept for later
+        /// calls. A camera its user has disposed is replaced by a new one for the same device.
+        /// </summary>
         public static IList<Camera> AvailableCameras
         {
             get
             {
-                if (_availableCameras == null)
+                lock (_syncObject)
+                {
+                    if (_availableCameras == null)
+                    {
+                        _availableCameras = BuildCameraList().ToList();
+                    }
+                    else
+                    {
+                        for (int i = 0; i < _availableCameras.Count; i++)
+                        {
+                            Camera camera = _availableCameras[i];
+                            if (camera.IsDisposed)
+                            {
+                                _availableCameras[i] = new Camera(new WebCamLib.CameraMethods(), camera.Name, camera.Index);
+                            }
+                        }
+                    }
+
+                    return _availableCameras;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Disposes every camera handed out and the session used to enumerate them. The next call to
+        /// AvailableCameras enumerates the devices again.
+        /// </summary>
+        public static void Dispose()
+        {
+            lock (_syncObject)
+            {
+                if (_availableCameras != null)
                 {
-                    _availableCameras = BuildCameraList().ToList();
+                    foreach (Camera camera in _availableCameras)
+                    {
+                        camera.Dispose();
+                    }
+
+                    _availableCameras = null;
                 }
 
-                return _availableCameras;
+                if (_cameraMethods != null)
+                {
+                    _cameraMethods.Dispose();
+                    _cameraMethods = null;
+                }
             }
         }
 
@@ -49,7 +97,10 @@ namespace Touchless.Vision.Camera
             for (int i = 0; i < CameraMethods.Count; i++)
             {
                 WebCamLib.CameraInfo cameraInfo = CameraMethods.GetCameraInfo(i);
-                yield return new Camera(CameraMethods, cameraInfo.Name, cameraInfo.Index);
+
+                // Every camera gets a capture session of its own, so several can run at once. The
+                // camera owns it and disposes it with itself.
+                yield return new Camera(new WebCamLib.CameraMethods(), cameraInfo.Name, cameraInfo.Index);
             }
         }
     }
@@ -55,10 +55,16 @@ namespace Touchless.Vision.Camera.Configuration
                 if (!_frameWaiting)
                 {
                     _frameWaiting = true;
+
+                    // The preview is drawn after the event returns and releases the frame
+                    Touchless.Vision.Contracts.Frame held = frame.AddReference();
                     Action workAction = delegate
                     {
                         this.labelCameraFPSValue.Content = fps.ToString();
-                        this.imgPreview.Source = frame.OriginalImage.ToBitmapSource();
+                        using (held)
+                        {
+                            this.imgPreview.Source = held.OriginalImage.ToBitmapSource();
+                        }
 
                         lock (_frameSync)
                         {
@@ -0,0 +1,100 @@
+﻿using System;
+using System.Collections.ObjectModel;
+using Touchless.Vision.Contracts;
+
+namespace Touchless.Vision.Capture
+{
+    /// <summary>
+    /// One frame from each source of a <see cref="MultiCameraGroup"/>, taken at about the same time.
+    /// The set holds its own reference to every frame; dispose it to hand the buffers back.
+    /// </summary>
+    public sealed class FrameSet : IDisposable
+    {
+        private readonly ReadOnlyCollection<IFrameSource> _sources;
+        private readonly Frame[] _frames;
+        private readonly long[] _times;
+
+        internal FrameSet(ReadOnlyCollection<IFrameSource> sources, Frame[] frames, long[] times, long timestamp, long sequenceNumber)
+        {
+            _sources = sources;
+            _frames = frames;
+            _times = times;
+            Timestamp = timestamp;
+            SequenceNumber = sequenceNumber;
+
+            long earliest = times[0];
+            long latest = times[0];
+            foreach (long time in times)
+            {
+                earliest = Math.Min(earliest, time);
+                latest = Math.Max(latest, time);
+            }
+
+            Spread = latest - earliest;
+        }
+
+        /// <summary>
+        /// Position of the set in the group's output, counting from 0
+        /// </summary>
+        public long SequenceNumber { get; private set; }
+
+        /// <summary>
+        /// Stopwatch ticks on the group's clock the frames were matched against; every frame is within
+        /// the group's tolerance of it
+        /// </summary>
+        public long Timestamp { get; private set; }
+
+        /// <summary>
+        /// Stopwatch ticks between the earliest and the latest frame of the set
+        /// </summary>
+        public long Spread { get; private set; }
+
+        public int Count
+        {
+            get { return _frames.Length; }
+        }
+
+        /// <summary>
+        /// Sources of the frames, in the order the group was given them
+        /// </summary>
+        public ReadOnlyCollection<IFrameSource> Sources
+        {
+            get { return _sources; }
+        }
+
+        /// <summary>
+        /// The frame of the source at the given position in <see cref="Sources"/>
+        /// </summary>
+        public Frame this[int index]
+        {
+            get { return _frames[index]; }
+        }
+
+        public Frame this[IFrameSource source]
+        {
+            get
+            {
+                int index = _sources.IndexOf(source);
+                if (index < 0) throw new ArgumentException("The source is not part of the set.", "source");
+
+                return _frames[index];
+            }
+        }
+
+        /// <summary>
+        /// Capture time of a frame on the group's clock, i.e. after any clock offset was applied
+        /// </summary>
+        public long GetAlignedTimestamp(int index)
+        {
+            return _times[index];
+        }
+
+        public void Dispose()
+        {
+            foreach (Frame frame in _frames)
+            {
+                frame.Dispose();
+            }
+        }
+    }
+}
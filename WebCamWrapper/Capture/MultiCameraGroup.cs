@@ -0,0 +1,496 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Collections.ObjectModel;
+using System.Diagnostics;
+using System.Threading;
+using Touchless.Vision.Contracts;
+
+namespace Touchless.Vision.Capture
+{
+    /// <summary>
+    /// Captures from several sources at once and pairs their frames up by time. Each source runs on
+    /// its own session and thread; the group keeps a few frames per source and emits a
+    /// <see cref="FrameSet"/> holding, for every source, the frame closest to a common time, as long as
+    /// all of them are within <see cref="Tolerance"/> of it. Frames which cannot be matched any more,
+    /// or which overflow a source's buffer, are released and counted as unmatched.
+    /// </summary>
+    public class MultiCameraGroup : IDisposable
+    {
+        public const int DefaultMaximumBufferedFrames = 4;
+
+        // Frames kept per source for estimating its clock offset
+        private const int OffsetWindow = 32;
+
+        /// <summary>
+        /// Raised on the thread of the source whose frame completed the set. Sets completed on
+        /// different threads may be delivered at the same time; SequenceNumber gives their order.
+        /// The handler owns the set and has to dispose it.
+        /// </summary>
+        public event Action<MultiCameraGroup, FrameSet> FrameSetReady;
+
+        private readonly object _syncObject = new object();
+        private readonly List<SourceState> _states = new List<SourceState>();
+        private ReadOnlyCollection<IFrameSource> _sources = new ReadOnlyCollection<IFrameSource>(new IFrameSource[0]);
+        private long _tolerance;
+        private int _maximumBufferedFrames = DefaultMaximumBufferedFrames;
+        private bool _estimateClockOffsets;
+        private long _frameSetsEmitted;
+        private bool _disposed;
+
+        public MultiCameraGroup()
+        {
+            Tolerance = TimeSpan.FromMilliseconds(10);
+        }
+
+        public MultiCameraGroup(IEnumerable<IFrameSource> sources)
+            : this()
+        {
+            if (sources == null) throw new ArgumentNullException("sources");
+
+            foreach (IFrameSource source in sources)
+            {
+                AddSource(source);
+            }
+        }
+
+        /// <summary>
+        /// Sources of the group, in the order their frames appear in each set
+        /// </summary>
+        public ReadOnlyCollection<IFrameSource> Sources
+        {
+            get { return _sources; }
+        }
+
+        /// <summary>
+        /// How far any frame of a set may be from the set's timestamp
+        /// </summary>
+        public TimeSpan Tolerance
+        {
+            get { return TimeSpan.FromSeconds((double) Interlocked.Read(ref _tolerance) / Stopwatch.Frequency); }
+            set
+            {
+                if (value < TimeSpan.Zero) throw new ArgumentOutOfRangeException("value", "Tolerance cannot be negative.");
+
+                Interlocked.Exchange(ref _tolerance, (long) (value.TotalSeconds * Stopwatch.Frequency));
+            }
+        }
+
+        /// <summary>
+        /// Frames kept per source while waiting for the other sources to catch up
+        /// </summary>
+        public int MaximumBufferedFrames
+        {
+            get { return _maximumBufferedFrames; }
+            set
+            {
+                if (value < 1) throw new ArgumentOutOfRangeException("value", "At least one frame has to be buffered.");
+
+                _maximumBufferedFrames = value;
+            }
+        }
+
+        /// <summary>
+        /// Whether the sources' timestamps come from clocks of their own. When set, the group maps each
+        /// source onto the group's clock by the smallest delay between a frame's timestamp and its arrival
+        /// over the last frames, which follows a constant offset and slow drift. Cameras of this
+        /// process all stamp frames with the same clock, so this is off by default.
+        /// </summary>
+        public bool EstimateClockOffsets
+        {
+            get { return _estimateClockOffsets; }
+            set
+            {
+                lock (_syncObject)
+                {
+                    _estimateClockOffsets = value;
+                }
+            }
+        }
+
+        public long FrameSetsEmitted
+        {
+            get { return Interlocked.Read(ref _frameSetsEmitted); }
+        }
+
+        public void AddSource(IFrameSource source)
+        {
+            if (source == null) throw new ArgumentNullException("source");
+
+            lock (_syncObject)
+            {
+                if (_disposed) throw new ObjectDisposedException("MultiCameraGroup");
+                if (_sources.Contains(source)) throw new ArgumentException("The source is already part of the group.", "source");
+
+                _states.Add(new SourceState(source));
+                _sources = new ReadOnlyCollection<IFrameSource>(_states.ConvertAll(state => state.Source));
+            }
+
+            source.NewFrame += OnNewFrame;
+        }
+
+        /// <summary>
+        /// Starts capture on every source; returns false when any of them did not start
+        /// </summary>
+        public bool Start()
+        {
+            bool result = true;
+
+            foreach (IFrameSource source in _sources)
+            {
+                result &= source.StartFrameCapture();
+            }
+
+            return result;
+        }
+
+        /// <summary>
+        /// Stops every source and releases the frames still waiting for a match
+        /// </summary>
+        public void Stop()
+        {
+            foreach (IFrameSource source in _sources)
+            {
+                source.StopFrameCapture();
+            }
+
+            lock (_syncObject)
+            {
+                foreach (SourceState state in _states)
+                {
+                    state.Clear();
+                }
+            }
+        }
+
+        /// <summary>
+        /// Frames delivered by a source since it joined the group
+        /// </summary>
+        public long GetFramesReceived(IFrameSource source)
+        {
+            lock (_syncObject)
+            {
+                return GetState(source).FramesReceived;
+            }
+        }
+
+        /// <summary>
+        /// Frames of a source released without being part of a set
+        /// </summary>
+        public long GetUnmatchedFrames(IFrameSource source)
+        {
+            lock (_syncObject)
+            {
+                return GetState(source).FramesUnmatched;
+            }
+        }
+
+        /// <summary>
+        /// Offset added to a source's timestamps to bring them onto the group's clock, 0 unless
+        /// <see cref="EstimateClockOffsets"/> is set
+        /// </summary>
+        public TimeSpan GetClockOffset(IFrameSource source)
+        {
+            lock (_syncObject)
+            {
+                return TimeSpan.FromSeconds((double) GetOffset(GetState(source)) / Stopwatch.Frequency);
+            }
+        }
+
+        public void Dispose()
+        {
+            SourceState[] states;
+
+            lock (_syncObject)
+            {
+                if (_disposed)
+                    return;
+
+                _disposed = true;
+                states = _states.ToArray();
+            }
+
+            foreach (SourceState state in states)
+            {
+                state.Source.NewFrame -= OnNewFrame;
+            }
+
+            lock (_syncObject)
+            {
+                foreach (SourceState state in states)
+                {
+                    state.Clear();
+                }
+            }
+        }
+
+        private SourceState GetState(IFrameSource source)
+        {
+            SourceState result = _states.Find(state => state.Source == source);
+            if (result == null) throw new ArgumentException("The source is not part of the group.", "source");
+
+            return result;
+        }
+
+        private long GetOffset(SourceState state)
+        {
+            return _estimateClockOffsets ? state.EstimateOffset() : 0;
+        }
+
+        private void OnNewFrame(IFrameSource source, Frame frame, double fps)
+        {
+            long arrival = Stopwatch.GetTimestamp();
+            List<FrameSet> ready = null;
+
+            lock (_syncObject)
+            {
+                if (_disposed)
+                    return;
+
+                SourceState state = _states.Find(s => s.Source == source);
+                if (state == null)
+                    return;
+
+                state.FramesReceived++;
+                state.AddOffsetSample(arrival - frame.Timestamp);
+
+                state.Enqueue(new PendingFrame(frame.AddReference(), frame.Timestamp + GetOffset(state)));
+                while (state.Queue.Count > _maximumBufferedFrames)
+                {
+                    state.Drop();
+                }
+
+                FrameSet frameSet;
+                while ((frameSet = TryMatch()) != null)
+                {
+                    if (ready == null)
+                    {
+                        ready = new List<FrameSet>();
+                    }
+
+                    ready.Add(frameSet);
+                }
+            }
+
+            if (ready != null)
+            {
+                var handler = FrameSetReady;
+
+                foreach (FrameSet frameSet in ready)
+                {
+                    if (handler != null)
+                    {
+                        handler(this, frameSet);
+                    }
+                    else
+                    {
+                        frameSet.Dispose();
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Takes the next set off the heads of the queues, or returns null while any source still has
+        /// to deliver a frame before the set can be told apart
+        /// </summary>
+        private FrameSet TryMatch()
+        {
+            if (_states.Count == 0)
+                return null;
+
+            long tolerance = Interlocked.Read(ref _tolerance);
+            long pivot = GetLatestHead();
+
+            // Dropping frames moves heads on, which can move the latest one and with it the pivot;
+            // the heads are only chosen once they agree on a pivot. It never moves back, and only
+            // moves when a frame was dropped, so this ends.
+            for (;;)
+            {
+                if (pivot == Int64.MinValue)
+                    return null;
+
+                foreach (SourceState state in _states)
+                {
+                    Queue<PendingFrame> queue = state.Queue;
+
+                    // Anything this old is too early for every frame the other sources can still deliver
+                    while (queue.Count > 0 && pivot - queue.Peek().Time > tolerance)
+                    {
+                        state.Drop();
+                    }
+
+                    // Move on to the frame closest to the pivot
+                    while (queue.Count >= 2 && Math.Abs(state.Second.Time - pivot) <= Math.Abs(queue.Peek().Time - pivot))
+                    {
+                        state.Drop();
+                    }
+                }
+
+                long latest = GetLatestHead();
+                if (latest == pivot)
+                    break;
+
+                pivot = latest;
+            }
+
+            bool settled = true;
+
+            foreach (SourceState state in _states)
+            {
+                Queue<PendingFrame> queue = state.Queue;
+
+                // A set is never emitted with a frame further than the tolerance from its time
+                if (Math.Abs(queue.Peek().Time - pivot) > tolerance)
+                {
+                    settled = false;
+                }
+                else if (queue.Count == 1 && queue.Peek().Time < pivot)
+                {
+                    // The next frame might be closer still, unless it is due more than twice as far off
+                    long interval = state.FrameInterval;
+                    if (interval <= 0 || 2 * (pivot - queue.Peek().Time) > interval)
+                    {
+                        settled = false;
+                    }
+                }
+            }
+
+            if (!settled)
+                return null;
+
+            var frames = new Frame[_states.Count];
+            var times = new long[_states.Count];
+            for (int i = 0; i < _states.Count; i++)
+            {
+                PendingFrame pending = _states[i].Queue.Dequeue();
+                frames[i] = pending.Frame;
+                times[i] = pending.Time;
+            }
+
+            long sequenceNumber = Interlocked.Increment(ref _frameSetsEmitted) - 1;
+            return new FrameSet(_sources, frames, times, pivot, sequenceNumber);
+        }
+
+        /// <summary>
+        /// The latest head is the earliest time every source can still have a frame for;
+        /// Int64.MinValue while any source has none waiting
+        /// </summary>
+        private long GetLatestHead()
+        {
+            long result = Int64.MinValue;
+
+            foreach (SourceState state in _states)
+            {
+                if (state.Queue.Count == 0)
+                    return Int64.MinValue;
+
+                result = Math.Max(result, state.Queue.Peek().Time);
+            }
+
+            return result;
+        }
+
+        private struct PendingFrame
+        {
+            public readonly Frame Frame;
+            public readonly long Time;
+
+            public PendingFrame(Frame frame, long time)
+            {
+                Frame = frame;
+                Time = time;
+            }
+        }
+
+        private sealed class SourceState
+        {
+            private readonly long[] _offsetSamples = new long[OffsetWindow];
+            private int _offsetSampleCount;
+            private int _nextOffsetSample;
+            private long _lastTime;
+
+            public SourceState(IFrameSource source)
+            {
+                Source = source;
+                Queue = new Queue<PendingFrame>();
+            }
+
+            public IFrameSource Source { get; private set; }
+
+            public Queue<PendingFrame> Queue { get; private set; }
+
+            public long FramesReceived { get; set; }
+
+            public long FramesUnmatched { get; private set; }
+
+            /// <summary>
+            /// Running average of the time between the source's frames, 0 until two have arrived
+            /// </summary>
+            public long FrameInterval { get; private set; }
+
+            public PendingFrame Second
+            {
+                get
+                {
+                    using (Queue<PendingFrame>.Enumerator enumerator = Queue.GetEnumerator())
+                    {
+                        enumerator.MoveNext();
+                        enumerator.MoveNext();
+                        return enumerator.Current;
+                    }
+                }
+            }
+
+            public void Enqueue(PendingFrame pending)
+            {
+                if (_lastTime != 0 && pending.Time > _lastTime)
+                {
+                    long interval = pending.Time - _lastTime;
+                    FrameInterval = FrameInterval == 0 ? interval : FrameInterval + (interval - FrameInterval) / 8;
+                }
+
+                _lastTime = pending.Time;
+                Queue.Enqueue(pending);
+            }
+
+            public void Drop()
+            {
+                Queue.Dequeue().Frame.Dispose();
+                FramesUnmatched++;
+            }
+
+            public void Clear()
+            {
+                while (Queue.Count > 0)
+                {
+                    Queue.Dequeue().Frame.Dispose();
+                }
+
+                _lastTime = 0;
+                FrameInterval = 0;
+            }
+
+            public void AddOffsetSample(long delay)
+            {
+                _offsetSamples[_nextOffsetSample] = delay;
+                _nextOffsetSample = (_nextOffsetSample + 1) % OffsetWindow;
+                _offsetSampleCount = Math.Min(_offsetSampleCount + 1, OffsetWindow);
+            }
+
+            /// <summary>
+            /// The quickest delivery seen lately is the one least disturbed by scheduling
+            /// </summary>
+            public long EstimateOffset()
+            {
+                long result = Int64.MaxValue;
+
+                for (int i = 0; i < _offsetSampleCount; i++)
+                {
+                    result = Math.Min(result, _offsetSamples[i]);
+                }
+
+                return _offsetSampleCount > 0 ? result : 0;
+            }
+        }
+    }
+}
@@ -1,20 +1,57 @@
-﻿using System.Drawing;
+﻿using System;
+using System.Diagnostics;
+using System.Drawing;
 using System.Drawing.Imaging;
 using System.IO;
 using System.Runtime.Serialization;
+using WebCamLib;
 
 namespace Touchless.Vision.Contracts
 {
     [DataContract]
-    public class Frame
+    public class Frame : IDisposable
     {
         [DataMember]
         public int Id { get; set; }
 
+        private PooledFrame _buffer;
+        private readonly RotateFlipType _rotateFlip;
+
+        private Bitmap _originalImage;
+        private bool _ownsOriginalImage;
+        /// <summary>
+        /// The captured image. For frames backed by a pooled buffer this is created on first use as a
+        /// view over the buffer without copying, so it must be treated as read-only and is only valid
+        /// until the frame is disposed. Use <see cref="Image"/> for a copy that can be changed.
+        /// A bitmap assigned here stays the caller's to dispose.
+        /// </summary>
         [IgnoreDataMember]
-        public Bitmap OriginalImage { get; set; }
+        public Bitmap OriginalImage
+        {
+            get
+            {
+                if (_originalImage == null && _buffer != null)
+                {
+                    _originalImage = CreateView(_buffer, _rotateFlip);
+                    _ownsOriginalImage = true;
+                }
+
+                return _originalImage;
+            }
+            set
+            {
+                _originalImage = value;
+                _ownsOriginalImage = false;
+            }
+        }
 
         private Bitmap _image;
+        private bool _ownsImage;
+        /// <summary>
+        /// A private copy of <see cref="OriginalImage"/>, made the first time it is asked for and
+        /// disposed with the frame; copy it again to keep it longer. A bitmap assigned here stays the
+        /// caller's to dispose.
+        /// </summary>
         [IgnoreDataMember]
         public Bitmap Image
         {
@@ -23,17 +60,176 @@ namespace Touchless.Vision.Contracts
                 if (_image == null)
                 {
                     _image = new Bitmap( OriginalImage );
+                    _ownsImage = true;
                 }
 
                 return _image;
             }
-            set { _image = value;}
+            set
+            {
+                _image = value;
+                _ownsImage = false;
+            }
+        }
+
+        /// <summary>
+        /// The native buffer behind the frame, null for frames built from a Bitmap
+        /// </summary>
+        [IgnoreDataMember]
+        public PooledFrame Buffer
+        {
+            get { return _buffer; }
+        }
+
+        private long _timestamp;
+        /// <summary>
+        /// Stopwatch ticks when the frame was captured. Pooled buffers carry the time they arrived from
+        /// the driver; frames built from a Bitmap are stamped on construction unless the source sets it.
+        /// </summary>
+        [IgnoreDataMember]
+        public long Timestamp
+        {
+            get { return _timestamp; }
+            set { _timestamp = value; }
+        }
+
+        private FrameStatistics _statistics;
+        /// <summary>
+        /// Image statistics computed once by the capture layer, null when the source does not provide them
+        /// </summary>
+        [IgnoreDataMember]
+        public FrameStatistics Statistics
+        {
+            get
+            {
+                if (_statistics == null && _buffer != null)
+                {
+                    _statistics = _buffer.Statistics;
+                }
+
+                return _statistics;
+            }
+            set { _statistics = value; }
         }
 
         public Frame(Bitmap originalImage)
         {
             Id = NextId();
-            OriginalImage = new Bitmap( originalImage );
+            _originalImage = new Bitmap( originalImage );
+            _ownsOriginalImage = true;
+            _timestamp = Stopwatch.GetTimestamp();
+        }
+
+        /// <summary>
+        /// Wraps a pooled buffer without copying it; the frame takes over the reference
+        /// </summary>
+        public Frame(PooledFrame buffer, RotateFlipType rotateFlip)
+        {
+            if (buffer == null) throw new ArgumentNullException("buffer");
+
+            Id = NextId();
+            _buffer = buffer;
+            _rotateFlip = rotateFlip;
+            _timestamp = buffer.Timestamp;
+        }
+
+        /// <summary>
+        /// Another frame over the same image, for holding on to a frame after the event delivering it
+        /// returns. A pooled buffer is shared by reference; a frame built from a Bitmap is copied.
+        /// </summary>
+        public Frame AddReference()
+        {
+            Frame result;
+
+            if (_buffer != null)
+            {
+                result = new Frame(_buffer.AddReference(), _rotateFlip);
+            }
+            else
+            {
+                result = new Frame(OriginalImage);
+            }
+
+            result._timestamp = _timestamp;
+            result._statistics = _statistics;
+
+            return result;
+        }
+
+        public void Dispose()
+        {
+            if (_image != null && _ownsImage)
+            {
+                _image.Dispose();
+            }
+
+            _image = null;
+
+            // A view points into the buffer, so it has to go before the buffer
+            if (_originalImage != null && _ownsOriginalImage)
+            {
+                _originalImage.Dispose();
+            }
+
+            _originalImage = null;
+
+            if (_buffer != null)
+            {
+                _buffer.Dispose();
+                _buffer = null;
+            }
+        }
+
+        /// <summary>
+        /// Bitmap over the pixels of a pooled buffer. Upright and vertically flipped images are plain
+        /// views; any other rotation has to be materialised.
+        /// </summary>
+        public static Bitmap CreateView(PooledFrame buffer, RotateFlipType rotateFlip)
+        {
+            PixelFormat format = buffer.BitsPerPixel == 32 ? PixelFormat.Format32bppRgb : PixelFormat.Format24bppRgb;
+            Bitmap result;
+
+            if (rotateFlip == RotateFlipType.RotateNoneFlipY)
+            {
+                // Walking the rows the other way round is a vertical flip for free
+                IntPtr bottom = buffer.Scan0 + (buffer.Height - 1) * buffer.Stride;
+                result = new Bitmap(buffer.Width, buffer.Height, -buffer.Stride, format, bottom);
+            }
+            else
+            {
+                result = new Bitmap(buffer.Width, buffer.Height, buffer.Stride, format, buffer.Scan0);
+
+                if (rotateFlip != RotateFlipType.RotateNoneFlipNone)
+                {
+                    using (Bitmap view = result)
+                    {
+                        result = (Bitmap) view.Clone();
+                    }
+
+                    result.RotateFlip(rotateFlip);
+                }
+            }
+
+            return result;
+        }
+
+        /// <summary>
+        /// Bitmap copied out of a pooled buffer, which stays valid after the buffer is released
+        /// </summary>
+        public static Bitmap CreateImage(PooledFrame buffer, RotateFlipType rotateFlip)
+        {
+            Bitmap result = CreateView(buffer, rotateFlip);
+
+            // Rotated views are copies already
+            if (rotateFlip == RotateFlipType.RotateNoneFlipNone || rotateFlip == RotateFlipType.RotateNoneFlipY)
+            {
+                using (Bitmap view = result)
+                {
+                    result = (Bitmap) view.Clone();
+                }
+            }
+
+            return result;
         }
 
         [DataMember]
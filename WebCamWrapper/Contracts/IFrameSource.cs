@@ -4,6 +4,11 @@ namespace Touchless.Vision.Contracts
 {
     public interface IFrameSource : ITouchlessAddIn
     {
+        /// <summary>
+        /// Raised with each captured frame, which may share a pooled native buffer and is released when
+        /// the handlers return. A subscriber keeping the frame, or using it from another thread, calls
+        /// <see cref="Frame.AddReference"/> during the event and disposes of that reference when done.
+        /// </summary>
         event Action<IFrameSource, Frame, double> NewFrame;
 
         bool StartFrameCapture();
@@ -0,0 +1,265 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Collections.ObjectModel;
+using System.Drawing;
+using System.Runtime.Serialization;
+using System.Windows;
+using Touchless.Vision.Contracts;
+using WebCamLib;
+
+namespace Touchless.Vision.Detection
+{
+    /// <summary>
+    /// Finds objects with an OpenCV Haar or LBP cascade, such as faces, and follows them from frame to
+    /// frame: a detection overlapping one of the last frame's objects keeps its id and is reported as
+    /// moved, the rest are new, and objects no longer found are removed.
+    /// </summary>
+    public class CascadeObjectDetector : IObjectDetector, IDisposable
+    {
+        public event Action<IObjectDetector, DetectedObject, Frame> NewObject;
+        public event Action<IObjectDetector, DetectedObject, Frame> ObjectMoved;
+        public event Action<IObjectDetector, DetectedObject, Frame> ObjectRemoved;
+        public event Action<IObjectDetector, Frame, ReadOnlyCollection<DetectedObject>> FrameProcessed;
+
+        private readonly object _syncObject = new object();
+        private readonly CascadeDetector _detector;
+        private readonly List<CascadeDetection> _detections = new List<CascadeDetection>();
+        private List<CascadeDetectedObject> _objects = new List<CascadeDetectedObject>();
+        private double _matchOverlap = 0.3;
+
+        /// <summary>
+        /// Loads a cascade written by opencv_traincascade, searching it on the shared native worker pool
+        /// </summary>
+        public CascadeObjectDetector(string fileName)
+            : this(fileName, true)
+        {
+        }
+
+        public CascadeObjectDetector(string fileName, bool parallel)
+        {
+            if (fileName == null) throw new ArgumentNullException("fileName");
+
+            _detector = new CascadeDetector(fileName, parallel);
+            Name = System.IO.Path.GetFileNameWithoutExtension(fileName);
+        }
+
+        public string Name { get; set; }
+
+        public string Description
+        {
+            get { return "Detects objects with a Haar or LBP cascade"; }
+        }
+
+        public bool HasConfiguration
+        {
+            get { return false; }
+        }
+
+        public UIElement ConfigurationElement
+        {
+            get { return null; }
+        }
+
+        /// <summary>
+        /// Ratio between successive window sizes searched, more than 1
+        /// </summary>
+        public double ScaleFactor
+        {
+            get { lock (_syncObject) return _detector.ScaleFactor; }
+            set { lock (_syncObject) _detector.ScaleFactor = value; }
+        }
+
+        /// <summary>
+        /// Objects found by this many overlapping windows or fewer are ignored
+        /// </summary>
+        public int MinNeighbors
+        {
+            get { lock (_syncObject) return _detector.MinNeighbors; }
+            set { lock (_syncObject) _detector.MinNeighbors = value; }
+        }
+
+        /// <summary>
+        /// Smallest object width searched in pixels, zero for the cascade's window
+        /// </summary>
+        public int MinimumSize
+        {
+            get { lock (_syncObject) return _detector.MinimumSize; }
+            set { lock (_syncObject) _detector.MinimumSize = value; }
+        }
+
+        /// <summary>
+        /// Largest object width searched in pixels, zero for no limit
+        /// </summary>
+        public int MaximumSize
+        {
+            get { lock (_syncObject) return _detector.MaximumSize; }
+            set { lock (_syncObject) _detector.MaximumSize = value; }
+        }
+
+        /// <summary>
+        /// Intersection over union a detection needs with one of the last frame's objects to be that object
+        /// </summary>
+        public double MatchOverlap
+        {
+            get { return _matchOverlap; }
+            set
+            {
+                if (value <= 0.0 || value > 1.0) throw new ArgumentOutOfRangeException("value");
+                _matchOverlap = value;
+            }
+        }
+
+        public ReadOnlyCollection<DetectedObject> DetectObjects(Frame frame)
+        {
+            if (frame == null) throw new ArgumentNullException("frame");
+
+            var moved = new List<CascadeDetectedObject>();
+            var added = new List<CascadeDetectedObject>();
+            List<CascadeDetectedObject> removed;
+            var current = new List<CascadeDetectedObject>();
+
+            lock (_syncObject)
+            {
+                Search(frame);
+
+                removed = new List<CascadeDetectedObject>(_objects);
+
+                var bounds = new Rectangle[_detections.Count];
+                var pairs = new List<OverlapPair>();
+
+                for (int i = 0; i < bounds.Length; i++)
+                {
+                    CascadeDetection detection = _detections[i];
+                    bounds[i] = new Rectangle(detection.X, detection.Y, detection.Width, detection.Height);
+
+                    foreach (CascadeDetectedObject candidate in _objects)
+                    {
+                        double overlap = GetOverlap(candidate.Bounds, bounds[i]);
+                        if (overlap >= _matchOverlap)
+                        {
+                            pairs.Add(new OverlapPair(i, candidate, overlap));
+                        }
+                    }
+                }
+
+                // Greedy matching against the last frame's objects, best overlap first, so an object
+                // goes to the detection covering it most rather than to the first one found
+                pairs.Sort((a, b) => a.Overlap != b.Overlap ? b.Overlap.CompareTo(a.Overlap) : a.Detection.CompareTo(b.Detection));
+
+                var matches = new CascadeDetectedObject[bounds.Length];
+                foreach (OverlapPair pair in pairs)
+                {
+                    if (matches[pair.Detection] == null && removed.Remove(pair.Object))
+                    {
+                        matches[pair.Detection] = pair.Object;
+                    }
+                }
+
+                for (int i = 0; i < bounds.Length; i++)
+                {
+                    CascadeDetection detection = _detections[i];
+                    CascadeDetectedObject match = matches[i];
+
+                    if (match != null)
+                    {
+                        match.Update(bounds[i], detection.Neighbors);
+                        moved.Add(match);
+                        current.Add(match);
+                    }
+                    else
+                    {
+                        var created = new CascadeDetectedObject(bounds[i], detection.Neighbors);
+                        added.Add(created);
+                        current.Add(created);
+                    }
+                }
+
+                _objects = current;
+            }
+
+            NativeDetection.Raise(this, ObjectRemoved, removed, frame);
+            NativeDetection.Raise(this, ObjectMoved, moved, frame);
+            NativeDetection.Raise(this, NewObject, added, frame);
+
+            var result = new ReadOnlyCollection<DetectedObject>(current.ConvertAll(o => (DetectedObject) o));
+
+            var handler = FrameProcessed;
+            if (handler != null)
+            {
+                handler(this, frame, result);
+            }
+
+            return result;
+        }
+
+        public void Dispose()
+        {
+            lock (_syncObject)
+            {
+                _detector.Dispose();
+            }
+        }
+
+        private void Search(Frame frame)
+        {
+            NativeDetection.Search(frame, _detector.Detect, _detector.Detect);
+
+            _detector.GetDetections(_detections);
+        }
+
+        private static double GetOverlap(Rectangle a, Rectangle b)
+        {
+            Rectangle intersection = Rectangle.Intersect(a, b);
+            if (intersection.IsEmpty)
+                return 0.0;
+
+            double common = (double) intersection.Width * intersection.Height;
+            return common / ((double) a.Width * a.Height + (double) b.Width * b.Height - common);
+        }
+
+        /// <summary>
+        /// A detection, by its index, and one of the last frame's objects it overlaps enough to be
+        /// </summary>
+        private struct OverlapPair
+        {
+            public readonly int Detection;
+            public readonly CascadeDetectedObject Object;
+            public readonly double Overlap;
+
+            public OverlapPair(int detection, CascadeDetectedObject detectedObject, double overlap)
+            {
+                Detection = detection;
+                Object = detectedObject;
+                Overlap = overlap;
+            }
+        }
+    }
+
+    /// <summary>
+    /// An object found by a <see cref="CascadeObjectDetector"/>; its position is the centre of its bounds
+    /// </summary>
+    [DataContract]
+    public class CascadeDetectedObject : DetectedObject
+    {
+        internal CascadeDetectedObject(Rectangle bounds, int neighbors)
+        {
+            Update(bounds, neighbors);
+        }
+
+        [DataMember]
+        public Rectangle Bounds { get; private set; }
+
+        /// <summary>
+        /// Windows merged into the detection; more means a more certain one
+        /// </summary>
+        [DataMember]
+        public int Neighbors { get; private set; }
+
+        internal void Update(Rectangle bounds, int neighbors)
+        {
+            Bounds = bounds;
+            Neighbors = neighbors;
+            Position = new System.Drawing.Point(bounds.X + bounds.Width / 2, bounds.Y + bounds.Height / 2);
+        }
+    }
+}
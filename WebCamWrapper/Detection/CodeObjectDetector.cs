@@ -0,0 +1,193 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Collections.ObjectModel;
+using System.Drawing;
+using System.Runtime.Serialization;
+using System.Windows;
+using Touchless.Vision.Contracts;
+using WebCamLib;
+
+namespace Touchless.Vision.Detection
+{
+    /// <summary>
+    /// Reads QR codes and EAN-13 barcodes in the frames and follows them: a code is new when it
+    /// first comes into view, moved in the frames after, and removed once it has been out of view
+    /// for a few frames. Codes in view are only decoded again now and then, so a frame costs little
+    /// more than finding them.
+    /// </summary>
+    public class CodeObjectDetector : IObjectDetector, IDisposable
+    {
+        public event Action<IObjectDetector, DetectedObject, Frame> NewObject;
+        public event Action<IObjectDetector, DetectedObject, Frame> ObjectMoved;
+        public event Action<IObjectDetector, DetectedObject, Frame> ObjectRemoved;
+        public event Action<IObjectDetector, Frame, ReadOnlyCollection<DetectedObject>> FrameProcessed;
+
+        private readonly object _syncObject = new object();
+        private readonly CodeReader _reader;
+        private readonly List<CodeInfo> _codes = new List<CodeInfo>();
+        private readonly List<int> _removedIds = new List<int>();
+        private readonly Dictionary<int, CodeDetectedObject> _objects = new Dictionary<int, CodeDetectedObject>();
+
+        /// <summary>
+        /// Creates a detector working on the shared native worker pool
+        /// </summary>
+        public CodeObjectDetector()
+            : this(true)
+        {
+        }
+
+        public CodeObjectDetector(bool parallel)
+        {
+            _reader = new CodeReader(parallel);
+        }
+
+        public string Name
+        {
+            get { return "Code Reader"; }
+        }
+
+        public string Description
+        {
+            get { return "Reads QR codes and EAN-13 barcodes"; }
+        }
+
+        public bool HasConfiguration
+        {
+            get { return false; }
+        }
+
+        public UIElement ConfigurationElement
+        {
+            get { return null; }
+        }
+
+        /// <summary>
+        /// Frames a code may go unseen before it is removed
+        /// </summary>
+        public int Retention
+        {
+            get { lock (_syncObject) return _reader.Retention; }
+            set { lock (_syncObject) _reader.Retention = value; }
+        }
+
+        /// <summary>
+        /// Frames a QR code in view goes without being decoded again; 1 decodes every frame
+        /// </summary>
+        public int VerifyInterval
+        {
+            get { lock (_syncObject) return _reader.VerifyInterval; }
+            set { lock (_syncObject) _reader.VerifyInterval = value; }
+        }
+
+        public ReadOnlyCollection<DetectedObject> DetectObjects(Frame frame)
+        {
+            if (frame == null) throw new ArgumentNullException("frame");
+
+            var moved = new List<CodeDetectedObject>();
+            var added = new List<CodeDetectedObject>();
+            var removed = new List<CodeDetectedObject>();
+            var current = new List<CodeDetectedObject>();
+
+            lock (_syncObject)
+            {
+                Scan(frame);
+
+                foreach (CodeInfo code in _codes)
+                {
+                    var bounds = new Rectangle(code.X, code.Y, code.Width, code.Height);
+                    CodeDetectedObject detectedObject;
+
+                    if (_objects.TryGetValue(code.Id, out detectedObject))
+                    {
+                        detectedObject.Update(bounds);
+                        moved.Add(detectedObject);
+                    }
+                    else
+                    {
+                        detectedObject = new CodeDetectedObject(code, bounds);
+                        _objects.Add(code.Id, detectedObject);
+                        added.Add(detectedObject);
+                    }
+
+                    current.Add(detectedObject);
+                }
+
+                foreach (int id in _removedIds)
+                {
+                    CodeDetectedObject detectedObject;
+                    if (_objects.TryGetValue(id, out detectedObject))
+                    {
+                        _objects.Remove(id);
+                        removed.Add(detectedObject);
+                    }
+                }
+            }
+
+            NativeDetection.Raise(this, ObjectRemoved, removed, frame);
+            NativeDetection.Raise(this, ObjectMoved, moved, frame);
+            NativeDetection.Raise(this, NewObject, added, frame);
+
+            var result = new ReadOnlyCollection<DetectedObject>(current.ConvertAll(o => (DetectedObject) o));
+
+            var handler = FrameProcessed;
+            if (handler != null)
+            {
+                handler(this, frame, result);
+            }
+
+            return result;
+        }
+
+        public void Dispose()
+        {
+            lock (_syncObject)
+            {
+                _reader.Dispose();
+            }
+        }
+
+        private void Scan(Frame frame)
+        {
+            NativeDetection.Search(frame, _reader.Scan, _reader.Scan);
+
+            _reader.GetCodes(_codes);
+            _reader.GetRemovedIds(_removedIds);
+        }
+    }
+
+    /// <summary>
+    /// A code read by a <see cref="CodeObjectDetector"/>; its position is the centre of its bounds
+    /// </summary>
+    [DataContract]
+    public class CodeDetectedObject : DetectedObject
+    {
+        internal CodeDetectedObject(CodeInfo code, Rectangle bounds)
+        {
+            Symbology = code.Symbology;
+            Data = code.Data;
+            Text = code.Text;
+            Update(bounds);
+        }
+
+        [DataMember]
+        public CodeSymbology Symbology { get; private set; }
+
+        [DataMember]
+        public byte[] Data { get; private set; }
+
+        /// <summary>
+        /// The content as text; the digits for barcodes
+        /// </summary>
+        [DataMember]
+        public string Text { get; private set; }
+
+        [DataMember]
+        public Rectangle Bounds { get; private set; }
+
+        internal void Update(Rectangle bounds)
+        {
+            Bounds = bounds;
+            Position = new System.Drawing.Point(bounds.X + bounds.Width / 2, bounds.Y + bounds.Height / 2);
+        }
+    }
+}
@@ -0,0 +1,361 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Collections.ObjectModel;
+using System.Diagnostics;
+using System.Threading;
+using System.Threading.Tasks;
+using Touchless.Vision.Contracts;
+
+namespace Touchless.Vision.Detection
+{
+    /// <summary>
+    /// Runs every registered detector against each frame of a source on the thread pool.
+    /// Every detector receives its own reference to the frame, released once it returns, and must
+    /// treat the image as read-only. A detector which is still busy with an earlier frame skips the
+    /// new one instead of queueing it.
+    /// </summary>
+    public class DetectorScheduler : IDisposable
+    {
+        /// <summary>
+        /// Raised once all detectors started for a frame have finished, on a thread pool thread.
+        /// The frame is released when the handlers return; handlers call AddReference to keep it.
+        /// </summary>
+        public event Action<DetectorScheduler, Frame, ReadOnlyCollection<DetectorResult>> FrameProcessed;
+
+        private readonly object _syncObject = new object();
+        private readonly IFrameSource _frameSource;
+        private volatile DetectorEntry[] _entries = new DetectorEntry[0];
+        private bool _disposed;
+
+        // Frames whose detectors are still running, guarded by _syncObject
+        private int _pendingFrames;
+
+        public DetectorScheduler(IFrameSource frameSource)
+        {
+            if (frameSource == null) throw new ArgumentNullException("frameSource");
+
+            _frameSource = frameSource;
+            _frameSource.NewFrame += OnNewFrame;
+        }
+
+        public DetectorScheduler(IFrameSource frameSource, IEnumerable<IObjectDetector> detectors)
+            : this(frameSource)
+        {
+            if (detectors == null) throw new ArgumentNullException("detectors");
+
+            foreach (IObjectDetector detector in detectors)
+            {
+                Register(detector);
+            }
+        }
+
+        public IFrameSource FrameSource
+        {
+            get { return _frameSource; }
+        }
+
+        public void Register(IObjectDetector detector)
+        {
+            if (detector == null) throw new ArgumentNullException("detector");
+
+            lock (_syncObject)
+            {
+                foreach (DetectorEntry entry in _entries)
+                {
+                    if (entry.Detector == detector)
+                        return;
+                }
+
+                var entries = new DetectorEntry[_entries.Length + 1];
+                _entries.CopyTo(entries, 0);
+                entries[entries.Length - 1] = new DetectorEntry(detector);
+                _entries = entries;
+            }
+        }
+
+        public bool Unregister(IObjectDetector detector)
+        {
+            bool result = false;
+
+            lock (_syncObject)
+            {
+                var entries = new List<DetectorEntry>(_entries);
+                int index = entries.FindIndex(entry => entry.Detector == detector);
+
+                if (result = index >= 0)
+                {
+                    entries.RemoveAt(index);
+                    _entries = entries.ToArray();
+                }
+            }
+
+            return result;
+        }
+
+        /// <summary>
+        /// Snapshot of the timing counters of every registered detector
+        /// </summary>
+        public ReadOnlyCollection<DetectorTiming> Timings
+        {
+            get
+            {
+                DetectorEntry[] entries = _entries;
+                var result = new List<DetectorTiming>(entries.Length);
+
+                foreach (DetectorEntry entry in entries)
+                {
+                    result.Add(entry.GetTiming());
+                }
+
+                return result.AsReadOnly();
+            }
+        }
+
+        /// <summary>
+        /// Stops taking frames and waits for the detectors still working on one, so they can be
+        /// disposed of once this returns. FrameProcessed handlers may still be running.
+        /// </summary>
+        public void Dispose()
+        {
+            lock (_syncObject)
+            {
+                if (_disposed)
+                    return;
+
+                _frameSource.NewFrame -= OnNewFrame;
+                _disposed = true;
+
+                while (_pendingFrames > 0)
+                {
+                    Monitor.Wait(_syncObject);
+                }
+            }
+        }
+
+        private void OnNewFrame(IFrameSource source, Frame frame, double fps)
+        {
+            DetectorEntry[] entries = _entries;
+            var tasks = new List<Task<DetectorResult>>(entries.Length);
+
+            lock (_syncObject)
+            {
+                // The source may still be raising the event it was just unsubscribed from
+                if (_disposed)
+                    return;
+
+                foreach (DetectorEntry entry in entries)
+                {
+                    if (entry.TryBeginFrame())
+                    {
+                        DetectorEntry current = entry;
+                        Frame held = frame.AddReference();
+
+                        tasks.Add(Task.Factory.StartNew(() =>
+                        {
+                            try
+                            {
+                                return current.Process(held);
+                            }
+                            finally
+                            {
+                                held.Dispose();
+                            }
+                        }));
+                    }
+                }
+
+                if (tasks.Count > 0)
+                {
+                    _pendingFrames++;
+                }
+            }
+
+            if (tasks.Count > 0)
+            {
+                Frame processed = frame.AddReference();
+                Task.Factory.ContinueWhenAll(tasks.ToArray(), completed => OnFrameProcessed(processed, completed));
+            }
+        }
+
+        private void OnFrameProcessed(Frame frame, Task<DetectorResult>[] completed)
+        {
+            lock (_syncObject)
+            {
+                if (--_pendingFrames == 0)
+                {
+                    Monitor.PulseAll(_syncObject);
+                }
+            }
+
+            try
+            {
+                var handler = this.FrameProcessed;
+                if (handler != null)
+                {
+                    var results = new DetectorResult[completed.Length];
+                    for (int i = 0; i < completed.Length; i++)
+                    {
+                        results[i] = completed[i].Result;
+                    }
+
+                    handler(this, frame, new ReadOnlyCollection<DetectorResult>(results));
+                }
+            }
+            finally
+            {
+                frame.Dispose();
+            }
+        }
+
+        private sealed class DetectorEntry
+        {
+            private readonly object _timingLock = new object();
+            private readonly Stopwatch _stopwatch = new Stopwatch();
+            private int _busy;
+            private long _processed;
+            private long _skipped;
+            private long _failed;
+            private TimeSpan _last;
+            private TimeSpan _total;
+            private TimeSpan _maximum;
+
+            public DetectorEntry(IObjectDetector detector)
+            {
+                Detector = detector;
+            }
+
+            public IObjectDetector Detector { get; private set; }
+
+            public bool TryBeginFrame()
+            {
+                bool result = Interlocked.CompareExchange(ref _busy, 1, 0) == 0;
+
+                if (!result)
+                {
+                    Interlocked.Increment(ref _skipped);
+                }
+
+                return result;
+            }
+
+            public DetectorResult Process(Frame frame)
+            {
+                ReadOnlyCollection<DetectedObject> objects = null;
+                Exception error = null;
+
+                // Only one frame is ever in flight per entry, so the stopwatch is not shared
+                _stopwatch.Restart();
+                try
+                {
+                    objects = Detector.DetectObjects(frame);
+                }
+                catch (Exception e)
+                {
+                    error = e;
+                }
+                _stopwatch.Stop();
+
+                TimeSpan elapsed = _stopwatch.Elapsed;
+                lock (_timingLock)
+                {
+                    _processed++;
+                    if (error != null)
+                    {
+                        _failed++;
+                    }
+                    _last = elapsed;
+                    _total += elapsed;
+                    if (elapsed > _maximum)
+                    {
+                        _maximum = elapsed;
+                    }
+                }
+
+                Interlocked.Exchange(ref _busy, 0);
+
+                return new DetectorResult(Detector, objects, elapsed, error);
+            }
+
+            public DetectorTiming GetTiming()
+            {
+                lock (_timingLock)
+                {
+                    return new DetectorTiming(Detector, _processed, Interlocked.Read(ref _skipped), _failed, _last, _total, _maximum);
+                }
+            }
+        }
+    }
+
+    /// <summary>
+    /// Outcome of one detector for one frame
+    /// </summary>
+    public class DetectorResult
+    {
+        internal DetectorResult(IObjectDetector detector, ReadOnlyCollection<DetectedObject> objects, TimeSpan duration, Exception error)
+        {
+            Detector = detector;
+            Objects = objects;
+            Duration = duration;
+            Error = error;
+        }
+
+        public IObjectDetector Detector { get; private set; }
+
+        /// <summary>
+        /// Objects found in the frame, null when the detector threw
+        /// </summary>
+        public ReadOnlyCollection<DetectedObject> Objects { get; private set; }
+
+        public TimeSpan Duration { get; private set; }
+
+        public Exception Error { get; private set; }
+    }
+
+    /// <summary>
+    /// Accumulated timing counters of a detector run by a <see cref="DetectorScheduler"/>
+    /// </summary>
+    public class DetectorTiming
+    {
+        internal DetectorTiming(IObjectDetector detector, long framesProcessed, long framesSkipped, long framesFailed, TimeSpan lastDuration, TimeSpan totalDuration, TimeSpan maximumDuration)
+        {
+            Detector = detector;
+            FramesProcessed = framesProcessed;
+            FramesSkipped = framesSkipped;
+            FramesFailed = framesFailed;
+            LastDuration = lastDuration;
+            TotalDuration = totalDuration;
+            MaximumDuration = maximumDuration;
+        }
+
+        public IObjectDetector Detector { get; private set; }
+
+        public long FramesProcessed { get; private set; }
+
+        /// <summary>
+        /// Frames dropped because the detector was still busy with an earlier one
+        /// </summary>
+        public long FramesSkipped { get; private set; }
+
+        public long FramesFailed { get; private set; }
+
+        public TimeSpan LastDuration { get; private set; }
+
+        public TimeSpan TotalDuration { get; private set; }
+
+        public TimeSpan MaximumDuration { get; private set; }
+
+        public TimeSpan AverageDuration
+        {
+            get
+            {
+                return FramesProcessed > 0 ? TimeSpan.FromTicks(TotalDuration.Ticks / FramesProcessed) : TimeSpan.Zero;
+            }
+        }
+
+        public override string ToString()
+        {
+            return String.Format("{0}: {1} processed, {2} skipped, avg {3:0.00} ms, max {4:0.00} ms",
+                Detector.Name, FramesProcessed, FramesSkipped, AverageDuration.TotalMilliseconds, MaximumDuration.TotalMilliseconds);
+        }
+    }
+}
@@ -0,0 +1,69 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Drawing;
+using System.Drawing.Imaging;
+using Touchless.Vision.Contracts;
+using WebCamLib;
+
+namespace Touchless.Vision.Detection
+{
+    /// <summary>
+    /// Pixels as the native detectors take them: the top row, the signed offset to the row below, and 24 or 32 bits per pixel
+    /// </summary>
+    internal delegate int NativeImageHandler(IntPtr top, int width, int height, int stride, int bitsPerPixel);
+
+    /// <summary>
+    /// What the detectors built on WebCamLib share. A frame backed by a pooled buffer is searched in
+    /// place, so the positions found in it are in the buffer's orientation as captured; any other
+    /// frame is searched through the bits of its bitmap.
+    /// </summary>
+    internal static class NativeDetection
+    {
+        /// <summary>
+        /// Hands the frame to searchBuffer when it has a pooled buffer, and its bitmap's bits to searchImage
+        /// otherwise, returning what the one called returns
+        /// </summary>
+        public static int Search(Frame frame, Func<PooledFrame, int> searchBuffer, NativeImageHandler searchImage)
+        {
+            if (frame.Buffer != null)
+            {
+                return searchBuffer(frame.Buffer);
+            }
+
+            return LockBits(frame.OriginalImage, searchImage);
+        }
+
+        /// <summary>
+        /// Locks the bitmap as 32 bit RGB when it is so already and as 24 bit RGB otherwise, for as long as handler runs
+        /// </summary>
+        public static int LockBits(Bitmap image, NativeImageHandler handler)
+        {
+            PixelFormat format = image.PixelFormat == PixelFormat.Format32bppRgb ? PixelFormat.Format32bppRgb : PixelFormat.Format24bppRgb;
+            BitmapData data = image.LockBits(new Rectangle(0, 0, image.Width, image.Height), ImageLockMode.ReadOnly, format);
+
+            try
+            {
+                return handler(data.Scan0, data.Width, data.Height, data.Stride, format == PixelFormat.Format32bppRgb ? 32 : 24);
+            }
+            finally
+            {
+                image.UnlockBits(data);
+            }
+        }
+
+        /// <summary>
+        /// Raises one of a detector's object events once for each of the objects
+        /// </summary>
+        public static void Raise<T>(IObjectDetector detector, Action<IObjectDetector, DetectedObject, Frame> handler, List<T> objects, Frame frame)
+            where T : DetectedObject
+        {
+            if (handler != null)
+            {
+                foreach (T detectedObject in objects)
+                {
+                    handler(detector, detectedObject, frame);
+                }
+            }
+        }
+    }
+}
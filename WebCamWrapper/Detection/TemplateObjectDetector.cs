@@ -0,0 +1,242 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Collections.ObjectModel;
+using System.Drawing;
+using System.Runtime.Serialization;
+using System.Windows;
+using Touchless.Vision.Contracts;
+using WebCamLib;
+
+namespace Touchless.Vision.Detection
+{
+    /// <summary>
+    /// Finds template images in the frames and follows them: a template is new when it is first
+    /// found, moved while it keeps being found, and removed in the first frame it is not. Each
+    /// template is looked for near where it last was before the whole frame is searched, so a
+    /// frame with every template in view costs little.
+    /// </summary>
+    public class TemplateObjectDetector : IObjectDetector, IDisposable
+    {
+        public event Action<IObjectDetector, DetectedObject, Frame> NewObject;
+        public event Action<IObjectDetector, DetectedObject, Frame> ObjectMoved;
+        public event Action<IObjectDetector, DetectedObject, Frame> ObjectRemoved;
+        public event Action<IObjectDetector, Frame, ReadOnlyCollection<DetectedObject>> FrameProcessed;
+
+        private readonly object _syncObject = new object();
+        private readonly TemplateTracker _tracker;
+        private readonly List<string> _names = new List<string>();
+        private readonly List<TemplateLocation> _locations = new List<TemplateLocation>();
+        private readonly Dictionary<int, TemplateDetectedObject> _objects = new Dictionary<int, TemplateDetectedObject>();
+        private readonly List<TemplateDetectedObject> _cleared = new List<TemplateDetectedObject>();
+
+        /// <summary>
+        /// Creates a detector working on the shared native worker pool
+        /// </summary>
+        public TemplateObjectDetector()
+            : this(true)
+        {
+        }
+
+        public TemplateObjectDetector(bool parallel)
+        {
+            _tracker = new TemplateTracker(parallel);
+        }
+
+        public string Name
+        {
+            get { return "Template Matcher"; }
+        }
+
+        public string Description
+        {
+            get { return "Finds template images by normalised cross correlation"; }
+        }
+
+        public bool HasConfiguration
+        {
+            get { return false; }
+        }
+
+        public UIElement ConfigurationElement
+        {
+            get { return null; }
+        }
+
+        public int TemplateCount
+        {
+            get { lock (_syncObject) return _tracker.TemplateCount; }
+        }
+
+        public TemplateMetric Metric
+        {
+            get { lock (_syncObject) return _tracker.Metric; }
+            set { lock (_syncObject) _tracker.Metric = value; }
+        }
+
+        /// <summary>
+        /// Score a template must reach to count as found, at most 1
+        /// </summary>
+        public float MinimumScore
+        {
+            get { lock (_syncObject) return _tracker.MinimumScore; }
+            set { lock (_syncObject) _tracker.MinimumScore = value; }
+        }
+
+        /// <summary>
+        /// Pixels around its last position a template is looked for within before the whole frame
+        /// </summary>
+        public int SearchRadius
+        {
+            get { lock (_syncObject) return _tracker.SearchRadius; }
+            set { lock (_syncObject) _tracker.SearchRadius = value; }
+        }
+
+        /// <summary>
+        /// Adds a template, at least 8 by 8 pixels, and returns its index
+        /// </summary>
+        public int AddTemplate(Bitmap image, string name)
+        {
+            if (image == null) throw new ArgumentNullException("image");
+
+            lock (_syncObject)
+            {
+                int index = NativeDetection.LockBits(image, _tracker.AddTemplate);
+                _names.Add(name);
+                return index;
+            }
+        }
+
+        /// <summary>
+        /// Removes every template; the objects they were found as are removed with the next frame
+        /// </summary>
+        public void ClearTemplates()
+        {
+            lock (_syncObject)
+            {
+                _tracker.ClearTemplates();
+                _names.Clear();
+                _cleared.AddRange(_objects.Values);
+                _objects.Clear();
+            }
+        }
+
+        public ReadOnlyCollection<DetectedObject> DetectObjects(Frame frame)
+        {
+            if (frame == null) throw new ArgumentNullException("frame");
+
+            var moved = new List<TemplateDetectedObject>();
+            var added = new List<TemplateDetectedObject>();
+            var removed = new List<TemplateDetectedObject>();
+            var current = new List<TemplateDetectedObject>();
+
+            lock (_syncObject)
+            {
+                removed.AddRange(_cleared);
+                _cleared.Clear();
+
+                Match(frame);
+
+                foreach (TemplateLocation location in _locations)
+                {
+                    TemplateDetectedObject detectedObject;
+
+                    if (!location.Found)
+                    {
+                        if (_objects.TryGetValue(location.Index, out detectedObject))
+                        {
+                            _objects.Remove(location.Index);
+                            removed.Add(detectedObject);
+                        }
+
+                        continue;
+                    }
+
+                    var bounds = new Rectangle(location.X, location.Y, location.Width, location.Height);
+
+                    if (_objects.TryGetValue(location.Index, out detectedObject))
+                    {
+                        detectedObject.Update(bounds, location.Score);
+                        moved.Add(detectedObject);
+                    }
+                    else
+                    {
+                        detectedObject = new TemplateDetectedObject(location.Index, _names[location.Index], bounds, location.Score);
+                        _objects.Add(location.Index, detectedObject);
+                        added.Add(detectedObject);
+                    }
+
+                    current.Add(detectedObject);
+                }
+            }
+
+            NativeDetection.Raise(this, ObjectRemoved, removed, frame);
+            NativeDetection.Raise(this, ObjectMoved, moved, frame);
+            NativeDetection.Raise(this, NewObject, added, frame);
+
+            var result = new ReadOnlyCollection<DetectedObject>(current.ConvertAll(o => (DetectedObject) o));
+
+            var handler = FrameProcessed;
+            if (handler != null)
+            {
+                handler(this, frame, result);
+            }
+
+            return result;
+        }
+
+        public void Dispose()
+        {
+            lock (_syncObject)
+            {
+                _tracker.Dispose();
+            }
+        }
+
+        private void Match(Frame frame)
+        {
+            NativeDetection.Search(frame, _tracker.Match, _tracker.Match);
+
+            _locations.Clear();
+            for (int i = 0; i < _tracker.TemplateCount; i++)
+            {
+                _locations.Add(_tracker.GetLocation(i));
+            }
+        }
+    }
+
+    /// <summary>
+    /// A template found by a <see cref="TemplateObjectDetector"/>; its position is the centre of its bounds
+    /// </summary>
+    [DataContract]
+    public class TemplateDetectedObject : DetectedObject
+    {
+        internal TemplateDetectedObject(int templateIndex, string name, Rectangle bounds, float score)
+        {
+            TemplateIndex = templateIndex;
+            Name = name;
+            Update(bounds, score);
+        }
+
+        [DataMember]
+        public int TemplateIndex { get; private set; }
+
+        [DataMember]
+        public string Name { get; private set; }
+
+        [DataMember]
+        public Rectangle Bounds { get; private set; }
+
+        /// <summary>
+        /// How well the template matched, by the detector's metric
+        /// </summary>
+        [DataMember]
+        public float Score { get; private set; }
+
+        internal void Update(Rectangle bounds, float score)
+        {
+            Bounds = bounds;
+            Score = score;
+            Position = new System.Drawing.Point(bounds.X + bounds.Width / 2, bounds.Y + bounds.Height / 2);
+        }
+    }
+}
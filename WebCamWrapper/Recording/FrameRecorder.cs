@@ -0,0 +1,294 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Drawing;
+using System.Drawing.Imaging;
+using System.IO;
+using Touchless.Vision.Contracts;
+using WebCamLib;
+
+namespace Touchless.Vision.Recording
+{
+    /// <summary>
+    /// Records frames of mostly static scenes to a stream. Every <see cref="KeyframeInterval"/> frames
+    /// a whole frame is stored; in between only the tiles which changed, without loss. An index of the
+    /// keyframes is appended on <see cref="Close"/>, which <see cref="FrameRecording"/> uses to seek;
+    /// a recording cut short without one is still readable, the index being rebuilt on open.
+    /// Frames are encoded and written on the calling thread.
+    /// </summary>
+    public class FrameRecorder : IDisposable
+    {
+        public const int DefaultKeyframeInterval = 150;
+
+        internal const int FileMagic = 0x43524C54;
+        internal const int IndexMagic = 0x49524C54;
+        internal const int Version = 1;
+        internal const int FlagKeyframe = 1;
+
+        // Length, flags and timestamp ahead of each frame's data
+        private const int FrameHeaderLength = 16;
+
+        private readonly object _syncObject = new object();
+        private readonly Stream _stream;
+        private readonly bool _ownsStream;
+        private readonly BinaryWriter _writer;
+        private readonly DeltaFrameCodec _codec = new DeltaFrameCodec();
+        private readonly List<RecordingKeyframe> _keyframes = new List<RecordingKeyframe>();
+        private byte[] _buffer = new byte[0];
+        private int _frameCount;
+        private int _framesSinceKeyframe;
+        private long _position;
+        private bool _closed;
+
+        /// <summary>
+        /// Records to a new file, replacing any file of that name
+        /// </summary>
+        public FrameRecorder(string path)
+            : this(new FileStream(path, FileMode.Create, FileAccess.Write, FileShare.Read, 64 * 1024), true)
+        {
+        }
+
+        /// <summary>
+        /// Records to a stream, which is left open on Close. The stream need not be seekable: the
+        /// recorder counts the bytes it writes, from the stream's position when it can tell one.
+        /// </summary>
+        public FrameRecorder(Stream stream)
+            : this(stream, false)
+        {
+        }
+
+        private FrameRecorder(Stream stream, bool ownsStream)
+        {
+            if (stream == null) throw new ArgumentNullException("stream");
+            if (!stream.CanWrite) throw new ArgumentException("The stream cannot be written.", "stream");
+
+            _stream = stream;
+            _ownsStream = ownsStream;
+            _writer = new BinaryWriter(stream);
+            _position = stream.CanSeek ? stream.Position : 0;
+            KeyframeInterval = DefaultKeyframeInterval;
+
+            _writer.Write(FileMagic);
+            _writer.Write(Version);
+            _position += 8;
+        }
+
+        /// <summary>
+        /// Frames from one keyframe to the next. Seeking decodes up to this many frames, so it bounds
+        /// the cost of a seek as well as the space saved.
+        /// </summary>
+        public int KeyframeInterval { get; set; }
+
+        /// <summary>
+        /// Mean difference per byte above which a tile is stored, see <see cref="DeltaFrameCodec.ChangeThreshold"/>
+        /// </summary>
+        public int ChangeThreshold
+        {
+            get { return _codec.ChangeThreshold; }
+            set { _codec.ChangeThreshold = value; }
+        }
+
+        /// <summary>
+        /// Difference of one byte above which its tile is stored, see <see cref="DeltaFrameCodec.PeakThreshold"/>
+        /// </summary>
+        public int PeakThreshold
+        {
+            get { return _codec.PeakThreshold; }
+            set { _codec.PeakThreshold = value; }
+        }
+
+        public int FrameCount
+        {
+            get { return _frameCount; }
+        }
+
+        public int KeyframeCount
+        {
+            get { return _keyframes.Count; }
+        }
+
+        /// <summary>
+        /// Share of the tiles stored by the last frame, 1 for a keyframe
+        /// </summary>
+        public double LastChangedFraction
+        {
+            get
+            {
+                lock (_syncObject)
+                {
+                    return _codec.TileCount > 0 ? (double) _codec.ChangedTiles / _codec.TileCount : 0.0;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Records a captured frame, stamped with its capture time
+        /// </summary>
+        public void Write(PooledFrame frame)
+        {
+            if (frame == null) throw new ArgumentNullException("frame");
+
+            Write(frame.Scan0, frame.Width, frame.Height, frame.Stride, frame.BitsPerPixel, frame.Timestamp);
+        }
+
+        public void Write(Frame frame)
+        {
+            if (frame == null) throw new ArgumentNullException("frame");
+
+            if (frame.Buffer != null)
+            {
+                Write(frame.Buffer);
+            }
+            else
+            {
+                Write(frame.OriginalImage, Stopwatch.GetTimestamp());
+            }
+        }
+
+        /// <summary>
+        /// Records an image; formats other than 32 bit RGB are stored as 24 bit
+        /// </summary>
+        public void Write(Bitmap image, long timestamp)
+        {
+            if (image == null) throw new ArgumentNullException("image");
+
+            PixelFormat format = image.PixelFormat == PixelFormat.Format32bppRgb ? PixelFormat.Format32bppRgb : PixelFormat.Format24bppRgb;
+            BitmapData data = image.LockBits(new Rectangle(0, 0, image.Width, image.Height), ImageLockMode.ReadOnly, format);
+
+            try
+            {
+                Write(data.Scan0, data.Width, data.Height, data.Stride, format == PixelFormat.Format32bppRgb ? 32 : 24, timestamp);
+            }
+            finally
+            {
+                image.UnlockBits(data);
+            }
+        }
+
+        /// <summary>
+        /// Records an image given as in <see cref="BitmapData"/>, stamped with Stopwatch ticks
+        /// </summary>
+        public void Write(IntPtr scan0, int width, int height, int stride, int bitsPerPixel, long timestamp)
+        {
+            lock (_syncObject)
+            {
+                if (_closed) throw new ObjectDisposedException("FrameRecorder");
+
+                int capacity = DeltaFrameCodec.GetMaximumEncodedSize(width, height);
+                if (_buffer.Length < capacity)
+                {
+                    _buffer = new byte[capacity];
+                }
+
+                bool keyframe = _frameCount == 0 || _framesSinceKeyframe + 1 >= KeyframeInterval;
+                int length = _codec.Encode(scan0, width, height, stride, bitsPerPixel, keyframe, _buffer, 0);
+
+                // The codec starts over by itself when the size changes
+                keyframe = DeltaFrameCodec.IsKeyframe(_buffer, 0, length);
+
+                if (keyframe)
+                {
+                    _keyframes.Add(new RecordingKeyframe(_frameCount, _position, timestamp));
+                    _framesSinceKeyframe = 0;
+                }
+                else
+                {
+                    _framesSinceKeyframe++;
+                }
+
+                _writer.Write(length);
+                _writer.Write(keyframe ? FlagKeyframe : 0);
+                _writer.Write(timestamp);
+                _writer.Write(_buffer, 0, length);
+                _position += FrameHeaderLength + length;
+
+                _frameCount++;
+            }
+        }
+
+        /// <summary>
+        /// Appends the keyframe index and ends the recording. The stream, when the recorder opened it,
+        /// and the codec are released even if writing the index fails.
+        /// </summary>
+        public void Close()
+        {
+            lock (_syncObject)
+            {
+                if (_closed)
+                    return;
+
+                _closed = true;
+
+                try
+                {
+                    long indexOffset = _position;
+
+                    _writer.Write(_keyframes.Count);
+                    foreach (RecordingKeyframe keyframe in _keyframes)
+                    {
+                        _writer.Write(keyframe.FrameNumber);
+                        _writer.Write(keyframe.Offset);
+                        _writer.Write(keyframe.Timestamp);
+                    }
+
+                    _writer.Write(indexOffset);
+                    _writer.Write(_frameCount);
+                    _writer.Write(IndexMagic);
+                    _writer.Flush();
+                }
+                finally
+                {
+                    if (_ownsStream)
+                    {
+                        _stream.Dispose();
+                    }
+
+                    _codec.Dispose();
+                }
+            }
+        }
+
+        public void Dispose()
+        {
+            Close();
+        }
+    }
+
+    /// <summary>
+    /// Where a keyframe starts in a recording
+    /// </summary>
+    public struct RecordingKeyframe
+    {
+        private readonly int _frameNumber;
+        private readonly long _offset;
+        private readonly long _timestamp;
+
+        public RecordingKeyframe(int frameNumber, long offset, long timestamp)
+        {
+            _frameNumber = frameNumber;
+            _offset = offset;
+            _timestamp = timestamp;
+        }
+
+        public int FrameNumber
+        {
+            get { return _frameNumber; }
+        }
+
+        /// <summary>
+        /// Stream position of the frame's record
+        /// </summary>
+        public long Offset
+        {
+            get { return _offset; }
+        }
+
+        /// <summary>
+        /// Stopwatch ticks, taken when the frame was captured
+        /// </summary>
+        public long Timestamp
+        {
+            get { return _timestamp; }
+        }
+    }
+}
@@ -0,0 +1,304 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Collections.ObjectModel;
+using System.Drawing;
+using System.Drawing.Imaging;
+using System.IO;
+using WebCamLib;
+
+namespace Touchless.Vision.Recording
+{
+    /// <summary>
+    /// Plays back a recording made by <see cref="FrameRecorder"/>. Frames read in order cost one
+    /// decode each; <see cref="Seek"/> jumps to the keyframe at or before the frame asked for and
+    /// decodes forward from there.
+    /// </summary>
+    public class FrameRecording : IDisposable
+    {
+        private const int RecordHeaderLength = 16;
+        private const int TrailerLength = 16;
+
+        private readonly Stream _stream;
+        private readonly bool _ownsStream;
+        private readonly BinaryReader _reader;
+        private readonly DeltaFrameCodec _codec = new DeltaFrameCodec();
+        private readonly long _dataStart;
+        private List<RecordingKeyframe> _keyframes;
+        private int _frameCount;
+        private byte[] _buffer = new byte[0];
+        private Bitmap _image;
+        private int _position;
+        private long _timestamp;
+        private bool _disposed;
+
+        public FrameRecording(string path)
+            : this(new FileStream(path, FileMode.Open, FileAccess.Read, FileShare.ReadWrite, 64 * 1024), true)
+        {
+        }
+
+        /// <summary>
+        /// Reads a recording from a seekable stream, which is left open on Dispose
+        /// </summary>
+        public FrameRecording(Stream stream)
+            : this(stream, false)
+        {
+        }
+
+        private FrameRecording(Stream stream, bool ownsStream)
+        {
+            if (stream == null) throw new ArgumentNullException("stream");
+            if (!stream.CanRead || !stream.CanSeek) throw new ArgumentException("The stream must be readable and seekable.", "stream");
+
+            _stream = stream;
+            _ownsStream = ownsStream;
+            _reader = new BinaryReader(stream);
+
+            if (stream.Length < 8 || _reader.ReadInt32() != FrameRecorder.FileMagic)
+                throw new InvalidDataException("The stream is not a frame recording.");
+
+            if (_reader.ReadInt32() != FrameRecorder.Version)
+                throw new InvalidDataException("The recording was made by a newer version.");
+
+            _dataStart = stream.Position;
+
+            if (!ReadIndex())
+            {
+                RebuildIndex();
+            }
+
+            _stream.Position = _dataStart;
+        }
+
+        public int FrameCount
+        {
+            get { return _frameCount; }
+        }
+
+        public ReadOnlyCollection<RecordingKeyframe> Keyframes
+        {
+            get { return _keyframes.AsReadOnly(); }
+        }
+
+        /// <summary>
+        /// Number of the frame ReadFrame returns next
+        /// </summary>
+        public int Position
+        {
+            get { return _position; }
+        }
+
+        /// <summary>
+        /// Stopwatch ticks at which the frame last read was captured
+        /// </summary>
+        public long Timestamp
+        {
+            get { return _timestamp; }
+        }
+
+        /// <summary>
+        /// Makes the given frame the next one read
+        /// </summary>
+        public void Seek(int frameNumber)
+        {
+            if (_disposed) throw new ObjectDisposedException("FrameRecording");
+            if (frameNumber < 0 || frameNumber > _frameCount) throw new ArgumentOutOfRangeException("frameNumber");
+
+            if (_frameCount == 0)
+                return;
+
+            // Reading on from where we are beats going back to a keyframe when it is no further
+            RecordingKeyframe keyframe = FindKeyframe(frameNumber);
+            if (frameNumber < _position || keyframe.FrameNumber > _position)
+            {
+                _stream.Position = keyframe.Offset;
+                _position = keyframe.FrameNumber;
+                _codec.Reset();
+            }
+
+            while (_position < frameNumber)
+            {
+                ReadRecord();
+            }
+        }
+
+        /// <summary>
+        /// Returns the next frame as a new bitmap, or null at the end of the recording
+        /// </summary>
+        public Bitmap ReadFrame()
+        {
+            if (_disposed) throw new ObjectDisposedException("FrameRecording");
+
+            if (_position >= _frameCount)
+                return null;
+
+            ReadRecord();
+
+            return (Bitmap) _image.Clone();
+        }
+
+        public void Dispose()
+        {
+            if (_disposed)
+                return;
+
+            _disposed = true;
+
+            if (_image != null)
+            {
+                _image.Dispose();
+                _image = null;
+            }
+
+            _codec.Dispose();
+
+            if (_ownsStream)
+            {
+                _stream.Dispose();
+            }
+        }
+
+        private RecordingKeyframe FindKeyframe(int frameNumber)
+        {
+            int low = 0;
+            int high = _keyframes.Count - 1;
+
+            // The last keyframe at or before the frame; the first frame is always one
+            while (low < high)
+            {
+                int middle = (low + high + 1) / 2;
+                if (_keyframes[middle].FrameNumber <= frameNumber)
+                {
+                    low = middle;
+                }
+                else
+                {
+                    high = middle - 1;
+                }
+            }
+
+            return _keyframes[low];
+        }
+
+        private void ReadRecord()
+        {
+            int length = _reader.ReadInt32();
+            _reader.ReadInt32();
+            long timestamp = _reader.ReadInt64();
+
+            if (length <= 0 || length > _stream.Length - _stream.Position)
+                throw new InvalidDataException("The recording is damaged at frame " + _position + ".");
+
+            if (_buffer.Length < length)
+            {
+                _buffer = new byte[length];
+            }
+
+            for (int read = 0; read < length; )
+            {
+                int count = _stream.Read(_buffer, read, length - read);
+                if (count == 0)
+                    throw new EndOfStreamException();
+
+                read += count;
+            }
+
+            Tuple<int, int, int> size = DeltaFrameCodec.GetFrameSize(_buffer, 0, length);
+            PixelFormat format = size.Item3 == 32 ? PixelFormat.Format32bppRgb : PixelFormat.Format24bppRgb;
+
+            if (_image == null || _image.Width != size.Item1 || _image.Height != size.Item2 || _image.PixelFormat != format)
+            {
+                if (_image != null)
+                {
+                    _image.Dispose();
+                }
+
+                _image = new Bitmap(size.Item1, size.Item2, format);
+            }
+
+            BitmapData data = _image.LockBits(new Rectangle(0, 0, _image.Width, _image.Height), ImageLockMode.WriteOnly, format);
+            try
+            {
+                _codec.Decode(_buffer, 0, length, data.Scan0, data.Stride);
+            }
+            finally
+            {
+                _image.UnlockBits(data);
+            }
+
+            _timestamp = timestamp;
+            _position++;
+        }
+
+        /// <summary>
+        /// Reads the index written by FrameRecorder.Close; false when there is none
+        /// </summary>
+        private bool ReadIndex()
+        {
+            if (_stream.Length - _dataStart < TrailerLength + 4)
+                return false;
+
+            _stream.Position = _stream.Length - TrailerLength;
+            long indexOffset = _reader.ReadInt64();
+            int frameCount = _reader.ReadInt32();
+
+            if (_reader.ReadInt32() != FrameRecorder.IndexMagic || indexOffset < _dataStart || indexOffset > _stream.Length - TrailerLength - 4)
+                return false;
+
+            _stream.Position = indexOffset;
+            int count = _reader.ReadInt32();
+
+            if (count < 0 || count > (_stream.Length - TrailerLength - _stream.Position) / 20)
+                return false;
+
+            var keyframes = new List<RecordingKeyframe>(count);
+            for (int i = 0; i < count; i++)
+            {
+                keyframes.Add(new RecordingKeyframe(_reader.ReadInt32(), _reader.ReadInt64(), _reader.ReadInt64()));
+            }
+
+            if (frameCount > 0 && count == 0)
+                return false;
+
+            _keyframes = keyframes;
+            _frameCount = frameCount;
+
+            return true;
+        }
+
+        /// <summary>
+        /// Walks the records of a recording that was never closed, keeping every whole frame
+        /// </summary>
+        private void RebuildIndex()
+        {
+            var keyframes = new List<RecordingKeyframe>();
+            long offset = _dataStart;
+            int frameCount = 0;
+
+            while (_stream.Length - offset >= RecordHeaderLength)
+            {
+                _stream.Position = offset;
+                int length = _reader.ReadInt32();
+                int flags = _reader.ReadInt32();
+                long timestamp = _reader.ReadInt64();
+
+                if (length <= 0 || length > _stream.Length - offset - RecordHeaderLength)
+                    break;
+
+                if ((flags & FrameRecorder.FlagKeyframe) != 0)
+                {
+                    keyframes.Add(new RecordingKeyframe(frameCount, offset, timestamp));
+                }
+                else if (keyframes.Count == 0)
+                {
+                    break;
+                }
+
+                offset += RecordHeaderLength + length;
+                frameCount++;
+            }
+
+            _keyframes = keyframes;
+            _frameCount = frameCount;
+        }
+    }
+}
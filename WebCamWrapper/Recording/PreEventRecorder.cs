@@ -0,0 +1,271 @@
+﻿using System;
+using System.Diagnostics;
+using System.Runtime.InteropServices;
+using System.Threading;
+using WebCamLib;
+
+namespace Touchless.Vision.Recording
+{
+    /// <summary>
+    /// Records the seconds a <see cref="PreEventBuffer"/> holds ahead of a trigger and the frames
+    /// captured for <see cref="PostEventDuration"/> after it. Each recording is drained from the
+    /// buffer on a thread of its own, so capture is never held up by encoding or disk writes;
+    /// a trigger while recording only moves the end out.
+    /// </summary>
+    public class PreEventRecorder : IDisposable
+    {
+        /// <summary>
+        /// Raised on the recording thread once a recording is complete and its recorder closed
+        /// </summary>
+        public event Action<PreEventRecorder, FrameRecorder> RecordingCompleted;
+
+        private const int PollInterval = 100;
+
+        private readonly object _syncObject = new object();
+        private readonly PreEventBuffer _buffer;
+        private readonly Func<FrameRecorder> _createRecorder;
+        private Thread _thread;
+        private Thread _closingThread;
+        private long _endTimestamp;
+        private volatile bool _stopRequested;
+        private int _lostFrames;
+        private volatile Exception _lastError;
+        private bool _disposed;
+
+        /// <summary>
+        /// Records from the buffer into a new recorder for each event
+        /// </summary>
+        public PreEventRecorder(PreEventBuffer buffer, Func<FrameRecorder> createRecorder)
+        {
+            if (buffer == null) throw new ArgumentNullException("buffer");
+            if (createRecorder == null) throw new ArgumentNullException("createRecorder");
+
+            _buffer = buffer;
+            _createRecorder = createRecorder;
+            PostEventDuration = TimeSpan.FromSeconds(5);
+        }
+
+        /// <summary>
+        /// How long recording goes on after the last trigger
+        /// </summary>
+        public TimeSpan PostEventDuration { get; set; }
+
+        public bool IsRecording
+        {
+            get
+            {
+                lock (_syncObject)
+                {
+                    return _thread != null;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Frames of the current or last recording which left the buffer before they were written,
+        /// because the recorder fell behind by more than the buffer holds
+        /// </summary>
+        public int LostFrames
+        {
+            get { return Thread.VolatileRead(ref _lostFrames); }
+        }
+
+        /// <summary>
+        /// What ended the last recording early, e.g. a full disk, or failed to finish its file; null
+        /// when it ran its course. When both happen, the first is kept.
+        /// </summary>
+        public Exception LastError
+        {
+            get { return _lastError; }
+        }
+
+        /// <summary>
+        /// Starts a recording with the frames held now, or extends the one under way
+        /// </summary>
+        public void Trigger()
+        {
+            lock (_syncObject)
+            {
+                if (_disposed) throw new ObjectDisposedException("PreEventRecorder");
+
+                long end = Stopwatch.GetTimestamp() + (long) (PostEventDuration.TotalSeconds * Stopwatch.Frequency);
+
+                if (end > Interlocked.Read(ref _endTimestamp))
+                {
+                    Interlocked.Exchange(ref _endTimestamp, end);
+                }
+
+                if (_thread == null)
+                {
+                    // Opened here, so the recording starts with what the buffer holds at the trigger
+                    PreEventReader reader = _buffer.OpenReader();
+                    FrameRecorder recorder;
+
+                    try
+                    {
+                        recorder = _createRecorder();
+                    }
+                    catch
+                    {
+                        reader.Dispose();
+                        throw;
+                    }
+
+                    _stopRequested = false;
+                    _lostFrames = 0;
+                    _lastError = null;
+                    _thread = new Thread(() => Record(reader, recorder));
+                    _thread.Name = "Pre-event recorder";
+                    _thread.IsBackground = true;
+                    _thread.Start();
+                }
+            }
+        }
+
+        /// <summary>
+        /// Ends the recording under way, if any, and waits for it to be closed
+        /// </summary>
+        public void Stop()
+        {
+            Thread thread;
+            Thread closingThread;
+
+            lock (_syncObject)
+            {
+                thread = _thread;
+                closingThread = _closingThread;
+                _stopRequested = true;
+            }
+
+            foreach (Thread pending in new[] { thread, closingThread })
+            {
+                if (pending != null && pending != Thread.CurrentThread)
+                {
+                    pending.Join();
+                }
+            }
+        }
+
+        public void Dispose()
+        {
+            lock (_syncObject)
+            {
+                _disposed = true;
+            }
+
+            Stop();
+        }
+
+        private void Record(PreEventReader reader, FrameRecorder recorder)
+        {
+            IntPtr pixels = IntPtr.Zero;
+            int capacity = 0;
+
+            try
+            {
+                while (!_stopRequested)
+                {
+                    if (!reader.MoveNext(PollInterval))
+                    {
+                        // Nothing is coming, e.g. the camera stopped; the event still ends on time
+                        if (EndRecording(Stopwatch.GetTimestamp()))
+                            break;
+
+                        continue;
+                    }
+
+                    if (EndRecording(reader.Timestamp))
+                        break;
+
+                    int stride = ((reader.Width * reader.BitsPerPixel + 31) / 32) * 4;
+                    int size = stride * reader.Height;
+
+                    if (capacity < size)
+                    {
+                        if (pixels != IntPtr.Zero)
+                        {
+                            Marshal.FreeHGlobal(pixels);
+                            pixels = IntPtr.Zero;
+                        }
+
+                        pixels = Marshal.AllocHGlobal(size);
+                        capacity = size;
+                    }
+
+                    if (reader.Decode(pixels, stride))
+                    {
+                        recorder.Write(pixels, reader.Width, reader.Height, stride, reader.BitsPerPixel, reader.Timestamp);
+                    }
+
+                    Thread.VolatileWrite(ref _lostFrames, reader.LostFrames);
+                }
+            }
+            catch (Exception e)
+            {
+                // Nobody is there to catch it on this thread
+                _lastError = e;
+                EndRecording(long.MaxValue);
+            }
+            finally
+            {
+                if (pixels != IntPtr.Zero)
+                {
+                    Marshal.FreeHGlobal(pixels);
+                }
+
+                Thread.VolatileWrite(ref _lostFrames, reader.LostFrames);
+                reader.Dispose();
+
+                try
+                {
+                    recorder.Close();
+                }
+                catch (Exception e)
+                {
+                    // Closing after a failed write fails too, more often than not; the write says why
+                    if (_lastError == null)
+                    {
+                        _lastError = e;
+                    }
+                }
+
+                lock (_syncObject)
+                {
+                    if (_thread == Thread.CurrentThread)
+                    {
+                        _thread = null;
+                    }
+
+                    if (_closingThread == Thread.CurrentThread)
+                    {
+                        _closingThread = null;
+                    }
+                }
+            }
+
+            var handler = this.RecordingCompleted;
+            if (handler != null)
+            {
+                handler(this, recorder);
+            }
+        }
+
+        /// <summary>
+        /// Decides under the lock whether the recording is over by a given time, so that a trigger
+        /// either extends it or, once it is over, starts the next one
+        /// </summary>
+        private bool EndRecording(long timestamp)
+        {
+            lock (_syncObject)
+            {
+                if (timestamp <= Interlocked.Read(ref _endTimestamp) && !_stopRequested)
+                    return false;
+
+                _closingThread = _thread;
+                _thread = null;
+
+                return true;
+            }
+        }
+    }
+}
@@ -0,0 +1,518 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Net;
+using System.Net.Sockets;
+using System.Text;
+using System.Threading;
+using Touchless.Vision.Contracts;
+
+namespace Touchless.Vision.Streaming
+{
+    /// <summary>
+    /// Embedded HTTP server publishing frame sources as multipart/x-mixed-replace MJPEG streams, one per
+    /// name at http://host:port/name. A client can ask for its own size and quality with the width,
+    /// height, quality and fps query parameters, e.g. /front?width=320&amp;quality=60&amp;fps=10.
+    /// Each frame is encoded once per distinct size and quality among the clients ready for it, and a
+    /// client whose socket has not taken the previous frame yet skips this one rather than queueing it.
+    /// </summary>
+    public class MjpegServer : IDisposable
+    {
+        public const int DefaultQuality = 75;
+        public const int DefaultRequestTimeout = 10000;
+
+        private const int MaximumRequestLength = 8192;
+
+        private readonly object _syncObject = new object();
+        private readonly TcpListener _listener;
+        private readonly Dictionary<string, MjpegStream> _streams = new Dictionary<string, MjpegStream>(StringComparer.OrdinalIgnoreCase);
+        private volatile bool _running;
+        private bool _disposed;
+
+        public MjpegServer(int port)
+            : this(IPAddress.Any, port)
+        {
+        }
+
+        public MjpegServer(IPAddress address, int port)
+        {
+            if (address == null) throw new ArgumentNullException("address");
+
+            _listener = new TcpListener(address, port);
+            Quality = DefaultQuality;
+            SendBufferSize = 64 * 1024;
+            RequestTimeout = DefaultRequestTimeout;
+        }
+
+        /// <summary>
+        /// JPEG quality, 1 to 100, for clients which do not ask for one
+        /// </summary>
+        public int Quality { get; set; }
+
+        /// <summary>
+        /// Socket send buffer of each client. The smaller it is, the sooner a slow client starts
+        /// skipping frames instead of having them pile up in the network stack.
+        /// </summary>
+        public int SendBufferSize { get; set; }
+
+        /// <summary>
+        /// Milliseconds a client has from connecting to the end of its request header before it is
+        /// disconnected, so one which never finishes its request does not hold a socket forever
+        /// </summary>
+        public int RequestTimeout { get; set; }
+
+        public bool IsRunning
+        {
+            get { return _running; }
+        }
+
+        /// <summary>
+        /// Address and port the server listens on; the port is only known after Start when 0 was given
+        /// </summary>
+        public IPEndPoint LocalEndpoint
+        {
+            get { return (IPEndPoint) _listener.LocalEndpoint; }
+        }
+
+        /// <summary>
+        /// Clients currently streaming, over all sources
+        /// </summary>
+        public int ClientCount
+        {
+            get
+            {
+                int result = 0;
+
+                lock (_syncObject)
+                {
+                    foreach (MjpegStream stream in _streams.Values)
+                    {
+                        result += stream.ClientCount;
+                    }
+                }
+
+                return result;
+            }
+        }
+
+        /// <summary>
+        /// JPEG images encoded so far, over all sources and sizes
+        /// </summary>
+        public long FramesEncoded
+        {
+            get
+            {
+                long result = 0;
+
+                lock (_syncObject)
+                {
+                    foreach (MjpegStream stream in _streams.Values)
+                    {
+                        result += stream.FramesEncoded;
+                    }
+                }
+
+                return result;
+            }
+        }
+
+        /// <summary>
+        /// Serves the frames of a source at /name. The source has to be capturing for clients to get anything.
+        /// </summary>
+        public void AddSource(string name, IFrameSource source)
+        {
+            if (name == null) throw new ArgumentNullException("name");
+            if (source == null) throw new ArgumentNullException("source");
+            if (name.Length == 0 || name.IndexOfAny(new[] { '/', '?', ' ' }) >= 0) throw new ArgumentException("Name must be a single path segment.", "name");
+
+            lock (_syncObject)
+            {
+                if (_disposed) throw new ObjectDisposedException("MjpegServer");
+                if (_streams.ContainsKey(name)) throw new ArgumentException("A source named " + name + " is already served.", "name");
+
+                _streams.Add(name, new MjpegStream(this, source));
+            }
+        }
+
+        /// <summary>
+        /// Stops serving a source and disconnects its clients
+        /// </summary>
+        public bool RemoveSource(string name)
+        {
+            MjpegStream stream;
+
+            lock (_syncObject)
+            {
+                if (name == null || !_streams.TryGetValue(name, out stream))
+                    return false;
+
+                _streams.Remove(name);
+            }
+
+            stream.Detach();
+
+            return true;
+        }
+
+        public void Start()
+        {
+            lock (_syncObject)
+            {
+                if (_disposed) throw new ObjectDisposedException("MjpegServer");
+                if (_running)
+                    return;
+
+                _listener.Start();
+                _running = true;
+            }
+
+            BeginAccept();
+        }
+
+        /// <summary>
+        /// Stops listening and disconnects every client; sources stay registered for the next Start
+        /// </summary>
+        public void Stop()
+        {
+            MjpegStream[] streams;
+
+            lock (_syncObject)
+            {
+                if (!_running)
+                    return;
+
+                _running = false;
+                _listener.Stop();
+
+                streams = new MjpegStream[_streams.Count];
+                _streams.Values.CopyTo(streams, 0);
+            }
+
+            foreach (MjpegStream stream in streams)
+            {
+                stream.CloseClients();
+            }
+        }
+
+        public void Dispose()
+        {
+            Stop();
+
+            MjpegStream[] streams;
+
+            lock (_syncObject)
+            {
+                if (_disposed)
+                    return;
+
+                _disposed = true;
+
+                streams = new MjpegStream[_streams.Count];
+                _streams.Values.CopyTo(streams, 0);
+                _streams.Clear();
+            }
+
+            foreach (MjpegStream stream in streams)
+            {
+                stream.Detach();
+            }
+        }
+
+        private void BeginAccept()
+        {
+            try
+            {
+                _listener.BeginAcceptTcpClient(OnAccept, null);
+            }
+            catch (ObjectDisposedException)
+            {
+                // Stopped in the meantime
+            }
+            catch (InvalidOperationException)
+            {
+            }
+        }
+
+        private void OnAccept(IAsyncResult result)
+        {
+            TcpClient client = null;
+
+            try
+            {
+                client = _listener.EndAcceptTcpClient(result);
+            }
+            catch (ObjectDisposedException)
+            {
+                return;
+            }
+            catch (SocketException)
+            {
+                // A connection reset before it was accepted; keep listening
+            }
+
+            if (!_running)
+            {
+                if (client != null)
+                {
+                    client.Close();
+                }
+
+                return;
+            }
+
+            BeginAccept();
+
+            if (client != null)
+            {
+                new RequestReader(this, client).Begin();
+            }
+        }
+
+        private void OnRequest(TcpClient client, string requestLine)
+        {
+            // GET /name?query HTTP/1.1
+            string[] parts = requestLine.Split(' ');
+            if (parts.Length != 3 || !parts[2].StartsWith("HTTP/", StringComparison.Ordinal))
+            {
+                Reject(client, "400 Bad Request");
+                return;
+            }
+
+            if (parts[0] != "GET")
+            {
+                Reject(client, "405 Method Not Allowed");
+                return;
+            }
+
+            string target = parts[1];
+            string query = String.Empty;
+
+            int queryStart = target.IndexOf('?');
+            if (queryStart >= 0)
+            {
+                query = target.Substring(queryStart + 1);
+                target = target.Substring(0, queryStart);
+            }
+
+            MjpegStream stream;
+            lock (_syncObject)
+            {
+                _streams.TryGetValue(target.Trim('/'), out stream);
+            }
+
+            if (stream == null)
+            {
+                Reject(client, "404 Not Found");
+                return;
+            }
+
+            MjpegClientOptions options;
+            if (!MjpegClientOptions.TryParse(query, out options))
+            {
+                Reject(client, "400 Bad Request");
+                return;
+            }
+
+            client.NoDelay = true;
+            client.SendBufferSize = SendBufferSize;
+
+            stream.AddClient(client, options);
+        }
+
+        private static void Reject(TcpClient client, string status)
+        {
+            byte[] response = Encoding.ASCII.GetBytes("HTTP/1.0 " + status + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+
+            try
+            {
+                // Small enough for the socket buffer, so this never waits on the client
+                client.GetStream().Write(response, 0, response.Length);
+            }
+            catch (IOException)
+            {
+            }
+            catch (ObjectDisposedException)
+            {
+            }
+
+            client.Close();
+        }
+
+        /// <summary>
+        /// Reads a request header without holding a thread, up to the blank line ending it or the
+        /// server's RequestTimeout, whichever comes first
+        /// </summary>
+        private sealed class RequestReader
+        {
+            private readonly MjpegServer _server;
+            private readonly TcpClient _client;
+            private readonly byte[] _buffer = new byte[MaximumRequestLength];
+            private readonly Timer _deadline;
+            private int _length;
+            private int _finished;
+
+            public RequestReader(MjpegServer server, TcpClient client)
+            {
+                _server = server;
+                _client = client;
+
+                // Armed once assigned, as a deadline of 0 could fire before the constructor returns
+                _deadline = new Timer(OnDeadline, null, Timeout.Infinite, Timeout.Infinite);
+                _deadline.Change(server.RequestTimeout, Timeout.Infinite);
+            }
+
+            /// <summary>
+            /// True for the one caller which gets to answer or close the client, either the read
+            /// which completed the request or the deadline
+            /// </summary>
+            private bool Finish()
+            {
+                if (Interlocked.Exchange(ref _finished, 1) != 0)
+                    return false;
+
+                _deadline.Dispose();
+
+                return true;
+            }
+
+            private void Close()
+            {
+                if (Finish())
+                {
+                    _client.Close();
+                }
+            }
+
+            private void OnDeadline(object state)
+            {
+                // Closing the socket ends the pending read, which then finds the reader finished
+                if (Finish())
+                {
+                    Reject(_client, "408 Request Timeout");
+                }
+            }
+
+            public void Begin()
+            {
+                try
+                {
+                    _client.GetStream().BeginRead(_buffer, _length, _buffer.Length - _length, OnRead, null);
+                }
+                catch (IOException)
+                {
+                    Close();
+                }
+                catch (ObjectDisposedException)
+                {
+                    Close();
+                }
+                catch (InvalidOperationException)
+                {
+                    Close();
+                }
+            }
+
+            private void OnRead(IAsyncResult result)
+            {
+                int read;
+
+                try
+                {
+                    read = _client.GetStream().EndRead(result);
+                }
+                catch (IOException)
+                {
+                    read = 0;
+                }
+                catch (ObjectDisposedException)
+                {
+                    read = 0;
+                }
+                catch (InvalidOperationException)
+                {
+                    read = 0;
+                }
+
+                if (read == 0 || !_server._running)
+                {
+                    Close();
+                    return;
+                }
+
+                _length += read;
+
+                string header = Encoding.ASCII.GetString(_buffer, 0, _length);
+                if (header.IndexOf("\r\n\r\n", StringComparison.Ordinal) >= 0)
+                {
+                    if (Finish())
+                    {
+                        _server.OnRequest(_client, header.Substring(0, header.IndexOf("\r\n", StringComparison.Ordinal)));
+                    }
+                }
+                else if (_length == _buffer.Length)
+                {
+                    if (Finish())
+                    {
+                        Reject(_client, "431 Request Header Fields Too Large");
+                    }
+                }
+                else
+                {
+                    Begin();
+                }
+            }
+        }
+    }
+
+    /// <summary>
+    /// What a client asked for in its query string; 0 leaves a value to the source or the server
+    /// </summary>
+    internal struct MjpegClientOptions
+    {
+        public int Width;
+        public int Height;
+        public int Quality;
+        public double FrameRate;
+
+        public static bool TryParse(string query, out MjpegClientOptions options)
+        {
+            options = new MjpegClientOptions();
+
+            foreach (string pair in query.Split(new[] { '&' }, StringSplitOptions.RemoveEmptyEntries))
+            {
+                int separator = pair.IndexOf('=');
+                if (separator <= 0)
+                    continue;
+
+                string key = pair.Substring(0, separator);
+                string value = pair.Substring(separator + 1);
+
+                bool valid = true;
+                switch (key.ToLowerInvariant())
+                {
+                    case "width":
+                        valid = Int32.TryParse(value, NumberStyles.None, CultureInfo.InvariantCulture, out options.Width) && options.Width > 0;
+                        break;
+
+                    case "height":
+                        valid = Int32.TryParse(value, NumberStyles.None, CultureInfo.InvariantCulture, out options.Height) && options.Height > 0;
+                        break;
+
+                    case "quality":
+                        valid = Int32.TryParse(value, NumberStyles.None, CultureInfo.InvariantCulture, out options.Quality) && options.Quality >= 1 && options.Quality <= 100;
+                        break;
+
+                    case "fps":
+                        valid = Double.TryParse(value, NumberStyles.AllowDecimalPoint, CultureInfo.InvariantCulture, out options.FrameRate) && options.FrameRate > 0;
+                        break;
+                }
+
+                if (!valid)
+                    return false;
+            }
+
+            return true;
+        }
+    }
+}
@@ -0,0 +1,418 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Drawing;
+using System.Drawing.Drawing2D;
+using System.Drawing.Imaging;
+using System.IO;
+using System.Net.Sockets;
+using System.Runtime.InteropServices;
+using System.Text;
+using System.Threading;
+using Touchless.Vision.Contracts;
+
+namespace Touchless.Vision.Streaming
+{
+    /// <summary>
+    /// The clients of one source of an <see cref="MjpegServer"/>. Frames are encoded on the thread
+    /// pool, never on the source's thread; a frame arriving while the previous one is still being
+    /// encoded replaces any frame waiting behind it. The stream holds its own reference to the frame
+    /// waiting and to the one being encoded, since the source releases its frame once handled.
+    /// </summary>
+    internal sealed class MjpegStream
+    {
+        private const string Boundary = "frame";
+
+        private static readonly byte[] ResponseHeader = Encoding.ASCII.GetBytes(
+            "HTTP/1.0 200 OK\r\n" +
+            "Content-Type: multipart/x-mixed-replace; boundary=" + Boundary + "\r\n" +
+            "Cache-Control: no-cache, no-store\r\n" +
+            "Pragma: no-cache\r\n" +
+            "Connection: close\r\n\r\n");
+
+        private static readonly ImageCodecInfo JpegCodec = FindJpegCodec();
+
+        private readonly object _syncObject = new object();
+        private readonly MjpegServer _server;
+        private readonly IFrameSource _source;
+        private volatile Client[] _clients = new Client[0];
+        private Frame _pendingFrame;
+        private int _encoding;
+        private long _framesEncoded;
+
+        public MjpegStream(MjpegServer server, IFrameSource source)
+        {
+            _server = server;
+            _source = source;
+            _source.NewFrame += OnNewFrame;
+        }
+
+        public int ClientCount
+        {
+            get { return _clients.Length; }
+        }
+
+        public long FramesEncoded
+        {
+            get { return Interlocked.Read(ref _framesEncoded); }
+        }
+
+        public void AddClient(TcpClient tcpClient, MjpegClientOptions options)
+        {
+            var client = new Client(this, tcpClient, options);
+
+            lock (_syncObject)
+            {
+                var clients = new Client[_clients.Length + 1];
+                _clients.CopyTo(clients, 0);
+                clients[clients.Length - 1] = client;
+                _clients = clients;
+            }
+
+            client.Begin();
+        }
+
+        public void CloseClients()
+        {
+            foreach (Client client in _clients)
+            {
+                client.Close();
+            }
+        }
+
+        public void Detach()
+        {
+            _source.NewFrame -= OnNewFrame;
+            CloseClients();
+
+            Frame pending = Interlocked.Exchange(ref _pendingFrame, null);
+            if (pending != null)
+            {
+                pending.Dispose();
+            }
+        }
+
+        private void RemoveClient(Client client)
+        {
+            lock (_syncObject)
+            {
+                var clients = new List<Client>(_clients);
+                if (clients.Remove(client))
+                {
+                    _clients = clients.ToArray();
+                }
+            }
+        }
+
+        private void OnNewFrame(IFrameSource source, Frame frame, double fps)
+        {
+            if (_clients.Length == 0)
+                return;
+
+            Frame replaced = Interlocked.Exchange(ref _pendingFrame, frame.AddReference());
+            if (replaced != null)
+            {
+                // Never encoded; a newer frame overtook it
+                replaced.Dispose();
+            }
+
+            if (Interlocked.CompareExchange(ref _encoding, 1, 0) == 0)
+            {
+                ThreadPool.QueueUserWorkItem(EncodePending);
+            }
+        }
+
+        private void EncodePending(object state)
+        {
+            for (;;)
+            {
+                Frame frame = Interlocked.Exchange(ref _pendingFrame, null);
+
+                if (frame == null)
+                {
+                    Interlocked.Exchange(ref _encoding, 0);
+
+                    // A frame stored after the exchange above saw the flag still set and left it to us
+                    if (Interlocked.CompareExchange(ref _pendingFrame, null, null) == null ||
+                        Interlocked.CompareExchange(ref _encoding, 1, 0) != 0)
+                        break;
+
+                    continue;
+                }
+
+                try
+                {
+                    Publish(frame);
+                }
+                finally
+                {
+                    frame.Dispose();
+                }
+            }
+        }
+
+        private void Publish(Frame frame)
+        {
+            Client[] clients = _clients;
+            long now = Stopwatch.GetTimestamp();
+            var parts = new List<EncodedPart>();
+            Bitmap image = null;
+
+            foreach (Client client in clients)
+            {
+                if (!client.TryBeginFrame(now))
+                    continue;
+
+                EncodedPart part = null;
+                try
+                {
+                    if (image == null)
+                    {
+                        image = frame.OriginalImage;
+                    }
+
+                    if (image != null)
+                    {
+                        Size size = client.GetSize(image.Size);
+                        int quality = client.Quality > 0 ? client.Quality : _server.Quality;
+
+                        // Clients asking for the same thing share one encoding
+                        part = parts.Find(p => p.Size == size && p.Quality == quality);
+                        if (part == null)
+                        {
+                            part = new EncodedPart(size, quality, EncodePart(image, size, quality));
+                            parts.Add(part);
+                            Interlocked.Increment(ref _framesEncoded);
+                        }
+                    }
+                }
+                catch (ExternalException)
+                {
+                    // GDI+ failed on this frame
+                }
+                catch (ArgumentException)
+                {
+                    // GDI+ rejected the image or the size asked for
+                }
+
+                if (part == null)
+                {
+                    // Leave this client, and the ones not offered the frame yet, ready for the next one
+                    client.CancelFrame();
+                    break;
+                }
+
+                client.Send(part.Data, now);
+            }
+        }
+
+        private static byte[] EncodePart(Bitmap image, Size size, int quality)
+        {
+            using (var jpeg = new MemoryStream())
+            using (var parameters = new EncoderParameters(1))
+            {
+                parameters.Param[0] = new EncoderParameter(System.Drawing.Imaging.Encoder.Quality, (long) quality);
+
+                if (size == image.Size)
+                {
+                    image.Save(jpeg, JpegCodec, parameters);
+                }
+                else
+                {
+                    using (var scaled = new Bitmap(size.Width, size.Height, PixelFormat.Format24bppRgb))
+                    {
+                        using (Graphics graphics = Graphics.FromImage(scaled))
+                        {
+                            graphics.InterpolationMode = InterpolationMode.Bilinear;
+                            graphics.PixelOffsetMode = PixelOffsetMode.HighSpeed;
+                            graphics.DrawImage(image, 0, 0, size.Width, size.Height);
+                        }
+
+                        scaled.Save(jpeg, JpegCodec, parameters);
+                    }
+                }
+
+                byte[] header = Encoding.ASCII.GetBytes(
+                    "--" + Boundary + "\r\n" +
+                    "Content-Type: image/jpeg\r\n" +
+                    "Content-Length: " + jpeg.Length + "\r\n\r\n");
+
+                // Header, image and trailing line in one buffer, so each client needs a single write
+                var result = new byte[header.Length + jpeg.Length + 2];
+                Buffer.BlockCopy(header, 0, result, 0, header.Length);
+                Buffer.BlockCopy(jpeg.GetBuffer(), 0, result, header.Length, (int) jpeg.Length);
+                result[result.Length - 2] = (byte) '\r';
+                result[result.Length - 1] = (byte) '\n';
+
+                return result;
+            }
+        }
+
+        private static ImageCodecInfo FindJpegCodec()
+        {
+            foreach (ImageCodecInfo codec in ImageCodecInfo.GetImageEncoders())
+            {
+                if (codec.FormatID == ImageFormat.Jpeg.Guid)
+                    return codec;
+            }
+
+            return null;
+        }
+
+        private sealed class EncodedPart
+        {
+            public EncodedPart(Size size, int quality, byte[] data)
+            {
+                Size = size;
+                Quality = quality;
+                Data = data;
+            }
+
+            public Size Size { get; private set; }
+
+            public int Quality { get; private set; }
+
+            public byte[] Data { get; private set; }
+        }
+
+        /// <summary>
+        /// One connected browser. At most one write is in flight; the socket completing it is the
+        /// backpressure signal, so a client is only offered a frame once it has taken the last one.
+        /// </summary>
+        private sealed class Client
+        {
+            private readonly MjpegStream _owner;
+            private readonly TcpClient _tcpClient;
+            private readonly MjpegClientOptions _options;
+            private readonly long _frameInterval;
+            private long _nextFrameTime;
+            private int _busy = 1;
+            private int _closed;
+
+            public Client(MjpegStream owner, TcpClient tcpClient, MjpegClientOptions options)
+            {
+                _owner = owner;
+                _tcpClient = tcpClient;
+                _options = options;
+                _frameInterval = options.FrameRate > 0 ? (long) (Stopwatch.Frequency / options.FrameRate) : 0;
+            }
+
+            public int Quality
+            {
+                get { return _options.Quality; }
+            }
+
+            /// <summary>
+            /// Writes the response header; the client takes frames once it has gone out
+            /// </summary>
+            public void Begin()
+            {
+                Write(ResponseHeader);
+            }
+
+            /// <summary>
+            /// Claims the client for a frame arriving now, unless it is still sending or over its frame rate
+            /// </summary>
+            public bool TryBeginFrame(long now)
+            {
+                if (now < _nextFrameTime)
+                    return false;
+
+                return Interlocked.CompareExchange(ref _busy, 1, 0) == 0;
+            }
+
+            /// <summary>
+            /// Releases a client claimed by TryBeginFrame without sending it anything
+            /// </summary>
+            public void CancelFrame()
+            {
+                Interlocked.Exchange(ref _busy, 0);
+            }
+
+            public void Send(byte[] data, long now)
+            {
+                if (_frameInterval > 0)
+                {
+                    // Do not save up for a burst after a stall
+                    _nextFrameTime = Math.Max(_nextFrameTime + _frameInterval, now);
+                }
+
+                Write(data);
+            }
+
+            /// <summary>
+            /// Output size for a source of the given size: as asked for, keeping the aspect ratio when
+            /// only one side is given, and never larger than the source
+            /// </summary>
+            public Size GetSize(Size source)
+            {
+                int width = _options.Width;
+                int height = _options.Height;
+
+                if (width == 0 && height == 0)
+                    return source;
+
+                if (width == 0)
+                {
+                    width = (int) Math.Round((double) height * source.Width / source.Height);
+                }
+                else if (height == 0)
+                {
+                    height = (int) Math.Round((double) width * source.Height / source.Width);
+                }
+
+                return new Size(Math.Max(1, Math.Min(width, source.Width)), Math.Max(1, Math.Min(height, source.Height)));
+            }
+
+            public void Close()
+            {
+                if (Interlocked.Exchange(ref _closed, 1) == 0)
+                {
+                    _tcpClient.Close();
+                    _owner.RemoveClient(this);
+                }
+            }
+
+            private void Write(byte[] data)
+            {
+                try
+                {
+                    _tcpClient.GetStream().BeginWrite(data, 0, data.Length, OnWritten, null);
+                }
+                catch (IOException)
+                {
+                    Close();
+                }
+                catch (ObjectDisposedException)
+                {
+                    Close();
+                }
+                catch (InvalidOperationException)
+                {
+                    Close();
+                }
+            }
+
+            private void OnWritten(IAsyncResult result)
+            {
+                try
+                {
+                    _tcpClient.GetStream().EndWrite(result);
+                    Interlocked.Exchange(ref _busy, 0);
+                }
+                catch (IOException)
+                {
+                    Close();
+                }
+                catch (ObjectDisposedException)
+                {
+                    Close();
+                }
+                catch (InvalidOperationException)
+                {
+                    Close();
+                }
+            }
+        }
+    }
+}
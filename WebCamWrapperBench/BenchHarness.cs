@@ -0,0 +1,85 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+
+namespace Touchless.Vision.Bench
+{
+    /// <summary>
+    /// Every measurement of one quantity in a run, summarised once the run is over
+    /// </summary>
+    internal class BenchSamples
+    {
+        private readonly List<double> _values = new List<double>();
+
+        public void Add(double value)
+        {
+            _values.Add(value);
+        }
+
+        public int Count
+        {
+            get { return _values.Count; }
+        }
+
+        /// <summary>
+        /// Zero when there are no samples
+        /// </summary>
+        public double Mean
+        {
+            get
+            {
+                if (_values.Count == 0)
+                    return 0.0;
+
+                double sum = 0.0;
+                foreach (double value in _values)
+                {
+                    sum += value;
+                }
+
+                return sum / _values.Count;
+            }
+        }
+
+        /// <summary>
+        /// Value below which the fraction of the samples fall, 0.5 for the median; zero when there are none
+        /// </summary>
+        public double GetPercentile(double fraction)
+        {
+            if (_values.Count == 0)
+                return 0.0;
+
+            List<double> sorted = new List<double>(_values);
+            sorted.Sort();
+
+            int index = (int)(fraction * (sorted.Count - 1) + 0.5);
+
+            return sorted[Math.Min(index, sorted.Count - 1)];
+        }
+    }
+
+    internal static class BenchHarness
+    {
+        public static double ToMilliseconds(long stopwatchTicks)
+        {
+            return stopwatchTicks * 1000.0 / Stopwatch.Frequency;
+        }
+
+        /// <summary>
+        /// Prints the title of a table and its column headings, each column 10 characters wide,
+        /// as the native WebCamBench does
+        /// </summary>
+        public static void PrintHeader(string title, params string[] columns)
+        {
+            Console.WriteLine();
+            Console.WriteLine(title);
+
+            foreach (string column in columns)
+            {
+                Console.Write("{0,10}", column);
+            }
+
+            Console.WriteLine();
+        }
+    }
+}
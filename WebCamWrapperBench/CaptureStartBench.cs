@@ -0,0 +1,154 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading;
+using Touchless.Vision.Camera;
+using Touchless.Vision.Contracts;
+using WebCamLib;
+
+namespace Touchless.Vision.Bench
+{
+    /// <summary>
+    /// Starts the default camera over and over with KeepSessionWarm set: cold after the warm graph was
+    /// released, resumed with the format it had, and reconnected for another capture size. Reports the
+    /// time each path took in StartCapture, from LastStartKind and LastStartDuration, and the time until
+    /// its first frame arrived. Needs a camera offering at least two capture sizes.
+    /// </summary>
+    internal static class CaptureStartBench
+    {
+        // Cycles of cold start, resume and format change; a cold start takes around a second,
+        // so the seconds per pass are not used
+        private const int Cycles = 5;
+
+        private const int FirstFrameTimeout = 5000;
+
+        private static readonly CaptureStartKind[] Kinds = { CaptureStartKind.Cold, CaptureStartKind.Resume, CaptureStartKind.FormatChange };
+        private static readonly string[] KindNames = { "cold", "resume", "format" };
+
+        public static void Run(double seconds)
+        {
+            BenchHarness.PrintHeader("Capture start of the default camera, KeepSessionWarm set; ms in StartCapture and until the first frame",
+                "Kind", "Starts", "Start p50", "Start max", "Frame p50", "Frame max", "Missed");
+
+            Camera.Camera camera = CameraService.DefaultCamera;
+            if (camera == null)
+            {
+                Console.WriteLine("No camera found.");
+                return;
+            }
+
+            CaptureSize first;
+            CaptureSize second;
+            if (!PickSizes(camera, out first, out second))
+            {
+                Console.WriteLine("{0} offers fewer than two capture sizes.", camera.Name);
+                return;
+            }
+
+            var startTime = new Dictionary<CaptureStartKind, BenchSamples>();
+            var frameTime = new Dictionary<CaptureStartKind, BenchSamples>();
+            var missed = new Dictionary<CaptureStartKind, int>();
+
+            foreach (CaptureStartKind kind in Kinds)
+            {
+                startTime[kind] = new BenchSamples();
+                frameTime[kind] = new BenchSamples();
+                missed[kind] = 0;
+            }
+
+            var source = new CameraFrameSource(camera);
+            var firstFrame = new ManualResetEvent(false);
+            Action<IFrameSource, Frame, double> onFrame = delegate { firstFrame.Set(); };
+            source.NewFrame += onFrame;
+
+            try
+            {
+                for (int cycle = 0; cycle < Cycles; cycle++)
+                {
+                    // Clearing KeepSessionWarm releases the graph, so the next start is cold
+                    camera.KeepSessionWarm = false;
+                    camera.KeepSessionWarm = true;
+
+                    foreach (CaptureSize size in new[] { first, first, second })
+                    {
+                        camera.CaptureWidth = size.Width;
+                        camera.CaptureHeight = size.Height;
+
+                        firstFrame.Reset();
+                        long started = Stopwatch.GetTimestamp();
+
+                        if (!source.StartFrameCapture())
+                        {
+                            Console.WriteLine("{0} did not start at {1}.", camera.Name, size);
+                            return;
+                        }
+
+                        bool arrived = firstFrame.WaitOne(FirstFrameTimeout);
+                        long frameTicks = Stopwatch.GetTimestamp() - started;
+
+                        CaptureStartKind kind = camera.LastStartKind;
+                        source.StopFrameCapture();
+
+                        if (!startTime.ContainsKey(kind))
+                            continue;
+
+                        startTime[kind].Add(camera.LastStartDuration);
+
+                        if (arrived)
+                            frameTime[kind].Add(BenchHarness.ToMilliseconds(frameTicks));
+                        else
+                            missed[kind]++;
+                    }
+                }
+            }
+            finally
+            {
+                source.StopFrameCapture();
+                source.NewFrame -= onFrame;
+                camera.KeepSessionWarm = false;
+                firstFrame.Close();
+            }
+
+            for (int n = 0; n < Kinds.Length; n++)
+            {
+                CaptureStartKind kind = Kinds[n];
+
+                Console.WriteLine("{0,10}{1,10}{2,10:F1}{3,10:F1}{4,10:F1}{5,10:F1}{6,10}",
+                    KindNames[n],
+                    startTime[kind].Count,
+                    startTime[kind].GetPercentile(0.5),
+                    startTime[kind].GetPercentile(1.0),
+                    frameTime[kind].GetPercentile(0.5),
+                    frameTime[kind].GetPercentile(1.0),
+                    missed[kind]);
+            }
+        }
+
+        /// <summary>
+        /// The camera's 640x480, or its first size, and another size to change to
+        /// </summary>
+        private static bool PickSizes(Camera.Camera camera, out CaptureSize first, out CaptureSize second)
+        {
+            IList<CaptureSize> sizes = camera.CaptureSizes;
+            first = null;
+            second = null;
+
+            foreach (CaptureSize size in sizes)
+            {
+                if (first == null || (size.Width == 640 && size.Height == 480))
+                    first = size;
+            }
+
+            foreach (CaptureSize size in sizes)
+            {
+                if (first != null && (size.Width != first.Width || size.Height != first.Height))
+                {
+                    second = size;
+                    break;
+                }
+            }
+
+            return second != null;
+        }
+    }
+}
@@ -0,0 +1,165 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using Touchless.Vision.Capture;
+
+namespace Touchless.Vision.Bench
+{
+    /// <summary>
+    /// Feeds a MultiCameraGroup the frames of synthetic sources whose clocks are offset, run at other
+    /// rates, jitter, drop frames and deliver them late, in the order their delivery puts them in, and
+    /// checks that no set it emits spans more than its Tolerance. Reports the sets made, their spread and the frames
+    /// left unmatched. Time is scripted, so the seconds per pass are not used.
+    /// </summary>
+    internal static class FrameSkewBench
+    {
+        private const double ToleranceMilliseconds = 10.0;
+
+        // Half a minute of a 30 frames per second camera
+        private const double Duration = 30.0;
+
+        // Frames reach the group up to this late, so sources interleave out of timestamp order
+        private const double DeliveryDelay = 5.0;
+
+        private const int Width = 16;
+        private const int Height = 16;
+
+        private const int Seed = 20140301;
+
+        private sealed class SkewScenario
+        {
+            public readonly string Name;
+            public readonly double[] FrameRates;
+            public readonly double[] Offsets;
+            public readonly double[] Latencies;
+            public readonly double Jitter;
+            public readonly double DropRate;
+
+            /// <summary>
+            /// One rate, clock offset in ms and delivery latency in ms per source; timestamps jitter by
+            /// up to Jitter ms either way, and each frame is lost with the probability DropRate
+            /// </summary>
+            public SkewScenario(string name, double[] frameRates, double[] offsets, double[] latencies, double jitter, double dropRate)
+            {
+                Name = name;
+                FrameRates = frameRates;
+                Offsets = offsets;
+                Latencies = latencies;
+                Jitter = jitter;
+                DropRate = dropRate;
+            }
+        }
+
+        private struct FrameEvent
+        {
+            public int Source;
+            public long Timestamp;
+            public double Arrival;
+        }
+
+        private static readonly SkewScenario[] Scenarios =
+        {
+            new SkewScenario("aligned", new[] { 30.0, 30.0 }, new[] { 0.0, 0.0 }, new[] { 0.0, 0.0 }, 1.0, 0.0),
+            new SkewScenario("skew 7 ms", new[] { 30.0, 30.0 }, new[] { 0.0, 7.0 }, new[] { 0.0, 0.0 }, 1.0, 0.0),
+            new SkewScenario("half frame", new[] { 30.0, 30.0 }, new[] { 0.0, 16.7 }, new[] { 0.0, 0.0 }, 1.0, 0.0),
+            new SkewScenario("half late", new[] { 30.0, 30.0 }, new[] { 0.0, 16.7 }, new[] { 40.0, 0.0 }, 1.0, 0.0),
+            new SkewScenario("late", new[] { 30.0, 30.0 }, new[] { 0.0, 3.0 }, new[] { 40.0, 0.0 }, 2.0, 0.0),
+            new SkewScenario("30 and 25", new[] { 30.0, 25.0 }, new[] { 0.0, 0.0 }, new[] { 0.0, 0.0 }, 1.0, 0.0),
+            new SkewScenario("drift", new[] { 30.0, 29.9 }, new[] { 0.0, 0.0 }, new[] { 0.0, 25.0 }, 1.0, 0.0),
+            new SkewScenario("drops", new[] { 30.0, 30.0 }, new[] { 0.0, 3.0 }, new[] { 0.0, 0.0 }, 2.0, 0.1),
+            new SkewScenario("jitter", new[] { 30.0, 30.0, 30.0 }, new[] { 0.0, 4.0, -4.0 }, new[] { 0.0, 20.0, 40.0 }, 4.0, 0.0),
+            new SkewScenario("three", new[] { 30.0, 30.0, 15.0 }, new[] { 0.0, 5.0, 2.0 }, new[] { 30.0, 0.0, 60.0 }, 2.0, 0.05),
+        };
+
+        public static void Run(double seconds)
+        {
+            BenchHarness.PrintHeader(String.Format(CultureInfo.InvariantCulture, "Frame sets of sources with skewed clocks, Tolerance {0} ms; spread in ms, Over counts sets wider than the tolerance", ToleranceMilliseconds),
+                "Scenario", "Frames", "Sets", "p50 ms", "max ms", "Over", "Unmatched", "Within");
+
+            foreach (SkewScenario scenario in Scenarios)
+            {
+                RunScenario(scenario);
+            }
+        }
+
+        private static void RunScenario(SkewScenario scenario)
+        {
+            var random = new Random(Seed);
+            var sources = new SyntheticFrameSource[scenario.FrameRates.Length];
+            var events = new List<FrameEvent>();
+
+            // Well clear of 0, which the group takes for no time at all
+            long start = Stopwatch.Frequency * 1000;
+
+            for (int i = 0; i < sources.Length; i++)
+            {
+                sources[i] = new SyntheticFrameSource("skew " + i, Width, Height, scenario.FrameRates[i]);
+
+                int count = (int) (Duration * scenario.FrameRates[i]);
+                for (int n = 0; n < count; n++)
+                {
+                    if (random.NextDouble() < scenario.DropRate)
+                        continue;
+
+                    double time = n * 1000.0 / scenario.FrameRates[i] + scenario.Offsets[i] + (random.NextDouble() * 2.0 - 1.0) * scenario.Jitter;
+
+                    var frameEvent = new FrameEvent();
+                    frameEvent.Source = i;
+                    frameEvent.Timestamp = start + ToTicks(time);
+                    frameEvent.Arrival = time + scenario.Latencies[i] + random.NextDouble() * DeliveryDelay;
+                    events.Add(frameEvent);
+                }
+            }
+
+            events.Sort((a, b) => a.Arrival.CompareTo(b.Arrival));
+
+            long tolerance = ToTicks(ToleranceMilliseconds);
+            var spread = new BenchSamples();
+            int over = 0;
+            long unmatched = 0;
+
+            using (var group = new MultiCameraGroup(sources))
+            {
+                group.Tolerance = TimeSpan.FromMilliseconds(ToleranceMilliseconds);
+                group.FrameSetReady += delegate(MultiCameraGroup sender, FrameSet frameSet)
+                {
+                    using (frameSet)
+                    {
+                        spread.Add(BenchHarness.ToMilliseconds(frameSet.Spread));
+
+                        if (frameSet.Spread > tolerance)
+                        {
+                            over++;
+                        }
+                    }
+                };
+
+                foreach (FrameEvent frameEvent in events)
+                {
+                    sources[frameEvent.Source].Raise(frameEvent.Timestamp);
+                }
+
+                foreach (SyntheticFrameSource source in sources)
+                {
+                    unmatched += group.GetUnmatchedFrames(source);
+                }
+            }
+
+            Console.WriteLine("{0,10}{1,10}{2,10}{3,10:F2}{4,10:F2}{5,10}{6,10}{7,10}",
+                scenario.Name,
+                events.Count,
+                spread.Count,
+                spread.GetPercentile(0.5),
+                spread.GetPercentile(1.0),
+                over,
+                unmatched,
+                over == 0 ? "yes" : "NO");
+        }
+
+        private static long ToTicks(double milliseconds)
+        {
+            return (long) (milliseconds * Stopwatch.Frequency / 1000.0);
+        }
+    }
+}
@@ -0,0 +1,328 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using System.Net;
+using System.Net.Sockets;
+using System.Text;
+using System.Threading;
+using Touchless.Vision.Streaming;
+
+namespace Touchless.Vision.Bench
+{
+    /// <summary>
+    /// Serves a synthetic 640x480 source at 30 frames per second from an MjpegServer on localhost to
+    /// hundreds of clients at once, each reading its stream as fast as it comes, and reports the frames
+    /// per second delivered to each client and the CPU the process used. The clients only parse the part
+    /// headers, so nearly all of that CPU is the server's. A last pass opens connections which never send
+    /// a request and times how long the server takes to close them.
+    /// </summary>
+    internal static class MjpegLoadBench
+    {
+        private const int Width = 640;
+        private const int Height = 480;
+        private const double FrameRate = 30.0;
+
+        private const int WarmUp = 1000;
+
+        private const int IdleClients = 50;
+        private const int IdleTimeout = 1000;
+
+        private static readonly int[] ClientCounts = { 1, 100, 200, 400 };
+
+        public static void Run(double seconds)
+        {
+            BenchHarness.PrintHeader("MJPEG server on localhost, one 640x480 source at 30 fps; frames per second delivered to each client and CPU % of all cores",
+                "Clients", "Streaming", "Encoded", "fps p50", "fps min", "fps max", "CPU %");
+
+            foreach (int count in ClientCounts)
+            {
+                RunLoadPass(count, seconds);
+            }
+
+            BenchHarness.PrintHeader(String.Format(CultureInfo.InvariantCulture, "Connections which never send a request, RequestTimeout {0} ms; ms until the server closed them", IdleTimeout),
+                "Clients", "Closed", "Close p50", "Close max");
+
+            RunIdlePass();
+        }
+
+        private static void RunLoadPass(int count, double seconds)
+        {
+            var source = new SyntheticFrameSource("bench", Width, Height, FrameRate);
+            var clients = new List<LoadClient>();
+
+            using (var server = new MjpegServer(IPAddress.Loopback, 0))
+            {
+                server.AddSource("bench", source);
+                server.Start();
+                source.StartFrameCapture();
+
+                try
+                {
+                    for (int i = 0; i < count; i++)
+                    {
+                        clients.Add(LoadClient.Connect(server.LocalEndpoint, "GET /bench HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+                    }
+
+                    Thread.Sleep(WarmUp);
+
+                    Process process = Process.GetCurrentProcess();
+                    var framesBefore = new long[count];
+
+                    for (int i = 0; i < count; i++)
+                    {
+                        framesBefore[i] = clients[i].Frames;
+                    }
+
+                    long encodedBefore = server.FramesEncoded;
+                    TimeSpan cpuBefore = process.TotalProcessorTime;
+                    long started = Stopwatch.GetTimestamp();
+
+                    Thread.Sleep((int) (seconds * 1000.0));
+
+                    double elapsed = BenchHarness.ToMilliseconds(Stopwatch.GetTimestamp() - started) / 1000.0;
+                    process.Refresh();
+                    double cpu = (process.TotalProcessorTime - cpuBefore).TotalSeconds / elapsed / Environment.ProcessorCount * 100.0;
+
+                    var fps = new BenchSamples();
+                    for (int i = 0; i < count; i++)
+                    {
+                        fps.Add((clients[i].Frames - framesBefore[i]) / elapsed);
+                    }
+
+                    Console.WriteLine("{0,10}{1,10}{2,10:F1}{3,10:F1}{4,10:F1}{5,10:F1}{6,10:F1}",
+                        count,
+                        server.ClientCount,
+                        (server.FramesEncoded - encodedBefore) / elapsed,
+                        fps.GetPercentile(0.5),
+                        fps.GetPercentile(0.0),
+                        fps.GetPercentile(1.0),
+                        cpu);
+                }
+                finally
+                {
+                    foreach (LoadClient client in clients)
+                    {
+                        client.Close();
+                    }
+
+                    source.StopFrameCapture();
+                }
+            }
+        }
+
+        private static void RunIdlePass()
+        {
+            var clients = new List<LoadClient>();
+
+            using (var server = new MjpegServer(IPAddress.Loopback, 0))
+            {
+                server.RequestTimeout = IdleTimeout;
+                server.Start();
+
+                try
+                {
+                    long started = Stopwatch.GetTimestamp();
+
+                    for (int i = 0; i < IdleClients; i++)
+                    {
+                        clients.Add(LoadClient.Connect(server.LocalEndpoint, null));
+                    }
+
+                    // Twice the deadline is plenty; any still open then are counted as not closed
+                    Thread.Sleep(2 * IdleTimeout);
+
+                    var closeTime = new BenchSamples();
+                    foreach (LoadClient client in clients)
+                    {
+                        if (client.ClosedAt != 0)
+                        {
+                            closeTime.Add(BenchHarness.ToMilliseconds(client.ClosedAt - started));
+                        }
+                    }
+
+                    Console.WriteLine("{0,10}{1,10}{2,10:F0}{3,10:F0}",
+                        IdleClients,
+                        closeTime.Count,
+                        closeTime.GetPercentile(0.5),
+                        closeTime.GetPercentile(1.0));
+                }
+                finally
+                {
+                    foreach (LoadClient client in clients)
+                    {
+                        client.Close();
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Client reading an MJPEG stream asynchronously, counting each part whose body it received
+        /// in full and skipping the bodies without looking at them
+        /// </summary>
+        private sealed class LoadClient
+        {
+            private readonly TcpClient _client;
+            private readonly byte[] _buffer = new byte[64 * 1024];
+            private readonly StringBuilder _header = new StringBuilder();
+            private int _remaining;
+            private long _frames;
+            private long _closedAt;
+
+            private LoadClient(TcpClient client)
+            {
+                _client = client;
+            }
+
+            /// <summary>
+            /// Parts received in full so far
+            /// </summary>
+            public long Frames
+            {
+                get { return Interlocked.Read(ref _frames); }
+            }
+
+            /// <summary>
+            /// Stopwatch ticks when the server closed the connection, 0 while it is open
+            /// </summary>
+            public long ClosedAt
+            {
+                get { return Interlocked.Read(ref _closedAt); }
+            }
+
+            /// <summary>
+            /// Connects and sends the request, or nothing at all when it is null
+            /// </summary>
+            public static LoadClient Connect(IPEndPoint endpoint, string request)
+            {
+                var tcpClient = new TcpClient();
+                tcpClient.Connect(endpoint);
+
+                if (request != null)
+                {
+                    byte[] bytes = Encoding.ASCII.GetBytes(request);
+                    tcpClient.GetStream().Write(bytes, 0, bytes.Length);
+                }
+
+                var client = new LoadClient(tcpClient);
+                client.BeginRead();
+
+                return client;
+            }
+
+            public void Close()
+            {
+                _client.Close();
+            }
+
+            private void BeginRead()
+            {
+                try
+                {
+                    _client.GetStream().BeginRead(_buffer, 0, _buffer.Length, OnRead, null);
+                }
+                catch (IOException)
+                {
+                    OnClosed();
+                }
+                catch (ObjectDisposedException)
+                {
+                    OnClosed();
+                }
+                catch (InvalidOperationException)
+                {
+                    OnClosed();
+                }
+            }
+
+            private void OnRead(IAsyncResult result)
+            {
+                int read;
+
+                try
+                {
+                    read = _client.GetStream().EndRead(result);
+                }
+                catch (IOException)
+                {
+                    read = 0;
+                }
+                catch (ObjectDisposedException)
+                {
+                    read = 0;
+                }
+                catch (InvalidOperationException)
+                {
+                    read = 0;
+                }
+
+                if (read == 0)
+                {
+                    OnClosed();
+                    return;
+                }
+
+                Consume(read);
+                BeginRead();
+            }
+
+            private void OnClosed()
+            {
+                Interlocked.CompareExchange(ref _closedAt, Stopwatch.GetTimestamp(), 0);
+            }
+
+            private void Consume(int count)
+            {
+                int offset = 0;
+
+                while (offset < count)
+                {
+                    if (_remaining > 0)
+                    {
+                        int skipped = Math.Min(_remaining, count - offset);
+
+                        offset += skipped;
+                        _remaining -= skipped;
+
+                        if (_remaining == 0)
+                        {
+                            Interlocked.Increment(ref _frames);
+                        }
+
+                        continue;
+                    }
+
+                    _header.Append((char) _buffer[offset++]);
+
+                    int length = _header.Length;
+                    if (length >= 4 && _header[length - 4] == '\r' && _header[length - 3] == '\n' && _header[length - 2] == '\r' && _header[length - 1] == '\n')
+                    {
+                        // The response header has no length; each part header has that of its JPEG image
+                        _remaining = GetContentLength(_header.ToString());
+                        _header.Length = 0;
+                    }
+                }
+            }
+
+            private static int GetContentLength(string header)
+            {
+                const string Name = "Content-Length:";
+
+                foreach (string line in header.Split(new[] { "\r\n" }, StringSplitOptions.RemoveEmptyEntries))
+                {
+                    int length;
+
+                    if (line.StartsWith(Name, StringComparison.OrdinalIgnoreCase)
+                        && int.TryParse(line.Substring(Name.Length).Trim(), NumberStyles.None, CultureInfo.InvariantCulture, out length))
+                    {
+                        return length;
+                    }
+                }
+
+                return 0;
+            }
+        }
+    }
+}
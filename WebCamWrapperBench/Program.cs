@@ -0,0 +1,88 @@
+﻿using System;
+using System.Globalization;
+using Touchless.Vision.Camera;
+
+namespace Touchless.Vision.Bench
+{
+    /// <summary>
+    /// Runs the benchmarks of the managed wrapper from the command line:
+    ///     WebCamWrapperBench [suite] [seconds per pass]
+    /// Native kernels are measured by WebCamBench; these suites need the wrapper's managed types.
+    /// </summary>
+    internal static class Program
+    {
+        private const double DefaultSeconds = 2.0;
+
+        private struct BenchSuite
+        {
+            public string Name;
+            public string Description;
+            public Action<double> Run;
+
+            public BenchSuite(string name, string description, Action<double> run)
+            {
+                Name = name;
+                Description = description;
+                Run = run;
+            }
+        }
+
+        private static readonly BenchSuite[] Suites =
+        {
+            new BenchSuite("start", "cold start, warm resume and format change of the default camera", CaptureStartBench.Run),
+            new BenchSuite("mjpeg", "MJPEG server delivery and CPU with hundreds of localhost clients", MjpegLoadBench.Run),
+            new BenchSuite("skew", "frame sets of sources with skewed clocks stay within the tolerance", FrameSkewBench.Run),
+        };
+
+        private static void PrintUsage()
+        {
+            Console.WriteLine("WebCamWrapperBench [suite] [seconds per pass]");
+            Console.WriteLine();
+            Console.WriteLine("Suites, all of them when none is given:");
+
+            foreach (BenchSuite suite in Suites)
+            {
+                Console.WriteLine("  {0,-10} {1}", suite.Name, suite.Description);
+            }
+        }
+
+        [STAThread]
+        private static int Main(string[] args)
+        {
+            string name = args.Length > 0 ? args[0] : null;
+            double seconds = DefaultSeconds;
+
+            if (args.Length > 1 && (!double.TryParse(args[1], NumberStyles.Float, CultureInfo.InvariantCulture, out seconds) || seconds <= 0.0))
+            {
+                PrintUsage();
+                return 1;
+            }
+
+            bool found = false;
+
+            try
+            {
+                foreach (BenchSuite suite in Suites)
+                {
+                    if (name == null || string.Equals(name, suite.Name, StringComparison.OrdinalIgnoreCase))
+                    {
+                        suite.Run(seconds);
+                        found = true;
+                    }
+                }
+            }
+            finally
+            {
+                CameraService.Dispose();
+            }
+
+            if (!found)
+            {
+                PrintUsage();
+                return 1;
+            }
+
+            return 0;
+        }
+    }
+}
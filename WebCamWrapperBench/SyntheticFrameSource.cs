@@ -0,0 +1,182 @@
+﻿using System;
+using System.Diagnostics;
+using System.Drawing;
+using System.Drawing.Imaging;
+using System.Runtime.InteropServices;
+using System.Threading;
+using System.Windows;
+using Touchless.Vision.Contracts;
+
+namespace Touchless.Vision.Bench
+{
+    /// <summary>
+    /// Frame source with no camera behind it: raises a moving test pattern at a fixed rate from its own
+    /// thread, so the suites of the streaming and capture layers run anywhere and measure only those layers.
+    /// A suite which scripts the timing itself leaves capture stopped and calls <see cref="Raise"/>.
+    /// </summary>
+    internal sealed class SyntheticFrameSource : IFrameSource
+    {
+        private readonly string _name;
+        private readonly int _width;
+        private readonly int _height;
+        private readonly double _frameRate;
+        private readonly byte[] _pixels;
+        private readonly int _stride;
+        private Thread _thread;
+        private volatile bool _running;
+
+        public SyntheticFrameSource(string name, int width, int height, double frameRate)
+        {
+            if (width <= 0) throw new ArgumentOutOfRangeException("width");
+            if (height <= 0) throw new ArgumentOutOfRangeException("height");
+            if (frameRate <= 0.0) throw new ArgumentOutOfRangeException("frameRate");
+
+            _name = name;
+            _width = width;
+            _height = height;
+            _frameRate = frameRate;
+            _stride = (width * 3 + 3) & ~3;
+            _pixels = new byte[_stride * height];
+        }
+
+        public event Action<IFrameSource, Frame, double> NewFrame;
+
+        public string Name
+        {
+            get { return _name; }
+        }
+
+        public string Description
+        {
+            get { return "Synthetic test pattern"; }
+        }
+
+        public bool HasConfiguration
+        {
+            get { return false; }
+        }
+
+        public UIElement ConfigurationElement
+        {
+            get { return null; }
+        }
+
+        /// <summary>
+        /// Frames raised so far
+        /// </summary>
+        public long FrameCount { get; private set; }
+
+        public bool StartFrameCapture()
+        {
+            if (_running)
+                return true;
+
+            _running = true;
+            _thread = new Thread(Run) { IsBackground = true, Name = "Synthetic source " + _name };
+            _thread.Start();
+
+            return true;
+        }
+
+        public void StopFrameCapture()
+        {
+            if (!_running)
+                return;
+
+            _running = false;
+            _thread.Join();
+            _thread = null;
+        }
+
+        /// <summary>
+        /// Raises the next frame on the calling thread, stamped with the given Stopwatch ticks
+        /// </summary>
+        public void Raise(long timestamp)
+        {
+            if (_running) throw new InvalidOperationException("The source is capturing on its own thread.");
+
+            using (var bitmap = new Bitmap(_width, _height, PixelFormat.Format24bppRgb))
+            {
+                RaiseFrame(bitmap, timestamp);
+            }
+        }
+
+        private void Run()
+        {
+            long interval = (long) (Stopwatch.Frequency / _frameRate);
+            long due = Stopwatch.GetTimestamp();
+
+            using (var bitmap = new Bitmap(_width, _height, PixelFormat.Format24bppRgb))
+            {
+                while (_running)
+                {
+                    long wait = due - Stopwatch.GetTimestamp();
+                    if (wait > 0)
+                    {
+                        Thread.Sleep((int) Math.Ceiling(BenchHarness.ToMilliseconds(wait)));
+                        continue;
+                    }
+
+                    RaiseFrame(bitmap, due);
+
+                    // A frame raised late does not make the next ones early
+                    due = Math.Max(due + interval, Stopwatch.GetTimestamp() - interval);
+                }
+            }
+        }
+
+        private void RaiseFrame(Bitmap bitmap, long timestamp)
+        {
+            DrawPattern(bitmap, FrameCount);
+
+            using (var frame = new Frame(bitmap))
+            {
+                frame.Timestamp = timestamp;
+
+                Action<IFrameSource, Frame, double> handler = NewFrame;
+                if (handler != null)
+                {
+                    handler(this, frame, _frameRate);
+                }
+            }
+
+            FrameCount++;
+        }
+
+        /// <summary>
+        /// Diagonal bands scrolling one pixel per frame over a vertical ramp, so each frame differs from
+        /// the last throughout and the JPEG encoder has detail to work on
+        /// </summary>
+        private void DrawPattern(Bitmap bitmap, long frameNumber)
+        {
+            for (int y = 0; y < _height; y++)
+            {
+                int row = y * _stride;
+                byte ramp = (byte) (y * 255 / _height);
+
+                for (int x = 0; x < _width; x++)
+                {
+                    byte band = (byte) (((x + y + frameNumber) & 63) << 2);
+
+                    _pixels[row + x * 3] = band;
+                    _pixels[row + x * 3 + 1] = ramp;
+                    _pixels[row + x * 3 + 2] = (byte) (band ^ ramp);
+                }
+            }
+
+            BitmapData data = bitmap.LockBits(new Rectangle(0, 0, _width, _height), ImageLockMode.WriteOnly, PixelFormat.Format24bppRgb);
+
+            try
+            {
+                for (int y = 0; y < _height; y++)
+                {
+                    Marshal.Copy(_pixels, y * _stride, data.Scan0 + y * data.Stride, _width * 3);
+                }
+            }
+            finally
+            {
+                bitmap.UnlockBits(data);
+            }
+        }
+    }
+}